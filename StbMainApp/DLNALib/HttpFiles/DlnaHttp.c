@@ -102,10 +102,10 @@ int DH_AddHeader_Range(struct packetheader* http_headers, int first_byte_pos, in
 	return retval;
 }
 
-int DH_AddHeader_ContentRange(struct packetheader* http_headers, size_t first_byte_pos, size_t last_byte_pos, long instance_length)
+int DH_AddHeader_ContentRange(struct packetheader* http_headers, long long first_byte_pos, long long last_byte_pos, long long instance_length)
 {
 	char h[255];
-	int hLen = sprintf(h,"bytes %ld-%ld/%ld",(long)first_byte_pos,(long)last_byte_pos,instance_length);
+	int hLen = sprintf(h,"bytes %lld-%lld/%lld",first_byte_pos,last_byte_pos,instance_length);
 
 	ILibAddHeaderLine(http_headers,"Content-Range",13,h,hLen);
 
@@ -218,7 +218,7 @@ void* DH_GetUserObject(DH_TransferStatus transfer_status_handle)
 	return NULL;
 }
 
-void DH_QueryTransferStatus(DH_TransferStatus transfer_status_handle, long* send_total, long* send_expected, long* receive_total, long* receive_expected)
+void DH_QueryTransferStatus(DH_TransferStatus transfer_status_handle, long long* send_total, long long* send_expected, long long* receive_total, long long* receive_expected)
 {
 	sem_wait(&(transfer_status_handle->syncLock));
 	if(send_total!=NULL){*send_total = transfer_status_handle->ActualBytesSent;}
@@ -123,10 +123,10 @@
 struct DH_TransferStatus_StateObject
 {
 	sem_t syncLock;
-	long TotalBytesToBeSent;
-	long ActualBytesSent;
-	long TotalBytesToBeReceived;
-	long ActualBytesReceived;
+	long long TotalBytesToBeSent;
+	long long ActualBytesSent;
+	long long TotalBytesToBeReceived;
+	long long ActualBytesReceived;
 	void *RequestToken;
 	void *ServerSession;
 	int SessionFlag;
@@ -319,7 +319,7 @@ int DH_AddHeader_Range(struct packetheader* http_headers, int first_byte_pos, in
 		- Negative: The header was not applied because it would cause an overrun 
 		beyond \ref DH_MAX_HTTP_HEADER_SIZE.
 */
-int DH_AddHeader_ContentRange(struct packetheader* http_headers, size_t first_byte_pos, size_t last_byte_pos, long instance_length);
+int DH_AddHeader_ContentRange(struct packetheader* http_headers, long long first_byte_pos, long long last_byte_pos, long long instance_length);
 
 /*!	\brief Adds the <b>TimeSeekRange.dlna.org</b> HTTP header to a set of HTTP headers.
 	
@@ -754,7 +754,7 @@ void* DH_GetUserObject(DH_TransferStatus transfer_status_handle);
 	\param[in,out] receive_total The number of entity-body bytes that have been received.
 	\param[in,out] receive_expected The total number of entity-body bytes that expect to be received.
 */
-void DH_QueryTransferStatus(DH_TransferStatus transfer_status_handle, long* send_total, long* send_expected, long* receive_total, long* receive_expected);
+void DH_QueryTransferStatus(DH_TransferStatus transfer_status_handle, long long* send_total, long long* send_expected, long long* receive_total, long long* receive_expected);
 void DH_AbortTransfer(DH_TransferStatus transfer_status_handle);
 
 /*! \} */
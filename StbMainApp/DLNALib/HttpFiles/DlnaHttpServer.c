@@ -48,7 +48,10 @@
 struct DH_Data
 {
 	FILE *f;
-	long BytesLeft;
+	void *source;
+	long long BytesLeft;
+	long long Position;
+	int SendFile;
 
 	struct packetheader *header;
 	struct ILibWebServer_Session *session;
@@ -65,6 +68,75 @@ struct DH_Data
 };
 
 void DH_Pool(ILibThreadPool,void*);
+#if defined(_POSIX)
+void DH_Pool_SendFile(ILibThreadPool,void*);
+#endif
+
+//
+// Default file reader, plain stdio
+//
+static void* DH_FileOpen(const char *file_name)
+{
+	return fopen(file_name,"rb");
+}
+#if defined(_POSIX)
+#define DH_fseek fseeko
+#define DH_ftell ftello
+#elif defined(WIN32)
+#define DH_fseek _fseeki64
+#define DH_ftell _ftelli64
+#else
+#define DH_fseek fseek
+#define DH_ftell ftell
+#endif
+static long long DH_FileLength(void *source)
+{
+	long long length;
+
+	DH_fseek((FILE*)source,0,SEEK_END);
+	length = DH_ftell((FILE*)source);
+	DH_fseek((FILE*)source,0,SEEK_SET);
+	return length;
+}
+static int DH_FileSeek(void *source, long long offset)
+{
+	return DH_fseek((FILE*)source,offset,SEEK_SET);
+}
+static int DH_FileRead(void *source, char *buffer, int size)
+{
+	return (int)fread(buffer,sizeof(char),size,(FILE*)source);
+}
+static void DH_FileClose(void *source)
+{
+	fclose((FILE*)source);
+}
+#if defined(_POSIX)
+static int DH_FileGetFile(void *source, long long position, long long *offset, long *length)
+{
+	*offset = position;
+	return fileno((FILE*)source);
+}
+#endif
+
+static const struct DHS_FileReader DH_StdioReader =
+{
+	&DH_FileOpen,
+	&DH_FileLength,
+	&DH_FileSeek,
+	&DH_FileRead,
+	&DH_FileClose,
+#if defined(_POSIX)
+	&DH_FileGetFile
+#else
+	NULL
+#endif
+};
+static const struct DHS_FileReader *DH_Reader = &DH_StdioReader;
+
+void DHS_SetFileReader(const struct DHS_FileReader *reader)
+{
+	DH_Reader = reader!=NULL ? reader : &DH_StdioReader;
+}
 
 void DH_UpdateProtocolInfoOptions(struct DLNAProtocolInfo *inputInfo)
 {
@@ -105,6 +177,16 @@ void DH_SendOK(struct ILibWebServer_Session *session)
 	struct DH_Data *data = (struct DH_Data*)session->User3;
 
 	session->OnSendOK = NULL;
+#if defined(_POSIX)
+	if(data->SendFile!=0)
+	{
+		//
+		// Nothing to read, queue the next range right from the chain thread
+		//
+		DH_Pool_SendFile(NULL,data);
+		return;
+	}
+#endif
 	ILibThreadPool_QueueUserWorkItem(data->pool,data,&DH_Pool);
 }
 void DH_Disconnect(struct ILibWebServer_Session *session)
@@ -119,14 +201,14 @@ void DH_Disconnect(struct ILibWebServer_Session *session)
 		sem_post(&(data->SendStatusLock));
 		if(SendStatus>0 || SendStatus<0)
 		{
-			if(data->f!=NULL)
+			if(data->source!=NULL)
 			{
 				if(data->callback_response!=NULL)
 				{
 					data->callback_response(data->session, data->TransferStatus, DHS_ERRORS_PEER_ABORTED_CONNECTION,data->user_object);
 				}
-				fclose(data->f);
-				data->f = NULL;
+				DH_Reader->Close(data->source);
+				data->source = NULL;
 			}
 			DH_DestroyTransferStatus(data->TransferStatus);
 			sem_destroy(&(data->SendStatusLock));
@@ -166,13 +248,11 @@ void DH_Pool(ILibThreadPool sender, void *var)
 	if(data->TransferStatus->TotalBytesToBeSent==-1)
 	{
 		sem_wait(&(data->TransferStatus->syncLock));
-		fseek(data->f,0,SEEK_END);
-		data->TransferStatus->TotalBytesToBeSent = ftell(data->f);
-		fseek(data->f,0,SEEK_SET);
+		data->TransferStatus->TotalBytesToBeSent = DH_Reader->Length(data->source);
 		sem_post(&(data->TransferStatus->syncLock));
 	}
 
-	bytesRead = (int)fread(buffer,sizeof(char),data->BytesLeft>DHS_READ_BLOCK_SIZE?DHS_READ_BLOCK_SIZE:data->BytesLeft,data->f);
+	bytesRead = DH_Reader->Read(data->source,buffer,data->BytesLeft>DHS_READ_BLOCK_SIZE?DHS_READ_BLOCK_SIZE:(int)data->BytesLeft);
 
 	if(bytesRead>0)
 	{
@@ -203,7 +283,7 @@ void DH_Pool(ILibThreadPool sender, void *var)
 
 	if(SendStatus>=0)
 	{
-		if(feof(data->f) || data->BytesLeft==0)
+		if(bytesRead<=0 || data->BytesLeft==0)
 		{
 			//
 			// Read all there is to read
@@ -219,7 +299,7 @@ void DH_Pool(ILibThreadPool sender, void *var)
 			{
 				data->callback_response(data->session, data->TransferStatus, DHS_ERRORS_NONE,data->user_object);
 			}
-			fclose(data->f);
+			DH_Reader->Close(data->source);
 			DH_DestroyTransferStatus(data->TransferStatus);
 			sem_destroy(&(data->SendStatusLock));
 			free(data);
@@ -227,29 +307,31 @@ void DH_Pool(ILibThreadPool sender, void *var)
 		else
 		{
 			//
-			// More to read
+			// More to read. Only the local status may be checked here: once the
+			// send is pending, DH_SendOK may already have queued the next block,
+			// which owns data->SendStatus from then on.
 			//
 			
-			if(data->SendStatus==0 && data->Disconnect==0)
+			if(SendStatus==0 && data->Disconnect==0)
 			{
 				//
 				// Everything was sent, just need to read more
 				//
 				ILibThreadPool_QueueUserWorkItem(data->pool,data,&DH_Pool);
 			}
-			else if(data->SendStatus==0 && data->Disconnect!=0)
+			else if(SendStatus==0 && data->Disconnect!=0)
 			{
 				//
 				// Clean up everything, because the session was disconnected
 				//
-				if(data->f!=NULL)
+				if(data->source!=NULL)
 				{
 					if(data->callback_response!=NULL)
 					{
 						data->callback_response(data->session, data->TransferStatus, DHS_ERRORS_PEER_ABORTED_CONNECTION,data->user_object);
 					}
-					fclose(data->f);
-					data->f = NULL;
+					DH_Reader->Close(data->source);
+					data->source = NULL;
 				}
 				DH_DestroyTransferStatus(data->TransferStatus);
 				sem_destroy(&(data->SendStatusLock));
@@ -264,14 +346,115 @@ void DH_Pool(ILibThreadPool sender, void *var)
 	}
 }
 
+#if defined(_POSIX)
+//
+// Zero-copy variant of DH_Pool. Each range is queued on the socket and sent with
+// sendfile() by the chain thread, the next one is queued from DH_SendOK.
+//
+void DH_Pool_SendFile(ILibThreadPool sender, void *var)
+{
+	struct DH_Data *data = (struct DH_Data*)var;
+	long long offset = 0;
+	long length;
+	int fd;
+	int paused=0;
+	int Disconnect=0;
+
+	sem_wait(&(data->TransferStatus->syncLock));
+	if(data->TransferStatus->Reserved1!=0)
+	{
+		data->TransferStatus->Reserved2 = 3;
+		data->TransferStatus->Reserved3 = data;
+		paused=1;
+	}
+	sem_post(&(data->TransferStatus->syncLock));
+
+	if(paused)
+	{
+		return;
+	}
+
+	//
+	// The first range is queued from the thread pool, following ones from DH_SendOK on the
+	// chain thread, which may run as soon as the range is queued. Hold the lock until we are done.
+	//
+	sem_wait(&(data->SendStatusLock));
+	if(data->BytesLeft==0)
+	{
+		//
+		// Everything was sent
+		//
+		sem_post(&(data->SendStatusLock));
+		data->session->OnSendOK = NULL;
+		data->session->OnDisconnect = NULL;
+		data->session->User3 = NULL;
+		ILibWebServer_StreamBody(data->session,NULL,0,ILibAsyncSocket_MemoryOwnership_STATIC,1);
+		if(data->callback_response!=NULL)
+		{
+			data->callback_response(data->session, data->TransferStatus, DHS_ERRORS_NONE,data->user_object);
+		}
+		DH_Reader->Close(data->source);
+		DH_DestroyTransferStatus(data->TransferStatus);
+		sem_destroy(&(data->SendStatusLock));
+		free(data);
+		return;
+	}
+
+	length = data->BytesLeft>DHS_SENDFILE_BLOCK_SIZE?DHS_SENDFILE_BLOCK_SIZE:(long)data->BytesLeft;
+	fd = DH_Reader->GetFile(data->source,data->Position,&offset,&length);
+	if(fd<0 || length<=0)
+	{
+		//
+		// Data is not stored in a file we can send from, read the rest
+		//
+		data->SendFile = 0;
+		DH_Reader->Seek(data->source,data->Position);
+		sem_post(&(data->SendStatusLock));
+		ILibThreadPool_QueueUserWorkItem(data->pool,data,&DH_Pool);
+		return;
+	}
+
+	data->BytesLeft -= length;
+	data->Position += length;
+	sem_wait(&(data->TransferStatus->syncLock));
+	data->TransferStatus->ActualBytesSent += length;
+	sem_post(&(data->TransferStatus->syncLock));
+
+	data->session->User3 = data;
+	data->session->OnSendOK = &DH_SendOK;
+	data->session->OnDisconnect = &DH_Disconnect;
+	data->SendStatus = ILibWebServer_StreamFile(data->session,fd,(off_t)offset,(int)length,0);
+	Disconnect = data->Disconnect;
+	sem_post(&(data->SendStatusLock));
+
+	if(Disconnect!=0)
+	{
+		//
+		// The session was disconnected before the range was queued
+		//
+		if(data->callback_response!=NULL)
+		{
+			data->callback_response(data->session, data->TransferStatus, DHS_ERRORS_PEER_ABORTED_CONNECTION,data->user_object);
+		}
+		DH_Reader->Close(data->source);
+		DH_DestroyTransferStatus(data->TransferStatus);
+		sem_destroy(&(data->SendStatusLock));
+		free(data);
+	}
+	//
+	// Otherwise DH_SendOK queues the next range, or DH_Disconnect cleans up
+	//
+}
+#endif
+
 DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session, ILibThreadPool pool, struct packetheader *header, size_t buffer_size, const char *file_name, unsigned int supported_transfer_mode, const char *mime_type, const char *content_features, const char* ifo_uri, void *user_obj, DHS_OnResponseDone callback_response)
 {
 	DH_TransferStatus retval = NULL;
-	FILE *f;
+	void *f;
 	struct DH_Data *data = NULL;
 	struct packetheader *resp = NULL;
 	char *ifo, *cf = NULL;
-	long RangeStart,RangeLength,FileLength;
+	long long RangeStart,RangeLength,FileLength;
 	char len[255];
 	enum ILibWebClient_Range_Result RangeResult = 0;
 	enum DH_TransferModes transferMode;
@@ -284,7 +467,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		return NULL;
 	}
 
-	f = fopen(file_name,"rb");
+	f = DH_Reader->Open(file_name);
 	if(f!=NULL)
 	{
 		data = (struct DH_Data*)malloc(sizeof(struct DH_Data));
@@ -293,16 +476,14 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		resp = ILibCreateEmptyPacket();
 		ILibSetVersion(resp,"1.1",3);
 		
-		fseek(f,0,SEEK_END);
-		FileLength = ftell(f);
-		fseek(f,0,SEEK_SET);
+		FileLength = DH_Reader->Length(f);
 
 		cf = ILibGetHeaderLine(header,"getcontentFeatures.dlna.org",27);
 
 		if(cf!= NULL && memcmp(cf, "1", 1)!=0)
 		{
 			ILibWebServer_Send_Raw(session,"HTTP/1.1 400 Bad Request\r\n\r\n",28,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(f);
+			DH_Reader->Close(f);
 			free(data);
 			ILibDestructPacket(resp);
 			return(NULL);
@@ -321,7 +502,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		)
 		{
 			ILibWebServer_Send_Raw(session,"HTTP/1.1 400 Bad Request\r\n\r\n",28,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(f);
+			DH_Reader->Close(f);
 			free(data);
 			ILibDestructPacket(resp);
 			return(NULL);			
@@ -333,21 +514,22 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 			switch(RangeResult)
 			{
 				case ILibWebClient_Range_Result_OK:
-					fseek(f,RangeStart,SEEK_SET);
+					DH_Reader->Seek(f,RangeStart);
+					data->Position = RangeStart;
 					data->BytesLeft = RangeLength;
 					ILibSetStatusCode(resp,206,"Partial Content",15);
 					DH_AddHeader_ContentRange(resp,RangeStart,(RangeStart+RangeLength)-1,FileLength);
 					break;
 				case ILibWebClient_Range_Result_INVALID_RANGE:								 
 					ILibWebServer_Send_Raw(session,"HTTP/1.1 416 Invalid Range\r\n\r\n",30,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-					fclose(f);
+					DH_Reader->Close(f);
 					free(data);
 					ILibDestructPacket(resp);
 					return(NULL);
 					break;
 				case ILibWebClient_Range_Result_BAD_REQUEST:
 					ILibWebServer_Send_Raw(session,"HTTP/1.1 400 Bad Request\r\n\r\n",28,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-					fclose(f);
+					DH_Reader->Close(f);
 					free(data);
 					ILibDestructPacket(resp);
 					return(NULL);
@@ -357,7 +539,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		else if(ILibGetHeaderLine(header,"TimeSeekRange.dlna.org",22)!=NULL)
 		{
 			ILibWebServer_Send_Raw(session,"HTTP/1.1 406 Time-based seek not supported\r\n\r\n",46,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(f);
+			DH_Reader->Close(f);
 			free(data);
 			ILibDestructPacket(resp);
 			return(NULL);
@@ -365,7 +547,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		else if(ILibGetHeaderLine(header,"PlaySpeed.dlna.org",18)!=NULL)
 		{
 			ILibWebServer_Send_Raw(session,"HTTP/1.1 406 PlaySpeeds not supported\r\n\r\n",41,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(f);
+			DH_Reader->Close(f);
 			free(data);
 			ILibDestructPacket(resp);
 			return(NULL);
@@ -374,7 +556,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		{
 			ILibSetStatusCode(resp,200,"OK",2);
 			data->BytesLeft = FileLength;
-			sprintf(len,"%ld",data->BytesLeft);
+			sprintf(len,"%lld",data->BytesLeft);
 			ILibAddHeaderLine(resp,"Content-Length",14,len,(int)strlen(len));
 		}
 
@@ -399,7 +581,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 			// Specified transfer mode is not supported
 			//
 			ILibWebServer_Send_Raw(session,"HTTP/1.1 406 Not Acceptable\r\n\r\n",31,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(f);
+			DH_Reader->Close(f);
 			free(data);
 			ILibDestructPacket(resp);
 			return(NULL);
@@ -410,7 +592,7 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		}
 
 		data->callback_response = callback_response;
-		data->f = f;
+		data->source = f;
 		data->header = header;
 		data->session = session;
 		data->pool = pool;
@@ -445,8 +627,8 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		if(header->DirectiveLength==4 && strncasecmp(header->Directive,"HEAD",4)==0)
 		{
 			ILibWebServer_StreamBody(session,NULL,0,ILibAsyncSocket_MemoryOwnership_STATIC,1);
-			fclose(data->f);
-			data->f = NULL;
+			DH_Reader->Close(data->source);
+			data->source = NULL;
 			DH_DestroyTransferStatus(data->TransferStatus);
 			free(data);
 			session->OnDisconnect = NULL;
@@ -455,7 +637,17 @@ DH_TransferStatus DHS_RespondWithLocalFile(struct ILibWebServer_Session *session
 		else
 		{
 			sem_init(&(data->SendStatusLock),0,1);
-			ILibThreadPool_QueueUserWorkItem(pool,data,&DH_Pool);
+#if defined(_POSIX)
+			if(DH_Reader->GetFile!=NULL)
+			{
+				data->SendFile = 1;
+				ILibThreadPool_QueueUserWorkItem(pool,data,&DH_Pool_SendFile);
+			}
+			else
+#endif
+			{
+				ILibThreadPool_QueueUserWorkItem(pool,data,&DH_Pool);
+			}
 		}
 	}
 	else
@@ -736,6 +928,11 @@ void DH_Resume(DH_TransferStatus tstatus)
 		case 2:
 			ILibThreadPool_QueueUserWorkItem(data->pool,data,&DH_Pool);
 			break;
+#if defined(_POSIX)
+		case 3:
+			ILibThreadPool_QueueUserWorkItem(data->pool,data,&DH_Pool_SendFile);
+			break;
+#endif
 	}
 }
 
@@ -43,6 +43,7 @@
 #include "DLNAProtocolInfo.h"
 
 #define DHS_READ_BLOCK_SIZE 16384
+#define DHS_SENDFILE_BLOCK_SIZE 1048576
 #define DHS_DEFAULT_MIMETYPE "application/octet-stream"
 
 
@@ -75,6 +76,36 @@ enum DHS_Errors
 */
 typedef void(*DHS_OnResponseDone)(struct ILibWebServer_Session *session, DH_TransferStatus transfer_status_handle, enum DHS_Errors dhs_error_code, void *user_obj);
 
+/*! \brief Set of methods used by \ref DHS_RespondWithLocalFile to read the local file.
+
+	Read is called from thread pool threads, other methods may be called from the chain thread.
+*/
+struct DHS_FileReader
+{
+	/*! \brief Opens \a file_name for reading, returns NULL on failure */
+	void* (*Open)(const char *file_name);
+	/*! \brief Returns total length in bytes, leaving position at the beginning */
+	long long (*Length)(void *source);
+	/*! \brief Sets position to \a offset bytes from the beginning, returns 0 on success */
+	int (*Seek)(void *source, long long offset);
+	/*! \brief Reads up to \a size bytes, returns number of bytes read, 0 or less at the end */
+	int (*Read)(void *source, char *buffer, int size);
+	void (*Close)(void *source);
+	/*! \brief Optional, may be NULL. Returns a file descriptor that holds the data at stream \a position, or -1 if there is none.
+
+		\a offset receives the file offset of the data, \a length is reduced to the number of bytes stored there contiguously.
+		The descriptor must stay open until the next call or Close. When available, the response body is sent from it
+		with sendfile() in blocks of \ref DHS_SENDFILE_BLOCK_SIZE, without copying the data. */
+	int (*GetFile)(void *source, long long position, long long *offset, long *length);
+};
+
+/*!	\brief Replaces the reader used by \ref DHS_RespondWithLocalFile for all subsequent responses.
+
+	The application may use it to serve files which are not plain local files, e.g. recordings stored in several parts.
+	\param[in] reader The methods to use, must stay valid while the server runs. NULL restores the default stdio reader.
+*/
+void DHS_SetFileReader(const struct DHS_FileReader *reader);
+
 /*!	\brief Allows the application to respond to an HTTP <b>GET</b> or <b>HEAD</b> request by specifying a local file for response.
 	
 	The application is responsible for doing the following.
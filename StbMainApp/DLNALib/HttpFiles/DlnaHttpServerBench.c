@@ -0,0 +1,401 @@
+/*
+ DlnaHttpServerBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file DlnaHttpServerBench.c Throughput benchmark of DHS_RespondWithLocalFile
+ * Serves a local file to a client on loopback, once with zero-copy sendfile()
+ * path and once with the read and copy path of the thread pool, and reports
+ * throughput and CPU time of the process. Received data is compared with the
+ * file, so the benchmark doubles as a check of chunked and Range responses.
+ *
+ * Usage: DlnaHttpServerBench file [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ILibParsers.h"
+#include "ILibWebServer.h"
+#include "ILibThreadPool.h"
+#include "DlnaHttpServer.h"
+
+#define BENCH_POOL_THREADS 3
+#define BENCH_BUFFER_SIZE  65536
+
+static void *Bench_Chain;
+static ILibThreadPool Bench_Pool;
+static const char *Bench_FileName;
+static int Bench_File = -1;
+static long Bench_FileLength;
+static volatile int Bench_Errors;
+
+//
+// Stdio reader without GetFile, forces the read and copy path
+//
+static void* Bench_Open(const char *file_name)
+{
+	return fopen(file_name,"rb");
+}
+static long long Bench_Length(void *source)
+{
+	long long length;
+
+	fseeko((FILE*)source,0,SEEK_END);
+	length = ftello((FILE*)source);
+	fseeko((FILE*)source,0,SEEK_SET);
+	return length;
+}
+static int Bench_Seek(void *source, long long offset)
+{
+	return fseeko((FILE*)source,offset,SEEK_SET);
+}
+static int Bench_Read(void *source, char *buffer, int size)
+{
+	return (int)fread(buffer,sizeof(char),size,(FILE*)source);
+}
+static void Bench_Close(void *source)
+{
+	fclose((FILE*)source);
+}
+static const struct DHS_FileReader Bench_CopyReader =
+{
+	&Bench_Open,
+	&Bench_Length,
+	&Bench_Seek,
+	&Bench_Read,
+	&Bench_Close,
+	NULL
+};
+
+//
+// Server side
+//
+static void Bench_OnResponseDone(struct ILibWebServer_Session *session, DH_TransferStatus transfer_status_handle, enum DHS_Errors dhs_error_code, void *user_obj)
+{
+	if(dhs_error_code!=DHS_ERRORS_NONE)
+	{
+		Bench_Errors++;
+	}
+}
+static void Bench_OnReceive(struct ILibWebServer_Session *sender, int InterruptFlag, struct packetheader *header, char *bodyBuffer, int *beginPointer, int endPointer, int done)
+{
+	if(done!=0)
+	{
+		DHS_RespondWithLocalFile(sender,Bench_Pool,header,BENCH_BUFFER_SIZE,Bench_FileName,
+			DH_TransferMode_Bulk|DH_TransferMode_Streaming,"video/mpeg",NULL,NULL,NULL,&Bench_OnResponseDone);
+	}
+}
+static void Bench_OnSession(struct ILibWebServer_Session *SessionToken, void *User)
+{
+	SessionToken->OnReceive = &Bench_OnReceive;
+}
+static void* Bench_ChainThread(void *args)
+{
+	ILibStartChain(Bench_Chain);
+	return(NULL);
+}
+static void* Bench_PoolThread(void *args)
+{
+	ILibThreadPool_AddThread(Bench_Pool);
+	return(NULL);
+}
+
+//
+// Client side
+//
+struct Bench_Connection
+{
+	int s;
+	char buffer[BENCH_BUFFER_SIZE];
+	int begin;
+	int end;
+};
+
+static int Bench_Fill(struct Bench_Connection *c)
+{
+	int bytesRead;
+
+	if(c->begin<c->end)
+	{
+		return(c->end-c->begin);
+	}
+	bytesRead = (int)recv(c->s,c->buffer,sizeof(c->buffer),0);
+	c->begin = 0;
+	c->end = bytesRead>0?bytesRead:0;
+	return(bytesRead);
+}
+static int Bench_ReadLine(struct Bench_Connection *c, char *line, int size)
+{
+	int length = 0;
+
+	while(Bench_Fill(c)>0)
+	{
+		char ch = c->buffer[c->begin++];
+		if(ch=='\n')
+		{
+			while(length>0 && line[length-1]=='\r') {--length;}
+			line[length] = 0;
+			return(length);
+		}
+		if(length<size-1) {line[length++] = ch;}
+	}
+	return(-1);
+}
+//
+// Compares next length bytes of the body with the file at offset
+//
+static int Bench_ReadBody(struct Bench_Connection *c, long offset, long length)
+{
+	char expected[BENCH_BUFFER_SIZE];
+	int size;
+
+	while(length>0)
+	{
+		if(Bench_Fill(c)<=0)
+		{
+			return(-1);
+		}
+		size = c->end-c->begin;
+		if(size>length) {size = (int)length;}
+		if(pread(Bench_File,expected,size,offset)!=size || memcmp(expected,c->buffer+c->begin,size)!=0)
+		{
+			fprintf(stderr,"Body differs from file at %ld\n",offset);
+			return(-1);
+		}
+		c->begin += size;
+		offset += size;
+		length -= size;
+	}
+	return(0);
+}
+
+//
+// Requests [start, start+length) of the file, length<0 requests whole file.
+// Returns number of body bytes received and verified, -1 on failure
+//
+static long Bench_Get(unsigned short port, long start, long length)
+{
+	struct Bench_Connection *c = (struct Bench_Connection*)malloc(sizeof(struct Bench_Connection));
+	struct sockaddr_in addr;
+	char request[256];
+	char line[256];
+	int requestLength;
+	int chunked = 0;
+	long contentLength = -1;
+	long offset = length<0?0:start;
+	long received = 0;
+	long chunk;
+	int retry;
+
+	memset(c,0,sizeof(struct Bench_Connection));
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if((c->s = socket(AF_INET,SOCK_STREAM,0))<0)
+	{
+		goto failure;
+	}
+	// The server starts listening when the chain is started
+	for(retry=0;connect(c->s,(struct sockaddr*)&addr,sizeof(addr))!=0;++retry)
+	{
+		if(errno!=ECONNREFUSED || retry==100)
+		{
+			perror("connect");
+			goto failure;
+		}
+		usleep(20000);
+	}
+	if(length<0)
+	{
+		requestLength = sprintf(request,"GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+	}
+	else
+	{
+		requestLength = sprintf(request,"GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nRange: bytes=%ld-%ld\r\nConnection: close\r\n\r\n",start,start+length-1);
+	}
+	if(send(c->s,request,requestLength,0)!=requestLength)
+	{
+		goto failure;
+	}
+
+	if(Bench_ReadLine(c,line,sizeof(line))<0 || (strstr(line," 200 ")==NULL && strstr(line," 206 ")==NULL))
+	{
+		fprintf(stderr,"Unexpected response: %s\n",line);
+		goto failure;
+	}
+	while(Bench_ReadLine(c,line,sizeof(line))>0)
+	{
+		if(strncasecmp(line,"Transfer-Encoding: chunked",26)==0) {chunked = 1;}
+		if(strncasecmp(line,"Content-Length:",15)==0) {contentLength = atol(line+15);}
+	}
+
+	if(chunked==0)
+	{
+		if(contentLength<0 || Bench_ReadBody(c,offset,contentLength)!=0)
+		{
+			goto failure;
+		}
+		received = contentLength;
+	}
+	else
+	{
+		for(;;)
+		{
+			if(Bench_ReadLine(c,line,sizeof(line))<0)
+			{
+				goto failure;
+			}
+			chunk = strtol(line,NULL,16);
+			if(chunk==0)
+			{
+				break;
+			}
+			if(Bench_ReadBody(c,offset+received,chunk)!=0 || Bench_ReadLine(c,line,sizeof(line))!=0)
+			{
+				goto failure;
+			}
+			received += chunk;
+		}
+	}
+	close(c->s);
+	free(c);
+	return(received);
+
+failure:
+	if(c->s>0) {close(c->s);}
+	free(c);
+	return(-1);
+}
+
+static double Bench_Now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return(tv.tv_sec+tv.tv_usec/1000000.0);
+}
+static double Bench_CpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return(usage.ru_utime.tv_sec+usage.ru_utime.tv_usec/1000000.0+usage.ru_stime.tv_sec+usage.ru_stime.tv_usec/1000000.0);
+}
+
+static int Bench_Run(const char *name, unsigned short port, int passes)
+{
+	double start,cpu,elapsed;
+	long total = 0;
+	long received;
+	int i;
+
+	// Ranges at unaligned offsets first, they are checked only
+	received = Bench_Get(port,Bench_FileLength/3+1,Bench_FileLength/2);
+	if(received!=Bench_FileLength/2)
+	{
+		fprintf(stderr,"%s: range request failed (%ld)\n",name,received);
+		return(-1);
+	}
+
+	start = Bench_Now();
+	cpu = Bench_CpuTime();
+	for(i=0;i<passes;++i)
+	{
+		received = Bench_Get(port,0,-1);
+		if(received!=Bench_FileLength)
+		{
+			fprintf(stderr,"%s: pass %d received %ld of %ld bytes\n",name,i,received,Bench_FileLength);
+			return(-1);
+		}
+		total += received;
+	}
+	elapsed = Bench_Now()-start;
+	cpu = Bench_CpuTime()-cpu;
+	printf("%-10s %8.1f MB/s  %6.3f s cpu per GB\n",name,total/elapsed/1048576.0,cpu*1073741824.0/total);
+	return(0);
+}
+
+int main(int argc, char **argv)
+{
+	void *server;
+	unsigned short port;
+	pthread_t t;
+	struct stat st;
+	int passes = argc>2?atoi(argv[2]):10;
+	int x;
+	int ret = 0;
+
+	if(argc<2)
+	{
+		fprintf(stderr,"Usage: %s file [passes]\n",argv[0]);
+		return(1);
+	}
+	Bench_FileName = argv[1];
+	if((Bench_File = open(Bench_FileName,O_RDONLY))<0 || fstat(Bench_File,&st)!=0)
+	{
+		perror(Bench_FileName);
+		return(1);
+	}
+	Bench_FileLength = (long)st.st_size;
+
+	Bench_Chain = ILibCreateChain();
+	Bench_Pool = ILibThreadPool_Create();
+	for(x=0;x<BENCH_POOL_THREADS;++x)
+	{
+		pthread_create(&t,NULL,&Bench_PoolThread,NULL);
+	}
+	server = ILibWebServer_Create(Bench_Chain,5,0,&Bench_OnSession,NULL);
+	port = ILibWebServer_GetPortNumber(server);
+	pthread_create(&t,NULL,&Bench_ChainThread,NULL);
+
+	printf("%s: %ld bytes, %d passes\n",Bench_FileName,Bench_FileLength,passes);
+	ret |= Bench_Run("sendfile",port,passes);
+	DHS_SetFileReader(&Bench_CopyReader);
+	ret |= Bench_Run("read+copy",port,passes);
+	if(Bench_Errors!=0)
+	{
+		fprintf(stderr,"%d transfers failed\n",Bench_Errors);
+		ret = -1;
+	}
+
+	ILibStopChain(Bench_Chain);
+	pthread_join(t,NULL);
+	return(ret==0?0:1);
+}
@@ -331,7 +331,7 @@ void ILibAsyncServerSocket_Destroy(void *socketModule)
 	#elif WIN32
 		closesocket(module->ListenSocket);
 	#elif _POSIX
-		close(module->ListenSocket);
+		ILibChain_CloseSocket(module->ListenSocket);
 	#elif defined(__SYMBIAN32__)
 		ILibSocketWrapper_close(module->ListenSocket);
 	#endif	
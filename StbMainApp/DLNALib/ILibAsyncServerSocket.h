@@ -139,6 +139,18 @@ unsigned short ILibAsyncServerSocket_GetPortNumber(ILibAsyncServerSocket_ServerM
 	\returns \a ILibAsyncSocket_SendStatus indicating the send status
 */
 #define ILibAsyncServerSocket_Send(ServerSocketModule, ConnectionToken, buffer, bufferLength, UserFreeBuffer) ILibAsyncSocket_Send(ConnectionToken,buffer,bufferLength,UserFreeBuffer)
+#if defined(_POSIX)
+/*! \def ILibAsyncServerSocket_SendFile
+	\brief Queues a range of a file to be sent onto the TCP stream, see \a ILibAsyncSocket_SendFile
+	\param ServerSocketModule The parent ILibAsyncServerSocket_ServerModule
+	\param ConnectionToken The connection state for this session
+	\param fileDescriptor The file to send data from
+	\param offset The file offset of the range
+	\param length The length of the range
+	\returns \a ILibAsyncSocket_SendStatus indicating the send status
+*/
+#define ILibAsyncServerSocket_SendFile(ServerSocketModule, ConnectionToken, fileDescriptor, offset, length) ILibAsyncSocket_SendFile(ConnectionToken,fileDescriptor,offset,length)
+#endif
 
 /*! \def ILibAsyncServerSocket_Disconnect
 	\brief Disconnects a TCP stream
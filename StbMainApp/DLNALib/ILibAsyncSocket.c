@@ -73,6 +73,9 @@
 #if defined(WIN32) && defined(WIN32_QWAVE)
 #include "Qos2.h"
 #endif
+#if defined(_POSIX) && defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 #define DEBUGSTATEMENT(x)
 
@@ -115,6 +118,8 @@ struct ILibAsyncSocket_SendData
 	unsigned short remotePort;
 
 	int UserFree;
+	int fileDescriptor;	// -1, or file to send bufferSize bytes from, starting at fileOffset
+	off_t fileOffset;
 	struct ILibAsyncSocket_SendData *Next;
 };
 
@@ -227,7 +232,7 @@ void ILibAsyncSocket_Destroy(void *socketModule)
 			closesocket(module->internalSocket);
 		#elif defined(_POSIX)
 			shutdown(module->internalSocket,SHUT_RDWR);
-			close(module->internalSocket);
+			ILibChain_CloseSocket(module->internalSocket);
 		#elif defined(__SYMBIAN32__)
 			ILibSocketWrapper_close(module->internalSocket);
 		#endif
@@ -376,6 +381,7 @@ enum ILibAsyncSocket_SendStatus ILibAsyncSocket_SendTo(ILibAsyncSocket_SocketMod
 	data->UserFree = UserFree;
 	data->remoteAddress = remoteAddress;
 	data->remotePort = remotePort;
+	data->fileDescriptor = -1;
 	data->Next = NULL;
 
 	SEM_TRACK(AsyncSocket_TrackLock("ILibAsyncSocket_Send",1,module);)
@@ -524,6 +530,105 @@ enum ILibAsyncSocket_SendStatus ILibAsyncSocket_SendTo(ILibAsyncSocket_SocketMod
 	return(unblock);
 }
 
+#if defined(_POSIX)
+/*! \fn ILibAsyncSocket_SendFile(ILibAsyncSocket_SocketModule socketModule, int fileDescriptor, off_t offset, int length)
+	\brief Queues a range of a file to be sent on an AsyncSocket module. (Valid only for <B>TCP</B>)
+	\par
+	The range is sent by the chain thread when the socket is writable, with sendfile() where available,
+	so the data is not copied through user space. \a fileDescriptor must remain open until OnSendOK is
+	triggered, or the socket is disconnected.
+	\param socketModule The ILibAsyncSocket module to send data on
+	\param fileDescriptor The file to send data from
+	\param offset The file offset of the range
+	\param length The length of the range
+	\returns \a ILibAsyncSocket_NOT_ALL_DATA_SENT_YET if the range was queued, or \a ILibAsyncSocket_SEND_ON_CLOSED_SOCKET_ERROR
+*/
+enum ILibAsyncSocket_SendStatus ILibAsyncSocket_SendFile(ILibAsyncSocket_SocketModule socketModule, int fileDescriptor, off_t offset, int length)
+{
+	struct ILibAsyncSocketModule *module = (struct ILibAsyncSocketModule*)socketModule;
+	struct ILibAsyncSocket_SendData *data;
+
+	if(socketModule==NULL)
+	{
+		return(ILibAsyncSocket_SEND_ON_CLOSED_SOCKET_ERROR);
+	}
+
+	data = (struct ILibAsyncSocket_SendData*)malloc(sizeof(struct ILibAsyncSocket_SendData));
+	memset(data,0,sizeof(struct ILibAsyncSocket_SendData));
+
+	data->bufferSize = length;
+	data->UserFree = ILibAsyncSocket_MemoryOwnership_STATIC;
+	data->fileDescriptor = fileDescriptor;
+	data->fileOffset = offset;
+
+	SEM_TRACK(AsyncSocket_TrackLock("ILibAsyncSocket_SendFile",1,module);)
+	sem_wait(&(module->SendLock));
+	if(module->internalSocket==~0)
+	{
+		// Too Bad, the socket closed
+		free(data);
+		SEM_TRACK(AsyncSocket_TrackUnLock("ILibAsyncSocket_SendFile",2,module);)
+		sem_post(&(module->SendLock));
+		return(ILibAsyncSocket_SEND_ON_CLOSED_SOCKET_ERROR);
+	}
+
+	//
+	// Always queue the range, it is sent from PostSelect, when the socket is writable
+	//
+	module->PendingBytesToSend += length;
+	if(module->PendingSend_Tail!=NULL)
+	{
+		module->PendingSend_Tail->Next = data;
+		module->PendingSend_Tail = data;
+	}
+	else
+	{
+		module->PendingSend_Tail = data;
+		module->PendingSend_Head = data;
+	}
+	SEM_TRACK(AsyncSocket_TrackUnLock("ILibAsyncSocket_SendFile",3,module);)
+	sem_post(&(module->SendLock));
+	ILibForceUnBlockChain(module->Chain);
+	return(ILibAsyncSocket_NOT_ALL_DATA_SENT_YET);
+}
+
+//
+// Sends the next portion of a queued file range. Returns like send()
+//
+static int ILibAsyncSocket_SendFileData(int s, struct ILibAsyncSocket_SendData *data)
+{
+	int bytesSent;
+#if defined(__linux__)
+	off_t offset = data->fileOffset + data->bytesSent;
+
+	bytesSent = (int)sendfile(s,data->fileDescriptor,&offset,data->bufferSize-data->bytesSent);
+#else
+	char buffer[16384];
+	int length = data->bufferSize-data->bytesSent;
+
+	if(length>(int)sizeof(buffer)) {length = (int)sizeof(buffer);}
+	bytesSent = (int)pread(data->fileDescriptor,buffer,length,data->fileOffset+data->bytesSent);
+	if(bytesSent>0)
+	{
+	#if defined(MSG_NOSIGNAL)
+		bytesSent = send(s,buffer,bytesSent,MSG_NOSIGNAL);
+	#else
+		bytesSent = send(s,buffer,bytesSent,0);
+	#endif
+	}
+#endif
+	if(bytesSent==0)
+	{
+		//
+		// The file ended before the queued range, the peer would wait for the rest forever
+		//
+		errno = EPIPE;
+		bytesSent = -1;
+	}
+	return(bytesSent);
+}
+#endif
+
 /*! \fn ILibAsyncSocket_Disconnect(ILibAsyncSocket_SocketModule socketModule)
 	\brief Disconnects an ILibAsyncSocket
 	\param socketModule The ILibAsyncSocket to disconnect
@@ -569,7 +674,7 @@ void ILibAsyncSocket_Disconnect(ILibAsyncSocket_SocketModule socketModule)
 					closesocket(s);
 			#elif defined(_POSIX)
 					shutdown(s,SHUT_RDWR);
-					close(s);
+					ILibChain_CloseSocket(s);
 			#elif defined(__SYMBIAN32__)
 					ILibSocketWrapper_close(s);
 			#endif
@@ -610,7 +715,7 @@ void ILibAsyncSocket_ConnectTimeout(void *socketModule)
 		closesocket(module->internalSocket);
 	#elif defined(_POSIX)
 		shutdown(module->internalSocket,SHUT_RDWR);
-		close(module->internalSocket);
+		ILibChain_CloseSocket(module->internalSocket);
 	#elif defined(__SYMBIAN32__)
 		ILibSocketWrapper_close(module->internalSocket);
 	#endif
@@ -943,7 +1048,7 @@ if(Reader->LocalIPAddress2!=0)
 			closesocket(Reader->internalSocket);
 		#elif defined(_POSIX)
 			shutdown(Reader->internalSocket,SHUT_RDWR);
-			close(Reader->internalSocket);
+			ILibChain_CloseSocket(Reader->internalSocket);
 		#elif defined(__SYMBIAN32__)
 			ILibSocketWrapper_close(Reader->internalSocket);
 		#endif
@@ -1166,6 +1271,13 @@ void ILibAsyncSocket_PostSelect(void* socketModule,int slct, void *readset, void
 		while(TRY_TO_SEND!=0)
 		{
 
+#if defined(_POSIX)
+			if(module->PendingSend_Head->fileDescriptor>=0)
+			{
+				bytesSent = ILibAsyncSocket_SendFileData(module->internalSocket,module->PendingSend_Head);
+			}
+			else
+#endif
 			if(module->PendingSend_Head->remoteAddress==0 && module->PendingSend_Head->remotePort==0)
 			{
 #if defined(MSG_NOSIGNAL)
@@ -1322,7 +1434,7 @@ void ILibAsyncSocket_PostSelect(void* socketModule,int slct, void *readset, void
 					closesocket(module->internalSocket);
 				#elif defined(_POSIX)
 					shutdown(module->internalSocket,SHUT_RDWR);
-					close(module->internalSocket);
+					ILibChain_CloseSocket(module->internalSocket);
 				#endif
 				module->internalSocket = ~0;
 				triggerErrorSet=1;
@@ -1361,7 +1473,7 @@ void ILibAsyncSocket_PostSelect(void* socketModule,int slct, void *readset, void
 					closesocket(module->internalSocket);
 				#elif defined(_POSIX)
 					shutdown(module->internalSocket,SHUT_RDWR);
-					close(module->internalSocket);
+					ILibChain_CloseSocket(module->internalSocket);
 				#endif
 				module->internalSocket = ~0;
 				module->PAUSE = 1;
@@ -1506,7 +1618,7 @@ void OnILibAsyncSocket_ReplaceSocketSink(void *obj)
 		#if defined(_WIN32_WCE) || defined(WIN32)
 			closesocket(data->module->internalSocket);
 		#elif defined(_POSIX)
-			close(data->module->internalSocket);
+			ILibChain_CloseSocket(data->module->internalSocket);
 		#elif defined(__SYMBIAN32__)
 			ILibSocketWrapper_close(data->module->internalSocket);
 		#endif
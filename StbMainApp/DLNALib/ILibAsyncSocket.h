@@ -174,6 +174,9 @@ enum ILibAsyncSocket_SendStatus ILibAsyncSocket_SendTo(ILibAsyncSocket_SocketMod
 	\returns \a ILibAsyncSocket_SendStatus indicating the send status
 */
 #define ILibAsyncSocket_Send(socketModule, buffer, length, UserFree) ILibAsyncSocket_SendTo(socketModule, buffer, length, 0, 0, UserFree)
+#if defined(_POSIX)
+enum ILibAsyncSocket_SendStatus ILibAsyncSocket_SendFile(ILibAsyncSocket_SocketModule socketModule, int fileDescriptor, off_t offset, int length);
+#endif
 void ILibAsyncSocket_Disconnect(ILibAsyncSocket_SocketModule socketModule);
 void ILibAsyncSocket_GetBuffer(ILibAsyncSocket_SocketModule socketModule, char **buffer, int *BeginPointer, int *EndPointer);
 
@@ -0,0 +1,361 @@
+/*
+ ILibChainBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file ILibChainBench.c Event loop benchmark of the chain
+ * Keeps a number of keep-alive HTTP sessions open to ILibWebServer on
+ * loopback and reports chain wakeups per second, CPU time of the chain thread
+ * per wakeup and request latency, with all sessions busy, with one busy
+ * session among idle ones and with all sessions idle.
+ *
+ * Built twice by the bench target: ILibChainBench with the loop the library
+ * was built with, ILibChainBenchSelect with the select loop.
+ *
+ * Usage: ILibChainBench [sessions] [seconds per phase]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ILibParsers.h"
+#include "ILibWebServer.h"
+
+#define BENCH_MAX_SAMPLES 65536
+
+#if defined(ILIB_CHAIN_SELECT) || !defined(__linux__)
+	#define BENCH_LOOP "select"
+#else
+	#define BENCH_LOOP "epoll"
+#endif
+
+static char Bench_Response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+static void *Bench_Chain;
+static pthread_t Bench_ChainThreadId;
+static volatile unsigned long Bench_Wakeups;
+static volatile int Bench_Phase;
+static volatile int Bench_Active;
+static volatile int Bench_Quit;
+static unsigned short Bench_Port;
+
+//
+// Chain link that only counts iterations of the chain
+//
+struct Bench_Counter
+{
+	void (*PreSelect)(void* object,void *readset, void *writeset, void *errorset, int* blocktime);
+	void (*PostSelect)(void* object,int slct, void *readset, void *writeset, void *errorset);
+	void (*Destroy)(void* object);
+};
+static void Bench_CounterPreSelect(void* object,void *readset, void *writeset, void *errorset, int* blocktime)
+{
+	++Bench_Wakeups;
+}
+
+//
+// Server side
+//
+static void Bench_OnReceive(struct ILibWebServer_Session *sender, int InterruptFlag, struct packetheader *header, char *bodyBuffer, int *beginPointer, int endPointer, int done)
+{
+	if(done!=0)
+	{
+		ILibWebServer_Send_Raw(sender,Bench_Response,sizeof(Bench_Response)-1,ILibAsyncSocket_MemoryOwnership_STATIC,1);
+	}
+}
+static void Bench_OnSession(struct ILibWebServer_Session *SessionToken, void *User)
+{
+	SessionToken->OnReceive = &Bench_OnReceive;
+}
+static void* Bench_ChainThread(void *args)
+{
+	ILibStartChain(Bench_Chain);
+	return(NULL);
+}
+
+//
+// Client side
+//
+struct Bench_Client
+{
+	pthread_t thread;
+	int index;
+	int s;
+	volatile int ready;
+	volatile int phase;
+	int *samples;
+	int count;
+	long requests;
+	volatile int failed;
+};
+
+static long Bench_Microseconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return(tv.tv_sec*1000000L+tv.tv_usec);
+}
+static double Bench_ChainCpuTime()
+{
+	struct timespec ts;
+	clockid_t cid;
+
+	if(pthread_getcpuclockid(Bench_ChainThreadId,&cid)!=0 || clock_gettime(cid,&ts)!=0)
+	{
+		return(0);
+	}
+	return(ts.tv_sec+ts.tv_nsec/1000000000.0);
+}
+
+//
+// Sends one request and reads the whole response, returns 0 on success
+//
+static int Bench_Request(struct Bench_Client *c)
+{
+	static const char request[] = "GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+	char buffer[256];
+	int length = 0;
+	int bytesRead;
+
+	if(send(c->s,request,sizeof(request)-1,0)!=sizeof(request)-1)
+	{
+		return(-1);
+	}
+	while(length<(int)sizeof(Bench_Response)-1)
+	{
+		bytesRead = (int)recv(c->s,buffer+length,sizeof(buffer)-length,0);
+		if(bytesRead<=0)
+		{
+			return(-1);
+		}
+		length += bytesRead;
+	}
+	return(memcmp(buffer,Bench_Response,sizeof(Bench_Response)-1)==0?0:-1);
+}
+static void* Bench_ClientThread(void *args)
+{
+	struct Bench_Client *c = (struct Bench_Client*)args;
+	struct sockaddr_in addr;
+	long start;
+	int retry;
+
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(Bench_Port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if((c->s = socket(AF_INET,SOCK_STREAM,0))<0)
+	{
+		c->failed = 1;
+		return(NULL);
+	}
+	// The server starts listening when the chain is started
+	for(retry=0;connect(c->s,(struct sockaddr*)&addr,sizeof(addr))!=0;++retry)
+	{
+		if(errno!=ECONNREFUSED || retry==100)
+		{
+			perror("connect");
+			c->failed = 1;
+			return(NULL);
+		}
+		usleep(20000);
+	}
+	// Make sure the session is accepted before the first phase
+	if(Bench_Request(c)!=0)
+	{
+		c->failed = 1;
+	}
+	c->ready = 1;
+
+	while(Bench_Quit==0 && c->failed==0)
+	{
+		c->phase = Bench_Phase;
+		if(c->index>=Bench_Active || c->phase<0)
+		{
+			usleep(1000);
+			continue;
+		}
+		start = Bench_Microseconds();
+		if(Bench_Request(c)!=0)
+		{
+			c->failed = 1;
+			break;
+		}
+		if(c->count<BENCH_MAX_SAMPLES)
+		{
+			c->samples[c->count++] = (int)(Bench_Microseconds()-start);
+		}
+		++c->requests;
+	}
+	c->phase = -1;
+	close(c->s);
+	return(NULL);
+}
+
+static int Bench_Compare(const void *a, const void *b)
+{
+	return(*(const int*)a-*(const int*)b);
+}
+//
+// Waits until no client is inside a request of the phase that is being finished
+//
+static void Bench_WaitClients(struct Bench_Client *clients, int sessions, int phase)
+{
+	int i;
+
+	for(i=0;i<sessions;++i)
+	{
+		while(clients[i].phase==phase && clients[i].failed==0)
+		{
+			usleep(1000);
+		}
+	}
+}
+static int Bench_RunPhase(const char *name, struct Bench_Client *clients, int sessions, int active, int seconds, int phase)
+{
+	static int all[BENCH_MAX_SAMPLES*4];
+	unsigned long wakeups;
+	double cpu;
+	long start,elapsed;
+	long requests = 0;
+	int count = 0;
+	int i,j;
+
+	for(i=0;i<sessions;++i)
+	{
+		clients[i].count = 0;
+		clients[i].requests = 0;
+	}
+	Bench_Active = active;
+	wakeups = Bench_Wakeups;
+	cpu = Bench_ChainCpuTime();
+	start = Bench_Microseconds();
+	Bench_Phase = phase;
+	sleep(seconds);
+	Bench_Phase = -1;
+	Bench_WaitClients(clients,sessions,phase);
+	elapsed = Bench_Microseconds()-start;
+	wakeups = Bench_Wakeups-wakeups;
+	cpu = Bench_ChainCpuTime()-cpu;
+
+	for(i=0;i<sessions;++i)
+	{
+		if(clients[i].failed!=0)
+		{
+			fprintf(stderr,"%s: session %d failed\n",name,i);
+			return(-1);
+		}
+		requests += clients[i].requests;
+		for(j=0;j<clients[i].count && count<(int)(sizeof(all)/sizeof(all[0]));++j)
+		{
+			all[count++] = clients[i].samples[j];
+		}
+	}
+	qsort(all,count,sizeof(int),&Bench_Compare);
+
+	printf("%-10s %9.0f %11.0f %9.2f",name,requests*1000000.0/elapsed,wakeups*1000000.0/elapsed,wakeups!=0?cpu*1000000.0/wakeups:0);
+	if(count>0)
+	{
+		printf(" %8d %8d %8d\n",all[count/2],all[count*99/100],all[count-1]);
+	}
+	else
+	{
+		printf(" %8s %8s %8s\n","-","-","-");
+	}
+	fflush(stdout);
+	return(0);
+}
+
+int main(int argc, char **argv)
+{
+	struct Bench_Counter *counter;
+	struct Bench_Client *clients;
+	void *server;
+	int sessions = argc>1?atoi(argv[1]):50;
+	int seconds = argc>2?atoi(argv[2]):3;
+	char name[32];
+	int i;
+	int ret = 0;
+
+	if(sessions<=0 || seconds<=0)
+	{
+		fprintf(stderr,"Usage: %s [sessions] [seconds per phase]\n",argv[0]);
+		return(1);
+	}
+
+	Bench_Chain = ILibCreateChain();
+	counter = (struct Bench_Counter*)malloc(sizeof(struct Bench_Counter));
+	memset(counter,0,sizeof(struct Bench_Counter));
+	counter->PreSelect = &Bench_CounterPreSelect;
+	ILibAddToChain(Bench_Chain,counter);
+	server = ILibWebServer_Create(Bench_Chain,sessions+5,0,&Bench_OnSession,NULL);
+	Bench_Port = ILibWebServer_GetPortNumber(server);
+	Bench_Phase = -1;
+	pthread_create(&Bench_ChainThreadId,NULL,&Bench_ChainThread,NULL);
+
+	clients = (struct Bench_Client*)malloc(sessions*sizeof(struct Bench_Client));
+	memset(clients,0,sessions*sizeof(struct Bench_Client));
+	for(i=0;i<sessions;++i)
+	{
+		clients[i].index = i;
+		clients[i].phase = -1;
+		clients[i].samples = (int*)malloc(BENCH_MAX_SAMPLES*sizeof(int));
+		pthread_create(&clients[i].thread,NULL,&Bench_ClientThread,&clients[i]);
+		// Connect one by one, the listen backlog of ILibAsyncServerSocket is short
+		while(clients[i].ready==0 && clients[i].failed==0)
+		{
+			usleep(1000);
+		}
+	}
+
+	printf("%s loop, %d sessions, %d s per phase\n",BENCH_LOOP,sessions,seconds);
+	printf("%-10s %9s %11s %9s %8s %8s %8s\n","active","req/s","wakeups/s","us/wakeup","p50 us","p99 us","max us");
+	sprintf(name,"%d",sessions);
+	ret |= Bench_RunPhase(name,clients,sessions,sessions,seconds,0);
+	ret |= Bench_RunPhase("1",clients,sessions,1,seconds,1);
+	ret |= Bench_RunPhase("0",clients,sessions,0,seconds,2);
+
+	Bench_Quit = 1;
+	for(i=0;i<sessions;++i)
+	{
+		pthread_join(clients[i].thread,NULL);
+		free(clients[i].samples);
+	}
+	free(clients);
+	ILibStopChain(Bench_Chain);
+	pthread_join(Bench_ChainThreadId,NULL);
+	return(ret==0?0:1);
+}
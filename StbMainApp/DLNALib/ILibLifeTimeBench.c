@@ -0,0 +1,411 @@
+/*
+ ILibLifeTimeBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file ILibLifeTimeBench.c Micro-benchmark of ILibLifeTime
+ * Compares the heap of ILibLifeTime with the sorted linked list it replaced,
+ * which is kept here as List_*. For each number of pending triggers it
+ * measures adding them, refreshing (remove and add again, like SSDP cache
+ * entries do), a chain iteration with nothing expired, and firing them all.
+ * Order of fired triggers and destroy callbacks of removed ones are checked.
+ *
+ * Usage: ILibLifeTimeBench [triggers...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ILibParsers.h"
+
+#define BENCH_REFRESHES 10000
+#define BENCH_CHECKS    1000
+#define BENCH_MAX_DELAY 1800000
+
+struct Bench_Object
+{
+	int delay;
+	unsigned long due;
+	int fired;
+	int destroyed;
+};
+
+static struct Bench_Object *Bench_Objects;
+static unsigned long Bench_LastDue;
+static int Bench_Errors;
+
+// PreSelect of the ILibLifeTime module, the chain is never started
+void ILibLifeTime_Check(void *LifeTimeMonitorObject,void *readset, void *writeset, void *errorset, int* blocktime);
+
+static unsigned long Bench_Tick()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return((tv.tv_sec*1000) + (tv.tv_usec/1000));
+}
+static void Bench_OnFire(void *obj)
+{
+	struct Bench_Object *o = (struct Bench_Object*)obj;
+
+	// Tick may be taken a millisecond apart from the one of the implementation
+	if(o->due+1<Bench_LastDue)
+	{
+		++Bench_Errors;
+	}
+	Bench_LastDue = o->due;
+	++o->fired;
+}
+static void Bench_OnDestroy(void *obj)
+{
+	++((struct Bench_Object*)obj)->destroyed;
+}
+
+//
+// The sorted list ILibLifeTime used before
+//
+struct List_Data
+{
+	unsigned long ExpirationTick;
+	void *data;
+	ILibLifeTime_OnCallback CallbackPtr;
+	ILibLifeTime_OnCallback DestroyPtr;
+};
+struct List_LifeTime
+{
+	void *ObjectList;
+	void *Reserved;
+};
+
+static void List_AddEx(struct List_LifeTime *lt, void *data, int ms, ILibLifeTime_OnCallback Callback, ILibLifeTime_OnCallback Destroy)
+{
+	struct timeval tv;
+	struct List_Data *temp;
+	struct List_Data *ltms = (struct List_Data*)malloc(sizeof(struct List_Data));
+	void *node;
+
+	gettimeofday(&tv,NULL);
+	ltms->data = data;
+	ltms->ExpirationTick = (tv.tv_sec*1000) + (tv.tv_usec/1000) + ms;
+	ltms->CallbackPtr = Callback;
+	ltms->DestroyPtr = Destroy;
+
+	ILibLinkedList_Lock(lt->ObjectList);
+	node = ILibLinkedList_GetNode_Head(lt->ObjectList);
+	while(node!=NULL)
+	{
+		temp = (struct List_Data*)ILibLinkedList_GetDataFromNode(node);
+		if(ltms->ExpirationTick<=temp->ExpirationTick)
+		{
+			ILibLinkedList_InsertBefore(node,ltms);
+			break;
+		}
+		node = ILibLinkedList_GetNextNode(node);
+	}
+	if(node==NULL)
+	{
+		ILibLinkedList_AddTail(lt->ObjectList,ltms);
+	}
+	ILibLinkedList_UnLock(lt->ObjectList);
+}
+static void List_Check(struct List_LifeTime *lt, int *blocktime)
+{
+	struct timeval tv;
+	unsigned long CurrentTick;
+	struct List_Data *Temp;
+	void *node;
+	void *EventQueue = ILibQueue_Create();
+	int removed;
+
+	gettimeofday(&tv,NULL);
+	CurrentTick = (tv.tv_sec*1000) + (tv.tv_usec/1000);
+
+	ILibLinkedList_Lock(lt->ObjectList);
+	ILibLinkedList_Lock(lt->Reserved);
+	while(ILibQueue_DeQueue(lt->Reserved)!=NULL);
+	node = ILibLinkedList_GetNode_Head(lt->ObjectList);
+	while(node!=NULL)
+	{
+		Temp = (struct List_Data*)ILibLinkedList_GetDataFromNode(node);
+		if(Temp->ExpirationTick<CurrentTick)
+		{
+			ILibQueue_EnQueue(EventQueue,Temp);
+			node = ILibLinkedList_Remove(node);
+		}
+		else
+		{
+			node = ILibLinkedList_GetNextNode(node);
+		}
+	}
+	ILibLinkedList_UnLock(lt->Reserved);
+	ILibLinkedList_UnLock(lt->ObjectList);
+
+	while((Temp = (struct List_Data*)ILibQueue_DeQueue(EventQueue))!=NULL)
+	{
+		ILibLinkedList_Lock(lt->Reserved);
+		removed = ILibLinkedList_Remove_ByData(lt->Reserved,Temp);
+		ILibLinkedList_UnLock(lt->Reserved);
+		if(removed==0)
+		{
+			Temp->CallbackPtr(Temp->data);
+		}
+		else if(Temp->DestroyPtr!=NULL)
+		{
+			Temp->DestroyPtr(Temp->data);
+		}
+		free(Temp);
+	}
+	ILibQueue_Destroy(EventQueue);
+
+	ILibLinkedList_Lock(lt->ObjectList);
+	if(ILibLinkedList_GetNode_Head(lt->ObjectList)!=NULL)
+	{
+		int nexttick = ((struct List_Data*)ILibLinkedList_GetDataFromNode(ILibLinkedList_GetNode_Head(lt->ObjectList)))->ExpirationTick - CurrentTick;
+		if(nexttick<*blocktime) {*blocktime=nexttick;}
+	}
+	ILibLinkedList_UnLock(lt->ObjectList);
+}
+static void List_Remove(struct List_LifeTime *lt, void *data)
+{
+	struct List_Data *evt;
+	void *node;
+	void *EventQueue = ILibQueue_Create();
+	int removed = 0;
+
+	ILibLinkedList_Lock(lt->ObjectList);
+	node = ILibLinkedList_GetNode_Head(lt->ObjectList);
+	if(node!=NULL)
+	{
+		while(node!=NULL)
+		{
+			evt = (struct List_Data*)ILibLinkedList_GetDataFromNode(node);
+			if(evt->data==data)
+			{
+				ILibQueue_EnQueue(EventQueue,evt);
+				node = ILibLinkedList_Remove(node);
+				removed = 1;
+			}
+			else
+			{
+				node = ILibLinkedList_GetNextNode(node);
+			}
+		}
+		if(removed==0)
+		{
+			ILibLinkedList_Lock(lt->Reserved);
+			ILibLinkedList_AddTail(lt->Reserved,data);
+			ILibLinkedList_UnLock(lt->Reserved);
+		}
+	}
+	ILibLinkedList_UnLock(lt->ObjectList);
+
+	while((evt = (struct List_Data*)ILibQueue_DeQueue(EventQueue))!=NULL)
+	{
+		if(evt->DestroyPtr!=NULL) {evt->DestroyPtr(evt->data);}
+		free(evt);
+	}
+	ILibQueue_Destroy(EventQueue);
+}
+
+//
+// Both implementations behind one interface
+//
+struct Bench_Impl
+{
+	const char *name;
+	void *(*Create)(void *chain);
+	void (*Add)(void *lt, void *data, int ms);
+	void (*Remove)(void *lt, void *data);
+	void (*Check)(void *lt, int *blocktime);
+	void (*Destroy)(void *lt);
+};
+
+static void *Heap_Create(void *chain)
+{
+	return(ILibCreateLifeTime(chain));
+}
+static void Heap_Add(void *lt, void *data, int ms)
+{
+	ILibLifeTime_AddEx(lt,data,ms,&Bench_OnFire,&Bench_OnDestroy);
+}
+static void Heap_Check(void *lt, int *blocktime)
+{
+	ILibLifeTime_Check(lt,NULL,NULL,NULL,blocktime);
+}
+static void Heap_Destroy(void *lt)
+{
+	ILibLifeTime_Flush(lt);
+}
+
+static void *List_Create(void *chain)
+{
+	struct List_LifeTime *lt = (struct List_LifeTime*)malloc(sizeof(struct List_LifeTime));
+	lt->ObjectList = ILibLinkedList_Create();
+	lt->Reserved = ILibQueue_Create();
+	return(lt);
+}
+static void List_Add(void *lt, void *data, int ms)
+{
+	List_AddEx((struct List_LifeTime*)lt,data,ms,&Bench_OnFire,&Bench_OnDestroy);
+}
+static void List_RemoveData(void *lt, void *data)
+{
+	List_Remove((struct List_LifeTime*)lt,data);
+}
+static void List_CheckAll(void *lt, int *blocktime)
+{
+	List_Check((struct List_LifeTime*)lt,blocktime);
+}
+static void List_Destroy(void *lt)
+{
+	struct List_Data *temp;
+
+	while((temp = (struct List_Data*)ILibQueue_DeQueue(((struct List_LifeTime*)lt)->ObjectList))!=NULL)
+	{
+		free(temp);
+	}
+	ILibLinkedList_Destroy(((struct List_LifeTime*)lt)->ObjectList);
+	ILibQueue_Destroy(((struct List_LifeTime*)lt)->Reserved);
+	free(lt);
+}
+
+static const struct Bench_Impl Bench_Impls[] =
+{
+	{"list",&List_Create,&List_Add,&List_RemoveData,&List_CheckAll,&List_Destroy},
+	{"heap",&Heap_Create,&Heap_Add,&ILibLifeTime_Remove,&Heap_Check,&Heap_Destroy}
+};
+
+static double Bench_Now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return(tv.tv_sec*1000000000.0+tv.tv_usec*1000.0);
+}
+
+static int Bench_Run(const struct Bench_Impl *impl, void *chain, int count)
+{
+	void *lt = impl->Create(chain);
+	double t,add,refresh,check,fire;
+	int blocktime;
+	int scale = count<5000?5000/count:1;
+	int destroyed = 0;
+	int fired = 0;
+	int i,j;
+
+	memset(Bench_Objects,0,count*sizeof(struct Bench_Object));
+	srand(count);
+
+	// Pending triggers with delays of up to half an hour
+	t = Bench_Now();
+	for(i=0;i<count;++i)
+	{
+		Bench_Objects[i].delay = BENCH_MAX_DELAY/2+rand()%(BENCH_MAX_DELAY/2);
+		impl->Add(lt,&Bench_Objects[i],Bench_Objects[i].delay);
+	}
+	add = (Bench_Now()-t)/count;
+
+	t = Bench_Now();
+	for(j=0;j<BENCH_REFRESHES;++j)
+	{
+		i = rand()%count;
+		impl->Remove(lt,&Bench_Objects[i]);
+		impl->Add(lt,&Bench_Objects[i],Bench_Objects[i].delay);
+	}
+	refresh = (Bench_Now()-t)/BENCH_REFRESHES;
+
+	t = Bench_Now();
+	for(j=0;j<BENCH_CHECKS;++j)
+	{
+		blocktime = BENCH_MAX_DELAY;
+		impl->Check(lt,&blocktime);
+	}
+	check = (Bench_Now()-t)/BENCH_CHECKS;
+
+	// Replace all of them with short triggers and let them fire
+	for(i=0;i<count;++i)
+	{
+		impl->Remove(lt,&Bench_Objects[i]);
+		Bench_Objects[i].delay = rand()%count;
+	}
+	for(i=0;i<count;++i)
+	{
+		Bench_Objects[i].due = Bench_Tick()+Bench_Objects[i].delay*scale/10;
+		impl->Add(lt,&Bench_Objects[i],Bench_Objects[i].delay*scale/10);
+	}
+	usleep((count*scale/10+10)*1000);
+	Bench_LastDue = 0;
+	t = Bench_Now();
+	blocktime = BENCH_MAX_DELAY;
+	impl->Check(lt,&blocktime);
+	fire = (Bench_Now()-t)/count;
+
+	for(i=0;i<count;++i)
+	{
+		fired += Bench_Objects[i].fired;
+		destroyed += Bench_Objects[i].destroyed;
+	}
+	if(fired!=count || destroyed!=BENCH_REFRESHES+count || Bench_Errors!=0)
+	{
+		fprintf(stderr,"%s: %d triggers fired of %d, %d destroyed of %d, %d out of order\n",impl->name,fired,count,destroyed,BENCH_REFRESHES+count,Bench_Errors);
+		return(-1);
+	}
+	impl->Destroy(lt);
+
+	printf("%-5s %8d %9.0f %9.0f %9.0f %9.0f\n",impl->name,count,add,refresh,check,fire);
+	return(0);
+}
+
+int main(int argc, char **argv)
+{
+	static const int defaultCounts[] = {100,1000,10000};
+	void *chain = ILibCreateChain();
+	int count;
+	int i,k;
+	int ret = 0;
+
+	printf("%-5s %8s %9s %9s %9s %9s\n","impl","triggers","add ns","refresh","check ns","fire ns");
+	for(i=0;i<(argc>1?argc-1:(int)(sizeof(defaultCounts)/sizeof(defaultCounts[0])));++i)
+	{
+		count = argc>1?atoi(argv[i+1]):defaultCounts[i];
+		if(count<=0)
+		{
+			fprintf(stderr,"Usage: %s [triggers...]\n",argv[0]);
+			return(1);
+		}
+		Bench_Objects = (struct Bench_Object*)malloc(count*sizeof(struct Bench_Object));
+		for(k=0;k<(int)(sizeof(Bench_Impls)/sizeof(Bench_Impls[0]));++k)
+		{
+			ret |= Bench_Run(&Bench_Impls[k],chain,count);
+		}
+		free(Bench_Objects);
+	}
+	ILibChain_DestroyEx(chain);
+	return(ret==0?0:1);
+}
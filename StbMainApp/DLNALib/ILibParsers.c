@@ -58,6 +58,16 @@
 	#include <crtdbg.h>
 #endif
 #include "ILibParsers.h"
+
+//
+// On Linux the chain waits with epoll instead of select, define ILIB_CHAIN_SELECT
+// to build the select loop only
+//
+#if defined(_POSIX) && defined(__linux__) && !defined(ILIB_CHAIN_SELECT)
+	#define ILIB_CHAIN_EPOLL
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+#endif
 #define DEBUGSTATEMENT(x)
 #define MINPORTNUMBER 50000
 #define PORTNUMBERRANGE 15000
@@ -333,21 +343,37 @@ struct ILibChain_SubChain
 struct LifeTimeMonitorData
 {
 	unsigned long ExpirationTick;
+	unsigned long Sequence;
 	void *data;
 	ILibLifeTime_OnCallback CallbackPtr;
 	ILibLifeTime_OnCallback DestroyPtr;
+
+	int HeapIndex;
+	int Removed;
+	struct LifeTimeMonitorData *NextInBucket;
+	struct LifeTimeMonitorData *NextFired;
 };
+//
+// Pending triggers are kept in a binary heap ordered by expiration, and in a hash
+// by data object for ILibLifeTime_Remove. Entries come from a pool that only grows.
+//
 struct ILibLifeTime
 {
 	ILibChain_PreSelect PreSelect;
 	ILibChain_PostSelect PostSelect;
 	ILibChain_Destroy Destroy;
-	struct LifeTimeMonitorData *LM;
 	void *Chain;
 
-	void *Reserved;
-
-	void *ObjectList;
+	sem_t Lock;
+	struct LifeTimeMonitorData **Heap;
+	int HeapSize;
+	int HeapCapacity;
+	struct LifeTimeMonitorData **Buckets;
+	int BucketCount;
+	int Count;
+	struct LifeTimeMonitorData *Free;
+	struct ILibLifeTime_Block *Blocks;
+	unsigned long Sequence;
 };
 
 struct ILibBaseChain_SafeData
@@ -356,6 +382,35 @@ struct ILibBaseChain_SafeData
 	void *Object;
 };
 
+#if defined(ILIB_CHAIN_EPOLL)
+#define ILibChainPoll_MAXEVENTS 64
+#define ILibChainPoll_WORDS (sizeof(fd_set)/sizeof(unsigned long))
+#define ILibChainPoll_WORDBITS (8*sizeof(unsigned long))
+
+//
+// Epoll state of a running chain. Modules still describe their interest with
+// PreSelect, but descriptors stay registered between iterations, so only the
+// ones whose interest changed cost a system call
+//
+struct ILibChainPoll
+{
+	int EpollFd;
+	int EventFd;
+	unsigned int CloseCount;
+	fd_set Registered[3];
+	unsigned char Generation[FD_SETSIZE];
+	struct epoll_event Events[ILibChainPoll_MAXEVENTS];
+};
+
+//
+// Bumped by ILibChain_CloseSocket. The kernel drops a closed socket from every
+// epoll set, so a registration is only valid while the generation of its
+// descriptor is unchanged
+//
+static unsigned char ILibChainSocketGeneration[FD_SETSIZE];
+static unsigned int ILibChainSocketCloseCount = 0;
+#endif
+
 struct ILibBaseChain
 {
 	int TerminateFlag;
@@ -366,6 +421,9 @@ struct ILibBaseChain
 	FILE *TerminateReadPipe;
 	FILE *TerminateWritePipe;
 #endif
+#if defined(ILIB_CHAIN_EPOLL)
+	struct ILibChainPoll *Poll;
+#endif
 #if defined(__SYMBIAN32__)
 	void *SymbianAdaptor;
 	ILibOnChainStopped OnChainStoppedHandler;
@@ -583,6 +641,16 @@ void ILibForceUnBlockChain(void *Chain)
 #elif defined(__SYMBIAN32__)
 	ILibChainAdaptor_ForceUnBlock(c->SymbianAdaptor);	
 #else
+	#if defined(ILIB_CHAIN_EPOLL)
+	//
+	// Incrementing the event counter will trigger the epoll_wait
+	//
+	if(c->Poll!=NULL)
+	{
+		eventfd_write(c->Poll->EventFd,1);
+	}
+	else
+	#endif
 	//
 	// Writing data on the pipe will trigger the select on Posix
 	//
@@ -594,6 +662,31 @@ void ILibForceUnBlockChain(void *Chain)
 #endif
 	sem_post(&ILibChainLock);
 }
+#if defined(_POSIX)
+/*! \fn ILibChain_CloseSocket(int socket)
+	\brief Closes a socket that was set in the fd_sets of PreSelect
+	\par
+	The epoll loop of the chain keeps sockets registered between iterations. Modules
+	must close such sockets with this method, so the chain notices that the descriptor
+	number may be reused by a new socket.
+	\param socket The socket to close
+*/
+void ILibChain_CloseSocket(int socket)
+{
+#if defined(ILIB_CHAIN_EPOLL)
+	sem_wait(&ILibChainLock);
+	if(socket>=0 && socket<FD_SETSIZE)
+	{
+		++ILibChainSocketGeneration[socket];
+		++ILibChainSocketCloseCount;
+	}
+	close(socket);
+	sem_post(&ILibChainLock);
+#else
+	close(socket);
+#endif
+}
+#endif
 void ILibChain_SubChain_Destroy(void *object)
 {
 	struct ILibChain_SubChain *c = (struct ILibChain_SubChain*)object;
@@ -851,6 +944,251 @@ void ILibChain_OnDestroy(void *sender)
 {
 }
 #endif
+#if defined(ILIB_CHAIN_EPOLL)
+//
+// Brings the epoll registration of a descriptor in line with the fd_sets of PreSelect.
+// Descriptors epoll can't wait for are added to failed, and reported ready like select does
+//
+static int ILibChain_PollUpdate(struct ILibChainPoll *p, int fd, fd_set *sets, fd_set *failed)
+{
+	static const unsigned int events[3] = {EPOLLIN, EPOLLOUT, EPOLLPRI};
+	struct epoll_event ev;
+	unsigned int oldEvents = 0;
+	int op;
+	int k;
+	int RetVal = 0;
+
+	memset(&ev,0,sizeof(ev));
+	ev.data.fd = fd;
+	for(k=0;k<3;++k)
+	{
+		if(FD_ISSET(fd,&p->Registered[k])) {oldEvents |= events[k];}
+		if(FD_ISSET(fd,&sets[k])) {ev.events |= events[k];}
+	}
+	op = oldEvents==0?EPOLL_CTL_ADD:(ev.events==0?EPOLL_CTL_DEL:EPOLL_CTL_MOD);
+	if(epoll_ctl(p->EpollFd,op,fd,&ev)!=0 && op!=EPOLL_CTL_DEL)
+	{
+		//
+		// The kernel may know the descriptor better than we do, if it was
+		// closed or duplicated behind our back
+		//
+		op = errno==EEXIST?EPOLL_CTL_MOD:(errno==ENOENT?EPOLL_CTL_ADD:-1);
+		if(op<0 || epoll_ctl(p->EpollFd,op,fd,&ev)!=0)
+		{
+			for(k=0;k<3;++k)
+			{
+				if(FD_ISSET(fd,&sets[k])) {FD_SET(fd,&failed[k]);}
+			}
+			ev.events = 0;
+			RetVal = 1;
+		}
+	}
+	for(k=0;k<3;++k)
+	{
+		if((ev.events&events[k])!=0)
+		{
+			FD_SET(fd,&p->Registered[k]);
+		}
+		else
+		{
+			FD_CLR(fd,&p->Registered[k]);
+		}
+	}
+	p->Generation[fd] = ILibChainSocketGeneration[fd];
+	return(RetVal);
+}
+//
+// Updates registrations of descriptors whose interest changed since the previous
+// iteration. Must be called with ILibChainLock held, returns the number of failed descriptors
+//
+static int ILibChain_PollSync(struct ILibChainPoll *p, fd_set *sets, fd_set *failed)
+{
+	unsigned long *r = (unsigned long*)&sets[0];
+	unsigned long *w = (unsigned long*)&sets[1];
+	unsigned long *e = (unsigned long*)&sets[2];
+	unsigned long *R = (unsigned long*)&p->Registered[0];
+	unsigned long *W = (unsigned long*)&p->Registered[1];
+	unsigned long *E = (unsigned long*)&p->Registered[2];
+	unsigned long diff;
+	unsigned int i;
+	int fd;
+	int RetVal = 0;
+
+	FD_ZERO(&failed[0]);
+	FD_ZERO(&failed[1]);
+	FD_ZERO(&failed[2]);
+
+	if(p->CloseCount!=ILibChainSocketCloseCount)
+	{
+		//
+		// Forget registrations of sockets that were closed since the last check
+		//
+		for(i=0;i<ILibChainPoll_WORDS;++i)
+		{
+			for(diff=R[i]|W[i]|E[i],fd=i*ILibChainPoll_WORDBITS;diff!=0;diff>>=1,++fd)
+			{
+				if((diff&1)!=0 && p->Generation[fd]!=ILibChainSocketGeneration[fd])
+				{
+					FD_CLR(fd,&p->Registered[0]);
+					FD_CLR(fd,&p->Registered[1]);
+					FD_CLR(fd,&p->Registered[2]);
+				}
+			}
+		}
+		p->CloseCount = ILibChainSocketCloseCount;
+	}
+
+	for(i=0;i<ILibChainPoll_WORDS;++i)
+	{
+		for(diff=(r[i]^R[i])|(w[i]^W[i])|(e[i]^E[i]),fd=i*ILibChainPoll_WORDBITS;diff!=0;diff>>=1,++fd)
+		{
+			if((diff&1)!=0)
+			{
+				RetVal += ILibChain_PollUpdate(p,fd,sets,failed);
+			}
+		}
+	}
+	return(RetVal);
+}
+//
+// The main loop of ILibStartChain on Linux. Returns -1 without running if the
+// kernel doesn't support epoll or eventfd, so the select loop can be used instead
+//
+static int ILibChain_PollLoop(void *Chain)
+{
+	struct ILibBaseChain *chain = (struct ILibBaseChain*)Chain;
+	struct ILibBaseChain *c;
+	struct ILibChainPoll *p;
+	struct epoll_event ev;
+	fd_set sets[3];
+	fd_set failed[3];
+	eventfd_t value;
+	unsigned long *dst,*src;
+	unsigned int i;
+	int failedCount;
+	int timeout;
+	int slct;
+	int fd;
+	int k;
+
+	if((p = (struct ILibChainPoll*)malloc(sizeof(struct ILibChainPoll)))==NULL)
+	{
+		return(-1);
+	}
+	memset(p,0,sizeof(struct ILibChainPoll));
+	p->EpollFd = epoll_create(ILibChainPoll_MAXEVENTS);
+	p->EventFd = eventfd(0,0);
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = p->EventFd;
+	if(p->EpollFd<0 || p->EventFd<0 || epoll_ctl(p->EpollFd,EPOLL_CTL_ADD,p->EventFd,&ev)!=0)
+	{
+		if(p->EpollFd>=0) {close(p->EpollFd);}
+		if(p->EventFd>=0) {close(p->EventFd);}
+		free(p);
+		return(-1);
+	}
+	//
+	// We need to set the eventfd to nonblock, so we can blindly empty it
+	//
+	fcntl(p->EventFd,F_SETFL,O_NONBLOCK|fcntl(p->EventFd,F_GETFL,0));
+
+	sem_wait(&ILibChainLock);
+	p->CloseCount = ILibChainSocketCloseCount;
+	chain->Poll = p;
+	sem_post(&ILibChainLock);
+
+	chain->RunningFlag = 1;
+	while(chain->TerminateFlag==0)
+	{
+		FD_ZERO(&sets[0]);
+		FD_ZERO(&sets[1]);
+		FD_ZERO(&sets[2]);
+		timeout = UPNP_MAX_WAIT*1000;
+
+		//
+		// Iterate through all the PreSelect function pointers in the chain
+		//
+		c = chain;
+		while(c!=NULL && c->Object!=NULL)
+		{
+			if(((struct ILibChain*)c->Object)->PreSelect!=NULL)
+			{
+				((struct ILibChain*)c->Object)->PreSelect(c->Object,&sets[0],&sets[1],&sets[2],&timeout);
+			}
+			c = c->Next;
+		}
+
+		sem_wait(&ILibChainLock);
+		failedCount = ILibChain_PollSync(p,sets,failed);
+		sem_post(&ILibChainLock);
+
+		slct = epoll_wait(p->EpollFd,p->Events,ILibChainPoll_MAXEVENTS,(failedCount!=0 || timeout<0)?0:timeout);
+
+		//
+		// Translate the events back to fd_sets, with the same conditions select uses
+		//
+		FD_ZERO(&sets[0]);
+		FD_ZERO(&sets[1]);
+		FD_ZERO(&sets[2]);
+		for(k=0;k<slct;++k)
+		{
+			fd = p->Events[k].data.fd;
+			if(fd==p->EventFd)
+			{
+				eventfd_read(fd,&value);
+				continue;
+			}
+			if((p->Events[k].events&(EPOLLIN|EPOLLHUP|EPOLLERR))!=0 && FD_ISSET(fd,&p->Registered[0]))
+			{
+				FD_SET(fd,&sets[0]);
+			}
+			if((p->Events[k].events&(EPOLLOUT|EPOLLERR))!=0 && FD_ISSET(fd,&p->Registered[1]))
+			{
+				FD_SET(fd,&sets[1]);
+			}
+			if((p->Events[k].events&EPOLLPRI)!=0 && FD_ISSET(fd,&p->Registered[2]))
+			{
+				FD_SET(fd,&sets[2]);
+			}
+		}
+		if(failedCount!=0 && slct>=0)
+		{
+			for(k=0;k<3;++k)
+			{
+				dst = (unsigned long*)&sets[k];
+				src = (unsigned long*)&failed[k];
+				for(i=0;i<ILibChainPoll_WORDS;++i)
+				{
+					dst[i] |= src[i];
+				}
+			}
+			slct += failedCount;
+		}
+
+		//
+		// Iterate through all of the PostSelect in the chain
+		//
+		c = chain;
+		while(c!=NULL && c->Object!=NULL)
+		{
+			if(((struct ILibChain*)c->Object)->PostSelect!=NULL)
+			{
+				((struct ILibChain*)c->Object)->PostSelect(c->Object,slct,&sets[0],&sets[1],&sets[2]);
+			}
+			c = c->Next;
+		}
+	}
+
+	sem_wait(&ILibChainLock);
+	chain->Poll = NULL;
+	sem_post(&ILibChainLock);
+	close(p->EventFd);
+	close(p->EpollFd);
+	free(p);
+	return(0);
+}
+#endif
 /*! \fn ILibStartChain(void *Chain)
 	\brief Starts a Chain
 	\par
@@ -902,8 +1240,15 @@ void ILibStartChain(void *Chain)
 	FD_ZERO(&errorset);
 	FD_ZERO(&writeset);
 	
+#if defined(ILIB_CHAIN_EPOLL)
+	//
+	// The epoll loop returns when the chain is stopped, so the select loop below is skipped
+	//
+	if(ILibChain_PollLoop(Chain)!=0)
+#endif
 #if !defined(__SYMBIAN32__)
 	#if !defined(WIN32) && !defined(_WIN32_WCE)
+	{
 		// 
 		// For posix, we need to use a pipe to force unblock the select loop
 		//
@@ -915,6 +1260,7 @@ void ILibStartChain(void *Chain)
 		fcntl(TerminatePipe[0],F_SETFL,O_NONBLOCK|flags);
 		((struct ILibBaseChain*)Chain)->TerminateReadPipe = fdopen(TerminatePipe[0],"r");
 		((struct ILibBaseChain*)Chain)->TerminateWritePipe = fdopen(TerminatePipe[1],"w");
+	}
 	#endif
 #endif
 
@@ -1071,8 +1417,11 @@ void ILibStartChain(void *Chain)
 	//
 	// Free the pipe resources
 	//
-	fclose(c->TerminateReadPipe);
-	fclose(c->TerminateWritePipe);
+	if(c->TerminateReadPipe!=NULL)
+	{
+		fclose(c->TerminateReadPipe);
+		fclose(c->TerminateWritePipe);
+	}
 	c->TerminateReadPipe=0;
 	c->TerminateWritePipe=0;
 #endif
@@ -4162,6 +4511,192 @@ int ILibXmlEscape(char* outdata, const char* indata)
 	return (int)(out - outdata);
 }
 
+//
+// Entries are taken from blocks of this many, and never returned to the heap allocator
+// until the ILibLifeTime is destroyed
+//
+#define ILibLifeTime_BLOCK_SIZE 64
+#define ILibLifeTime_MIN_BUCKETS 64
+
+struct ILibLifeTime_Block
+{
+	struct ILibLifeTime_Block *Next;
+	struct LifeTimeMonitorData Entries[ILibLifeTime_BLOCK_SIZE];
+};
+
+//
+// Returns nonzero if a has to be triggered before b. Ticks are compared by difference,
+// so wrap around of 32 bit tick counts is harmless. Of equal ticks the entry added last
+// is triggered first, as the sorted list of older versions did.
+//
+static int ILibLifeTime_Before(struct LifeTimeMonitorData *a, struct LifeTimeMonitorData *b)
+{
+	long d = (long)(a->ExpirationTick - b->ExpirationTick);
+	if(d!=0)
+	{
+		return(d<0);
+	}
+	return((long)(a->Sequence - b->Sequence)>0);
+}
+static void ILibLifeTime_HeapUp(struct ILibLifeTime *lt, int i)
+{
+	struct LifeTimeMonitorData *e = lt->Heap[i];
+	int parent;
+
+	while(i>0)
+	{
+		parent = (i-1)/2;
+		if(!ILibLifeTime_Before(e,lt->Heap[parent]))
+		{
+			break;
+		}
+		lt->Heap[i] = lt->Heap[parent];
+		lt->Heap[i]->HeapIndex = i;
+		i = parent;
+	}
+	lt->Heap[i] = e;
+	e->HeapIndex = i;
+}
+static void ILibLifeTime_HeapDown(struct ILibLifeTime *lt, int i)
+{
+	struct LifeTimeMonitorData *e = lt->Heap[i];
+	int child;
+
+	while((child = 2*i+1)<lt->HeapSize)
+	{
+		if(child+1<lt->HeapSize && ILibLifeTime_Before(lt->Heap[child+1],lt->Heap[child]))
+		{
+			++child;
+		}
+		if(!ILibLifeTime_Before(lt->Heap[child],e))
+		{
+			break;
+		}
+		lt->Heap[i] = lt->Heap[child];
+		lt->Heap[i]->HeapIndex = i;
+		i = child;
+	}
+	lt->Heap[i] = e;
+	e->HeapIndex = i;
+}
+//
+// Takes an entry out of the heap, it stays in its hash bucket
+//
+static void ILibLifeTime_HeapRemove(struct ILibLifeTime *lt, struct LifeTimeMonitorData *e)
+{
+	int i = e->HeapIndex;
+	struct LifeTimeMonitorData *last = lt->Heap[--lt->HeapSize];
+
+	e->HeapIndex = -1;
+	if(last!=e)
+	{
+		lt->Heap[i] = last;
+		last->HeapIndex = i;
+		if(i>0 && ILibLifeTime_Before(last,lt->Heap[(i-1)/2]))
+		{
+			ILibLifeTime_HeapUp(lt,i);
+		}
+		else
+		{
+			ILibLifeTime_HeapDown(lt,i);
+		}
+	}
+}
+
+static unsigned int ILibLifeTime_Hash(struct ILibLifeTime *lt, void *data)
+{
+	unsigned long key = (unsigned long)data;
+	key ^= key>>16;
+	key *= 0x45d9f3bUL;
+	key ^= key>>16;
+	return((unsigned int)key & (lt->BucketCount-1));
+}
+static void ILibLifeTime_HashRemove(struct ILibLifeTime *lt, struct LifeTimeMonitorData *e)
+{
+	struct LifeTimeMonitorData **p = &lt->Buckets[ILibLifeTime_Hash(lt,e->data)];
+
+	while(*p!=e)
+	{
+		p = &(*p)->NextInBucket;
+	}
+	*p = e->NextInBucket;
+	--lt->Count;
+}
+//
+// Doubles the hash table, so lookups stay short as more triggers are added
+//
+static int ILibLifeTime_Grow(struct ILibLifeTime *lt)
+{
+	struct LifeTimeMonitorData **old = lt->Buckets;
+	struct LifeTimeMonitorData *e,*next;
+	int oldCount = lt->BucketCount;
+	int i;
+	unsigned int b;
+
+	lt->Buckets = (struct LifeTimeMonitorData**)malloc(2*oldCount*sizeof(struct LifeTimeMonitorData*));
+	if(lt->Buckets==NULL)
+	{
+		lt->Buckets = old;
+		return(-1);
+	}
+	memset(lt->Buckets,0,2*oldCount*sizeof(struct LifeTimeMonitorData*));
+	lt->BucketCount = 2*oldCount;
+	for(i=0;i<oldCount;++i)
+	{
+		for(e=old[i];e!=NULL;e=next)
+		{
+			next = e->NextInBucket;
+			b = ILibLifeTime_Hash(lt,e->data);
+			e->NextInBucket = lt->Buckets[b];
+			lt->Buckets[b] = e;
+		}
+	}
+	free(old);
+	return(0);
+}
+static struct LifeTimeMonitorData* ILibLifeTime_Alloc(struct ILibLifeTime *lt)
+{
+	struct ILibLifeTime_Block *block;
+	struct LifeTimeMonitorData *RetVal;
+	int i;
+
+	if(lt->Free==NULL)
+	{
+		block = (struct ILibLifeTime_Block*)malloc(sizeof(struct ILibLifeTime_Block));
+		if(block==NULL)
+		{
+			return(NULL);
+		}
+		block->Next = lt->Blocks;
+		lt->Blocks = block;
+		for(i=0;i<ILibLifeTime_BLOCK_SIZE;++i)
+		{
+			block->Entries[i].NextInBucket = lt->Free;
+			lt->Free = &(block->Entries[i]);
+		}
+	}
+	RetVal = lt->Free;
+	lt->Free = RetVal->NextInBucket;
+	return(RetVal);
+}
+//
+// Returns entries of a list linked by NextFired to the pool
+//
+static void ILibLifeTime_Release(struct ILibLifeTime *lt, struct LifeTimeMonitorData *list)
+{
+	struct LifeTimeMonitorData *next;
+
+	sem_wait(&(lt->Lock));
+	while(list!=NULL)
+	{
+		next = list->NextFired;
+		list->NextInBucket = lt->Free;
+		lt->Free = list;
+		list = next;
+	}
+	sem_post(&(lt->Lock));
+}
+
 /*! \fn ILibLifeTime_AddEx(void *LifetimeMonitorObject,void *data, int ms, void* Callback, void* Destroy)
 	\brief Registers a timed callback with millisecond granularity
 	\param LifetimeMonitorObject The \a ILibLifeTime object to add the timed callback to
@@ -4173,24 +4708,46 @@ int ILibXmlEscape(char* outdata, const char* indata)
 void ILibLifeTime_AddEx(void *LifetimeMonitorObject,void *data, int ms, ILibLifeTime_OnCallback Callback, ILibLifeTime_OnCallback Destroy)
 {
 	struct timeval tv;
-	struct LifeTimeMonitorData *temp;
-	struct LifeTimeMonitorData *ltms = (struct LifeTimeMonitorData*)malloc(sizeof(struct LifeTimeMonitorData));
+	struct LifeTimeMonitorData *ltms;
 	struct ILibLifeTime *UPnPLifeTime = (struct ILibLifeTime*)LifetimeMonitorObject;
+	struct LifeTimeMonitorData **heap;
+	unsigned int b;
+	int first;
 
-	void *node;
-
-	memset(ltms,0,sizeof(struct LifeTimeMonitorData));
-	
 	//
 	// Get the current time for reference
 	//
 	gettimeofday(&tv,NULL);
-	
+
+	sem_wait(&(UPnPLifeTime->Lock));
+	if(UPnPLifeTime->HeapSize==UPnPLifeTime->HeapCapacity)
+	{
+		heap = (struct LifeTimeMonitorData**)realloc(UPnPLifeTime->Heap,2*UPnPLifeTime->HeapCapacity*sizeof(struct LifeTimeMonitorData*));
+		if(heap==NULL)
+		{
+			sem_post(&(UPnPLifeTime->Lock));
+			return;
+		}
+		UPnPLifeTime->Heap = heap;
+		UPnPLifeTime->HeapCapacity *= 2;
+	}
+	if(UPnPLifeTime->Count>=2*UPnPLifeTime->BucketCount)
+	{
+		ILibLifeTime_Grow(UPnPLifeTime);
+	}
+	if((ltms = ILibLifeTime_Alloc(UPnPLifeTime))==NULL)
+	{
+		sem_post(&(UPnPLifeTime->Lock));
+		return;
+	}
+	memset(ltms,0,sizeof(struct LifeTimeMonitorData));
+
 	//
 	// Set the trigger time
 	//
 	ltms->data = data;
-	ltms->ExpirationTick = (tv.tv_sec*1000) + (tv.tv_usec/1000) + ms; 
+	ltms->ExpirationTick = (tv.tv_sec*1000) + (tv.tv_usec/1000) + ms;
+	ltms->Sequence = UPnPLifeTime->Sequence++;
 
 	//
 	// Set the callback handlers
@@ -4198,35 +4755,23 @@ void ILibLifeTime_AddEx(void *LifetimeMonitorObject,void *data, int ms, ILibLife
 	ltms->CallbackPtr = Callback;
 	ltms->DestroyPtr = Destroy;
 
-	ILibLinkedList_Lock(UPnPLifeTime->ObjectList);
-	node = ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList);
-	if(node==NULL)
+	b = ILibLifeTime_Hash(UPnPLifeTime,data);
+	ltms->NextInBucket = UPnPLifeTime->Buckets[b];
+	UPnPLifeTime->Buckets[b] = ltms;
+	++UPnPLifeTime->Count;
+
+	UPnPLifeTime->Heap[UPnPLifeTime->HeapSize++] = ltms;
+	ILibLifeTime_HeapUp(UPnPLifeTime,UPnPLifeTime->HeapSize-1);
+	first = ltms->HeapIndex==0;
+	sem_post(&(UPnPLifeTime->Lock));
+
+	//
+	// The chain may be blocked longer than the new trigger allows
+	//
+	if(first)
 	{
-		ILibLinkedList_AddTail(UPnPLifeTime->ObjectList,ltms);
 		ILibForceUnBlockChain(UPnPLifeTime->Chain);
 	}
-	else
-	{
-		while(node!=NULL)
-		{
-			temp = (struct LifeTimeMonitorData*)ILibLinkedList_GetDataFromNode(node);
-			if(ltms->ExpirationTick<=temp->ExpirationTick)
-			{
-				ILibLinkedList_InsertBefore(node,ltms);
-				break;
-			}
-			node = ILibLinkedList_GetNextNode(node);
-		}
-		if(node==NULL)
-		{
-			ILibLinkedList_AddTail(UPnPLifeTime->ObjectList,ltms);
-		}
-		else if(ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList)==ltms)
-		{
-			ILibForceUnBlockChain(UPnPLifeTime->Chain);
-		}
-	}
-	ILibLinkedList_UnLock(UPnPLifeTime->ObjectList);
 }
 
 //
@@ -4236,12 +4781,11 @@ void ILibLifeTime_Check(void *LifeTimeMonitorObject,void *readset, void *writese
 {
 	struct timeval tv;
 	unsigned long CurrentTick;
-	struct LifeTimeMonitorData *Temp, *EVT;
+	struct LifeTimeMonitorData *EVT;
+	struct LifeTimeMonitorData *Fired = NULL;
+	struct LifeTimeMonitorData **FiredTail = &Fired;
 	struct ILibLifeTime *UPnPLifeTime = (struct ILibLifeTime*)LifeTimeMonitorObject;
-	int nexttick;
-
-	void *node;
-	void *EventQueue = ILibQueue_Create();
+	long nexttick;
 	int removed;
 
 	//
@@ -4250,45 +4794,35 @@ void ILibLifeTime_Check(void *LifeTimeMonitorObject,void *readset, void *writese
 	gettimeofday(&tv,NULL);
 	CurrentTick = (tv.tv_sec*1000) + (tv.tv_usec/1000);
 
-	ILibLinkedList_Lock(UPnPLifeTime->ObjectList);
-	ILibLinkedList_Lock(UPnPLifeTime->Reserved);
-
-	while(ILibQueue_DeQueue(UPnPLifeTime->Reserved)!=NULL);
-
-	node = ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList);
-	while(node!=NULL)
+	//
+	// Take the expired triggers out of the heap, in the order they have to fire.
+	// They stay in the hash, so ILibLifeTime_Remove can still cancel them.
+	//
+	sem_wait(&(UPnPLifeTime->Lock));
+	while(UPnPLifeTime->HeapSize>0 && (long)(CurrentTick-UPnPLifeTime->Heap[0]->ExpirationTick)>0)
 	{
-		Temp = (struct LifeTimeMonitorData*)ILibLinkedList_GetDataFromNode(node);
-		if(Temp->ExpirationTick<CurrentTick)
-		{
-			ILibQueue_EnQueue(EventQueue,Temp);
-			node = ILibLinkedList_Remove(node);
-		}
-		else
-		{
-			node = ILibLinkedList_GetNextNode(node);
-		}
+		EVT = UPnPLifeTime->Heap[0];
+		ILibLifeTime_HeapRemove(UPnPLifeTime,EVT);
+		*FiredTail = EVT;
+		FiredTail = &(EVT->NextFired);
 	}
-
-	ILibLinkedList_UnLock(UPnPLifeTime->Reserved);
-	ILibLinkedList_UnLock(UPnPLifeTime->ObjectList);
+	*FiredTail = NULL;
+	sem_post(&(UPnPLifeTime->Lock));
 
 	//
 	// Iterate through all the triggers that we need to fire
 	//
-	node = ILibQueue_DeQueue(EventQueue);
-	while(node!=NULL)
+	for(EVT=Fired;EVT!=NULL;EVT=EVT->NextFired)
 	{
-
 		//
-		// Check to see if the item to be fired, is in the remove list.
-		// If it is, that means we shouldn't fire this item anymore.
+		// Check to see if the item to be fired was removed by one of the
+		// previous callbacks. If it was, we shouldn't fire this item anymore.
 		//
-		ILibLinkedList_Lock(UPnPLifeTime->Reserved);
-		removed = ILibLinkedList_Remove_ByData(UPnPLifeTime->Reserved,node);
-		ILibLinkedList_UnLock(UPnPLifeTime->Reserved);
+		sem_wait(&(UPnPLifeTime->Lock));
+		removed = EVT->Removed;
+		ILibLifeTime_HashRemove(UPnPLifeTime,EVT);
+		sem_post(&(UPnPLifeTime->Lock));
 
-		EVT = (struct LifeTimeMonitorData*)node;
 		if(removed==0)
 		{
 			#ifdef MEMORY_CHECK
@@ -4311,28 +4845,28 @@ void ILibLifeTime_Check(void *LifeTimeMonitorObject,void *readset, void *writese
 			//
 			if(EVT->DestroyPtr!=NULL) {EVT->DestroyPtr(EVT->data);}
 		}
-		
-		free(EVT);
-		node = ILibQueue_DeQueue(EventQueue);
 	}
-	ILibQueue_Destroy(EventQueue);
-
+	ILibLifeTime_Release(UPnPLifeTime,Fired);
 
 	//
 	// If there are more triggers that need to be fired later, we need to 
 	// recalculate what the max block time for our select should be
 	//
-	ILibLinkedList_Lock(UPnPLifeTime->ObjectList);
-	if(ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList)!=NULL)
+	sem_wait(&(UPnPLifeTime->Lock));
+	if(UPnPLifeTime->HeapSize>0)
 	{
-		nexttick = ((struct LifeTimeMonitorData*)ILibLinkedList_GetDataFromNode(ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList)))->ExpirationTick  - CurrentTick;
-		if(nexttick<*blocktime) {*blocktime=nexttick;}
+		nexttick = (long)(UPnPLifeTime->Heap[0]->ExpirationTick - CurrentTick);
+		if(nexttick<0) {nexttick = 0;}
+		if(nexttick<*blocktime) {*blocktime=(int)nexttick;}
 	}
-	ILibLinkedList_UnLock(UPnPLifeTime->ObjectList);
+	sem_post(&(UPnPLifeTime->Lock));
 }
 
 /*! \fn ILibLifeTime_Remove(void *LifeTimeToken, void *data)
 	\brief Removes a timed callback from an \a ILibLifeTime module
+	\par
+	Triggers are found by a hash of \a data, so the cost doesn't depend on the number of
+	other pending triggers.
 	\param LifeTimeToken The \a ILibLifeTime object to remove the callback from
 	\param data The data object to remove
 */
@@ -4340,55 +4874,42 @@ void ILibLifeTime_Remove(void *LifeTimeToken, void *data)
 {
 	struct ILibLifeTime *UPnPLifeTime = (struct ILibLifeTime*)LifeTimeToken;
 	struct LifeTimeMonitorData *evt;
+	struct LifeTimeMonitorData *next;
+	struct LifeTimeMonitorData *Removed = NULL;
 
-	void *node;
-	void *EventQueue = ILibQueue_Create();
-
-	int removed=0;
-
-
-	ILibLinkedList_Lock(UPnPLifeTime->ObjectList);
-
-	node = ILibLinkedList_GetNode_Head(UPnPLifeTime->ObjectList);
-	if(node!=NULL)
+	sem_wait(&(UPnPLifeTime->Lock));
+	for(evt=UPnPLifeTime->Buckets[ILibLifeTime_Hash(UPnPLifeTime,data)];evt!=NULL;evt=next)
 	{
-		while(node!=NULL)
+		next = evt->NextInBucket;
+		if(evt->data!=data)
 		{
-			evt = (struct LifeTimeMonitorData*)ILibLinkedList_GetDataFromNode(node);
-			if(evt->data==data)
-			{
-				ILibQueue_EnQueue(EventQueue,evt);
-				node = ILibLinkedList_Remove(node);
-				removed=1;
-			}
-			else
-			{
-				node = ILibLinkedList_GetNextNode(node);
-			}
+			continue;
 		}
-		if(removed==0)
+		if(evt->HeapIndex<0)
 		{
 			//
-			// The item wasn't in the list, so maybe it is pending to be triggered
+			// The item is pending to be triggered by ILibLifeTime_Check
 			//
-			ILibLinkedList_Lock(UPnPLifeTime->Reserved);
-			ILibLinkedList_AddTail(UPnPLifeTime->Reserved,data);
-			ILibLinkedList_UnLock(UPnPLifeTime->Reserved);
+			evt->Removed = 1;
+		}
+		else
+		{
+			ILibLifeTime_HeapRemove(UPnPLifeTime,evt);
+			ILibLifeTime_HashRemove(UPnPLifeTime,evt);
+			evt->NextFired = Removed;
+			Removed = evt;
 		}
 	}
-	ILibLinkedList_UnLock(UPnPLifeTime->ObjectList);
+	sem_post(&(UPnPLifeTime->Lock));
 
 	//
 	// Iterate through each node that is to be removed
 	//
-	evt = (struct LifeTimeMonitorData*)ILibQueue_DeQueue(EventQueue);
-	while(evt!=NULL)
+	for(evt=Removed;evt!=NULL;evt=evt->NextFired)
 	{
 		if(evt->DestroyPtr!=NULL) {evt->DestroyPtr(evt->data);}
-		free(evt);
-		evt = (struct LifeTimeMonitorData*)ILibQueue_DeQueue(EventQueue);
 	}
-	ILibQueue_Destroy(EventQueue);
+	ILibLifeTime_Release(UPnPLifeTime,Removed);
 }
 
 /*! \fn ILibLifeTime_Flush(void *LifeTimeToken)
@@ -4399,20 +4920,27 @@ void ILibLifeTime_Flush(void *LifeTimeToken)
 {
 	struct ILibLifeTime *UPnPLifeTime = (struct ILibLifeTime*)LifeTimeToken;
 	struct LifeTimeMonitorData *temp;
+	struct LifeTimeMonitorData *Removed = NULL;
 
-	ILibLinkedList_Lock(UPnPLifeTime->ObjectList);
+	sem_wait(&(UPnPLifeTime->Lock));
+	while(UPnPLifeTime->HeapSize>0)
+	{
+		temp = UPnPLifeTime->Heap[--UPnPLifeTime->HeapSize];
+		temp->HeapIndex = -1;
+		ILibLifeTime_HashRemove(UPnPLifeTime,temp);
+		temp->NextFired = Removed;
+		Removed = temp;
+	}
+	sem_post(&(UPnPLifeTime->Lock));
 
-	temp = (struct LifeTimeMonitorData*)ILibQueue_DeQueue(UPnPLifeTime->ObjectList);
-	while(temp!=NULL)
+	for(temp=Removed;temp!=NULL;temp=temp->NextFired)
 	{
 		if(temp->DestroyPtr!=NULL)
 		{
 			temp->DestroyPtr(temp->data);
 		}
-		free(temp);
-		temp = (struct LifeTimeMonitorData*)ILibQueue_DeQueue(UPnPLifeTime->ObjectList);
 	}
-	ILibLinkedList_UnLock(UPnPLifeTime->ObjectList);
+	ILibLifeTime_Release(UPnPLifeTime,Removed);
 }
 
 //
@@ -4421,9 +4949,17 @@ void ILibLifeTime_Flush(void *LifeTimeToken)
 void ILibLifeTime_Destroy(void *LifeTimeToken)
 {
 	struct ILibLifeTime *UPnPLifeTime = (struct ILibLifeTime*)LifeTimeToken;
+	struct ILibLifeTime_Block *block;
+
 	ILibLifeTime_Flush(LifeTimeToken);
-	ILibLinkedList_Destroy(UPnPLifeTime->ObjectList);
-	ILibQueue_Destroy(UPnPLifeTime->Reserved);
+	while((block = UPnPLifeTime->Blocks)!=NULL)
+	{
+		UPnPLifeTime->Blocks = block->Next;
+		free(block);
+	}
+	free(UPnPLifeTime->Heap);
+	free(UPnPLifeTime->Buckets);
+	sem_destroy(&(UPnPLifeTime->Lock));
 }
 
 /*! \fn ILibCreateLifeTime(void *Chain)
@@ -4436,14 +4972,18 @@ void ILibLifeTime_Destroy(void *LifeTimeToken)
 void *ILibCreateLifeTime(void *Chain)
 {
 	struct ILibLifeTime *RetVal = (struct ILibLifeTime*)malloc(sizeof(struct ILibLifeTime));
-	RetVal->ObjectList = ILibLinkedList_Create();
+	memset(RetVal,0,sizeof(struct ILibLifeTime));
 
-	RetVal->LM = NULL;
 	RetVal->PreSelect = &ILibLifeTime_Check;
 	RetVal->PostSelect = NULL;
 	RetVal->Destroy = &ILibLifeTime_Destroy;
 	RetVal->Chain = Chain;
-	RetVal->Reserved = ILibQueue_Create();
+	sem_init(&(RetVal->Lock),0,1);
+	RetVal->HeapCapacity = ILibLifeTime_BLOCK_SIZE;
+	RetVal->Heap = (struct LifeTimeMonitorData**)malloc(RetVal->HeapCapacity*sizeof(struct LifeTimeMonitorData*));
+	RetVal->BucketCount = ILibLifeTime_MIN_BUCKETS;
+	RetVal->Buckets = (struct LifeTimeMonitorData**)malloc(RetVal->BucketCount*sizeof(struct LifeTimeMonitorData*));
+	memset(RetVal->Buckets,0,RetVal->BucketCount*sizeof(struct LifeTimeMonitorData*));
 	ILibAddToChain(Chain,RetVal);
 	return((void*)RetVal);
 }
@@ -626,6 +626,9 @@ void ILibStopChain(void *chain);
 void ILibChain_SetOnStoppedHandler(void *chain, void *user, ILibOnChainStopped Handler);
 #endif
 void ILibForceUnBlockChain(void *Chain);
+#if defined(_POSIX)
+void ILibChain_CloseSocket(int socket);
+#endif
 /* \} */
 
 
@@ -41,39 +41,249 @@
 
 #include "ILibParsers.h"
 
+#if defined(_POSIX)
+#include <pthread.h>
+#endif
+
+//
+// Atomic operations of the work item ring
+//
+#if defined(WIN32) || defined(_WIN32_WCE)
+	#define ILibThreadPool_CAS(ptr,old,new) (InterlockedCompareExchange((volatile LONG*)(ptr),(LONG)(new),(LONG)(old))==(LONG)(old))
+	#define ILibThreadPool_Add(ptr,value) InterlockedExchangeAdd((volatile LONG*)(ptr),(LONG)(value))
+	#define ILibThreadPool_Barrier() MemoryBarrier()
+#else
+	#define ILibThreadPool_CAS(ptr,old,new) __sync_bool_compare_and_swap((ptr),(old),(new))
+	#define ILibThreadPool_Add(ptr,value) __sync_fetch_and_add((ptr),(value))
+	#define ILibThreadPool_Barrier() __sync_synchronize()
+#endif
+
+//
+// Work items are stored in a bounded ring of this many cells by default, see
+// ILibThreadPool_CreateEx. Items which don't fit go to a locked overflow queue.
+//
+#define ILibThreadPool_DEFAULT_QUEUE_SIZE 256
+//
+// Only every Nth work item is timed for MaxWait, reading the clock costs as much
+// as queueing the item
+//
+#define ILibThreadPool_WAIT_SAMPLE 16
+
 struct ILibThreadPool_WorkItem
 {
 	ILibThreadPool_Handler Callback;
 	void *var;
+	long QueuedTime;
+};
+//
+// Cell of the ring. Sequence tells the state of the cell to producers and consumers,
+// so neither has to take a lock (bounded MPMC queue by D. Vyukov)
+//
+struct ILibThreadPool_Cell
+{
+	volatile unsigned long Sequence;
+	struct ILibThreadPool_WorkItem Item;
 };
 struct ILibThreadPool_ThreadState
 {
-	int NumThreads;
-	int Terminate;
+	volatile int NumThreads;
+	volatile int Terminate;
 	void *WorkItemQueue;
 	sem_t SyncHandle;
 	sem_t AbortHandle;
+	struct ILibThreadPool_Cell *Ring;
+	unsigned long Mask;
+	volatile long OverflowCount;
+	volatile unsigned long Overflows;
+
+	//
+	// Producers and workers update their counters on separate cache lines
+	//
+	char Pad1[64];
+	volatile unsigned long EnqueuePos;
+	volatile unsigned long Queued;
+	volatile int Idle;
+	char Pad2[64];
+	volatile unsigned long DequeuePos;
+	volatile int Running;
+	volatile long MaxWait;
+	char Pad3[64];
 };
 
-/*! \fn ILibThreadPool ILibThreadPool_Create()
+static long ILibThreadPool_Now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return(tv.tv_sec*1000000L+tv.tv_usec);
+}
+
+//
+// Returns 0 if the item was stored, nonzero if the ring is full
+//
+static int ILibThreadPool_RingPut(struct ILibThreadPool_ThreadState *ts, struct ILibThreadPool_WorkItem *wi)
+{
+	struct ILibThreadPool_Cell *cell;
+	unsigned long pos = ts->EnqueuePos;
+	long diff;
+
+	for(;;)
+	{
+		cell = &(ts->Ring[pos&ts->Mask]);
+		diff = (long)(cell->Sequence-pos);
+		if(diff==0)
+		{
+			if(ILibThreadPool_CAS(&(ts->EnqueuePos),pos,pos+1))
+			{
+				break;
+			}
+			pos = ts->EnqueuePos;
+		}
+		else if(diff<0)
+		{
+			return(1);
+		}
+		else
+		{
+			pos = ts->EnqueuePos;
+		}
+	}
+	cell->Item = *wi;
+	ILibThreadPool_Barrier();
+	cell->Sequence = pos+1;
+	return(0);
+}
+//
+// Returns 0 if an item was taken, nonzero if the ring is empty
+//
+static int ILibThreadPool_RingGet(struct ILibThreadPool_ThreadState *ts, struct ILibThreadPool_WorkItem *wi)
+{
+	struct ILibThreadPool_Cell *cell;
+	unsigned long pos = ts->DequeuePos;
+	long diff;
+
+	for(;;)
+	{
+		cell = &(ts->Ring[pos&ts->Mask]);
+		diff = (long)(cell->Sequence-(pos+1));
+		if(diff==0)
+		{
+			if(ILibThreadPool_CAS(&(ts->DequeuePos),pos,pos+1))
+			{
+				break;
+			}
+			pos = ts->DequeuePos;
+		}
+		else if(diff<0)
+		{
+			return(1);
+		}
+		else
+		{
+			pos = ts->DequeuePos;
+		}
+	}
+	*wi = cell->Item;
+	ILibThreadPool_Barrier();
+	cell->Sequence = pos+ts->Mask+1;
+	return(0);
+}
+//
+// Takes the next item from the ring, or from the overflow queue
+//
+static int ILibThreadPool_Get(struct ILibThreadPool_ThreadState *ts, struct ILibThreadPool_WorkItem *wi)
+{
+	struct ILibThreadPool_WorkItem *overflow = NULL;
+
+	if(ILibThreadPool_RingGet(ts,wi)==0)
+	{
+		return(0);
+	}
+	if(ts->OverflowCount!=0)
+	{
+		ILibQueue_Lock(ts->WorkItemQueue);
+		overflow = (struct ILibThreadPool_WorkItem*)ILibQueue_DeQueue(ts->WorkItemQueue);
+		if(overflow!=NULL)
+		{
+			ILibThreadPool_Add(&(ts->OverflowCount),-1);
+		}
+		ILibQueue_UnLock(ts->WorkItemQueue);
+	}
+	if(overflow==NULL)
+	{
+		return(1);
+	}
+	*wi = *overflow;
+	free(overflow);
+	return(0);
+}
+
+/*! \fn ILibThreadPool ILibThreadPool_CreateEx(int queueSize)
 	\brief Instantiate a new ILibThreadPool handle
+	\par
+	Work items are kept in a preallocated ring, so queueing them doesn't allocate
+	memory or take locks. Items which don't fit wait in a slower overflow queue.
+	\param queueSize Number of work items the ring holds, rounded up to a power of two. Zero selects the default size.
 	\returns Handle to a new ILibThreadPool module
 */
-ILibThreadPool ILibThreadPool_Create()
+ILibThreadPool ILibThreadPool_CreateEx(int queueSize)
 {
 	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)malloc(sizeof(struct ILibThreadPool_ThreadState));
+	unsigned long size = 2;
+	unsigned long i;
+
 	memset(ts,0,sizeof(struct ILibThreadPool_ThreadState));
+	if(queueSize<=0)
+	{
+		queueSize = ILibThreadPool_DEFAULT_QUEUE_SIZE;
+	}
+	while(size<(unsigned long)queueSize)
+	{
+		size *= 2;
+	}
+	ts->Ring = (struct ILibThreadPool_Cell*)malloc(size*sizeof(struct ILibThreadPool_Cell));
+	memset(ts->Ring,0,size*sizeof(struct ILibThreadPool_Cell));
+	for(i=0;i<size;++i)
+	{
+		ts->Ring[i].Sequence = i;
+	}
+	ts->Mask = size-1;
 
 	ts->WorkItemQueue = ILibQueue_Create();
 	sem_init(&(ts->SyncHandle),0,0);
 	sem_init(&(ts->AbortHandle),0,0);
 	return(ts);
 }
+/*! \fn ILibThreadPool ILibThreadPool_Create()
+	\brief Instantiate a new ILibThreadPool handle, with the default queue size
+	\returns Handle to a new ILibThreadPool module
+*/
+ILibThreadPool ILibThreadPool_Create()
+{
+	return(ILibThreadPool_CreateEx(0));
+}
 int ILibThreadPool_GetThreadCount(ILibThreadPool pool)
 {
 	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
 	return(ts->NumThreads);
 }
+/*! \fn void ILibThreadPool_GetStats(ILibThreadPool pool, struct ILibThreadPool_Stats *stats)
+	\brief Returns usage statistics of a thread pool
+	\param pool The ILibThreadPool handle
+	\param[out] stats Statistics since the pool was created
+*/
+void ILibThreadPool_GetStats(ILibThreadPool pool, struct ILibThreadPool_Stats *stats)
+{
+	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
+
+	ILibQueue_Lock(ts->WorkItemQueue);
+	stats->Threads = ts->NumThreads;
+	ILibQueue_UnLock(ts->WorkItemQueue);
+	stats->Running = ts->Running;
+	stats->Queued = ts->Queued;
+	stats->Pending = (long)(ts->EnqueuePos-ts->DequeuePos)+ts->OverflowCount;
+	stats->Overflows = ts->Overflows;
+	stats->MaxWait = ts->MaxWait;
+}
 /*! \fn void ILibThreadPool_Destroy(ILibThreadPool pool)
 	\brief Free the resources associated with an ILibThreadPool module
 	\param pool Handle to free
@@ -81,6 +291,7 @@ int ILibThreadPool_GetThreadCount(ILibThreadPool pool)
 void ILibThreadPool_Destroy(ILibThreadPool pool)
 {
 	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
+	struct ILibThreadPool_WorkItem *wi;
 	int ok = 0;
 	int count = 0;
 
@@ -103,11 +314,72 @@ void ILibThreadPool_Destroy(ILibThreadPool pool)
 
 	sem_destroy(&(ts->SyncHandle));
 	sem_destroy(&(ts->AbortHandle));
+	while((wi = (struct ILibThreadPool_WorkItem*)ILibQueue_DeQueue(ts->WorkItemQueue))!=NULL)
+	{
+		free(wi);
+	}
 	ILibQueue_Destroy(ts->WorkItemQueue);
+	free(ts->Ring);
 
 	free(pool);
 }
 
+//
+// Worker loop of a thread which is already counted in NumThreads
+//
+static void ILibThreadPool_Run(ILibThreadPool pool)
+{
+	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
+	struct ILibThreadPool_WorkItem wi;
+	long wait;
+	long max;
+	int empty;
+	int ok=0;
+
+	while(ts->Terminate==0)
+	{
+		empty = ILibThreadPool_Get(ts,&wi);
+		if(empty!=0)
+		{
+			//
+			// Nothing to do. Tell producers this thread needs a post, then look once
+			// more, because an item may have been queued before they could see it.
+			// A post which arrives after that is just a spurious wakeup.
+			//
+			ILibThreadPool_Add(&(ts->Idle),1);
+			if(ts->Terminate==0)
+			{
+				empty = ILibThreadPool_Get(ts,&wi);
+			}
+			if(empty!=0)
+			{
+				sem_wait(&(ts->SyncHandle));
+				continue;
+			}
+		}
+
+		if(wi.QueuedTime!=0)
+		{
+			wait = ILibThreadPool_Now()-wi.QueuedTime;
+			while(wait>(max = ts->MaxWait) && !ILibThreadPool_CAS(&(ts->MaxWait),max,wait));
+		}
+
+		ILibThreadPool_Add(&(ts->Running),1);
+		wi.Callback(pool,wi.var);
+		ILibThreadPool_Add(&(ts->Running),-1);
+	}
+
+	ILibQueue_Lock(ts->WorkItemQueue);
+	--ts->NumThreads;
+	ok = ts->NumThreads;
+	ILibQueue_UnLock(ts->WorkItemQueue);
+
+	if(ok==0)
+	{
+		sem_post(&(ts->AbortHandle));
+	}
+}
+
 /*! \fn void ILibThreadPool_AddThread(ILibThreadPool pool)
 	\brief Gives ownership of the current thread to the pool.
 	\par
@@ -117,50 +389,73 @@ void ILibThreadPool_Destroy(ILibThreadPool pool)
 void ILibThreadPool_AddThread(ILibThreadPool pool)
 {
 	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
-	struct ILibThreadPool_WorkItem *wi = NULL;
-	int abort = 0;
-	int id;
-	int ok=0;
 
 	ILibQueue_Lock(ts->WorkItemQueue);
 	++ts->NumThreads;
-	id = ts->NumThreads;
 	ILibQueue_UnLock(ts->WorkItemQueue);
 
-	do
-	{
-		sem_wait(&(ts->SyncHandle));
-
-		ILibQueue_Lock(ts->WorkItemQueue);
-		wi = (struct ILibThreadPool_WorkItem*)ILibQueue_DeQueue(ts->WorkItemQueue);	
-		abort = ts->Terminate;
-		ILibQueue_UnLock(ts->WorkItemQueue);
+	ILibThreadPool_Run(pool);
+}
 
-		if(wi!=NULL && !abort)
-		{
-			wi->Callback(pool,wi->var);
-			free(wi);
-		}
-		else if(wi!=NULL)
-		{
-			free(wi);
-		}
+#if defined(_POSIX)
+static void* ILibThreadPool_ThreadStart(void *pool)
+{
+	ILibThreadPool_Run(pool);
+	return(NULL);
+}
+#elif defined(WIN32)
+static DWORD WINAPI ILibThreadPool_ThreadStart(LPVOID pool)
+{
+	ILibThreadPool_Run(pool);
+	return(0);
+}
+#endif
+/*! \fn int ILibThreadPool_StartThreads(ILibThreadPool pool, int count)
+	\brief Creates threads owned by the pool, instead of giving it threads with \a ILibThreadPool_AddThread
+	\par
+	The threads exit when the pool is destroyed.
+	\param pool The ILibThreadPool handle
+	\param count Number of threads to create
+	\returns Number of threads created
+*/
+int ILibThreadPool_StartThreads(ILibThreadPool pool, int count)
+{
+	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
+	int RetVal = 0;
+#if defined(_POSIX)
+	pthread_t t;
+#elif defined(WIN32)
+	HANDLE t;
+#endif
 
+	while(RetVal<count)
+	{
+		//
+		// Count the thread before it runs, so work items queued meanwhile are not
+		// processed on the caller's thread
+		//
 		ILibQueue_Lock(ts->WorkItemQueue);
-		abort = ts->Terminate;
+		++ts->NumThreads;
 		ILibQueue_UnLock(ts->WorkItemQueue);
-		
-	}while(!abort);
 
-	ILibQueue_Lock(ts->WorkItemQueue);
-	--ts->NumThreads;
-	ok = ts->NumThreads;
-	ILibQueue_UnLock(ts->WorkItemQueue);
-
-	if(ok==0)
+#if defined(_POSIX)
+		if(pthread_create(&t,NULL,&ILibThreadPool_ThreadStart,pool)!=0) {break;}
+		pthread_detach(t);
+#elif defined(WIN32)
+		if((t = CreateThread(NULL,0,&ILibThreadPool_ThreadStart,pool,0,NULL))==NULL) {break;}
+		CloseHandle(t);
+#else
+		break;
+#endif
+		++RetVal;
+	}
+	if(RetVal<count)
 	{
-		sem_post(&(ts->AbortHandle));
+		ILibQueue_Lock(ts->WorkItemQueue);
+		--ts->NumThreads;
+		ILibQueue_UnLock(ts->WorkItemQueue);
 	}
+	return(RetVal);
 }
 
 /*! \fn void ILibThreadPool_QueueUserWorkItem(ILibThreadPool pool, void *var, ILibThreadPool_Handler callback)
@@ -171,31 +466,44 @@ void ILibThreadPool_AddThread(ILibThreadPool pool)
 */
 void ILibThreadPool_QueueUserWorkItem(ILibThreadPool pool, void *var, ILibThreadPool_Handler callback)
 {
-	struct ILibThreadPool_WorkItem *wi = NULL;
+	struct ILibThreadPool_WorkItem wi;
+	struct ILibThreadPool_WorkItem *overflow;
 	struct ILibThreadPool_ThreadState *ts = (struct ILibThreadPool_ThreadState*)pool;
-	int NumThreads=0;
+	int idle;
 
-	wi = (struct ILibThreadPool_WorkItem*)malloc(sizeof(struct ILibThreadPool_WorkItem));
-	memset(wi,0,sizeof(struct ILibThreadPool_WorkItem));
-	wi->var = var;
-	wi->Callback = callback;
-	
-	ILibQueue_Lock(ts->WorkItemQueue);
-		
-	if(ts->NumThreads!=0)
-	{
-		NumThreads = ts->NumThreads;
-		ILibQueue_EnQueue(ts->WorkItemQueue,wi);
-		sem_post(&(ts->SyncHandle));
-	}
-	ILibQueue_UnLock(ts->WorkItemQueue);
-
-	if(NumThreads==0)
+	if(ts->NumThreads==0)
 	{
 		//
 		// There are no threads in the Pool, so call this thing from here
 		//
-		wi->Callback(pool,wi->var);
-		free(wi);
+		callback(pool,var);
+		return;
+	}
+
+	wi.Callback = callback;
+	wi.var = var;
+	wi.QueuedTime = 0;
+	if(ILibThreadPool_Add(&(ts->Queued),1)%ILibThreadPool_WAIT_SAMPLE==0)
+	{
+		wi.QueuedTime = ILibThreadPool_Now();
+	}
+	if(ILibThreadPool_RingPut(ts,&wi)!=0)
+	{
+		overflow = (struct ILibThreadPool_WorkItem*)malloc(sizeof(struct ILibThreadPool_WorkItem));
+		*overflow = wi;
+		ILibQueue_Lock(ts->WorkItemQueue);
+		ILibQueue_EnQueue(ts->WorkItemQueue,overflow);
+		ILibThreadPool_Add(&(ts->OverflowCount),1);
+		ILibQueue_UnLock(ts->WorkItemQueue);
+		ILibThreadPool_Add(&(ts->Overflows),1);
+	}
+
+	//
+	// Busy threads take items from the ring on their own, only idle ones need a post
+	//
+	while((idle = ts->Idle)>0 && !ILibThreadPool_CAS(&(ts->Idle),idle,idle-1));
+	if(idle>0)
+	{
+		sem_post(&(ts->SyncHandle));
 	}
 }
@@ -52,11 +52,27 @@ typedef void* ILibThreadPool;
 */
 typedef void(*ILibThreadPool_Handler)(ILibThreadPool sender, void *var);
 
+/*! \struct ILibThreadPool_Stats
+	\brief Usage statistics of a thread pool, see \a ILibThreadPool_GetStats
+*/
+struct ILibThreadPool_Stats
+{
+	int Threads;			//!< Threads owned by the pool
+	int Running;			//!< Work items being processed
+	long Pending;			//!< Work items waiting for a thread
+	unsigned long Queued;	//!< Work items queued since the pool was created
+	unsigned long Overflows;//!< Work items which did not fit into the preallocated queue
+	long MaxWait;			//!< Longest time a sampled work item waited for a thread, in microseconds
+};
+
 ILibThreadPool ILibThreadPool_Create();
+ILibThreadPool ILibThreadPool_CreateEx(int queueSize);
+int ILibThreadPool_StartThreads(ILibThreadPool pool, int count);
 void ILibThreadPool_AddThread(ILibThreadPool pool);
 void ILibThreadPool_QueueUserWorkItem(ILibThreadPool pool, void *var, ILibThreadPool_Handler callback);
 void ILibThreadPool_Destroy(ILibThreadPool pool);
 int ILibThreadPool_GetThreadCount(ILibThreadPool pool);
+void ILibThreadPool_GetStats(ILibThreadPool pool, struct ILibThreadPool_Stats *stats);
 
 
 /*! \} */
@@ -2948,19 +2948,24 @@ void ILibWebClient_Parse_ContentRange(char *contentRange, int *Start, int *End,
 		*TotalLength = -1;
 	}
 }
-/*! \fn int ILibWebClient_Parse_Range(char *Range, long *Start, long *Length, long TotalLength)
+#if defined(WIN32)
+#define ILibWebClient_atoll _atoi64
+#else
+#define ILibWebClient_atoll atoll
+#endif
+/*! \fn int ILibWebClient_Parse_Range(char *Range, long long *Start, long long *Length, long long TotalLength)
 	\brief Parses the Range request header, to obtain the requested range
 	\param Range The Range header to parse. This can be obtained with a call to \a ILibGetHeaderLine
-	\param[out] Start Pointer to the long value where the Start byte position will be stored
-	\param[out] Length Pointer to the long value where the desired length will be stored.
+	\param[out] Start Pointer to the long long value where the Start byte position will be stored
+	\param[out] Length Pointer to the long long value where the desired length will be stored.
 	\param TotalLength The total length of available content.
 	\returns 0 = Success, 1 = Failure
 */
-enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long *Start, long *Length, long TotalLength)
+enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long long *Start, long long *Length, long long TotalLength)
 {
 	struct parser_result *pr,*pr2;
-	long x=-1;
-	long y=-1;
+	long long x=-1;
+	long long y=-1;
 	enum ILibWebClient_Range_Result RetVal = ILibWebClient_Range_Result_OK;
 
 	*Start = 0;
@@ -2979,7 +2984,7 @@ enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long *Sta
 			else
 			{
 				pr2->FirstResult->data[pr2->FirstResult->datalength]=0;
-				x = atol(pr2->FirstResult->data);
+				x = ILibWebClient_atoll(pr2->FirstResult->data);
 			}
 			if(pr2->LastResult->datalength == 0)
 			{
@@ -2993,11 +2998,11 @@ enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long *Sta
 				pr2->LastResult->data[pr2->LastResult->datalength]=0;
 				if(x!=-1)
 				{
-					y = 1+atol(pr2->LastResult->data)-x;
+					y = 1+ILibWebClient_atoll(pr2->LastResult->data)-x;
 				}
 				else
 				{
-					x = TotalLength - atol(pr2->LastResult->data);
+					x = TotalLength - ILibWebClient_atoll(pr2->LastResult->data);
 					y = TotalLength - x;
 				}
 			}
@@ -206,7 +206,7 @@ ILibWebClient_RequestToken ILibWebClient_GetRequestToken_FromStateObject(ILibWeb
 ILibWebClient_StateObject ILibWebClient_GetStateObjectFromRequestToken(ILibWebClient_RequestToken token);
 
 void ILibWebClient_Parse_ContentRange(char *contentRange, int *Start, int *End, int *TotalLength);
-enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long *Start, long *Length, long TotalLength);
+enum ILibWebClient_Range_Result ILibWebClient_Parse_Range(char *Range, long long *Start, long long *Length, long long TotalLength);
 
 void ILibWebClient_SetMaxConcurrentSessionsToServer(ILibWebClient_RequestManager WebClient, int maxConnections);
 void ILibWebClient_SetUser(ILibWebClient_RequestManager manager, void *user);
@@ -1066,6 +1066,89 @@ enum ILibWebServer_Status ILibWebServer_StreamBody(struct ILibWebServer_Session
 	return(RetVal);
 }
 
+#if defined(_POSIX)
+/*! \fn ILibWebServer_StreamFile(struct ILibWebServer_Session *session, int fileDescriptor, off_t offset, int length, int done)
+	\brief Streams a range of a file as the HTTP body on a session
+	\par
+	The range is queued and sent by the chain thread without copying, see \a ILibAsyncSocket_SendFile.
+	The file descriptor must remain open until OnSendOK is triggered, or the session is disconnected.
+	\param session The ILibWebServer_Session to send the response on
+	\param fileDescriptor The file to send data from
+	\param offset The file offset of the range
+	\param length The length of the range
+	\param done Flag indicating if this is everything
+	\returns Send Status
+*/
+enum ILibWebServer_Status ILibWebServer_StreamFile(struct ILibWebServer_Session *session, int fileDescriptor, off_t offset, int length, int done)
+{
+	struct packetheader *hdr;
+	char *hex;
+	int hexLen;
+	enum ILibAsyncSocket_SendStatus SocketStatus;
+	enum ILibWebServer_Status RetVal = ILibWebServer_ALL_DATA_SENT;
+
+	if(session==NULL || (session!=NULL && session->SessionInterrupted!=0)) 
+	{
+		return(ILibWebServer_INVALID_SESSION);
+	}
+	hdr = ILibWebClient_GetHeaderFromDataObject(session->Reserved3);
+
+	if(length>0)
+	{
+		session->Reserved4 = 0;
+		//{{{ REMOVE_THIS_FOR_HTTP/1.0_ONLY_SUPPORT--> }}}
+		if(hdr->VersionLength==3 && memcmp(hdr->Version,"1.0",3)==0)
+		{
+		//{{{ <--REMOVE_THIS_FOR_HTTP/1.0_ONLY_SUPPORT }}}
+			SocketStatus = ILibAsyncServerSocket_SendFile(session->Reserved1,session->Reserved2,fileDescriptor,offset,length);
+			switch(SocketStatus)
+			{
+				case ILibAsyncSocket_ALL_DATA_SENT:
+					RetVal = ILibWebServer_ALL_DATA_SENT;
+					break;
+				case ILibAsyncSocket_NOT_ALL_DATA_SENT_YET:
+					RetVal = ILibWebServer_NOT_ALL_DATA_SENT_YET;
+					break;
+				default:
+					RetVal = ILibWebServer_TRIED_TO_SEND_ON_CLOSED_SOCKET;
+					break;
+			}
+		//{{{ REMOVE_THIS_FOR_HTTP/1.0_ONLY_SUPPORT--> }}}
+		}
+		else
+		{
+			//
+			// HTTP/1.1+ , the range is sent as one chunk
+			//
+			hex = (char*)malloc(16);
+			hexLen = sprintf(hex,"%X\r\n",length);
+			RetVal = ILibWebServer_TRIED_TO_SEND_ON_CLOSED_SOCKET;
+			if(ILibWebServer_Send_Raw(session,hex,hexLen,0,0)!=ILibWebServer_TRIED_TO_SEND_ON_CLOSED_SOCKET)
+			{
+				SocketStatus = ILibAsyncServerSocket_SendFile(session->Reserved1,session->Reserved2,fileDescriptor,offset,length);
+				if(SocketStatus!=ILibAsyncSocket_SEND_ON_CLOSED_SOCKET_ERROR)
+				{
+					RetVal = ILibWebServer_Send_Raw(session,"\r\n",2,1,0);
+				}
+			}
+		}
+		//{{{ <--REMOVE_THIS_FOR_HTTP/1.0_ONLY_SUPPORT }}}
+	}
+	if(done!=0 && RetVal != ILibWebServer_TRIED_TO_SEND_ON_CLOSED_SOCKET && RetVal != ILibWebServer_SEND_RESULTED_IN_DISCONNECT)
+	{
+		//
+		// Terminate the body, the way StreamBody does
+		//
+		return(ILibWebServer_StreamBody(session,NULL,0,ILibAsyncSocket_MemoryOwnership_STATIC,1));
+	}
+
+	if(RetVal!=0 && session->Reserved10!=NULL)
+	{
+		*(session->Reserved10)=NULL;
+	}
+	return(RetVal);
+}
+#endif
 
 /*! \fn ILibWebServer_GetRemoteInterface(struct ILibWebServer_Session *session)
 	\brief Returns the remote interface of an HTTP session
@@ -78,7 +78,7 @@ typedef void (*ILibWebServer_Session_OnDisconnect)(struct ILibWebServer_Session
 	\brief Handler for when pending send operations have completed
 	\par
 	<B>Note:</B> This handler will only be called after all pending data from any call(s) to 
-	\a ILibWebServer_Send, \a ILibWebServer_Send_Raw, \a ILibWebServer_StreamBody,
+	\a ILibWebServer_Send, \a ILibWebServer_Send_Raw, \a ILibWebServer_StreamBody, \a ILibWebServer_StreamFile,
 	\a ILibWebServer_StreamHeader, and/or \a ILibWebServer_StreamHeader_Raw, have completed. You will need to look at the return values
 	of those methods, to determine if there is any pending data that still needs to be sent. That will determine if this handler will get called.
 	\param sender The \a ILibWebServer_Session that has completed sending all of the pending data
@@ -194,6 +194,9 @@ int ILibWebServer_GetRemoteInterface(struct ILibWebServer_Session *session);
 
 enum ILibWebServer_Status ILibWebServer_StreamHeader(struct ILibWebServer_Session *session, struct packetheader *header);
 enum ILibWebServer_Status ILibWebServer_StreamBody(struct ILibWebServer_Session *session, char *buffer, int bufferSize, int userFree, int done);
+#if defined(_POSIX)
+enum ILibWebServer_Status ILibWebServer_StreamFile(struct ILibWebServer_Session *session, int fileDescriptor, off_t offset, int length, int done);
+#endif
 
 enum ILibWebServer_Status ILibWebServer_StreamHeader_Raw(struct ILibWebServer_Session *session, int StatusCode,char *StatusData,char *ResponseHeaders, int ResponseHeaders_FREE);
 void ILibWebServer_DisconnectSession(struct ILibWebServer_Session *session);
@@ -28,74 +28,136 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * Shows programs and PIDs of a transport stream file and measures DemuxTS_Parse:
+ * position of the first PMT and of complete PSI in the stream, and parsing speed.
+ *
+ * Build: make bench, see TSDemuxGetStreams target in makefile
+ */
+
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#define MAX_BUF_LEN 187
-//#define MAX_BUF_LEN 64*1024
+#include <time.h>
 
-typedef struct
-{
+#include "rtp_func.h"
 
-	int ItemsCnt;
-	int ProgramCnt;
-        int TotalProgramCnt;
-	struct StrmInfo
-	{
-		int ProgNum;
-		int ProgID;
-		int PCR_PID;
-		int stream_type;
-		int elementary_PID;
-	} *pStream;
-} StreamsPIDs, *pStreamsPIDs;
-
-int DemuxTS_Open(void **ppInstance);
-int DemuxTS_Close(void *ppInstance);
-int DemuxTS_Parse(void *ivp_, char *pbBuffer, int iBufferLength, pStreamsPIDs pOutputPIDs);
+/* Default chunk size matches 7 TS packets of RTP/UDP payload */
+#define DEFAULT_CHUNK_LEN	(7*188)
+#define DEFAULT_PASSES		(10)
+#define DEFAULT_BITRATE		(4000000)
+
+extern "C" int DemuxTS_Open(void **ppInstance);
+extern "C" int DemuxTS_Close(void *ppInstance);
+extern "C" int DemuxTS_Parse(void *ivp_, char *pbBuffer, int iBufferLength, pStreamsPIDs pOutputPIDs);
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
 
 int main(int argc, char * argv[])
 {
 	void *hDemuxer;
 	FILE *fInput;
-	char pbBuf[MAX_BUF_LEN];
-	int rez, iBufNum = 0, i;
-	pStreamsPIDs pTsStreams = (pStreamsPIDs)malloc(sizeof(StreamsPIDs));
+	char *pbFile;
+	long fileLen, pos, firstPmt = -1, complete = -1;
+	int chunkLen = DEFAULT_CHUNK_LEN, passes = DEFAULT_PASSES, bitrate = DEFAULT_BITRATE;
+	int i;
+	double start, firstPmtTime = 0, completeTime = 0, elapsed;
+	StreamsPIDs TsStreams;
 
 	printf("\n");
-	if ( argc!=2 )
+	if ( argc < 2 )
+	{
+		printf("Program shows programs and PIDs of a transport stream\n"
+		       "Usage: %s <file.ts> [chunk bytes] [passes] [bitrate bps]\n\n", argv[0]);
+		return -1;
+	}
+	if ( argc > 2 ) chunkLen = atoi(argv[2]);
+	if ( argc > 3 ) passes   = atoi(argv[3]);
+	if ( argc > 4 ) bitrate  = atoi(argv[4]);
+	if ( chunkLen <= 0 || passes <= 0 || bitrate <= 0 )
 	{
-		printf("Program shows programs and PIDs of a transport stream\nNeed transport stream file as a parameter\n\n");
+		printf("Invalid parameters\n");
 		return -1;
 	}
 
 	fInput = fopen(argv[1], "rb");
-	memset(pTsStreams, 0, sizeof(StreamsPIDs));
+	if ( fInput == NULL )
+	{
+		perror(argv[1]);
+		return -1;
+	}
+	fseek(fInput, 0, SEEK_END);
+	fileLen = ftell(fInput);
+	fseek(fInput, 0, SEEK_SET);
+	pbFile = (char *)malloc(fileLen > 0 ? fileLen : 1);
+	if ( pbFile == NULL || fread(pbFile, 1, fileLen, fInput) != (size_t)fileLen )
+	{
+		printf("Failed to read %s\n", argv[1]);
+		fclose(fInput);
+		return -1;
+	}
+	fclose(fInput);
+
+	// Zapping: feed chunks until PSI is complete
+	memset(&TsStreams, 0, sizeof(TsStreams));
 	DemuxTS_Open(&hDemuxer);
-	while ( !feof(fInput) )
+	start = now_sec();
+	for ( pos = 0; pos < fileLen; pos += chunkLen )
 	{
-		if ( 0!=(rez=DemuxTS_Parse(hDemuxer, pbBuf, fread(pbBuf, 1, MAX_BUF_LEN, fInput), pTsStreams)) )
+		int len = fileLen - pos < chunkLen ? fileLen - pos : chunkLen;
+		int rez = DemuxTS_Parse(hDemuxer, pbFile + pos, len, &TsStreams);
+
+		if ( firstPmt < 0 && TsStreams.ProgramCnt > 0 )
 		{
-			if ( rez != 0xabc )	printf("The error occure in searching transport streams, number %d\n", rez);
-			else
-			{
-				break;
-			}
-		};
-		iBufNum++;
-		/*if ( pTsStreams->ItemsCnt )
+			firstPmt     = pos + len;
+			firstPmtTime = now_sec() - start;
+		}
+		if ( rez != 0 )
 		{
-			printf("Program%d (ID 0x%x), PCR=0x%x\n",pTsStreams->ProgNum,pTsStreams->ProgID, pTsStreams->PCR_PID);
-			for ( i=0;i<pTsStreams->ItemsCnt;i++ )
-			{
-				printf("\tstream_type 0x%x, ID=0x%x\n",pTsStreams->pStream[i].stream_type,pTsStreams->pStream[i].elementary_PID);
-			}
-			free(pTsStreams->pStream);
-			pTsStreams->ItemsCnt = 0;
-		}*/
-	}   
+			complete     = pos + len;
+			completeTime = now_sec() - start;
+			break;
+		}
+	}
 	DemuxTS_Close(hDemuxer);
+
+	printf("Found %d streams in %d/%d programs\n", TsStreams.ItemsCnt, TsStreams.ProgramCnt, TsStreams.TotalProgramCnt);
+	for ( i = 0; i < TsStreams.ItemsCnt; i++ )
+	{
+		printf("\tprogram %d (PMT 0x%x, PCR 0x%x): stream_type 0x%x, PID 0x%x\n",
+			TsStreams.pStream[i].ProgNum, TsStreams.pStream[i].ProgID, TsStreams.pStream[i].PCR_PID,
+			TsStreams.pStream[i].stream_type, TsStreams.pStream[i].elementary_PID);
+	}
+	if ( firstPmt >= 0 )
+		printf("First PMT after %ld bytes (%.1f ms at %d bps), parsed in %.3f ms\n",
+			firstPmt, firstPmt*8000.0/bitrate, bitrate, firstPmtTime*1000);
+	else
+		printf("No PMT found\n");
+	if ( complete >= 0 )
+		printf("PSI complete after %ld bytes (%.1f ms at %d bps), parsed in %.3f ms\n",
+			complete, complete*8000.0/bitrate, bitrate, completeTime*1000);
+
+	// Throughput: whole file through a fresh parser on each pass
+	start = now_sec();
+	for ( i = 0; i < passes; i++ )
+	{
+		memset(&TsStreams, 0, sizeof(TsStreams));
+		DemuxTS_Open(&hDemuxer);
+		for ( pos = 0; pos < fileLen; pos += chunkLen )
+			DemuxTS_Parse(hDemuxer, pbFile + pos, fileLen - pos < chunkLen ? fileLen - pos : chunkLen, &TsStreams);
+		DemuxTS_Close(hDemuxer);
+	}
+	elapsed = now_sec() - start;
+	if ( elapsed > 0 )
+		printf("Parsed %d x %ld bytes in %.3f s: %.1f MB/s\n",
+			passes, fileLen, elapsed, (double)fileLen*passes/elapsed/(1024*1024));
+
+	free(pbFile);
 	return 0;
 }
-
@@ -29,140 +29,103 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#define MAX_PROGRAMS			256
-#define MAX_STREAMS_IN_PROGRAM	MAX_PROGRAMS
+/*
+ * Incremental PSI parser used to discover programs and elementary streams of
+ * an MPEG transport stream while it is being received.
+ *
+ * Sections of PAT and PMT PIDs are assembled across TS packets and across
+ * DemuxTS_Parse calls, validated by CRC32 and parsed as soon as they are
+ * complete. All parser state lives in a single fixed-size instance
+ * allocation, nothing is allocated while parsing.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct
-{
-	int ItemsCnt;
-	int ProgramCnt;
-	int TotalProgramCnt;
-	struct StrmInfo
-	{
-		int ProgNum;
-		int ProgID;
-		int PCR_PID;
-		int stream_type;
-		int elementary_PID;
-	} *pStream;
-} StreamsPIDs, *pStreamsPIDs;
-
-#ifdef _WIN32
-	#include <windows.h>
-#else
-typedef unsigned int    LONGLONG;
-typedef unsigned int    DWORD;
-typedef unsigned short  WORD;
-typedef int             BOOL;
-	#if !defined(TRUE) || !defined(FALSE)
-		#define TRUE 1
-		#define FALSE 0
-	#endif
-
-	#if !defined(min) || !defined(max)
-		#define min(x,y) (x<y ? x:y)
-		#define max(x,y) (x>y ? x:y)
-	#endif
-#endif	// end not win32 headers and difinitions
+extern "C" {
+#include "crc32.h"
+}
+#include "rtp_func.h"
 
-typedef struct
-{
-	int uiStreams;
-	int transport_stream_id;
-	int version_number;
-	int current_next_indicator;
-	int section_number;
-	int last_section_number;
-	struct
-	{
-		int program_number;
-		int program_map_PID;
-	} stream[MAX_STREAMS_IN_PROGRAM];
-} *pAssociationSection, AssociationSection;
+#define TS_PACKET_LENGTH		(188)
+#define TS_SYNC_BYTE			(0x47)
+#define TS_PAT_PID				(0)
+#define TS_TABLE_PAT			(0x00)
+#define TS_TABLE_PMT			(0x02)
+#define TS_STUFFING_BYTE		(0xFF)
 
-typedef struct
-{
-	int uiStreams;
-	int program_number;
-	int version_number;
-	int PCR_PID;
-	int current_next_indicator;
-	struct
-	{
-		int stream_type;
-		int elementary_PID;
-	} stream[MAX_STREAMS_IN_PROGRAM];
-} *pMapSection, MapSection;
+/* PAT and PMT sections are limited to 1021 bytes after section_length field */
+#define TS_SECTION_MAX			(1024)
+#define TS_MAX_PROGRAMS			(64)
+
+/* DemuxTS_Parse return values */
+#define DEMUX_TS_INCOMPLETE		(0)
+#define DEMUX_TS_COMPLETE		(1)
 
 typedef struct
 {
-	unsigned char*  pStart;
-	unsigned char*  pEnd;
-	long    Size;
-	unsigned char*  p;
-} strBufferDTS, *pstrBufferDTS;
+	int pid;
+	int ccount;				// last continuity counter, -1 if unknown
+	int length;				// collected section bytes, -1 if not assembling
+	unsigned char section[TS_SECTION_MAX];
+} SectionAssembler, *pSectionAssembler;
 
 typedef struct
 {
-	int         pid;
-	int         started;
-	int         ccount;
-	unsigned int llCurTime;
-} PidInfoStr, *pPidInfoStr;
-
+	int program_number;
+	int program_map_PID;
+	int done;
+} ProgramInfo;
 
 typedef struct
 {
-	// Transport Stream and Program
-	int             bSyncronized;
-	PidInfoStr      pAudioInfo, pVideoInfo;
-	unsigned char   *tp_packet;		// current stream poiter
-	int             read_index;		// offset in tp_packet
-	int             pcrDiscontinuity;
+	unsigned char carry[TS_PACKET_LENGTH];	// partial packet left from previous call
+	int carryLen;
 
-	pstrBufferDTS   pInputBuffer;
+	int patVersion;							// -1 until first valid PAT section
+	int patLastSection;
+	int patSectionsLeft;
+	unsigned char patSections[256/8];
 
-	void *vscaner_mem, *ascaner_mem;
+	int programCnt;
+	int programsDone;
+	ProgramInfo program[TS_MAX_PROGRAMS];
 
-	int PidsFound;
-	pPidInfoStr pPidsInfo[MAX_PROGRAMS];
+	int assemblerCnt;
+	SectionAssembler pat;
+	SectionAssembler pmt[TS_MAX_PROGRAMS];
 
-	int PAT_PIDS[MAX_PROGRAMS];
-	int PAT_NBRS[MAX_PROGRAMS];
-	int iPatCnt;
+	unsigned int packets;
+	unsigned int crcErrors;
+	unsigned int ccErrors;
 } strInstanceDTS, *pstrInstanceDTS;
 
-
-#define TS_PACKET_LENGTH 	188
-
-#define TS_SYNC_BYTE 		0x47
-#define NULL_PACKETS_PID    0x1FFF
-#define DEMUXER_INPUT_BUFFER	1024*100				/* max PES packet length = 65535, should be bigger */
-
-#define CHECK_MARKER_BITS(x, y) if ((x)!=(y)) { printf("ERROR: wrong marker %s %d\n", __FILE__, __LINE__);return 0;}
-
-
 extern "C" int DemuxTS_Open(void **ppInstance);
 extern "C" int DemuxTS_Close(void *ppInstance);
 extern "C" int DemuxTS_Parse(void *ivp_, char *pbBuffer, int iBufferLength, pStreamsPIDs pOutputPIDs);
 
+static void DemuxTS_ResetAssembler(pSectionAssembler pAsm, int pid)
+{
+	pAsm->pid    = pid;
+	pAsm->ccount = -1;
+	pAsm->length = -1;
+}
+
 // Allocate memory, initialize
 int DemuxTS_Open(void **ppInstance)
 {
-	strInstanceDTS *ivp = (pstrInstanceDTS)     malloc(sizeof(strInstanceDTS));
-	memset(ivp, 0, sizeof(strInstanceDTS));
+	pstrInstanceDTS ivp = (pstrInstanceDTS)malloc(sizeof(strInstanceDTS));
 
-	//printf("DemuxTS_Open\n");
+	if (ivp == NULL)
+	{
+		*ppInstance = NULL;
+		return -1;
+	}
+	memset(ivp, 0, sizeof(strInstanceDTS));
 
-	ivp->pInputBuffer   = (pstrBufferDTS)       malloc(sizeof(*ivp->pInputBuffer));
-	ivp->pInputBuffer->p= ivp->pInputBuffer->pStart = (unsigned char *)malloc(DEMUXER_INPUT_BUFFER);
-	ivp->pInputBuffer->Size = 0;
-	ivp->pInputBuffer->pEnd = ivp->pInputBuffer->pStart + DEMUXER_INPUT_BUFFER;
-	ivp->pVideoInfo.pid = ivp->pAudioInfo.pid =-1;
+	ivp->patVersion = -1;
+	DemuxTS_ResetAssembler(&ivp->pat, TS_PAT_PID);
 
 	*ppInstance = ivp;
 	return 0;
@@ -170,441 +133,365 @@ int DemuxTS_Open(void **ppInstance)
 // free memory
 int DemuxTS_Close(void *ppInstance)
 {
-	//printf("DemuxTS_Close\n");
+	pstrInstanceDTS ivp = (pstrInstanceDTS)ppInstance;
 
-	pstrInstanceDTS ivp  = (pstrInstanceDTS)ppInstance;
-	free(ivp->pInputBuffer->pStart);
-	free(ivp->pInputBuffer);
+	if (ivp != NULL && (ivp->crcErrors || ivp->ccErrors))
+	{
+		printf("DemuxTS: %u packets, %u CRC errors, %u CC errors\n", ivp->packets, ivp->crcErrors, ivp->ccErrors);
+	}
 	free(ppInstance);
 	return 0;
 }
 
-int DemuxTS_AppendData(void *ivp, char *pPkBuffer, int iPkSize)
+//---------------------------------------------------------------------------
+static pSectionAssembler DemuxTS_FindAssembler(pstrInstanceDTS ivp, int pid)
 {
-	int size;
-	strBufferDTS* pBuffer = ((pstrInstanceDTS)ivp)->pInputBuffer;
-	size = pBuffer->pEnd - pBuffer->p - pBuffer->Size;
-	if ( size >= iPkSize )
+	int i;
+
+	if (pid == TS_PAT_PID)
+		return &ivp->pat;
+	for (i = 0; i < ivp->assemblerCnt; i++)
 	{
-		memcpy(pBuffer->p + pBuffer->Size, pPkBuffer, iPkSize);
-		pBuffer->Size += iPkSize;
-		return 0;
-	} else
+		if (ivp->pmt[i].pid == pid)
+			return &ivp->pmt[i];
+	}
+	return NULL;
+}
+
+static int DemuxTS_IsPidPending(pstrInstanceDTS ivp, int pid)
+{
+	int i;
+
+	if (pid == TS_PAT_PID)
+		return 1;
+	for (i = 0; i < ivp->programCnt; i++)
+	{
+		if (ivp->program[i].program_map_PID == pid && !ivp->program[i].done)
+			return 1;
+	}
+	return 0;
+}
+
+static void DemuxTS_ResetPrograms(pstrInstanceDTS ivp, pStreamsPIDs pOutputPIDs)
+{
+	ivp->programCnt   = 0;
+	ivp->programsDone = 0;
+	ivp->assemblerCnt = 0;
+	pOutputPIDs->ItemsCnt        = 0;
+	pOutputPIDs->ProgramCnt      = 0;
+	pOutputPIDs->TotalProgramCnt = 0;
+}
+
+static void program_association_section(pstrInstanceDTS ivp, unsigned char *s, int length, pStreamsPIDs pOutputPIDs)
+{
+	int version        = (s[5]>>1) & 0x1f;
+	int section_number = s[6];
+	int last_section   = s[7];
+	unsigned char *p, *end;
+
+	if ( (s[5] & 1) == 0 )			// current_next_indicator
+		return;
+
+	if ( version != ivp->patVersion )
+	{
+		if ( ivp->patVersion >= 0 )
+			printf("DemuxTS: PAT version changed %d -> %d\n", ivp->patVersion, version);
+		DemuxTS_ResetPrograms(ivp, pOutputPIDs);
+		memset(ivp->patSections, 0, sizeof(ivp->patSections));
+		ivp->patVersion      = version;
+		ivp->patLastSection  = last_section;
+		ivp->patSectionsLeft = last_section + 1;
+	}
+	if ( section_number > ivp->patLastSection ||
+	     (ivp->patSections[section_number>>3] & (1<<(section_number&7))) )
+		return;
+	ivp->patSections[section_number>>3] |= 1<<(section_number&7);
+	ivp->patSectionsLeft--;
+
+	end = s + length - 4;
+	for ( p = s + 8; p + 4 <= end; p += 4 )
 	{
-		if ( pBuffer->p != pBuffer->pStart )
+		int program_number  = (p[0]<<8) | p[1];
+		int program_map_PID = ((p[2]&0x1f)<<8) | p[3];
+		int i;
+
+		if ( program_number == 0 )	// network_PID
+			continue;
+		if ( ivp->programCnt >= TS_MAX_PROGRAMS )
 		{
-			memcpy(pBuffer->pStart, pBuffer->p, pBuffer->Size);
-			pBuffer->p = pBuffer->pStart;
-			return DemuxTS_AppendData(ivp, pPkBuffer, iPkSize);
+			printf("DemuxTS: too many programs, program %d ignored\n", program_number);
+			continue;
 		}
-		printf("ERROR: BUFFER OVERFLOW in DemuxTS_AppendData << err start=0x%x, p=0x%x, end=0x%x, size=%d\n", pBuffer->pStart, pBuffer->p, pBuffer->pEnd, pBuffer->Size);
-		return -1;
+		ivp->program[ivp->programCnt].program_number  = program_number;
+		ivp->program[ivp->programCnt].program_map_PID = program_map_PID;
+		ivp->program[ivp->programCnt].done            = 0;
+		ivp->programCnt++;
+
+		// several programs may share one PMT PID
+		for ( i = 0; i < ivp->assemblerCnt; i++ )
+			if ( ivp->pmt[i].pid == program_map_PID )
+				break;
+		if ( i == ivp->assemblerCnt )
+			DemuxTS_ResetAssembler(&ivp->pmt[ivp->assemblerCnt++], program_map_PID);
 	}
+	if ( ivp->patSectionsLeft == 0 )
+		pOutputPIDs->TotalProgramCnt = ivp->programCnt;
 }
 
-//---------------------------------------------------------------------------
-int program_association_section(pstrInstanceDTS ivp, pAssociationSection pPMT)
+static int DemuxTS_StreamType(int stream_type, unsigned char *descr, int length)
 {
-	unsigned char *tp_packet = ivp->tp_packet+ivp->read_index;
-	unsigned char *tp_packet_bak = tp_packet;
-	int section_length, section_length_bak;
-	int program_info_length;
-	pPMT->uiStreams = 0;
-
-	tp_packet ++;
-	if ( tp_packet[0]!=0 )
+	if ( stream_type != 0x06 )
+		return stream_type;
+
+	// private stream: AC3 is signalled by DVB AC-3/E-AC-3 descriptor
+	while ( length >= 2 )
 	{
-		return 0;							// table_id
+		if ( descr[0] == 0x6a || descr[0] == 0x7a )
+			return 81;
+		length -= 2 + descr[1];
+		descr  += 2 + descr[1];
 	}
-	CHECK_MARKER_BITS((tp_packet[1]>>6) & 1, 0);				// section_syntax_indicator
-	CHECK_MARKER_BITS((tp_packet[1]>>2)&3, 0);					// first 2 bits of section_length
-	section_length_bak = section_length = (((tp_packet[1] & 3)<<8) | tp_packet[2]);
-	pPMT->transport_stream_id  = (tp_packet[3] <<8) | tp_packet[4];
-	pPMT->version_number = (tp_packet[5]>>1) & 0x1f;
-	pPMT->current_next_indicator = tp_packet[5] & 1;
-	pPMT->section_number = tp_packet[6];						// section_number
-	pPMT->last_section_number = tp_packet[7];					// last_section_number
-	tp_packet += 8;
-	section_length -= 7 + 4;
-	if ( section_length>188 )
+	return 0xff;
+}
+
+static void TS_program_map_section(pstrInstanceDTS ivp, int pid, unsigned char *s, int length, pStreamsPIDs pOutputPIDs)
+{
+	int program_number = (s[3]<<8) | s[4];
+	int PCR_PID, program_info_length;
+	unsigned char *p, *end;
+	ProgramInfo *program = NULL;
+	int i;
+
+	if ( (s[5] & 1) == 0 )			// current_next_indicator
+		return;
+	for ( i = 0; i < ivp->programCnt; i++ )
 	{
-		printf("ERROR: SECTION LENGTH %d FORBIDDEN\n", section_length);
-		return 0;
+		if ( ivp->program[i].program_number == program_number &&
+		     ivp->program[i].program_map_PID == pid )
+		{
+			program = &ivp->program[i];
+			break;
+		}
 	}
-	while ( section_length>0 )
+	if ( program == NULL || program->done )
+		return;
+
+	PCR_PID             = ((s[8]&0x1f)<<8) | s[9];
+	program_info_length = ((s[10]&0x0f)<<8) | s[11];
+	end = s + length - 4;
+	for ( p = s + 12 + program_info_length; p + 5 <= end; )
 	{
-		if (pPMT->uiStreams < MAX_STREAMS_IN_PROGRAM)
+		int ES_info_length = ((p[3]&0x0f)<<8) | p[4];
+
+		if ( p + 5 + ES_info_length > end )
+			break;
+		if ( p[0] )
 		{
-			pPMT->stream[pPMT->uiStreams].program_number = (tp_packet[0] <<8) | tp_packet[1];
-			pPMT->stream[pPMT->uiStreams].program_map_PID= ((tp_packet[2]&0x1f)<<8) | tp_packet[3];
-	//		printf("Program%d number %d, PID = %d\n", pPMT->uiStreams, pPMT->stream[pPMT->uiStreams].program_number,
-//			pPMT->stream[pPMT->uiStreams].program_map_PID);
-			pPMT->uiStreams++;
+			if ( pOutputPIDs->ItemsCnt < TS_MAX_STREAMS )
+			{
+				StreamsPIDs::StrmInfo *pStream = &pOutputPIDs->pStream[pOutputPIDs->ItemsCnt++];
+
+				pStream->ProgNum        = program_number;
+				pStream->ProgID         = pid;
+				pStream->PCR_PID        = PCR_PID;
+				pStream->elementary_PID = ((p[1]&0x1f)<<8) | p[2];
+				pStream->stream_type    = DemuxTS_StreamType(p[0], p + 5, ES_info_length);
+			} else
+			{
+				printf("DemuxTS: too many streams in program %d\n", program_number);
+			}
 		}
-		tp_packet += 4;
-		section_length -= 4;
+		p += 5 + ES_info_length;
 	}
-	section_length = section_length_bak;
-	if ( tp_packet-tp_packet_bak != section_length )
+	program->done = 1;
+	ivp->programsDone++;
+	pOutputPIDs->ProgramCnt++;
+}
+
+static void DemuxTS_Section(pstrInstanceDTS ivp, pSectionAssembler pAsm, pStreamsPIDs pOutputPIDs)
+{
+	unsigned char *s = pAsm->section;
+
+	if ( (s[1] & 0x80) == 0 || pAsm->length < 12 )	// section_syntax_indicator
+		return;
+	if ( dvb_crc32(s, pAsm->length) != 0 )
 	{
-		printf("Possible ERROR: PAS read %d, section length %d\n", tp_packet-tp_packet_bak, section_length);
-		return section_length+4;
+		ivp->crcErrors++;
+		return;
+	}
+	if ( pAsm->pid == TS_PAT_PID )
+	{
+		if ( s[0] == TS_TABLE_PAT )
+			program_association_section(ivp, s, pAsm->length, pOutputPIDs);
+	} else if ( s[0] == TS_TABLE_PMT )
+	{
+		TS_program_map_section(ivp, pAsm->pid, s, pAsm->length, pOutputPIDs);
 	}
-	return tp_packet-tp_packet_bak+4;
 }
 
+// Appends payload to section being assembled, returns number of consumed bytes
+static int DemuxTS_AppendSection(pstrInstanceDTS ivp, pSectionAssembler pAsm, unsigned char *data, int size, pStreamsPIDs pOutputPIDs)
+{
+	int consumed = 0;
+	int total, n;
 
+	if ( pAsm->length < 3 )
+	{
+		n = 3 - pAsm->length;
+		if ( n > size )
+			n = size;
+		memcpy(pAsm->section + pAsm->length, data, n);
+		pAsm->length += n;
+		consumed     += n;
+		if ( pAsm->length < 3 )
+			return consumed;
+	}
+	total = 3 + (((pAsm->section[1]&0x0f)<<8) | pAsm->section[2]);
+	if ( total > TS_SECTION_MAX )
+	{
+		pAsm->length = -1;
+		return size;
+	}
+	n = total - pAsm->length;
+	if ( n > size - consumed )
+		n = size - consumed;
+	memcpy(pAsm->section + pAsm->length, data + consumed, n);
+	pAsm->length += n;
+	consumed     += n;
+	if ( pAsm->length == total )
+	{
+		DemuxTS_Section(ivp, pAsm, pOutputPIDs);
+		pAsm->length = -1;
+	}
+	return consumed;
+}
 
-int TS_program_map_section(pstrInstanceDTS ivp, pMapSection pPMT)
+static void DemuxTS_Packet(pstrInstanceDTS ivp, unsigned char *p, pStreamsPIDs pOutputPIDs)
 {
-	unsigned char *tp_packet = ivp->tp_packet+ivp->read_index;
-	unsigned char *tp_packet_bak = tp_packet;
-	int section_length, section_length_bak;
-	int program_info_length;
-	int ES_info_length;
-	pPMT->uiStreams = 0;
-	tp_packet++;
-
-	if ( tp_packet[0]!=2 )
+	int pid                          = ((p[1] & 0x1F) << 8) | p[2];
+	int transport_error_indicator    = p[1] & 0x80;
+	int payload_unit_start_indicator = p[1] & 0x40;
+	int adaptation_field_control     = (p[3] & 0x30) >> 4;
+	int continuity_counter           = p[3] & 0x0f;
+	pSectionAssembler pAsm;
+	unsigned char *data;
+	int size;
+
+	ivp->packets++;
+	if ( transport_error_indicator || (adaptation_field_control & 1) == 0 )
+		return;
+	if ( (pAsm = DemuxTS_FindAssembler(ivp, pid)) == NULL || !DemuxTS_IsPidPending(ivp, pid) )
+		return;
+
+	data = p + 4;
+	if ( adaptation_field_control == 3 )
 	{
-		printf("It's not a PMT\n");
-		return 0;							// table_id
+		data += 1 + data[0];
+		if ( data >= p + TS_PACKET_LENGTH )
+			return;
 	}
-	CHECK_MARKER_BITS((tp_packet[1]>>6) & 1, 0);				// section_syntax_indicator
-	CHECK_MARKER_BITS((tp_packet[1]>>2) & 3, 0);				// first 2 bits of section_length
-	section_length_bak = section_length = ((tp_packet[1] & 3)<<8) | tp_packet[2];
-	pPMT->program_number = (tp_packet[3] <<8) | tp_packet[4];
-	pPMT->version_number = (tp_packet[5]>>1) & 0x1f;
-	pPMT->current_next_indicator = tp_packet[5] & 1;
-//	printf("Program %d, version %d\n", pPMT->program_number, pPMT->version_number);
-	CHECK_MARKER_BITS(tp_packet[6], 0);							// section_number
-	CHECK_MARKER_BITS(tp_packet[7], 0);							// last_section_number
-	pPMT->PCR_PID = ((tp_packet[8] & 0x1f)<<5) | tp_packet[9];
-	CHECK_MARKER_BITS(tp_packet[10] & 0x0c, 0);				// first 2 bits of program_info_length
-	program_info_length = ((tp_packet[10] & 0xf) <<4) | tp_packet[11];
-	tp_packet+=program_info_length+12;
-	section_length -= 11 + program_info_length + 4;
-	if ( section_length>188 )
+	size = p + TS_PACKET_LENGTH - data;
+
+	if ( pAsm->ccount >= 0 )
 	{
-		printf("ERROR: SECTION LENGTH %d FORBIDDEN\n", section_length);
-		return 0;
+		if ( continuity_counter == pAsm->ccount )
+			return;				// duplicate packet
+		if ( continuity_counter != ((pAsm->ccount + 1) & 0x0f) )
+		{
+			ivp->ccErrors++;
+			pAsm->length = -1;	// partial section is lost
+		}
 	}
-	while ( section_length>0 )
+	pAsm->ccount = continuity_counter;
+
+	if ( !payload_unit_start_indicator )
 	{
-		ES_info_length = ((tp_packet[3] & 3)<<8) | tp_packet[4];
-		if ( tp_packet[0] )
+		if ( pAsm->length >= 0 )
+			DemuxTS_AppendSection(ivp, pAsm, data, size, pOutputPIDs);
+		return;
+	}
+
+	{
+		int pointer_field = data[0];
+
+		data++;
+		size--;
+		if ( pointer_field > size )
 		{
-			if (pPMT->uiStreams < MAX_STREAMS_IN_PROGRAM)
-			{
-				pPMT->stream[pPMT->uiStreams].stream_type       = tp_packet[0];	// MPEG1 or MPEG2
-				pPMT->stream[pPMT->uiStreams].elementary_PID    = ((tp_packet[1]&0x1f)<<8) | tp_packet[2];
-	//			printf("stream_type = %d  PID = %d\n", pPMT->stream[pPMT->uiStreams].stream_type, pPMT->stream[pPMT->uiStreams].elementary_PID);
-				if (tp_packet[0]==0x06) {	// possible value for DVB-T AC3
-					pPMT->stream[pPMT->uiStreams].stream_type = 0xff;
-
-					if (ES_info_length) {
-						printf("minidmx: Private stream tag (%d)\n",tp_packet[5]);
-						if (tp_packet[5]==0x6a || tp_packet[5]==0x7a) {	// Im not sure about 0x7a, but it was mentioned by someone when I searched in google
-							pPMT->stream[pPMT->uiStreams].stream_type = 81;
-						}
-					}
-				}
-				pPMT->uiStreams++;
-			}
-			CHECK_MARKER_BITS(tp_packet[3] & 0x0c, 0);			// first 2 bits of ES_info_length
+			pAsm->length = -1;
+			return;
 		}
-		tp_packet += 5 + ES_info_length;
-		section_length -= 5 + ES_info_length;
+		// tail of previous section
+		if ( pAsm->length >= 0 && pointer_field > 0 )
+			DemuxTS_AppendSection(ivp, pAsm, data, pointer_field, pOutputPIDs);
+		data += pointer_field;
+		size -= pointer_field;
 	}
-	section_length = section_length_bak;
-	if ( tp_packet-tp_packet_bak != section_length )
+	// one or more sections starting in this packet
+	while ( size > 0 && data[0] != TS_STUFFING_BYTE )
 	{
-		printf("Psssible ERROR: PMT read %d, section length %d\n", tp_packet-tp_packet_bak, section_length);
-		return section_length+4;
+		int consumed;
+
+		pAsm->length = 0;
+		consumed = DemuxTS_AppendSection(ivp, pAsm, data, size, pOutputPIDs);
+		data += consumed;
+		size -= consumed;
+		if ( !DemuxTS_IsPidPending(ivp, pid) )
+			break;
 	}
-	return tp_packet-tp_packet_bak+4; // +4 - CRC
 }
+
+static int DemuxTS_IsComplete(pstrInstanceDTS ivp)
+{
+	return ivp->patVersion >= 0 && ivp->patSectionsLeft == 0 &&
+	       ivp->programsDone == ivp->programCnt;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 ////									DemuxTS_Parse									  ////
 //////////////////////////////////////////////////////////////////////////////////////////////
-//debug = debug
-#ifdef _DEBUG
-int iBytesRecve = 0;
-#endif
+// Returns DEMUX_TS_COMPLETE when PAT and PMTs of all announced programs are parsed,
+// DEMUX_TS_INCOMPLETE if more data is needed. Partial sections and packets are kept
+// until next call.
 int DemuxTS_Parse(void *ivp_, char *pbBuffer, int iBufferLength, pStreamsPIDs pOutputPIDs)
 {
-
-#define GOTO_NEXT_PACKET	pBufDTS->p	+=	TS_PACKET_LENGTH;\
-							pBufDTS->Size	-=	TS_PACKET_LENGTH;\
-							iCurPos	+=	TS_PACKET_LENGTH;
-
 	pstrInstanceDTS ivp = (pstrInstanceDTS)ivp_;
-	int iCurPos = 0;
-	pstrBufferDTS pBufDTS = ivp->pInputBuffer;
-	int     MaxOutStreams = MAX_STREAMS_IN_PROGRAM;
-/*
-	pOutputPIDs->pStream    = NULL;
-	pOutputPIDs->ItemsCnt   = 0;
-*/
-//	printf("%d = %d\n", pOutputPIDs->pStream, pOutputPIDs->ItemsCnt);
-
-#ifdef _DEBUG
-	iBytesRecve += iBufferLength;
-#endif
-	DemuxTS_AppendData(ivp_, pbBuffer, iBufferLength);
-	while ( pBufDTS->Size>3*TS_PACKET_LENGTH || (pBufDTS->p[0]==TS_SYNC_BYTE && ivp->bSyncronized && pBufDTS->Size>=TS_PACKET_LENGTH) )
+	unsigned char *p   = (unsigned char *)pbBuffer;
+	unsigned char *end = p + (iBufferLength > 0 ? iBufferLength : 0);
+
+	if ( ivp->carryLen > 0 )
 	{
-		if ( pBufDTS->p[0]!=TS_SYNC_BYTE )
+		int n = TS_PACKET_LENGTH - ivp->carryLen;
+
+		if ( n > end - p )
+			n = end - p;
+		memcpy(ivp->carry + ivp->carryLen, p, n);
+		ivp->carryLen += n;
+		p             += n;
+		if ( ivp->carryLen == TS_PACKET_LENGTH )
 		{
-			//printf("Missing synch byte ! 0x47 != %d  offset = %d\n", pBufDTS->p[0], pBufDTS->p-pBufDTS->pStart);
-			ivp->bSyncronized = 0;
+			DemuxTS_Packet(ivp, ivp->carry, pOutputPIDs);
+			ivp->carryLen = 0;
 		}
-		// if 4 times synch byte found, assume that we have sequence of transport stream packets
-		if ( !ivp->bSyncronized )
+	}
+
+	while ( p < end )
+	{
+		if ( p[0] != TS_SYNC_BYTE ||
+		     (p + TS_PACKET_LENGTH < end && p[TS_PACKET_LENGTH] != TS_SYNC_BYTE) )
 		{
-			while ( pBufDTS->Size>3*TS_PACKET_LENGTH )
-			{
-				if ( (pBufDTS->p[0]==TS_SYNC_BYTE) &&
-					 (pBufDTS->p[TS_PACKET_LENGTH]==TS_SYNC_BYTE) &&
-					 (pBufDTS->p[TS_PACKET_LENGTH*2]==TS_SYNC_BYTE) &&
-					 (pBufDTS->p[TS_PACKET_LENGTH*3]==TS_SYNC_BYTE) )
-				{
-					ivp->bSyncronized = 1; break;
-				}
-				pBufDTS->p++;
-				pBufDTS->Size--;
-				iCurPos++;
-			}
+			p++;	// resynchronize
+			continue;
 		}
-		if ( ivp->bSyncronized )
+		if ( end - p < TS_PACKET_LENGTH )
 		{
-			int     drop_packet = FALSE;
-			int     transport_error_indicator;
-			int     payload_unit_start_indicator;
-			int     pid;
-			int     adaptation_field_control;
-			int     continuity_counter;
-			int     first_section;
-			int     two_sections;
-			int     pidType=0;
-			int     iTmp, iTmp1, iTmp2, i;
-//	PESPacket	tmpPES;
-			AssociationSection  pAS;
-			MapSection          pPmt;
-			PidInfoStr  *pPidInfo;
-
-//	printf("Demux TS Packet offset = %d\n", pBufDTS->p-pBufDTS->pStart);
-//	tmpPES.llPTS = 0;
-			ivp->tp_packet      = pBufDTS->p;
-			ivp->read_index     = 4;	// TS packet header
-
-			// Get the transport packet header
-			pid                          = ((pBufDTS->p[1] & 0x1F) << 8) + pBufDTS->p[2];
-
-			transport_error_indicator    = ((int)(pBufDTS->p[1] & 0x80) >> 7);
-			payload_unit_start_indicator = ((int)(pBufDTS->p[1] & 0x40) >> 6);
-			adaptation_field_control     = ((int)(pBufDTS->p[3] & 0x30) >> 4);
-			continuity_counter           = (pBufDTS->p[3] & 0x0f);
-
-#if 0  // Unused
-//	int  transport_priority;
-//	int  transport_scrambling_control;
-
-//	transport_priority           = ((int)(pBufDTS->p[1] & 0x08) >> 3);
-//	transport_scrambling_control = ((int)(pBufDTS->p[3] & 0xc0) >> 6);
-#endif
-			for ( i=0;i<ivp->PidsFound;i++ )
-				if ( pid==ivp->pPidsInfo[i]->pid )
-				{
-					pPidInfo    = ivp->pPidsInfo[i];
-					break;
-				}
-			if ( i==ivp->PidsFound )
-			{
-				pPidInfo = ivp->pPidsInfo[i] = (pPidInfoStr)malloc(sizeof(*pPidInfo));
-				memset(pPidInfo, 0, sizeof(*pPidInfo));
-				pPidInfo->pid = pid;
-				ivp->PidsFound++;
-			}
-
-			if ( transport_error_indicator )
-			{
-				printf("ERROR: Recieve error flag in a transport packet\n");
-				GOTO_NEXT_PACKET
-				continue;
-			}
-			if ( adaptation_field_control == 0 )
-			{
-				drop_packet = TRUE;
-			}
-
-			if ( pPidInfo->started == TRUE )
-			{
-				if ( pPidInfo->ccount == continuity_counter )
-				{
-					if ( (adaptation_field_control > 1) &&
-						 (pBufDTS->p[4]      > 0) &&		 // Adapation field length
-						 ((pBufDTS->p[5] & 0x80) == 0x80) )	 // Discontinuity_counter set
-					{
-						//				Discontinuity
-						pPidInfo->ccount  = continuity_counter;	 // already have this value
-					} else
-					{	 //				printf("Duplicate packet counter = %d\n", continuity_counter);
-						drop_packet = TRUE;
-					}
-				} else if ( ((int)(pPidInfo->ccount + 1) % 16) != continuity_counter )
-				{
-					//printf("Continuity counter mismatch: Expected=%d Got=%d\n", ((int)(pPidInfo->ccount + 1) % 16), continuity_counter);
-					pPidInfo->ccount = continuity_counter;
-				} else
-				{
-					pPidInfo->ccount = continuity_counter;	// OK
-				}
-			} else
-			{
-//		printf("New TS started %d, first TS packet counter = %d\n", pid, continuity_counter);
-				pPidInfo->started = TRUE;
-				pPidInfo->ccount  = continuity_counter;
-			}
-
-			if ( adaptation_field_control > 1 )
-			{
-//		getAdaptationField( ivp, pid, pPidInfo );
-				iTmp=1+ivp->tp_packet[ivp->read_index];
-				if ( iTmp>180 )
-				{
-					GOTO_NEXT_PACKET
-					continue;
-				}
-				ivp->read_index += iTmp;
-			}
-			if ( (pid == NULL_PACKETS_PID) || drop_packet )
-			{
-				GOTO_NEXT_PACKET
-				continue;
-			}
-//	if (ivp->iPatCnt && pid==ivp->PAT_PIDS[0] && !(adaptation_field_control & payload_unit_start_indicator))
-//	printf("WARNING: PAT Table Skipped: Adaptation: %d, Playload %d\n", adaptation_field_control, payload_unit_start_indicator);
-
-			if ( adaptation_field_control & 1 )
-			{
-				if ( payload_unit_start_indicator )
-				{
-					if ( pid == 0 )
-					{
-						ivp->read_index += iTmp = program_association_section(ivp, &pAS);
-						// add new PID if found
-						if ( iTmp )
-						{
-							for ( iTmp1=0;iTmp1<pAS.uiStreams;iTmp1++ )
-							{
-								iTmp = 1;
-								for ( iTmp2=0;iTmp2<ivp->iPatCnt;iTmp2++ )
-									if ( pAS.stream[iTmp1].program_map_PID == ivp->PAT_PIDS[iTmp2] ) iTmp = 0;
-								if ( iTmp )
-								{
-									ivp->PAT_PIDS[ivp->iPatCnt] = pAS.stream[iTmp1].program_map_PID;
-									ivp->PAT_NBRS[ivp->iPatCnt] = pAS.stream[iTmp1].program_number;
-									ivp->iPatCnt++;
-								}
-							}
-						}
-					} else
-						if ( ivp->iPatCnt )
-					{
-						for ( i=0;i<ivp->iPatCnt;i++ )
-							if ( pid==ivp->PAT_PIDS[i] )
-							{
-								break;
-							}
-						if ( i!=ivp->iPatCnt )
-						{
-							void *tmpBuf;
-							TS_program_map_section(ivp, &pPmt);
-							if ( pOutputPIDs->pStream==NULL )
-							{
-								pOutputPIDs->pStream = (StreamsPIDs::StrmInfo *)malloc(sizeof(*pOutputPIDs->pStream) * MaxOutStreams);
-								pOutputPIDs->TotalProgramCnt = pAS.uiStreams;
-							}
-							if ( pOutputPIDs->ItemsCnt+pPmt.uiStreams>=MaxOutStreams )
-							{
-								MaxOutStreams <<= 1;
-								tmpBuf = malloc(sizeof(*pOutputPIDs->pStream) * MaxOutStreams);
-								memcpy(tmpBuf, pOutputPIDs->pStream, sizeof(*pOutputPIDs->pStream) * pOutputPIDs->ItemsCnt);
-								free(pOutputPIDs->pStream);
-								pOutputPIDs->pStream = (StreamsPIDs::StrmInfo *)tmpBuf;
-								pOutputPIDs->TotalProgramCnt = pAS.uiStreams;
-							}
-
-							{
-								int idx1;
-								int found;
-
-								found = 0;
-								for (idx1=0; idx1<pOutputPIDs->ItemsCnt; idx1++)
-								{
-									if (pOutputPIDs->pStream[idx1].ProgID			== ivp->PAT_PIDS[i])
-									{
-										if(pOutputPIDs->ItemsCnt == 0
-												|| (pOutputPIDs->ItemsCnt == pPmt.uiStreams))
-										{
-											found = 1;
-											break;
-										}
-									}
-								}
-
-								if (!found)
-								{
-									pOutputPIDs->ProgramCnt++;
-
-									pOutputPIDs->ItemsCnt	=	0;
-
-									for ( iTmp1=0; iTmp1<pPmt.uiStreams; iTmp1++ )
-									{
-										pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].PCR_PID		= pPmt.PCR_PID;
-										pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].ProgID      = ivp->PAT_PIDS[i];
-										pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].ProgNum     = ivp->PAT_NBRS[i];
-										pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].elementary_PID = pPmt.stream[iTmp1].elementary_PID;
-										pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].stream_type = pPmt.stream[iTmp1].stream_type;
-										/*printf("%03d (%03d/%03d):\t%08X > %08X (%08X):\t%08X (%8X)\n",
-												iTmp1, pOutputPIDs->ItemsCnt, pOutputPIDs->ProgramCnt,
-												pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].ProgID,
-												pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].ProgNum,
-												pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].PCR_PID,
-												pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].elementary_PID,
-												pOutputPIDs->pStream[pOutputPIDs->ItemsCnt].stream_type);*/
-										pOutputPIDs->ItemsCnt++;
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-
-			GOTO_NEXT_PACKET;
-//	printf("Decoded TS packet, new ptr: 0x%x. (offset=%d)\n", pBufDTS->p, iCurPos);
-		}			// if was sunc byte (TS packet end
-	}			// while not eof input buffer
-	return 0;
-}			//	func
-/*
+			ivp->carryLen = end - p;
+			memcpy(ivp->carry, p, ivp->carryLen);
+			break;
+		}
+		DemuxTS_Packet(ivp, p, pOutputPIDs);
+		p += TS_PACKET_LENGTH;
+	}
 
-#define BUFFER_SIZE		4*1024
-
-int main (int argc, char *argv[]) {
-	FILE *fInput = fopen(argv[1],"rb");
-	int iRead;
-	char pbBuffer[BUFFER_SIZE];
-	void *pDmxInst;
-	StreamsPIDs OutputPIDs;
-	DemuxTS_Open(&pDmxInst);
-	do {
-		iRead = fread(pbBuffer, 1, BUFFER_SIZE, fInput);
-		DemuxTS_Parse(pDmxInst, pbBuffer, iRead, &OutputPIDs);
-	} while (iRead=BUFFER_SIZE);
-	DemuxTS_Close(pDmxInst);
-	return 0;
+	return DemuxTS_IsComplete(ivp) ? DEMUX_TS_COMPLETE : DEMUX_TS_INCOMPLETE;
 }
-*/
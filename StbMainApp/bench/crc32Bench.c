@@ -0,0 +1,359 @@
+/*
+ crc32Bench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file crc32Bench.c Check and throughput of table driven MPEG-2 CRC32
+ * Collects PSI/SI sections from a captured transport stream given on command
+ * line: PAT, PMTs announced in it and sections with CRC on SI PIDs 0x10-0x14.
+ * Every section must have zero CRC residue with both dvb_crc32 and a plain
+ * bitwise reference, then dvb_crc32 is compared with the reference on every
+ * tail of the section to cover all alignments and remainders. Without capture
+ * synthetic PAT, PMT, SDT and EIT sections of typical sizes are checked.
+ * Finally all sections are processed in loops by dvb_crc32 and by a one
+ * table bytewise loop to compare throughput.
+ *
+ * Usage: crc32Bench [capture.ts [loops]]
+ */
+
+#include "crc32.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_TS_SIZE       (188)
+#define BENCH_MAX_SECTION   (4096)
+#define BENCH_MAX_SECTIONS  (20000)
+#define BENCH_MAX_PIDS      (64)
+#define BENCH_DEFAULT_LOOPS (200)
+#define BENCH_POLYNOMIAL    (0x04c11db7)
+
+typedef struct {
+	int      pid;
+	int      length; // collected bytes of current section, -1 while waiting for unit start
+	uint8_t  data[BENCH_MAX_SECTION + BENCH_TS_SIZE];
+} benchPid_t;
+
+static uint8_t   *bench_sections[BENCH_MAX_SECTIONS];
+static int        bench_lengths[BENCH_MAX_SECTIONS];
+static int        bench_count;
+static long       bench_bytes;
+static benchPid_t bench_pids[BENCH_MAX_PIDS];
+static int        bench_pidCount;
+static uint32_t   bench_table[256];
+
+static double bench_getTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* Bit by bit, shares nothing with crc32.c */
+static uint32_t bench_crcBitwise(const uint8_t *p, int length)
+{
+	uint32_t crc = 0xffffffff;
+	int i;
+
+	while (length-- > 0) {
+		crc ^= (uint32_t)*p++ << 24;
+		for (i = 0; i < 8; i++)
+			crc = crc & 0x80000000 ? (crc << 1) ^ BENCH_POLYNOMIAL : crc << 1;
+	}
+	return crc;
+}
+
+/* Plain one table implementation dvb_crc32 used before, for comparison */
+static uint32_t bench_crcBytewise(const uint8_t *p, int length)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (length-- > 0)
+		crc = (crc << 8) ^ bench_table[((crc >> 24) ^ *p++) & 0xff];
+	return crc;
+}
+
+static void bench_initTable(void)
+{
+	uint32_t crc;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc = (uint32_t)i << 24;
+		for (k = 0; k < 8; k++)
+			crc = crc & 0x80000000 ? (crc << 1) ^ BENCH_POLYNOMIAL : crc << 1;
+		bench_table[i] = crc;
+	}
+}
+
+static void bench_addSection(const uint8_t *data, int length)
+{
+	if (bench_count >= BENCH_MAX_SECTIONS)
+		return;
+	bench_sections[bench_count] = malloc(length);
+	if (bench_sections[bench_count] == NULL)
+		return;
+	memcpy(bench_sections[bench_count], data, length);
+	bench_lengths[bench_count] = length;
+	bench_bytes += length;
+	bench_count++;
+}
+
+static benchPid_t *bench_findPid(int pid)
+{
+	int i;
+
+	for (i = 0; i < bench_pidCount; i++)
+		if (bench_pids[i].pid == pid)
+			return &bench_pids[i];
+	return NULL;
+}
+
+static void bench_addPid(int pid)
+{
+	if (bench_findPid(pid) != NULL || bench_pidCount >= BENCH_MAX_PIDS)
+		return;
+	bench_pids[bench_pidCount].pid    = pid;
+	bench_pids[bench_pidCount].length = -1;
+	bench_pidCount++;
+}
+
+/* Takes complete sections out of PID buffer, keeps incomplete tail */
+static void bench_takeSections(benchPid_t *p)
+{
+	int pos = 0, length, i;
+	const uint8_t *s;
+
+	while (p->length - pos >= 3 && p->data[pos] != 0xff) {
+		s = &p->data[pos];
+		length = 3 + (((s[1] & 0x0f) << 8) | s[2]);
+		if (length > BENCH_MAX_SECTION) {
+			p->length = -1;
+			return;
+		}
+		if (p->length - pos < length)
+			break;
+		/* Sections with syntax indicator and TOT carry CRC */
+		if ((s[1] & 0x80) || s[0] == 0x73) {
+			bench_addSection(s, length);
+			if (p->pid == 0 && s[0] == 0x00) {
+				for (i = 8; i + 4 <= length - 4; i += 4)
+					if (((s[i] << 8) | s[i+1]) != 0)
+						bench_addPid(((s[i+2] & 0x1f) << 8) | s[i+3]);
+			}
+		}
+		pos += length;
+	}
+	if (p->length - pos >= 1 && p->data[pos] == 0xff) {
+		p->length = -1; // stuffing till end of packet
+		return;
+	}
+	memmove(p->data, &p->data[pos], p->length - pos);
+	p->length -= pos;
+}
+
+static int bench_readCapture(const char *name)
+{
+	uint8_t ts[BENCH_TS_SIZE];
+	const uint8_t *payload;
+	benchPid_t *p;
+	int pid, size, pointer;
+	long packets = 0;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (f == NULL) {
+		perror(name);
+		return -1;
+	}
+	for (pid = 0x00; pid <= 0x14; pid++)
+		if (pid == 0x00 || pid >= 0x10)
+			bench_addPid(pid);
+
+	while (fread(ts, 1, 1, f) == 1) {
+		if (ts[0] != 0x47 || fread(&ts[1], 1, BENCH_TS_SIZE-1, f) != BENCH_TS_SIZE-1)
+			continue; // resync byte by byte
+		packets++;
+		pid = ((ts[1] & 0x1f) << 8) | ts[2];
+		p = bench_findPid(pid);
+		if (p == NULL || (ts[1] & 0x80) || !(ts[3] & 0x10))
+			continue;
+		payload = &ts[4];
+		if (ts[3] & 0x20)
+			payload += 1 + ts[4];
+		size = &ts[BENCH_TS_SIZE] - payload;
+		if (size <= 0)
+			continue;
+		if (ts[1] & 0x40) {
+			pointer = payload[0];
+			if (pointer + 1 > size) {
+				p->length = -1;
+				continue;
+			}
+			/* Tail of previous section precedes the pointed one */
+			if (p->length > 0) {
+				memcpy(&p->data[p->length], &payload[1], pointer);
+				p->length += pointer;
+				bench_takeSections(p);
+			}
+			p->length = 0;
+			payload += 1 + pointer;
+			size    -= 1 + pointer;
+		} else if (p->length < 0) {
+			continue;
+		}
+		memcpy(&p->data[p->length], payload, size);
+		p->length += size;
+		bench_takeSections(p);
+	}
+	fclose(f);
+	printf("%s: %ld TS packets, %d sections with CRC on %d PIDs\n", name, packets, bench_count, bench_pidCount);
+	return 0;
+}
+
+static void bench_appendCrc(uint8_t *s, int length)
+{
+	uint32_t crc = bench_crcBitwise(s, length - 4);
+
+	s[length-4] = crc >> 24;
+	s[length-3] = crc >> 16;
+	s[length-2] = crc >> 8;
+	s[length-1] = crc;
+}
+
+/* Long form section of given total length with pseudo random body */
+static void bench_makeSection(uint8_t tableId, int length, unsigned seed)
+{
+	uint8_t s[BENCH_MAX_SECTION];
+	int i;
+
+	s[0] = tableId;
+	s[1] = 0xb0 | ((length - 3) >> 8);
+	s[2] = (length - 3) & 0xff;
+	for (i = 3; i < length - 4; i++) {
+		seed = seed * 1103515245 + 12345;
+		s[i] = seed >> 16;
+	}
+	bench_appendCrc(s, length);
+	bench_addSection(s, length);
+}
+
+static void bench_makeSections(void)
+{
+	int i;
+
+	bench_makeSection(0x00, 16, 1);              // PAT with one program
+	bench_makeSection(0x00, 12 + 4*32, 2);       // PAT with 32 programs
+	for (i = 0; i < 16; i++)
+		bench_makeSection(0x02, 27 + 5*i, 3+i);  // PMTs
+	for (i = 0; i < 8; i++)
+		bench_makeSection(0x42, 200 + 111*i, 20+i); // SDT
+	for (i = 0; i < 256; i++)
+		bench_makeSection(0x4e + (i & 1), 100 + (i*37) % 3997, 30+i); // EIT p/f and schedule up to 4096 bytes
+	printf("no capture given: %d synthetic sections\n", bench_count);
+}
+
+static int bench_check(void)
+{
+	int errors = 0, invalid = 0;
+	int i, k, length;
+	const uint8_t *s;
+
+	for (i = 0; i < bench_count; i++) {
+		s = bench_sections[i];
+		length = bench_lengths[i];
+		if (bench_crcBitwise(s, length) != 0) {
+			invalid++; // corrupted in capture, still usable for comparison
+		} else if (dvb_crc32(s, length) != 0) {
+			printf("section %d table 0x%02x length %d: valid CRC rejected\n", i, s[0], length);
+			errors++;
+		}
+		for (k = 0; k < length; k++) {
+			if (dvb_crc32(&s[k], length - k) != bench_crcBitwise(&s[k], length - k)) {
+				printf("section %d table 0x%02x length %d: mismatch at offset %d\n", i, s[0], length, k);
+				errors++;
+				break;
+			}
+		}
+	}
+	printf("checked %d sections (%ld bytes, %d with bad CRC in source): %d errors\n",
+		bench_count, bench_bytes, invalid, errors);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int loops = BENCH_DEFAULT_LOOPS;
+	int errors, loop, i;
+	uint32_t sum = 0;
+	double start, sliced, bytewise;
+
+	bench_initTable();
+	if (argc > 1) {
+		if (bench_readCapture(argv[1]) != 0)
+			return 1;
+		if (argc > 2)
+			loops = atoi(argv[2]);
+	} else {
+		bench_makeSections();
+	}
+	if (bench_count == 0 || loops <= 0) {
+		fprintf(stderr, "usage: %s [capture.ts [loops]], capture must contain PSI/SI sections\n", argv[0]);
+		return 1;
+	}
+
+	errors = bench_check();
+
+	start = bench_getTime();
+	for (loop = 0; loop < loops; loop++)
+		for (i = 0; i < bench_count; i++)
+			sum += dvb_crc32(bench_sections[i], bench_lengths[i]);
+	sliced = bench_getTime() - start;
+
+	start = bench_getTime();
+	for (loop = 0; loop < loops; loop++)
+		for (i = 0; i < bench_count; i++)
+			sum -= bench_crcBytewise(bench_sections[i], bench_lengths[i]);
+	bytewise = bench_getTime() - start;
+
+	if (sum != 0) {
+		printf("dvb_crc32 and bytewise loop disagree\n");
+		errors++;
+	}
+	printf("dvb_crc32: %.1f MB/s, %.0f ns per section; bytewise: %.1f MB/s, %.0f ns per section; speedup %.2fx\n",
+		loops*bench_bytes/sliced/1e6,   sliced*1e9/loops/bench_count,
+		loops*bench_bytes/bytewise/1e6, bytewise*1e9/loops/bench_count,
+		bytewise/sliced);
+
+	for (i = 0; i < bench_count; i++)
+		free(bench_sections[i]);
+	return errors != 0;
+}
@@ -0,0 +1,589 @@
+/*
+ dvbScanBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file dvbScanBench.c Parallel service scan on simulated tuners
+ * Writes transport streams of a small cable network to DVB_SIMULATOR_DIR:
+ * six transponders announced in NIT, one of them also received on a frequency
+ * missing from NIT, plus a frequency without signal. Scan starts from half of
+ * the NIT frequencies and has to find the rest through NIT. Workers take
+ * frequencies from dvbScanQueue like dvb_scanFrequencies() ones, tune through
+ * dvbSimulator, wait for tuner lock and collect PAT, SDT and NIT from section
+ * filters. Found services are checked against the network after merge with
+ * the same NIT preference as dvb_scanMerge(), then scan time with one tuner
+ * is compared to all tuners. At last scan is cancelled right after start,
+ * workers must stop after their current frequency.
+ *
+ * Usage: dvbScanBench [lock_ms]
+ */
+
+#include "dvbScanQueue.h"
+#include "dvbSimulator.h"
+#include "dvb_types.h"
+#include "crc32.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BENCH_TS_SIZE         (188)
+#define BENCH_MAX_SECTION     (1024)
+#define BENCH_TRANSPONDERS    (6)
+#define BENCH_SERVICES        (8)
+#define BENCH_NETWORK_ID      (0x1001)
+#define BENCH_FIRST_FREQUENCY (474000)
+#define BENCH_STEP            (8000)
+/* Receives transport stream of transponder 2, but is not in NIT */
+#define BENCH_EXTRA_FREQUENCY (602000)
+/* No file, tuning fails */
+#define BENCH_EMPTY_FREQUENCY (610000)
+#define BENCH_DEFAULT_LOCK_MS (150)
+#define BENCH_SECTION_TIMEOUT (2000)
+#define BENCH_MAX_FOUND       (4 * BENCH_TRANSPONDERS * BENCH_SERVICES)
+
+typedef struct {
+	uint16_t onid;
+	uint16_t tsid;
+	uint16_t sid;
+	uint32_t frequency;
+	char     name[32];
+} benchService_t;
+
+typedef struct {
+	dvbScanQueue_t *queue;
+	uint32_t        adapter;
+	pthread_t       thread;
+} benchWorker_t;
+
+static pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+static benchService_t  bench_found[BENCH_MAX_FOUND];
+static int             bench_foundCount;
+static uint32_t        bench_nit[BENCH_TRANSPONDERS];
+static int             bench_nitCount;
+static int             bench_lockMs = BENCH_DEFAULT_LOCK_MS;
+static int             bench_errors;
+
+static double bench_getTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static uint32_t bench_frequency(int transponder)
+{
+	return BENCH_FIRST_FREQUENCY + transponder * BENCH_STEP;
+}
+
+static uint16_t bench_tsid(int transponder)
+{
+	return transponder + 1;
+}
+
+static uint16_t bench_sid(int transponder, int service)
+{
+	return bench_tsid(transponder) * 100 + service;
+}
+
+/* Fills section header, sets length and CRC once body is written after it */
+static int bench_finishSection(uint8_t *s, uint8_t tableId, uint16_t idExtension, int length)
+{
+	uint32_t crc;
+
+	length += 4;
+	s[0] = tableId;
+	s[1] = 0xb0 | ((length - 3) >> 8);
+	s[2] = (length - 3) & 0xff;
+	s[3] = idExtension >> 8;
+	s[4] = idExtension & 0xff;
+	s[5] = 0xc1; // version 0, current
+	s[6] = 0;
+	s[7] = 0;
+	crc = dvb_crc32(s, length - 4);
+	s[length-4] = crc >> 24;
+	s[length-3] = crc >> 16;
+	s[length-2] = crc >> 8;
+	s[length-1] = crc;
+	return length;
+}
+
+static int bench_makePat(uint8_t *s, int transponder)
+{
+	int length = 8, i;
+
+	for (i = 0; i < BENCH_SERVICES; i++) {
+		uint16_t pmt = 0x100 + i;
+		s[length++] = bench_sid(transponder, i) >> 8;
+		s[length++] = bench_sid(transponder, i) & 0xff;
+		s[length++] = 0xe0 | (pmt >> 8);
+		s[length++] = pmt & 0xff;
+	}
+	return bench_finishSection(s, 0x00, bench_tsid(transponder), length);
+}
+
+static int bench_makeSdt(uint8_t *s, int transponder)
+{
+	int length = 11, i;
+
+	s[8] = BENCH_NETWORK_ID >> 8;
+	s[9] = BENCH_NETWORK_ID & 0xff;
+	s[10] = 0xff;
+	for (i = 0; i < BENCH_SERVICES; i++) {
+		char name[32];
+		int nameLength = snprintf(name, sizeof(name), "TS%d service %d", bench_tsid(transponder), i);
+
+		s[length++] = bench_sid(transponder, i) >> 8;
+		s[length++] = bench_sid(transponder, i) & 0xff;
+		s[length++] = 0xfc;
+		s[length++] = 0x80 | (((5 + nameLength) >> 8) & 0x0f); // running
+		s[length++] = (5 + nameLength) & 0xff;
+		s[length++] = 0x48; // service_descriptor
+		s[length++] = 3 + nameLength;
+		s[length++] = 0x01; // digital television
+		s[length++] = 0;    // no provider name
+		s[length++] = nameLength;
+		memcpy(s + length, name, nameLength);
+		length += nameLength;
+	}
+	return bench_finishSection(s, 0x42, bench_tsid(transponder), length);
+}
+
+static int bench_makeNit(uint8_t *s)
+{
+	int length = 12, start, i;
+
+	s[8] = 0xf0; // no network descriptors
+	s[9] = 0;
+	start = length;
+	for (i = 0; i < BENCH_TRANSPONDERS; i++) {
+		// cable_delivery_system_descriptor, frequency in BCD XXXX.XXXX MHz
+		uint32_t value = bench_frequency(i) * 10;
+		uint32_t bcd = 0;
+		int digit;
+
+		for (digit = 0; digit < 8; digit++, value /= 10)
+			bcd |= (value % 10) << (4 * digit);
+		s[length++] = bench_tsid(i) >> 8;
+		s[length++] = bench_tsid(i) & 0xff;
+		s[length++] = BENCH_NETWORK_ID >> 8;
+		s[length++] = BENCH_NETWORK_ID & 0xff;
+		s[length++] = 0xf0;
+		s[length++] = 13;
+		s[length++] = 0x44;
+		s[length++] = 11;
+		s[length++] = bcd >> 24;
+		s[length++] = bcd >> 16;
+		s[length++] = bcd >> 8;
+		s[length++] = bcd;
+		s[length++] = 0xff;
+		s[length++] = 0xf2; // outer FEC RS(204/188)
+		s[length++] = 0x03; // 64-QAM
+		s[length++] = 0x00; // 6.875 Msymbol/s
+		s[length++] = 0x68;
+		s[length++] = 0x75;
+		s[length++] = 0x0f;
+	}
+	s[start-2] = 0xf0 | ((length - start) >> 8);
+	s[start-1] = (length - start) & 0xff;
+	return bench_finishSection(s, 0x40, BENCH_NETWORK_ID, length);
+}
+
+/* Splits section to TS packets, stuffing tail of the last one */
+static void bench_writeSection(FILE *f, int pid, const uint8_t *s, int length, int *cc)
+{
+	int offset = 0;
+
+	while (offset < length) {
+		uint8_t packet[BENCH_TS_SIZE];
+		int payload = 4, size;
+
+		memset(packet, 0xff, sizeof(packet));
+		packet[0] = 0x47;
+		packet[1] = (offset == 0 ? 0x40 : 0) | (pid >> 8);
+		packet[2] = pid & 0xff;
+		packet[3] = 0x10 | (*cc & 0x0f);
+		*cc = (*cc + 1) & 0x0f;
+		if (offset == 0)
+			packet[payload++] = 0; // pointer_field
+		size = length - offset;
+		if (size > BENCH_TS_SIZE - payload)
+			size = BENCH_TS_SIZE - payload;
+		memcpy(packet + payload, s + offset, size);
+		offset += size;
+		fwrite(packet, 1, sizeof(packet), f);
+	}
+}
+
+static int bench_writeStream(uint32_t frequency, int transponder)
+{
+	uint8_t section[BENCH_MAX_SECTION];
+	char filename[256];
+	int cc[3] = { 0, 0, 0 };
+	FILE *f;
+
+	snprintf(filename, sizeof(filename), "%s/%u.ts", DVB_SIMULATOR_DIR, frequency);
+	f = fopen(filename, "wb");
+	if (f == NULL) {
+		perror(filename);
+		return -1;
+	}
+	bench_writeSection(f, 0x00, section, bench_makePat(section, transponder), &cc[0]);
+	bench_writeSection(f, 0x11, section, bench_makeSdt(section, transponder), &cc[1]);
+	bench_writeSection(f, 0x10, section, bench_makeNit(section), &cc[2]);
+	fclose(f);
+	return 0;
+}
+
+static int bench_writeNetwork(void)
+{
+	char filename[256];
+	int i;
+
+	mkdir(DVB_SIMULATOR_DIR, 0755);
+	for (i = 0; i < BENCH_TRANSPONDERS; i++)
+		if (bench_writeStream(bench_frequency(i), i) != 0)
+			return -1;
+	if (bench_writeStream(BENCH_EXTRA_FREQUENCY, 1) != 0)
+		return -1;
+	snprintf(filename, sizeof(filename), "%s/%u.ts", DVB_SIMULATOR_DIR, BENCH_EMPTY_FREQUENCY);
+	unlink(filename);
+	return 0;
+}
+
+static void bench_removeNetwork(void)
+{
+	char filename[256];
+	int i;
+
+	for (i = 0; i <= BENCH_TRANSPONDERS; i++) {
+		snprintf(filename, sizeof(filename), "%s/%u.ts", DVB_SIMULATOR_DIR,
+			i < BENCH_TRANSPONDERS ? bench_frequency(i) : BENCH_EXTRA_FREQUENCY);
+		unlink(filename);
+	}
+	rmdir(DVB_SIMULATOR_DIR);
+}
+
+static int bench_parseSdt(const uint8_t *s, uint32_t frequency)
+{
+	int length = (((s[1] & 0x0f) << 8) | s[2]) + 3 - 4;
+	uint16_t tsid = (s[3] << 8) | s[4];
+	uint16_t onid = (s[8] << 8) | s[9];
+	int found = 0;
+	int p = 11;
+
+	pthread_mutex_lock(&bench_mutex);
+	while (p + 5 <= length && bench_foundCount < BENCH_MAX_FOUND) {
+		benchService_t *service = &bench_found[bench_foundCount++];
+		int end = p + 5 + (((s[p+3] & 0x0f) << 8) | s[p+4]);
+		int d;
+
+		memset(service, 0, sizeof(*service));
+		service->onid = onid;
+		service->tsid = tsid;
+		service->sid = (s[p] << 8) | s[p+1];
+		service->frequency = frequency;
+		for (d = p + 5; d + 2 <= end; d += 2 + s[d+1]) {
+			if (s[d] == 0x48) {
+				int provider = s[d+3];
+				int nameLength = s[d+4+provider];
+
+				if (nameLength >= (int)sizeof(service->name))
+					nameLength = sizeof(service->name) - 1;
+				memcpy(service->name, s + d + 5 + provider, nameLength);
+			}
+		}
+		found++;
+		p = end;
+	}
+	pthread_mutex_unlock(&bench_mutex);
+	return found;
+}
+
+static int bench_parseNit(const uint8_t *s, uint32_t *frequencies, int max)
+{
+	int length = (((s[1] & 0x0f) << 8) | s[2]) + 3 - 4;
+	int p = 10 + (((s[8] & 0x0f) << 8) | s[9]) + 2;
+	int count = 0;
+
+	while (p + 6 <= length && count < max) {
+		int end = p + 6 + (((s[p+4] & 0x0f) << 8) | s[p+5]);
+		int d;
+
+		for (d = p + 6; d + 2 <= end; d += 2 + s[d+1]) {
+			if (s[d] == 0x44 && s[d+1] >= 4) {
+				uint32_t value = 0;
+				int digit;
+
+				for (digit = 0; digit < 8; digit++)
+					value = value * 10 + ((s[d+2+digit/2] >> (digit & 1 ? 0 : 4)) & 0x0f);
+				frequencies[count++] = value / 10;
+			}
+		}
+		p = end;
+	}
+	pthread_mutex_lock(&bench_mutex);
+	bench_nitCount = count;
+	memcpy(bench_nit, frequencies, count * sizeof(uint32_t));
+	pthread_mutex_unlock(&bench_mutex);
+	return count;
+}
+
+/* Collects PAT, SDT and NIT of tuned transport stream like dvb_collectServices().
+ * Returns number of services found */
+static int bench_collect(uint32_t adapter, uint32_t frequency, uint32_t *nit, int *nitCount)
+{
+	static const int pids[3]   = { 0x00, 0x11, 0x10 };
+	static const int tables[3] = { 0x00, 0x42, 0x40 };
+	struct pollfd fds[3];
+	int received = 0, found = 0, programs = -1;
+	double deadline = bench_getTime() + BENCH_SECTION_TIMEOUT/1000.0;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		fds[i].fd = dvbSimulator_sectionOpen(adapter, pids[i], tables[i]);
+		fds[i].events = POLLIN;
+	}
+	while (received != 7 && bench_getTime() < deadline) {
+		if (poll(fds, 3, 100) <= 0)
+			continue;
+		for (i = 0; i < 3; i++) {
+			uint8_t s[BENCH_MAX_SECTION];
+
+			if (fds[i].fd < 0 || !(fds[i].revents & POLLIN) || (received & (1 << i)))
+				continue;
+			if (read(fds[i].fd, s, sizeof(s)) <= 0)
+				continue;
+			received |= 1 << i;
+			if (i == 0)
+				programs = ((((s[1] & 0x0f) << 8) | s[2]) + 3 - 12) / 4;
+			else if (i == 1)
+				found = bench_parseSdt(s, frequency);
+			else
+				*nitCount = bench_parseNit(s, nit, BENCH_TRANSPONDERS);
+			fds[i].events = 0;
+		}
+	}
+	for (i = 0; i < 3; i++)
+		if (fds[i].fd >= 0)
+			dvbSimulator_sectionClose(fds[i].fd);
+	if (received != 7) {
+		printf("%u: timeout waiting for sections, got mask %d\n", frequency, received);
+		bench_errors++;
+	} else if (programs != found) {
+		printf("%u: %d programs in PAT, %d services in SDT\n", frequency, programs, found);
+		bench_errors++;
+	}
+	return found;
+}
+
+static void *bench_workerThread(void *pArg)
+{
+	benchWorker_t *worker = pArg;
+	uint32_t frequency;
+
+	while (dvbScanQueue_take(worker->queue, &frequency) == 0) {
+		uint32_t nit[BENCH_TRANSPONDERS];
+		int nitCount = 0;
+		int found = 0;
+
+		if (dvbSimulator_tune(worker->adapter, frequency) == 0 && dvbSimulator_hasLock(worker->adapter)) {
+			usleep(bench_lockMs * 1000); // dvbfe_setParam waits for lock
+			if (!dvbScanQueue_isCancelled(worker->queue))
+				found = bench_collect(worker->adapter, frequency, nit, &nitCount);
+		}
+		dvbScanQueue_complete(worker->queue, frequency, found, nit, nitCount);
+	}
+	dvbScanQueue_leave(worker->queue);
+	return NULL;
+}
+
+static int bench_isNitFrequency(uint32_t frequency)
+{
+	int i;
+
+	for (i = 0; i < bench_nitCount; i++)
+		if (bench_nit[i] == frequency)
+			return 1;
+	return 0;
+}
+
+/* Drops duplicates preferring frequency announced in NIT like dvb_scanMerge(),
+ * returns number of unique services left at start of bench_found */
+static int bench_merge(void)
+{
+	int count = 0, i, k;
+
+	for (i = 0; i < bench_foundCount; i++) {
+		benchService_t *service = &bench_found[i];
+
+		for (k = 0; k < count; k++)
+			if (bench_found[k].onid == service->onid &&
+			    bench_found[k].tsid == service->tsid &&
+			    bench_found[k].sid  == service->sid)
+				break;
+		if (k == count)
+			bench_found[count++] = *service;
+		else if (!bench_isNitFrequency(bench_found[k].frequency) && bench_isNitFrequency(service->frequency))
+			bench_found[k] = *service;
+	}
+	return count;
+}
+
+static int bench_checkServices(int count)
+{
+	int errors = 0, transponder, i, k;
+
+	if (count != BENCH_TRANSPONDERS * BENCH_SERVICES) {
+		printf("%d services after merge, %d expected\n", count, BENCH_TRANSPONDERS * BENCH_SERVICES);
+		errors++;
+	}
+	for (transponder = 0; transponder < BENCH_TRANSPONDERS; transponder++) {
+		for (i = 0; i < BENCH_SERVICES; i++) {
+			char name[32];
+
+			snprintf(name, sizeof(name), "TS%d service %d", bench_tsid(transponder), i);
+			for (k = 0; k < count; k++)
+				if (bench_found[k].sid == bench_sid(transponder, i))
+					break;
+			if (k == count) {
+				printf("service %u not found\n", bench_sid(transponder, i));
+				errors++;
+			} else if (bench_found[k].frequency != bench_frequency(transponder) ||
+			           bench_found[k].tsid != bench_tsid(transponder) ||
+			           bench_found[k].onid != BENCH_NETWORK_ID ||
+			           strcmp(bench_found[k].name, name) != 0) {
+				printf("service %u: tsid %u onid %u on %u named '%s'\n", bench_found[k].sid,
+					bench_found[k].tsid, bench_found[k].onid, bench_found[k].frequency, bench_found[k].name);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+/* Scans initial list on adapters [0, adapters), cancels right after start if asked.
+ * Returns scan time in seconds */
+static double bench_scan(uint32_t adapters, int cancel, dvbScanProgress_t *progress)
+{
+	uint32_t frequencies[BENCH_TRANSPONDERS];
+	benchWorker_t workers[MAX_ADAPTER_SUPPORTED];
+	dvbScanQueue_t queue;
+	uint32_t count = 0, i;
+	double start;
+
+	// half of NIT, duplicate of transponder 2 first so NIT copy has to replace it
+	frequencies[count++] = BENCH_EXTRA_FREQUENCY;
+	for (i = 0; i < BENCH_TRANSPONDERS / 2; i++)
+		frequencies[count++] = bench_frequency(i);
+	frequencies[count++] = BENCH_EMPTY_FREQUENCY;
+
+	bench_foundCount = 0;
+	bench_nitCount = 0;
+	if (dvbScanQueue_init(&queue, frequencies, count) != 0) {
+		printf("failed to init queue\n");
+		bench_errors++;
+		return 0;
+	}
+	start = bench_getTime();
+	for (i = 0; i < adapters; i++) {
+		workers[i].queue = &queue;
+		workers[i].adapter = i;
+		dvbScanQueue_join(&queue);
+		if (pthread_create(&workers[i].thread, NULL, bench_workerThread, &workers[i]) != 0) {
+			dvbScanQueue_leave(&queue);
+			adapters = i;
+			break;
+		}
+	}
+	if (cancel)
+		dvbScanQueue_cancel(&queue);
+	for (i = 0; i < adapters; i++)
+		pthread_join(workers[i].thread, NULL);
+	start = bench_getTime() - start;
+
+	dvbScanQueue_getProgress(&queue, progress);
+	dvbScanQueue_destroy(&queue);
+	return start;
+}
+
+int main(int argc, char *argv[])
+{
+	dvbScanProgress_t progress;
+	double single = 0, parallel = 0;
+	uint32_t adapters;
+
+	if (argc > 1)
+		bench_lockMs = atoi(argv[1]);
+	if (bench_lockMs < 0) {
+		fprintf(stderr, "usage: %s [lock_ms]\n", argv[0]);
+		return 1;
+	}
+	if (bench_writeNetwork() != 0 || !dvbSimulator_isAvailable()) {
+		fprintf(stderr, "failed to write streams to %s\n", DVB_SIMULATOR_DIR);
+		return 1;
+	}
+
+	for (adapters = 1; adapters <= MAX_ADAPTER_SUPPORTED; adapters++) {
+		double elapsed = bench_scan(adapters, 0, &progress);
+		int count;
+
+		if (progress.done != progress.total || progress.total != BENCH_TRANSPONDERS + 2 ||
+		    progress.running != 0 || progress.found != (uint32_t)bench_foundCount) {
+			printf("%u tuners: %u of %u frequencies done, %u running, %u of %d services counted\n",
+				adapters, progress.done, progress.total, progress.running, progress.found, bench_foundCount);
+			bench_errors++;
+		}
+		count = bench_merge();
+		bench_errors += bench_checkServices(count);
+		printf("%u tuners: %u frequencies, %u services, %d unique, %.2f s\n",
+			adapters, progress.done, progress.found, count, elapsed);
+		if (adapters == 1)
+			single = elapsed;
+		parallel = elapsed;
+	}
+	if (MAX_ADAPTER_SUPPORTED > 1)
+		printf("speedup %.2fx\n", single / parallel);
+
+	bench_scan(MAX_ADAPTER_SUPPORTED, 1, &progress);
+	if (progress.running != 0 || progress.done > MAX_ADAPTER_SUPPORTED) {
+		printf("cancel: %u frequencies done, %u workers running\n", progress.done, progress.running);
+		bench_errors++;
+	} else {
+		printf("cancel: stopped after %u frequencies\n", progress.done);
+	}
+
+	bench_removeNetwork();
+	return bench_errors != 0;
+}
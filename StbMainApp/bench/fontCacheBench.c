@@ -0,0 +1,268 @@
+/*
+ fontCacheBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file fontCacheBench.c Font calls made to fit list labels
+ * Fits a frame of long EPG titles, Latin and Cyrillic, into menu width with
+ * the per-character search getMaxStringLengthForFont used before and with
+ * fontCache_fitString, and reports font calls and glyphs measured per frame.
+ * Font is a stand-in with proportional advances and a few kerning pairs,
+ * which measures strings glyph by glyph like DirectFB does, so results of
+ * both searches are also compared for every title and width.
+ *
+ * Usage: fontCacheBench [frames]
+ */
+
+#include "fontCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ENTRIES (12)
+
+static const char *bench_titles[] = {
+	"Formula 1: Grand Prix of Abu Dhabi, qualification. Live broadcast from Yas Marina circuit with commentary",
+	"The Voyage of the Dawn Treader (Chronicles of Narnia, part 3), adventure, fantasy, family, 2010",
+	"Документальный фильм \"Тайны Вселенной: как рождаются и умирают звёзды\" (Великобритания, 2012)",
+	"Новости. Итоги дня с подробным обзором событий в стране и мире, погода на выходные",
+	"Чемпионат мира по хоккею. Россия - Финляндия. Прямая трансляция из Минска, 1-й период",
+	"AVATAR: The Way of Water. Tonight at 21:00, premiere. WAVE, TOWER, Yesterday, Today, Tomorrow",
+	"Short title",
+	"Жизнь замечательных людей: Фёдор Шаляпин",
+	"Wildlife Special: Wolves of the Yellowstone valley, one year with the pack through every season",
+	"Кино в деталях. Большое интервью с режиссёром и актёрами фильма, вышедшего в прокат на этой неделе",
+	"Late Night Show with guests, music and improvised comedy sketches from the studio audience",
+	"Спокойной ночи, малыши!",
+};
+#define BENCH_TITLES ((int)(sizeof(bench_titles)/sizeof(bench_titles[0])))
+
+static unsigned long bench_stringCalls;
+static unsigned long bench_glyphCalls;
+static unsigned long bench_glyphsMeasured;
+
+static int bench_advance(unsigned int code)
+{
+	if (code < 0x80) {
+		if (strchr("il.,:;!'| ", code))
+			return 5;
+		if (strchr("mwMW", code))
+			return 15;
+		if (code >= 'A' && code <= 'Z')
+			return 12;
+		return 9;
+	}
+	if (code >= 0x400 && code < 0x500)
+		return strchr("\x16\x28\x36\x29\x49", code & 0xff) ? 14 : 10;
+	return 11;
+}
+
+static int bench_kerning(unsigned int prev, unsigned int code)
+{
+	if ((prev == 'A' && (code == 'V' || code == 'W' || code == 'v')) ||
+	    (prev == 'V' && code == 'A') || (prev == 'W' && code == 'A') ||
+	    (prev == 'T' && (code == 'o' || code == 'a')) || (prev == 'Y' && code == 'e'))
+		return -3;
+	if (prev == 'f' && code == 'f')
+		return 1;
+	return 0;
+}
+
+static unsigned int bench_decode(const unsigned char **s, const unsigned char *end)
+{
+	unsigned int code = *(*s)++;
+	if (code >= 0xE0)
+		code &= 0x0F;
+	else if (code >= 0xC0)
+		code &= 0x1F;
+	while (*s < end && (**s & 0xC0) == 0x80)
+		code = (code << 6) | (*(*s)++ & 0x3F);
+	return code;
+}
+
+static DFBResult bench_getStringWidth(IDirectFBFont *thiz, const char *text, int bytes, int *ret_width)
+{
+	const unsigned char *s = (const unsigned char*)text;
+	const unsigned char *end = s + (bytes < 0 ? (int)strlen(text) : bytes);
+	unsigned int prev = 0;
+	int width = 0;
+
+	bench_stringCalls++;
+	while (s < end) {
+		unsigned int code = bench_decode(&s, end);
+		width += bench_advance(code) + bench_kerning(prev, code);
+		prev = code;
+		bench_glyphsMeasured++;
+	}
+	*ret_width = width;
+	return DFB_OK;
+}
+
+static DFBResult bench_getGlyphAdvance(IDirectFBFont *thiz, unsigned int character, int *ret_advance)
+{
+	bench_glyphCalls++;
+	*ret_advance = bench_advance(character);
+	return DFB_OK;
+}
+
+/* getMaxStringLengthForFont as it was in interface.c */
+static int bench_fitLinear(IDirectFBFont *font, const char *string, int maxWidth)
+{
+	int total_length, width, pos, last_length, real_length;
+
+	total_length = 0;
+	real_length = strlen(string);
+
+	font->GetStringWidth(font, string, -1, &width);
+
+	if (width <= maxWidth)
+	{
+		return real_length;
+	}
+
+	pos = maxWidth*(real_length-6)/width;
+	if (pos > 0 && pos < real_length)
+	{
+		while ((string[pos] & 0xC0) == 0x80)
+		{
+			pos++;
+		}
+		font->GetStringWidth(font, string, pos, &width);
+		if (width <= maxWidth)
+		{
+			total_length = pos;
+		}
+	}
+
+	while (string[total_length] != 0)
+	{
+		last_length = total_length;
+		total_length++;
+		while ((string[total_length] & 0xC0) == 0x80)
+		{
+			total_length++;
+		}
+		font->GetStringWidth(font, string, total_length, &width);
+		if (width > maxWidth)
+		{
+			return last_length;
+		}
+	}
+
+	return total_length;
+}
+
+static double bench_getTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* Reference search: longest prefix at character boundary measured by font */
+static int bench_fitExact(IDirectFBFont *font, const char *string, int maxWidth)
+{
+	int length = 0, width;
+
+	while (string[length] != 0) {
+		int next = length+1;
+		while ((string[next] & 0xC0) == 0x80)
+			next++;
+		font->GetStringWidth(font, string, next, &width);
+		if (width > maxWidth)
+			break;
+		length = next;
+	}
+	return length;
+}
+
+static void bench_frames(IDirectFBFont *font, const char *name, int frames, int maxWidth,
+                         int (*fit)(IDirectFBFont*, const char*, int))
+{
+	double start = bench_getTime(), seconds;
+	volatile int sink = 0;
+	int frame, i;
+
+	bench_stringCalls = bench_glyphCalls = bench_glyphsMeasured = 0;
+	for (frame = 0; frame < frames; frame++)
+		for (i = 0; i < BENCH_ENTRIES; i++)
+			sink += fit(font, bench_titles[(frame+i) % BENCH_TITLES], maxWidth);
+	seconds = bench_getTime() - start;
+
+	printf("%-6s width %4d: %6.1f string calls, %5.2f glyph calls, %7.1f glyphs measured, %6.1f us per frame\n",
+		name, maxWidth, (double)bench_stringCalls/frames, (double)bench_glyphCalls/frames,
+		(double)bench_glyphsMeasured/frames, seconds*1e6/frames);
+	(void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 2000;
+	int widths[] = { 300, 560, 1100 };
+	fontCacheStats_t stats;
+	IDirectFBFont font;
+	int errors = 0;
+	int i, w;
+
+	if (frames <= 0) {
+		fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+		return 1;
+	}
+	memset(&font, 0, sizeof(font));
+	font.GetStringWidth  = bench_getStringWidth;
+	font.GetGlyphAdvance = bench_getGlyphAdvance;
+
+	/* Both searches must cut titles at the same place */
+	for (i = 0; i < BENCH_TITLES; i++) {
+		for (w = -1; w < 1300; w++) {
+			int expected = bench_fitExact(&font, bench_titles[i], w);
+			int old      = bench_fitLinear(&font, bench_titles[i], w);
+			int cached   = fontCache_fitString(&font, bench_titles[i], w);
+			if (cached != expected) {
+				if (errors++ < 10)
+					printf("mismatch: title %d width %d: cache %d, expected %d\n", i, w, cached, expected);
+			}
+			if (old != expected && errors++ < 10)
+				printf("old search differs: title %d width %d: %d, expected %d\n", i, w, old, expected);
+		}
+	}
+	fontCache_getStats(&stats);
+	printf("checked %d titles at %d widths: %d mismatches, %u of %u fits corrected for kerning\n",
+		BENCH_TITLES, 1301, errors, stats.corrections, stats.fits);
+
+	printf("frame of %d entries:\n", BENCH_ENTRIES);
+	for (i = 0; i < (int)(sizeof(widths)/sizeof(widths[0])); i++) {
+		bench_frames(&font, "before", frames, widths[i], bench_fitLinear);
+		bench_frames(&font, "cache",  frames, widths[i], fontCache_fitString);
+	}
+
+	fontCache_forget(&font);
+	return errors != 0;
+}
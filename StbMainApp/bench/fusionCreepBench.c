@@ -0,0 +1,276 @@
+/*
+ fusionCreepBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file fusionCreepBench.c Headless check of fusion creepline scrolling
+ * Drives fusionCreep_getFrame with a fake clock which advances frames by
+ * 7..33 ms, as a jittery creep thread would, and draws frames into a model
+ * of creep band. Every frame is checked for offset matching elapsed time,
+ * rectangles staying inside creep surface and band, and band content
+ * matching text position. The last frame must leave the band blank.
+ *
+ * Then fusionCreep_drawFrame is run with real time against a thread which
+ * takes the output lock like fusion_surface replacement does. Blit and flip
+ * are emulated with busy wait and sleep till vsync, lock wait of the other
+ * thread must not include flip time.
+ *
+ * Usage: fusionCreepBench [creep width] [screen width]
+ */
+
+#include "fusionCreep.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_JITTER_MIN_MS (7)
+#define BENCH_JITTER_MAX_MS (33)
+#define BENCH_BLIT_US       (300)
+#define BENCH_FLIP_US       (16000)
+#define BENCH_DRAW_FRAMES   (100)
+
+static int  bench_creepWidth  = 3000;
+static int  bench_screenWidth = 1280;
+static int *bench_surface;
+static int *bench_band;
+static int  bench_errors;
+
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int    bench_drawing;
+static uint64_t        bench_blitStart;
+static uint64_t        bench_holdMax;
+
+static uint64_t bench_getTimeUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static void bench_spin(int us)
+{
+	uint64_t end = bench_getTimeUs() + us;
+
+	while (bench_getTimeUs() < end)
+		;
+}
+
+static void bench_error(unsigned long long elapsed, const char *what, const fusionCreepFrame_t *frame)
+{
+	if (bench_errors++ < 10)
+		printf("%llu ms: %s (offset %d src %d dst %d width %d)\n", elapsed, what,
+			frame->offset, frame->srcX, frame->dstX, frame->width);
+}
+
+/* Text column n of surface holds n+1, blank tail holds 0 */
+static int bench_expected(int x, int offset)
+{
+	int column = x - bench_screenWidth + offset;
+
+	return column >= 0 && column < bench_creepWidth ? column + 1 : 0;
+}
+
+static int bench_fakeBlit(void *pArg, const fusionCreepFrame_t *frame)
+{
+	memcpy(bench_band + frame->dstX, bench_surface + frame->srcX, frame->width * sizeof(int));
+	return 0;
+}
+
+static void bench_checkFrame(unsigned long long elapsed, const fusionCreepFrame_t *frame)
+{
+	int x;
+
+	if (frame->offset != (int)(elapsed * FUSION_CREEP_SPEED / 1000))
+		bench_error(elapsed, "offset doesn't match elapsed time", frame);
+	if (frame->srcX < 0 || frame->width <= 0 ||
+	    frame->srcX + frame->width > bench_creepWidth + bench_screenWidth)
+		bench_error(elapsed, "source is outside of creep surface", frame);
+	if (frame->dstX < 0 || frame->dstX + frame->width > bench_screenWidth)
+		bench_error(elapsed, "destination is outside of band", frame);
+	if (bench_errors)
+		return;
+	bench_fakeBlit(NULL, frame);
+	for (x = 0; x < bench_screenWidth; x++) {
+		if (bench_band[x] != (frame->finished ? 0 : bench_expected(x, frame->offset))) {
+			bench_error(elapsed, "band content doesn't match position", frame);
+			break;
+		}
+	}
+}
+
+static int bench_fakeClock(void)
+{
+	unsigned long long elapsed = 0;
+	unsigned long long ideal = (unsigned long long)(bench_creepWidth + bench_screenWidth) * 1000 / FUSION_CREEP_SPEED;
+	fusionCreepFrame_t frame;
+	int lastOffset = 0;
+	int frames = 0, skipped = 0;
+
+	memset(bench_band, 0, bench_screenWidth * sizeof(int));
+	srand(1);
+	while (elapsed < ideal * 2) {
+		elapsed += BENCH_JITTER_MIN_MS + rand() % (BENCH_JITTER_MAX_MS - BENCH_JITTER_MIN_MS + 1);
+		if (fusionCreep_getFrame(elapsed, lastOffset, bench_creepWidth, bench_screenWidth, &frame) != 0) {
+			skipped++;
+			continue;
+		}
+		frames++;
+		lastOffset = frame.offset;
+		bench_checkFrame(elapsed, &frame);
+		if (frame.finished)
+			break;
+	}
+	// one unchanged position must not be redrawn
+	if (fusionCreep_getFrame(elapsed, lastOffset, bench_creepWidth, bench_screenWidth, &frame) != 1)
+		bench_error(elapsed, "unchanged position is drawn again", &frame);
+	if (!frame.finished)
+		bench_error(elapsed, "creep didn't finish", &frame);
+
+	printf("fake clock   %d frames, %d skipped, finished in %llu ms, ideal %llu ms, frame limit %d ms\n",
+		frames, skipped, elapsed, ideal, BENCH_JITTER_MAX_MS);
+	if (elapsed < ideal || elapsed > ideal + BENCH_JITTER_MAX_MS + 1000 / FUSION_CREEP_SPEED)
+		bench_error(elapsed, "finish time is off", &frame);
+	return bench_errors;
+}
+
+static int bench_blit(void *pArg, const fusionCreepFrame_t *frame)
+{
+	bench_blitStart = bench_getTimeUs();
+	bench_spin(BENCH_BLIT_US);
+	return 0;
+}
+
+static void bench_flip(void *pArg, int x1, int x2)
+{
+	uint64_t hold = bench_getTimeUs() - bench_blitStart;
+	struct timespec ts = { 0, BENCH_FLIP_US * 1000 };
+
+	if (pthread_mutex_trylock(&bench_lock) != 0) {
+		printf("flip is called with output lock held\n");
+		bench_errors++;
+	} else {
+		pthread_mutex_unlock(&bench_lock);
+	}
+	// time from blit start to flip bounds lock hold time from above
+	if (hold > bench_holdMax)
+		bench_holdMax = hold;
+	nanosleep(&ts, NULL);
+}
+
+/* Replaces fusion_surface every few ms, as fusion threads do */
+static void *bench_writer(void *pArg)
+{
+	uint64_t *waitMax = pArg;
+
+	while (bench_drawing) {
+		uint64_t start = bench_getTimeUs();
+		uint64_t wait;
+		struct timespec ts = { 0, 1000000 };
+
+		pthread_mutex_lock(&bench_lock);
+		wait = bench_getTimeUs() - start;
+		pthread_mutex_unlock(&bench_lock);
+		if (wait > *waitMax)
+			*waitMax = wait;
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+static int bench_lockHold(void)
+{
+	fusionCreepOutput_t output = { bench_blit, bench_flip, &bench_lock, NULL };
+	unsigned long long start = fusionCreep_getTime();
+	fusionCreepFrame_t frame;
+	uint64_t waitMax = 0;
+	pthread_t writer;
+	int lastOffset = 0;
+	int frames = 0;
+	int errors = bench_errors;
+
+	bench_drawing = 1;
+	if (pthread_create(&writer, NULL, bench_writer, &waitMax) != 0) {
+		printf("failed to create writer thread\n");
+		return 1;
+	}
+	while (frames < BENCH_DRAW_FRAMES) {
+		struct timespec ts = { 0, FUSION_CREEP_FRAME_MS * 1000000 };
+
+		if (fusionCreep_getFrame(fusionCreep_getTime() - start, lastOffset, bench_creepWidth, bench_screenWidth, &frame) == 0) {
+			lastOffset = frame.offset;
+			fusionCreep_drawFrame(&output, &frame);
+			frames++;
+		}
+		nanosleep(&ts, NULL);
+	}
+	bench_drawing = 0;
+	pthread_join(writer, NULL);
+
+	printf("lock hold    %d frames, blit %d us, flip %d us: blit to flip max %llu us, writer waited max %llu us\n",
+		frames, BENCH_BLIT_US, BENCH_FLIP_US, (unsigned long long)bench_holdMax, (unsigned long long)waitMax);
+	if (waitMax >= BENCH_FLIP_US) {
+		printf("writer waited for flip\n");
+		bench_errors++;
+	}
+	return bench_errors - errors;
+}
+
+int main(int argc, char **argv)
+{
+	int x;
+
+	if (argc > 1)
+		bench_creepWidth = atoi(argv[1]);
+	if (argc > 2)
+		bench_screenWidth = atoi(argv[2]);
+	if (bench_creepWidth <= 0 || bench_screenWidth <= 0) {
+		printf("Usage: %s [creep width] [screen width]\n", argv[0]);
+		return 1;
+	}
+	bench_surface = malloc((bench_creepWidth + bench_screenWidth) * sizeof(int));
+	bench_band    = malloc(bench_screenWidth * sizeof(int));
+	if (!bench_surface || !bench_band) {
+		printf("out of memory\n");
+		return 1;
+	}
+	for (x = 0; x < bench_creepWidth + bench_screenWidth; x++)
+		bench_surface[x] = x < bench_creepWidth ? x + 1 : 0;
+
+	bench_fakeClock();
+	bench_lockHold();
+
+	free(bench_surface);
+	free(bench_band);
+	if (bench_errors)
+		printf("%d errors\n", bench_errors);
+	return bench_errors != 0;
+}
@@ -0,0 +1,296 @@
+/*
+ imageCacheBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file imageCacheBench.c Lookup and decode latency of image cache
+ * Decoder is synthetic: it spins for given time and allocates thumbnail
+ * sized buffer, so results show cache overhead and what caller thread waits
+ * for rather than speed of real image codecs.
+ *
+ * Reports lookup time of hashed cache against linear most-recent-first list
+ * which gfx.c used before, time menu drawing thread spends on a screen of new
+ * thumbnails with synchronous and background decoding, and hit rate when
+ * images don't fit into budget.
+ *
+ * Usage: imageCacheBench [images] [decode us]
+ */
+
+#include "imageCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_IMAGE_WIDTH   (120)
+#define BENCH_IMAGE_HEIGHT  (90)
+#define BENCH_IMAGE_SIZE    (BENCH_IMAGE_WIDTH*BENCH_IMAGE_HEIGHT*4)
+#define BENCH_LOOKUPS       (200000)
+#define BENCH_SCREEN        (24)
+#define BENCH_SCREENS       (20)
+
+typedef struct bench_entry_s
+{
+	char                 *name;
+	void                 *image;
+	struct bench_entry_s *next;
+	struct bench_entry_s *prev;
+} bench_entry_t;
+
+static char **bench_names;
+static int    bench_decodeUs = 2000;
+
+static pthread_mutex_t bench_readyMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  bench_readyCond  = PTHREAD_COND_INITIALIZER;
+static int             bench_ready;
+
+static uint64_t bench_getTimeUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static void *bench_decode(const imageCacheRequest_t *request, size_t *size, void *pArg)
+{
+	uint64_t end = bench_getTimeUs() + bench_decodeUs;
+	void *image;
+
+	while (bench_getTimeUs() < end)
+		;
+	image = malloc(BENCH_IMAGE_SIZE);
+	if (!image) {
+		*size = IMAGE_CACHE_NO_MEMORY;
+		return NULL;
+	}
+	memset(image, request->variant, BENCH_IMAGE_SIZE);
+	*size = BENCH_IMAGE_SIZE;
+	return image;
+}
+
+static void bench_release(void *image, void *pArg)
+{
+	free(image);
+}
+
+static void bench_imageReady(const imageCacheRequest_t *request, void *image, void *pArg)
+{
+	pthread_mutex_lock(&bench_readyMutex);
+	bench_ready++;
+	pthread_cond_signal(&bench_readyCond);
+	pthread_mutex_unlock(&bench_readyMutex);
+}
+
+static imageCache_t *bench_createCache(size_t budget)
+{
+	imageCacheConfig_t config;
+
+	memset(&config, 0, sizeof(config));
+	config.budget  = budget;
+	config.decode  = bench_decode;
+	config.release = bench_release;
+	config.ready   = bench_imageReady;
+	return imageCache_create(&config);
+}
+
+static void *bench_get(imageCache_t *cache, int index, int flags)
+{
+	imageCacheRequest_t request;
+
+	memset(&request, 0, sizeof(request));
+	request.name   = bench_names[index];
+	request.width  = BENCH_IMAGE_WIDTH;
+	request.height = BENCH_IMAGE_HEIGHT;
+	return imageCache_get(cache, &request, flags);
+}
+
+/* Lookup as it was done by gfx_decodeImage: linear scan, found entry moved to front */
+static void *bench_listFind(bench_entry_t **list, const char *name)
+{
+	bench_entry_t *entry;
+
+	for (entry = *list; entry; entry = entry->next) {
+		if (strcmp(entry->name, name) == 0)
+			break;
+	}
+	if (!entry)
+		return NULL;
+	if (entry != *list) {
+		entry->prev->next = entry->next;
+		if (entry->next)
+			entry->next->prev = entry->prev;
+		entry->prev = NULL;
+		entry->next = *list;
+		(*list)->prev = entry;
+		*list = entry;
+	}
+	return entry->image;
+}
+
+/* Screens are scrolled over a shelf of images, some of which are visited more often */
+static int bench_pick(unsigned int *seed, int count)
+{
+	if (rand_r(seed) % 4)
+		return rand_r(seed) % (count < 64 ? count : 64);
+	return rand_r(seed) % count;
+}
+
+static void bench_lookup(int count)
+{
+	imageCache_t *cache = bench_createCache((size_t)count*(BENCH_IMAGE_SIZE+1024));
+	bench_entry_t *entries = calloc(count, sizeof(bench_entry_t));
+	bench_entry_t *list = NULL;
+	unsigned int seed = 1;
+	uint64_t start, hashUs, listUs;
+	int i, missing = 0;
+
+	for (i = 0; i < count; i++) {
+		bench_get(cache, i, 0);
+		entries[i].name  = bench_names[i];
+		entries[i].image = &entries[i];
+		entries[i].next  = list;
+		if (list)
+			list->prev = &entries[i];
+		list = &entries[i];
+	}
+
+	start = bench_getTimeUs();
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+		missing += bench_get(cache, bench_pick(&seed, count), IMAGE_CACHE_LOOKUP) == NULL;
+	hashUs = bench_getTimeUs() - start;
+
+	seed = 1;
+	start = bench_getTimeUs();
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+		missing += bench_listFind(&list, bench_names[bench_pick(&seed, count)]) == NULL;
+	listUs = bench_getTimeUs() - start;
+
+	printf("lookup of %d images: hash %.3f us, list %.3f us%s\n", count,
+		(double)hashUs/BENCH_LOOKUPS, (double)listUs/BENCH_LOOKUPS,
+		missing ? " (some images missing!)" : "");
+	imageCache_destroy(cache);
+	free(entries);
+}
+
+static void bench_draw(int count, int async)
+{
+	imageCache_t *cache = bench_createCache((size_t)count*(BENCH_IMAGE_SIZE+1024));
+	imageCacheStats_t stats;
+	uint64_t drawUs = 0, drawUsMax = 0, readyUs = 0;
+	int screen, i;
+
+	for (screen = 0; screen < BENCH_SCREENS; screen++) {
+		int first = (screen*BENCH_SCREEN) % (count - BENCH_SCREEN + 1);
+		uint64_t start = bench_getTimeUs();
+		uint64_t us;
+
+		bench_ready = 0;
+		for (i = 0; i < BENCH_SCREEN; i++)
+			bench_get(cache, first+i, async ? IMAGE_CACHE_ASYNC : 0);
+		us = bench_getTimeUs() - start;
+		drawUs += us;
+		if (us > drawUsMax)
+			drawUsMax = us;
+
+		if (async) {
+			/* Menu is redrawn when all thumbnails are ready */
+			pthread_mutex_lock(&bench_readyMutex);
+			while (bench_ready < BENCH_SCREEN)
+				pthread_cond_wait(&bench_readyCond, &bench_readyMutex);
+			pthread_mutex_unlock(&bench_readyMutex);
+			for (i = 0; i < BENCH_SCREEN; i++)
+				bench_get(cache, first+i, IMAGE_CACHE_ASYNC);
+		}
+		readyUs += bench_getTimeUs() - start;
+		imageCache_collect(cache);
+	}
+
+	imageCache_getStats(cache, &stats);
+	printf("%-5s screen of %d: draw avg %.2f ms max %.2f ms, complete %.2f ms, decode avg %.2f ms, queue wait avg %.2f ms max %.2f ms\n",
+		async ? "async" : "sync", BENCH_SCREEN,
+		drawUs/1000.0/BENCH_SCREENS, drawUsMax/1000.0, readyUs/1000.0/BENCH_SCREENS,
+		stats.decoded ? stats.decodeUsTotal/1000.0/stats.decoded : 0.0,
+		async && stats.decoded ? stats.waitUsTotal/1000.0/stats.decoded : 0.0,
+		stats.waitUsMax/1000.0);
+	imageCache_destroy(cache);
+}
+
+static void bench_budget(int count)
+{
+	/* Budget for a quarter of images */
+	imageCache_t *cache = bench_createCache((size_t)count/4*(BENCH_IMAGE_SIZE+1024));
+	imageCacheStats_t stats;
+	unsigned int seed = 2;
+	int saved = bench_decodeUs;
+	int i;
+
+	bench_decodeUs = 0;
+	for (i = 0; i < 4*count; i++) {
+		bench_get(cache, bench_pick(&seed, count), 0);
+		if (i % BENCH_SCREEN == 0)
+			imageCache_collect(cache);
+	}
+	bench_decodeUs = saved;
+
+	imageCache_getStats(cache, &stats);
+	printf("budget for %d of %d images: hit rate %.1f%%, evicted %u, used %zu KiB max %zu KiB\n",
+		count/4, count, 100.0*stats.hits/(stats.hits+stats.misses),
+		stats.evicted, stats.used/1024, stats.usedMax/1024);
+	imageCache_destroy(cache);
+}
+
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 4000;
+	int i;
+
+	if (argc > 2)
+		bench_decodeUs = atoi(argv[2]);
+	if (count < BENCH_SCREEN) {
+		fprintf(stderr, "usage: %s [images >= %d] [decode us]\n", argv[0], BENCH_SCREEN);
+		return 1;
+	}
+
+	bench_names = malloc(count*sizeof(char*));
+	for (i = 0; i < count; i++) {
+		bench_names[i] = malloc(64);
+		snprintf(bench_names[i], 64, "/usb/Photos/2014/holiday/IMG_%04d.JPG", i);
+	}
+
+	bench_lookup(count);
+	bench_draw(count, 0);
+	bench_draw(count, 1);
+	bench_budget(count);
+
+	for (i = 0; i < count; i++)
+		free(bench_names[i]);
+	free(bench_names);
+	return 0;
+}
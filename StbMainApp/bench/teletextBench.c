@@ -0,0 +1,449 @@
+/*
+ teletextBench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file teletextBench.c Teletext decoding throughput and page-ready latency
+ * Builds transport stream of teletext service with eight magazines sent in
+ * parallel, packet by packet in turn, as real inserters do. Every fifth page
+ * rotates four subpages and all pages carry FastText links. Stream is fed to
+ * teletextDecoder one PES (one video frame) at a time to measure how long
+ * after its header each page is ready in stream time, then decoded content
+ * of every subpage is checked. At last stream is replayed from memory in
+ * chunks not aligned to TS packets to measure packets decoded per second.
+ *
+ * Usage: teletextBench [loops]
+ */
+
+#include "teletextDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PAGES_PER_MAGAZINE (12)
+#define BENCH_SUBPAGES           (4)
+/* Enough frames for each rotating page to send all of its subpages */
+#define BENCH_FRAMES             (400)
+#define BENCH_FRAME_MS           (40)
+/* Data units per PES, PES of 9 TS packets carries 35 of them */
+#define BENCH_UNITS_PER_FRAME    (35)
+#define BENCH_TS_PER_FRAME       (9)
+#define BENCH_PID                (0x100)
+#define BENCH_PACKET_SIZE        (42)
+#define BENCH_MAX_HEADERS        (64)
+#define BENCH_CHUNK              (1000)
+
+/* Character set designations sent in X/28 for magazine 2 and M/29 for magazine 4 */
+#define BENCH_PAGE_DESIGNATION     (0x24)
+#define BENCH_MAGAZINE_DESIGNATION (0x25)
+
+/* Hamming 8/4 codes of nibbles, first transmitted bit is LSB */
+static const uint8_t bench_hamm84[16] = {
+	0x15, 0x02, 0x49, 0x5e, 0x64, 0x73, 0x38, 0x2f, 0xd0, 0xc7, 0x8c, 0x9b, 0xa1, 0xb6, 0xfd, 0xea
+};
+
+static uint8_t  bench_ts[BENCH_FRAMES*BENCH_TS_PER_FRAME*188];
+static int      bench_headerFrames[1000][BENCH_MAX_HEADERS];
+static int      bench_headerCount[1000];
+static int      bench_readyCount[1000];
+static int      bench_frame;
+static unsigned bench_readyPages;
+static unsigned bench_latencyTotal;
+static unsigned bench_latencyMax;
+
+static double bench_getTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static uint8_t bench_reverse(uint8_t b)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		if (b & (1 << i))
+			r |= 0x80 >> i;
+	return r;
+}
+
+static uint8_t bench_hamm(int nibble)
+{
+	return bench_reverse(bench_hamm84[nibble & 0x0f]);
+}
+
+static uint8_t bench_char(uint8_t c)
+{
+	if (!__builtin_parity(c))
+		c |= 0x80;
+	return bench_reverse(c);
+}
+
+/* Hamming 24/18: data bits go to positions other than 1, 2, 4, 8, 16 and 24,
+ * which are set for odd parity of their groups, EN 300 706 8.3 */
+static void bench_hamm24(uint8_t *p, uint32_t value)
+{
+	uint32_t word = 0;
+	int pos, bit = 0, k;
+
+	for (pos = 1; pos <= 23; pos++)
+		if (pos & (pos - 1))
+			word |= ((value >> bit++) & 1) << (pos - 1);
+	for (k = 0; k < 5; k++) {
+		int ones = 0;
+		for (pos = 1; pos <= 23; pos++)
+			if ((pos & (1 << k)) && (word & (1 << (pos - 1))))
+				ones++;
+		if (!(ones & 1))
+			word |= 1 << ((1 << k) - 1);
+	}
+	if (!__builtin_parity(word))
+		word |= 1 << 23;
+	p[0] = bench_reverse(word & 0xff);
+	p[1] = bench_reverse((word >> 8) & 0xff);
+	p[2] = bench_reverse((word >> 16) & 0xff);
+}
+
+static int bench_isRotating(int page)
+{
+	return page % 5 == 0;
+}
+
+static void bench_rowText(char *text, int page, int subpage, int row)
+{
+	char buffer[TELETEXT_COLUMNS + 1];
+
+	snprintf(buffer, sizeof(buffer), "%cPage %03d subpage %02d row %02d text line",
+		0x01 + (row % 7), page, subpage, row);
+	memset(text, ' ', TELETEXT_COLUMNS);
+	memcpy(text, buffer, strlen(buffer));
+}
+
+static void bench_linkOf(int page, int link, teletextLink_t *out)
+{
+	/* Red, green and yellow lead to next pages, possibly in other magazine */
+	int next = page + (link < 3 ? link + 1 : 50 + link);
+
+	if (next > TELETEXT_LAST_PAGE)
+		next -= 800;
+	out->page    = next;
+	out->subpage = TELETEXT_ANY_SUBPAGE;
+}
+
+static int bench_designationOf(int page)
+{
+	if (page / 100 == 2)
+		return BENCH_PAGE_DESIGNATION;
+	if (page / 100 == 4)
+		return BENCH_MAGAZINE_DESIGNATION;
+	return -1;
+}
+
+static void bench_address(uint8_t *p, int magazine, int row)
+{
+	p[0] = bench_hamm((magazine & 7) | (row & 1) << 3);
+	p[1] = bench_hamm(row >> 1);
+}
+
+static void bench_pageNumber(uint8_t *p, int page)
+{
+	p[0] = bench_hamm(page % 10);
+	p[1] = bench_hamm(page / 10 % 10);
+}
+
+/* Packets of one transmission of page, returns their number */
+static int bench_makePage(uint8_t (*packets)[BENCH_PACKET_SIZE], int page, int subpage, int second)
+{
+	int magazine = page / 100;
+	int count = 0, row, i;
+	uint8_t *p;
+	char text[TELETEXT_COLUMNS + 1];
+
+	/* Header, erasing rotating pages */
+	p = packets[count++];
+	bench_address(p, magazine, 0);
+	bench_pageNumber(p + 2, page);
+	p[4] = bench_hamm(subpage & 0x0f);
+	p[5] = bench_hamm(((subpage >> 4) & 0x07) | (bench_isRotating(page) ? 0x08 : 0));
+	p[6] = bench_hamm((subpage >> 8) & 0x0f);
+	p[7] = bench_hamm((subpage >> 12) & 0x03);
+	p[8] = bench_hamm(0);
+	p[9] = bench_hamm(0);
+	snprintf(text, sizeof(text), "%-24s%02d:%02d:%02d", "  Bench TV  teletext",
+		second / 3600, second / 60 % 60, second % 60);
+	for (i = 8; i < TELETEXT_COLUMNS; i++)
+		p[2 + i] = bench_char(text[i - 8]);
+
+	/* FastText links */
+	p = packets[count++];
+	bench_address(p, magazine, 27);
+	p[2] = bench_hamm(0);
+	for (i = 0; i < TELETEXT_LINKS; i++) {
+		teletextLink_t link;
+		int relative;
+		uint8_t *l = p + 3 + 6*i;
+
+		bench_linkOf(page, i, &link);
+		relative = ((link.page / 100) ^ magazine) & 7;
+		bench_pageNumber(l, link.page);
+		l[2] = bench_hamm(link.subpage & 0x0f);
+		l[3] = bench_hamm(((link.subpage >> 4) & 0x07) | (relative & 1) << 3);
+		l[4] = bench_hamm((link.subpage >> 8) & 0x0f);
+		l[5] = bench_hamm(((link.subpage >> 12) & 0x03) | (relative >> 1) << 2);
+	}
+	p[39] = bench_hamm(0x08);
+	p[40] = bench_hamm(0);
+	p[41] = bench_hamm(0);
+
+	if (magazine == 2) {
+		p = packets[count++];
+		bench_address(p, magazine, 28);
+		p[2] = bench_hamm(0);
+		bench_hamm24(p + 3, BENCH_PAGE_DESIGNATION << 7);
+		for (i = 1; i < 13; i++)
+			bench_hamm24(p + 3 + 3*i, 0);
+	}
+
+	for (row = 1; row <= 24; row++) {
+		p = packets[count++];
+		bench_address(p, magazine, row);
+		bench_rowText(text, page, subpage, row);
+		for (i = 0; i < TELETEXT_COLUMNS; i++)
+			p[2 + i] = bench_char(text[i]);
+	}
+	return count;
+}
+
+/* Magazine stream of packets, page after page, one subpage per cycle */
+typedef struct {
+	int magazine;
+	int page;       /* Index in magazine */
+	int cycle;
+	int packet;
+	int count;
+	uint8_t packets[32][BENCH_PACKET_SIZE];
+} benchMagazine_t;
+
+static const uint8_t *bench_nextPacket(benchMagazine_t *m, int frame, int *header)
+{
+	if (m->packet == m->count) {
+		int page = m->magazine*100 + m->page;
+		int subpage = bench_isRotating(page) ? 1 + m->cycle % BENCH_SUBPAGES : 0;
+
+		m->count = 0;
+		if (m->page == 0 && m->magazine == 4) {
+			uint8_t *p = m->packets[m->count++];
+			int i;
+			bench_address(p, m->magazine, 29);
+			p[2] = bench_hamm(0);
+			bench_hamm24(p + 3, BENCH_MAGAZINE_DESIGNATION << 7);
+			for (i = 1; i < 13; i++)
+				bench_hamm24(p + 3 + 3*i, 0);
+		}
+		*header = page;
+		m->count += bench_makePage(&m->packets[m->count], page, subpage, frame*BENCH_FRAME_MS/1000);
+		m->packet = 0;
+		if (++m->page == BENCH_PAGES_PER_MAGAZINE) {
+			m->page = 0;
+			m->cycle++;
+		}
+	}
+	return m->packets[m->packet++];
+}
+
+/* Packs teletext packets into PES of one frame and TS packets */
+static void bench_makeStream(void)
+{
+	static benchMagazine_t magazines[8];
+	uint8_t pes[BENCH_TS_PER_FRAME*184];
+	int frame, unit, i, slot = 0, continuity = 0;
+
+	for (i = 0; i < 8; i++) {
+		memset(&magazines[i], 0, sizeof(magazines[i]));
+		magazines[i].magazine = i + 1;
+	}
+	for (frame = 0; frame < BENCH_FRAMES; frame++) {
+		uint8_t *p = pes;
+
+		memset(pes, 0xff, sizeof(pes));
+		p[0] = 0; p[1] = 0; p[2] = 1; p[3] = 0xbd;
+		p[4] = (sizeof(pes) - 6) >> 8;
+		p[5] = (sizeof(pes) - 6) & 0xff;
+		p[6] = 0x84; p[7] = 0x80; p[8] = 0x24;
+		p[45] = 0x10; /* EBU data */
+		p += 46;
+		for (unit = 0; unit < BENCH_UNITS_PER_FRAME; unit++, p += 46) {
+			int header = 0;
+			const uint8_t *packet = bench_nextPacket(&magazines[slot++ % 8], frame, &header);
+
+			if (header && bench_headerCount[header] < BENCH_MAX_HEADERS)
+				bench_headerFrames[header][bench_headerCount[header]++] = frame;
+			p[0] = 0x02;
+			p[1] = 44;
+			p[2] = 0xc0 | (7 + unit % 16);
+			p[3] = 0xe4;
+			memcpy(p + 4, packet, BENCH_PACKET_SIZE);
+		}
+		for (i = 0; i < BENCH_TS_PER_FRAME; i++) {
+			uint8_t *ts = &bench_ts[(frame*BENCH_TS_PER_FRAME + i)*188];
+
+			ts[0] = 0x47;
+			ts[1] = (i == 0 ? 0x40 : 0) | BENCH_PID >> 8;
+			ts[2] = BENCH_PID & 0xff;
+			ts[3] = 0x10 | continuity;
+			continuity = (continuity + 1) & 0x0f;
+			memcpy(ts + 4, pes + i*184, 184);
+		}
+	}
+}
+
+static void bench_ready(int page, int subpage, void *pArg)
+{
+	int latency;
+	(void)subpage;
+	(void)pArg;
+
+	if (page == 0 || pArg == NULL)
+		return;
+	/* Each transmission of page is stored once, right after its last row */
+	if (bench_readyCount[page] >= bench_headerCount[page])
+		return;
+	latency = (bench_frame - bench_headerFrames[page][bench_readyCount[page]++])*BENCH_FRAME_MS;
+	bench_readyPages++;
+	bench_latencyTotal += latency;
+	if ((unsigned)latency > bench_latencyMax)
+		bench_latencyMax = latency;
+}
+
+static int bench_check(teletextDecoder_t *decoder)
+{
+	int errors = 0, magazine, index, s, row, i;
+	char text[TELETEXT_COLUMNS];
+	teletextPage_t page;
+
+	for (magazine = 1; magazine <= 8; magazine++) {
+		for (index = 0; index < BENCH_PAGES_PER_MAGAZINE; index++) {
+			int number = magazine*100 + index;
+			int subpages = bench_isRotating(number) ? BENCH_SUBPAGES : 1;
+			uint16_t codes[TELETEXT_MAX_SUBPAGES];
+
+			if (teletextDecoder_getSubpages(decoder, number, codes, TELETEXT_MAX_SUBPAGES) != subpages) {
+				printf("page %d: wrong number of subpages\n", number);
+				errors++;
+				continue;
+			}
+			for (s = 0; s < subpages; s++) {
+				int code = subpages > 1 ? s + 1 : 0;
+
+				if (codes[s] != code || teletextDecoder_getPage(decoder, number, code, &page) != 0) {
+					printf("page %d/%d: missing\n", number, code);
+					errors++;
+					continue;
+				}
+				for (row = 1; row <= 24; row++) {
+					bench_rowText(text, number, code, row);
+					if (memcmp(text, page.text[row], TELETEXT_COLUMNS) != 0) {
+						printf("page %d/%d: row %d differs\n", number, code, row);
+						errors++;
+					}
+				}
+				if (memcmp(&page.text[0][8], "  Bench TV  teletext", 20) != 0 ||
+				    page.rows != (1 << TELETEXT_ROWS) - 1 ||
+				    page.designation != bench_designationOf(number) ||
+				    !page.hasLinks || !page.showLinks) {
+					printf("page %d/%d: wrong header, rows or designation\n", number, code);
+					errors++;
+				}
+				for (i = 0; i < TELETEXT_LINKS; i++) {
+					teletextLink_t link;
+					bench_linkOf(number, i, &link);
+					if (page.links[i].page != link.page || page.links[i].subpage != link.subpage) {
+						printf("page %d/%d: link %d is %d, expected %d\n",
+							number, code, i, page.links[i].page, link.page);
+						errors++;
+					}
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int loops = argc > 1 ? atoi(argv[1]) : 50;
+	size_t size = sizeof(bench_ts), pos;
+	teletextDecoderStats_t stats;
+	teletextDecoder_t *decoder;
+	double start, elapsed;
+	int frame, loop, errors;
+
+	if (loops <= 0) {
+		fprintf(stderr, "usage: %s [loops]\n", argv[0]);
+		return 1;
+	}
+	bench_makeStream();
+
+	/* Frame by frame, as stream comes from demux */
+	decoder = teletextDecoder_create(bench_ready, &bench_frame);
+	for (frame = 0; frame < BENCH_FRAMES; frame++) {
+		bench_frame = frame;
+		teletextDecoder_feedTs(decoder, &bench_ts[frame*BENCH_TS_PER_FRAME*188], BENCH_TS_PER_FRAME*188);
+	}
+	teletextDecoder_getStats(decoder, &stats);
+	errors = bench_check(decoder);
+	printf("%d frames, %u TS packets, %u teletext packets, %u errors in stream\n",
+		BENCH_FRAMES, stats.tsPackets, stats.packets, stats.tsErrors + stats.hammingErrors + stats.parityErrors);
+	printf("checked %d pages: %d errors\n", 8*BENCH_PAGES_PER_MAGAZINE, errors);
+	printf("page ready after header: %.1f ms average, %u ms max in stream time (%u pages), "
+		"%.1f packets average, %u max\n",
+		bench_readyPages ? (double)bench_latencyTotal/bench_readyPages : 0.0, bench_latencyMax, bench_readyPages,
+		stats.pagesReady ? (double)stats.latencyTotal/stats.pagesReady : 0.0, stats.latencyMax);
+	teletextDecoder_destroy(decoder);
+
+	/* Replay from memory in chunks split inside TS packets */
+	decoder = teletextDecoder_create(bench_ready, NULL);
+	start = bench_getTime();
+	for (loop = 0; loop < loops; loop++)
+		for (pos = 0; pos < size; pos += BENCH_CHUNK)
+			teletextDecoder_feedTs(decoder, &bench_ts[pos], size - pos < BENCH_CHUNK ? size - pos : BENCH_CHUNK);
+	elapsed = bench_getTime() - start;
+	teletextDecoder_getStats(decoder, &stats);
+	printf("replay: %u TS packets, %u teletext packets in %.3f s: %.0f TS packets/s, %.0f teletext packets/s, "
+		"%.0fx real time, %u errors\n",
+		stats.tsPackets, stats.packets, elapsed, stats.tsPackets/elapsed, stats.packets/elapsed,
+		loops*BENCH_FRAMES*BENCH_FRAME_MS/1000.0/elapsed, stats.tsErrors + stats.hammingErrors + stats.parityErrors);
+	errors += stats.tsErrors + stats.hammingErrors + stats.parityErrors;
+	teletextDecoder_destroy(decoder);
+	return errors != 0;
+}
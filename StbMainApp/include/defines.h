@@ -169,6 +169,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	/** @def ENABLE_STATS Enable DVB watch statistics
 	 */
 	//#define ENABLE_STATS
+
+	/** @def ENABLE_DVB_SIMULATOR Add simulated tuners playing recorded TS files from DVB_SIMULATOR_DIR
+	 */
+	//#define ENABLE_DVB_SIMULATOR
 #endif // ENABLE_DVB
 
 #ifdef  ENABLE_WEB_SERVICES
@@ -498,6 +502,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	#define CHANNEL_FILE_NAME   CONFIG_DIR "/channels.conf"
 #endif
 
+/** Default DVB EPG cache file, keeps EIT sections between reboots
+ */
+#ifndef EPG_CACHE_FILE_NAME
+	#define EPG_CACHE_FILE_NAME   CONFIG_DIR "/epg.cache"
+#endif
+
+/** Directory of cached IPTV EPG server responses
+ */
+#ifndef IPTV_EPG_CACHE_DIR
+	#define IPTV_EPG_CACHE_DIR    "/var/tmp/iptv_epg"
+#endif
+
+/** Directory with recorded transport streams named <frequency>.ts for simulated tuners
+ */
+#ifndef DVB_SIMULATOR_DIR
+	#define DVB_SIMULATOR_DIR   "/tmp/dvbsim"
+#endif
+
 #ifndef OFFAIR_SERVICES_FILENAME
 	#define OFFAIR_SERVICES_FILENAME         CONFIG_DIR "/offair.conf"
 #endif
@@ -405,6 +405,18 @@ int loadAppSettings()
 		{
 			//dprintf("%s: rtp pid timeout %ld\n", __FUNCTION__, appControlInfo.rtpMenuInfo.pidTimeout);
 		}
+		else if (sscanf(buf, "RTPJITTER=%u", &appControlInfo.rtpMenuInfo.jitterLatency) == 1)
+		{
+			//dprintf("%s: rtp jitter latency %u\n", __FUNCTION__, appControlInfo.rtpMenuInfo.jitterLatency);
+		}
+		else if (sscanf(buf, "RTPOUTBUFFER=%u", &appControlInfo.rtpMenuInfo.outputBuffer) == 1)
+		{
+			//dprintf("%s: rtp output buffer %u\n", __FUNCTION__, appControlInfo.rtpMenuInfo.outputBuffer);
+		}
+		else if (sscanf(buf, "RTPEPGPARALLEL=%d", &appControlInfo.rtpMenuInfo.epgParallel) == 1)
+		{
+			//dprintf("%s: rtp EPG parallel requests %d\n", __FUNCTION__, appControlInfo.rtpMenuInfo.epgParallel);
+		}
 #ifdef ENABLE_PVR
 		else if (sscanf(buf, "PVRDIRECTORY=%[^\r\n]", appControlInfo.pvrInfo.directory) == 1)
 		{
@@ -851,6 +863,9 @@ int saveAppSettings()
 #endif
 	fprintf(fd, "RTPEPG=%s\n",                    appControlInfo.rtpMenuInfo.epg);
 	fprintf(fd, "RTPPIDTIMEOUT=%ld\n",            appControlInfo.rtpMenuInfo.pidTimeout);
+	fprintf(fd, "RTPJITTER=%u\n",                 appControlInfo.rtpMenuInfo.jitterLatency);
+	fprintf(fd, "RTPOUTBUFFER=%u\n",              appControlInfo.rtpMenuInfo.outputBuffer);
+	fprintf(fd, "RTPEPGPARALLEL=%d\n",            appControlInfo.rtpMenuInfo.epgParallel);
 	fprintf(fd, "LANGUAGE=%s\n",                  l10n_currentLanguage);
 	fprintf(fd, "MEDIA_FILTER=%s\n",              appControlInfo.mediaInfo.typeIndex < 0 ?
 	                                                "showall" : mediaTypeNames[appControlInfo.mediaInfo.typeIndex] );
@@ -1092,6 +1107,9 @@ void appInfo_init(void)
 	strcpy(appControlInfo.rtpMenuInfo.lastUrl,      "rtp://");
 	appControlInfo.rtpMenuInfo.playlist[0]        = 0;
 	appControlInfo.rtpMenuInfo.pidTimeout         = 3;
+	appControlInfo.rtpMenuInfo.jitterLatency      = 0;
+	appControlInfo.rtpMenuInfo.outputBuffer       = 0;
+	appControlInfo.rtpMenuInfo.epgParallel        = 4;
 	appControlInfo.rtpMenuInfo.hasInternalPlaylist=helperFileExists(IPTV_FW_PLAYLIST_FILENAME);
 	if (appControlInfo.rtpMenuInfo.hasInternalPlaylist)
 		appControlInfo.rtpMenuInfo.usePlaylistURL = iptvPlaylistFw;
@@ -294,7 +294,10 @@ typedef struct __stb810_rtpMenuInfo
 	char                 lastUrl[MAX_URL];
 	char                 playlist[MAX_URL];
 	char                 epg[MAX_URL];
+	int                  epgParallel; // simultaneous EPG requests
 	time_t               pidTimeout;
+	unsigned int         jitterLatency; // ms, default for channels without own setting, ccRTP engine only
+	unsigned int         outputBuffer;  // ms of output ring at 20 Mbit/s, 0 for default
 #ifdef ENABLE_TELETES
 	char                 teletesPlaylist[MAX_URL];
 #endif
@@ -282,6 +282,7 @@ static int bouquet_find_or_AddChannels(const bouquet_element_list_t *element)
         el->common.transport_stream_id = element->data.transport_stream_id;
         el->original_network_id = element->data.network_id;
         strncpy((char *)el->service_descriptor.service_name, element->lamedbData.channelsName, strlen(element->lamedbData.channelsName));
+        dvb_invalidateSrvices();
 
         service_index_data_t data;
         memset(&data, 0, sizeof(data));
@@ -35,12 +35,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+/* Define CRC32_BYTEWISE to build the plain one table implementation */
+#ifndef CRC32_BYTEWISE
+#define CRC32_SLICE_BY_8
+#endif
 
 /******************************************************************
 * STATIC DATA                                                     *
 *******************************************************************/
 
-static uint32_t crc_table[256] = {
+static const uint32_t crc_table[256] = {
 	0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b,
     0x1a864db2, 0x1e475005, 0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61,
     0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd, 0x4c11db70, 0x48d0c6c7,
@@ -86,10 +96,66 @@ static uint32_t crc_table[256] = {
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+#ifdef CRC32_SLICE_BY_8
+/* crc_slice[k][i] is CRC of byte i followed by k zero bytes, crc_slice[0] equals crc_table */
+static uint32_t crc_slice[8][256];
+static pthread_once_t crc_slice_once = PTHREAD_ONCE_INIT;
+#endif
+
 /******************************************************************
 * FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
 *******************************************************************/
 
+#ifdef CRC32_SLICE_BY_8
+static void crc32_initSlices(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++)
+	{
+		crc_slice[0][i] = crc_table[i];
+	}
+	for (k = 1; k < 8; k++)
+	{
+		for (i = 0; i < 256; i++)
+		{
+			uint32_t prev = crc_slice[k-1][i];
+			crc_slice[k][i] = (prev << 8) ^ crc_table[prev >> 24];
+		}
+	}
+}
+
+/* Processes 8 bytes per iteration using 8 lookups into independent tables.
+ * Input is read byte by byte, so it works for any alignment and endianness. */
+uint32_t dvb_crc32(const uint8_t *pData, int length)
+{
+	uint32_t crc = 0xffffffff;
+
+	pthread_once(&crc_slice_once, crc32_initSlices);
+
+	while (length >= 8)
+	{
+		crc ^= ((uint32_t)pData[0] << 24) | ((uint32_t)pData[1] << 16) |
+		       ((uint32_t)pData[2] << 8)  |  (uint32_t)pData[3];
+		crc = crc_slice[7][ crc >> 24        ] ^
+		      crc_slice[6][(crc >> 16) & 0xff] ^
+		      crc_slice[5][(crc >> 8)  & 0xff] ^
+		      crc_slice[4][ crc        & 0xff] ^
+		      crc_slice[3][pData[4]] ^
+		      crc_slice[2][pData[5]] ^
+		      crc_slice[1][pData[6]] ^
+		      crc_slice[0][pData[7]];
+		pData  += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+	{
+		crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *pData++) & 0xff];
+	}
+
+	return crc;
+}
+#else
 uint32_t dvb_crc32(const uint8_t *pData, int length)
 {
     int i;
@@ -102,3 +168,4 @@ uint32_t dvb_crc32(const uint8_t *pData, int length)
 
     return crc;
 }
+#endif
@@ -41,6 +41,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "l10n.h"
 #include "media.h"
 #include "rtsp.h"
+#ifdef ENABLE_PVR
+#include "pvrReader.h"
+#endif
 
 #if defined(WIN32)
 	#ifndef MICROSTACK_NO_STDAFX
@@ -77,6 +80,7 @@ extern struct FB_FilteringBrowserManager	*FB_TheManager;
 #include "DLNAProtocolInfo.h"
 #include "DMR.h"
 #include "FilteringBrowser.h"
+#include "DlnaHttpServer.h"
 
 #if defined(WIN32)
 	#include <crtdbg.h>
@@ -131,6 +135,9 @@ static const char* ProtocolInfoList[] = {
 };
 #endif
 
+/* Worker threads streaming local files and recordings to renderers */
+#define DLNA_POOL_THREADS (3)
+
 static void *MicroStackChain;
 static void *ILib_Pool;
 static void *DMP_Browser = NULL;
@@ -150,6 +157,26 @@ static char parentObjectID[256] = "";
 
 static void *childContexts = NULL;
 
+#ifdef ENABLE_PVR
+static void* dlna_recordOpen(const char *file_name);
+static long long dlna_recordLength(void *source);
+static int   dlna_recordSeek(void *source, long long offset);
+static int   dlna_recordRead(void *source, char *buffer, int size);
+static void  dlna_recordClose(void *source);
+static int   dlna_recordGetFile(void *source, long long position, long long *offset, long *length);
+
+/* Serves recording directories as a single stream */
+static const struct DHS_FileReader dlna_recordReader =
+{
+	dlna_recordOpen,
+	dlna_recordLength,
+	dlna_recordSeek,
+	dlna_recordRead,
+	dlna_recordClose,
+	dlna_recordGetFile
+};
+#endif
+
 /************************************************
 * EXPORTED DATA                                 *
 *************************************************/
@@ -212,6 +239,50 @@ static int dlna_stream_change(interfaceMenu_t *pMenu, void* pArg)
 	return 1;
 }
 
+#ifdef ENABLE_PVR
+static void* dlna_recordOpen(const char *file_name)
+{
+	/* Body is sent from part files with sendfile(), so kernel readahead is enough */
+	pvrReaderConfig_t config = { 0, 0 };
+
+	return pvrReader_open(file_name, &config);
+}
+
+static long long dlna_recordLength(void *source)
+{
+	return (long long)pvrReader_size((pvrReader_t *)source);
+}
+
+static int dlna_recordSeek(void *source, long long offset)
+{
+	return pvrReader_seek((pvrReader_t *)source, offset, SEEK_SET) < 0 ? -1 : 0;
+}
+
+static int dlna_recordRead(void *source, char *buffer, int size)
+{
+	return (int)pvrReader_read((pvrReader_t *)source, buffer, size);
+}
+
+static void dlna_recordClose(void *source)
+{
+	pvrReader_close((pvrReader_t *)source);
+}
+
+static int dlna_recordGetFile(void *source, long long position, long long *offset, long *length)
+{
+	off_t fileOffset, size;
+	int fd;
+
+	fd = pvrReader_getFile((pvrReader_t *)source, position, &fileOffset, &size);
+	if (fd >= 0) {
+		*offset = (long long)fileOffset;
+		if (*length > size)
+			*length = (long)size;
+	}
+	return fd;
+}
+#endif
+
 static void dlna_IPAddressMonitor(void *data)
 {
 	int length;
@@ -242,6 +313,11 @@ static void dlna_onQuit(void *data)
 
 	if(ILib_Pool!=NULL)
 	{
+		struct ILibThreadPool_Stats stats;
+
+		ILibThreadPool_GetStats(ILib_Pool, &stats);
+		dprintf("DLNA: Thread Pool: %lu queued (%lu overflows), max wait %ld us\n",
+			stats.Queued, stats.Overflows, stats.MaxWait);
 		dprintf("DLNA: Stopping Thread Pool...\r\n");
 		ILibThreadPool_Destroy(ILib_Pool);
 		dprintf("DLNA: Thread Pool Destroyed...\r\n");
@@ -256,12 +332,6 @@ static void dlna_onQuit(void *data)
 	mysem_release(dlna_semaphore);
 }
 
-static void* dlna_poolThread(void *args)
-{
-	ILibThreadPool_AddThread(ILib_Pool);
-	return(0);
-}
-
 static int DMP_OnFB_ExamineObject(FB_Object fb, struct CdsObject *cds_obj)
 {
 	dprintf("DLNA: Examine object %08X = %s\n", cds_obj, cds_obj->Title);
@@ -468,9 +538,6 @@ static void dlna_createBrowser(void)
 
 int dlna_start(void) 
 {
-	int x;
-	pthread_t t;
-
 	if (dlnaWorkerHandle == 0)
 	{
 	MicroStackChain = ILibCreateChain();
@@ -484,13 +551,14 @@ int dlna_start(void)
 	eprintf("DLNA: Starting DLNA Stack\n");
 	
 	ILib_Pool = ILibThreadPool_Create();
-	for(x=0;x<3;++x)
-	{
-		
-		pthread_create(&t,NULL,&dlna_poolThread,NULL);
-	}
+	if (ILibThreadPool_StartThreads(ILib_Pool, DLNA_POOL_THREADS) != DLNA_POOL_THREADS)
+		eprintf("DLNA: Failed to start all pool threads\n");
 
 	FB_Init();
+
+#ifdef ENABLE_PVR
+	DHS_SetFileReader(&dlna_recordReader);
+#endif
 	
 #ifdef ENABLE_DLNA_DMR
 	eprintf("DLNA: Create DMR\n");
@@ -46,6 +46,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "off_air.h"
 #include "stsdk.h"
 #include "helper.h"
+#include "dvbSimulator.h"
 
 /******************************************************************
 * LOCAL MACROS                                                    *
@@ -111,6 +112,7 @@ typedef enum {
 	eTunerDriver_linuxDVBapi,
 	eTunerDriver_STAPISDK,
 	eTunerDriver_streamerInput,
+	eTunerDriver_simulated,
 } stb_adapterDriverType_e;
 
 /* DVB adapter information */
@@ -204,6 +206,14 @@ int32_t dvbfe_isLinuxAdapter(uint32_t adapter)
 	return 0;
 }
 
+int32_t dvbfe_isSimulatedAdapter(uint32_t adapter)
+{
+	if((adapter < MAX_ADAPTER_SUPPORTED) && (g_adapterInfo[adapter].driverType == eTunerDriver_simulated)) {
+		return 1;
+	}
+	return 0;
+}
+
 /**  @ingroup dvb
  *   @brief Returns the fe_type of the FrontEnd device
  *
@@ -675,6 +685,29 @@ static int32_t dvbfe_scanSTAPISDKTuners()
 	return 0;
 }
 
+static int32_t dvbfe_scanSimulatedTuners(void)
+{
+#if (defined ENABLE_DVB_SIMULATOR)
+	uint32_t adapter;
+
+	if(!dvbSimulator_isAvailable()) {
+		return -1;
+	}
+	for(adapter = 0; adapter < MAX_ADAPTER_SUPPORTED; adapter++) {
+		if(dvbfe_hasTuner(adapter)) {//adapter busy
+			continue;
+		}
+		g_adapterInfo[adapter].supportedDelSys[0] = SYS_DVBT;
+		g_adapterInfo[adapter].supportedDelSys[1] = SYS_DVBC_ANNEX_AC;
+		g_adapterInfo[adapter].supportedDelSysCount = 2;
+		g_adapterInfo[adapter].state.curDelSys = SYS_DVBT;
+		g_adapterInfo[adapter].driverType = eTunerDriver_simulated;
+		eprintf("%s(): Adapter=%d simulated tuner, streams from %s\n", __func__, adapter, DVB_SIMULATOR_DIR);
+	}
+#endif //#if (defined ENABLE_DVB_SIMULATOR)
+	return 0;
+}
+
 static uint32_t dvbfe_getBandwidthHz(fe_bandwidth_t bw)
 {
 	table_IntInt_t bands[] = {
@@ -936,6 +969,11 @@ int32_t dvbfe_setParam(uint32_t adapter, int32_t wait_for_lock,
         case eTunerDriver_STAPISDK:
             ret = dvbfe_setParamSTAPISDK(adapter, delSys, frequency, media);
             break;
+#if (defined ENABLE_DVB_SIMULATOR)
+        case eTunerDriver_simulated:
+            ret = dvbSimulator_tune(adapter, frequency);
+            break;
+#endif
         default:
             break;
     }
@@ -1037,7 +1075,10 @@ int32_t dvbfe_checkFrequency(fe_delivery_system_t type, uint32_t frequency, uint
 		media = &local_media;
 	}
 
-	if((res = dvbfe_setParam(adapter, 1, media, pFunction)) == 0) {
+	if(((res = dvbfe_setParam(adapter, 1, media, pFunction)) == 0) && dvbfe_isSimulatedAdapter(adapter)) {
+		*ber = 0;
+		return 1;
+	} else if(res == 0) {
 		int32_t i;
 		for(i = 0; i < 10; i++) {
 			fe_status_t s;
@@ -1237,6 +1278,18 @@ int32_t dvbfe_getSignalInfo(uint32_t adapter, tunerState_t *state)
 #endif //#if (defined STSDK)
 			break;
 		}
+		case eTunerDriver_simulated:
+#if (defined ENABLE_DVB_SIMULATOR)
+			ret = dvbSimulator_hasLock(adapter);
+			if(state) {
+				state->fe_status = ret ? (FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK) : 0;
+				state->signal_strength = ret ? 0xffff : 0;
+				state->snr = ret ? 0xffff : 0;
+				state->ber = 0;
+				state->uncorrected_blocks = 0;
+			}
+#endif
+			break;
 		case eTunerDriver_streamerInput:
 		default:
 			break;
@@ -1385,6 +1438,7 @@ int32_t dvbfe_init(void)
 		dvbfe_scanLinuxDVBTuner(i);
 	}
 	dvbfe_scanSTAPISDKTuners();
+	dvbfe_scanSimulatedTuners();
 
 	return 0;
 }
@@ -149,6 +149,7 @@ const char *dvbfe_getTunerTypeName(uint32_t adapter);
 fe_delivery_system_t dvbfe_getType(uint32_t adapter);
 
 int32_t dvbfe_isLinuxAdapter(uint32_t adapter);
+int32_t dvbfe_isSimulatedAdapter(uint32_t adapter);
 
 static inline uint32_t dvbfe_frequencyKHz(uint32_t adapter, uint32_t frequency)
 {
@@ -48,6 +48,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "helper.h"
 #include "dvb-fe.h"
 #include "bouquet.h"
+#include "crc32.h"
+#include "epgStore.h"
+#include "epgCache.h"
+#include "dvbSimulator.h"
+#include "dvbScanQueue.h"
+#include "pvrReader.h"
 //#include "elcd-rpc.h"
 
 #include <fcntl.h>
@@ -66,6 +72,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pthread.h>
 
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include <linux/dvb/dmx.h>
 
@@ -89,6 +96,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_OFFSETS   (1)
 
 #define MAX_RUNNING   (32)
+/* Enough for several max-sized (4096 bytes) private sections per read */
+#define SECTION_BUFFER_SIZE (2*4096)
+/* Upper limit for a single epoll_wait, so waiting filters get a chance to start */
+#define FILTER_POLL_INTERVAL_MS (1000)
+/* How often parallel scan reports progress and checks for user abort */
+#define SCAN_PROGRESS_INTERVAL_US (200000)
 
 #define FILE_PERMS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
 
@@ -130,6 +143,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 } while (0)
 #endif
 
+/* Buckets of service index hashes, must be power of 2 */
+#define SERVICES_HASH_SIZE (1024)
+
 #define ZERO_SCAN_MESAGE()	//scan_messages[0] = 0
 #define SCAN_MESSAGE(...)	//sprintf(&scan_messages[strlen(scan_messages)], __VA_ARGS__)
 
@@ -178,6 +194,7 @@ struct dvb_instance {
 		int rate;
 		pthread_t thread;
 		pthread_t rate_thread;
+		pvrReader_t *reader;
 	} pvr;
 #endif
 #ifdef ENABLE_MULTI_VIEW
@@ -192,6 +209,32 @@ struct dvb_instance {
 };
 
 
+/* Read-only snapshot of l_dvb_services built on demand.
+ * Readers access it without dvb_semaphore, snapshots replaced by a newer one
+ * are freed only when no reader is active. */
+typedef struct dvb_servicesIndex {
+	int32_t count;
+	int32_t generation; // value of l_servicesIndexGeneration snapshot was built from
+	int32_t idBucket[SERVICES_HASH_SIZE];   // by original_network_id/transport_stream_id/service_id
+	int32_t ptrBucket[SERVICES_HASH_SIZE];  // by service pointer
+	struct dvb_servicesIndex *retired;
+	struct {
+		EIT_service_t *service;
+		uint16_t original_network_id;
+		uint16_t transport_stream_id;
+		uint16_t service_id;
+		int32_t  idNext;
+		int32_t  ptrNext;
+	} entry[];
+} dvb_servicesIndex_t;
+
+typedef struct {
+	dvbScanQueue_t  *queue;
+	uint32_t         adapter;
+	pthread_t        thread;
+	list_element_t  *services;  // found by this adapter, merged to channel list at the end
+} dvb_scanWorker_t;
+
 struct section_buf {
     struct list_head list;
     uint32_t adapter;
@@ -202,7 +245,8 @@ struct section_buf {
     int32_t  section_version_number;
     uint8_t  section_done[32];
     int32_t  sectionfilter_done;
-    uint8_t  buf[BUFFER_SIZE];
+    uint8_t  buf[SECTION_BUFFER_SIZE];
+    uint32_t bufFill;
     time_t   timeout;
     time_t   start_time;
     time_t   running_time;
@@ -216,7 +260,12 @@ struct section_buf {
     // segmented tables (like NIT-other)
     struct section_buf *next_seg;
 
-    struct pollfd	*poll_fd;
+    int32_t  slot;          // index in l_filterSlots while running, -1 otherwise
+    int32_t  timerIndex;    // position in l_filterTimers heap
+    uint64_t startMs;
+    uint64_t deadlineMs;
+    uint32_t sections;
+    uint32_t bytes;
 #if (defined STSDK)
     int32_t  pipeId;
 #endif
@@ -228,11 +277,28 @@ struct section_buf {
 *******************************************************************/
 static list_element_t *l_dvb_services = NULL;
 
+static dvb_servicesIndex_t *volatile l_servicesIndex = NULL;
+static volatile int32_t l_servicesIndexGeneration = 0; // bumped atomically on every change of services list
+static volatile int32_t l_servicesIndexReaders = 0;
+static dvb_servicesIndex_t *l_servicesIndexRetired = NULL; // protected by dvb_semaphore
+
 static LIST_HEAD(running_filters);
 static LIST_HEAD(waiting_filters);
 static int n_running = 0;
 static int l_filtersEnabled = 0;
 
+/* Running filters are registered in epoll with slot index and generation,
+ * timeouts are kept in min-heap by deadline.
+ * Both are protected by dvb_filter_running_list_semaphore */
+static int32_t l_filtersEpoll = -1;
+static struct section_buf *l_filterSlots[MAX_RUNNING];
+static uint32_t l_filterSlotGeneration[MAX_RUNNING];
+static struct section_buf *l_filterTimers[MAX_RUNNING];
+static int32_t l_filterTimersCount = 0;
+static uint32_t l_filterTimeouts = 0;
+
+static dvbScanQueue_t *volatile l_scanQueue = NULL;
+
 static struct dvb_instance dvbInstances[MAX_ADAPTER_SUPPORTED];
 
 static pmysem_t dvb_semaphore;
@@ -251,6 +317,8 @@ static int32_t g_dvb_pipe[16];
 * STATIC FUNCTION PROTOTYPES                  <Module>_<Word>+    *
 *******************************************************************/
 static list_element_t **dvb_getSrvicesPP(void);
+static void dvb_servicesIndexInvalidate(int32_t released);
+static EIT_service_t *dvb_findServiceNB(list_element_t *head, uint16_t original_network_id, uint16_t transport_stream_id, uint16_t service_id);
 
 static int dvb_hasPayloadTypeNB(EIT_service_t *service, payload_type p_type);
 static int dvb_hasMediaTypeNB(EIT_service_t *service, media_type m_type);
@@ -278,47 +346,140 @@ static inline void dvb_filtersDisable(void)
 //    mysem_release(dvb_filter_semaphore);
 }
 
-static int32_t dvb_getPollFds(struct pollfd **fds, nfds_t *count)
+static uint64_t dvb_filterNowMs(void)
 {
-    struct list_head *pos;
-    struct section_buf* s;
-    int32_t i;
-    int32_t ret = 0;
-    static struct pollfd poll_fds[MAX_RUNNING];
+	struct timespec ts;
 
-//     for(i = 0; i < MAX_RUNNING; i++) {
-//         poll_fds[i].fd = -1;
-//     }
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    i = 0;
-    mysem_get(dvb_filter_running_list_semaphore);
-    list_for_each(pos, &running_filters) {
-        if(i >= MAX_RUNNING) {
-            eprintf("%s: too many poll_fds: i=%d\n", __FUNCTION__, i);
-            i++;
-            continue;
-        }
-        s = list_entry(pos, struct section_buf, list);
-        if(s->fd == -1) {
-            eprintf("%s: s->fd == -1 on running_filters\n", __FUNCTION__);
-        }
-        poll_fds[i].fd = s->fd;
-        poll_fds[i].events = POLLIN;
-        poll_fds[i].revents = 0;
-        s->poll_fd = poll_fds + i;
-        i++;
-    }
-    mysem_release(dvb_filter_running_list_semaphore);
+static void dvb_filterTimerSwap(int32_t a, int32_t b)
+{
+	struct section_buf *tmp = l_filterTimers[a];
 
-    if(i != n_running) {
-        eprintf("%s: n_running is hosed: i=%d, n_running=%d\n", __FUNCTION__, i, n_running);
-        n_running = i;
-        ret = -1;
-    }
-    *fds = poll_fds;
-    *count = n_running;
+	l_filterTimers[a] = l_filterTimers[b];
+	l_filterTimers[b] = tmp;
+	l_filterTimers[a]->timerIndex = a;
+	l_filterTimers[b]->timerIndex = b;
+}
 
-    return ret;
+static void dvb_filterTimerSift(int32_t i)
+{
+	while(i > 0 && l_filterTimers[(i - 1) / 2]->deadlineMs > l_filterTimers[i]->deadlineMs) {
+		dvb_filterTimerSwap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	for(;;) {
+		int32_t smallest = i;
+		int32_t child = 2 * i + 1;
+
+		if(child < l_filterTimersCount && l_filterTimers[child]->deadlineMs < l_filterTimers[smallest]->deadlineMs) {
+			smallest = child;
+		}
+		child++;
+		if(child < l_filterTimersCount && l_filterTimers[child]->deadlineMs < l_filterTimers[smallest]->deadlineMs) {
+			smallest = child;
+		}
+		if(smallest == i) {
+			break;
+		}
+		dvb_filterTimerSwap(i, smallest);
+		i = smallest;
+	}
+}
+
+/* Filter timeout may be prolonged by parser, so deadline is refreshed after each read */
+static void dvb_filterTimerUpdate(struct section_buf *s)
+{
+	uint64_t deadlineMs = s->startMs + (uint64_t)s->timeout * 1000;
+
+	if(s->timerIndex >= 0 && deadlineMs != s->deadlineMs) {
+		s->deadlineMs = deadlineMs;
+		dvb_filterTimerSift(s->timerIndex);
+	}
+}
+
+static int32_t dvb_filterRegister(struct section_buf *s)
+{
+	struct epoll_event event;
+	int32_t slot;
+
+	for(slot = 0; slot < MAX_RUNNING; slot++) {
+		if(l_filterSlots[slot] == NULL) {
+			break;
+		}
+	}
+	if(slot >= MAX_RUNNING) {
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = (++l_filterSlotGeneration[slot] << 8) | slot;
+	if(epoll_ctl(l_filtersEpoll, EPOLL_CTL_ADD, s->fd, &event) != 0) {
+		PERROR("%s: epoll_ctl failed for pid 0x%04x", __FUNCTION__, s->pid);
+		return -1;
+	}
+	l_filterSlots[slot] = s;
+	s->slot = slot;
+
+	s->deadlineMs = s->startMs + (uint64_t)s->timeout * 1000;
+	s->timerIndex = l_filterTimersCount++;
+	l_filterTimers[s->timerIndex] = s;
+	dvb_filterTimerSift(s->timerIndex);
+
+	return 0;
+}
+
+static void dvb_filterUnregister(struct section_buf *s)
+{
+	int32_t i = s->timerIndex;
+
+	if(s->slot < 0) {
+		return;
+	}
+	epoll_ctl(l_filtersEpoll, EPOLL_CTL_DEL, s->fd, NULL);
+	l_filterSlots[s->slot] = NULL;
+	s->slot = -1;
+
+	l_filterTimersCount--;
+	if(i != l_filterTimersCount) {
+		dvb_filterTimerSwap(i, l_filterTimersCount);
+		dvb_filterTimerSift(i);
+	}
+	s->timerIndex = -1;
+}
+
+/* Returns filter by epoll event data, NULL if it was stopped since epoll_wait */
+static struct section_buf *dvb_filterFromEvent(uint32_t data)
+{
+	uint32_t slot = data & 0xff;
+
+	if(slot >= MAX_RUNNING || (l_filterSlotGeneration[slot] & 0xffffff) != (data >> 8)) {
+		return NULL;
+	}
+	return l_filterSlots[slot];
+}
+
+static int32_t dvb_filterWaitTimeout(void)
+{
+	int32_t timeout = FILTER_POLL_INTERVAL_MS;
+
+	mysem_get(dvb_filter_running_list_semaphore);
+	if(l_filterTimersCount > 0) {
+		uint64_t now = dvb_filterNowMs();
+		uint64_t deadlineMs = l_filterTimers[0]->deadlineMs;
+
+		if(deadlineMs <= now) {
+			timeout = 0;
+		} else if(deadlineMs - now < FILTER_POLL_INTERVAL_MS) {
+			timeout = deadlineMs - now;
+		}
+	}
+	mysem_release(dvb_filter_running_list_semaphore);
+
+	return timeout;
 }
 
 #if (defined LINUX_DVB_API_DEMUX)
@@ -516,6 +677,12 @@ static int dvb_filterStart(struct section_buf* s)
 	}
 
 	debug("%s: start filter 0x%02x\n", __FUNCTION__, s->pid);
+#if (defined ENABLE_DVB_SIMULATOR)
+	if(dvbfe_isSimulatedAdapter(s->adapter)) {
+		s->fd = dvbSimulator_sectionOpen(s->adapter, s->pid, s->table_id);
+		ret = (s->fd < 0) ? -1 : 0;
+	} else
+#endif
 	ret = dvb_filterStart_arch(s);
 	if(ret != 0) {
 //		eprintf("%s(): Cant start collecting section with pid=0x%04x, table_id=0x%02x\n", __func__, (uint16_t)s->pid, (uint8_t)s->table_id);
@@ -524,7 +691,8 @@ static int dvb_filterStart(struct section_buf* s)
 
 	s->sectionfilter_done = 0;
 	time(&s->start_time);
-	s->poll_fd = NULL;
+	s->startMs = dvb_filterNowMs();
+	s->bufFill = 0;
 
 	n_running++;
 
@@ -539,6 +707,14 @@ static int32_t dvb_filterStop(struct section_buf *s)
 	if(s->start_time == 0) {
 		return -1;
 	}
+	dvb_filterUnregister(s);
+#if (defined ENABLE_DVB_SIMULATOR)
+	if(dvbfe_isSimulatedAdapter(s->adapter)) {
+		dvbSimulator_sectionClose(s->fd);
+		s->fd = -1;
+		ret = 0;
+	} else
+#endif
 	ret = dvb_filterStop_arch(s);
 	(void)ret;
 
@@ -570,6 +746,11 @@ static void dvb_filterAdd(struct section_buf *s)
     }
     ret = dvb_filterStart(s);
     mysem_get(dvb_filter_running_list_semaphore);
+    if(ret == 0 && dvb_filterRegister(s) != 0) {
+        dvb_filterStop(s);
+        s->start_time = 0;
+        ret = -1;
+    }
     if(ret == 0) {
         list_add_tail(&s->list, &running_filters);
     } else {
@@ -598,6 +779,11 @@ static int32_t dvb_filterPushWaiters(void)
         //dvb_filterAdd(s);
         ret = dvb_filterStart(s);
         mysem_get(dvb_filter_running_list_semaphore);
+        if(ret == 0 && dvb_filterRegister(s) != 0) {
+            dvb_filterStop(s);
+            s->start_time = 0;
+            ret = -1;
+        }
         if(ret == 0) {
             list_del(pos);//remove from waiting_filters
             list_add_tail(&s->list, &running_filters);
@@ -629,6 +815,8 @@ static void dvb_filterSetup(struct section_buf* s, uint32_t adapter,
 	s->transport_stream_id = -1;
 	s->service_list = outServices;
 	s->media = outMedia;
+	s->slot = -1;
+	s->timerIndex = -1;
 
 	INIT_LIST_HEAD (&s->list);
 }
@@ -865,7 +1053,7 @@ static char checkSectionCrc(const uint8_t *section_bytes)
 	section_length = ((uint32_t)(section_bytes[1] & 0x0F) << 8) +
 					 (uint32_t)(section_bytes[2]);
 	crc_read_index = section_length + 3 - 4;
-	crc32val       = getCrcValue(section_bytes, crc_read_index);
+	crc32val       = dvb_crc32(section_bytes, crc_read_index);
 	crc_32         = ((uint32_t)(section_bytes[crc_read_index  ]) << 24) +
 					 ((uint32_t)(section_bytes[crc_read_index + 1]) << 16) +
 					 ((uint32_t)(section_bytes[crc_read_index + 2]) << 8) +
@@ -1159,7 +1347,9 @@ static int dvb_sectionParse(struct section_buf *s)
 	uint32_t network_id;
 	int32_t frequency = 0;
     int32_t needUnlockServices = 0;
+	epgCacheBuffer_t epgRecord;
 
+	epgRecord.length = 0;
 	if(s->media == NULL) {
 		eprintf("%s(): Error, media not defined!\n", __func__);
 		return -1;
@@ -1311,6 +1501,15 @@ static int dvb_sectionParse(struct section_buf *s)
 				updated = parse_eit(services, (unsigned char *)s->buf, network_id, s->media);
 				if(updated) {
 					s->timeout = 5;
+					if(services == dvb_getSrvicesPP()) {
+						epgStore_update(dvb_findServiceNB(*services,
+						                                  (s->buf[10] << 8) | s->buf[11],
+						                                  (s->buf[8] << 8) | s->buf[9],
+						                                  table_id_ext),
+						                s->buf);
+						// Appended after unlocking services, not to block them on flash I/O
+						epgCache_prepare(&epgRecord, (uint8_t *)s->buf, network_id, s->media);
+					}
 				}
 				can_count_sections = 0;
 				break;
@@ -1342,9 +1541,13 @@ static int dvb_sectionParse(struct section_buf *s)
 		}
 	}
 
+    if(services == dvb_getSrvicesPP()) {
+        dvb_servicesIndexInvalidate(0);
+    }
     if(needUnlockServices) {
         dvb_unlockSrvices();
     }
+	epgCache_append(&epgRecord);
 
 	if(updated) {
 		s->was_updated = 1;
@@ -1362,73 +1565,111 @@ static int dvb_sectionParse(struct section_buf *s)
 
 static int32_t dvb_sectionRead(struct section_buf *s)
 {
-	int section_length, count;
+	int32_t count;
+	int32_t ret = 0;
 
 	if(s->sectionfilter_done) {
 		return 1;
 	}
 
-	/* the section filter API guarantess that we get one full section
-	 * per read(), provided that the buffer is large enough (it is)
+	/* Demux returns whole sections, but one read may contain several of them.
+	 * Section pipes may also split sections, so incomplete tail is kept in buffer.
 	 */
-	if(((count = read(s->fd, s->buf, sizeof(s->buf))) < 0) && (errno == EOVERFLOW)) {
-		count = read(s->fd, s->buf, sizeof(s->buf));
+	if(((count = read(s->fd, s->buf + s->bufFill, sizeof(s->buf) - s->bufFill)) < 0) && (errno == EOVERFLOW)) {
+		count = read(s->fd, s->buf + s->bufFill, sizeof(s->buf) - s->bufFill);
 	}
 	if(count < 0 && errno != EAGAIN) {
 		dprintf("%s: Read error %d (errno %d) pid 0x%04x\n", __FUNCTION__, count, errno, s->pid);
 		return -1;
 	}
-
-	//dprintf("%s: READ %d bytes!!!\n", __FUNCTION__, count);
-	if(count < 4) {
+	if(count <= 0) {
 		return -1;
 	}
+	s->bufFill += count;
+	s->bytes += count;
 
-	section_length = ((s->buf[1] & 0x0f) << 8) | s->buf[2];
-	//dprintf("%s: READ %d bytes, section length %d!!!\n", __FUNCTION__, count, section_length);
-	if(count != section_length + 3) {
-#warning TODO: Handle if we read more data (several sections)
-		return -1;
-	}
+	while(s->bufFill >= 3) {
+		uint32_t length;
 
-	if(dvb_sectionParse(s) == 1) {
-		return 1;
+		if(s->buf[0] == 0xff) {
+			// stuffing till the end of read
+			s->bufFill = 0;
+			break;
+		}
+		length = (((s->buf[1] & 0x0f) << 8) | s->buf[2]) + 3;
+		if(length > sizeof(s->buf)) {
+			dprintf("%s: Wrong section length %u pid 0x%04x\n", __FUNCTION__, length, s->pid);
+			s->bufFill = 0;
+			break;
+		}
+		if(length > s->bufFill) {
+			break;
+		}
+
+		s->sections++;
+		if(length >= 8 && dvb_sectionParse(s) == 1) {
+			ret = 1;
+		}
+		s->bufFill -= length;
+		if(ret == 1) {
+			break;
+		}
+		memmove(s->buf, s->buf + length, s->bufFill);
 	}
 
-	return 0;
+	return ret;
+}
+
+static void dvb_filterComplete(struct section_buf *s, int32_t timedOut)
+{
+	uint32_t runningMs = dvb_filterNowMs() - s->startMs;
+	uint32_t rate = runningMs ? (uint64_t)s->sections * 1000 / runningMs : s->sections;
+
+	if(timedOut) {
+		l_filterTimeouts++;
+		SCAN_MESSAGE("DVB: filter timeout pid 0x%04x\n", s->pid);
+		eprintf("%s: pid 0x%04x table 0x%02x: %u sections (%u/s, %u bytes) in %u ms, timeout #%u\n", __FUNCTION__,
+				s->pid, s->table_id & 0xff, s->sections, rate, s->bytes, runningMs, l_filterTimeouts);
+	} else {
+		dprintf("%s: pid 0x%04x table 0x%02x: %u sections (%u/s, %u bytes) in %u ms\n", __FUNCTION__,
+				s->pid, s->table_id & 0xff, s->sections, rate, s->bytes, runningMs);
+	}
+	dvb_filterRemove(s);
 }
 
 static void dvb_filtersRead(void)
 {
-    struct list_head *pos;
-    struct list_head *n;
-    struct pollfd *fds;
-    nfds_t nfds;
+    struct epoll_event events[MAX_RUNNING];
+    int32_t count;
+    int32_t i;
+    uint64_t now;
 
-    dvb_getPollFds(&fds, &nfds);
-    if(poll(fds, nfds, 1000) == -1) {
-        PERROR("%s: filter poll failed", __FUNCTION__);
+    count = epoll_wait(l_filtersEpoll, events, MAX_RUNNING, dvb_filterWaitTimeout());
+    if(count < 0) {
+        if(errno != EINTR) {
+            PERROR("%s: filter epoll failed", __FUNCTION__);
+        }
+        count = 0;
     }
 
     mysem_get(dvb_filter_running_list_semaphore);
-    list_for_each_safe(pos, n, &running_filters) {
-        int32_t done = 0;
-        struct section_buf *s = list_entry(pos, struct section_buf, list);
+    for(i = 0; i < count; i++) {
+        struct section_buf *s = dvb_filterFromEvent(events[i].data.u32);
 
-        if(s->poll_fd && s->poll_fd->revents) {
-            if(dvb_sectionRead(s) == 1) {
-                done = 1;
-            }
+        if(s == NULL) {
+            continue;
         }
-
-        if(done) {
-            dvb_filterRemove(s);
-        } else if(time(NULL) > (s->start_time + s->timeout)) {
-            SCAN_MESSAGE("DVB: filter timeout pid 0x%04x\n", s->pid);
-            debug("%s: filter timeout pid 0x%04x\n", __FUNCTION__, s->pid);
-            dvb_filterRemove(s);
+        if(dvb_sectionRead(s) == 1) {
+            dvb_filterComplete(s, 0);
+        } else {
+            dvb_filterTimerUpdate(s);
         }
     }
+
+    now = dvb_filterNowMs();
+    while(l_filterTimersCount > 0 && l_filterTimers[0]->deadlineMs <= now) {
+        dvb_filterComplete(l_filterTimers[0], 1);
+    }
     mysem_release(dvb_filter_running_list_semaphore);
     dvb_filterPushWaiters();
 }
@@ -1445,6 +1686,34 @@ static int32_t dvb_filtersHasAny(void)
     return empty ? 0 : 1;
 }
 
+/* Checks for running or waiting filters collecting into specified service list */
+static int32_t dvb_filtersHasAnyFor(list_element_t **services)
+{
+    struct list_head *pos;
+    int32_t found = 0;
+
+    mysem_get(dvb_filter_running_list_semaphore);
+    mysem_get(dvb_filter_waiting_list_semaphore);
+    list_for_each(pos, &running_filters) {
+        if(list_entry(pos, struct section_buf, list)->service_list == services) {
+            found = 1;
+            break;
+        }
+    }
+    if(!found) {
+        list_for_each(pos, &waiting_filters) {
+            if(list_entry(pos, struct section_buf, list)->service_list == services) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    mysem_release(dvb_filter_waiting_list_semaphore);
+    mysem_release(dvb_filter_running_list_semaphore);
+
+    return found;
+}
+
 /*
 static void dvb_filterServices(list_element_t **head)
 {
@@ -1550,7 +1819,10 @@ int32_t dvb_scanForPMT(uint32_t adapter, EIT_service_t *service)
 	return -1;
 }
 
-static void dvb_scanForServices(uint32_t adapter, uint32_t enableNit, EIT_media_config_t *media)
+/* Collects PSI/SI of transport stream the adapter is tuned to into services list.
+ * Filters must be enabled by caller. Several adapters may collect simultaneously
+ * into different lists. */
+static void dvb_collectServices(uint32_t adapter, uint32_t enableNit, EIT_media_config_t *media, list_element_t **services)
 {
     //struct section_buf process in dvb_filtersRead
     // so they should exist while dvb_filtersRead() executes
@@ -1561,17 +1833,13 @@ static void dvb_scanForServices(uint32_t adapter, uint32_t enableNit, EIT_media_
     struct section_buf nit_filter;
     struct section_buf tvct_filter;
     struct section_buf cvct_filter;
-    list_element_t **pp_dvb_services = dvb_getSrvicesPP();
-
-    mysem_get(dvb_filter_semaphore);
-    dvb_filtersEnable();
 
     /**
     *  filter timeouts > min repetition rates specified in ETR211
     */
-    dvb_filterSetup(&pat_filter, adapter, 0x00, 0x00, 5, pp_dvb_services, media); /* PAT */
-    //dvb_filterSetup(&sdt1_filter, adapter, 0x11, 0x46, 5, pp_dvb_services, media); /* SDT other */
-    dvb_filterSetup(&eit_filter, adapter, 0x12,   -1, 5, pp_dvb_services, media); /* EIT */
+    dvb_filterSetup(&pat_filter, adapter, 0x00, 0x00, 5, services, media); /* PAT */
+    //dvb_filterSetup(&sdt1_filter, adapter, 0x11, 0x46, 5, services, media); /* SDT other */
+    dvb_filterSetup(&eit_filter, adapter, 0x12,   -1, 5, services, media); /* EIT */
 
     dvb_filterAdd(&pat_filter);
     //dvb_filterAdd(&sdt1_filter);
@@ -1579,28 +1847,38 @@ static void dvb_scanForServices(uint32_t adapter, uint32_t enableNit, EIT_media_
 
     if((dvbfe_getType(adapter) == SYS_ATSC) || (dvbfe_getType(adapter) == SYS_DVBC_ANNEX_B)) {
 #if (defined ENABLE_USE_DVB_APPS)
-        dvb_filterSetup(&tvct_filter, adapter, 0x1ffb, stag_atsc_terrestrial_virtual_channel, 5, pp_dvb_services, media); //Terrestrial Virtual Channel Table (TVCT)
+        dvb_filterSetup(&tvct_filter, adapter, 0x1ffb, stag_atsc_terrestrial_virtual_channel, 5, services, media); //Terrestrial Virtual Channel Table (TVCT)
         dvb_filterAdd(&tvct_filter);
-        dvb_filterSetup(&cvct_filter, adapter, 0x1ffb, stag_atsc_cable_virtual_channel, 5, pp_dvb_services, media); //Cable Virtual Channel Table (CVCT)
+        dvb_filterSetup(&cvct_filter, adapter, 0x1ffb, stag_atsc_cable_virtual_channel, 5, services, media); //Cable Virtual Channel Table (CVCT)
         dvb_filterAdd(&cvct_filter);
 #else
         (void)tvct_filter;
         (void)cvct_filter;
 #endif
     } else {
-        dvb_filterSetup(&sdt_filter, adapter, 0x11, 0x42, 5, pp_dvb_services, media); /* SDT actual */
+        dvb_filterSetup(&sdt_filter, adapter, 0x11, 0x42, 5, services, media); /* SDT actual */
         dvb_filterAdd(&sdt_filter);
     }
 
     if(enableNit) {
-        dvb_clearNIT(&dvb_scan_network);
-        dvb_filterSetup(&nit_filter, adapter, 0x10, 0x40, 5, pp_dvb_services, media); /* NIT */
+        dvb_filterSetup(&nit_filter, adapter, 0x10, 0x40, 5, services, media); /* NIT */
         dvb_filterAdd(&nit_filter);
     }
 
     do {
         dvb_filtersRead();
-    } while(dvb_filtersHasAny());
+    } while(dvb_filtersHasAnyFor(services));
+}
+
+static void dvb_scanForServices(uint32_t adapter, uint32_t enableNit, EIT_media_config_t *media)
+{
+    mysem_get(dvb_filter_semaphore);
+    dvb_filtersEnable();
+
+    if(enableNit) {
+        dvb_clearNIT(&dvb_scan_network);
+    }
+    dvb_collectServices(adapter, enableNit, media, dvb_getSrvicesPP());
 
     dvb_filtersDisable();
     mysem_release(dvb_filter_semaphore);
@@ -1738,6 +2016,7 @@ void dvb_clearServiceList(int permanent)
 {
 	dprintf("%s: %d\n", __FUNCTION__, permanent);
 	dvb_lockSrvices();
+	dvb_servicesIndexInvalidate(1);
 	free_services(dvb_getSrvicesPP());
 	if(permanent) {
 		FILE *fd;
@@ -1767,12 +2046,43 @@ int dvb_readServicesFromDump(char* filename)
 {
 	int res;
 	dvb_lockSrvices();
+	dvb_servicesIndexInvalidate(1);
 	free_services(dvb_getSrvicesPP());
 	res = services_load_from_dump(dvb_getSrvicesPP(), filename);
 	dvb_unlockSrvices();
 	return res;
 }
 
+/* Called with services list locked */
+static int32_t dvb_replayCachedEit(uint8_t *section, uint32_t network_id, EIT_media_config_t *media)
+{
+	EIT_service_t *service;
+
+	service = dvb_findServiceNB(*dvb_getSrvicesPP(),
+	                            (section[10] << 8) | section[11],
+	                            (section[8] << 8) | section[9],
+	                            (section[3] << 8) | section[4]);
+	// Don't let stale cache create services which are not in channel list
+	if(service == NULL) {
+		return 0;
+	}
+	if(parse_eit(dvb_getSrvicesPP(), section, network_id, media)) {
+		epgStore_update(service, section);
+	}
+	return 1;
+}
+
+int32_t dvb_loadEpgCache(void)
+{
+	int32_t res;
+
+	dvb_lockSrvices();
+	res = epgCache_load(dvb_replayCachedEit);
+	dvb_servicesIndexInvalidate(0);
+	dvb_unlockSrvices();
+	return res;
+}
+
 
 #ifdef STSDK
 static int32_t dvb_frequencyScanOne(uint32_t adapter, EIT_media_config_t *media,
@@ -2042,6 +2352,300 @@ frequency_scan_failed:
 	return -1;
 }
 
+static int32_t dvb_scanCancelled(void)
+{
+	dvbScanQueue_t *queue = l_scanQueue;
+
+	return (queue != NULL && dvbScanQueue_isCancelled(queue)) ? -1 : 0;
+}
+
+static uint32_t dvb_countServices(list_element_t *head)
+{
+	uint32_t count = 0;
+
+	for(; head != NULL; head = head->next) {
+		count++;
+	}
+	return count;
+}
+
+/* Returns frequencies of NIT transport streams collected so far, caller frees them */
+static uint32_t *dvb_scanGetNitFrequencies(uint32_t *count)
+{
+	list_element_t *tstream_element;
+	uint32_t *frequencies;
+
+	*count = 0;
+	mysem_get(dvb_filter_running_list_semaphore);
+	// list counter works for any list, one more to not allocate 0 bytes
+	frequencies = dmalloc((dvb_countServices(dvb_scan_network.transport_streams) + 1) * sizeof(uint32_t));
+	for(tstream_element = dvb_scan_network.transport_streams;
+	    frequencies != NULL && tstream_element != NULL;
+	    tstream_element = tstream_element->next)
+	{
+		NIT_transport_stream_t *tsrtream = (NIT_transport_stream_t *)tstream_element->data;
+
+		if(tsrtream == NULL ||
+		   tsrtream->media.type <= serviceMediaNone ||
+		   tsrtream->media.frequency == 0)
+		{
+			continue;
+		}
+		frequencies[(*count)++] = tsrtream->media.frequency;
+	}
+	mysem_release(dvb_filter_running_list_semaphore);
+	return frequencies;
+}
+
+static void *dvb_scanWorkerThread(void *pArg)
+{
+	dvb_scanWorker_t *worker = pArg;
+	dvbScanQueue_t *queue = worker->queue;
+	uint32_t frequency;
+
+	if(dvbfe_open(worker->adapter) != 0) {
+		eprintf("%s(): Failed to open adapter=%d frontend\n", __func__, worker->adapter);
+		dvbScanQueue_leave(queue);
+		return NULL;
+	}
+
+	while(dvbScanQueue_take(queue, &frequency) == 0) {
+		EIT_media_config_t media;
+		uint32_t *nitFrequencies = NULL;
+		uint32_t nitCount = 0;
+		uint32_t found = dvb_countServices(worker->services);
+
+		dvbfe_fillMediaConfig(worker->adapter, frequency, &media);
+		if(dvbfe_setParam(worker->adapter, 1, &media, dvb_scanCancelled) == 0) {
+			dvbfe_updateMediaToCurentState(worker->adapter, &media);
+			eprintf("%s(): adapter=%d, scanning %u\n", __func__, worker->adapter, frequency);
+			dvb_collectServices(worker->adapter, 1, &media, &worker->services);
+		}
+		found = dvb_countServices(worker->services) - found;
+
+		if(appControlInfo.dvbCommonInfo.networkScan) {
+			nitFrequencies = dvb_scanGetNitFrequencies(&nitCount);
+		}
+		dvbScanQueue_complete(queue, frequency, found, nitFrequencies, nitCount);
+		dfree(nitFrequencies);
+	}
+
+	dvbfe_close(worker->adapter);
+	dvbScanQueue_leave(queue);
+	return NULL;
+}
+
+static int32_t dvb_isNitFrequency(uint32_t frequency)
+{
+	list_element_t *tstream_element;
+
+	for(tstream_element = dvb_scan_network.transport_streams; tstream_element != NULL; tstream_element = tstream_element->next) {
+		NIT_transport_stream_t *tsrtream = (NIT_transport_stream_t *)tstream_element->data;
+		if(tsrtream != NULL && tsrtream->media.frequency == frequency) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static list_element_t *dvb_scanFindDuplicate(list_element_t *head, list_element_t *end, EIT_service_t *service)
+{
+	for(; head != end; head = head->next) {
+		EIT_service_t *known = (EIT_service_t *)head->data;
+		if(known->common.service_id == service->common.service_id &&
+		   known->common.transport_stream_id == service->common.transport_stream_id &&
+		   known->original_network_id == service->original_network_id)
+		{
+			return head;
+		}
+	}
+	return NULL;
+}
+
+/* Moves data collected by scan into known service, old data goes to scanned copy.
+ * Known pointer stays valid for channel list references.
+ * Tables missing from scanned copy are kept. Called with services locked. */
+static void dvb_scanRefresh(EIT_service_t *known, EIT_service_t *service)
+{
+	EIT_service_t old = *known;
+
+	*known = *service;
+	*service = old;
+
+	if((known->flags & serviceFlagHasPMT) == 0 && (service->flags & serviceFlagHasPMT)) {
+		service->program_map = known->program_map;
+		known->program_map = old.program_map;
+		known->flags |= serviceFlagHasPMT;
+	}
+	if(known->service_descriptor.service_name[0] == 0) {
+		known->service_descriptor = service->service_descriptor;
+	}
+	if(known->schedule == NULL) {
+		known->schedule = service->schedule;
+		service->schedule = NULL;
+	}
+	if(known->present_following == NULL) {
+		known->present_following = service->present_following;
+		service->present_following = NULL;
+	}
+	epgStore_invalidate(known);
+}
+
+/* Moves services found by workers to the channel list.
+ * Services already known are refreshed in place, so channel list references stay valid,
+ * unless known one is on frequency announced in NIT and scanned copy is not.
+ * Among new duplicates (transport stream received on several frequencies)
+ * the one tuned to frequency announced in NIT wins. */
+static uint32_t dvb_scanMerge(dvb_scanWorker_t *workers, uint32_t workerCount)
+{
+	list_element_t *duplicates = NULL;
+	list_element_t *firstNew;
+	list_element_t **tail;
+	uint32_t added = 0;
+	uint32_t refreshed = 0;
+	uint32_t i;
+
+	dvb_lockSrvices();
+	for(tail = dvb_getSrvicesPP(); *tail != NULL; tail = &(*tail)->next);
+	firstNew = NULL;
+
+	for(i = 0; i < workerCount; i++) {
+		list_element_t *element = workers[i].services;
+
+		while(element != NULL) {
+			list_element_t *next = element->next;
+			EIT_service_t *service = (EIT_service_t *)element->data;
+			list_element_t *known;
+
+			element->next = NULL;
+			known = dvb_scanFindDuplicate(*dvb_getSrvicesPP(), firstNew, service);
+			if(known != NULL) {
+				// same preference as for new duplicates below
+				if(dvb_isNitFrequency(service->media.frequency) ||
+				   !dvb_isNitFrequency(((EIT_service_t *)known->data)->media.frequency))
+				{
+					dvb_scanRefresh((EIT_service_t *)known->data, service);
+					refreshed++;
+				}
+			} else if(firstNew != NULL) {
+				known = dvb_scanFindDuplicate(firstNew, NULL, service);
+				if(known != NULL &&
+				   !dvb_isNitFrequency(((EIT_service_t *)known->data)->media.frequency) &&
+				   dvb_isNitFrequency(service->media.frequency))
+				{
+					element->data = known->data;
+					known->data = service;
+				}
+			}
+			if(known != NULL) {
+				element->next = duplicates;
+				duplicates = element;
+			} else {
+				*tail = element;
+				tail = &element->next;
+				if(firstNew == NULL) {
+					firstNew = element;
+				}
+				added++;
+			}
+			element = next;
+		}
+		workers[i].services = NULL;
+	}
+	// duplicates hold data replaced in refreshed services, free it before readers see the list
+	if(duplicates != NULL) {
+		dprintf("%s(): %u services refreshed, %u duplicates dropped\n", __func__,
+				refreshed, dvb_countServices(duplicates) - refreshed);
+		free_services(&duplicates);
+	}
+	dvb_servicesIndexInvalidate(0);
+	dvb_unlockSrvices();
+
+	return added;
+}
+
+int32_t dvb_scanFrequencies(uint32_t adapter, const uint32_t *frequencies, uint32_t count,
+						dvb_displayFunctionDef* pFunction, int32_t save_service_list)
+{
+	dvb_scanWorker_t workers[MAX_ADAPTER_SUPPORTED];
+	dvbScanQueue_t queue;
+	dvbScanProgress_t progress;
+	uint32_t workerCount = 0;
+	uint32_t added;
+	uint32_t i;
+	int32_t finished = 0;
+	struct timespec started;
+	struct timespec now;
+
+	if(dvbScanQueue_init(&queue, frequencies, count) != 0) {
+		return -1;
+	}
+
+	mysem_get(dvb_filter_semaphore);
+	dvb_filtersEnable();
+	dvb_clearNIT(&dvb_scan_network);
+	l_scanQueue = &queue;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
+	// selected adapter goes first, others of the same type join
+	memset(workers, 0, sizeof(workers));
+	for(i = 0; i < MAX_ADAPTER_SUPPORTED; i++) {
+		uint32_t a = (adapter + i) % MAX_ADAPTER_SUPPORTED;
+
+		if(!dvbfe_hasTuner(a) || dvbfe_getType(a) != dvbfe_getType(adapter)) {
+			continue;
+		}
+		workers[workerCount].adapter = a;
+		workers[workerCount].queue = &queue;
+		dvbScanQueue_join(&queue);
+		if(pthread_create(&workers[workerCount].thread, NULL, dvb_scanWorkerThread, &workers[workerCount]) != 0) {
+			eprintf("%s(): Failed to start scan on adapter=%d\n", __func__, a);
+			dvbScanQueue_leave(&queue);
+			continue;
+		}
+		workerCount++;
+	}
+	eprintf("%s(): scanning %u frequencies on %u adapters\n", __func__, count, workerCount);
+
+	while(workerCount > 0 && !finished) {
+		dvbScanQueue_getProgress(&queue, &progress);
+		finished = (progress.running == 0);
+
+		if(pFunction != NULL && !dvbScanQueue_isCancelled(&queue) &&
+		   pFunction(progress.lastFrequency, dvb_getNumberOfServices() + progress.found,
+		             adapter, progress.done, progress.total) == -1)
+		{
+			dprintf("%s[%d]: aborted by user\n", __FUNCTION__, adapter);
+			dvbScanQueue_cancel(&queue);
+		}
+		if(!finished) {
+			usleep(SCAN_PROGRESS_INTERVAL_US);
+		}
+	}
+
+	for(i = 0; i < workerCount; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	l_scanQueue = NULL;
+	added = dvb_scanMerge(workers, workerCount);
+
+	dvb_filtersDisable();
+	mysem_release(dvb_filter_semaphore);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	eprintf("%s(): %u of %u frequencies scanned, %u new services, %lu s%s\n", __func__,
+			queue.done, queue.count, added, (unsigned long)(now.tv_sec - started.tv_sec),
+			queue.cancel ? ", cancelled" : "");
+
+	if(save_service_list && added > 0) {
+		dvb_exportServiceList(appControlInfo.dvbCommonInfo.channelConfigFile);
+	}
+
+	dvbScanQueue_destroy(&queue);
+
+	return queue.cancel ? -1 : (int32_t)added;
+}
+
 /*
    clear and inits the given instance.
    @param mode @b IN The DVB mode to set up
@@ -2313,16 +2917,21 @@ static int dvb_instanceOpen(struct dvb_instance * dvb, char *pFilename)
 #ifdef ENABLE_DVB_PVR
 	else if (dvb->mode == DvbMode_Play)
 	{
-		char in_path[PATH_MAX];
-		dprintf("%s[%d]: %s/part%02d.spts\n", __FUNCTION__, adapter, dvb->directory, dvb->fileIndex);
+		off_t position;
 
 		snprintf(dvb->directory, sizeof(dvb->directory), "%s", pFilename);
+		dprintf("%s[%d]: %s/part%02d.spts\n", __FUNCTION__, adapter, dvb->directory, dvb->fileIndex);
 		dvb->pvr.rate = DEFAULT_PVR_RATE;
-		snprintf(in_path, sizeof(in_path), "%s/part%02d.spts", dvb->directory, dvb->fileIndex);
-		open_or_abort(adapter, "read", in_path, O_RDONLY, dvb->fdin);
+		/* All parts are read as one stream, readahead hides part switching */
+		if ((dvb->pvr.reader = pvrReader_open(dvb->directory, NULL)) == NULL) {
+			PERROR("%s[%d]: failed to open %s for read: %s\n",
+				__FUNCTION__, adapter, dvb->directory, strerror(errno));
+			return -1;
+		}
 
 		/* Set the current read position */
-		lseek(dvb->fdin, (dvb->pvr.position/TS_PACKET_SIZE)*TS_PACKET_SIZE, 0);
+		position = pvrReader_getPosition(dvb->pvr.reader, dvb->fileIndex, (dvb->pvr.position/TS_PACKET_SIZE)*TS_PACKET_SIZE);
+		pvrReader_seek(dvb->pvr.reader, position > 0 ? position : 0, SEEK_SET);
 		dvb->pvr.last_position = dvb->pvr.position;
 		dvb->pvr.last_index = dvb->fileIndex;
 
@@ -2374,6 +2983,10 @@ static void dvb_instanceClose (struct dvb_instance * dvb)
 	CLOSE_FD(dvb->adapter, "input",          dvb->fdin);
 #ifdef ENABLE_DVB_PVR
 	CLOSE_FD(dvb->adapter, "output",         dvb->fdout);
+	if (dvb->pvr.reader) {
+		pvrReader_close(dvb->pvr.reader);
+		dvb->pvr.reader = NULL;
+	}
 #endif
 #endif // LINUX_DVB_API_DEMUX
 	dprintf("%s[%d]: ok\n", __FUNCTION__, dvb->adapter);
@@ -2511,21 +3124,15 @@ static void *dvb_pvrThread(void *pArg)
 		unsigned char buffer[PVR_BUFFER_SIZE];
 
 		pthread_testcancel();
-		length = read(dvb->fdin, buffer, PVR_BUFFER_SIZE);
-		if (length == 0)
+		if (dvb->mode == DvbMode_Play)
 		{
-			if (dvb->mode == DvbMode_Play)
-			{
-				close(dvb->fdin);
-				snprintf(filename, sizeof(filename), "%s/part%02d.spts", dvb->directory, dvb->fileIndex+1);
-				if ((dvb->fdin = open(filename, O_RDONLY)) >= 0)
-				{
-					dvb->fileIndex++;
-					dvb->pvr.position = 0;
-					length = read(dvb->fdin, buffer, PVR_BUFFER_SIZE);
-				}
-			}
-		}
+			int state;
+			/* reader may wait on its mutex, cancel only between reads */
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+			length = pvrReader_read(dvb->pvr.reader, buffer, PVR_BUFFER_SIZE);
+			pthread_setcancelstate(state, NULL);
+		} else
+			length = read(dvb->fdin, buffer, PVR_BUFFER_SIZE);
 
 		if (length < 0)
 		{
@@ -2547,7 +3154,13 @@ static void *dvb_pvrThread(void *pArg)
 					}
 				}
 			}
-			dvb->pvr.position += length;
+			if (dvb->mode == DvbMode_Play)
+			{
+				off_t offset;
+				if (pvrReader_getPart(dvb->pvr.reader, pvrReader_tell(dvb->pvr.reader), &dvb->fileIndex, &offset) == 0)
+					dvb->pvr.position = offset;
+			} else
+				dvb->pvr.position += length;
 			pthread_testcancel();
 			write_length = write(dvb->fdout, buffer, length);
 			if (write_length < 0)
@@ -2578,54 +3191,256 @@ int dvb_getNumberOfServices(void)
 
 int32_t dvb_getCountOfServices(void)
 {
-    list_element_t *service_element;
-    int serviceCount = 0;
-    dvb_lockSrvices();
-    for(service_element = dvb_getSrvices(); service_element != NULL; service_element = service_element->next) {
-        serviceCount++;
-    }
-    dvb_unlockSrvices();
+    dvb_servicesIndex_t *index = dvb_servicesIndexAcquire();
+    int serviceCount = index ? index->count : 0;
+    dvb_servicesIndexRelease(index);
     return serviceCount;
 }
 
 
-EIT_service_t* dvb_getService(int which)
+static inline uint32_t dvb_servicesHashIds(uint16_t original_network_id, uint16_t transport_stream_id, uint16_t service_id)
+{
+	uint32_t h = ((uint32_t)original_network_id << 16 | transport_stream_id) * 0x9e3779b1u;
+	return (h ^ (service_id * 0x85ebca6bu)) >> 16 & (SERVICES_HASH_SIZE-1);
+}
+
+static inline uint32_t dvb_servicesHashPtr(EIT_service_t *service)
+{
+	return ((uint32_t)(uintptr_t)service * 0x9e3779b1u) >> 16 & (SERVICES_HASH_SIZE-1);
+}
+
+/* Frees replaced snapshots if no reader can reference them. Called with dvb_semaphore held. */
+static void dvb_servicesIndexCollect(void)
+{
+	__sync_synchronize();
+	if(l_servicesIndexReaders != 0) {
+		return;
+	}
+	while(l_servicesIndexRetired != NULL) {
+		dvb_servicesIndex_t *index = l_servicesIndexRetired;
+		l_servicesIndexRetired = index->retired;
+		dfree(index);
+	}
+}
+
+static void dvb_servicesIndexRetire(dvb_servicesIndex_t *index)
+{
+	if(index != NULL) {
+		index->retired = l_servicesIndexRetired;
+		l_servicesIndexRetired = index;
+	}
+}
+
+/* Marks index outdated, may be called without dvb_semaphore. If services are
+ * about to be removed from the list, it must be called before freeing them
+ * with dvb_semaphore held: current snapshot is dropped and readers still
+ * using it are waited for. */
+static void dvb_servicesIndexInvalidate(int32_t released)
+{
+	if(released) {
+		dvb_servicesIndex_t *index = l_servicesIndex;
+
+		/* Readers count themselves before loading l_servicesIndex, so once
+		 * count drops to zero nobody can reach services of dropped snapshot */
+		l_servicesIndex = NULL;
+		__sync_fetch_and_add(&l_servicesIndexGeneration, 1);
+		while(__sync_fetch_and_add(&l_servicesIndexReaders, 0) != 0) {
+			usleep(1000);
+		}
+		epgStore_clear();
+		dvb_servicesIndexRetire(index);
+		dvb_servicesIndexCollect();
+		return;
+	}
+	__sync_fetch_and_add(&l_servicesIndexGeneration, 1);
+}
+
+/* Builds new snapshot of l_dvb_services. Called with dvb_semaphore held. */
+static void dvb_servicesIndexRebuild(void)
 {
 	list_element_t *service_element;
+	dvb_servicesIndex_t *index;
+	int32_t generation;
+	int32_t count = 0;
+	int32_t i;
+
+	/* Generation is sampled before walking the list: invalidation racing
+	 * with the walk leaves snapshot outdated instead of being lost */
+	generation = __sync_fetch_and_add(&l_servicesIndexGeneration, 0);
+	if(l_servicesIndex != NULL && l_servicesIndex->generation == generation) {
+		return;
+	}
+	for(service_element = dvb_getSrvices(); service_element != NULL; service_element = service_element->next) {
+		count++;
+	}
+	index = dmalloc(sizeof(dvb_servicesIndex_t) + count*sizeof(index->entry[0]));
+	if(index == NULL) {
+		eprintf("%s: failed to allocate index of %d services\n", __FUNCTION__, count);
+		return;
+	}
+	index->count      = count;
+	index->generation = generation;
+	index->retired    = NULL;
+	memset(index->idBucket,  0xff, sizeof(index->idBucket));
+	memset(index->ptrBucket, 0xff, sizeof(index->ptrBucket));
+
+	for(service_element = dvb_getSrvices(), i = 0; service_element != NULL; service_element = service_element->next, i++) {
+		EIT_service_t *service = (EIT_service_t *)service_element->data;
+		uint32_t h;
+
+		index->entry[i].service             = service;
+		index->entry[i].original_network_id = service->original_network_id;
+		index->entry[i].transport_stream_id = service->common.transport_stream_id;
+		index->entry[i].service_id          = service->common.service_id;
+
+		h = dvb_servicesHashIds(index->entry[i].original_network_id, index->entry[i].transport_stream_id, index->entry[i].service_id);
+		index->entry[i].idNext = index->idBucket[h];
+		index->idBucket[h] = i;
+
+		h = dvb_servicesHashPtr(service);
+		index->entry[i].ptrNext = index->ptrBucket[h];
+		index->ptrBucket[h] = i;
+	}
+
+	dvb_servicesIndexRetire(l_servicesIndex);
+	__sync_synchronize();
+	l_servicesIndex = index;
+	dvb_servicesIndexCollect();
+}
+
+/* Returns current snapshot, rebuilding it if needed. While scanning thread holds
+ * services list, previous snapshot is used instead of waiting. Every non-NULL
+ * result must be released with dvb_servicesIndexRelease. */
+static dvb_servicesIndex_t *dvb_servicesIndexAcquire(void)
+{
+	dvb_servicesIndex_t *index;
+	int32_t locked = 0;
+
+	__sync_fetch_and_add(&l_servicesIndexReaders, 1);
+	index = l_servicesIndex;
+	if(index != NULL && index->generation == l_servicesIndexGeneration) {
+		return index;
+	}
+	if(index != NULL) {
+		if(mysem_tryget(dvb_semaphore) == 0) {
+			locked = 1;
+		} else if(l_servicesIndex == index) {
+			/* Outdated but still current snapshot: its services are alive
+			 * until invalidation drops it and waits for this reader */
+			return index;
+		}
+	}
+	__sync_fetch_and_sub(&l_servicesIndexReaders, 1);
+
+	if(!locked) {
+		dvb_lockSrvices();
+	}
+	dvb_servicesIndexRebuild();
+	index = l_servicesIndex;
+	if(index != NULL) {
+		/* Fresh snapshot is used even if list was invalidated again meanwhile,
+		 * so that unlocked invalidations can't keep readers rebuilding */
+		__sync_fetch_and_add(&l_servicesIndexReaders, 1);
+	}
+	dvb_unlockSrvices();
+	return index;
+}
+
+static inline void dvb_servicesIndexRelease(dvb_servicesIndex_t *index)
+{
+	if(index != NULL) {
+		__sync_fetch_and_sub(&l_servicesIndexReaders, 1);
+	}
+}
+
+EIT_service_t* dvb_getService(int which)
+{
+	dvb_servicesIndex_t *index;
+	EIT_service_t *service = NULL;
+
 	if( which < 0 )
 		return NULL;
-	dvb_lockSrvices();
-	for( service_element = dvb_getSrvices(); service_element != NULL; service_element = service_element->next )
+	index = dvb_servicesIndexAcquire();
+	if( index != NULL && which < index->count )
+	{
+		service = index->entry[which].service;
+	}
+	dvb_servicesIndexRelease(index);
+	return service;
+}
+
+int dvb_getServiceIndex( EIT_service_t* service )
+{
+	dvb_servicesIndex_t *index;
+	int32_t i, found = -1;
+
+	if( service == NULL )
+		return -1;
+	index = dvb_servicesIndexAcquire();
+	if( index == NULL )
+		return -1;
+
+	for( i = index->ptrBucket[dvb_servicesHashPtr(service)]; i >= 0; i = index->entry[i].ptrNext )
 	{
-		if(which == 0)
+		if( index->entry[i].service == service )
 		{
-			dvb_unlockSrvices();
-			return (EIT_service_t*)service_element->data;
+			found = i;
+			break;
 		}
-		which--;
 	}
-	dvb_unlockSrvices();
-	return NULL;
+	dvb_servicesIndexRelease(index);
+	return found;
 }
 
-int dvb_getServiceIndex( EIT_service_t* service )
+/* Linear lookup for callers holding services list. Falls back to service with
+ * matching transport stream and service id if original network is not known. */
+static EIT_service_t *dvb_findServiceNB(list_element_t *head, uint16_t original_network_id, uint16_t transport_stream_id, uint16_t service_id)
 {
+	EIT_service_t *candidate = NULL;
 	list_element_t *service_element;
-	int i;
-	dvb_lockSrvices();
 
-	for( service_element = dvb_getSrvices(), i = 0;
-		service_element != NULL;
-		service_element = service_element->next, i++ )
+	for(service_element = head; service_element != NULL; service_element = service_element->next) {
+		EIT_service_t *service = (EIT_service_t *)service_element->data;
+		if(service->common.service_id == service_id &&
+		   service->common.transport_stream_id == transport_stream_id) {
+			if(service->original_network_id == original_network_id) {
+				return service;
+			}
+			if(candidate == NULL) {
+				candidate = service;
+			}
+		}
+	}
+	return candidate;
+}
+
+EIT_service_t* dvb_findServiceByIds(uint16_t original_network_id, uint16_t transport_stream_id, uint16_t service_id)
+{
+	dvb_servicesIndex_t *index;
+	EIT_service_t *service = NULL;
+	int32_t i, found = -1;
+
+	index = dvb_servicesIndexAcquire();
+	if( index == NULL )
+		return NULL;
+
+	for( i = index->idBucket[dvb_servicesHashIds(original_network_id, transport_stream_id, service_id)];
+	     i >= 0;
+	     i = index->entry[i].idNext )
 	{
-		if( (EIT_service_t*)service_element->data == service )
+		if( index->entry[i].service_id          == service_id &&
+		    index->entry[i].transport_stream_id == transport_stream_id &&
+		    index->entry[i].original_network_id == original_network_id )
 		{
-			dvb_unlockSrvices();
-			return i;
+			found = i; // chain is in reverse list order, keep the first service in list
 		}
 	}
-	dvb_unlockSrvices();
-	return -1;
+	if( found >= 0 )
+	{
+		service = index->entry[found].service;
+	}
+	dvb_servicesIndexRelease(index);
+	return service;
 }
 
 char* dvb_getServiceName(EIT_service_t *service)
@@ -3407,6 +4222,10 @@ void dvb_init(void)
     mysem_create(&dvb_filter_semaphore);
     mysem_create(&dvb_filter_running_list_semaphore);
     mysem_create(&dvb_filter_waiting_list_semaphore);
+    l_filtersEpoll = epoll_create(MAX_RUNNING);
+    if(l_filtersEpoll < 0) {
+        PERROR("%s: epoll_create failed", __FUNCTION__);
+    }
 
     dvbfe_init();
     dvbChannel_init();
@@ -3426,13 +4245,21 @@ void dvb_terminate(void)
     bouquet_terminate();
     dvbChannel_terminate();
     dvbfe_terminate();
+    epgCache_terminate();
 
+    dvb_lockSrvices();
     free_services(dvb_getSrvicesPP());
+    dvb_servicesIndexInvalidate(1);
+    dvb_unlockSrvices();
 
     mysem_destroy(dvb_semaphore);
     mysem_destroy(dvb_filter_semaphore);
     mysem_destroy(dvb_filter_running_list_semaphore);
     mysem_destroy(dvb_filter_waiting_list_semaphore);
+    if(l_filtersEpoll >= 0) {
+        close(l_filtersEpoll);
+        l_filtersEpoll = -1;
+    }
 }
 
 #ifdef ENABLE_DVB_PVR
@@ -3511,9 +4338,15 @@ static list_element_t **dvb_getSrvicesPP(void)
 int32_t dvb_setSrvices(list_element_t *new_services)
 {
     l_dvb_services = new_services;
+    dvb_servicesIndexInvalidate(1);
     return 0;
 }
 
+void dvb_invalidateSrvices(void)
+{
+    dvb_servicesIndexInvalidate(0);
+}
+
 int32_t dvb_lockSrvices(void)
 {
     return mysem_get(dvb_semaphore);
@@ -212,6 +212,25 @@ int dvb_frequencyScan(	uint32_t adapter, __u32 frequency,
 						int save_service_list,
 						dvbfe_cancelFunctionDef* pCancelFunction);
 
+/**  @ingroup dvb_instance
+ *   @ingroup dvb_service
+ *   @brief Function used to scan list of frequencies on all tuners of the same type in parallel
+ *
+ *   Frequencies are distributed between tuners, each locked transponder is scanned
+ *   while other tuners are tuning. Found services are merged into channel list
+ *   once at the end, services with already known DVB ids are skipped.
+ *
+ *   @param[in]  tuner             Tuner which type defines frequency meaning
+ *   @param[in]  frequencies       Frequencies to scan
+ *   @param[in]  count             Number of frequencies
+ *   @param[in]  pFunction         Callback function to display progress and check for user cancel
+ *   @param[in]  save_service_list Allow saving channel list to permanent storage
+ *
+ *   @return Number of new services, -1 if cancelled or failed
+ */
+int32_t dvb_scanFrequencies(uint32_t adapter, const uint32_t *frequencies, uint32_t count,
+						dvb_displayFunctionDef* pFunction, int32_t save_service_list);
+
 /**  @ingroup dvb_instance
  *   @ingroup dvb_service
  *   @brief Function used to scan for EPG during playback
@@ -268,6 +287,17 @@ char *dvb_getTempServiceName(int index);
  */
 int dvb_getServiceIndex( EIT_service_t* service);
 
+/**  @ingroup dvb_service
+ *   @brief Find channel by its DVB identifiers
+ *
+ *   @param[in]  original_network_id  Original network of the channel
+ *   @param[in]  transport_stream_id  Transport stream of the channel
+ *   @param[in]  service_id           Service (program) number
+ *
+ *   @return NULL if service not found
+ */
+EIT_service_t* dvb_findServiceByIds(uint16_t original_network_id, uint16_t transport_stream_id, uint16_t service_id);
+
 /**  @ingroup dvb_service
  *   @brief Function used to return the name of a given DVB channel
  *
@@ -425,6 +455,12 @@ void dvb_exportServiceList(char* filename);
  */
 int dvb_readServicesFromDump(char* filename);
 
+/**  @ingroup dvb_service
+ *   @brief Function fills schedules of current channel list from persistent EPG cache
+ *   @return Number of cached EIT sections or -1 if there is no cache
+ */
+int32_t dvb_loadEpgCache(void);
+
 /**  @ingroup dvb_service
  *   @brief Function cleans current channel list
  *   @param[in]  permanent Save changes to disk
@@ -480,6 +516,9 @@ uint16_t dvb_getStreamPid(PID_info_t *stream)
 
 list_element_t *dvb_getSrvices(void);
 int32_t dvb_setSrvices(list_element_t *new_services);
+/* Must be called after services were added to the list or their ids were changed
+ * outside of dvb.c, so index used by dvb_getService & co is rebuilt */
+void dvb_invalidateSrvices(void);
 int32_t dvb_lockSrvices(void);
 int32_t dvb_unlockSrvices(void);
 
@@ -712,6 +712,7 @@ int32_t dvbChannel_load(void)
 	if(helperFileExists(appControlInfo.dvbCommonInfo.channelConfigFile)) {
 		dvb_readServicesFromDump(appControlInfo.dvbCommonInfo.channelConfigFile);
 		dprintf("%s(): loaded %d services\n", __func__, dvb_getNumberOfServices());
+		dvb_loadEpgCache();
 	}
 	dvbChannel_initServices();
 	return 0;
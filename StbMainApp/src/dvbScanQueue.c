@@ -0,0 +1,179 @@
+/*
+ dvbScanQueue.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "dvbScanQueue.h"
+
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ENABLE_DVB
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+int32_t dvbScanQueue_init(dvbScanQueue_t *queue, const uint32_t *frequencies, uint32_t count)
+{
+	if(frequencies == NULL || count == 0) {
+		return -1;
+	}
+	memset(queue, 0, sizeof(*queue));
+	queue->frequencies = dmalloc(count * sizeof(uint32_t));
+	if(queue->frequencies == NULL) {
+		return -1;
+	}
+	memcpy(queue->frequencies, frequencies, count * sizeof(uint32_t));
+	queue->count = count;
+	queue->capacity = count;
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+	return 0;
+}
+
+void dvbScanQueue_destroy(dvbScanQueue_t *queue)
+{
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->mutex);
+	dfree(queue->frequencies);
+	queue->frequencies = NULL;
+}
+
+void dvbScanQueue_join(dvbScanQueue_t *queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->running++;
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+void dvbScanQueue_leave(dvbScanQueue_t *queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->running--;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+int32_t dvbScanQueue_take(dvbScanQueue_t *queue, uint32_t *frequency)
+{
+	pthread_mutex_lock(&queue->mutex);
+	// other workers may still add transport streams from NIT
+	while(!queue->cancel && queue->next >= queue->count && queue->busy > 0) {
+		pthread_cond_wait(&queue->cond, &queue->mutex);
+	}
+	if(queue->cancel || queue->next >= queue->count) {
+		pthread_mutex_unlock(&queue->mutex);
+		return -1;
+	}
+	*frequency = queue->frequencies[queue->next++];
+	queue->busy++;
+	pthread_mutex_unlock(&queue->mutex);
+	return 0;
+}
+
+/* Called with queue mutex held */
+static void dvbScanQueue_addNB(dvbScanQueue_t *queue, uint32_t frequency)
+{
+	uint32_t i;
+
+	if(frequency == 0) {
+		return;
+	}
+	for(i = 0; i < queue->count; i++) {
+		if(queue->frequencies[i] == frequency) {
+			return;
+		}
+	}
+	if(queue->count == queue->capacity) {
+		uint32_t *frequencies = drealloc(queue->frequencies, 2 * queue->capacity * sizeof(uint32_t));
+		if(frequencies == NULL) {
+			eprintf("%s(): failed to queue %u\n", __func__, frequency);
+			return;
+		}
+		queue->frequencies = frequencies;
+		queue->capacity *= 2;
+	}
+	dprintf("%s(): queued %u\n", __func__, frequency);
+	queue->frequencies[queue->count++] = frequency;
+}
+
+void dvbScanQueue_complete(dvbScanQueue_t *queue, uint32_t frequency, uint32_t found,
+                           const uint32_t *more, uint32_t moreCount)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&queue->mutex);
+	// new frequencies must be queued before busy is released, idle workers exit otherwise
+	for(i = 0; more != NULL && i < moreCount; i++) {
+		dvbScanQueue_addNB(queue, more[i]);
+	}
+	queue->busy--;
+	queue->done++;
+	queue->found += found;
+	queue->lastFrequency = frequency;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+void dvbScanQueue_cancel(dvbScanQueue_t *queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->cancel = 1;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+int32_t dvbScanQueue_isCancelled(dvbScanQueue_t *queue)
+{
+	int32_t cancel;
+
+	pthread_mutex_lock(&queue->mutex);
+	cancel = queue->cancel;
+	pthread_mutex_unlock(&queue->mutex);
+	return cancel;
+}
+
+void dvbScanQueue_getProgress(dvbScanQueue_t *queue, dvbScanProgress_t *progress)
+{
+	pthread_mutex_lock(&queue->mutex);
+	progress->lastFrequency = queue->lastFrequency ? queue->lastFrequency : queue->frequencies[0];
+	progress->done    = queue->done;
+	progress->total   = queue->count;
+	progress->found   = queue->found;
+	progress->running = queue->running;
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+#endif /* ENABLE_DVB */
@@ -0,0 +1,137 @@
+#if !defined(__DVB_SCAN_QUEUE_H)
+#define __DVB_SCAN_QUEUE_H
+
+/*
+ dvbScanQueue.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file dvbScanQueue.h Frequencies shared by parallel scan workers
+ * Each worker thread runs on its own tuner and takes next frequency from the
+ * queue until it is empty. Workers may append frequencies found in NIT, so
+ * idle worker waits while others are busy, as they can still add more.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include "defines.h"
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef ENABLE_DVB
+
+/*******************
+* EXPORTED TYPEDEFS *
+********************/
+
+typedef struct {
+	pthread_mutex_t  mutex;
+	pthread_cond_t   cond;
+	uint32_t        *frequencies;
+	uint32_t         count;
+	uint32_t         capacity;
+	uint32_t         next;
+	uint32_t         busy;      // workers scanning a frequency
+	uint32_t         running;   // workers not finished yet
+	uint32_t         done;
+	uint32_t         found;     // services collected by all workers
+	uint32_t         lastFrequency;
+	int32_t          cancel;
+} dvbScanQueue_t;
+
+/** Snapshot of queue state for progress display */
+typedef struct {
+	uint32_t lastFrequency; /**< Last scanned frequency, first queued if none yet */
+	uint32_t done;
+	uint32_t total;
+	uint32_t found;
+	uint32_t running;
+} dvbScanProgress_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+/**
+ *  @brief Initializes queue with copy of frequencies list
+ *
+ *  @return 0 on success
+ */
+int32_t dvbScanQueue_init(dvbScanQueue_t *queue, const uint32_t *frequencies, uint32_t count);
+
+/**
+ *  @brief Frees queue, all workers must be joined before
+ */
+void dvbScanQueue_destroy(dvbScanQueue_t *queue);
+
+/**
+ *  @brief Registers worker, must be called before worker thread is started
+ */
+void dvbScanQueue_join(dvbScanQueue_t *queue);
+
+/**
+ *  @brief Unregisters worker when it exits or failed to start
+ */
+void dvbScanQueue_leave(dvbScanQueue_t *queue);
+
+/**
+ *  @brief Takes next frequency to scan
+ *
+ *  Blocks while queue is empty and other workers are busy.
+ *
+ *  @return 0 if frequency was taken, -1 if scan is finished or cancelled
+ */
+int32_t dvbScanQueue_take(dvbScanQueue_t *queue, uint32_t *frequency);
+
+/**
+ *  @brief Reports frequency taken by dvbScanQueue_take() as scanned
+ *
+ *  @param[in]  found      Number of services collected on frequency
+ *  @param[in]  more       Frequencies to scan additionally, already queued ones are skipped, may be NULL
+ */
+void dvbScanQueue_complete(dvbScanQueue_t *queue, uint32_t frequency, uint32_t found,
+                           const uint32_t *more, uint32_t moreCount);
+
+/**
+ *  @brief Stops all workers after their current frequency
+ */
+void dvbScanQueue_cancel(dvbScanQueue_t *queue);
+
+/**
+ *  @brief Checks if scan was cancelled, to abort tuning in progress
+ */
+int32_t dvbScanQueue_isCancelled(dvbScanQueue_t *queue);
+
+void dvbScanQueue_getProgress(dvbScanQueue_t *queue, dvbScanProgress_t *progress);
+
+#endif /* ENABLE_DVB */
+
+#endif /* __DVB_SCAN_QUEUE_H      Do not add any thing below this line */
@@ -0,0 +1,358 @@
+/*
+ dvbSimulator.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "dvbSimulator.h"
+
+#if (defined ENABLE_DVB) && (defined ENABLE_DVB_SIMULATOR)
+
+#include "debug.h"
+#include "crc32.h"
+#include "dvb_types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define TS_PACKET_SIZE          (188)
+#define TS_SYNC_BYTE            (0x47)
+#define SIMULATOR_READ_PACKETS  (64)
+#define SIMULATOR_MAX_SECTION   (4096)
+/* Pause between passes over the file, roughly a carousel repetition period */
+#define SIMULATOR_PASS_DELAY_US (20000)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct {
+	int32_t  fd;
+	int32_t  pid;
+	int32_t  table_id;
+	char     filename[PATH_MAX];
+
+	int32_t  cc;
+	uint32_t fill;
+	uint8_t  section[SIMULATOR_MAX_SECTION + TS_PACKET_SIZE];
+} dvbSimulator_filter_t;
+
+/***********************************************
+* STATIC DATA                                  *
+************************************************/
+
+static pthread_mutex_t l_simulatorMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t l_simulatorFrequency[MAX_ADAPTER_SUPPORTED];
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static void dvbSimulator_getFilename(uint32_t frequency, char *filename, size_t size)
+{
+	snprintf(filename, size, "%s/%u.ts", DVB_SIMULATOR_DIR, frequency);
+}
+
+int32_t dvbSimulator_isAvailable(void)
+{
+	struct stat st;
+
+	return stat(DVB_SIMULATOR_DIR, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+int32_t dvbSimulator_tune(uint32_t adapter, uint32_t frequency)
+{
+	char filename[PATH_MAX];
+	int32_t ret;
+
+	if(adapter >= MAX_ADAPTER_SUPPORTED) {
+		return -1;
+	}
+	dvbSimulator_getFilename(frequency, filename, sizeof(filename));
+	ret = access(filename, R_OK) == 0 ? 0 : -1;
+
+	pthread_mutex_lock(&l_simulatorMutex);
+	l_simulatorFrequency[adapter] = (ret == 0) ? frequency : 0;
+	pthread_mutex_unlock(&l_simulatorMutex);
+
+	return ret;
+}
+
+int32_t dvbSimulator_hasLock(uint32_t adapter)
+{
+	int32_t ret;
+
+	if(adapter >= MAX_ADAPTER_SUPPORTED) {
+		return 0;
+	}
+	pthread_mutex_lock(&l_simulatorMutex);
+	ret = l_simulatorFrequency[adapter] != 0;
+	pthread_mutex_unlock(&l_simulatorMutex);
+
+	return ret;
+}
+
+/* Returns -1 if reader has gone */
+static int32_t dvbSimulator_sendSection(dvbSimulator_filter_t *f, const uint8_t *section, uint32_t length)
+{
+	if(f->table_id >= 0 && f->table_id < 0x100 && section[0] != f->table_id) {
+		return 0;
+	}
+	// emulate DMX_CHECK_CRC
+	if((section[1] & 0x80) && dvb_crc32(section, length) != 0) {
+		return 0;
+	}
+	while(send(f->fd, section, length, MSG_NOSIGNAL) < 0) {
+		if(errno != EINTR) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+/* Assembles sections of filter pid from TS packet.
+ * Returns number of sent sections or -1 if reader has gone */
+static int32_t dvbSimulator_processPacket(dvbSimulator_filter_t *f, const uint8_t *packet)
+{
+	const uint8_t *payload = packet + 4;
+	const uint8_t *end = packet + TS_PACKET_SIZE;
+	int32_t cc = packet[3] & 0x0f;
+	int32_t sent = 0;
+
+	if((packet[1] & 0x80) || !(packet[3] & 0x10)) {
+		return 0;
+	}
+	if(packet[3] & 0x20) {
+		payload += 1 + packet[4];
+		if(payload >= end) {
+			return 0;
+		}
+	}
+	if(f->cc >= 0 && cc != ((f->cc + 1) & 0x0f)) {
+		if(cc == f->cc) {
+			return 0; // duplicate packet
+		}
+		f->fill = 0;
+	}
+	f->cc = cc;
+
+	if(packet[1] & 0x40) {
+		uint32_t pointer = *payload++;
+
+		if(payload + pointer > end) {
+			f->fill = 0;
+			return 0;
+		}
+		// tail of previous section is completed below, new one starts after pointer
+		if(f->fill > 0) {
+			memcpy(f->section + f->fill, payload, pointer);
+			f->fill += pointer;
+			if(f->fill >= 3) {
+				uint32_t length = (((f->section[1] & 0x0f) << 8) | f->section[2]) + 3;
+				if(length <= f->fill && dvbSimulator_sendSection(f, f->section, length) < 0) {
+					return -1;
+				}
+			}
+		}
+		payload += pointer;
+		f->fill = 0;
+	} else if(f->fill == 0) {
+		return 0; // wait for section start
+	}
+
+	memcpy(f->section + f->fill, payload, end - payload);
+	f->fill += end - payload;
+
+	while(f->fill >= 3) {
+		uint32_t length;
+
+		if(f->section[0] == 0xff) {
+			f->fill = 0;
+			break;
+		}
+		length = (((f->section[1] & 0x0f) << 8) | f->section[2]) + 3;
+		if(length > SIMULATOR_MAX_SECTION) {
+			f->fill = 0;
+			break;
+		}
+		if(length > f->fill) {
+			break;
+		}
+		switch(dvbSimulator_sendSection(f, f->section, length)) {
+			case -1: return -1;
+			case  1: sent++; break;
+			default: break;
+		}
+		f->fill -= length;
+		memmove(f->section, f->section + length, f->fill);
+	}
+	return sent;
+}
+
+static int32_t dvbSimulator_readerGone(int32_t fd)
+{
+	uint8_t dummy;
+	ssize_t ret = recv(fd, &dummy, sizeof(dummy), MSG_DONTWAIT | MSG_PEEK);
+
+	return ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+static void *dvbSimulator_filterThread(void *pArg)
+{
+	dvbSimulator_filter_t *f = pArg;
+	uint8_t *buffer;
+	FILE *file;
+
+	buffer = dmalloc(TS_PACKET_SIZE * SIMULATOR_READ_PACKETS);
+	file = fopen(f->filename, "rb");
+	if(buffer == NULL || file == NULL) {
+		eprintf("%s(): Failed to open %s: %m\n", __func__, f->filename);
+		goto exit;
+	}
+
+	for(;;) {
+		size_t count;
+		size_t i;
+
+		count = fread(buffer, TS_PACKET_SIZE, SIMULATOR_READ_PACKETS, file);
+		if(count == 0) {
+			if(dvbSimulator_readerGone(f->fd)) {
+				break;
+			}
+			usleep(SIMULATOR_PASS_DELAY_US);
+			rewind(file);
+			f->cc = -1;
+			f->fill = 0;
+			continue;
+		}
+		for(i = 0; i < count; i++) {
+			uint8_t *packet = buffer + i * TS_PACKET_SIZE;
+
+			if(packet[0] != TS_SYNC_BYTE) {
+				// lost sync, find next sync byte and realign file position
+				uint8_t *sync = memchr(packet + 1, TS_SYNC_BYTE, (count - i) * TS_PACKET_SIZE - 1);
+				long back = sync ? (long)(buffer + count * TS_PACKET_SIZE - sync) : 0;
+
+				fseek(file, -back, SEEK_CUR);
+				f->cc = -1;
+				f->fill = 0;
+				break;
+			}
+			if((((packet[1] & 0x1f) << 8) | packet[2]) != f->pid) {
+				continue;
+			}
+			if(dvbSimulator_processPacket(f, packet) < 0) {
+				goto exit;
+			}
+		}
+	}
+
+exit:
+	if(file) {
+		fclose(file);
+	}
+	dfree(buffer);
+	close(f->fd);
+	dfree(f);
+	return NULL;
+}
+
+int32_t dvbSimulator_sectionOpen(uint32_t adapter, int32_t pid, int32_t table_id)
+{
+	dvbSimulator_filter_t *f;
+	pthread_attr_t attr;
+	pthread_t thread;
+	uint32_t frequency;
+	int sockets[2];
+
+	if(adapter >= MAX_ADAPTER_SUPPORTED) {
+		return -1;
+	}
+	pthread_mutex_lock(&l_simulatorMutex);
+	frequency = l_simulatorFrequency[adapter];
+	pthread_mutex_unlock(&l_simulatorMutex);
+	if(frequency == 0) {
+		return -1;
+	}
+
+	f = dmalloc(sizeof(*f));
+	if(f == NULL) {
+		return -1;
+	}
+	memset(f, 0, sizeof(*f));
+	f->pid = pid;
+	f->table_id = table_id;
+	f->cc = -1;
+	dvbSimulator_getFilename(frequency, f->filename, sizeof(f->filename));
+
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) != 0) {
+		eprintf("%s(): socketpair failed: %m\n", __func__);
+		dfree(f);
+		return -1;
+	}
+	fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+	f->fd = sockets[1];
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&thread, &attr, dvbSimulator_filterThread, f) != 0) {
+		eprintf("%s(): Failed to start filter thread\n", __func__);
+		pthread_attr_destroy(&attr);
+		close(sockets[0]);
+		close(sockets[1]);
+		dfree(f);
+		return -1;
+	}
+	pthread_attr_destroy(&attr);
+
+	return sockets[0];
+}
+
+void dvbSimulator_sectionClose(int32_t fd)
+{
+	// filter thread notices closed peer on next send and exits
+	shutdown(fd, SHUT_RDWR);
+	close(fd);
+}
+
+#endif /* ENABLE_DVB && ENABLE_DVB_SIMULATOR */
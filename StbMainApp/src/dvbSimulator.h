@@ -0,0 +1,89 @@
+#if !defined(__DVB_SIMULATOR_H)
+#define __DVB_SIMULATOR_H
+
+/*
+ dvbSimulator.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file dvbSimulator.h Simulated DVB tuners backed by recorded transport streams
+ * Tuning a simulated adapter to frequency F succeeds if file
+ * DVB_SIMULATOR_DIR/F.ts exists. Section filters are served by a thread per
+ * filter, which loops over the file like a broadcast carousel and delivers
+ * complete sections through SOCK_SEQPACKET socket, one section per read
+ * as Linux DVB demux does.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include "defines.h"
+
+#include <stdint.h>
+
+#if (defined ENABLE_DVB) && (defined ENABLE_DVB_SIMULATOR)
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+/**
+ *  @brief Checks if recorded streams directory exists
+ */
+int32_t dvbSimulator_isAvailable(void);
+
+/**
+ *  @brief Switches adapter to stream recorded on frequency
+ *
+ *  @return 0 if stream exists, -1 otherwise
+ */
+int32_t dvbSimulator_tune(uint32_t adapter, uint32_t frequency);
+
+/**
+ *  @brief Returns 1 if adapter is tuned to existing stream
+ */
+int32_t dvbSimulator_hasLock(uint32_t adapter);
+
+/**
+ *  @brief Starts section filter on current stream of adapter
+ *
+ *  @param[in]  table_id  Table to pass, any if outside of [0; 0xff]
+ *
+ *  @return Non-blocking descriptor to read sections from, -1 on error
+ */
+int32_t dvbSimulator_sectionOpen(uint32_t adapter, int32_t pid, int32_t table_id);
+
+/**
+ *  @brief Stops section filter started by dvbSimulator_sectionOpen()
+ */
+void dvbSimulator_sectionClose(int32_t fd);
+
+#endif /* ENABLE_DVB && ENABLE_DVB_SIMULATOR */
+
+#endif /* __DVB_SIMULATOR_H      Do not add any thing below this line */
@@ -0,0 +1,706 @@
+/*
+ epgCache.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "epgCache.h"
+
+#include "debug.h"
+#include "crc32.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef ENABLE_DVB
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define EPG_CACHE_MAGIC         (0x43475045) /* "EPGC" */
+/* Increment on any change of record layout */
+#define EPG_CACHE_FORMAT        (1)
+#define EPG_CACHE_TMP_FILE_NAME EPG_CACHE_FILE_NAME ".tmp"
+
+/* Cache is compacted when dead records take more than live ones plus this slack */
+#define EPG_CACHE_COMPACT_SLACK (256*1024)
+/* Lifetime of sections without events */
+#define EPG_CACHE_EMPTY_TTL     (24*60*60)
+
+#define EIT_HEADER_LENGTH       (14)
+#define EIT_EVENT_LENGTH        (12)
+#define MJD_UNIX_EPOCH          (40587)
+
+#define BCD(x)                  ((((x) >> 4) & 0x0f) * 10 + ((x) & 0x0f))
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct {
+	uint32_t magic;
+	uint16_t format;
+	uint16_t mediaSize;   /**< sizeof(EIT_media_config_t) of the writer */
+} epgCacheHeader_t;
+
+/* Record is followed by EIT_media_config_t and section, padded to 4 bytes */
+typedef struct {
+	uint32_t length;      /**< Whole record length */
+	uint32_t expires;     /**< End of the last event in section */
+	uint32_t network_id;
+	uint16_t sectionLength;
+	uint16_t reserved;
+} epgCacheRecord_t;
+
+typedef struct {
+	uint32_t *live;       /**< Offsets of live records in file order */
+	uint32_t  liveCount;
+	uint32_t  liveSize;
+	uint32_t  validSize;  /**< Size of file up to the first broken record */
+	uint32_t  superseded;
+	uint32_t  expired;
+	time_t    now;        /**< Records expired by this time are not live */
+} epgCacheScan_t;
+
+/* Latest record of every section in cache file, keeps live size up to date
+ * while records are appended */
+typedef struct {
+	uint8_t  key[12];     /**< Section header up to original_network_id */
+	uint32_t length;      /**< Latest record length, 0 marks empty slot */
+	uint32_t expires;
+	uint32_t seq;         /**< Append number of the latest record, 0 if it was loaded */
+} epgCacheIndexEntry_t;
+
+/***********************************************
+* STATIC DATA                                  *
+************************************************/
+
+static pthread_mutex_t l_epgCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  l_epgCacheIdle  = PTHREAD_COND_INITIALIZER;
+static int             l_epgCacheFd = -1;
+static uint32_t        l_epgCacheFileSize = 0;
+static uint32_t        l_epgCacheLiveSize = 0;
+static int             l_epgCacheCompacting = 0;
+static uint32_t        l_epgCacheSeq = 0;
+static epgCacheIndexEntry_t *l_epgCacheIndex = NULL;
+static uint32_t        l_epgCacheIndexSize = 0;
+static uint32_t        l_epgCacheIndexCount = 0;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static inline uint32_t epgCache_sectionLength(const uint8_t *section)
+{
+	return (((section[1] & 0x0f) << 8) | section[2]) + 3;
+}
+
+static inline uint32_t epgCache_recordLength(uint32_t sectionLength)
+{
+	return (sizeof(epgCacheRecord_t) + sizeof(EIT_media_config_t) + sectionLength + 3) & ~3;
+}
+
+static time_t epgCache_sectionExpires(const uint8_t *section, uint32_t length)
+{
+	const uint8_t *event = section + EIT_HEADER_LENGTH;
+	const uint8_t *end = section + length - 4;
+	time_t expires = 0;
+
+	while(event + EIT_EVENT_LENGTH <= end) {
+		uint32_t mjd = (event[2] << 8) | event[3];
+		uint32_t descriptorsLength = ((event[10] & 0x0f) << 8) | event[11];
+
+		if(mjd != 0xffff && mjd > MJD_UNIX_EPOCH) {
+			time_t eventEnd = (time_t)(mjd - MJD_UNIX_EPOCH) * 24*60*60 +
+				BCD(event[4]) * 3600 + BCD(event[5]) * 60 + BCD(event[6]) +
+				BCD(event[7]) * 3600 + BCD(event[8]) * 60 + BCD(event[9]);
+			if(eventEnd > expires) {
+				expires = eventEnd;
+			}
+		}
+		event += EIT_EVENT_LENGTH + descriptorsLength;
+	}
+	if(expires == 0) {
+		expires = time(NULL) + EPG_CACHE_EMPTY_TTL;
+	}
+	return expires;
+}
+
+/* Section is identified by table_id, service_id, section_number,
+ * transport_stream_id and original_network_id */
+static inline uint32_t epgCache_sectionHash(const uint8_t *section)
+{
+	uint32_t hash = section[0];
+
+	hash = hash * 31 + ((section[3] << 8) | section[4]);
+	hash = hash * 31 + section[6];
+	hash = hash * 31 + ((section[8] << 8) | section[9]);
+	hash = hash * 31 + ((section[10] << 8) | section[11]);
+	return hash * 2654435761u;
+}
+
+static inline int32_t epgCache_sameSection(const uint8_t *a, const uint8_t *b)
+{
+	return a[0] == b[0] && a[3] == b[3] && a[4] == b[4] && a[6] == b[6] &&
+		memcmp(a + 8, b + 8, 4) == 0;
+}
+
+static epgCacheIndexEntry_t *epgCache_indexFindNB(epgCacheIndexEntry_t *table, uint32_t tableSize, const uint8_t *section)
+{
+	uint32_t i = epgCache_sectionHash(section) & (tableSize - 1);
+
+	while(table[i].length != 0 && !epgCache_sameSection(table[i].key, section)) {
+		i = (i + 1) & (tableSize - 1);
+	}
+	return &table[i];
+}
+
+/* Moves index to table of tableSize entries. If purge is set, sections which
+ * were latest in file compacted at purgeSeq and expired by now are dropped.
+ * Live size is recounted from the remaining entries. Called with mutex held */
+static int32_t epgCache_indexRehashNB(uint32_t tableSize, int32_t purge, uint32_t purgeSeq, time_t now)
+{
+	epgCacheIndexEntry_t *table;
+	uint32_t i;
+
+	table = dmalloc(tableSize * sizeof(*table));
+	if(table == NULL) {
+		eprintf("%s(): Failed to allocate %u entries\n", __func__, tableSize);
+		return -1;
+	}
+	memset(table, 0, tableSize * sizeof(*table));
+	l_epgCacheIndexCount = 0;
+	l_epgCacheLiveSize = 0;
+	for(i = 0; i < l_epgCacheIndexSize; i++) {
+		epgCacheIndexEntry_t *entry = &l_epgCacheIndex[i];
+
+		if(entry->length == 0 ||
+		   (purge && entry->seq <= purgeSeq && (time_t)entry->expires <= now))
+		{
+			continue;
+		}
+		*epgCache_indexFindNB(table, tableSize, entry->key) = *entry;
+		l_epgCacheIndexCount++;
+		l_epgCacheLiveSize += entry->length;
+	}
+	if(l_epgCacheIndex != NULL) {
+		dfree(l_epgCacheIndex);
+	}
+	l_epgCacheIndex = table;
+	l_epgCacheIndexSize = tableSize;
+	return 0;
+}
+
+/* Accounts record of section as the latest one. Called with mutex held */
+static void epgCache_indexUpdateNB(const uint8_t *section, uint32_t length, uint32_t expires, uint32_t seq)
+{
+	epgCacheIndexEntry_t *entry;
+
+	if(l_epgCacheIndexCount * 2 >= l_epgCacheIndexSize &&
+	   epgCache_indexRehashNB(l_epgCacheIndexSize ? l_epgCacheIndexSize * 2 : 256, 0, 0, 0) != 0)
+	{
+		return;
+	}
+	entry = epgCache_indexFindNB(l_epgCacheIndex, l_epgCacheIndexSize, section);
+	if(entry->length != 0) {
+		// Superseded record is dead now
+		l_epgCacheLiveSize -= entry->length;
+	} else {
+		memcpy(entry->key, section, sizeof(entry->key));
+		l_epgCacheIndexCount++;
+	}
+	entry->length = length;
+	entry->expires = expires;
+	entry->seq = seq;
+	l_epgCacheLiveSize += length;
+}
+
+/* Called with mutex held */
+static void epgCache_indexClearNB(void)
+{
+	if(l_epgCacheIndex != NULL) {
+		dfree(l_epgCacheIndex);
+		l_epgCacheIndex = NULL;
+	}
+	l_epgCacheIndexSize = 0;
+	l_epgCacheIndexCount = 0;
+	l_epgCacheLiveSize = 0;
+}
+
+static int32_t epgCache_getRecord(const uint8_t *map, uint32_t size, uint32_t offset, epgCacheRecord_t *record)
+{
+	const uint8_t *section;
+
+	if(offset + sizeof(*record) > size) {
+		return -1;
+	}
+	memcpy(record, map + offset, sizeof(*record));
+	if(record->sectionLength < EIT_HEADER_LENGTH + 4 ||
+	   record->sectionLength > EPG_CACHE_MAX_SECTION ||
+	   record->length != epgCache_recordLength(record->sectionLength) ||
+	   record->length > size - offset)
+	{
+		return -1;
+	}
+	section = map + offset + sizeof(*record) + sizeof(EIT_media_config_t);
+	if(epgCache_sectionLength(section) != record->sectionLength ||
+	   dvb_crc32(section, record->sectionLength) != 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static inline const uint8_t *epgCache_recordSection(const uint8_t *map, uint32_t offset)
+{
+	return map + offset + sizeof(epgCacheRecord_t) + sizeof(EIT_media_config_t);
+}
+
+static int epgCache_compareOffsets(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Finds the latest unexpired copy of every section */
+static int32_t epgCache_scan(const uint8_t *map, uint32_t size, epgCacheScan_t *scan)
+{
+	epgCacheRecord_t record;
+	uint32_t *table;
+	uint32_t tableSize = 16;
+	uint32_t count = 0;
+	uint32_t offset;
+	uint32_t i;
+
+	memset(scan, 0, sizeof(*scan));
+	scan->now = time(NULL);
+	scan->validSize = sizeof(epgCacheHeader_t);
+
+	for(offset = sizeof(epgCacheHeader_t); epgCache_getRecord(map, size, offset, &record) == 0; offset += record.length) {
+		count++;
+	}
+	scan->validSize = offset;
+	while(tableSize < count * 2) {
+		tableSize <<= 1;
+	}
+	table = dmalloc(tableSize * sizeof(uint32_t));
+	if(table == NULL) {
+		eprintf("%s(): Failed to allocate %u entries\n", __func__, tableSize);
+		return -1;
+	}
+	memset(table, 0, tableSize * sizeof(uint32_t));
+
+	// Later records replace earlier ones, offset 0 marks empty slot
+	for(offset = sizeof(epgCacheHeader_t); offset < scan->validSize; offset += record.length) {
+		const uint8_t *section = epgCache_recordSection(map, offset);
+
+		memcpy(&record, map + offset, sizeof(record));
+		i = epgCache_sectionHash(section) & (tableSize - 1);
+		while(table[i] != 0 && !epgCache_sameSection(epgCache_recordSection(map, table[i]), section)) {
+			i = (i + 1) & (tableSize - 1);
+		}
+		if(table[i] != 0) {
+			scan->superseded++;
+		}
+		table[i] = offset;
+	}
+
+	for(i = 0; i < tableSize; i++) {
+		if(table[i] == 0) {
+			continue;
+		}
+		memcpy(&record, map + table[i], sizeof(record));
+		if((time_t)record.expires <= scan->now) {
+			scan->expired++;
+			continue;
+		}
+		table[scan->liveCount++] = table[i];
+		scan->liveSize += record.length;
+	}
+	// Replay in file order, so older tables are parsed before newer ones
+	qsort(table, scan->liveCount, sizeof(uint32_t), epgCache_compareOffsets);
+	scan->live = table;
+	return 0;
+}
+
+static const uint8_t *epgCache_map(int fd, uint32_t *size)
+{
+	struct stat st;
+	epgCacheHeader_t header;
+	uint8_t *map;
+
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header)) {
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED) {
+		eprintf("%s(): mmap failed: %m\n", __func__);
+		return NULL;
+	}
+	memcpy(&header, map, sizeof(header));
+	if(header.magic != EPG_CACHE_MAGIC ||
+	   header.format != EPG_CACHE_FORMAT ||
+	   header.mediaSize != sizeof(EIT_media_config_t))
+	{
+		eprintf("%s(): Incompatible cache format %u\n", __func__, header.format);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	*size = st.st_size;
+	return map;
+}
+
+static int32_t epgCache_writeHeader(int fd)
+{
+	epgCacheHeader_t header;
+
+	header.magic = EPG_CACHE_MAGIC;
+	header.format = EPG_CACHE_FORMAT;
+	header.mediaSize = sizeof(EIT_media_config_t);
+	return write(fd, &header, sizeof(header)) == sizeof(header) ? 0 : -1;
+}
+
+/* Writes live records to temporary file, returns its descriptor or -1.
+ * Doesn't touch shared state, so it may be called without mutex. */
+static int epgCache_writeLive(const uint8_t *map, const epgCacheScan_t *scan)
+{
+	uint32_t i;
+	int fd;
+
+	fd = open(EPG_CACHE_TMP_FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		eprintf("%s(): Failed to create %s: %m\n", __func__, EPG_CACHE_TMP_FILE_NAME);
+		return -1;
+	}
+	if(epgCache_writeHeader(fd) != 0) {
+		goto failure;
+	}
+	for(i = 0; i < scan->liveCount; i++) {
+		epgCacheRecord_t record;
+
+		memcpy(&record, map + scan->live[i], sizeof(record));
+		if(write(fd, map + scan->live[i], record.length) != (ssize_t)record.length) {
+			goto failure;
+		}
+	}
+	fsync(fd);
+	return fd;
+
+failure:
+	eprintf("%s(): Failed to write %s: %m\n", __func__, EPG_CACHE_TMP_FILE_NAME);
+	close(fd);
+	unlink(EPG_CACHE_TMP_FILE_NAME);
+	return -1;
+}
+
+/* Replaces cache file with temporary one holding recordsSize bytes of records.
+ * Called with mutex held */
+static int32_t epgCache_replaceNB(int fd, uint32_t recordsSize)
+{
+	close(fd);
+	if(rename(EPG_CACHE_TMP_FILE_NAME, EPG_CACHE_FILE_NAME) != 0) {
+		eprintf("%s(): Failed to replace %s: %m\n", __func__, EPG_CACHE_FILE_NAME);
+		unlink(EPG_CACHE_TMP_FILE_NAME);
+		return -1;
+	}
+	if(l_epgCacheFd >= 0) {
+		close(l_epgCacheFd);
+		l_epgCacheFd = -1;
+	}
+	l_epgCacheFileSize = sizeof(epgCacheHeader_t) + recordsSize;
+	dprintf("%s(): %u bytes\n", __func__, l_epgCacheFileSize);
+	return 0;
+}
+
+/* Rewrites cache file with live records only. Called with mutex held */
+static int32_t epgCache_compactNB(const uint8_t *map, const epgCacheScan_t *scan)
+{
+	int fd = epgCache_writeLive(map, scan);
+
+	if(fd < 0) {
+		return -1;
+	}
+	return epgCache_replaceNB(fd, scan->liveSize);
+}
+
+static inline int32_t epgCache_needCompact(uint32_t fileSize, uint32_t liveSize)
+{
+	return fileSize > 2 * liveSize + EPG_CACHE_COMPACT_SLACK;
+}
+
+int32_t epgCache_load(epgCacheReplay_t replay)
+{
+	struct timespec started;
+	struct timespec finished;
+	const uint8_t *map;
+	uint32_t size = 0;
+	epgCacheScan_t scan;
+	uint32_t hits = 0;
+	uint32_t i;
+	int fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	pthread_mutex_lock(&l_epgCacheMutex);
+
+	fd = open(EPG_CACHE_FILE_NAME, O_RDONLY);
+	if(fd < 0) {
+		pthread_mutex_unlock(&l_epgCacheMutex);
+		eprintf("%s(): No EPG cache\n", __func__);
+		return -1;
+	}
+	map = epgCache_map(fd, &size);
+	close(fd);
+	if(map == NULL) {
+		unlink(EPG_CACHE_FILE_NAME);
+		pthread_mutex_unlock(&l_epgCacheMutex);
+		return -1;
+	}
+	if(epgCache_scan(map, size, &scan) != 0) {
+		munmap((void *)map, size);
+		pthread_mutex_unlock(&l_epgCacheMutex);
+		return -1;
+	}
+
+	epgCache_indexClearNB();
+	for(i = 0; i < scan.liveCount; i++) {
+		epgCacheRecord_t record;
+		EIT_media_config_t media;
+		const uint8_t *data = map + scan.live[i];
+
+		memcpy(&record, data, sizeof(record));
+		memcpy(&media, data + sizeof(record), sizeof(media));
+		epgCache_indexUpdateNB(data + sizeof(record) + sizeof(media), record.length, record.expires, 0);
+		hits += replay((uint8_t *)data + sizeof(record) + sizeof(media), record.network_id, &media) > 0;
+	}
+
+	l_epgCacheFileSize = size;
+	if(scan.validSize < size) {
+		eprintf("%s(): Dropping %u bytes of broken records\n", __func__, size - scan.validSize);
+	}
+	if(scan.validSize < size || epgCache_needCompact(size, scan.liveSize)) {
+		epgCache_compactNB(map, &scan);
+	}
+	dfree(scan.live);
+	munmap((void *)map, size);
+	pthread_mutex_unlock(&l_epgCacheMutex);
+
+	clock_gettime(CLOCK_MONOTONIC, &finished);
+	eprintf("%s(): %u sections in %u bytes: %u hit, %u miss, %u expired, %u superseded, loaded in %lu ms\n", __func__,
+		scan.liveCount, size, hits, scan.liveCount - hits, scan.expired, scan.superseded,
+		(finished.tv_sec - started.tv_sec) * 1000 + (finished.tv_nsec - started.tv_nsec) / 1000000);
+	return scan.liveCount;
+}
+
+/* Copies records appended to cache file since offset to the end of tmp file */
+static int32_t epgCache_copyTail(int from, uint32_t offset, uint32_t end, int tmp)
+{
+	uint8_t buffer[EPG_CACHE_MAX_SECTION];
+	ssize_t length;
+
+	while(offset < end) {
+		length = pread(from, buffer, end - offset < sizeof(buffer) ? end - offset : sizeof(buffer), offset);
+		if(length <= 0 || write(tmp, buffer, length) != length) {
+			return -1;
+		}
+		offset += length;
+	}
+	return 0;
+}
+
+/* Compaction runs in background, so that section parsing is not blocked on
+ * flash I/O. The file is scanned and live records are written without mutex,
+ * mutex is only taken to append records stored meanwhile and replace the file. */
+static void *epgCache_compactThread(void *pArg)
+{
+	const uint8_t *map = NULL;
+	uint32_t mapSize = 0;
+	uint32_t size, seq, liveSize = 0;
+	epgCacheScan_t scan;
+	int fd, tmp = -1;
+
+	pthread_mutex_lock(&l_epgCacheMutex);
+	size = l_epgCacheFileSize;
+	seq = l_epgCacheSeq;
+	pthread_mutex_unlock(&l_epgCacheMutex);
+
+	fd = open(EPG_CACHE_FILE_NAME, O_RDONLY);
+	if(fd >= 0) {
+		map = epgCache_map(fd, &mapSize);
+	}
+	if(map != NULL && mapSize >= size) {
+		if(epgCache_scan(map, size, &scan) == 0) {
+			tmp = epgCache_writeLive(map, &scan);
+			liveSize = scan.liveSize;
+			dfree(scan.live);
+		}
+	}
+	if(map != NULL) {
+		munmap((void *)map, mapSize);
+	}
+
+	pthread_mutex_lock(&l_epgCacheMutex);
+	if(tmp >= 0) {
+		uint32_t tail = l_epgCacheFileSize - size;
+
+		if(epgCache_copyTail(fd, size, l_epgCacheFileSize, tmp) == 0) {
+			if(epgCache_replaceNB(tmp, liveSize + tail) == 0) {
+				// Forget sections dropped as expired, appended ones are all kept
+				if(l_epgCacheIndexSize != 0) {
+					epgCache_indexRehashNB(l_epgCacheIndexSize, 1, seq, scan.now);
+				}
+			}
+		} else {
+			eprintf("%s(): Failed to copy %u new bytes: %m\n", __func__, tail);
+			close(tmp);
+			unlink(EPG_CACHE_TMP_FILE_NAME);
+		}
+	}
+	if(fd >= 0) {
+		close(fd);
+	}
+	l_epgCacheCompacting = 0;
+	pthread_cond_broadcast(&l_epgCacheIdle);
+	pthread_mutex_unlock(&l_epgCacheMutex);
+	return NULL;
+}
+
+/* Called with mutex held */
+static void epgCache_startCompactNB(void)
+{
+	pthread_t thread;
+	int err;
+
+	err = pthread_create(&thread, NULL, epgCache_compactThread, NULL);
+	if(err != 0) {
+		eprintf("%s(): Failed to create thread: %s\n", __func__, strerror(err));
+		return;
+	}
+	pthread_detach(thread);
+	l_epgCacheCompacting = 1;
+}
+
+void epgCache_prepare(epgCacheBuffer_t *buffer, const uint8_t *section, uint32_t network_id, const EIT_media_config_t *media)
+{
+	epgCacheRecord_t record;
+
+	buffer->length = 0;
+	record.sectionLength = epgCache_sectionLength(section);
+	if(record.sectionLength < EIT_HEADER_LENGTH + 4 || record.sectionLength > EPG_CACHE_MAX_SECTION) {
+		return;
+	}
+	record.length = epgCache_recordLength(record.sectionLength);
+	if(record.length > sizeof(buffer->data)) {
+		return;
+	}
+	record.network_id = network_id;
+	record.reserved = 0;
+	record.expires = epgCache_sectionExpires(section, record.sectionLength);
+
+	memset(buffer->data, 0, record.length);
+	memcpy(buffer->data, &record, sizeof(record));
+	memcpy(buffer->data + sizeof(record), media, sizeof(*media));
+	memcpy(buffer->data + sizeof(record) + sizeof(*media), section, record.sectionLength);
+	buffer->length = record.length;
+}
+
+void epgCache_append(const epgCacheBuffer_t *buffer)
+{
+	epgCacheRecord_t record;
+
+	if(buffer->length == 0) {
+		return;
+	}
+	memcpy(&record, buffer->data, sizeof(record));
+
+	pthread_mutex_lock(&l_epgCacheMutex);
+	if(l_epgCacheFd < 0) {
+		struct stat st;
+
+		l_epgCacheFd = open(EPG_CACHE_FILE_NAME, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if(l_epgCacheFd < 0) {
+			eprintf("%s(): Failed to open %s: %m\n", __func__, EPG_CACHE_FILE_NAME);
+			pthread_mutex_unlock(&l_epgCacheMutex);
+			return;
+		}
+		if(fstat(l_epgCacheFd, &st) != 0 || st.st_size < (off_t)sizeof(epgCacheHeader_t)) {
+			if(ftruncate(l_epgCacheFd, 0) != 0 || epgCache_writeHeader(l_epgCacheFd) != 0) {
+				eprintf("%s(): Failed to init %s: %m\n", __func__, EPG_CACHE_FILE_NAME);
+				close(l_epgCacheFd);
+				l_epgCacheFd = -1;
+				pthread_mutex_unlock(&l_epgCacheMutex);
+				return;
+			}
+			st.st_size = sizeof(epgCacheHeader_t);
+			epgCache_indexClearNB();
+		}
+		l_epgCacheFileSize = st.st_size;
+	}
+	if(write(l_epgCacheFd, buffer->data, record.length) != (ssize_t)record.length) {
+		eprintf("%s(): Failed to write %s: %m\n", __func__, EPG_CACHE_FILE_NAME);
+		// Don't leave partial record, it would hide all following ones
+		if(ftruncate(l_epgCacheFd, l_epgCacheFileSize) != 0) {
+			close(l_epgCacheFd);
+			l_epgCacheFd = -1;
+		}
+	} else {
+		l_epgCacheFileSize += record.length;
+		epgCache_indexUpdateNB(buffer->data + sizeof(record) + sizeof(EIT_media_config_t),
+			record.length, record.expires, ++l_epgCacheSeq);
+	}
+	if(!l_epgCacheCompacting && epgCache_needCompact(l_epgCacheFileSize, l_epgCacheLiveSize)) {
+		epgCache_startCompactNB();
+	}
+	pthread_mutex_unlock(&l_epgCacheMutex);
+}
+
+void epgCache_terminate(void)
+{
+	pthread_mutex_lock(&l_epgCacheMutex);
+	while(l_epgCacheCompacting) {
+		pthread_cond_wait(&l_epgCacheIdle, &l_epgCacheMutex);
+	}
+	if(l_epgCacheFd >= 0) {
+		close(l_epgCacheFd);
+		l_epgCacheFd = -1;
+	}
+	epgCache_indexClearNB();
+	pthread_mutex_unlock(&l_epgCacheMutex);
+}
+
+#endif /* ENABLE_DVB */
@@ -0,0 +1,122 @@
+#if !defined(__EPG_CACHE_H)
+#define __EPG_CACHE_H
+
+/*
+ epgCache.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file epgCache.h Persistent cache of DVB EIT sections
+ * Raw EIT sections are appended to a versioned log file when their table
+ * version changes. On startup the file is memory-mapped, the latest unexpired
+ * copy of every section is replayed into service schedules, so EPG is
+ * available before EIT is received from the air.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include "defines.h"
+#include "dvb.h"
+
+#include <stdint.h>
+
+#ifdef ENABLE_DVB
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Longest EIT section accepted by cache */
+#define EPG_CACHE_MAX_SECTION   (4096)
+/** Room for record header, tuning parameters and padded section */
+#define EPG_CACHE_MAX_RECORD    (16 + sizeof(EIT_media_config_t) + EPG_CACHE_MAX_SECTION + 4)
+
+/*******************
+* EXPORTED TYPEDEFS *
+********************/
+
+/** Section serialized by epgCache_prepare() */
+typedef struct {
+	uint32_t length;      /**< Record length, 0 if section is not cached */
+	uint8_t  data[EPG_CACHE_MAX_RECORD];
+} epgCacheBuffer_t;
+
+/**
+ *  @brief Called for every live cached section during epgCache_load()
+ *
+ *  @return 1 if section was accounted to a known service, 0 otherwise
+ */
+typedef int32_t (*epgCacheReplay_t)(uint8_t *section, uint32_t network_id, EIT_media_config_t *media);
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+/**
+ *  @brief Replays cache file through replay callback
+ *
+ *  Superseded and expired sections are skipped. If the file contains
+ *  mostly dead records, it is compacted.
+ *
+ *  @return Number of replayed sections or -1 if cache is missing or invalid
+ */
+int32_t epgCache_load(epgCacheReplay_t replay);
+
+/**
+ *  @brief Serializes EIT section into cache record
+ *
+ *  Doesn't touch the file, so it may be called while section buffer is
+ *  locked, and record is appended by epgCache_append() after unlocking.
+ *
+ *  @param[out] buffer      Record, its length is 0 if section is not cached
+ *  @param[in]  section     Complete EIT section starting from table_id
+ *  @param[in]  network_id  Network the section was received from
+ *  @param[in]  media       Tuning parameters of the transport stream
+ */
+void epgCache_prepare(epgCacheBuffer_t *buffer, const uint8_t *section, uint32_t network_id, const EIT_media_config_t *media);
+
+/**
+ *  @brief Appends record prepared by epgCache_prepare() to cache file
+ *
+ *  Should be called only when section brings new table version.
+ *  When the file grows too large, it is compacted by a background thread.
+ */
+void epgCache_append(const epgCacheBuffer_t *buffer);
+
+/**
+ *  @brief Closes cache file
+ *
+ *  Waits for background compaction to finish.
+ */
+void epgCache_terminate(void);
+
+#endif /* ENABLE_DVB */
+
+#endif /* __EPG_CACHE_H      Do not add any thing below this line */
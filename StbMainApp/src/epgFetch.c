@@ -0,0 +1,574 @@
+/*
+ epgFetch.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "epgFetch.h"
+
+#include "debug.h"
+#include "md5.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define EPG_FETCH_CACHE_MAGIC     "EPGF1\n"
+#define EPG_FETCH_VALIDATOR_SIZE  (128)
+#define EPG_FETCH_CONNECT_TIMEOUT (5)
+#define EPG_FETCH_TIMEOUT         (15)
+/* Longest wait between checks of abort flag */
+#define EPG_FETCH_POLL_MS         (100)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct epgFetchRequest_s
+{
+	struct epgFetchRequest_s *next;
+	epgFetchCallback callback;
+	void            *pArg;
+	int              flags;
+	char            *url;         /**< Stored after request */
+} epgFetchRequest_t;
+
+typedef struct
+{
+	CURL              *curl;
+	epgFetch_t        *fetch;
+	epgFetchRequest_t *request;     /**< NULL if slot is idle */
+	struct curl_slist *headers;     /**< Fetcher headers plus conditions of this request */
+	char              *body;
+	size_t             size;
+	char               etag[EPG_FETCH_VALIDATOR_SIZE];
+	char               lastModified[EPG_FETCH_VALIDATOR_SIZE];
+	char               error[CURL_ERROR_SIZE];
+} epgFetchSlot_t;
+
+struct epgFetch_s
+{
+	CURLM             *multi;
+	epgFetchSlot_t    *slots;
+	int                slotCount;
+	int                active;
+	size_t             maxSize;
+	char              *cacheDir;
+	struct curl_slist *headers;
+	epgFetchRequest_t *head;
+	epgFetchRequest_t *tail;
+	epgFetchStats_t    stats;
+};
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static unsigned int epgFetch_getTimeMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static void epgFetch_cachePath(epgFetch_t *fetch, const char *url, char *path, size_t size)
+{
+	unsigned char digest[16];
+	char name[2*sizeof(digest)+1];
+	size_t i;
+
+	md5((const unsigned char*)url, strlen(url), digest);
+	for (i = 0; i < sizeof(digest); i++)
+		sprintf(&name[2*i], "%02x", digest[i]);
+	snprintf(path, size, "%s/%s", fetch->cacheDir, name);
+}
+
+/** Reads validators of cached response and leaves file positioned at body
+ *  @return Opened cache file or NULL
+ */
+static FILE *epgFetch_cacheOpen(const char *path, char *etag, char *lastModified)
+{
+	char line[EPG_FETCH_VALIDATOR_SIZE+16];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return NULL;
+	etag[0] = lastModified[0] = 0;
+	if (fgets(line, sizeof(line), f) == NULL || strcmp(line, EPG_FETCH_CACHE_MAGIC) != 0)
+		goto failure;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == 0)
+			return f;
+		if (strncmp(line, "ETag: ", 6) == 0)
+			snprintf(etag, EPG_FETCH_VALIDATOR_SIZE, "%s", line+6);
+		else if (strncmp(line, "Last-Modified: ", 15) == 0)
+			snprintf(lastModified, EPG_FETCH_VALIDATOR_SIZE, "%s", line+15);
+	}
+failure:
+	fclose(f);
+	return NULL;
+}
+
+static int epgFetch_cacheLoad(epgFetchSlot_t *slot)
+{
+	char path[PATH_MAX];
+	char etag[EPG_FETCH_VALIDATOR_SIZE];
+	char lastModified[EPG_FETCH_VALIDATOR_SIZE];
+	FILE *f;
+
+	epgFetch_cachePath(slot->fetch, slot->request->url, path, sizeof(path));
+	f = epgFetch_cacheOpen(path, etag, lastModified);
+	if (f == NULL)
+		return -1;
+	slot->size = fread(slot->body, 1, slot->fetch->maxSize, f);
+	slot->body[slot->size] = 0;
+	fclose(f);
+	return 0;
+}
+
+static void epgFetch_cacheStore(epgFetchSlot_t *slot)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX+4];
+	FILE *f;
+
+	epgFetch_cachePath(slot->fetch, slot->request->url, path, sizeof(path));
+	if (slot->etag[0] == 0 && slot->lastModified[0] == 0)
+	{
+		// Can't be validated, don't let old copy be used
+		unlink(path);
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (f == NULL)
+	{
+		eprintf("%s: failed to create %s: %m\n", __FUNCTION__, tmp);
+		return;
+	}
+	fputs(EPG_FETCH_CACHE_MAGIC, f);
+	if (slot->etag[0])
+		fprintf(f, "ETag: %s\n", slot->etag);
+	if (slot->lastModified[0])
+		fprintf(f, "Last-Modified: %s\n", slot->lastModified);
+	fputc('\n', f);
+	fwrite(slot->body, 1, slot->size, f);
+	if (fclose(f) != 0 || rename(tmp, path) != 0)
+	{
+		eprintf("%s: failed to write %s: %m\n", __FUNCTION__, path);
+		unlink(tmp);
+	}
+}
+
+static size_t epgFetch_writeCallback(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+	epgFetchSlot_t *slot = userp;
+	size_t length = size*nmemb;
+
+	if (slot->size + length > slot->fetch->maxSize)
+	{
+		eprintf("%s: %s is longer than %u bytes\n", __FUNCTION__, slot->request->url, (unsigned)slot->fetch->maxSize);
+		return 0;
+	}
+	memcpy(&slot->body[slot->size], buffer, length);
+	slot->size += length;
+	return length;
+}
+
+static void epgFetch_getValidator(const char *line, size_t length, const char *name, char *value)
+{
+	size_t nameLength = strlen(name);
+
+	if (length <= nameLength || strncasecmp(line, name, nameLength) != 0)
+		return;
+	line += nameLength;
+	length -= nameLength;
+	while (length > 0 && (*line == ' ' || *line == '\t'))
+	{
+		line++;
+		length--;
+	}
+	while (length > 0 && (unsigned char)line[length-1] <= ' ')
+		length--;
+	if (length >= EPG_FETCH_VALIDATOR_SIZE)
+		return;
+	memcpy(value, line, length);
+	value[length] = 0;
+}
+
+static size_t epgFetch_headerCallback(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+	epgFetchSlot_t *slot = userp;
+	const char *line = buffer;
+	size_t length = size*nmemb;
+
+	if (length > 5 && strncmp(line, "HTTP/", 5) == 0)
+	{
+		// Status line of next response, e.g. after redirect
+		slot->etag[0] = slot->lastModified[0] = 0;
+		slot->size = 0;
+	}
+	epgFetch_getValidator(line, length, "ETag:", slot->etag);
+	epgFetch_getValidator(line, length, "Last-Modified:", slot->lastModified);
+	return length;
+}
+
+epgFetch_t *epgFetch_create(int maxParallel, size_t maxSize, const char *cacheDir)
+{
+	epgFetch_t *fetch;
+	epgFetchSlot_t *slot;
+	int i;
+
+	if (maxParallel < 1)
+		maxParallel = 1;
+	fetch = dmalloc(sizeof(epgFetch_t));
+	if (fetch == NULL)
+		return NULL;
+	memset(fetch, 0, sizeof(epgFetch_t));
+	fetch->maxSize = maxSize;
+	fetch->slots = dmalloc(maxParallel*sizeof(epgFetchSlot_t));
+	fetch->multi = curl_multi_init();
+	if (fetch->slots == NULL || fetch->multi == NULL)
+		goto failure;
+	memset(fetch->slots, 0, maxParallel*sizeof(epgFetchSlot_t));
+	if (cacheDir != NULL)
+	{
+		if (mkdir(cacheDir, 0755) != 0 && errno != EEXIST)
+			eprintf("%s: failed to create %s: %m\n", __FUNCTION__, cacheDir);
+		else
+			fetch->cacheDir = strdup(cacheDir);
+	}
+#if LIBCURL_VERSION_NUM >= 0x071000 && LIBCURL_VERSION_NUM < 0x073e00
+	// HTTP/1.1 pipelining was dropped in 7.62, later versions still reuse kept-alive connections
+	curl_multi_setopt(fetch->multi, CURLMOPT_PIPELINING, 1L);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071003
+	curl_multi_setopt(fetch->multi, CURLMOPT_MAXCONNECTS, (long)maxParallel);
+#endif
+
+	for (i = 0; i < maxParallel; i++)
+	{
+		slot = &fetch->slots[i];
+		slot->fetch = fetch;
+		slot->body = dmalloc(maxSize+1);
+		slot->curl = curl_easy_init();
+		fetch->slotCount++;
+		if (slot->body == NULL || slot->curl == NULL)
+			goto failure;
+		curl_easy_setopt(slot->curl, CURLOPT_WRITEFUNCTION, epgFetch_writeCallback);
+		curl_easy_setopt(slot->curl, CURLOPT_WRITEDATA, slot);
+		curl_easy_setopt(slot->curl, CURLOPT_HEADERFUNCTION, epgFetch_headerCallback);
+		curl_easy_setopt(slot->curl, CURLOPT_HEADERDATA, slot);
+		curl_easy_setopt(slot->curl, CURLOPT_ERRORBUFFER, slot->error);
+		curl_easy_setopt(slot->curl, CURLOPT_CONNECTTIMEOUT, EPG_FETCH_CONNECT_TIMEOUT);
+		curl_easy_setopt(slot->curl, CURLOPT_TIMEOUT, EPG_FETCH_TIMEOUT);
+		curl_easy_setopt(slot->curl, CURLOPT_PROXY, "");
+		curl_easy_setopt(slot->curl, CURLOPT_NOSIGNAL, 1L);
+	}
+	return fetch;
+
+failure:
+	eprintf("%s: out of memory\n", __FUNCTION__);
+	epgFetch_destroy(fetch);
+	return NULL;
+}
+
+void epgFetch_setHeaders(epgFetch_t *fetch, struct curl_slist *headers)
+{
+	fetch->headers = headers;
+}
+
+int epgFetch_add(epgFetch_t *fetch, const char *url, int flags, epgFetchCallback callback, void *pArg)
+{
+	epgFetchRequest_t *request;
+	size_t length = strlen(url)+1;
+
+	request = dmalloc(sizeof(epgFetchRequest_t) + length);
+	if (request == NULL)
+		return -1;
+	request->next     = NULL;
+	request->callback = callback;
+	request->pArg     = pArg;
+	request->flags    = flags;
+	request->url      = (char*)(request+1);
+	memcpy(request->url, url, length);
+
+	if (fetch->tail)
+		fetch->tail->next = request;
+	else
+		fetch->head = request;
+	fetch->tail = request;
+	return 0;
+}
+
+/** @return 0 if request was started, -1 if it was dropped */
+static int epgFetch_start(epgFetch_t *fetch, epgFetchSlot_t *slot)
+{
+	char path[PATH_MAX];
+	char header[EPG_FETCH_VALIDATOR_SIZE+32];
+	struct curl_slist *item;
+	FILE *f = NULL;
+
+	slot->request = fetch->head;
+	fetch->head = slot->request->next;
+	if (fetch->head == NULL)
+		fetch->tail = NULL;
+
+	if (fetch->cacheDir != NULL)
+	{
+		epgFetch_cachePath(fetch, slot->request->url, path, sizeof(path));
+		f = epgFetch_cacheOpen(path, slot->etag, slot->lastModified);
+	}
+	if (f == NULL && (slot->request->flags & EPG_FETCH_REVALIDATE))
+	{
+		dfree(slot->request);
+		slot->request = NULL;
+		return -1;
+	}
+
+	for (item = fetch->headers; item != NULL; item = item->next)
+		slot->headers = curl_slist_append(slot->headers, item->data);
+	if (f != NULL)
+	{
+		fclose(f);
+		if (slot->etag[0])
+		{
+			snprintf(header, sizeof(header), "If-None-Match: %s", slot->etag);
+			slot->headers = curl_slist_append(slot->headers, header);
+		}
+		if (slot->lastModified[0])
+		{
+			snprintf(header, sizeof(header), "If-Modified-Since: %s", slot->lastModified);
+			slot->headers = curl_slist_append(slot->headers, header);
+		}
+	}
+	slot->etag[0] = slot->lastModified[0] = 0;
+	slot->size = 0;
+	slot->error[0] = 0;
+
+	curl_easy_setopt(slot->curl, CURLOPT_URL, slot->request->url);
+	curl_easy_setopt(slot->curl, CURLOPT_HTTPHEADER, slot->headers);
+	curl_multi_add_handle(fetch->multi, slot->curl);
+	fetch->active++;
+	fetch->stats.requests++;
+	return 0;
+}
+
+static void epgFetch_release(epgFetch_t *fetch, epgFetchSlot_t *slot)
+{
+	curl_multi_remove_handle(fetch->multi, slot->curl);
+	curl_slist_free_all(slot->headers);
+	slot->headers = NULL;
+	dfree(slot->request);
+	slot->request = NULL;
+	fetch->active--;
+}
+
+static void epgFetch_finish(epgFetch_t *fetch, epgFetchSlot_t *slot, CURLcode result)
+{
+	epgFetchStatus_t status = EPG_FETCH_FAILED;
+	epgFetchRequest_t *request = slot->request;
+	long code = 0;
+	long connects = 0;
+	char *body = NULL;
+
+	curl_easy_getinfo(slot->curl, CURLINFO_NUM_CONNECTS, &connects);
+	fetch->stats.connects += connects;
+	if (result == CURLE_OK)
+	{
+		curl_easy_getinfo(slot->curl, CURLINFO_RESPONSE_CODE, &code);
+		fetch->stats.downloaded += slot->size;
+		if (code == 200)
+		{
+			status = EPG_FETCH_OK;
+			body = slot->body;
+			body[slot->size] = 0;
+			if (fetch->cacheDir)
+				epgFetch_cacheStore(slot);
+		} else
+		if (code == 304)
+		{
+			status = EPG_FETCH_NOT_MODIFIED;
+			fetch->stats.notModified++;
+			if (request->flags & EPG_FETCH_CACHED_BODY)
+			{
+				if (epgFetch_cacheLoad(slot) == 0)
+					body = slot->body;
+				else
+					status = EPG_FETCH_FAILED;
+			}
+		} else
+			eprintf("%s: %s returned %ld\n", __FUNCTION__, request->url, code);
+	} else
+		eprintf("%s: failed to get %s: %s\n", __FUNCTION__, request->url,
+			slot->error[0] ? slot->error : curl_easy_strerror(result));
+
+	if (status == EPG_FETCH_FAILED)
+	{
+		fetch->stats.failed++;
+		body = NULL;
+	}
+	request->callback(request->pArg, status, body, body ? slot->size : 0);
+	epgFetch_release(fetch, slot);
+}
+
+static int epgFetch_readMessages(epgFetch_t *fetch)
+{
+	CURLMsg *msg;
+	int left;
+	int i;
+	int finished = 0;
+
+	while ((msg = curl_multi_info_read(fetch->multi, &left)) != NULL)
+	{
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+		for (i = 0; i < fetch->slotCount; i++)
+		{
+			if (fetch->slots[i].curl == msg->easy_handle && fetch->slots[i].request != NULL)
+			{
+				epgFetch_finish(fetch, &fetch->slots[i], msg->data.result);
+				finished++;
+				break;
+			}
+		}
+	}
+	return finished;
+}
+
+static void epgFetch_wait(epgFetch_t *fetch)
+{
+	fd_set rfds, wfds, efds;
+	struct timeval tv;
+	long timeout = -1;
+	int maxfd = -1;
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_ZERO(&efds);
+	curl_multi_fdset(fetch->multi, &rfds, &wfds, &efds, &maxfd);
+	curl_multi_timeout(fetch->multi, &timeout);
+	if (timeout < 0 || timeout > EPG_FETCH_POLL_MS)
+		timeout = EPG_FETCH_POLL_MS;
+	tv.tv_sec  = 0;
+	tv.tv_usec = timeout*1000;
+	if (maxfd < 0)
+	{
+		// Resolving or waiting for retry, nothing to select on yet
+		if (timeout > 0)
+			usleep(timeout*1000);
+		return;
+	}
+	select(maxfd+1, &rfds, &wfds, &efds, &tv);
+}
+
+int epgFetch_run(epgFetch_t *fetch, const volatile int *running, epgFetchStats_t *stats)
+{
+	epgFetchRequest_t *request;
+	int still;
+	int i;
+
+	memset(&fetch->stats, 0, sizeof(fetch->stats));
+	fetch->stats.timeMs = epgFetch_getTimeMs();
+
+	for (;;)
+	{
+		for (i = 0; i < fetch->slotCount && fetch->head != NULL; i++)
+		{
+			while (fetch->slots[i].request == NULL && fetch->head != NULL &&
+			       epgFetch_start(fetch, &fetch->slots[i]) != 0);
+		}
+		if (fetch->active == 0 || (running != NULL && *running == 0))
+			break;
+
+		while (curl_multi_perform(fetch->multi, &still) == CURLM_CALL_MULTI_PERFORM);
+		if (epgFetch_readMessages(fetch) == 0)
+			epgFetch_wait(fetch);
+	}
+
+	for (i = 0; i < fetch->slotCount; i++)
+	{
+		if (fetch->slots[i].request != NULL)
+			epgFetch_release(fetch, &fetch->slots[i]);
+	}
+	while ((request = fetch->head) != NULL)
+	{
+		fetch->head = request->next;
+		dfree(request);
+	}
+	fetch->tail = NULL;
+
+	fetch->stats.timeMs = epgFetch_getTimeMs() - fetch->stats.timeMs;
+	if (stats)
+		*stats = fetch->stats;
+	return fetch->stats.failed;
+}
+
+void epgFetch_destroy(epgFetch_t *fetch)
+{
+	epgFetchRequest_t *request;
+	int i;
+
+	if (fetch == NULL)
+		return;
+	for (i = 0; i < fetch->slotCount; i++)
+	{
+		if (fetch->slots[i].request != NULL)
+			epgFetch_release(fetch, &fetch->slots[i]);
+		if (fetch->slots[i].curl)
+			curl_easy_cleanup(fetch->slots[i].curl);
+		dfree(fetch->slots[i].body);
+	}
+	while ((request = fetch->head) != NULL)
+	{
+		fetch->head = request->next;
+		dfree(request);
+	}
+	if (fetch->multi)
+		curl_multi_cleanup(fetch->multi);
+	dfree(fetch->slots);
+	free(fetch->cacheDir);
+	dfree(fetch);
+}
@@ -0,0 +1,137 @@
+#if !defined(__EPG_FETCH_H)
+#define __EPG_FETCH_H
+
+/*
+ epgFetch.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file epgFetch.h Concurrent HTTP fetcher for IPTV EPG schedules
+ * Requests are run on a single curl multi handle, at most maxParallel at a
+ * time. Easy handles and the multi handle live as long as the fetcher, so
+ * keep-alive connections to the EPG server are reused between updates.
+ *
+ * Responses which carry ETag or Last-Modified are stored in a cache
+ * directory, one file per URL. Next requests for the URL are conditional,
+ * and 304 Not Modified is reported as EPG_FETCH_NOT_MODIFIED, so the caller
+ * may keep the schedule it parsed before.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stddef.h>
+#include <curl/curl.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Flags for epgFetch_add */
+#define EPG_FETCH_CACHED_BODY (0x01) /**< Deliver cached body with EPG_FETCH_NOT_MODIFIED */
+#define EPG_FETCH_REVALIDATE  (0x02) /**< Only check cached response, request is dropped without callback if nothing is cached */
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct epgFetch_s epgFetch_t;
+
+typedef enum
+{
+	EPG_FETCH_FAILED = -1,
+	EPG_FETCH_OK = 0,
+	EPG_FETCH_NOT_MODIFIED,
+} epgFetchStatus_t;
+
+/**
+ *  @brief Called from epgFetch_run for each finished request
+ *
+ *  Body is NUL terminated and may be modified in place. It is NULL if request
+ *  failed, or if it was not modified and EPG_FETCH_CACHED_BODY was not set.
+ */
+typedef void (*epgFetchCallback)(void *pArg, epgFetchStatus_t status, char *body, size_t size);
+
+typedef struct
+{
+	unsigned int   requests;
+	unsigned int   notModified;
+	unsigned int   failed;
+	unsigned int   connects;     /**< New connections, the rest reused kept-alive ones */
+	size_t         downloaded;   /**< Body bytes received */
+	unsigned int   timeMs;
+} epgFetchStats_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @param[in]  maxParallel  Number of simultaneous requests
+ *  @param[in]  maxSize      Responses are truncated to this size
+ *  @param[in]  cacheDir     Directory of response cache, NULL to disable cache
+ *
+ *  @return Fetcher handle, NULL on failure
+ */
+epgFetch_t *epgFetch_create(int maxParallel, size_t maxSize, const char *cacheDir);
+
+/**
+ *  @brief Sets extra request headers, list is owned by caller and must outlive requests
+ */
+void epgFetch_setHeaders(epgFetch_t *fetch, struct curl_slist *headers);
+
+/**
+ *  @brief Queues request, requests are started by epgFetch_run
+ *
+ *  @return 0 on success
+ */
+int epgFetch_add(epgFetch_t *fetch, const char *url, int flags, epgFetchCallback callback, void *pArg);
+
+/**
+ *  @brief Runs queued requests until all of them finish or *running becomes 0
+ *
+ *  Callbacks are called from this thread. Requests left after abort are dropped.
+ *
+ *  @param[out] stats  Statistics of this run, may be NULL
+ *
+ *  @return Number of failed requests
+ */
+int epgFetch_run(epgFetch_t *fetch, const volatile int *running, epgFetchStats_t *stats);
+
+void epgFetch_destroy(epgFetch_t *fetch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EPG_FETCH_H      Do not add any thing below this line */
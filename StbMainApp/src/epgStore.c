@@ -0,0 +1,501 @@
+/*
+ epgStore.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "epgStore.h"
+
+#include "debug.h"
+#include "off_air.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef ENABLE_DVB
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+/* Buckets of service pointer hash, must be power of 2 */
+#define EPG_STORE_BUCKETS      (256)
+#define EPG_STORE_MIN_CAPACITY (64)
+/* Version of events found in schedule but not yet seen in EIT section */
+#define EPG_VERSION_UNKNOWN    (0xff)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct {
+	time_t          start;
+	time_t          end;
+	list_element_t *element;
+	uint16_t        event_id;
+	uint8_t         version;
+} epgEntry_t;
+
+typedef struct epgStore {
+	struct epgStore *next;
+	EIT_service_t   *service;
+
+	epgEntry_t      *entry;     // sorted by start when not outdated
+	int32_t          count;
+	int32_t          capacity;
+	time_t           last_end;
+
+	int32_t         *idHash;    // event_id -> entry index, -1 for empty slot
+	int32_t          idHashSize;
+
+	int32_t          outdated;  // entries need to be matched with schedule list again
+} epgStore_t;
+
+/******************************************************************
+* STATIC DATA                                                     *
+*******************************************************************/
+
+static epgStore_t *epgStore_table[EPG_STORE_BUCKETS];
+static pthread_mutex_t epgStore_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
+*******************************************************************/
+
+static inline uint32_t epgStore_hashService(EIT_service_t *service)
+{
+	return ((uint32_t)(uintptr_t)service * 0x9e3779b1u) >> 16 & (EPG_STORE_BUCKETS-1);
+}
+
+static inline uint32_t epgStore_hashId(uint16_t event_id, int32_t size)
+{
+	return (event_id * 0x9e3779b1u) >> 12 & (size-1);
+}
+
+static void epgStore_hashInsert(epgStore_t *store, int32_t index)
+{
+	uint32_t slot = epgStore_hashId(store->entry[index].event_id, store->idHashSize);
+
+	while(store->idHash[slot] >= 0) {
+		slot = (slot + 1) & (store->idHashSize-1);
+	}
+	store->idHash[slot] = index;
+}
+
+static int32_t epgStore_hashFind(epgStore_t *store, uint16_t event_id)
+{
+	uint32_t slot;
+
+	if(store->idHash == NULL) {
+		return -1;
+	}
+	slot = epgStore_hashId(event_id, store->idHashSize);
+	while(store->idHash[slot] >= 0) {
+		if(store->entry[store->idHash[slot]].event_id == event_id) {
+			return store->idHash[slot];
+		}
+		slot = (slot + 1) & (store->idHashSize-1);
+	}
+	return -1;
+}
+
+static void epgStore_rehash(epgStore_t *store)
+{
+	int32_t i;
+
+	memset(store->idHash, 0xff, store->idHashSize * sizeof(store->idHash[0]));
+	for(i = 0; i < store->count; i++) {
+		epgStore_hashInsert(store, i);
+	}
+}
+
+/* Makes room for one more entry, keeps hash load factor at most 1/2 */
+static int epgStore_reserve(epgStore_t *store)
+{
+	epgEntry_t *entry;
+	int32_t *idHash;
+	int32_t capacity;
+
+	if(store->count < store->capacity) {
+		return 0;
+	}
+	capacity = store->capacity ? store->capacity * 2 : EPG_STORE_MIN_CAPACITY;
+	entry = drealloc(store->entry, capacity * sizeof(entry[0]));
+	if(entry == NULL) {
+		return -1;
+	}
+	store->entry = entry;
+	idHash = drealloc(store->idHash, 2 * capacity * sizeof(idHash[0]));
+	if(idHash == NULL) {
+		return -1;
+	}
+	store->idHash     = idHash;
+	store->idHashSize = 2 * capacity;
+	store->capacity   = capacity;
+	epgStore_rehash(store);
+	return 0;
+}
+
+static epgStore_t *epgStore_get(EIT_service_t *service, int create)
+{
+	uint32_t bucket = epgStore_hashService(service);
+	epgStore_t *store;
+
+	for(store = epgStore_table[bucket]; store != NULL; store = store->next) {
+		if(store->service == service) {
+			return store;
+		}
+	}
+	if(!create) {
+		return NULL;
+	}
+	store = dmalloc(sizeof(epgStore_t));
+	if(store == NULL) {
+		return NULL;
+	}
+	memset(store, 0, sizeof(epgStore_t));
+	store->service  = service;
+	store->outdated = 1;
+	store->next = epgStore_table[bucket];
+	epgStore_table[bucket] = store;
+	return store;
+}
+
+static int epgStore_compare(const void *p1, const void *p2)
+{
+	const epgEntry_t *e1 = p1;
+	const epgEntry_t *e2 = p2;
+
+	if(e1->start != e2->start) {
+		return e1->start < e2->start ? -1 : 1;
+	}
+	return (int)e1->event_id - (int)e2->event_id;
+}
+
+/* Matches entries with events of service schedule and restores start order.
+ * Entries of events missing from schedule are dropped, new events are added. */
+static void epgStore_resolve(epgStore_t *store)
+{
+	list_element_t *element;
+	int32_t i, j, known;
+
+	if(!store->outdated) {
+		return;
+	}
+	for(i = 0; i < store->count; i++) {
+		store->entry[i].element = NULL;
+	}
+	known = store->count;
+	for(element = store->service->schedule; element != NULL; element = element->next) {
+		EIT_event_t *event = element->data;
+		time_t start, end;
+
+		if(event == NULL || offair_getEventTimes(event, &start, &end) != 0) {
+			continue;
+		}
+		i = epgStore_hashFind(store, event->event_id);
+		if(i < 0 || i >= known || store->entry[i].element != NULL) {
+			if(epgStore_reserve(store) != 0) {
+				eprintf("%s: failed to grow store of %d events\n", __FUNCTION__, store->count);
+				break;
+			}
+			i = store->count++;
+			store->entry[i].event_id = event->event_id;
+			store->entry[i].version  = EPG_VERSION_UNKNOWN;
+			epgStore_hashInsert(store, i);
+		}
+		store->entry[i].element = element;
+		store->entry[i].start   = start;
+		store->entry[i].end     = end;
+	}
+
+	store->last_end = 0;
+	for(i = 0, j = 0; i < store->count; i++) {
+		if(store->entry[i].element != NULL) {
+			if(store->entry[i].end > store->last_end) {
+				store->last_end = store->entry[i].end;
+			}
+			store->entry[j++] = store->entry[i];
+		}
+	}
+	store->count = j;
+	qsort(store->entry, store->count, sizeof(store->entry[0]), epgStore_compare);
+	if(store->idHash != NULL) {
+		epgStore_rehash(store);
+	}
+	store->outdated = 0;
+}
+
+/* Returns index of first entry starting at or after t */
+static int32_t epgStore_lowerBound(epgStore_t *store, time_t t)
+{
+	int32_t low = 0, high = store->count;
+
+	while(low < high) {
+		int32_t mid = (low + high) / 2;
+		if(store->entry[mid].start < t) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/* Returns index of first entry in start order which ends after t */
+static int32_t epgStore_firstEnding(epgStore_t *store, time_t t)
+{
+	int32_t i = epgStore_lowerBound(store, t);
+
+	while(i > 0 && store->entry[i-1].end > t) {
+		i--;
+	}
+	while(i < store->count && store->entry[i].end <= t) {
+		i++;
+	}
+	return i;
+}
+
+static epgStore_t *epgStore_lookup(EIT_service_t *service)
+{
+	epgStore_t *store;
+
+	if(service == NULL || service->schedule == NULL) {
+		return NULL;
+	}
+	store = epgStore_get(service, 1);
+	if(store != NULL) {
+		epgStore_resolve(store);
+	}
+	return store;
+}
+
+void epgStore_update(EIT_service_t *service, const uint8_t *section)
+{
+	epgStore_t *store;
+	const uint8_t *p, *end;
+	uint8_t version;
+
+	if(service == NULL || section == NULL) {
+		return;
+	}
+	version = (section[5] >> 1) & 0x1f;
+	end = section + 3 + (((section[1] & 0x0f) << 8) | section[2]) - 4;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_get(service, 1);
+	if(store == NULL) {
+		pthread_mutex_unlock(&epgStore_mutex);
+		return;
+	}
+	for(p = section + 14; p + 12 <= end; p += 12 + (((p[10] & 0x0f) << 8) | p[11])) {
+		uint16_t event_id = (p[0] << 8) | p[1];
+		int32_t i = epgStore_hashFind(store, event_id);
+
+		if(i >= 0) {
+			if(store->entry[i].version != version) {
+				store->entry[i].version = version;
+				store->outdated = 1;
+			}
+			continue;
+		}
+		// times are taken from schedule event when store is resolved
+		if(epgStore_reserve(store) != 0) {
+			break;
+		}
+		i = store->count++;
+		memset(&store->entry[i], 0, sizeof(store->entry[i]));
+		store->entry[i].event_id = event_id;
+		store->entry[i].version  = version;
+		epgStore_hashInsert(store, i);
+		store->outdated = 1;
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+}
+
+void epgStore_clear(void)
+{
+	int i;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	for(i = 0; i < EPG_STORE_BUCKETS; i++) {
+		while(epgStore_table[i] != NULL) {
+			epgStore_t *store = epgStore_table[i];
+			epgStore_table[i] = store->next;
+			dfree(store->entry);
+			dfree(store->idHash);
+			dfree(store);
+		}
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+}
+
+void epgStore_invalidate(EIT_service_t *service)
+{
+	epgStore_t *store;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_get(service, 0);
+	if(store != NULL) {
+		store->outdated = 1;
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+}
+
+int epgStore_getCurrentEvent(EIT_service_t *service, time_t now, list_element_t **current, list_element_t **next)
+{
+	epgStore_t *store;
+	int32_t i;
+	int ret = -1;
+
+	*current = NULL;
+	if(next != NULL) {
+		*next = NULL;
+	}
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_lookup(service);
+	if(store != NULL) {
+		// first event starting after now
+		i = epgStore_lowerBound(store, now + 1);
+		if(next != NULL && i < store->count) {
+			*next = store->entry[i].element;
+		}
+		if(i > 0 && store->entry[i-1].end >= now) {
+			*current = store->entry[i-1].element;
+			ret = 0;
+		}
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+	return ret;
+}
+
+list_element_t *epgStore_getFirstEvent(EIT_service_t *service, time_t from, time_t *last_end)
+{
+	epgStore_t *store;
+	list_element_t *element = NULL;
+	int32_t i;
+
+	if(last_end != NULL) {
+		*last_end = 0;
+	}
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_lookup(service);
+	if(store != NULL) {
+		i = epgStore_firstEnding(store, from);
+		if(i < store->count) {
+			element = store->entry[i].element;
+		}
+		if(last_end != NULL) {
+			*last_end = store->last_end;
+		}
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+	return element;
+}
+
+int epgStore_getEvents(EIT_service_t *service, time_t from, time_t to, list_element_t **events, int max_count)
+{
+	epgStore_t *store;
+	int32_t i;
+	int count = 0;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_lookup(service);
+	if(store != NULL) {
+		for(i = epgStore_firstEnding(store, from);
+		    i < store->count && store->entry[i].start < to && count < max_count;
+		    i++) {
+			if(store->entry[i].end > from) {
+				events[count++] = store->entry[i].element;
+			}
+		}
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+	return count;
+}
+
+list_element_t *epgStore_findEvent(EIT_service_t *service, time_t start, time_t end)
+{
+	epgStore_t *store;
+	list_element_t *element = NULL;
+	int32_t i;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_lookup(service);
+	if(store != NULL) {
+		for(i = epgStore_lowerBound(store, start); i < store->count && store->entry[i].start == start; i++) {
+			if(store->entry[i].end == end) {
+				element = store->entry[i].element;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&epgStore_mutex);
+	return element;
+}
+
+void epgStore_sortSchedule(EIT_service_t *service)
+{
+	epgStore_t *store;
+	list_element_t *element, *next;
+	list_element_t *rest = NULL, **rest_tail = &rest, **tail;
+	int32_t i;
+
+	pthread_mutex_lock(&epgStore_mutex);
+	store = epgStore_lookup(service);
+	if(store == NULL) {
+		pthread_mutex_unlock(&epgStore_mutex);
+		return;
+	}
+	// events without valid time are not in store, keep them in original order
+	for(element = service->schedule; element != NULL; element = next) {
+		EIT_event_t *event = element->data;
+		time_t start, end;
+
+		next = element->next;
+		if(event == NULL || offair_getEventTimes(event, &start, &end) != 0) {
+			*rest_tail = element;
+			rest_tail  = &element->next;
+		}
+	}
+	*rest_tail = NULL;
+
+	tail = &service->schedule;
+	for(i = 0; i < store->count; i++) {
+		*tail = store->entry[i].element;
+		tail  = &store->entry[i].element->next;
+	}
+	*tail = rest;
+	pthread_mutex_unlock(&epgStore_mutex);
+}
+
+#endif /* ENABLE_DVB */
@@ -0,0 +1,122 @@
+#if !defined(__EPG_STORE_H)
+#define __EPG_STORE_H
+
+/*
+ epgStore.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file epgStore.h Time-indexed view of DVB service schedules
+ * For each service with EPG the store keeps a contiguous array of events
+ * sorted by start time, so "now/next" and EPG grid windows are found by
+ * binary search instead of walking EIT_service_t::schedule.
+ * Entries reference elements of the service schedule list, which stays the
+ * owner of event data.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include "defines.h"
+#include "dvb.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef ENABLE_DVB
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+/**
+ *  @brief Accounts EIT section which was parsed into service schedule
+ *
+ *  Events are matched by event_id. Store of the service is marked outdated
+ *  only if section brings new events or new version of known ones.
+ *  Called with services list locked.
+ *
+ *  @param[in]  service  Service the section belongs to
+ *  @param[in]  section  Complete EIT section starting from table_id
+ */
+void epgStore_update(EIT_service_t *service, const uint8_t *section);
+
+/**
+ *  @brief Drops all stores, must be called before services are freed
+ */
+void epgStore_clear(void);
+
+/**
+ *  @brief Marks store of the service outdated after its schedule list was replaced
+ *
+ *  Called with services list locked.
+ */
+void epgStore_invalidate(EIT_service_t *service);
+
+/**
+ *  @brief Finds event running at specified time and the one following it
+ *
+ *  @param[out] current  Event running at now, NULL if none
+ *  @param[out] next     First event starting after now, may be NULL
+ *
+ *  @return 0 if current event was found
+ */
+int epgStore_getCurrentEvent(EIT_service_t *service, time_t now, list_element_t **current, list_element_t **next);
+
+/**
+ *  @brief Finds first event in start order which ends after specified time
+ *
+ *  @param[out] last_end  End time of the latest event, may be NULL
+ *
+ *  @return Schedule element or NULL
+ */
+list_element_t *epgStore_getFirstEvent(EIT_service_t *service, time_t from, time_t *last_end);
+
+/**
+ *  @brief Collects events overlapping [from, to) in start order
+ *
+ *  @return Number of events stored in events[], at most max_count
+ */
+int epgStore_getEvents(EIT_service_t *service, time_t from, time_t to, list_element_t **events, int max_count);
+
+/**
+ *  @brief Finds event with exactly specified start and end times
+ */
+list_element_t *epgStore_findEvent(EIT_service_t *service, time_t start, time_t end);
+
+/**
+ *  @brief Relinks service schedule list in start time order
+ *
+ *  Events without valid start time are moved to the end of the list.
+ */
+void epgStore_sortSchedule(EIT_service_t *service);
+
+#endif /* ENABLE_DVB */
+
+#endif /* __EPG_STORE_H      Do not add any thing below this line */
@@ -0,0 +1,257 @@
+/*
+ fontCache.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "fontCache.h"
+
+#include "debug.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+/* Advances are stored in pages of 256 code points covering BMP */
+#define FONT_CACHE_PAGES   (256)
+#define FONT_CACHE_UNKNOWN INT16_MIN
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct
+{
+	IDirectFBFont *font;
+	int16_t       *pages[FONT_CACHE_PAGES];
+} fontCacheFont_t;
+
+/******************************************************************
+* STATIC DATA                  g[k|p|kp|pk|kpk]<Module>_<Word>+   *
+*******************************************************************/
+
+static pthread_mutex_t  fontCache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fontCacheFont_t  fontCache_fonts[FONT_CACHE_FONTS];
+static fontCacheStats_t fontCache_stats;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+/* Must be called with cache locked */
+static fontCacheFont_t *fontCache_getFont(IDirectFBFont *font)
+{
+	int i, freeSlot = -1;
+
+	for (i = 0; i < FONT_CACHE_FONTS; i++) {
+		if (fontCache_fonts[i].font == font)
+			return &fontCache_fonts[i];
+		if (freeSlot < 0 && fontCache_fonts[i].font == NULL)
+			freeSlot = i;
+	}
+	if (freeSlot < 0)
+		return NULL;
+	fontCache_fonts[freeSlot].font = font;
+	return &fontCache_fonts[freeSlot];
+}
+
+/* Must be called with cache locked */
+static int fontCache_getAdvance(IDirectFBFont *font, fontCacheFont_t *cached, uint32_t code)
+{
+	int16_t *page = NULL;
+	int advance = 0;
+
+	if (cached && code < FONT_CACHE_PAGES*256) {
+		page = cached->pages[code >> 8];
+		if (page == NULL) {
+			page = malloc(256*sizeof(int16_t));
+			if (page) {
+				int i;
+				for (i = 0; i < 256; i++)
+					page[i] = FONT_CACHE_UNKNOWN;
+				cached->pages[code >> 8] = page;
+			}
+		}
+		if (page && page[code & 0xff] != FONT_CACHE_UNKNOWN)
+			return page[code & 0xff];
+	}
+
+	fontCache_stats.glyphCalls++;
+	if (font->GetGlyphAdvance(font, code, &advance) != DFB_OK)
+		advance = 0;
+	if (page)
+		page[code & 0xff] = (int16_t)advance;
+	return advance;
+}
+
+/* Decodes character at *pos and moves *pos past its continuation bytes */
+static uint32_t fontCache_decodeUtf8(const char *string, int *pos)
+{
+	const unsigned char *s = (const unsigned char*)string;
+	int p = *pos;
+	uint32_t code = s[p++];
+	int extra;
+
+	if (code >= 0xF0)
+		extra = 3, code &= 0x07;
+	else if (code >= 0xE0)
+		extra = 2, code &= 0x0F;
+	else if (code >= 0xC0)
+		extra = 1, code &= 0x1F;
+	else
+		extra = 0;
+
+	/* Stray continuation bytes are skipped as part of character */
+	while ((s[p] & 0xC0) == 0x80) {
+		if (extra > 0) {
+			code = (code << 6) | (s[p] & 0x3F);
+			extra--;
+		}
+		p++;
+	}
+	*pos = p;
+	return code;
+}
+
+static int fontCache_getWidth(IDirectFBFont *font, const char *string, int length)
+{
+	int width = 0;
+
+	if (length == 0)
+		return 0;
+	fontCache_stats.stringCalls++;
+	if (font->GetStringWidth(font, string, length, &width) != DFB_OK)
+		return 0;
+	return width;
+}
+
+int fontCache_fitString(IDirectFBFont *font, const char *string, int maxWidth)
+{
+	/* offsets[k] is byte length of first k characters, widths[k] is their estimated width */
+	int offsets[FONT_CACHE_MAX_GLYPHS+1];
+	int widths[FONT_CACHE_MAX_GLYPHS+1];
+	fontCacheFont_t *cached;
+	int count, fit, lo, hi;
+
+	pthread_mutex_lock(&fontCache_mutex);
+	fontCache_stats.fits++;
+	cached = fontCache_getFont(font);
+
+	offsets[0] = widths[0] = 0;
+	count = 0;
+	while (string[offsets[count]] != 0 && count < FONT_CACHE_MAX_GLYPHS) {
+		int pos = offsets[count];
+		uint32_t code = fontCache_decodeUtf8(string, &pos);
+
+		offsets[count+1] = pos;
+		widths[count+1]  = widths[count] + fontCache_getAdvance(font, cached, code);
+		count++;
+		if (widths[count] > maxWidth)
+			break;
+	}
+	/* Estimate: longest prefix which fits without kerning */
+	fit = widths[count] <= maxWidth ? count : count-1;
+
+	if (string[offsets[fit]] == 0) {
+		if (fontCache_getWidth(font, string, -1) <= maxWidth)
+			goto done;
+	} else if (fit < count) {
+		if (fontCache_getWidth(font, string, offsets[fit]) <= maxWidth) {
+			if (fontCache_getWidth(font, string, offsets[fit+1]) > maxWidth)
+				goto done;
+			/* Kerning made text narrower, few more characters fit */
+			fontCache_stats.corrections++;
+			fit++;
+			goto extend;
+		}
+	} else {
+		/* Too many narrow characters to be estimated */
+		goto extend;
+	}
+
+	/* Kerning made text wider: fit is between 0, which always fits, and estimate */
+	fontCache_stats.corrections++;
+	lo = 0;
+	hi = fit;
+	while (hi - lo > 1) {
+		int mid = (lo + hi)/2;
+		if (fontCache_getWidth(font, string, offsets[mid]) <= maxWidth)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	fit = lo;
+	goto done;
+
+extend:
+	{
+		int length = offsets[fit];
+		while (string[length] != 0) {
+			int next = length;
+			fontCache_decodeUtf8(string, &next);
+			if (fontCache_getWidth(font, string, next) > maxWidth)
+				break;
+			length = next;
+		}
+		pthread_mutex_unlock(&fontCache_mutex);
+		return length;
+	}
+
+done:
+	pthread_mutex_unlock(&fontCache_mutex);
+	return offsets[fit];
+}
+
+void fontCache_forget(IDirectFBFont *font)
+{
+	int i, p;
+
+	pthread_mutex_lock(&fontCache_mutex);
+	for (i = 0; i < FONT_CACHE_FONTS; i++) {
+		if (fontCache_fonts[i].font != font)
+			continue;
+		for (p = 0; p < FONT_CACHE_PAGES; p++)
+			free(fontCache_fonts[i].pages[p]);
+		memset(&fontCache_fonts[i], 0, sizeof(fontCache_fonts[i]));
+	}
+	pthread_mutex_unlock(&fontCache_mutex);
+}
+
+void fontCache_getStats(fontCacheStats_t *stats)
+{
+	pthread_mutex_lock(&fontCache_mutex);
+	*stats = fontCache_stats;
+	pthread_mutex_unlock(&fontCache_mutex);
+}
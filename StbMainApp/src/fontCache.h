@@ -0,0 +1,95 @@
+#if !defined(__FONT_CACHE_H)
+#define __FONT_CACHE_H
+
+/*
+ fontCache.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file fontCache.h Glyph advance cache and text fitting
+ * Finding how much of a label fits into given width used to take one
+ * GetStringWidth call per character. Advances of glyphs are cached per font
+ * instead, so the fitting length is found from their prefix sums and only
+ * checked by the font, which also accounts for kerning.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <directfb.h>
+#include <stdint.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Number of fonts which advances are cached for, others are measured every time */
+#define FONT_CACHE_FONTS      (8)
+/** Longest prefix in characters which is fitted from cached advances */
+#define FONT_CACHE_MAX_GLYPHS (512)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct
+{
+	uint32_t fits;         /**< fontCache_fitString calls */
+	uint32_t stringCalls;  /**< GetStringWidth calls made by them */
+	uint32_t glyphCalls;   /**< GetGlyphAdvance calls on cache misses */
+	uint32_t corrections;  /**< Fits where kerning moved the result off estimate */
+} fontCacheStats_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Finds longest beginning of UTF-8 string which fits into maxWidth
+ *
+ *  @return Length of fitting part in bytes, ending on character boundary
+ */
+int  fontCache_fitString(IDirectFBFont *font, const char *string, int maxWidth);
+
+/**
+ *  @brief Drops cached advances, must be called before font is released
+ */
+void fontCache_forget(IDirectFBFont *font);
+
+void fontCache_getStats(fontCacheStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FONT_CACHE_H      Do not add any thing below this line */
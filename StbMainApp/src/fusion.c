@@ -49,7 +49,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 static char g_usbRoot[PATH_MAX] = {0};
 static int gStatus = 0;
 int g_shaping = FUSION_DEFAULT_BANDLIM_KBYTE;
+static int g_shapingPlay = FUSION_DEFAULT_BANDLIM_PLAY_KBYTE;
+static int g_adsQuota = FUSION_DEFAULT_ADS_QUOTA_MBYTE;
 static char g_adsPath[PATH_MAX] = {0};
+static mediaCache_t *g_adsCache = NULL;
 
 interfaceFusionObject_t FusionObject;
 
@@ -93,10 +96,8 @@ int fusion_getUtcFromEarthtools (char * utcBuffer, int size);
 int fusion_getUtcFromCustomServiceByWget (char * customRequest, char * utcBuffer, int size);
 
 static char helper_checkAdsOnUsb ();
-int fusion_makeAdsPathFromUrl (char * fileUrl, char * resultPath, int duration, int size);
-int fusion_saveFileByWget (char * url, char * filepath, int dtmf);
-int fusion_checkAdIsComplete(char * filepath);
-int fusion_waitAdIsDownloaded (char * filepath, int dtmf);
+static int helper_openAdsCache ();
+int fusion_makeAdsSymlink (char * filepath, int dtmf);
 int fusion_savePlaylistToFile(char * path, char * playlistBuffer, int size);
 
 extern int  helperParseLine(const char *path, const char *cmd, const char *pattern, char *out, char stopChar);
@@ -172,10 +173,26 @@ int fusion_getCommandOutput (char * cmd, char * result)
 
 void * fusion_threadFlipCreep (void * param)
 {
+	struct timespec next;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
 	while (1)
 	{
 		interface_updateFusionCreepSurface();
-		fusion_wait(10);
+
+		// sleep till absolute deadline, so drawing time doesn't lower frame rate
+		next.tv_nsec += FUSION_CREEP_FRAME_MS * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+			// skip missed frames, position is computed from time anyway
+			next = now;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
 	}
 	pthread_exit((void *)&gStatus);
 	return (void*)NULL;
@@ -343,13 +360,9 @@ void * fusion_threadMonitorCreep(void * param)
 		}*/
 		else if (FusionObject.creep.status == FUSION_SAME_CREEP && FusionObject.creep.isShown)
 		{
-			struct timeval tv;
 			//eprintf ("%s(%d): FUSION_SAME_CREEP. isShown = 1. Wait pause = %d sec and start again.\n", __FUNCTION__, __LINE__, FusionObject.creep.pause);
 			fusion_wait(FusionObject.creep.pause * 1000);
-			gettimeofday(&tv, NULL);
-			FusionObject.creep.startTime = (unsigned long long)(tv.tv_sec) * 1000 + (unsigned long long)(tv.tv_usec) / 1000;
-			FusionObject.creep.isShown = 0;
-			FusionObject.creep.deltaTime = 0;
+			interface_startFusionCreep();
 		}
 	}
 
@@ -367,12 +380,8 @@ void * fusion_threadGetCreepline(void * param)
 
 		if (FusionObject.creep.status == FUSION_NEW_CREEP)
 		{
-			struct timeval tv;
-			gettimeofday(&tv, NULL);
-			FusionObject.creep.startTime = (unsigned long long)(tv.tv_sec) * 1000 + (unsigned long long)(tv.tv_usec) / 1000;
+			interface_startFusionCreep();
 			//eprintf ("%s(%d): FUSION_NEW_CREEP -> FUSION_SAME_CREEP. Set iShown = 0. startTime = %lld.\n", __FUNCTION__, __LINE__, FusionObject.creep.startTime);
-			FusionObject.creep.deltaTime = 0;
-			FusionObject.creep.isShown = 0;	// test
 			FusionObject.creep.status = FUSION_SAME_CREEP;
 		}/*
 		else if (FusionObject.creep.status == FUSION_SAME_CREEP && FusionObject.creep.isShown)
@@ -491,6 +500,16 @@ int fusion_readConfig()
 			g_shaping = atoi(ptr);
 			eprintf (" %s: band limit = %d\n",   __FUNCTION__, g_shaping);
 		}
+		else if ((ptr = strcasestr((const char*) line, (const char*)"LIMITPLAY ")) != NULL){
+			ptr += 10;
+			g_shapingPlay = atoi(ptr);
+			eprintf (" %s: band limit while playing = %d\n",   __FUNCTION__, g_shapingPlay);
+		}
+		else if ((ptr = strcasestr((const char*) line, (const char*)"ADSQUOTA ")) != NULL){
+			ptr += 9;
+			g_adsQuota = atoi(ptr);
+			eprintf (" %s: ads quota = %d MB\n",   __FUNCTION__, g_adsQuota);
+		}
 		//---------- UTC web service url ----------------------------- //
 		else if ((ptr = strcasestr((const char*) line, (const char*)"UTC ")) != NULL){
 			ptr += 4;
@@ -1723,6 +1742,9 @@ int fusion_parsePlaylistMarks(cJSON * root)
 				return -1;
 			}
 		}
+		if (helper_openAdsCache() != 0){
+			return -1;
+		}
 
 		int markCount = cJSON_GetArraySize(jsonMarks);
 		if (markCount) {
@@ -1759,23 +1781,24 @@ int fusion_parsePlaylistMarks(cJSON * root)
 				eprintf ("%s(%d): WARNING! Incorrect mark duration (%s). Skip.\n", __FUNCTION__, __LINE__, jsonDuration->valuestring);
 				continue;
 			}
-			int remoteSize = fusion_getRemoteFileSize(jsonLink->valuestring);
+			long remoteSize = fusion_getRemoteFileSize(jsonLink->valuestring);
 			if (remoteSize == 0){
 				eprintf ("%s(%d): WARNING! Couldn't get remoteFileSize for %s. Skip\n", __FUNCTION__, __LINE__, jsonLink->valuestring);
 				continue;
 			}
 
-			if (fusion_makeAdsPathFromUrl(jsonLink->valuestring, filepath, duration, remoteSize) == 0){
-				fusion_saveFileByWget(jsonLink->valuestring, filepath, dtmfIndex);
-				fusion_waitAdIsDownloaded(filepath, dtmfIndex);
+			// size is a part of cache key, so ad replaced on server under the same url is downloaded again
+			if (mediaCache_get(g_adsCache, jsonLink->valuestring, remoteSize > 0 ? remoteSize : 0, filepath, sizeof(filepath)) != 0){
+				eprintf ("%s(%d): WARNING! Couldn't download %s. Skip until next playlist check.\n", __FUNCTION__, __LINE__, jsonLink->valuestring);
+				continue;
 			}
+			fusion_makeAdsSymlink(filepath, dtmfIndex);
 			FusionObject.marks[dtmfIndex].duration = duration;
 			snprintf (FusionObject.marks[dtmfIndex].link, PATH_MAX, "%s", jsonLink->valuestring);
 			snprintf (FusionObject.marks[dtmfIndex].filename, PATH_MAX, "%s", filepath);
 		}
 
 		fusion_removeAdLockFile();
-		// todo : remove old ad videos in ads folder
 	}
 	return 0;
 }
@@ -1887,6 +1910,10 @@ void fusion_cleanup()
 		FusionObject.playlistBuffer = NULL;
 	}
 
+	mediaCache_close(g_adsCache);
+	g_adsCache = NULL;
+
+	interface_releaseFusionCreepSurface();
 	if (fusion_surface){
 		fusion_surface->Release(fusion_surface);
 		fusion_surface = NULL;
@@ -1927,6 +1954,53 @@ static char helper_checkAdsOnUsb ()
 	return YES;
 }
 
+static int helper_isPlaybackActive (void * pArg)
+{
+	return gfx_videoProviderIsActive(screenMain);
+}
+
+// ads downloaded by wget were named like host_path_secN_sizeN_.ext
+static void helper_removeLegacyAds ()
+{
+	DIR * dir = opendir(g_adsPath);
+	struct dirent * item;
+	char path[PATH_MAX];
+
+	if (!dir) return;
+	while ((item = readdir(dir)) != NULL){
+		if (strstr(item->d_name, "_sec") && strstr(item->d_name, "_size") && strstr(item->d_name, "_.")){
+			snprintf (path, PATH_MAX, "%s/%s", g_adsPath, item->d_name);
+			eprintf ("%s(%d): remove %s\n", __FUNCTION__, __LINE__, path);
+			unlink(path);
+		}
+	}
+	closedir(dir);
+}
+
+static int helper_openAdsCache ()
+{
+	mediaCacheConfig_t config;
+
+	if (g_adsCache) return 0;
+
+	helper_removeLegacyAds();
+
+	memset(&config, 0, sizeof(config));
+	config.rate     = g_shaping * 1024;
+	config.busyRate = g_shapingPlay * 1024;
+	config.quota    = (uint64_t)g_adsQuota * 1024 * 1024;
+	// ads of current playlist are requested on every check and must stay
+	config.keepTime = 2 * FusionObject.checktime;
+	config.isBusy   = helper_isPlaybackActive;
+
+	g_adsCache = mediaCache_open(g_adsPath, &config);
+	if (g_adsCache == NULL){
+		eprintf ("%s(%d): ERROR! Couldn't open ads cache in %s\n", __FUNCTION__, __LINE__, g_adsPath);
+		return -1;
+	}
+	return 0;
+}
+
 void fusion_echoFilepath(char * symlinkPath, char * filepath)
 {
 	char command[PATH_MAX];
@@ -1956,125 +2030,4 @@ int fusion_makeAdsSymlink (char * filepath, int dtmf)
 	}
 	return 0;
 }
-
-int fusion_makeAdsPathFromUrl (char * fileUrl, char * resultPath, int duration, int size)
-{
-	char *ptr, *ptrSlash, *ptrDot;
-	char url[PATH_MAX];
-	char ext[16];
-	if (!fileUrl || !resultPath) return -1;
-
-	sprintf (url, fileUrl);
-
-	ptrDot = strrchr(url, '.');
-	if (ptrDot){
-		snprintf (ext, 16, "%s", ptrDot + 1);
-		*ptrDot = '\0';
-	}
-
-	ptr = strstr(url, "http:");
-	if (ptr == NULL) {
-		eprintf ("%s: ERROR! incorrect url %s\n", __FUNCTION__, url);
-		return -1;
-	}
-	ptr += 7;
-
-	// replace / with _
-	while ((ptrSlash = strchr(ptr, '/')) != NULL){
-		ptrSlash[0] = '_';
-	}
-
-	snprintf (resultPath, PATH_MAX, "%s/%s_sec%d_size%d_.%s", g_adsPath, ptr, duration, size, ext);
-	return 0;
-}
-
-int fusion_saveFileByWget (char * url, char * filepath, int dtmf)
-{
-	char cmd[PATH_MAX];
-
-	if (fusion_checkAdIsComplete(filepath) == NO)
-	{
-		//sprintf (cmd, "wget --limit-rate=%dk -c -q %s -O %s", g_shaping, url, filepath); // quiet mode
-		//sprintf (cmd, "/usr/sbin/wget1.12 --limit-rate=%dk -c -q %s -O %s", g_shaping, url, filepath); // quiet mode
-		sprintf (cmd, "wget -c -q %s -O %s", url, filepath); // quiet mode
-		eprintf ("%s(%d): %s ...\n",   __FUNCTION__, __LINE__, cmd);
-		system(cmd);
-	}
-
-	return 0;
-}
-
-static int helper_cutStringPiece (char * haystack, char * needle, char * piece, int maxPieceLen)
-{
-	if (!haystack || !needle || !piece) return -1;
-
-	char * ptrStartPiece = strstr(haystack, needle);
-	if (ptrStartPiece == NULL){
-		eprintf ("%s(%d): No %s found in %s.\n", __FUNCTION__, __LINE__, needle, haystack);
-		return -1;
-	}
-
-	ptrStartPiece += strlen (needle);
-
-	char * ptrUnderline = strchr(ptrStartPiece, '_');
-	if (ptrUnderline == NULL){
-		eprintf ("%s(%d): Incorrect format (%s).\n", __FUNCTION__, __LINE__, haystack);
-		return -1;
-	}
-	int pieceLen = (int)(ptrUnderline - ptrStartPiece + 1);
-	if (pieceLen > maxPieceLen){
-		eprintf ("%s(%d): Incorrect format (%s).\n", __FUNCTION__, __LINE__, haystack);
-		return -1;
-	}
-	snprintf (piece, pieceLen, "%s", ptrStartPiece);
-	return 0;
-}
-
-int fusion_checkAdIsComplete(char * filepath)
-{
-	long int localSize = 0;
-	int declaredSize = 0;
-	char strSize[32];
-
-	if (!filepath) return NO;
-
-	FILE * f = fopen(filepath, "rb");
-	if (!f) return NO;
-	fseek(f, 0, SEEK_END);
-	localSize = ftell(f);
-	fclose(f);
-
-	if (localSize == 1024){
-		eprintf ("%s(%d): WARNING! %s is too small (%ld bytes)\n", __FUNCTION__, __LINE__, filepath, localSize);
-		return NO;
-	}
-
-	if (helper_cutStringPiece(filepath, "_size", strSize, 32) != 0){
-		eprintf ("%s(%d): WARNING! Couldnot get size form path %s\n", __FUNCTION__, __LINE__, filepath);
-		return NO;
-	}
-	declaredSize = atoi(strSize);
-	if (declaredSize <= 0) {
-		eprintf ("%s(%d): WARNING! Couldnot get size form path %s\n", __FUNCTION__, __LINE__, filepath);
-		return NO;
-	}
-
-	if (declaredSize == localSize) return YES;
-	return NO;
-}
-
-int fusion_waitAdIsDownloaded (char * filepath, int dtmf)
-{
-	if (!filepath || dtmf < 0) return -1;
-
-	while (1){ // todo : aux break condition?
-		if (fusion_checkAdIsComplete(filepath) == YES){
-			//eprintf ("%s(%d): %s downloaded OK.\n", __FUNCTION__, __LINE__, filepath);
-			fusion_makeAdsSymlink(filepath, dtmf);
-			break;
-		}
-		fusion_wait(1000 * 3);
-	}
-	return 0;
-}
 #endif // ENABLE_FUSION
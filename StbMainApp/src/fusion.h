@@ -44,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <resolv.h>
 
 #include "md5.h"
+#include "mediaCache.h"
 #include "gfx.h"
 #include "cJSON.h"
 #include "media.h"
@@ -75,6 +76,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FUSION_LOCK_FILE    "/tmp/fusion_adverts.lock"
 
 #define FUSION_DEFAULT_BANDLIM_KBYTE (2048)
+#define FUSION_DEFAULT_BANDLIM_PLAY_KBYTE (256)
+#define FUSION_DEFAULT_ADS_QUOTA_MBYTE (1024)
 
 typedef struct
 {
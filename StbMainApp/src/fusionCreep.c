@@ -0,0 +1,86 @@
+/*
+ fusionCreep.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "fusionCreep.h"
+
+#include <time.h>
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+unsigned long long fusionCreep_getTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int fusionCreep_getFrame(unsigned long long elapsed, int lastOffset, int creepWidth, int screenWidth, fusionCreepFrame_t *frame)
+{
+	frame->offset = elapsed * FUSION_CREEP_SPEED / 1000;
+	if (frame->offset == lastOffset)
+		return 1;
+
+	frame->dstX = screenWidth - frame->offset;
+	frame->srcX = 0;
+	if (frame->dstX < 0) {
+		frame->srcX = -frame->dstX;
+		frame->dstX = 0;
+	}
+	frame->finished = frame->srcX > creepWidth;
+	if (frame->finished) {
+		// last frame clears the band with blank part of surface
+		frame->srcX = creepWidth;
+	}
+	frame->width = creepWidth + screenWidth - frame->srcX;
+	if (frame->width > screenWidth - frame->dstX)
+		frame->width = screenWidth - frame->dstX;
+	return 0;
+}
+
+int fusionCreep_drawFrame(const fusionCreepOutput_t *output, const fusionCreepFrame_t *frame)
+{
+	int res;
+
+	pthread_mutex_lock(output->lock);
+	res = output->blit(output->pArg, frame);
+	pthread_mutex_unlock(output->lock);
+	if (res != 0)
+		return res;
+
+	output->flip(output->pArg, frame->dstX, frame->dstX + frame->width - 1);
+	return 0;
+}
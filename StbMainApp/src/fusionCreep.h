@@ -0,0 +1,120 @@
+#if !defined(__FUSION_CREEP_H)
+#define __FUSION_CREEP_H
+
+/*
+ fusionCreep.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file fusionCreep.h Fusion creepline position and drawing sequence
+ * Creep position depends only on time passed since start, so scheduling
+ * jitter of creep thread doesn't change scroll speed. Creep surface holds
+ * creep text followed by a blank screen width, which clears the band when
+ * the text has left the screen.
+ *
+ * Drawing is done through output callbacks: blit is called with output lock
+ * held, flip is called after it is released, so waiting for vsync doesn't
+ * block threads replacing creep surface.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <pthread.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Creepline scroll speed, pixels per second */
+#define FUSION_CREEP_SPEED           (200)
+#define FUSION_CREEP_FRAME_MS        (20)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct
+{
+	int offset;   /**< Pixels scrolled since start */
+	int srcX;     /**< Source column of creep surface */
+	int dstX;     /**< Destination column of creep band */
+	int width;
+	int finished; /**< Text has left the screen, this frame clears the band */
+} fusionCreepFrame_t;
+
+typedef struct
+{
+	/** Copies frame->width columns of creep surface starting at srcX to band at dstX.
+	 *  Called with lock held, returns 0 on success */
+	int  (*blit)(void *pArg, const fusionCreepFrame_t *frame);
+	/** Shows columns x1..x2 of creep band. Called without lock */
+	void (*flip)(void *pArg, int x1, int x2);
+	pthread_mutex_t *lock;
+	void *pArg;
+} fusionCreepOutput_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Returns monotonic time in ms used for creep start and position
+ */
+unsigned long long fusionCreep_getTime(void);
+
+/**
+ *  @brief Computes creep frame for time passed since start
+ *
+ *  @param[in]  elapsed      Time in ms since creep was started
+ *  @param[in]  lastOffset   Offset of the last drawn frame
+ *  @param[in]  creepWidth   Width of creep text, creep surface is creepWidth + screenWidth wide
+ *  @param[in]  screenWidth  Width of creep band
+ *  @param[out] frame
+ *
+ *  @return 0 if frame should be drawn, 1 if position didn't change since lastOffset
+ */
+int fusionCreep_getFrame(unsigned long long elapsed, int lastOffset, int creepWidth, int screenWidth, fusionCreepFrame_t *frame);
+
+/**
+ *  @brief Blits frame with output lock held and flips damaged part of band without it
+ *
+ *  @return 0 on success
+ */
+int fusionCreep_drawFrame(const fusionCreepOutput_t *output, const fusionCreepFrame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FUSION_CREEP_H      Do not add any thing below this line */
@@ -51,6 +51,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "stsdk.h"
 #include "crc32.h"
 #include "gstreamer.h"
+#include "imageCache.h"
+#include "fontCache.h"
 #ifdef ENABLE_VIDIMAX
 #include "vidimax.h"
 #endif
@@ -188,7 +190,6 @@ static DFBEnumerationResult gfx_display_layer_callback( DFBDisplayLayerID
 														void                       *arg );
 static void gfx_setVideoProviderName(const char *videoSource);
 #ifdef STSDK
-static inline float st_getTimeValue (cJSON *object, const char *value_name);
 static void gfx_videoProviderStarted(elcdRpcType_t type, cJSON *result, void* pArg);
 #endif
 
@@ -196,9 +197,8 @@ static void gfx_videoProviderStarted(elcdRpcType_t type, cJSON *result, void* pA
 * STATIC DATA                  g[k|p|kp|pk|kpk]<Module>_<Word>+   *
 *******************************************************************/
 
-static stb810_gfxImageEntry gfx_imageTable[GFX_IMAGE_TABLE_SIZE];
-static stb810_gfxImageEntry *pgfx_FreeList = NULL;
-static stb810_gfxImageEntry *pgfx_ImageList = NULL;
+/* Decoded images, keyed by file name or url and stretch flag */
+static imageCache_t *gfx_imageCache = NULL;
 
 /* The surface to render the video on */
 static IDirectFBSurface *pgfx_videoSurface[screenOutputs] = {NULL, NULL};
@@ -389,35 +389,6 @@ static IDirectFBSurface * gfx_getSurface(int which)
 }
 #endif
 
-static void gfx_addImageToList(stb810_gfxImageEntry *pEntry,  stb810_gfxImageEntry **pList)
-{
-	pEntry->pNext = *pList;
-	pEntry->pPrev = NULL;
-	if ( *pList )
-	{
-		(*pList)->pPrev = pEntry;
-	}
-	*pList = pEntry;
-}
-
-static void gfx_removeImageFromList(stb810_gfxImageEntry *pEntry,  stb810_gfxImageEntry **pList)
-{
-	if ( pEntry->pPrev )
-	{
-		pEntry->pPrev->pNext = pEntry->pNext;
-	}
-	if ( pEntry->pNext )
-	{
-		pEntry->pNext->pPrev = pEntry->pPrev;
-	}
-
-	if ( pEntry == *pList )
-	{
-		*pList = pEntry->pNext;
-	}
-}
-
-
 /* Return next input byte, or EOF if no more */
 #define NEXTBYTE()  getc(myfile)
 
@@ -822,160 +793,140 @@ void  gfx_showImage(int layer)
 	interface_disableBackground();
 }
 
-stb810_gfxImageEntry *gfx_findImageEntryByName( const char* filename )
+void gfx_releaseImage(const char *filename)
 {
-	stb810_gfxImageEntry * pEntry = NULL;
 	if (filename == NULL)
-		return NULL;
-	pEntry = pgfx_ImageList;
-	while (pEntry && strcmp(filename,pEntry->filename))
-	{
-		pEntry = pEntry->pNext;
-	}
-	return pEntry;
-}
-
-static void gfx_freeImageEntry(stb810_gfxImageEntry* pEntry)
-{
-	if(!pEntry || !pEntry->pImage)
 		return;
-	dprintf("gfx: Releasing image '%s'...\n", pEntry->filename);
-	pEntry->pImage->Release(pEntry->pImage);
-	FREE(pEntry->filename);
+	if (imageCache_remove(gfx_imageCache, filename) == 0)
+		dprintf("%s: '%s' is not cached\n", __FUNCTION__, filename);
 }
 
-void gfx_releaseImageEntry( stb810_gfxImageEntry* pImageEntry )
+static void *gfx_decodeImageEntry(const imageCacheRequest_t *request, size_t *size, void *pArg)
 {
-	if (pImageEntry != NULL)
-	{/* Free off / release the memory used by the image */
-		dprintf("%s: Freeing of image surface '%s' %dx%d\n", __FUNCTION__, pImageEntry->filename, pImageEntry->width, pImageEntry->height);
-		//eprintf("%s: Freeing of image surface '%s' %dx%d\n", __FUNCTION__, pImageEntry->filename, pImageEntry->width, pImageEntry->height);
-		gfx_removeImageFromList(pImageEntry, &pgfx_ImageList);
-		gfx_addImageToList(pImageEntry, &pgfx_FreeList);
-		gfx_freeImageEntry(pImageEntry);
-	}
-}
-
-static IDirectFBSurface * gfx_decodeImageInternal(const char* img_source, const char* url, int width, int height, int stretchToSize)
-{
-	stb810_gfxImageEntry*   pEntry;
+	const char*             img_source = request->path ? request->path : request->name;
+	IDirectFBSurface*       pImage = NULL;
 	DFBSurfaceDescription   surfaceDesc;
 	DFBRectangle            actualRect;
 	DFBSurfaceDescription   imageDesc;
+	DFBSurfacePixelFormat   format;
 	DFBResult               result;
 	/* The decoder for a given image file type. */
-	IDirectFBImageProvider *pImageProvider = NULL;	
+	IDirectFBImageProvider *pImageProvider = NULL;
 
 	if (!helperFileExists (img_source))
 		return NULL;
 
-	//dprintf("%s: load image '%s'\n", __FUNCTION__, img_source);
-
+	/* Parsing runs without semaphore, so workers only wait for each other on surface access */
 	if(pgfx_dfb->CreateImageProvider(pgfx_dfb, img_source, &pImageProvider) != DFB_OK )
 		return NULL;
 
-	mysem_get(gfx_semaphore);
-
-	//dprintf("%s: loaded image '%s'\n", __FUNCTION__, img_source);
-	
-	DFBCHECKLABEL(pImageProvider->GetSurfaceDescription(pImageProvider, &imageDesc), decode_error);
-
-	//dprintf("%s: %s image size: %d %d (stretch %d)\n", __FUNCTION__, img_source, imageDesc.width, imageDesc.height, stretchToSize);
+	DFBCHECKLABEL(pImageProvider->GetSurfaceDescription(pImageProvider, &imageDesc), provider_error);
 
 	surfaceDesc = imageDesc;
-	if (stretchToSize)
+	if (request->variant)
 	{
 		/* Resize image to specified width and height */
-		if (width != 0)
+		if (request->width != 0)
 		{
-			surfaceDesc.width = width;
+			surfaceDesc.width = request->width;
 		}
-		if (height != 0)
+		if (request->height != 0)
 		{
-			surfaceDesc.height = height;
+			surfaceDesc.height = request->height;
 		}
-	} 
+	}
 	else
 	{
 		/* Use specified with and height as maximal values */
-		if ( surfaceDesc.width > width && width > 0 )
+		if ( surfaceDesc.width > request->width && request->width > 0 )
 		{
-			surfaceDesc.height = surfaceDesc.height*width/surfaceDesc.width;
-			surfaceDesc.width = width;
+			surfaceDesc.height = surfaceDesc.height*request->width/surfaceDesc.width;
+			surfaceDesc.width = request->width;
 		}
-		if ( surfaceDesc.height > height && height > 0 )
+		if ( surfaceDesc.height > request->height && request->height > 0 )
 		{
-			surfaceDesc.width = surfaceDesc.width*height/surfaceDesc.height;
-			surfaceDesc.height = height;
+			surfaceDesc.width = surfaceDesc.width*request->height/surfaceDesc.height;
+			surfaceDesc.height = request->height;
 		}
 	}
 
-	//dprintf("%s: surface desc: %dx%d\n", __FUNCTION__, surfaceDesc.width, surfaceDesc.height);
-
-	//dprintf("%s: Creating image surface\n", __FUNCTION__);
+	mysem_get(gfx_semaphore);
 
-	pEntry = pgfx_FreeList;
-		
-	//eprintf ("%s: CreateSurface err = %p\n", __FUNCTION__, err);
-		
-	while ( !pEntry || (result = pgfx_dfb->CreateSurface(pgfx_dfb, &surfaceDesc, &(pEntry->pImage))) != DFB_OK )
+	result = pgfx_dfb->CreateSurface(pgfx_dfb, &surfaceDesc, &pImage);
+	if (result != DFB_OK)
 	{
-		/* Probably not enough memory available - free off the oldest image */
-		stb810_gfxImageEntry* pFree;
-
-		dprintf("%s: Failed to create image surface for '%s'\n", __FUNCTION__, url);
-		//eprintf("%s: CreateSurface rets %d, Failed to create image surface for '%s'\n", __FUNCTION__, result, url);
-
-		pFree = pgfx_ImageList;
-		//dprintf("gfx: Starting at %p\n", pFree);
-		while ( pFree && pFree->pNext )
-		{
-			//dprintf("%p ---> %p\n", pFree, pFree->pNext);
-			pFree = pFree->pNext;
-		}
-		//dprintf("gfx: Using %p\n", pFree);
-		if ( pFree )
-		{
-			gfx_releaseImageEntry(pFree);
-			if( !pEntry )
-				pEntry = pFree;
-		} else
-		{
-			eprintf("%s: Given up trying to create image surface\n", __FUNCTION__);
-			/* No more memory to free off - give up! */
-			goto decode_error;
-		}
+		/* Probably not enough memory available - cache frees old images and calls us again */
+		dprintf("%s: Failed to create image surface for '%s'\n", __FUNCTION__, request->name);
+		*size = IMAGE_CACHE_NO_MEMORY;
+		goto decode_error;
 	}
 
 	actualRect.w = surfaceDesc.width;
 	actualRect.h = surfaceDesc.height;
 	actualRect.x = actualRect.y = 0;
 	/* Render the image */
-	DFBCHECKLABEL(pImageProvider->RenderTo(pImageProvider,pEntry->pImage, &actualRect), render_error);
+	DFBCHECKLABEL(pImageProvider->RenderTo(pImageProvider, pImage, &actualRect), render_error);
+	mysem_release(gfx_semaphore);
 
 	/* Release in reverse order to creation. */
 	pImageProvider->Release(pImageProvider);
-	
-	gfx_removeImageFromList (pEntry, &pgfx_FreeList);
-	helperSafeStrCpy (&pEntry->filename, url);
-	pEntry->width = width;
-	pEntry->height = height;
-	pEntry->stretch = stretchToSize;
-	//dprintf("%s: Adding new surface to store '%s' %dx%d %d\n", __FUNCTION__, pEntry->filename, pEntry->width, pEntry->height, stretchToSize);
-	gfx_addImageToList(pEntry, &pgfx_ImageList);
-	mysem_release(gfx_semaphore);
-	return pEntry->pImage;
+
+	if (pImage->GetPixelFormat(pImage, &format) != DFB_OK)
+		format = DSPF_ARGB;
+	*size = (size_t)surfaceDesc.width * surfaceDesc.height * DFB_BYTES_PER_PIXEL(format);
+	return pImage;
 render_error:
 	eprintf("gfx: Can't render image\n");
-	pEntry->pImage->Release(pEntry->pImage);
-	pEntry->pImage = NULL;
+	pImage->Release(pImage);
 decode_error:
-	eprintf("gfx: Failed to decode image '%s'\n", url);
-	pImageProvider->Release(pImageProvider);
 	mysem_release(gfx_semaphore);
+provider_error:
+	if (*size != IMAGE_CACHE_NO_MEMORY)
+		eprintf("gfx: Failed to decode image '%s'\n", request->name);
+	pImageProvider->Release(pImageProvider);
 	return NULL;
 }
 
+static void gfx_releaseImageEntry(void *image, void *pArg)
+{
+	IDirectFBSurface *pImage = image;
+
+	pImage->Release(pImage);
+}
+
+static int gfx_imageReadyEvent(void *pArg)
+{
+	interface_displayMenu(1);
+	return 0;
+}
+
+static void gfx_imageReady(const imageCacheRequest_t *request, void *image, void *pArg)
+{
+	/* Several images of one menu are usually decoded together, so redraw is
+	 * delayed a bit to be done once for all of them */
+	if (image && request->owner && request->owner == interfaceInfo.currentMenu)
+		interface_addEvent(gfx_imageReadyEvent, NULL, GFX_IMAGE_REDRAW_DELAY, 1);
+}
+
+static void gfx_imageCollect(const imageCacheRequest_t *request, void *pArg)
+{
+	/* Evicted images are released after next flip, so redraw even idle menu */
+	interface_addEvent(gfx_imageReadyEvent, NULL, GFX_IMAGE_REDRAW_DELAY, 1);
+}
+
+static IDirectFBSurface * gfx_getImage(const char* filename, const char* path, int width, int height, int stretchToSize, void *owner, int flags)
+{
+	imageCacheRequest_t request;
+
+	request.name    = filename;
+	request.variant = stretchToSize ? 1 : 0;
+	request.path    = path;
+	request.width   = width;
+	request.height  = height;
+	request.owner   = owner;
+	return imageCache_get(gfx_imageCache, &request, flags);
+}
+
 static void gfx_updateImage(int index, void *pArg )
 {
 	gfxImageInfo_t   *info = (gfxImageInfo_t*)pArg;
@@ -984,7 +935,7 @@ static void gfx_updateImage(int index, void *pArg )
 	//assert( info != NULL )
 
 	if (helperFileExists (info->filename))
-		pImage = gfx_decodeImageInternal (info->filename, info->url, info->width, info->height, info->stretchToSize);
+		pImage = gfx_getImage(info->url, info->filename, info->width, info->height, info->stretchToSize, NULL, 0);
 
 	downloader_cleanupTempFile (info->filename);
 
@@ -997,150 +948,74 @@ static void gfx_updateImage(int index, void *pArg )
 	dfree (info);
 }
 
-IDirectFBSurface * gfx_decodeImage (const char* filename, int width, int height, int stretchToSize)
+static void gfx_downloadImage(const char* url, int width, int height, int stretchToSize, char noUpdate)
 {
-	int foundImage = 0;
-	IDirectFBSurface* pImage = NULL;
-	stb810_gfxImageEntry* pEntry;
-	int index;
 	gfxImageInfo_t *info;
+	int result;
 
-	pEntry = pgfx_ImageList;
+	if (downloader_find (url) >= 0)
+		return;
 
-	//dprintf("%s: '%s' %dx%d stretch %d\n", __FUNCTION__, filename, width, height, stretchToSize);
-	//eprintf("%s: '%s' %dx%d stretch %d\n", __FUNCTION__, filename, width, height, stretchToSize);
+	info = dmalloc (sizeof(gfxImageInfo_t));
+	if (info == NULL)
+		return;
 
-	/* Find the entry in the decode table */
-	while (pEntry && !foundImage)
+	info->url = NULL;
+	helperSafeStrCpy (&info->url, url);
+	info->filename[0] = 0;
+	info->width = width;
+	info->height = height;
+	info->stretchToSize = stretchToSize;
+	info->pMenu = interfaceInfo.currentMenu;
+	info->noUpdate = noUpdate;
+
+	result = downloader_push (info->url,
+	                          info->filename, sizeof(info->filename),
+	                          GFX_IMAGE_DOWNLOAD_SIZE,
+	                          gfx_updateImage,
+	                          (void*)info);
+	if (result < 0)
 	{
-		if (!strcmp(filename, pEntry->filename) &&
-			(pEntry->stretch == stretchToSize))
-		{
-			foundImage = 1;
-		} else
-		{
-			pEntry = pEntry->pNext;
-		}
+		eprintf("%s: Can't start image download: pool is full!\n", __FUNCTION__);
+		dfree (info->url);
+		dfree (info);
 	}
+}
 
-	/* Not found - decode the image */
-	if (!foundImage)
-	{
-		if (strncasecmp (filename, "http", 4) == 0)
-		{
-			//dprintf("%s: from url '%s' %dx%d\n", __FUNCTION__, filename, width, height );
-			//eprintf("%s: from url '%s' %dx%d\n", __FUNCTION__, filename, width, height );
-			index = downloader_find (filename);
-			if (index < 0)
-			{
-				info = dmalloc (sizeof(gfxImageInfo_t));
-				if (info != NULL)
- 				{
-					int result;
-					info->url = NULL;
-					helperSafeStrCpy (&info->url, filename);
-					info->filename[0] = 0;
-					info->width = width;
-					info->height = height;
-					info->stretchToSize = stretchToSize;
-					info->pMenu = interfaceInfo.currentMenu;
-					
-					result = downloader_push (info->url, 
-					                    info->filename, sizeof(info->filename), 
-					                    GFX_IMAGE_DOWNLOAD_SIZE, 
-					                    gfx_updateImage, 
-					                    (void*)info);
-					if (result < 0)
-					{
-						eprintf("%s: Can't start image download: pool is full!\n", __FUNCTION__);
-						dfree (info);
-					}
-				}
-			}
-		} else
-		{
-			//dprintf("%s: Creating image '%s'... \n", __FUNCTION__, filename);
-			pImage = gfx_decodeImageInternal (filename, filename, width, height, stretchToSize);
-		}
-	} else
+IDirectFBSurface * gfx_decodeImage (const char* filename, int width, int height, int stretchToSize)
+{
+	IDirectFBSurface* pImage;
+
+	//dprintf("%s: '%s' %dx%d stretch %d\n", __FUNCTION__, filename, width, height, stretchToSize);
+
+	if (strncasecmp (filename, "http", 4) == 0)
 	{
-		//dprintf("%s: Re-using image surface '%s' %dx%d, %d\n", __FUNCTION__, pEntry->filename, pEntry->width, pEntry->height, stretchToSize);
-		/* Move the image entry to the front of the list - preserve it for as long as possible */
-		gfx_removeImageFromList(pEntry, &pgfx_ImageList);
-		gfx_addImageToList(pEntry, &pgfx_ImageList);
-		pImage = pEntry->pImage;
+		pImage = gfx_getImage(filename, NULL, width, height, stretchToSize, NULL, IMAGE_CACHE_LOOKUP);
+		if (pImage == NULL)
+			gfx_downloadImage(filename, width, height, stretchToSize, 0);
+		return pImage;
 	}
 
-	/* Return the surface */
-	return pImage;
+	/* Own resources are small and needed for layout, so they are decoded at once.
+	 * Other images are decoded in background and menu is redrawn when they are ready. */
+	if (strncmp (filename, IMAGE_DIR, sizeof(IMAGE_DIR)-1) == 0)
+		return gfx_getImage(filename, NULL, width, height, stretchToSize, NULL, 0);
+
+	return gfx_getImage(filename, NULL, width, height, stretchToSize, interfaceInfo.currentMenu, IMAGE_CACHE_ASYNC);
 }
 
 IDirectFBSurface * gfx_decodeImageNoUpdate (const char* filename, int width, int height, int stretchToSize)
 {
-	int foundImage = 0;
-	IDirectFBSurface* pImage = NULL;
-	stb810_gfxImageEntry* pEntry;
-	int index;
-	gfxImageInfo_t *info;
-
-	pEntry = pgfx_ImageList;
-
-	while (pEntry && !foundImage)
-	{
-		if (!strcmp(filename, pEntry->filename) && (pEntry->stretch == stretchToSize))
-		{
-			foundImage = 1;
-		} 
-		else
-		{
-			pEntry = pEntry->pNext;
-		}
-	}
+	IDirectFBSurface* pImage;
 
-	if (!foundImage)
+	if (strncasecmp (filename, "http", 4) == 0)
 	{
-		if (strncasecmp (filename, "http", 4) == 0)
-		{
-			index = downloader_find (filename);
-			if (index < 0)
-			{
-				info = dmalloc (sizeof(gfxImageInfo_t));
-				if (info != NULL)
- 				{
-					int result;
-					info->url = NULL;
-					helperSafeStrCpy (&info->url, filename);
-					info->filename[0] = 0;
-					info->width = width;
-					info->height = height;
-					info->stretchToSize = stretchToSize;
-					info->pMenu = interfaceInfo.currentMenu;
-					info->noUpdate = 1;                     // make no screen refresh
-					
-					result = downloader_push (info->url, 
-					                          info->filename, sizeof(info->filename), 
-					                          GFX_IMAGE_DOWNLOAD_SIZE, 
-					                          gfx_updateImage, 
-					                          (void*)info);
-					if (result < 0)
-					{
-						eprintf("%s: Can't start image download: pool is full!\n", __FUNCTION__);
-						dfree (info);
-					}
-				}
-			}
-		} 
-		else {
-			pImage = gfx_decodeImageInternal (filename, filename, width, height, stretchToSize);
-		}
-	} 
-	else
-	{
-		gfx_removeImageFromList (pEntry, &pgfx_ImageList);
-		gfx_addImageToList (pEntry, &pgfx_ImageList);
-		pImage = pEntry->pImage;
+		pImage = gfx_getImage(filename, NULL, width, height, stretchToSize, NULL, IMAGE_CACHE_LOOKUP);
+		if (pImage == NULL)
+			gfx_downloadImage(filename, width, height, stretchToSize, 1);  // make no screen refresh
+		return pImage;
 	}
-	return pImage;
+	return gfx_getImage(filename, NULL, width, height, stretchToSize, NULL, 0);
 }
 
 int gfx_videoProviderIsActive(int videoLayer)
@@ -2896,20 +2771,6 @@ void gfx_stopVideoProviders (int which)
 #endif
 }
 
-#ifdef STSDK
-static inline float st_getTimeValue (cJSON *object, const char *value_name)
-{
-	unsigned int hh, mm, ss;
-	cJSON *pos = cJSON_GetObjectItem(object, value_name);
-	if (pos && 
-	    pos->type == cJSON_String &&
-	    sscanf(pos->valuestring, "%02u:%02u:%02u", &hh, &mm, &ss) == 3)
-	{
-		return ss + 60 * mm + 3600 * hh;
-	}
-	return 0;
-}
-#endif
 
 double gfx_getVideoProviderPosition(int videoLayer)
 {
@@ -2936,16 +2797,7 @@ double gfx_getVideoProviderPosition(int videoLayer)
 		return position;
 	}
 
-	elcdRpcType_t type;
-	cJSON        *res = NULL;
-	int           ret;
-
-	ret = st_rpcSync (elcmd_times, NULL, &type, &res);
-	if (ret == 0 && type == elcdRpcResult && res && res->type == cJSON_Object)
-	{
-		position = st_getTimeValue(res, "current");
-	}
-	cJSON_Delete(res);
+	st_getTimes(&position, NULL);
 #endif
 	pprintf("%s(%d): %.2f\n", __FUNCTION__, videoLayer, position);
 	return position;
@@ -2979,20 +2831,13 @@ double gfx_getVideoProviderLength (int videoLayer)
 		return gfx_videoProvider.httpDuration;
 	}
 	
-	elcdRpcType_t type;
-	cJSON        *res = NULL;
-	int           ret;
-
-	ret = st_rpcSync (elcmd_times, NULL, &type, &res);
-	if (ret == 0 && type == elcdRpcResult && res && res->type == cJSON_Object)
+	if (st_getTimes(NULL, &length) == 0)
 	{
-		length = st_getTimeValue(res, "total");
 		if (length < 1.0) length = 1.0;
 	}
 	else {
 		length = 0.0;
 	}
-	cJSON_Delete(res);
 #endif
 	pprintf("%s(%d): %.2f\n", __FUNCTION__, videoLayer, length);
 	return length;
@@ -3015,20 +2860,13 @@ int gfx_getPosition (double *plength,double *pposition)
 		return 0;
 	}
 
-	elcdRpcType_t type;
-	cJSON        *res = NULL;
-	int           ret;
-	
-	ret = st_rpcSync (elcmd_times, NULL, &type, &res);
-	if (ret == 0 && type == elcdRpcResult && res && res->type == cJSON_Object)
+	if (st_getTimes(&position, &length) == 0)
 	{
-		position = st_getTimeValue(res, "current");
-		length   = gfx_videoProvider.httpDuration > 0.0 ? gfx_videoProvider.httpDuration :
-		           st_getTimeValue(res, "total");
+		if (gfx_videoProvider.httpDuration > 0.0)
+			length = gfx_videoProvider.httpDuration;
 	} else {
 		pprintf("%s: times failed\n", __FUNCTION__);
 	}
-	cJSON_Delete(res);
 #endif
 	if (length < 2.0)
 	{
@@ -3665,6 +3503,11 @@ void gfx_flipSurface (IDirectFBSurface *pSurface)
 #endif
 
 	finish_flip:;
+	if (pSurface == pgfx_frameBuffer)
+	{
+		/* Evicted images could be blitted until now */
+		imageCache_collect(gfx_imageCache);
+	}
 }
 
 void gfx_changeOutputFormat (int format)
@@ -3836,12 +3679,6 @@ void gfx_init (int argc, char* argv[])
 #ifdef STSDK
 	gfx_videoProvider.waiting = -1;
 #endif
-	/* Initialise the free image list */
-	for (i = 0; i < GFX_IMAGE_TABLE_SIZE; i++)
-	{
-		gfx_addImageToList(&gfx_imageTable[i], &pgfx_FreeList);
-	}
-	
 	dprintf("%s[%d]: DirectFBInit\n", __FILE__, __LINE__);
 	/* Initialise DirectFB, passing command line options.
 	 * Options recognised by DirectFB will be stripped. */
@@ -4180,6 +4017,21 @@ finish_attr_init:;
 	mysem_create(&gfx_semaphore);
 	pthread_mutex_init(&flipMutex, NULL);
 
+	{
+		imageCacheConfig_t imageCacheConfig;
+
+		memset(&imageCacheConfig, 0, sizeof(imageCacheConfig));
+		imageCacheConfig.budget  = GFX_IMAGE_CACHE_SIZE;
+		imageCacheConfig.threads = GFX_IMAGE_DECODE_THREADS;
+		imageCacheConfig.decode  = gfx_decodeImageEntry;
+		imageCacheConfig.release = gfx_releaseImageEntry;
+		imageCacheConfig.ready   = gfx_imageReady;
+		imageCacheConfig.collect = gfx_imageCollect;
+		gfx_imageCache = imageCache_create(&imageCacheConfig);
+		if (gfx_imageCache == NULL)
+			eprintf("%s: failed to create image cache\n", __FUNCTION__);
+	}
+
 	dprintf("%s[%d]: gfx_clearSurface\n", __FILE__, __LINE__);
 	gfx_clearSurface(pgfx_frameBuffer, 720, 576);
 	dprintf("%s[%d]: gfx_flipSurface\n", __FILE__, __LINE__);
@@ -4208,49 +4060,13 @@ finish_attr_init:;
 
 void gfx_clearImageList()
 {
-	stb810_gfxImageEntry* pEntry;
-	pEntry = pgfx_ImageList;
-	while (pEntry)
-	{
-		stb810_gfxImageEntry* pNext;
-		gfx_freeImageEntry(pEntry);
-		pNext = pEntry->pNext;
-		gfx_removeImageFromList(pEntry, &pgfx_ImageList);
-		gfx_addImageToList(pEntry, &pgfx_FreeList);
-		pEntry = pNext;
-	}
-	return;
+	imageCache_clear(gfx_imageCache, NULL, 0);
 }
 
 void gfx_clearImageListExcept(char ** names, int count)
 {
-	stb810_gfxImageEntry* pEntry;
-	unsigned char skip;
 	if (!count || !names) return;
-	pEntry = pgfx_ImageList;
-	while (pEntry)
-	{
-		stb810_gfxImageEntry* pNext;
-		int i;
-		skip = 0;
-		for (i=0; i<count; i++){
-			if (!names[i]) continue;
-			if (!strcmp(pEntry->filename, names[i])){
-				pNext = pEntry->pNext;
-				pEntry = pNext;
-				skip = 1;
-				break;
-			}
-		}
-		if (!skip) {
-			gfx_freeImageEntry(pEntry);
-			pNext = pEntry->pNext;
-			gfx_removeImageFromList(pEntry, &pgfx_ImageList);
-			gfx_addImageToList(pEntry, &pgfx_FreeList);
-			pEntry = pNext;
-		}
-	}
-	return;
+	imageCache_clear(gfx_imageCache, names, count);
 }
 
 void gfx_terminate(void)
@@ -4263,12 +4079,14 @@ void gfx_terminate(void)
 	if (pgfx_font)
 	{
 		dprintf("gfx: Releasing font ...\n");
+		fontCache_forget(pgfx_font);
 		pgfx_font->Release(pgfx_font);
 		pgfx_font = NULL;
 	}
 	if (pgfx_smallfont)
 	{
 		dprintf("gfx: Releasing small font ...\n");
+		fontCache_forget(pgfx_smallfont);
 		pgfx_smallfont->Release(pgfx_smallfont);
 		pgfx_smallfont = NULL;
 	}
@@ -4323,7 +4141,8 @@ void gfx_terminate(void)
 	}
 #endif
 
-	gfx_clearImageList();
+	imageCache_destroy(gfx_imageCache);
+	gfx_imageCache = NULL;
 
 	/* Release the super interface. */
 	dprintf("gfx: Releasing DirectFB Interface...\n");
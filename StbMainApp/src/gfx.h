@@ -59,8 +59,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MAX_SCALE             (8.0)
 
-/* image cache table size */
-#define GFX_IMAGE_TABLE_SIZE (100)
+/* memory taken by decoded images */
+#define GFX_IMAGE_CACHE_SIZE (16*1024*1024)
+#define GFX_IMAGE_DECODE_THREADS (2)
+/* delay of menu redraw after background decoding, ms */
+#define GFX_IMAGE_REDRAW_DELAY (50)
 #define GFX_IMAGE_DOWNLOAD_SIZE (128*1024)
 
 #define GFX_MAX_LAYERS_5L    (5)
@@ -116,17 +119,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 * EXPORTED TYPEDEFS                            *
 ************************************************/
 
-typedef struct __stb810_gfxImageEntry
-{
-	char *filename;
-	IDirectFBSurface *pImage;
-	int width;
-	int height;
-	int stretch;
-	struct __stb810_gfxImageEntry *pNext;
-	struct __stb810_gfxImageEntry *pPrev;
-} stb810_gfxImageEntry;
-
 typedef enum
 {
 	stb810_gfxStreamTypesUnknown = 0,
@@ -266,6 +258,9 @@ int gfx_getNumberLayers(void);
 *   @param  width         I     Output image width
 *   @param  height        I     Output image height
 *
+*   Images outside of IMAGE_DIR are decoded in background and current menu is
+*   redrawn when they are ready, NULL is returned until then.
+*
 *   @retval Pointer to surface containing decoded image - or NULL if decoding failed
 */
 IDirectFBSurface * gfx_decodeImage(const char* filename, int width, int height, int stretchToSize);
@@ -298,22 +293,13 @@ void gfx_hideVideoLayer (int videoLayer);
 void gfx_showVideoLayer (int videoLayer);
 
 /**
-*   @brief Function used to find image entry by name
-*
-*   @param  filename    I       Look up name
-*
-*   @retval image entry
-*/
-stb810_gfxImageEntry *gfx_findImageEntryByName( const char* filename );
-
-/**
-*   @brief Function used to release image entry
+*   @brief Function used to release all decoded variants of an image
 *
-*   @param  pImageEntry    I       Pointer to image entry
+*   @param  filename    I       Image file or url
 *
 *   @retval void
 */
-void gfx_releaseImageEntry( stb810_gfxImageEntry* pImageEntry );
+void gfx_releaseImage( const char* filename );
 
 /**
 *   @brief Function used to set up the output size for a given layer
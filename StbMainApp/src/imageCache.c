@@ -0,0 +1,614 @@
+/*
+ imageCache.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "imageCache.h"
+
+#include "debug.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+/* Must be power of two */
+#define IMAGE_CACHE_HASH_SIZE  (1024)
+/* Bookkeeping charged to budget for each entry, so failed images are evicted too */
+#define IMAGE_CACHE_ENTRY_COST (256)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef enum
+{
+	imageCacheQueued = 0,
+	imageCacheDecoding,
+	imageCacheReady,
+	imageCacheFailed,
+} imageCacheState_t;
+
+typedef struct imageCacheEntry_s
+{
+	struct imageCacheEntry_s *hashNext;
+	struct imageCacheEntry_s *prev;    /**< Position in LRU list if ready or failed, in queue if queued */
+	struct imageCacheEntry_s *next;
+	uint32_t            hash;
+	imageCacheState_t   state;
+	int                 removed;       /**< Removed while decoding, worker frees it */
+	imageCacheRequest_t request;       /**< Strings are stored after entry */
+	void               *image;
+	size_t              size;
+	uint64_t            timeUs;        /**< When it was queued or failed */
+} imageCacheEntry_t;
+
+typedef struct
+{
+	imageCacheEntry_t *head;
+	imageCacheEntry_t *tail;
+	uint32_t           count;
+} imageCacheList_t;
+
+struct imageCache_s
+{
+	pthread_mutex_t     mutex;
+	pthread_cond_t      queueCond;     /**< Signalled when request is queued or workers must quit */
+	pthread_cond_t      doneCond;      /**< Broadcast when decoding finishes */
+	imageCacheConfig_t  config;
+	imageCacheEntry_t  *hash[IMAGE_CACHE_HASH_SIZE];
+	imageCacheList_t    lru;           /**< Most recently used first */
+	imageCacheList_t    queue;         /**< Most recently requested first */
+	imageCacheEntry_t  *evicted;       /**< Waiting for imageCache_collect, linked by next */
+	int                 waitCollect;   /**< Worker ran out of memory, queue is paused till imageCache_collect */
+	pthread_t           workers[IMAGE_CACHE_MAX_THREADS];
+	int                 workerCount;
+	int                 quit;
+	imageCacheStats_t   stats;
+};
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static uint64_t imageCache_getTimeUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static uint32_t imageCache_hash(const char *name, int variant)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	return (hash ^ (uint32_t)variant) * 16777619u;
+}
+
+static void imageCache_listPush(imageCacheList_t *list, imageCacheEntry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = list->head;
+	if (list->head)
+		list->head->prev = entry;
+	else
+		list->tail = entry;
+	list->head = entry;
+	list->count++;
+}
+
+static void imageCache_listRemove(imageCacheList_t *list, imageCacheEntry_t *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		list->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		list->tail = entry->prev;
+	entry->prev = entry->next = NULL;
+	list->count--;
+}
+
+static imageCacheEntry_t *imageCache_find(imageCache_t *cache, const char *name, int variant, uint32_t hash)
+{
+	imageCacheEntry_t *entry;
+
+	for (entry = cache->hash[hash & (IMAGE_CACHE_HASH_SIZE-1)]; entry; entry = entry->hashNext)
+		if (entry->hash == hash && entry->request.variant == variant && strcmp(entry->request.name, name) == 0)
+			return entry;
+	return NULL;
+}
+
+static void imageCache_hashRemove(imageCache_t *cache, imageCacheEntry_t *entry)
+{
+	imageCacheEntry_t **link = &cache->hash[entry->hash & (IMAGE_CACHE_HASH_SIZE-1)];
+
+	while (*link != entry)
+		link = &(*link)->hashNext;
+	*link = entry->hashNext;
+}
+
+static imageCacheEntry_t *imageCache_createEntry(imageCache_t *cache, const imageCacheRequest_t *request, uint32_t hash)
+{
+	size_t nameLen = strlen(request->name)+1;
+	size_t pathLen = request->path ? strlen(request->path)+1 : 0;
+	imageCacheEntry_t *entry = malloc(sizeof(*entry) + nameLen + pathLen);
+	char *data;
+
+	if (!entry)
+		return NULL;
+	memset(entry, 0, sizeof(*entry));
+	entry->hash    = hash;
+	entry->request = *request;
+	data = (char*)(entry+1);
+	memcpy(data, request->name, nameLen);
+	entry->request.name = data;
+	if (request->path) {
+		memcpy(data+nameLen, request->path, pathLen);
+		entry->request.path = data+nameLen;
+	}
+
+	entry->hashNext = cache->hash[hash & (IMAGE_CACHE_HASH_SIZE-1)];
+	cache->hash[hash & (IMAGE_CACHE_HASH_SIZE-1)] = entry;
+	return entry;
+}
+
+/* Unlinks ready or failed entry, image is left to caller */
+static void imageCache_unlink(imageCache_t *cache, imageCacheEntry_t *entry)
+{
+	imageCache_listRemove(&cache->lru, entry);
+	imageCache_hashRemove(cache, entry);
+	cache->stats.used -= entry->size + IMAGE_CACHE_ENTRY_COST;
+}
+
+/* Evicts least recently used entries until cache fits into budget */
+static void imageCache_evict(imageCache_t *cache, size_t budget, imageCacheEntry_t *keep)
+{
+	while (cache->stats.used > budget && cache->lru.tail && cache->lru.tail != keep) {
+		imageCacheEntry_t *entry = cache->lru.tail;
+
+		imageCache_unlink(cache, entry);
+		cache->stats.evicted++;
+		if (entry->image) {
+			entry->next = cache->evicted;
+			cache->evicted = entry;
+		} else
+			free(entry);
+	}
+}
+
+/* Must be called with cache locked. Frees entry if it was removed while decoding. */
+static void imageCache_finish(imageCache_t *cache, imageCacheEntry_t *entry, void *image, size_t size)
+{
+	if (entry->removed) {
+		if (image)
+			cache->config.release(image, cache->config.pArg);
+		free(entry);
+		pthread_cond_broadcast(&cache->doneCond);
+		return;
+	}
+
+	if (image) {
+		entry->state = imageCacheReady;
+		entry->image = image;
+		entry->size  = size;
+		cache->stats.decoded++;
+	} else {
+		entry->state = imageCacheFailed;
+		entry->size  = 0;
+		cache->stats.failed++;
+	}
+	entry->timeUs = imageCache_getTimeUs();
+	imageCache_listPush(&cache->lru, entry);
+	cache->stats.used += entry->size + IMAGE_CACHE_ENTRY_COST;
+	if (cache->stats.used > cache->stats.usedMax)
+		cache->stats.usedMax = cache->stats.used;
+	imageCache_evict(cache, cache->config.budget, entry);
+	pthread_cond_broadcast(&cache->doneCond);
+}
+
+static void imageCache_releaseList(imageCache_t *cache, imageCacheEntry_t *entry)
+{
+	while (entry) {
+		imageCacheEntry_t *next = entry->next;
+		cache->config.release(entry->image, cache->config.pArg);
+		free(entry);
+		entry = next;
+	}
+}
+
+/* Resumes queue paused by worker out of memory, called without lock after evicted images are released */
+static void imageCache_resume(imageCache_t *cache)
+{
+	pthread_mutex_lock(&cache->mutex);
+	if (cache->waitCollect) {
+		cache->waitCollect = 0;
+		pthread_cond_broadcast(&cache->queueCond);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/* Decodes entry which is in decoding state, called without lock.
+ * Asynchronous decoding returns NULL with size IMAGE_CACHE_NO_MEMORY when
+ * request must wait for imageCache_collect to release evicted images. */
+static void *imageCache_decode(imageCache_t *cache, imageCacheEntry_t *entry, size_t *size, int async)
+{
+	uint64_t startUs = imageCache_getTimeUs();
+	uint32_t timeUs;
+	void *image;
+
+	*size = 0;
+	image = cache->config.decode(&entry->request, size, cache->config.pArg);
+	if (!image && *size == IMAGE_CACHE_NO_MEMORY) {
+		imageCacheEntry_t *evicted;
+
+		/* Evict half of cache at once */
+		pthread_mutex_lock(&cache->mutex);
+		imageCache_evict(cache, cache->stats.used/2, NULL);
+		evicted = cache->evicted;
+		if (async && evicted) {
+			/* Evicted images may still be drawn, only imageCache_collect may release them */
+			cache->waitCollect = 1;
+			pthread_mutex_unlock(&cache->mutex);
+			dprintf("%s: no memory for %s, waiting for collect\n", __FUNCTION__, entry->request.name);
+			return NULL;
+		}
+		/* Synchronous call comes from drawing thread, which doesn't use evicted images now */
+		cache->evicted = NULL;
+		pthread_mutex_unlock(&cache->mutex);
+		dprintf("%s: no memory for %s, releasing cache\n", __FUNCTION__, entry->request.name);
+		imageCache_releaseList(cache, evicted);
+		imageCache_resume(cache);
+
+		*size = 0;
+		image = cache->config.decode(&entry->request, size, cache->config.pArg);
+	}
+	if (!image)
+		*size = 0;
+
+	timeUs = imageCache_getTimeUs() - startUs;
+	pthread_mutex_lock(&cache->mutex);
+	cache->stats.decodeUsTotal += timeUs;
+	if (timeUs > cache->stats.decodeUsMax)
+		cache->stats.decodeUsMax = timeUs;
+	pthread_mutex_unlock(&cache->mutex);
+	return image;
+}
+
+static void *imageCache_worker(void *pArg)
+{
+	imageCache_t *cache = pArg;
+
+	pthread_mutex_lock(&cache->mutex);
+	for (;;) {
+		imageCacheEntry_t *entry;
+		uint32_t waitUs;
+		void *image;
+		size_t size;
+
+		while (!cache->quit && (!cache->queue.head || cache->waitCollect))
+			pthread_cond_wait(&cache->queueCond, &cache->mutex);
+		if (cache->quit)
+			break;
+
+		entry = cache->queue.head;
+		imageCache_listRemove(&cache->queue, entry);
+		entry->state = imageCacheDecoding;
+		waitUs = imageCache_getTimeUs() - entry->timeUs;
+		cache->stats.waitUsTotal += waitUs;
+		if (waitUs > cache->stats.waitUsMax)
+			cache->stats.waitUsMax = waitUs;
+		pthread_mutex_unlock(&cache->mutex);
+
+		image = imageCache_decode(cache, entry, &size, 1);
+
+		pthread_mutex_lock(&cache->mutex);
+		if (!image && size == IMAGE_CACHE_NO_MEMORY) {
+			size = 0;
+			if (!entry->removed) {
+				/* Decode again after imageCache_collect */
+				entry->state  = imageCacheQueued;
+				entry->timeUs = imageCache_getTimeUs();
+				imageCache_listPush(&cache->queue, entry);
+				cache->stats.starved++;
+				pthread_cond_broadcast(&cache->doneCond);
+				if (cache->config.collect)
+					cache->config.collect(&entry->request, cache->config.pArg);
+				continue;
+			}
+		}
+		if (entry->removed) {
+			imageCache_finish(cache, entry, image, size);
+			continue;
+		}
+		imageCache_finish(cache, entry, image, size);
+		if (cache->config.ready)
+			cache->config.ready(&entry->request, entry->image, cache->config.pArg);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return NULL;
+}
+
+imageCache_t *imageCache_create(const imageCacheConfig_t *config)
+{
+	imageCache_t *cache;
+	int threads;
+
+	if (!config || !config->decode || !config->release)
+		return NULL;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->config = *config;
+	pthread_mutex_init(&cache->mutex, NULL);
+	pthread_cond_init(&cache->queueCond, NULL);
+	pthread_cond_init(&cache->doneCond, NULL);
+
+	threads = config->threads > 0 ? config->threads : IMAGE_CACHE_DEFAULT_THREADS;
+	if (threads > IMAGE_CACHE_MAX_THREADS)
+		threads = IMAGE_CACHE_MAX_THREADS;
+	for (cache->workerCount = 0; cache->workerCount < threads; cache->workerCount++) {
+		if (pthread_create(&cache->workers[cache->workerCount], NULL, imageCache_worker, cache) != 0) {
+			eprintf("%s: failed to start decode worker: %m\n", __FUNCTION__);
+			break;
+		}
+	}
+	return cache;
+}
+
+void *imageCache_get(imageCache_t *cache, const imageCacheRequest_t *request, int flags)
+{
+	imageCacheEntry_t *entry;
+	uint32_t hash;
+	void *image;
+	size_t size;
+	int removed;
+
+	if (!cache || !request || !request->name)
+		return NULL;
+	/* Without workers everything is decoded synchronously */
+	if (cache->workerCount == 0)
+		flags &= ~IMAGE_CACHE_ASYNC;
+	hash = imageCache_hash(request->name, request->variant);
+
+	pthread_mutex_lock(&cache->mutex);
+	for (;;) {
+		entry = imageCache_find(cache, request->name, request->variant, hash);
+		if (!entry)
+			break;
+		switch (entry->state) {
+			case imageCacheReady:
+				cache->stats.hits++;
+				imageCache_listRemove(&cache->lru, entry);
+				imageCache_listPush(&cache->lru, entry);
+				image = entry->image;
+				pthread_mutex_unlock(&cache->mutex);
+				return image;
+			case imageCacheFailed:
+				if (imageCache_getTimeUs() - entry->timeUs < IMAGE_CACHE_RETRY_MS*1000ULL) {
+					cache->stats.hits++;
+					pthread_mutex_unlock(&cache->mutex);
+					return NULL;
+				}
+				imageCache_unlink(cache, entry);
+				free(entry);
+				break;
+			case imageCacheQueued:
+				if (flags & (IMAGE_CACHE_ASYNC|IMAGE_CACHE_LOOKUP)) {
+					/* Requested again, so it is still on screen */
+					cache->stats.pendingHits++;
+					imageCache_listRemove(&cache->queue, entry);
+					imageCache_listPush(&cache->queue, entry);
+					pthread_mutex_unlock(&cache->mutex);
+					return NULL;
+				}
+				imageCache_listRemove(&cache->queue, entry);
+				goto decode;
+			case imageCacheDecoding:
+				if (flags & (IMAGE_CACHE_ASYNC|IMAGE_CACHE_LOOKUP)) {
+					cache->stats.pendingHits++;
+					pthread_mutex_unlock(&cache->mutex);
+					return NULL;
+				}
+				pthread_cond_wait(&cache->doneCond, &cache->mutex);
+				continue;
+		}
+		break;
+	}
+
+	cache->stats.misses++;
+	if (flags & IMAGE_CACHE_LOOKUP) {
+		pthread_mutex_unlock(&cache->mutex);
+		return NULL;
+	}
+	entry = imageCache_createEntry(cache, request, hash);
+	if (!entry) {
+		pthread_mutex_unlock(&cache->mutex);
+		return NULL;
+	}
+	if (flags & IMAGE_CACHE_ASYNC) {
+		entry->state  = imageCacheQueued;
+		entry->timeUs = imageCache_getTimeUs();
+		imageCache_listPush(&cache->queue, entry);
+		while (cache->queue.count > IMAGE_CACHE_MAX_PENDING) {
+			imageCacheEntry_t *oldest = cache->queue.tail;
+			imageCache_listRemove(&cache->queue, oldest);
+			imageCache_hashRemove(cache, oldest);
+			free(oldest);
+			cache->stats.dropped++;
+		}
+		pthread_cond_signal(&cache->queueCond);
+		pthread_mutex_unlock(&cache->mutex);
+		return NULL;
+	}
+
+decode:
+	entry->state = imageCacheDecoding;
+	pthread_mutex_unlock(&cache->mutex);
+
+	image = imageCache_decode(cache, entry, &size, 0);
+
+	pthread_mutex_lock(&cache->mutex);
+	removed = entry->removed;
+	imageCache_finish(cache, entry, image, size);
+	pthread_mutex_unlock(&cache->mutex);
+	return removed ? NULL : image;
+}
+
+/* Must be called with cache locked, queued and ready entries are released at once */
+static void imageCache_removeEntry(imageCache_t *cache, imageCacheEntry_t *entry, imageCacheEntry_t **released)
+{
+	switch (entry->state) {
+		case imageCacheQueued:
+			imageCache_listRemove(&cache->queue, entry);
+			imageCache_hashRemove(cache, entry);
+			free(entry);
+			break;
+		case imageCacheDecoding:
+			imageCache_hashRemove(cache, entry);
+			entry->removed = 1;
+			break;
+		case imageCacheReady:
+		case imageCacheFailed:
+			imageCache_unlink(cache, entry);
+			if (entry->image) {
+				entry->next = *released;
+				*released = entry;
+			} else
+				free(entry);
+			break;
+	}
+}
+
+int imageCache_remove(imageCache_t *cache, const char *name)
+{
+	imageCacheEntry_t *released = NULL;
+	int count = 0;
+	int i;
+
+	if (!cache || !name)
+		return 0;
+	pthread_mutex_lock(&cache->mutex);
+	/* Variants are hashed apart, so whole table is scanned */
+	for (i = 0; i < IMAGE_CACHE_HASH_SIZE; i++) {
+		imageCacheEntry_t *entry = cache->hash[i];
+		while (entry) {
+			imageCacheEntry_t *next = entry->hashNext;
+			if (strcmp(entry->request.name, name) == 0) {
+				imageCache_removeEntry(cache, entry, &released);
+				count++;
+			}
+			entry = next;
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	imageCache_releaseList(cache, released);
+	return count;
+}
+
+void imageCache_clear(imageCache_t *cache, char **keep, int keepCount)
+{
+	imageCacheEntry_t *released;
+	int i, k;
+
+	if (!cache)
+		return;
+	pthread_mutex_lock(&cache->mutex);
+	released = cache->evicted;
+	cache->evicted = NULL;
+	for (i = 0; i < IMAGE_CACHE_HASH_SIZE; i++) {
+		imageCacheEntry_t *entry = cache->hash[i];
+		while (entry) {
+			imageCacheEntry_t *next = entry->hashNext;
+			for (k = 0; k < keepCount; k++)
+				if (keep[k] && strcmp(entry->request.name, keep[k]) == 0)
+					break;
+			if (k == keepCount)
+				imageCache_removeEntry(cache, entry, &released);
+			entry = next;
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	imageCache_releaseList(cache, released);
+	imageCache_resume(cache);
+}
+
+void imageCache_collect(imageCache_t *cache)
+{
+	imageCacheEntry_t *evicted;
+
+	if (!cache)
+		return;
+	pthread_mutex_lock(&cache->mutex);
+	evicted = cache->evicted;
+	cache->evicted = NULL;
+	pthread_mutex_unlock(&cache->mutex);
+	imageCache_releaseList(cache, evicted);
+	imageCache_resume(cache);
+}
+
+void imageCache_getStats(imageCache_t *cache, imageCacheStats_t *stats)
+{
+	pthread_mutex_lock(&cache->mutex);
+	*stats = cache->stats;
+	stats->entries = cache->lru.count;
+	stats->pending = cache->queue.count;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+void imageCache_destroy(imageCache_t *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	pthread_mutex_lock(&cache->mutex);
+	cache->quit = 1;
+	pthread_cond_broadcast(&cache->queueCond);
+	pthread_mutex_unlock(&cache->mutex);
+	for (i = 0; i < cache->workerCount; i++)
+		pthread_join(cache->workers[i], NULL);
+
+	imageCache_clear(cache, NULL, 0);
+	pthread_cond_destroy(&cache->doneCond);
+	pthread_cond_destroy(&cache->queueCond);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
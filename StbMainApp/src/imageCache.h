@@ -0,0 +1,210 @@
+#if !defined(__IMAGE_CACHE_H)
+#define __IMAGE_CACHE_H
+
+/*
+ imageCache.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file imageCache.h Decoded image cache with background decoding
+ * Images are looked up by name and variant through a hash table and kept in
+ * LRU order. Cache is limited by total size of decoded images; least recently
+ * used ones are evicted when it is exceeded.
+ *
+ * Requests made with IMAGE_CACHE_ASYNC return NULL at once and are decoded
+ * by worker threads, most recent request first, so images which have just
+ * appeared on screen are ready before the ones that were scrolled away.
+ * Ready callback tells when decoded image may be drawn.
+ *
+ * Image returned by imageCache_get may be evicted by another thread at any
+ * moment, so evicted images are only released by imageCache_collect, which
+ * is called when returned images are no longer used, e.g. after flip.
+ * When a worker runs out of memory, it evicts half of cache and workers wait
+ * for imageCache_collect to release it before decoding the request again.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+#define IMAGE_CACHE_DEFAULT_THREADS (2)
+#define IMAGE_CACHE_MAX_THREADS     (8)
+/** Older requests are dropped when queue is longer */
+#define IMAGE_CACHE_MAX_PENDING     (64)
+/** Failed images are not decoded again for this time */
+#define IMAGE_CACHE_RETRY_MS        (5000)
+
+/** Flags for imageCache_get */
+#define IMAGE_CACHE_ASYNC (0x01) /**< Queue decoding instead of doing it in caller thread */
+#define IMAGE_CACHE_LOOKUP (0x02) /**< Only return already decoded image, never decode */
+
+/** Size reported by decode callback when image didn't fit into memory */
+#define IMAGE_CACHE_NO_MEMORY ((size_t)-1)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct imageCache_s imageCache_t;
+
+typedef struct
+{
+	const char *name;     /**< Cache key, together with variant */
+	int         variant;
+	const char *path;     /**< File to decode, NULL if it is name itself */
+	int         width;
+	int         height;
+	void       *owner;    /**< Passed to ready callback */
+} imageCacheRequest_t;
+
+/**
+ *  @brief Decodes requested image
+ *
+ *  @param[out] size  Bytes taken by decoded image, IMAGE_CACHE_NO_MEMORY if
+ *                    there was no memory for it, then cache makes room and
+ *                    calls it once more
+ *
+ *  @return Decoded image, NULL on failure
+ */
+typedef void *(*imageCacheDecodeFunc)(const imageCacheRequest_t *request, size_t *size, void *pArg);
+
+typedef void  (*imageCacheReleaseFunc)(void *image, void *pArg);
+
+/**
+ *  @brief Called from worker thread after asynchronous request was decoded
+ *
+ *  Cache is locked during the call, so imageCache functions must not be used.
+ *
+ *  @param[in] image  Decoded image, NULL if decoding failed
+ */
+typedef void  (*imageCacheReadyFunc)(const imageCacheRequest_t *request, void *image, void *pArg);
+
+/**
+ *  @brief Called from worker thread when request ran out of memory and waits
+ *  for imageCache_collect to release evicted images, e.g. to schedule a flip
+ *
+ *  Cache is locked during the call, so imageCache functions must not be used.
+ */
+typedef void  (*imageCacheCollectFunc)(const imageCacheRequest_t *request, void *pArg);
+
+typedef struct
+{
+	size_t                budget;    /**< Total size of cached images */
+	int                   threads;   /**< Decode workers, 0 selects IMAGE_CACHE_DEFAULT_THREADS */
+	imageCacheDecodeFunc  decode;
+	imageCacheReleaseFunc release;
+	imageCacheReadyFunc   ready;     /**< May be NULL */
+	imageCacheCollectFunc collect;   /**< May be NULL, but then queue waits for some unrelated imageCache_collect */
+	void                 *pArg;      /**< Passed to callbacks */
+} imageCacheConfig_t;
+
+typedef struct
+{
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t pendingHits;   /**< Requests for images still being decoded */
+	uint32_t decoded;
+	uint32_t failed;
+	uint32_t dropped;       /**< Pending requests dropped from full queue */
+	uint32_t evicted;
+	uint32_t starved;       /**< Asynchronous requests put back to wait for imageCache_collect after running out of memory */
+	uint32_t entries;
+	uint32_t pending;
+	size_t   used;
+	size_t   usedMax;
+	uint32_t decodeUsMax;
+	uint64_t decodeUsTotal; /**< Divide by decoded+failed for average */
+	uint32_t waitUsMax;     /**< Longest time asynchronous request waited for worker */
+	uint64_t waitUsTotal;
+} imageCacheStats_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Creates cache and starts decode workers
+ *
+ *  @return Cache handle, NULL on failure
+ */
+imageCache_t *imageCache_create(const imageCacheConfig_t *config);
+
+/**
+ *  @brief Returns decoded image, decoding it if needed
+ *
+ *  Without IMAGE_CACHE_ASYNC image is decoded in caller thread, or caller
+ *  waits for worker which is already decoding it.
+ *
+ *  @return Image, NULL if it failed to decode or is not decoded yet
+ */
+void *imageCache_get(imageCache_t *cache, const imageCacheRequest_t *request, int flags);
+
+/**
+ *  @brief Releases all variants of named image at once
+ *
+ *  Caller must make sure image is not used anymore.
+ *
+ *  @return Number of removed entries
+ */
+int imageCache_remove(imageCache_t *cache, const char *name);
+
+/**
+ *  @brief Releases all images except the ones named in keep array
+ */
+void imageCache_clear(imageCache_t *cache, char **keep, int keepCount);
+
+/**
+ *  @brief Releases evicted images
+ *
+ *  Must be called when none of images returned by imageCache_get is in use.
+ */
+void imageCache_collect(imageCache_t *cache);
+
+void imageCache_getStats(imageCache_t *cache, imageCacheStats_t *stats);
+
+/**
+ *  @brief Stops workers, drops pending requests and releases all images
+ */
+void imageCache_destroy(imageCache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMAGE_CACHE_H      Do not add any thing below this line */
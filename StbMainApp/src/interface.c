@@ -51,6 +51,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pvr.h"
 #include "stsdk.h"
 #include "helper.h"
+#include "scheduler.h"
+#include "fontCache.h"
 #ifdef STB225
 #include "Stb225.h"
 #endif
@@ -135,16 +137,15 @@ typedef struct
 
 #ifdef ENABLE_FUSION
 extern interfaceFusionObject_t FusionObject;
-#endif
 
-static pthread_t interfaceEventThread;
+/* creepline band of frame buffer, drawn and flipped by creep thread only */
+static IDirectFBSurface *interface_fusionCreepBand = NULL;
+static int interface_fusionCreepBandY = -1;
+#endif
 
 /* display semaphore */
 static pmysem_t  interface_semaphore;
 
-/* event semaphore */
-static pmysem_t  event_semaphore;
-
 static const int interface_confirmBoxIcons[4] =
 { statusbar_f1_cancel, statusbar_f2_ok, 0, 0 };
 static const int interface_textBoxIcons[4] =
@@ -2132,76 +2133,86 @@ void interface_displayDtmf(void)
 #endif
 
 #ifdef ENABLE_FUSION
-void interface_updateFusionCreepSurface()
+void interface_startFusionCreep(void)
 {
-	int positionDst, positionSrc;
-	DFBRectangle srcRect;
-	DFBRegion region;
-	int dstX, dstY;
+	FusionObject.creep.deltaTime = 0;
+	FusionObject.creep.isShown = 0;
+	FusionObject.creep.startTime = fusionCreep_getTime();
+}
 
-	if (!fusion_surface) return;
-	if (FusionObject.creep.startTime <= 0) return;
-
-	//FusionObject.creep.deltaTime += 1;
-	FusionObject.creep.deltaTime += 2;
-	positionDst = interfaceInfo.screenWidth - FusionObject.creep.deltaTime;
-	positionSrc = 0;
-
-	if (positionDst < 0){
-		positionSrc = - positionDst;
-		positionDst = 0;
-		if (positionSrc > FusionObject.creepWidth){ // all creep is shown
-			FusionObject.creep.isShown = 1;
-			FusionObject.creep.startTime = 0;
-			FusionObject.creep.deltaTime = 0;
-
-			if (!FusionObject.creepline){
-				//eprintf ("%s(%d): All creep is shown. Clear surface.\n", __FUNCTION__, __LINE__);
-				pthread_mutex_lock(&FusionObject.mutexDtmf);
-				if (fusion_surface){
-					int width, height;
-					fusion_surface->GetSize (fusion_surface, &width, &height);
-					gfx_drawRectangle(fusion_surface, 0x0, 0x0, 0x0, 0x0, 0, 0, width, height);
-				}
-				pthread_mutex_unlock(&FusionObject.mutexDtmf);
-			}
-			return;
-		}
+void interface_releaseFusionCreepSurface(void)
+{
+	if (interface_fusionCreepBand) {
+		interface_fusionCreepBand->Release(interface_fusionCreepBand);
+		interface_fusionCreepBand = NULL;
 	}
-/*
-	srcRect.x = positionSrc;
-	srcRect.y = 0;
-	srcRect.w = min(interfaceInfo.screenWidth - positionDst, FusionObject.creepWidth - positionSrc);
-	srcRect.h = FUSION_SURF_HEIGHT;
-*/
+	interface_fusionCreepBandY = -1;
+}
 
-	srcRect.x = positionSrc;
-	srcRect.y = 0;
-	srcRect.w = FusionObject.creepWidth + 10;//min(interfaceInfo.screenWidth - positionDst, FusionObject.creepWidth - positionSrc);
-	srcRect.h = FUSION_SURF_HEIGHT;
+static int interface_blitFusionCreep(void *pArg, const fusionCreepFrame_t *frame)
+{
+	DFBRectangle srcRect = { frame->srcX, 0, frame->width, FUSION_SURF_HEIGHT };
 
-	if ((positionSrc > 0) && (srcRect.w < interfaceInfo.screenWidth)){
-		srcRect.w = interfaceInfo.screenWidth;
-	}
+	if (!fusion_surface) return -1;
+	DFBCHECK (interface_fusionCreepBand->Blit(interface_fusionCreepBand, fusion_surface, &srcRect, frame->dstX, 0));
+	return 0;
+}
 
-	dstX = positionDst;
-	dstY = FusionObject.creepY;
+static void interface_flipFusionCreep(void *pArg, int x1, int x2)
+{
+	DFBRegion region = { x1, 0, x2, FUSION_SURF_HEIGHT - 1 };
 
-	region.x1 = dstX;
-	region.x2 = interfaceInfo.screenWidth;
-	region.y1 = FusionObject.creepY;
-	region.y2 = FusionObject.creepY + FUSION_SURF_HEIGHT;
+	DFBCHECK (interface_fusionCreepBand->Flip(interface_fusionCreepBand, &region, DSFLIP_ONSYNC));
+}
 
-	mysem_get(interface_semaphore);
+/* Only creep band is drawn and flipped, interface_semaphore is not taken.
+ * mutexDtmf protects fusion_surface replacement and is held only during blit. */
+void interface_updateFusionCreepSurface()
+{
+	static const fusionCreepOutput_t output = {
+		interface_blitFusionCreep,
+		interface_flipFusionCreep,
+		&FusionObject.mutexDtmf,
+		NULL
+	};
+	unsigned long long startTime = FusionObject.creep.startTime;
+	fusionCreepFrame_t frame;
 
-	pthread_mutex_lock(&FusionObject.mutexDtmf);
-	DFBCHECK (pgfx_frameBuffer->Blit(pgfx_frameBuffer, fusion_surface, &srcRect, dstX, dstY));  // Blit is faster than StretchBlit
-	pthread_mutex_unlock(&FusionObject.mutexDtmf);
+	if (!fusion_surface) return;
+	if (startTime <= 0) return;
 
-	DFBCHECK (pgfx_frameBuffer->Flip(pgfx_frameBuffer, &region, DSFLIP_ONSYNC));
+	if (fusionCreep_getFrame(fusionCreep_getTime() - startTime, (int)FusionObject.creep.deltaTime,
+	                         FusionObject.creepWidth, interfaceInfo.screenWidth, &frame) != 0)
+		return;
+	FusionObject.creep.deltaTime = frame.offset;
 
-	mysem_release(interface_semaphore);
-	return;
+	if (interface_fusionCreepBandY != FusionObject.creepY) {
+		DFBRectangle band = { 0, FusionObject.creepY, interfaceInfo.screenWidth, FUSION_SURF_HEIGHT };
+		interface_releaseFusionCreepSurface();
+		DFBCHECK (pgfx_frameBuffer->GetSubSurface(pgfx_frameBuffer, &band, &interface_fusionCreepBand));
+		if (!interface_fusionCreepBand) return;
+		interface_fusionCreepBandY = FusionObject.creepY;
+	}
+
+	if (fusionCreep_drawFrame(&output, &frame) != 0)
+		return;
+
+	if (frame.finished) {
+		FusionObject.creep.isShown = 1;
+		FusionObject.creep.startTime = 0;
+		FusionObject.creep.deltaTime = 0;
+
+		if (!FusionObject.creepline){
+			//eprintf ("%s(%d): All creep is shown. Clear surface.\n", __FUNCTION__, __LINE__);
+			pthread_mutex_lock(&FusionObject.mutexDtmf);
+			if (fusion_surface){
+				int width, height;
+				fusion_surface->GetSize (fusion_surface, &width, &height);
+				gfx_drawRectangle(fusion_surface, 0x0, 0x0, 0x0, 0x0, 0, 0, width, height);
+			}
+			pthread_mutex_unlock(&FusionObject.mutexDtmf);
+		}
+	}
 }
 #endif
 
@@ -5005,51 +5016,7 @@ static int interface_listEntryDisplay(interfaceMenu_t* pMenu, DFBRectangle *rect
 
 int getMaxStringLengthForFont(IDirectFBFont *font, const char *string, int maxWidth)
 {
-	int total_length, width, pos, last_length, real_length;
-
-	total_length = 0;
-	real_length = strlen(string);
-
-	DFBCHECK( font->GetStringWidth(font, string, -1, &width) );
-
-	/* Do we have a short string */
-	if (width <= maxWidth)
-	{
-		return real_length;
-	}
-
-	/* Try guessing the expected length */
-	pos = maxWidth*(real_length-6)/width;
-	if (pos > 0 && pos < real_length)
-	{
-		while ((string[pos] & 0xC0) == 0x80)
-		{
-			pos++;
-		}
-		DFBCHECK( font->GetStringWidth(font, string, pos, &width) );
-		if (width <= maxWidth)
-		{
-			total_length = pos;
-		}
-	}
-
-	/* Count symbols in string and check length */
-	while (string[total_length] != 0)
-	{
-		last_length = total_length;
-		total_length++;
-		while ((string[total_length] & 0xC0) == 0x80)
-		{
-			total_length++;
-		}
-		DFBCHECK( font->GetStringWidth(font, string, total_length, &width) );
-		if (width > maxWidth)
-		{
-			return last_length;
-		}
-	}
-
-	return total_length;
+	return fontCache_fitString(font, string, maxWidth);
 }
 
 int getMaxStringLengthForFontWW(IDirectFBFont *font, const char *string, int maxWidth)
@@ -6693,78 +6660,6 @@ int fusion_enterPassword(interfaceMenu_t *pMenu, char *value, void* pArg)
 }
 #endif
 
-static void interface_ThreadTerm(void* pArg)
-{
-	mysem_release(event_semaphore);
-	interfaceEventThread = 0;
-}
-
-
-static void *interface_EventThread(void *pArg)
-{
-	int n, i;
-	struct timeval tv;
-	void *pEventArg;
-	eventActionFunction pAction;
-
-	//dprintf("interface: event thread in\n");
-
-	pthread_cleanup_push(interface_ThreadTerm, pArg);
-
-	while (keepCommandLoopAlive)
-	{
-		pthread_testcancel();
-		usleep(100000);
-		pthread_testcancel();
-
-		mysem_get(event_semaphore);
-
-		//dprintf("interface: check events %d\n", interfaceInfo.eventCount);
-		if ( interfaceInfo.eventCount > 0 )
-		{
-			for ( n=0; n<interfaceInfo.eventCount; n++ )
-			{
-				gettimeofday(&tv, NULL);
-				//dprintf("interface: check event %d count %d start %d time %d diff %d\n", n, interfaceInfo.event[n].counter, interfaceInfo.event[n].startTime, time(0), time(0) - interfaceInfo.event[n].startTime);
-				if ( (unsigned long long)(tv.tv_sec - interfaceInfo.event[n].startTime.tv_sec)*(unsigned long long)1000000+(unsigned long long)(tv.tv_usec - interfaceInfo.event[n].startTime.tv_usec) >= (unsigned long long)interfaceInfo.event[n].counter*(unsigned long long)1000 )
-				{
-					pAction = interfaceInfo.event[n].pAction;
-					pEventArg = interfaceInfo.event[n].pArg;
-					/* remove event */
-					for ( i=n; i<interfaceInfo.eventCount-1;i++ )
-					{
-						interfaceInfo.event[i] = interfaceInfo.event[i+1];
-					}
-					interfaceInfo.eventCount--;
-					//dprintf("interface: execute event %d\n", n);
-					/* execute event */
-					//mysem_release(event_semaphore);
-					if ( pAction != NULL && keepCommandLoopAlive )
-					{
-						pthread_t id;
-						if (pthread_create(&id, NULL, (void *(*)(void*))pAction, pEventArg) == 0)
-						{
-							pthread_detach(id);
-						} else
-						{
-							eprintf("interface: Failed to create event-action thread!\n");
-						}
-						//pAction(pEventArg);
-					}
-					//mysem_get(event_semaphore);
-					/* start over since someone might changed sequence during execution of action */
-					n = 0;
-				}
-			}
-		}
-
-		mysem_release(event_semaphore);
-	}
-
-	pthread_cleanup_pop(1);
-	return 0;
-}
-
 static int interface_hideMessageBoxEvent(void *pArg)
 {
 	//dprintf("interface: hide messagebox\n");
@@ -6965,81 +6860,12 @@ void interface_playControlHide(int redraw)
 
 int s_interface_addEvent(eventActionFunction pAction, void *pArg, int counter, int replaceSimilar)
 {
-	int eid, i;
-
-	mysem_get(event_semaphore);
-
-	//dprintf("%s: called\n", __FUNCTION__);
-
-	eid = -1;
-
-	if ( replaceSimilar )
-	{
-		for ( i=0; i<interfaceInfo.eventCount; i++ )
-		{
-			if ( interfaceInfo.event[i].pAction == pAction && interfaceInfo.event[i].pArg == pArg )
-			{
-				eid = i;
-				//dprintf("%s: refresh event %d\n", __FUNCTION__, eid);
-				break;
-			}
-		}
-	}
-
-	if ( (interfaceInfo.eventCount < MAX_EVENTS || eid != -1) && pAction != NULL )
-	{
-		//dprintf("%s: adding/updating %d\n", __FUNCTION__, eid);
-		interfaceInfo.event[eid == -1 ? interfaceInfo.eventCount : eid].pAction = pAction;
-		interfaceInfo.event[eid == -1 ? interfaceInfo.eventCount : eid].pArg = pArg;
-		interfaceInfo.event[eid == -1 ? interfaceInfo.eventCount : eid].counter = counter;
-		gettimeofday(&interfaceInfo.event[eid == -1 ? interfaceInfo.eventCount : eid].startTime, NULL);
-		if ( eid == -1 )
-		{
-			interfaceInfo.eventCount++;
-		}
-	} else
-	{
-		//dprintf("%s: failed\n", __FUNCTION__);
-		mysem_release(event_semaphore);
-		return -1;
-	}
-
-	mysem_release(event_semaphore);
-
-	return interfaceInfo.eventCount;
+	return scheduler_addEvent(pAction, pArg, counter, replaceSimilar);
 }
 
-
 int interface_removeEvent(eventActionFunction pAction, void *pArg)
 {
-	int n, i;
-
-	mysem_get(event_semaphore);
-
-	for ( n=0; n<interfaceInfo.eventCount; n++ )
-	{
-		if ( interfaceInfo.event[n].pAction == pAction && interfaceInfo.event[n].pArg == pArg )
-		{
-			break;
-		}
-	}
-
-	if ( interfaceInfo.eventCount > 0 && n < interfaceInfo.eventCount )
-	{
-		for ( i=n; i<interfaceInfo.eventCount-1; i++ )
-		{
-			interfaceInfo.event[i] = interfaceInfo.event[i+1];
-		}
-		interfaceInfo.eventCount--;
-	} else
-	{
-		mysem_release(event_semaphore);
-		return -1;
-	}
-
-	mysem_release(event_semaphore);
-
-	return n;
+	return scheduler_removeEvent(pAction, pArg);
 }
 
 static int interface_animationFrameEvent(void *pArg)
@@ -7098,8 +6924,6 @@ void interface_init()
 
 	interfaceInfo.showMenu = 0;
 
-	interfaceInfo.eventCount = 0;
-
 	interfaceInfo.keypad.enable = 0;
 	interfaceInfo.keypad.row = 0;
 	interfaceInfo.keypad.cell = 0;
@@ -7253,15 +7077,11 @@ void interface_init()
 	pArrow = gfx_decodeImage(IMAGE_DIR INTERFACE_ARROW_IMAGE, INTERFACE_ARROW_SIZE, INTERFACE_ARROW_SIZE, 0);
 #endif
 	mysem_create(&interface_semaphore);
-	mysem_create(&event_semaphore);
 
-	err = pthread_create (&interfaceEventThread, NULL,
-						  interface_EventThread,
-						  NULL);
+	err = scheduler_init(SCHEDULER_DEFAULT_WORKERS, &keepCommandLoopAlive);
 	if(err) {
-		eprintf("%s: failed to create event thread: %s\n", __FUNCTION__, strerror(err));
+		eprintf("%s: failed to start event scheduler\n", __FUNCTION__);
 	}
-	pthread_detach(interfaceEventThread);
 
 	toggleOnOffMap[0].value = _T("OFF");
 	toggleOnOffMap[1].value = _T("ON");
@@ -7283,19 +7103,11 @@ void interface_resize(void)
 
 void interface_destroy()
 {
-	if ( 0 != interfaceEventThread )
-	{
-		pthread_cancel (interfaceEventThread);
-		dprintf("interface: wait for thread\n");
-		/*Now make sure thread has exited*/
-		while ( interfaceEventThread )
-		{
-			usleep(10000);
-		}
-	}
+	dprintf("interface: wait for scheduler\n");
+	scheduler_printStats();
+	scheduler_destroy();
 	dprintf("interface: cleaned up\n");
 	mysem_destroy(interface_semaphore);
-	mysem_destroy(event_semaphore);
 }
 
 void interface_customSlider(customSliderFunction pFunction, void *pArg, int showOverMenu, int bRedrawFlag)
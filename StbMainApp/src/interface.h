@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "defines.h"
 #include "stb_resource.h"
 #include "app_info.h"
+#include "fusionCreep.h"
 
 #include <limits.h>
 #include <directfb.h>
@@ -97,8 +98,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MENU_ITEM_BACK                          (-1)
 #define MENU_ITEM_MAIN                          (-2)
 
-#define MAX_EVENTS                              (16)
-
 #define NO_LOGO                                 (-1)
 
 #define ALIGN_LEFT                              (0)
@@ -760,14 +759,6 @@ typedef struct
 	int visibleFlag;
 } interfaceSoundControl_t;
 
-typedef struct
-{
-	eventActionFunction pAction;
-	void *pArg;
-	time_t counter;
-	struct timeval startTime;
-} interfaceEvent_t;
-
 typedef enum
 {
 	interfaceMessageBoxNone = 0,
@@ -918,12 +909,9 @@ typedef struct
 
 	char notifyText[MENU_ENTRY_INFO_LENGTH];
 
-	interfaceEvent_t event[MAX_EVENTS];
 	interfaceMessageBox_t messageBox;
 	interfaceMessageList_t messageList;
 	interfaceAnimation_t animation;
-
-	int eventCount;
 #ifdef ENABLE_3D
 	int enable3d;
 	// 	1 - switch on off 3d header
@@ -1080,7 +1068,11 @@ typedef struct _interfaceFusionObject_t {
 
 } interfaceFusionObject_t;
 
+/** Draws creepline at position reached by now, called every FUSION_CREEP_FRAME_MS */
 void interface_updateFusionCreepSurface();
+/** Starts scrolling creepline from the right edge of screen */
+void interface_startFusionCreep(void);
+void interface_releaseFusionCreepSurface(void);
 #endif
 
 struct __toggleEntryArg_t;
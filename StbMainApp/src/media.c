@@ -1192,7 +1192,7 @@ int media_slideshowStart()
 #ifdef STBPNX
 		if(gfx_decode_and_render_Image(appControlInfo.slideshowInfo.filename) != 0)
 #else
-		IDirectFBSurface *pImage = gfx_decodeImage(appControlInfo.slideshowInfo.filename,
+		IDirectFBSurface *pImage = gfx_decodeImageNoUpdate(appControlInfo.slideshowInfo.filename,
 			interfaceInfo.screenWidth, interfaceInfo.screenHeight, 0);
 		if (!pImage)
 #endif
@@ -1360,11 +1360,7 @@ void media_slideshowReleaseImage(void)
 {
 	if (appControlInfo.slideshowInfo.filename[0] == 0)
 		return;
-	stb810_gfxImageEntry *entry = gfx_findImageEntryByName(appControlInfo.slideshowInfo.filename);
-	if (entry)
-		gfx_releaseImageEntry(entry);
-	else
-		eprintf("%s: warning: failed to release image entry for %s\n", __FUNCTION__, appControlInfo.slideshowInfo.filename);
+	gfx_releaseImage(appControlInfo.slideshowInfo.filename);
 }
 #endif
 
@@ -0,0 +1,1075 @@
+/*
+ mediaCache.c
+
+Copyright (C) 2015  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "mediaCache.h"
+
+#include "debug.h"
+#include "md5.h"
+
+#include <curl/curl.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define MEDIA_CACHE_MAGIC           "MCACHE1"
+#define MEDIA_CACHE_HASH_LEN        (32)
+#define MEDIA_CACHE_EXT_SIZE        (8)
+#define MEDIA_CACHE_VALIDATOR_SIZE  (128)
+/* Partial files are named ~<key>.part and ~<key>.hdr */
+#define MEDIA_CACHE_PARTIAL_PREFIX  '~'
+#define MEDIA_CACHE_PARTIAL_AGE     (7*24*3600)
+#define MEDIA_CACHE_CONNECT_TIMEOUT (15)
+/* Transfer is dropped and resumed when nothing is received for this long */
+#define MEDIA_CACHE_STALL_TIME      (30)
+#define MEDIA_CACHE_BUFFER_SIZE     (16*1024)
+#define MEDIA_CACHE_RETRY_DELAY     (2)
+#define MEDIA_CACHE_RETRY_DELAY_MAX (60)
+/* Last use time is saved to index only when it moved that much */
+#define MEDIA_CACHE_TOUCH_TIME      (600)
+/* Longest sleep of rate limiter, so busy state changes apply quickly */
+#define MEDIA_CACHE_SHAPING_MS      (200)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct
+{
+	char          key[MEDIA_CACHE_HASH_LEN+1];     /**< md5 of URL and expected size */
+	char          content[MEDIA_CACHE_HASH_LEN+1]; /**< md5 of file data */
+	char          ext[MEDIA_CACHE_EXT_SIZE];
+	int64_t       size;
+	time_t        lastUsed;
+} mediaCacheEntry_t;
+
+struct mediaCache_s
+{
+	pthread_mutex_t    mutex;
+	mediaCacheConfig_t config;
+	char              *directory;
+	mediaCacheEntry_t *entries;
+	int                count;
+	int                capacity;
+	mediaCacheStats_t  stats;
+};
+
+/** Validators of file being downloaded, kept in ~<key>.hdr */
+typedef struct
+{
+	char          etag[MEDIA_CACHE_VALIDATOR_SIZE];
+	char          lastModified[MEDIA_CACHE_VALIDATOR_SIZE];
+	char          contentMd5[MEDIA_CACHE_VALIDATOR_SIZE];
+	int64_t       length;
+} mediaCacheHeaders_t;
+
+typedef struct
+{
+	mediaCache_t        *cache;
+	CURL                *curl;
+	struct curl_slist   *headers;
+	int                  fd;
+	int64_t              size;        /**< Expected size, 0 if unknown */
+	char                 key[MEDIA_CACHE_HASH_LEN+1];
+	char                 partPath[PATH_MAX];
+	char                 hdrPath[PATH_MAX];
+
+	/* State of current response */
+	int64_t              offset;      /**< Partial file size before request */
+	long                 status;
+	int64_t              rangeStart;  /**< -1 if response has no Content-Range */
+	int64_t              total;       /**< Full file size, -1 if unknown */
+	int                  started;
+	mediaCacheHeaders_t  response;
+	mediaCacheHeaders_t  saved;
+	uint64_t             received;
+	unsigned int         resumes;
+
+	/* Rate limiter */
+	int64_t              tokens;
+	unsigned int         shapeTime;
+	char                 error[CURL_ERROR_SIZE];
+} mediaCacheTransfer_t;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static unsigned int mediaCache_getTimeMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static void mediaCache_sleepMs(unsigned int ms)
+{
+	struct timespec ts;
+	ts.tv_sec  = ms/1000;
+	ts.tv_nsec = (ms%1000)*1000000;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+/* Index is written with stdio, so cancellation is held off while it is locked */
+static void mediaCache_lock(mediaCache_t *cache, int *cancelState)
+{
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, cancelState);
+	pthread_mutex_lock(&cache->mutex);
+}
+
+static void mediaCache_unlock(mediaCache_t *cache, int cancelState)
+{
+	pthread_mutex_unlock(&cache->mutex);
+	pthread_setcancelstate(cancelState, NULL);
+}
+
+static void mediaCache_hex(const unsigned char *digest, char *hex)
+{
+	int i;
+	for (i = 0; i < MEDIA_CACHE_HASH_LEN/2; i++)
+		sprintf(&hex[2*i], "%02x", digest[i]);
+}
+
+static int mediaCache_isHash(const char *str, size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (!isxdigit((unsigned char)str[i]))
+			return 0;
+	return 1;
+}
+
+static void mediaCache_makeKey(const char *url, int64_t size, char *key)
+{
+	unsigned char digest[16];
+	md5_state_t state;
+	char sizeStr[32];
+
+	snprintf(sizeStr, sizeof(sizeStr), " %lld", (long long)size);
+	md5_init(&state);
+	md5_append(&state, (const md5_byte_t*)url, strlen(url));
+	md5_append(&state, (const md5_byte_t*)sizeStr, strlen(sizeStr));
+	md5_finish(&state, digest);
+	mediaCache_hex(digest, key);
+}
+
+/* Takes extension of last path segment of url, so players can guess the format */
+static void mediaCache_getExt(const char *url, char *ext)
+{
+	const char *end = url + strcspn(url, "?#");
+	const char *dot = NULL;
+	const char *ptr;
+	size_t len;
+
+	ext[0] = 0;
+	for (ptr = url; ptr < end; ptr++) {
+		if (*ptr == '/')
+			dot = NULL;
+		else if (*ptr == '.')
+			dot = ptr;
+	}
+	if (!dot)
+		return;
+	dot++;
+	len = end - dot;
+	if (len == 0 || len >= MEDIA_CACHE_EXT_SIZE)
+		return;
+	for (ptr = dot; ptr < end; ptr++)
+		if (!isalnum((unsigned char)*ptr))
+			return;
+	memcpy(ext, dot, len);
+	ext[len] = 0;
+}
+
+static void mediaCache_contentPath(mediaCache_t *cache, const mediaCacheEntry_t *entry, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%s%s%s", cache->directory, entry->content,
+	         entry->ext[0] ? "." : "", entry->ext);
+}
+
+static int mediaCache_find(mediaCache_t *cache, const char *key)
+{
+	int i;
+	for (i = 0; i < cache->count; i++)
+		if (strcmp(cache->entries[i].key, key) == 0)
+			return i;
+	return -1;
+}
+
+static int mediaCache_isReferenced(mediaCache_t *cache, const char *content, int except)
+{
+	int i;
+	for (i = 0; i < cache->count; i++)
+		if (i != except && strcmp(cache->entries[i].content, content) == 0)
+			return 1;
+	return 0;
+}
+
+static mediaCacheEntry_t *mediaCache_add(mediaCache_t *cache)
+{
+	if (cache->count == cache->capacity) {
+		int capacity = cache->capacity ? 2*cache->capacity : 16;
+		mediaCacheEntry_t *entries = realloc(cache->entries, capacity*sizeof(*entries));
+		if (!entries)
+			return NULL;
+		cache->entries  = entries;
+		cache->capacity = capacity;
+	}
+	memset(&cache->entries[cache->count], 0, sizeof(mediaCacheEntry_t));
+	return &cache->entries[cache->count++];
+}
+
+/* Removes entry and its file if no other URL refers to the same content */
+static void mediaCache_remove(mediaCache_t *cache, int index)
+{
+	mediaCacheEntry_t *entry = &cache->entries[index];
+
+	if (!mediaCache_isReferenced(cache, entry->content, index)) {
+		char path[PATH_MAX];
+		mediaCache_contentPath(cache, entry, path, sizeof(path));
+		unlink(path);
+	}
+	cache->entries[index] = cache->entries[--cache->count];
+}
+
+static uint64_t mediaCache_usage(mediaCache_t *cache, unsigned int *files)
+{
+	uint64_t used = 0;
+	int i, j;
+
+	if (files)
+		*files = 0;
+	for (i = 0; i < cache->count; i++) {
+		for (j = 0; j < i; j++)
+			if (strcmp(cache->entries[j].content, cache->entries[i].content) == 0)
+				break;
+		if (j < i)
+			continue;
+		used += cache->entries[i].size;
+		if (files)
+			(*files)++;
+	}
+	return used;
+}
+
+static int mediaCache_saveIndex(mediaCache_t *cache)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	FILE *f;
+	int i;
+
+	snprintf(path, sizeof(path), "%s/"MEDIA_CACHE_INDEX_NAME, cache->directory);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (!f) {
+		eprintf("%s: failed to create %s: %m\n", __FUNCTION__, tmp);
+		return -1;
+	}
+	fprintf(f, MEDIA_CACHE_MAGIC"\n");
+	for (i = 0; i < cache->count; i++) {
+		mediaCacheEntry_t *entry = &cache->entries[i];
+		fprintf(f, "%s %s %lld %ld %s\n", entry->key, entry->content, (long long)entry->size,
+		        (long)entry->lastUsed, entry->ext[0] ? entry->ext : "-");
+	}
+	fflush(f);
+	if (ferror(f) || fsync(fileno(f)) != 0) {
+		eprintf("%s: failed to write %s: %m\n", __FUNCTION__, tmp);
+		fclose(f);
+		unlink(tmp);
+		return -1;
+	}
+	fclose(f);
+	if (rename(tmp, path) != 0) {
+		eprintf("%s: failed to rename %s: %m\n", __FUNCTION__, tmp);
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static void mediaCache_loadIndex(mediaCache_t *cache)
+{
+	char path[PATH_MAX];
+	char line[256];
+	FILE *f;
+	int changed = 0;
+
+	snprintf(path, sizeof(path), "%s/"MEDIA_CACHE_INDEX_NAME, cache->directory);
+	f = fopen(path, "r");
+	if (f) {
+		if (!fgets(line, sizeof(line), f) || strncmp(line, MEDIA_CACHE_MAGIC"\n", sizeof(MEDIA_CACHE_MAGIC)) != 0) {
+			eprintf("%s: %s has unknown format\n", __FUNCTION__, path);
+			changed = 1;
+		} else while (fgets(line, sizeof(line), f)) {
+			mediaCacheEntry_t entry, *added;
+			long long size;
+			long lastUsed;
+			char file[PATH_MAX];
+			struct stat st;
+
+			memset(&entry, 0, sizeof(entry));
+			if (sscanf(line, "%32s %32s %lld %ld %7s", entry.key, entry.content, &size, &lastUsed, entry.ext) != 5 ||
+			    strlen(entry.key) != MEDIA_CACHE_HASH_LEN || !mediaCache_isHash(entry.key, MEDIA_CACHE_HASH_LEN) ||
+			    strlen(entry.content) != MEDIA_CACHE_HASH_LEN || !mediaCache_isHash(entry.content, MEDIA_CACHE_HASH_LEN) ||
+			    mediaCache_find(cache, entry.key) >= 0) {
+				changed = 1;
+				continue;
+			}
+			if (strcmp(entry.ext, "-") == 0)
+				entry.ext[0] = 0;
+			entry.size     = size;
+			entry.lastUsed = lastUsed;
+
+			mediaCache_contentPath(cache, &entry, file, sizeof(file));
+			if (stat(file, &st) != 0 || st.st_size != entry.size) {
+				dprintf("%s: dropping %s\n", __FUNCTION__, file);
+				changed = 1;
+				continue;
+			}
+			added = mediaCache_add(cache);
+			if (!added)
+				break;
+			*added = entry;
+		}
+		fclose(f);
+	}
+	if (changed)
+		mediaCache_saveIndex(cache);
+}
+
+/**
+ *  Deletes completed files left without index entry, e.g. by power loss
+ *  before index was saved, and partial files which were not resumed for long.
+ */
+static void mediaCache_removeOrphans(mediaCache_t *cache)
+{
+	DIR *dir = opendir(cache->directory);
+	struct dirent *item;
+	time_t now = time(NULL);
+	int i;
+
+	if (!dir)
+		return;
+	while ((item = readdir(dir)) != NULL) {
+		const char *name = item->d_name;
+		char path[PATH_MAX];
+		struct stat st;
+
+		if (name[0] == MEDIA_CACHE_PARTIAL_PREFIX) {
+			snprintf(path, sizeof(path), "%s/%s", cache->directory, name);
+			if (stat(path, &st) == 0 && st.st_mtime < now - MEDIA_CACHE_PARTIAL_AGE) {
+				dprintf("%s: removing %s\n", __FUNCTION__, path);
+				unlink(path);
+			}
+			continue;
+		}
+		if (strlen(name) < MEDIA_CACHE_HASH_LEN || !mediaCache_isHash(name, MEDIA_CACHE_HASH_LEN) ||
+		    (name[MEDIA_CACHE_HASH_LEN] != 0 && name[MEDIA_CACHE_HASH_LEN] != '.'))
+			continue;
+		for (i = 0; i < cache->count; i++)
+			if (strncmp(cache->entries[i].content, name, MEDIA_CACHE_HASH_LEN) == 0)
+				break;
+		if (i < cache->count)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", cache->directory, name);
+		dprintf("%s: removing %s\n", __FUNCTION__, path);
+		unlink(path);
+	}
+	closedir(dir);
+}
+
+/**
+ *  Deletes least recently used files until reserve more bytes fit into quota.
+ *  Must be called with cache locked.
+ *
+ *  @param[in] keep  Content which is never deleted, may be NULL
+ *
+ *  @return Non-zero if any entry was removed
+ */
+static int mediaCache_evict(mediaCache_t *cache, uint64_t reserve, const char *keep)
+{
+	time_t now = time(NULL);
+	uint64_t used;
+	int removed = 0;
+
+	if (cache->config.quota == 0)
+		return 0;
+	used = mediaCache_usage(cache, NULL);
+	while (used + reserve > cache->config.quota) {
+		int i, oldest = -1;
+
+		for (i = 0; i < cache->count; i++) {
+			mediaCacheEntry_t *entry = &cache->entries[i];
+			/* Time may jump back after it is set from network */
+			if (entry->lastUsed <= now && now - entry->lastUsed < (time_t)cache->config.keepTime)
+				continue;
+			if (keep && strcmp(entry->content, keep) == 0)
+				continue;
+			if (oldest < 0 || entry->lastUsed < cache->entries[oldest].lastUsed)
+				oldest = i;
+		}
+		if (oldest < 0) {
+			eprintf("%s: %llu bytes in use exceed quota, nothing to evict\n", __FUNCTION__,
+			        (unsigned long long)(used + reserve));
+			break;
+		}
+		dprintf("%s: evicting %s.%s\n", __FUNCTION__, cache->entries[oldest].content, cache->entries[oldest].ext);
+		if (!mediaCache_isReferenced(cache, cache->entries[oldest].content, oldest)) {
+			used -= cache->entries[oldest].size;
+			cache->stats.evicted++;
+		}
+		mediaCache_remove(cache, oldest);
+		removed = 1;
+	}
+	return removed;
+}
+
+static void mediaCache_loadHeaders(const char *path, mediaCacheHeaders_t *headers)
+{
+	char line[MEDIA_CACHE_VALIDATOR_SIZE+32];
+	FILE *f;
+
+	memset(headers, 0, sizeof(*headers));
+	headers->length = -1;
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (strncmp(line, "ETag: ", 6) == 0)
+			snprintf(headers->etag, sizeof(headers->etag), "%s", line+6);
+		else if (strncmp(line, "Last-Modified: ", 15) == 0)
+			snprintf(headers->lastModified, sizeof(headers->lastModified), "%s", line+15);
+		else if (strncmp(line, "Content-MD5: ", 13) == 0)
+			snprintf(headers->contentMd5, sizeof(headers->contentMd5), "%s", line+13);
+		else if (strncmp(line, "Length: ", 8) == 0)
+			headers->length = strtoll(line+8, NULL, 10);
+	}
+	fclose(f);
+}
+
+static int mediaCache_saveHeaders(const char *path, const mediaCacheHeaders_t *headers)
+{
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+	if (headers->etag[0])
+		fprintf(f, "ETag: %s\n", headers->etag);
+	if (headers->lastModified[0])
+		fprintf(f, "Last-Modified: %s\n", headers->lastModified);
+	if (headers->contentMd5[0])
+		fprintf(f, "Content-MD5: %s\n", headers->contentMd5);
+	fprintf(f, "Length: %lld\n", (long long)headers->length);
+	return fclose(f);
+}
+
+static void mediaCache_copyValue(char *dst, size_t size, const char *value)
+{
+	size_t len = strcspn(value, "\r\n");
+	if (len >= size)
+		len = size-1;
+	memcpy(dst, value, len);
+	dst[len] = 0;
+}
+
+static size_t mediaCache_headerCallback(char *data, size_t size, size_t nmemb, void *userp)
+{
+	mediaCacheTransfer_t *t = userp;
+	size_t len = size*nmemb;
+	char line[MEDIA_CACHE_VALIDATOR_SIZE+32];
+
+	/* Header data is not NUL terminated, longer lines are of no interest */
+	if (len >= sizeof(line))
+		return len;
+	memcpy(line, data, len);
+	line[len] = 0;
+	line[strcspn(line, "\r\n")] = 0;
+
+	if (strncmp(line, "HTTP/", 5) == 0) {
+		/* New response, previous one was redirect or 100 Continue */
+		const char *code = strchr(line, ' ');
+		t->status     = code ? strtol(code, NULL, 10) : 0;
+		t->rangeStart = -1;
+		t->total      = -1;
+		memset(&t->response, 0, sizeof(t->response));
+		t->response.length = -1;
+	} else if (strncasecmp(line, "Content-Range:", 14) == 0) {
+		const char *ptr = line+14;
+		const char *slash = strchr(ptr, '/');
+		while (*ptr == ' ')
+			ptr++;
+		if (strncasecmp(ptr, "bytes", 5) == 0)
+			ptr += 5;
+		while (*ptr == ' ')
+			ptr++;
+		if (isdigit((unsigned char)*ptr))
+			t->rangeStart = strtoll(ptr, NULL, 10);
+		if (slash && isdigit((unsigned char)slash[1]))
+			t->total = strtoll(slash+1, NULL, 10);
+	} else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+		if (t->status == 200)
+			t->total = strtoll(line+15, NULL, 10);
+	} else if (strncasecmp(line, "ETag:", 5) == 0) {
+		mediaCache_copyValue(t->response.etag, sizeof(t->response.etag), line+5+strspn(line+5, " "));
+	} else if (strncasecmp(line, "Last-Modified:", 14) == 0) {
+		mediaCache_copyValue(t->response.lastModified, sizeof(t->response.lastModified), line+14+strspn(line+14, " "));
+	} else if (strncasecmp(line, "Content-MD5:", 12) == 0) {
+		mediaCache_copyValue(t->response.contentMd5, sizeof(t->response.contentMd5), line+12+strspn(line+12, " "));
+	}
+	return len;
+}
+
+static void mediaCache_shape(mediaCacheTransfer_t *t, size_t len)
+{
+	mediaCacheConfig_t *config = &t->cache->config;
+
+	t->tokens -= len;
+	for (;;) {
+		unsigned int rate = (config->isBusy && config->isBusy(config->pArg)) ? config->busyRate : config->rate;
+		unsigned int now = mediaCache_getTimeMs();
+		int64_t burst = rate/4 > MEDIA_CACHE_BUFFER_SIZE ? rate/4 : MEDIA_CACHE_BUFFER_SIZE;
+		unsigned int ms;
+
+		if (rate == 0) {
+			t->tokens    = 0;
+			t->shapeTime = now;
+			return;
+		}
+		t->tokens += (int64_t)(now - t->shapeTime)*rate/1000;
+		t->shapeTime = now;
+		if (t->tokens > burst)
+			t->tokens = burst;
+		if (t->tokens >= 0)
+			return;
+		ms = -t->tokens*1000/rate + 1;
+		mediaCache_sleepMs(ms < MEDIA_CACHE_SHAPING_MS ? ms : MEDIA_CACHE_SHAPING_MS);
+	}
+}
+
+static size_t mediaCache_writeCallback(char *data, size_t size, size_t nmemb, void *userp)
+{
+	mediaCacheTransfer_t *t = userp;
+	size_t len = size*nmemb;
+	size_t done = 0;
+
+	if (!t->started) {
+		if (t->size > 0 && t->total >= 0 && t->total != t->size)
+			return 0;
+		if (t->status == 206 && t->rangeStart == t->offset) {
+			if (lseek(t->fd, t->offset, SEEK_SET) < 0)
+				return 0;
+			t->resumes++;
+		} else if (t->status == 200) {
+			if (t->offset > 0)
+				dprintf("%s: range was not accepted, restarting %s\n", __FUNCTION__, t->partPath);
+			t->offset = 0;
+			if (ftruncate(t->fd, 0) != 0 || lseek(t->fd, 0, SEEK_SET) < 0)
+				return 0;
+			t->saved = t->response;
+			t->saved.length = t->total;
+			mediaCache_saveHeaders(t->hdrPath, &t->saved);
+		} else {
+			return 0;
+		}
+		t->started = 1;
+	}
+
+	while (done < len) {
+		ssize_t ret = write(t->fd, data+done, len-done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			eprintf("%s: failed to write %s: %m\n", __FUNCTION__, t->partPath);
+			return 0;
+		}
+		done += ret;
+	}
+	t->received += len;
+	mediaCache_shape(t, len);
+	return len;
+}
+
+static void mediaCache_restart(mediaCacheTransfer_t *t)
+{
+	if (ftruncate(t->fd, 0) != 0)
+		eprintf("%s: failed to truncate %s: %m\n", __FUNCTION__, t->partPath);
+	unlink(t->hdrPath);
+}
+
+/**
+ *  Requests remaining part of file once
+ *
+ *  @return 1 if partial file is complete, 0 if transfer should be retried,
+ *          -1 if retrying is useless
+ */
+static int mediaCache_transfer(mediaCacheTransfer_t *t, const char *url)
+{
+	char header[MEDIA_CACHE_VALIDATOR_SIZE+16];
+	char range[32];
+	const char *validator = NULL;
+	struct stat st;
+	int64_t expected;
+	CURLcode res;
+
+	if (fstat(t->fd, &st) != 0)
+		return -1;
+	t->offset = st.st_size;
+	mediaCache_loadHeaders(t->hdrPath, &t->saved);
+	expected = t->size > 0 ? t->size : t->saved.length;
+	if (t->offset > 0 && expected >= 0) {
+		if (t->offset == expected)
+			return 1;
+		if (t->offset > expected) {
+			mediaCache_restart(t);
+			t->offset = 0;
+		}
+	}
+
+	t->status     = 0;
+	t->rangeStart = -1;
+	t->total      = -1;
+	t->started    = 0;
+	memset(&t->response, 0, sizeof(t->response));
+	t->response.length = -1;
+	t->error[0]   = 0;
+	curl_slist_free_all(t->headers);
+	t->headers    = NULL;
+
+	curl_easy_reset(t->curl);
+	curl_easy_setopt(t->curl, CURLOPT_URL, url);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, mediaCache_writeCallback);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
+	curl_easy_setopt(t->curl, CURLOPT_HEADERFUNCTION, mediaCache_headerCallback);
+	curl_easy_setopt(t->curl, CURLOPT_HEADERDATA, t);
+	curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, t->error);
+	curl_easy_setopt(t->curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(t->curl, CURLOPT_MAXREDIRS, 5L);
+	curl_easy_setopt(t->curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(t->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(t->curl, CURLOPT_CONNECTTIMEOUT, (long)MEDIA_CACHE_CONNECT_TIMEOUT);
+	curl_easy_setopt(t->curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(t->curl, CURLOPT_LOW_SPEED_TIME, (long)MEDIA_CACHE_STALL_TIME);
+	curl_easy_setopt(t->curl, CURLOPT_BUFFERSIZE, (long)MEDIA_CACHE_BUFFER_SIZE);
+	curl_easy_setopt(t->curl, CURLOPT_DNS_CACHE_TIMEOUT, 0L); // resolve again after network is re-established
+	if (t->offset > 0) {
+		/* CURLOPT_RESUME_FROM would fail on 200 response, which is expected when If-Range doesn't match */
+		snprintf(range, sizeof(range), "%lld-", (long long)t->offset);
+		curl_easy_setopt(t->curl, CURLOPT_RANGE, range);
+		if (t->saved.etag[0] && strncmp(t->saved.etag, "W/", 2) != 0)
+			validator = t->saved.etag;
+		else if (t->saved.lastModified[0])
+			validator = t->saved.lastModified;
+		if (validator) {
+			snprintf(header, sizeof(header), "If-Range: %s", validator);
+			t->headers = curl_slist_append(NULL, header);
+			curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, t->headers);
+		}
+	}
+
+	t->tokens    = 0;
+	t->shapeTime = mediaCache_getTimeMs();
+	res = curl_easy_perform(t->curl);
+
+	if (t->size > 0 && t->total >= 0 && t->total != t->size) {
+		eprintf("%s: %s has size %lld instead of %lld\n", __FUNCTION__, url, (long long)t->total, (long long)t->size);
+		mediaCache_restart(t);
+		return -1;
+	}
+	if (t->status == 416) {
+		/* Partial file is as long as remote one, or longer if it was changed */
+		if (t->total >= 0 && t->total == t->offset)
+			return 1;
+		mediaCache_restart(t);
+		return 0;
+	}
+	if (res != CURLE_OK) {
+		if (t->status == 206 && !t->started) {
+			eprintf("%s: %s returned unexpected range\n", __FUNCTION__, url);
+			mediaCache_restart(t);
+			return 0;
+		}
+		if (t->status >= 400 && t->status < 500 && t->status != 408 && t->status != 429) {
+			eprintf("%s: %s: HTTP %ld\n", __FUNCTION__, url, t->status);
+			return -1;
+		}
+		eprintf("%s: %s interrupted (%s)\n", __FUNCTION__, url, t->error[0] ? t->error : curl_easy_strerror(res));
+		return 0;
+	}
+	if (!t->started) {
+		/* Empty body */
+		if (t->status != 200)
+			return 0;
+		t->saved = t->response;
+		t->saved.length = t->total;
+		mediaCache_restart(t);
+		mediaCache_saveHeaders(t->hdrPath, &t->saved);
+	}
+
+	if (fstat(t->fd, &st) != 0)
+		return -1;
+	expected = t->size > 0 ? t->size : t->saved.length;
+	if (expected >= 0 && st.st_size != expected) {
+		eprintf("%s: %s ended at %lld of %lld\n", __FUNCTION__, url, (long long)st.st_size, (long long)expected);
+		if (st.st_size > expected)
+			mediaCache_restart(t);
+		return 0;
+	}
+	return 1;
+}
+
+static int mediaCache_decodeBase64(const char *in, unsigned char *out, size_t size)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	unsigned int acc = 0;
+	int bits = 0;
+	size_t len = 0;
+
+	for (; *in && *in != '='; in++) {
+		const char *ptr = strchr(alphabet, *in);
+		if (!ptr)
+			return -1;
+		acc = (acc << 6) | (ptr - alphabet);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (len == size)
+				return -1;
+			out[len++] = (acc >> bits) & 0xff;
+		}
+	}
+	return len;
+}
+
+/**
+ *  Computes md5 of partial file and checks it against Content-MD5.
+ *  ETag is compared too when it looks like md5, as S3 compatible servers
+ *  use it so, but only reported on mismatch as other servers don't.
+ */
+static int mediaCache_verify(mediaCacheTransfer_t *t, const char *url, char *content)
+{
+	unsigned char buffer[MEDIA_CACHE_BUFFER_SIZE];
+	unsigned char digest[16];
+	unsigned char expected[16];
+	md5_state_t state;
+	const char *etag = t->saved.etag;
+	size_t etagLen;
+	ssize_t len;
+
+	md5_init(&state);
+	if (lseek(t->fd, 0, SEEK_SET) < 0)
+		return -1;
+	while ((len = read(t->fd, buffer, sizeof(buffer))) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			eprintf("%s: failed to read %s: %m\n", __FUNCTION__, t->partPath);
+			return -1;
+		}
+		md5_append(&state, buffer, len);
+	}
+	md5_finish(&state, digest);
+	mediaCache_hex(digest, content);
+
+	if (t->saved.contentMd5[0]) {
+		if (mediaCache_decodeBase64(t->saved.contentMd5, expected, sizeof(expected)) != sizeof(expected)) {
+			eprintf("%s: %s has invalid Content-MD5 %s\n", __FUNCTION__, url, t->saved.contentMd5);
+		} else if (memcmp(digest, expected, sizeof(digest)) != 0) {
+			eprintf("%s: %s checksum mismatch\n", __FUNCTION__, url);
+			return -1;
+		}
+	}
+	if (etag[0] == '"')
+		etag++;
+	etagLen = strcspn(etag, "\"");
+	if (etagLen == MEDIA_CACHE_HASH_LEN && mediaCache_isHash(etag, etagLen) && strncasecmp(etag, content, etagLen) != 0)
+		eprintf("%s: %s md5 %s differs from ETag %s\n", __FUNCTION__, url, content, t->saved.etag);
+	return 0;
+}
+
+static int mediaCache_download(mediaCacheTransfer_t *t, const char *url, char *content)
+{
+	mediaCache_t *cache = t->cache;
+	unsigned int retries = cache->config.retries ? cache->config.retries : MEDIA_CACHE_RETRIES;
+	unsigned int delay = MEDIA_CACHE_RETRY_DELAY;
+	unsigned int failures = 0;
+	int cancelState;
+
+	for (;;) {
+		uint64_t received = t->received;
+		int ret = mediaCache_transfer(t, url);
+
+		if (ret < 0)
+			return -1;
+		if (ret > 0) {
+			if (mediaCache_verify(t, url, content) == 0)
+				return 0;
+			mediaCache_lock(cache, &cancelState);
+			cache->stats.rejected++;
+			mediaCache_unlock(cache, cancelState);
+			mediaCache_restart(t);
+		} else if (t->received > received) {
+			/* Connection dropped after some progress, continue soon */
+			failures = 0;
+			delay = MEDIA_CACHE_RETRY_DELAY;
+			mediaCache_sleepMs(delay*1000);
+			continue;
+		}
+		if (++failures >= retries)
+			return -1;
+		mediaCache_sleepMs(delay*1000);
+		delay = 2*delay < MEDIA_CACHE_RETRY_DELAY_MAX ? 2*delay : MEDIA_CACHE_RETRY_DELAY_MAX;
+	}
+}
+
+static int mediaCache_lookup(mediaCache_t *cache, const char *key, char *path, size_t pathSize)
+{
+	char file[PATH_MAX];
+	struct stat st;
+	int cancelState;
+	int index;
+	int ret = -1;
+
+	mediaCache_lock(cache, &cancelState);
+	index = mediaCache_find(cache, key);
+	if (index >= 0) {
+		mediaCacheEntry_t *entry = &cache->entries[index];
+		time_t now = time(NULL);
+
+		mediaCache_contentPath(cache, entry, file, sizeof(file));
+		if (stat(file, &st) == 0 && st.st_size == entry->size) {
+			if (now < entry->lastUsed || now - entry->lastUsed >= MEDIA_CACHE_TOUCH_TIME) {
+				entry->lastUsed = now;
+				mediaCache_saveIndex(cache);
+			}
+			cache->stats.hits++;
+			snprintf(path, pathSize, "%s", file);
+			ret = 0;
+		} else {
+			eprintf("%s: %s is missing or damaged\n", __FUNCTION__, file);
+			mediaCache_remove(cache, index);
+			mediaCache_saveIndex(cache);
+		}
+	}
+	mediaCache_unlock(cache, cancelState);
+	return ret;
+}
+
+/**
+ *  Opens and locks partial file, so only one thread downloads the URL.
+ *  Waiting thread may find the file already renamed to completed one,
+ *  then partial file is opened again.
+ */
+static int mediaCache_openPartial(mediaCacheTransfer_t *t)
+{
+	for (;;) {
+		struct stat st, stPath;
+
+		t->fd = open(t->partPath, O_RDWR|O_CREAT, 0644);
+		if (t->fd < 0) {
+			eprintf("%s: failed to open %s: %m\n", __FUNCTION__, t->partPath);
+			return -1;
+		}
+		while (flock(t->fd, LOCK_EX|LOCK_NB) != 0) {
+			if (errno != EWOULDBLOCK && errno != EINTR)
+				break; // locks are not supported by filesystem
+			mediaCache_sleepMs(500);
+		}
+		if (fstat(t->fd, &st) == 0 && stat(t->partPath, &stPath) == 0 &&
+		    st.st_dev == stPath.st_dev && st.st_ino == stPath.st_ino)
+			return 0;
+		close(t->fd);
+		t->fd = -1;
+	}
+}
+
+static void mediaCache_transferCleanup(void *pArg)
+{
+	mediaCacheTransfer_t *t = pArg;
+
+	if (t->fd >= 0)
+		close(t->fd);
+	if (t->curl)
+		curl_easy_cleanup(t->curl);
+	curl_slist_free_all(t->headers);
+}
+
+int mediaCache_get(mediaCache_t *cache, const char *url, int64_t size, char *path, size_t pathSize)
+{
+	mediaCacheTransfer_t t;
+	mediaCacheEntry_t *entry;
+	char content[MEDIA_CACHE_HASH_LEN+1];
+	char ext[MEDIA_CACHE_EXT_SIZE];
+	char file[PATH_MAX];
+	struct stat st;
+	int cancelState;
+	int ret = -1;
+
+	if (!cache || !url || !path || pathSize == 0)
+		return -1;
+
+	memset(&t, 0, sizeof(t));
+	t.cache = cache;
+	t.fd    = -1;
+	t.size  = size;
+	mediaCache_makeKey(url, size, t.key);
+	if (mediaCache_lookup(cache, t.key, path, pathSize) == 0)
+		return 0;
+	mediaCache_getExt(url, ext);
+	snprintf(t.partPath, sizeof(t.partPath), "%s/%c%s.part", cache->directory, MEDIA_CACHE_PARTIAL_PREFIX, t.key);
+	snprintf(t.hdrPath, sizeof(t.hdrPath), "%s/%c%s.hdr", cache->directory, MEDIA_CACHE_PARTIAL_PREFIX, t.key);
+
+	pthread_cleanup_push(mediaCache_transferCleanup, &t);
+
+	if (mediaCache_openPartial(&t) != 0)
+		goto done;
+	/* Another thread could finish the download while we were waiting */
+	if (mediaCache_lookup(cache, t.key, path, pathSize) == 0) {
+		ret = 0;
+		goto done;
+	}
+	if (size > 0 && fstat(t.fd, &st) == 0 && st.st_size < size) {
+		mediaCache_lock(cache, &cancelState);
+		if (mediaCache_evict(cache, size - st.st_size, NULL))
+			mediaCache_saveIndex(cache);
+		mediaCache_unlock(cache, cancelState);
+	}
+	t.curl = curl_easy_init();
+	if (!t.curl)
+		goto done;
+
+	dprintf("%s: downloading %s\n", __FUNCTION__, url);
+	ret = mediaCache_download(&t, url, content);
+
+	mediaCache_lock(cache, &cancelState);
+	cache->stats.received += t.received;
+	cache->stats.resumes  += t.resumes;
+	if (ret == 0 && fstat(t.fd, &st) == 0 && (entry = mediaCache_add(cache)) != NULL) {
+		snprintf(entry->key, sizeof(entry->key), "%s", t.key);
+		snprintf(entry->content, sizeof(entry->content), "%s", content);
+		snprintf(entry->ext, sizeof(entry->ext), "%s", ext);
+		entry->size     = st.st_size;
+		entry->lastUsed = time(NULL);
+		mediaCache_contentPath(cache, entry, file, sizeof(file));
+		if (rename(t.partPath, file) == 0) {
+			unlink(t.hdrPath);
+			cache->stats.downloads++;
+			mediaCache_evict(cache, 0, content);
+			mediaCache_saveIndex(cache);
+			snprintf(path, pathSize, "%s", file);
+		} else {
+			eprintf("%s: failed to rename %s: %m\n", __FUNCTION__, t.partPath);
+			cache->count--;
+			ret = -1;
+		}
+	} else {
+		ret = -1;
+	}
+	if (ret != 0)
+		cache->stats.failures++;
+	mediaCache_unlock(cache, cancelState);
+
+done:
+	/* Partial file is still locked, so nobody else writes it */
+	if (t.fd >= 0 && fstat(t.fd, &st) == 0 && st.st_size == 0) {
+		unlink(t.partPath);
+		unlink(t.hdrPath);
+	}
+	pthread_cleanup_pop(1);
+	return ret;
+}
+
+void mediaCache_getStats(mediaCache_t *cache, mediaCacheStats_t *stats)
+{
+	int cancelState;
+
+	mediaCache_lock(cache, &cancelState);
+	*stats = cache->stats;
+	stats->used = mediaCache_usage(cache, &stats->files);
+	mediaCache_unlock(cache, cancelState);
+}
+
+mediaCache_t *mediaCache_open(const char *directory, const mediaCacheConfig_t *config)
+{
+	mediaCache_t *cache;
+
+	if (!directory)
+		return NULL;
+	if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+		eprintf("%s: failed to create %s: %m\n", __FUNCTION__, directory);
+		return NULL;
+	}
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->directory = strdup(directory);
+	if (!cache->directory) {
+		free(cache);
+		return NULL;
+	}
+	if (config)
+		cache->config = *config;
+	pthread_mutex_init(&cache->mutex, NULL);
+
+	mediaCache_loadIndex(cache);
+	mediaCache_removeOrphans(cache);
+	if (mediaCache_evict(cache, 0, NULL))
+		mediaCache_saveIndex(cache);
+	return cache;
+}
+
+void mediaCache_close(mediaCache_t *cache)
+{
+	if (!cache)
+		return;
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->entries);
+	free(cache->directory);
+	free(cache);
+}
@@ -0,0 +1,138 @@
+#if !defined(__MEDIA_CACHE_H)
+#define __MEDIA_CACHE_H
+
+/*
+ mediaCache.h
+
+Copyright (C) 2015  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file mediaCache.h Resumable downloader with content addressed file cache
+ * Files are downloaded in-process with curl. Interrupted transfers are kept
+ * as partial files and continued with Range requests, guarded by If-Range,
+ * on next attempt or after reboot.
+ *
+ * Completed files are stored as <md5 of content>.<ext>, so the same media
+ * published under several URLs occupies disk once. An index maps URLs to
+ * content and keeps last use time; least recently used files are deleted
+ * when cache grows over its quota.
+ *
+ * Download rate is limited by sleeping in the write callback, so TCP flow
+ * control slows the sender down. A lower limit applies while isBusy callback
+ * reports that bandwidth is needed elsewhere, e.g. for playback.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+#define MEDIA_CACHE_INDEX_NAME  "mediaCache.idx"
+#define MEDIA_CACHE_RETRIES     (5)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct mediaCache_s mediaCache_t;
+
+typedef int (*mediaCacheBusyFunc)(void *pArg);
+
+typedef struct
+{
+	unsigned int       rate;       /**< Download limit in bytes per second, 0 for unlimited */
+	unsigned int       busyRate;   /**< Limit used while isBusy returns non-zero, 0 for unlimited */
+	uint64_t           quota;      /**< Disk space for completed files in bytes, 0 for unlimited */
+	unsigned int       keepTime;   /**< Files used less than keepTime seconds ago are never evicted */
+	unsigned int       retries;    /**< Attempts per mediaCache_get, 0 selects MEDIA_CACHE_RETRIES */
+	mediaCacheBusyFunc isBusy;     /**< May be NULL */
+	void              *pArg;
+} mediaCacheConfig_t;
+
+typedef struct
+{
+	unsigned int       hits;
+	unsigned int       downloads;  /**< Completed downloads */
+	unsigned int       resumes;    /**< Transfers continued from partial file */
+	unsigned int       failures;   /**< mediaCache_get calls which gave up */
+	unsigned int       rejected;   /**< Files which failed size or checksum verification */
+	unsigned int       evicted;
+	uint64_t           received;   /**< Body bytes received */
+	uint64_t           used;       /**< Disk space taken by completed files */
+	unsigned int       files;
+} mediaCacheStats_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Loads index of directory, dropping entries whose files are missing
+ *
+ *  Completed files which are not in index are deleted, partial files are kept
+ *  for resuming unless they were not touched for a week.
+ *
+ *  @return Cache handle, NULL on failure
+ */
+mediaCache_t *mediaCache_open(const char *directory, const mediaCacheConfig_t *config);
+
+/**
+ *  @brief Returns path of cached copy of url, downloading it if needed
+ *
+ *  Blocks until file is complete or retries are exhausted. Each retry
+ *  continues from the data already received. May be called from several
+ *  threads, and thread may be cancelled while downloading.
+ *
+ *  @param[in]  size  Expected file size, 0 if unknown. Same URL with different
+ *                    size is treated as new file.
+ *
+ *  @return 0 on success, -1 on failure
+ */
+int mediaCache_get(mediaCache_t *cache, const char *url, int64_t size, char *path, size_t pathSize);
+
+void mediaCache_getStats(mediaCache_t *cache, mediaCacheStats_t *stats);
+
+/**
+ *  @brief Frees cache, must not be called while mediaCache_get is running
+ */
+void mediaCache_close(mediaCache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEDIA_CACHE_H      Do not add any thing below this line */
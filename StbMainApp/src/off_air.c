@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "bouquet.h"
 #include "debug.h"
 #include "dvbChannel.h"
+#include "epgStore.h"
 #include "app_info.h"
 #include "sem.h"
 #include "gfx.h"
@@ -584,38 +585,45 @@ static int32_t offair_scanFrequency(interfaceMenu_t *pMenu, uint32_t adapter, ui
 }
 
 
+static int offair_scanProgress(uint32_t frequency, int channelCount, uint32_t adapter, int frequencyIndex, int frequencyCount)
+{
+	if(helperGetEvent(1) == interfaceCommandRed) {
+		return -1;
+	}
+	return offair_updateDisplay(frequency, channelCount, adapter, frequencyIndex, frequencyCount);
+}
+
 int offair_serviceScan(interfaceMenu_t *pMenu, void* pArg)
 {
 	uint32_t adapter;
 	uint32_t low_freq, high_freq, freq_step, freq_substep, frequency;
+	uint32_t *frequencies;
+	uint32_t count = 0;
 	int32_t which = GET_NUMBER(pArg);
+	int32_t ret;
 	char buf[256];
 
 	adapter = offair_getTuner();
 	dvbfe_getTuner_freqs(adapter, &low_freq, &high_freq, &freq_step);
-	
+	if(freq_step == 0 || high_freq < low_freq) {
+		eprintf("offair: wrong frequency range [%u:%u] step %u\n", low_freq, high_freq, freq_step);
+		interface_showMessageBox(_T("ERR_FREQUENCY_OUT_OF_RANGE"), thumbnail_error, 0);
+		return -1;
+	}
+
 	freq_substep = (DEFAULT_FREQUENCY - low_freq) % freq_step;
 	if(freq_substep != 0) {
 		freq_step = freq_step - freq_substep;
 	}
 
+	// steps alternate when default frequency is off the grid, so size the list by the smaller one
+	frequencies = dmalloc(((high_freq - low_freq) / ((freq_substep && freq_substep < freq_step) ? freq_substep : freq_step) + 1) * sizeof(uint32_t));
+	if(frequencies == NULL) {
+		return -1;
+	}
 	for(frequency = low_freq; frequency <= high_freq; frequency += freq_step) {
 		dprintf( "%s: [ %u < %u < %u ]\n", __FUNCTION__, low_freq, frequency, high_freq);
-		if(frequency < low_freq || frequency > high_freq) {
-			eprintf("offair: %u is out of frequency range\n", frequency);
-			interface_showMessageBox(_T("ERR_FREQUENCY_OUT_OF_RANGE"), thumbnail_error, 0);
-			return -1;
-		}
-		interface_hideMessageBox();
-		offair_updateDisplay(frequency, dvb_getNumberOfServices(), which, 0, 1);
-
-		if(offair_scanFrequency(pMenu, adapter, frequency) < 0) {
-			interface_hideMessageBox();
-			interface_sliderShow(0, 0);
-			sprintf(buf, _T("SCAN_COMPLETE_CHANNELS_FOUND"), dvb_getNumberOfServices());
-			interface_showMessageBox(buf, thumbnail_warning, 5000);
-			return -1;
-		}
+		frequencies[count++] = frequency;
 		if(freq_substep) {
 			uint32_t temp_step;
 			temp_step = freq_step;
@@ -623,9 +631,26 @@ int offair_serviceScan(interfaceMenu_t *pMenu, void* pArg)
 			freq_substep = temp_step;
 		}
 	}
+
+	interface_hideMessageBox();
+	offair_updateDisplay(low_freq, dvb_getNumberOfServices(), which, 0, count);
+
+	ret = dvb_scanFrequencies(adapter, frequencies, count, offair_scanProgress, 1);
+	dfree(frequencies);
+
+	if(ret > 0) {
+		interface_refreshMenu(pMenu);
+		output_showDVBMenu(pMenu, NULL);
+		bouquet_addScanChannels();
+#ifdef ENABLE_PVR
+		pvr_updateSettings();
+#endif
+	}
+
+	interface_hideMessageBox();
 	interface_sliderShow(0, 0);
 	sprintf(buf, _T("SCAN_COMPLETE_CHANNELS_FOUND"), dvb_getNumberOfServices());
-	interface_showMessageBox(buf, thumbnail_info, 5000);
+	interface_showMessageBox(buf, ret < 0 ? thumbnail_warning : thumbnail_info, 5000);
 
 	return -1;
 
@@ -1913,11 +1938,21 @@ static int offair_debugToggle(interfaceMenu_t *pMenu, void* pArg)
 }
 #endif
 
+static void offair_appendEventDescription(char *desc, const char *str, EIT_event_t *event)
+{
+	time_t start_time;
+
+	sprintf( &desc[strlen(desc)], "%s%s ", desc[0] == 0 ? "" : "\n", str);
+	offair_getLocalEventTime( event, NULL, &start_time );
+	start_time += offair_getEventDuration( event );
+	strftime(&desc[strlen(desc)], 11, "(%H:%M)", localtime( &start_time ));
+	sprintf( &desc[strlen(desc)], " %s", event->description.event_name );
+}
+
 static void offair_getServiceDescription(EIT_service_t *service, char *desc, const char *prefix)
 {
-	list_element_t *event_element;
+	list_element_t *event_element, *next_element;
 	EIT_event_t *event;
-	time_t start_time;
 	char *str;
 
 	if( service != NULL )
@@ -1932,6 +1967,19 @@ static void offair_getServiceDescription(EIT_service_t *service, char *desc, con
 
 		offair_sortEvents(&service->present_following);
 		event_element = service->present_following;
+		if ( event_element == NULL )
+		{
+			/* No present/following table received, take now/next from schedule */
+			if ( epgStore_getCurrentEvent(service, time(NULL), &event_element, &next_element) == 0 )
+			{
+				offair_appendEventDescription(desc, _T("PLAYING"), (EIT_event_t*)event_element->data);
+				if ( next_element != NULL )
+				{
+					offair_appendEventDescription(desc, _T("NEXT"), (EIT_event_t*)next_element->data);
+				}
+			}
+			event_element = NULL;
+		}
 		while ( event_element != NULL )
 		{
 			event = (EIT_event_t*)event_element->data;
@@ -1949,11 +1997,7 @@ static void offair_getServiceDescription(EIT_service_t *service, char *desc, con
 				break;
 			default: str = "";
 			}
-			sprintf( &desc[strlen(desc)], "%s%s ", desc[0] == 0 ? "" : "\n", str);
-			offair_getLocalEventTime( event, NULL, &start_time );
-			start_time += offair_getEventDuration( event );
-			strftime(&desc[strlen(desc)], 11, "(%H:%M)", localtime( &start_time ));
-			sprintf( &desc[strlen(desc)], " %s", event->description.event_name );
+			offair_appendEventDescription(desc, str, event);
 			/*if (event->description.text[0] != 0)
 			{
 				sprintf( &desc[strlen(desc)], ". %s", event->description.text );
@@ -2281,11 +2325,9 @@ int offair_enterDVBTMenu(interfaceMenu_t *pMenu, void* pArg)
 int offair_initEPGRecordMenu(interfaceMenu_t *pMenu, void *pArg)
 {
 	interfaceEpgMenu_t *pEpg = (interfaceEpgMenu_t *)pMenu;
-	list_element_t *event_element;
 
 	service_index_t *srvIdx;
-	EIT_event_t *event;
-	time_t event_start, event_end;
+	time_t event_end;
 	int i, events_found;
 
 	if(GET_NUMBER(pArg) < 0) {// double call fix
@@ -2327,22 +2369,12 @@ int offair_initEPGRecordMenu(interfaceMenu_t *pMenu, void *pArg)
 		}
 		srvIdx->first_event = NULL;
 		if(srvIdx->service != NULL && srvIdx->service->schedule != NULL && dvb_hasMedia(srvIdx->service) != 0) {
-			for(event_element = srvIdx->service->schedule; event_element != NULL; event_element = event_element->next) {
-				event = (EIT_event_t *)event_element->data;
-				if(offair_getLocalEventTime(event, NULL, &event_start) == 0) {
-					event_end = event_start + offair_getEventDuration(event);
-					if(srvIdx->first_event == NULL && event_end > pEpg->minOffset) {
-						srvIdx->first_event = event_element;
-						events_found = 1;
-					}
-					/* Skip older events
-					if(event_start < pEpg->minOffset) {
-						pEpg->minOffset = 3600 * (event_start / 3600);
-					}*/
-					event_end -= 3600 * pEpg->displayingHours;
-					if(event_end > pEpg->maxOffset) {
-						pEpg->maxOffset = 3600 * (event_end / 3600 + 1);
-					}
+			srvIdx->first_event = epgStore_getFirstEvent(srvIdx->service, pEpg->minOffset, &event_end);
+			if(srvIdx->first_event != NULL) {
+				events_found = 1;
+				event_end -= 3600 * pEpg->displayingHours;
+				if(event_end > pEpg->maxOffset) {
+					pEpg->maxOffset = 3600 * (event_end / 3600 + 1);
 				}
 			}
 		}
@@ -2402,6 +2434,8 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 	char buf[MAX_TEXT];
 	char *str;
 	list_element_t *event_element;
+	list_element_t *events[ERM_MAX_VISIBLE_EVENTS];
+	int event_count, k;
 	EIT_event_t *event;
 	time_t event_tt, event_len, end_tt;
 	struct tm event_tm, *t;
@@ -2523,8 +2557,9 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 	gfx_drawText(DRAWING_SURFACE, pgfx_font, INTERFACE_BOOKMARK_RED, INTERFACE_BOOKMARK_GREEN, INTERFACE_BOOKMARK_BLUE, INTERFACE_BOOKMARK_ALPHA, x, y+rect.h - interfaceInfo.paddingSize, buf, 0, 0);
 	/* Current service events */
 	x += interfaceInfo.paddingSize + ERM_CHANNEL_NAME_LENGTH;
-	event_element = srvIdx->first_event;
-	while(event_element != NULL) {
+	event_count = epgStore_getEvents(srvIdx->service, pEpg->curOffset, end_tt, events, ERM_MAX_VISIBLE_EVENTS);
+	for(k = 0; k < event_count; k++) {
+		event_element = events[k];
 		event = (EIT_event_t*)event_element->data;
 
 		if(offair_getLocalEventTime(event, &event_tm, &event_tt) == 0) {
@@ -2553,7 +2588,6 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 				gfx_drawText(DRAWING_SURFACE, pgfx_font, tr, tg, tb, ta, x, y+fh - interfaceInfo.paddingSize, buf, 0, 0);
 			}
 		}
-		event_element = event_element->next;
 	}
 
 	/* Other services (vertically scrollable) */
@@ -2591,9 +2625,10 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 			displayedChannels++;
 
 			x += interfaceInfo.paddingSize + ERM_CHANNEL_NAME_LENGTH;
-			event_element = srvIdx->first_event;
-			while( event_element != NULL )
+			event_count = epgStore_getEvents(srvIdx->service, pEpg->curOffset, end_tt, events, ERM_MAX_VISIBLE_EVENTS);
+			for(k = 0; k < event_count; k++)
 			{
+				event_element = events[k];
 				event = (EIT_event_t*)event_element->data;
 				if(offair_getLocalEventTime(event, &event_tm, &event_tt) == 0)
 				{
@@ -2625,7 +2660,6 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 						gfx_drawText(DRAWING_SURFACE, pgfx_font, tr, tg, tb, ta, x, y+rect.h - interfaceInfo.paddingSize, buf, 0, 0);
 					}
 				}
-				event_element = event_element->next;
 			}
 		}
 	} // end of services loop
@@ -2775,17 +2809,12 @@ static void offair_EPGRecordMenuDisplay(interfaceMenu_t *pMenu)
 
 static EIT_event_t * epgMenu_highlightCurrentEvent(interfaceEpgMenu_t *pEpg)
 {
-	time_t eventStart = 0, eventEnd = 0;
 	time_t maxEndTime = pEpg->curOffset + 3600 * pEpg->displayingHours;
 	service_index_t *srvIdx = dvbChannel_getServiceIndex(pEpg->highlightedService);
 
-	for(pEpg->highlightedEvent = srvIdx ? srvIdx->first_event : NULL;
-		pEpg->highlightedEvent;
-		pEpg->highlightedEvent =  pEpg->highlightedEvent->next )
-	{
-		offair_getEventTimes(pEpg->highlightedEvent->data, &eventStart, &eventEnd);
-		if(eventEnd > pEpg->curOffset && eventStart < maxEndTime )
-			break;
+	pEpg->highlightedEvent = NULL;
+	if(srvIdx != NULL && srvIdx->first_event != NULL) {
+		epgStore_getEvents(srvIdx->service, pEpg->curOffset, maxEndTime, &pEpg->highlightedEvent, 1);
 	}
 	return pEpg->highlightedEvent ? pEpg->highlightedEvent->data : NULL;
 }
@@ -3489,7 +3518,7 @@ void offair_sortSchedule(void)
     dvb_lockSrvices();
     for(list_element_t *s = dvb_getSrvices(); s != NULL; s = s->next ) {
         EIT_service_t *service = s->data;
-        offair_sortEvents(&service->schedule);
+        epgStore_sortSchedule(service);
     }
     dvb_unlockSrvices();
 }
@@ -68,6 +68,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define ERM_DISPLAYING_HOURS (3)
 #define ERM_TIMESTAMP_WIDTH  (3)
 #define ERM_ICON_SIZE        (34)
+/* Maximum number of events drawn in one row of EPG grid */
+#define ERM_MAX_VISIBLE_EVENTS (64)
 
 /* DVB play control layout */
 #define DVBPC_STATUS_ICON_SIZE 22
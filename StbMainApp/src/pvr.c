@@ -44,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "client.h"
 #include "gfx.h"
 #include "off_air.h"
+#include "epgStore.h"
 #include "rtp.h"
 #include "media.h"
 #include "menu_app.h"
@@ -1704,7 +1705,6 @@ int pvr_importJobList(void)
 	EIT_service_t *service;
 	list_element_t *event_element;
 	EIT_event_t *event;
-	time_t event_time;
 #endif
 
 	f = fopen( STBPVR_JOBLIST, "r" );
@@ -1865,17 +1865,11 @@ int pvr_importJobList(void)
 			curJob->info.dvb.event_id = CHANNEL_CUSTOM;
 #ifdef ENABLE_DVB
 			curJob->info.dvb.service  = service;
-			for( event_element = service->schedule; event_element != NULL; event_element = event_element->next )
+			event_element = epgStore_findEvent(service, curJob->start_time, curJob->end_time);
+			if( event_element != NULL )
 			{
 				event = (EIT_event_t*)event_element->data;
-				if( offair_getLocalEventTime( event, NULL, &event_time) == 0 )
-				{
-					if( event_time == curJob->start_time && event_time + offair_getEventDuration( event ) == curJob->end_time )
-					{
-						curJob->info.dvb.event_id = event->event_id;
-						break;
-					}
-				}
+				curJob->info.dvb.event_id = event->event_id;
 			}
 #else
 			curJob->info.dvb.service = NULL;
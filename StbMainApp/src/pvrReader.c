@@ -0,0 +1,532 @@
+/*
+ pvrReader.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "pvrReader.h"
+
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+/* Number of the first part file is probed from this range */
+#define PVR_READER_FIRST_PART  (0)
+#define PVR_READER_SECOND_PART (1)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct {
+	int     number;
+	off_t   start;      // stream position of part beginning
+	off_t   size;
+} pvrReaderPart_t;
+
+typedef struct {
+	int     fd;
+	int     part;       // index in parts, -1 if fd is not open
+} pvrReaderFile_t;
+
+struct pvrReader_s {
+	char             path[PATH_MAX];
+	const char      *extension;   // NULL for single file
+	pvrReaderPart_t *parts;       // protected by mutex
+	int              partCount;
+	int              partCapacity;
+
+	off_t            position;    // owned by caller thread
+	pvrReaderFile_t  file;        // used by synchronous reads
+
+	/* readahead: ring holds stream range [ringStart, ringEnd) */
+	unsigned char   *ring;
+	size_t           ringSize;
+	size_t           chunk;
+	off_t            ringStart;
+	off_t            ringEnd;
+	uint32_t         generation;  // incremented when ring is restarted at new position
+	int              eof;
+	int              error;
+	int              stop;
+	pthread_t        thread;
+	pthread_mutex_t  mutex;
+	pthread_cond_t   dataCond;
+	pthread_cond_t   spaceCond;
+};
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
+*******************************************************************/
+
+static void pvrReader_partName(pvrReader_t *r, int number, char *filename, size_t size)
+{
+	if (r->extension)
+		snprintf(filename, size, "%s/part%02d.%s", r->path, number, r->extension);
+	else
+		snprintf(filename, size, "%s", r->path);
+}
+
+/* Updates size of last part and appends parts created since. Called with mutex held */
+static int pvrReader_refresh(pvrReader_t *r)
+{
+	char filename[PATH_MAX];
+	struct stat st;
+	pvrReaderPart_t *last;
+
+	if (r->partCount > 0) {
+		last = &r->parts[r->partCount-1];
+		pvrReader_partName(r, last->number, filename, sizeof(filename));
+		if (stat(filename, &st) == 0)
+			last->size = st.st_size;
+	}
+	if (r->extension == NULL && r->partCount > 0)
+		return 0;
+
+	for (;;) {
+		int number;
+
+		if (r->partCount > 0) {
+			number = r->parts[r->partCount-1].number + 1;
+		} else {
+			number = PVR_READER_FIRST_PART;
+			pvrReader_partName(r, number, filename, sizeof(filename));
+			if (access(filename, F_OK) != 0)
+				number = PVR_READER_SECOND_PART;
+		}
+		pvrReader_partName(r, number, filename, sizeof(filename));
+		if (stat(filename, &st) != 0)
+			break;
+		if (r->partCount == r->partCapacity) {
+			int capacity = r->partCapacity ? 2*r->partCapacity : 16;
+			pvrReaderPart_t *parts = realloc(r->parts, capacity * sizeof(*parts));
+			if (parts == NULL)
+				return -1;
+			r->parts = parts;
+			r->partCapacity = capacity;
+		}
+		r->parts[r->partCount].number = number;
+		r->parts[r->partCount].start  = r->partCount > 0 ? r->parts[r->partCount-1].start + r->parts[r->partCount-1].size : 0;
+		r->parts[r->partCount].size   = st.st_size;
+		r->partCount++;
+		if (r->extension == NULL)
+			break;
+	}
+	return 0;
+}
+
+static off_t pvrReader_end(pvrReader_t *r)
+{
+	return r->partCount > 0 ? r->parts[r->partCount-1].start + r->parts[r->partCount-1].size : 0;
+}
+
+/* Called with mutex held */
+static int pvrReader_findPart(pvrReader_t *r, off_t position)
+{
+	int low = 0, high = r->partCount - 1;
+
+	while (low < high) {
+		int middle = (low + high + 1) / 2;
+		if (r->parts[middle].start <= position)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return r->partCount > 0 ? low : -1;
+}
+
+/* Opens part containing position in file. Caller holds mutex, it is released during open.
+ * Returns index of part, -1 at end of known data, -2 with errno set on error. */
+static int pvrReader_openAt(pvrReader_t *r, pvrReaderFile_t *file, off_t position)
+{
+	char filename[PATH_MAX];
+	int index, fd;
+
+	index = pvrReader_findPart(r, position);
+	if (index < 0 || position >= pvrReader_end(r))
+		return -1;
+	// skip empty parts
+	while (position - r->parts[index].start >= r->parts[index].size && index + 1 < r->partCount)
+		index++;
+	if (file->part == index)
+		return index;
+
+	pvrReader_partName(r, r->parts[index].number, filename, sizeof(filename));
+	pthread_mutex_unlock(&r->mutex);
+
+	if (file->fd >= 0)
+		close(file->fd);
+	file->part = -1;
+	fd = open(filename, O_RDONLY);
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (fd >= 0)
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	pthread_mutex_lock(&r->mutex);
+	if ((file->fd = fd) < 0)
+		return -2;
+	file->part = index;
+	return index;
+}
+
+/* Reads from part containing position. Caller holds mutex, it is released during I/O.
+ * Returns 0 at end of known data. */
+static ssize_t pvrReader_readAt(pvrReader_t *r, pvrReaderFile_t *file, off_t position, void *buf, size_t size)
+{
+	pvrReaderPart_t part;
+	ssize_t ret;
+	int index;
+
+	index = pvrReader_openAt(r, file, position);
+	if (index < 0)
+		return index == -1 ? 0 : -1;
+	part = r->parts[index];
+	pthread_mutex_unlock(&r->mutex);
+
+	if ((off_t)size > part.start + part.size - position)
+		size = part.start + part.size - position;
+	ret = pread(file->fd, buf, size, position - part.start);
+
+	pthread_mutex_lock(&r->mutex);
+	return ret;
+}
+
+static void *pvrReader_thread(void *pArg)
+{
+	pvrReader_t *r = pArg;
+	pvrReaderFile_t file = { -1, -1 };
+
+	pthread_mutex_lock(&r->mutex);
+	while (!r->stop) {
+		size_t offset, size;
+		uint32_t generation;
+		off_t position;
+		ssize_t ret;
+
+		size = r->ringSize - (size_t)(r->ringEnd - r->ringStart);
+		if (size < r->chunk && size < r->ringSize/2) {
+			pthread_cond_wait(&r->spaceCond, &r->mutex);
+			continue;
+		}
+		if (r->eof || r->error) {
+			pthread_cond_wait(&r->spaceCond, &r->mutex);
+			continue;
+		}
+		offset = r->ringEnd % r->ringSize;
+		if (size > r->ringSize - offset)
+			size = r->ringSize - offset;
+		if (size > r->chunk)
+			size = r->chunk;
+		position   = r->ringEnd;
+		generation = r->generation;
+
+		ret = pvrReader_readAt(r, &file, position, &r->ring[offset], size);
+		if (generation != r->generation)
+			continue; // seek happened, data is stale
+		if (ret < 0) {
+			r->error = errno ? errno : EIO;
+		} else if (ret == 0) {
+			r->eof = 1;
+		} else {
+			r->ringEnd += ret;
+		}
+		pthread_cond_broadcast(&r->dataCond);
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	if (file.fd >= 0)
+		close(file.fd);
+	return NULL;
+}
+
+pvrReader_t *pvrReader_open(const char *path, const pvrReaderConfig_t *config)
+{
+	char filename[PATH_MAX];
+	struct stat st;
+	pvrReader_t *r;
+	int err;
+
+	if (stat(path, &st) != 0)
+		return NULL;
+
+	r = dcalloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	strncpy(r->path, path, sizeof(r->path)-1);
+	r->file.fd   = -1;
+	r->file.part = -1;
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->dataCond, NULL);
+	pthread_cond_init(&r->spaceCond, NULL);
+
+	if (S_ISDIR(st.st_mode)) {
+		static const char *extensions[] = { "ts", "spts" };
+		size_t i;
+
+		for (i = 0; i < sizeof(extensions)/sizeof(extensions[0]) && r->extension == NULL; i++) {
+			r->extension = extensions[i];
+			pvrReader_partName(r, PVR_READER_FIRST_PART, filename, sizeof(filename));
+			if (access(filename, F_OK) == 0)
+				break;
+			pvrReader_partName(r, PVR_READER_SECOND_PART, filename, sizeof(filename));
+			if (access(filename, F_OK) == 0)
+				break;
+			r->extension = NULL;
+		}
+		if (r->extension == NULL) {
+			err = ENOENT;
+			goto failure;
+		}
+	}
+	if (pvrReader_refresh(r) != 0 || r->partCount == 0) {
+		err = errno ? errno : ENOENT;
+		goto failure;
+	}
+
+	r->ringSize = config ? config->prefetch : PVR_READER_DEFAULT_PREFETCH;
+	r->chunk    = config && config->chunk ? config->chunk : PVR_READER_DEFAULT_CHUNK;
+	if (r->ringSize > 0) {
+		if (r->chunk > r->ringSize)
+			r->chunk = r->ringSize;
+		if ((r->ring = dmalloc(r->ringSize)) == NULL) {
+			err = ENOMEM;
+			goto failure;
+		}
+		if ((err = pthread_create(&r->thread, NULL, pvrReader_thread, r)) != 0)
+			goto failure;
+	}
+	return r;
+
+failure:
+	if (r->ring)
+		dfree(r->ring);
+	free(r->parts);
+	pthread_cond_destroy(&r->spaceCond);
+	pthread_cond_destroy(&r->dataCond);
+	pthread_mutex_destroy(&r->mutex);
+	dfree(r);
+	errno = err;
+	return NULL;
+}
+
+void pvrReader_close(pvrReader_t *r)
+{
+	if (r->ring) {
+		pthread_mutex_lock(&r->mutex);
+		r->stop = 1;
+		pthread_cond_signal(&r->spaceCond);
+		pthread_mutex_unlock(&r->mutex);
+		pthread_join(r->thread, NULL);
+		dfree(r->ring);
+	}
+	if (r->file.fd >= 0)
+		close(r->file.fd);
+	free(r->parts);
+	pthread_cond_destroy(&r->spaceCond);
+	pthread_cond_destroy(&r->dataCond);
+	pthread_mutex_destroy(&r->mutex);
+	dfree(r);
+}
+
+ssize_t pvrReader_read(pvrReader_t *r, void *buf, size_t size)
+{
+	unsigned char *ptr = buf;
+	size_t available, offset, first;
+	ssize_t ret;
+
+	if (size == 0)
+		return 0;
+
+	pthread_mutex_lock(&r->mutex);
+	if (r->ring == NULL) {
+		ret = pvrReader_readAt(r, &r->file, r->position, buf, size);
+		if (ret == 0 && pvrReader_refresh(r) == 0)
+			ret = pvrReader_readAt(r, &r->file, r->position, buf, size);
+		if (ret > 0)
+			r->position += ret;
+		pthread_mutex_unlock(&r->mutex);
+		return ret;
+	}
+
+	while (r->ringEnd == r->ringStart) {
+		if (r->error) {
+			errno = r->error;
+			r->error = 0;
+			pthread_cond_signal(&r->spaceCond);
+			pthread_mutex_unlock(&r->mutex);
+			return -1;
+		}
+		if (r->eof) {
+			// recording may be still in progress
+			off_t end = pvrReader_end(r);
+			pvrReader_refresh(r);
+			if (pvrReader_end(r) == end) {
+				pthread_mutex_unlock(&r->mutex);
+				return 0;
+			}
+			r->eof = 0;
+			pthread_cond_signal(&r->spaceCond);
+		}
+		pthread_cond_wait(&r->dataCond, &r->mutex);
+	}
+
+	available = r->ringEnd - r->ringStart;
+	if (size > available)
+		size = available;
+	offset = r->ringStart % r->ringSize;
+	first  = r->ringSize - offset;
+	if (first > size)
+		first = size;
+	pthread_mutex_unlock(&r->mutex);
+
+	// data between ringStart and ringEnd is not touched by readahead thread
+	memcpy(ptr, &r->ring[offset], first);
+	memcpy(ptr + first, r->ring, size - first);
+
+	pthread_mutex_lock(&r->mutex);
+	r->ringStart += size;
+	r->position  += size;
+	pthread_cond_signal(&r->spaceCond);
+	pthread_mutex_unlock(&r->mutex);
+	return size;
+}
+
+off_t pvrReader_seek(pvrReader_t *r, off_t offset, int whence)
+{
+	off_t position;
+
+	pthread_mutex_lock(&r->mutex);
+	switch (whence) {
+		case SEEK_SET: position = offset; break;
+		case SEEK_CUR: position = r->position + offset; break;
+		case SEEK_END:
+			pvrReader_refresh(r);
+			position = pvrReader_end(r) + offset;
+			break;
+		default: position = -1;
+	}
+	if (position < 0) {
+		pthread_mutex_unlock(&r->mutex);
+		errno = EINVAL;
+		return -1;
+	}
+	r->position = position;
+	if (r->ring) {
+		if (position >= r->ringStart && position <= r->ringEnd) {
+			r->ringStart = position;
+		} else {
+			r->ringStart = r->ringEnd = position;
+			r->generation++;
+			r->eof   = 0;
+			r->error = 0;
+		}
+		pthread_cond_signal(&r->spaceCond);
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return position;
+}
+
+off_t pvrReader_tell(pvrReader_t *r)
+{
+	return r->position;
+}
+
+off_t pvrReader_size(pvrReader_t *r)
+{
+	off_t size;
+
+	pthread_mutex_lock(&r->mutex);
+	pvrReader_refresh(r);
+	size = pvrReader_end(r);
+	pthread_mutex_unlock(&r->mutex);
+	return size;
+}
+
+int pvrReader_getPart(pvrReader_t *r, off_t position, int *part, off_t *offset)
+{
+	int index, ret = -1;
+
+	pthread_mutex_lock(&r->mutex);
+	index = pvrReader_findPart(r, position);
+	if (index >= 0 && position <= pvrReader_end(r)) {
+		*part   = r->parts[index].number;
+		*offset = position - r->parts[index].start;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return ret;
+}
+
+int pvrReader_getFile(pvrReader_t *r, off_t position, off_t *offset, off_t *size)
+{
+	int index, fd = -1;
+
+	pthread_mutex_lock(&r->mutex);
+	index = pvrReader_openAt(r, &r->file, position);
+	if (index == -1 && pvrReader_refresh(r) == 0)
+		index = pvrReader_openAt(r, &r->file, position);
+	if (index >= 0) {
+		*offset = position - r->parts[index].start;
+		*size   = r->parts[index].size - *offset;
+		fd = r->file.fd;
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return fd;
+}
+
+off_t pvrReader_getPosition(pvrReader_t *r, int part, off_t offset)
+{
+	off_t position = -1;
+	int i;
+
+	pthread_mutex_lock(&r->mutex);
+	for (i = 0; i < r->partCount; i++) {
+		if (r->parts[i].number == part) {
+			position = r->parts[i].start + offset;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return position;
+}
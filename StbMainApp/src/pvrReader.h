@@ -0,0 +1,131 @@
+#ifndef __PVR_READER_H
+#define __PVR_READER_H
+
+/*
+ pvrReader.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file pvrReader.h Recording as a single seekable stream
+ * Recording directory with part%02d.ts or part%02d.spts files (or single
+ * file) is presented as one byte stream. Optional readahead thread keeps a
+ * window of data ahead of read position in memory and opens next part
+ * before it is needed, so part boundaries don't interrupt playback.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/***********************************************
+* EXPORTED MACROS                              *
+************************************************/
+
+/** Default readahead window */
+#define PVR_READER_DEFAULT_PREFETCH (4*1024*1024)
+/** Default size of single disk read */
+#define PVR_READER_DEFAULT_CHUNK    (256*1024)
+
+/***********************************************
+* EXPORTED TYPEDEFS                            *
+************************************************/
+
+typedef struct pvrReader_s pvrReader_t;
+
+typedef struct
+{
+	size_t prefetch;   /**< Readahead window in bytes, 0 reads synchronously without thread */
+	size_t chunk;      /**< Disk read size, 0 selects PVR_READER_DEFAULT_CHUNK */
+} pvrReaderConfig_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Opens recording directory or regular file
+ *
+ *  @param[in]  config  NULL selects PVR_READER_DEFAULT_PREFETCH
+ *
+ *  @return Reader handle, NULL on failure with errno set
+ */
+pvrReader_t *pvrReader_open(const char *path, const pvrReaderConfig_t *config);
+void         pvrReader_close(pvrReader_t *reader);
+
+/**
+ *  @brief Reads data at current position
+ *
+ *  Waits for readahead if needed. Parts appended by recording in progress
+ *  are picked up when end of known data is reached.
+ *
+ *  @return Number of bytes read, 0 at end of recording, -1 with errno set on error
+ */
+ssize_t pvrReader_read(pvrReader_t *reader, void *buf, size_t size);
+
+/** @return New position, -1 with errno set if it is out of range */
+off_t   pvrReader_seek(pvrReader_t *reader, off_t offset, int whence);
+off_t   pvrReader_tell(pvrReader_t *reader);
+
+/** @return Total size of all parts */
+off_t   pvrReader_size(pvrReader_t *reader);
+
+/**
+ *  @brief Converts stream position to part file number and offset in it
+ *
+ *  @return 0 on success, -1 if position is beyond end
+ */
+int     pvrReader_getPart(pvrReader_t *reader, off_t position, int *part, off_t *offset);
+
+/**
+ *  @brief Gets part file holding data at position, to send it without copying
+ *
+ *  Descriptor is owned by reader and stays valid until next call,
+ *  synchronous read or close.
+ *
+ *  @param[out] offset  Offset of position in part file
+ *  @param[out] size    Bytes stored in part file from offset
+ *
+ *  @return File descriptor, -1 at end of recording or on error
+ */
+int     pvrReader_getFile(pvrReader_t *reader, off_t position, off_t *offset, off_t *size);
+
+/** @return Stream position of offset in part file, -1 if there is no such part */
+off_t   pvrReader_getPosition(pvrReader_t *reader, int part, off_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__PVR_READER_H
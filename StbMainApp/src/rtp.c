@@ -53,6 +53,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "m3u.h"
 #include "xmlconfig.h"
 #include "pvr.h"
+#include "epgFetch.h"
 #ifdef ENABLE_TELETES
 #include "../third_party/teletes/teletes.h"
 #endif
@@ -130,6 +131,7 @@ typedef struct
 	unsigned int id;
 	unsigned char genre;
 	unsigned int audio;
+	int jitter; // ms, -1 to use rtpMenuInfo.jitterLatency
 } rtpMediaInfo_t;
 
 typedef struct
@@ -175,6 +177,7 @@ static void* rtp_epgThread(void *pArg);
 static void rtp_showEpg(void);
 
 static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type);
+static int rtp_parseSchedule(int channel, char *data);
 static void rtp_displayShortInfo();
 static int rtp_shortInfoProcessCommand(pinterfaceCommandEvent_t cmd, void* pArg);
 static int rtp_longInfoCallback(interfaceMenu_t* pMenu, pinterfaceCommandEvent_t cmd, void* pArg);
@@ -197,6 +200,7 @@ static int rtp_multiviewPlay(interfaceMenu_t *pMenu, void *pArg);
 static int rtp_reconnectEvent(void *pArg);
 #endif
 
+static unsigned int rtp_getJitterLatency(int channel);
 static int rtp_saveAudioTrackList();
 static int rtp_loadAudioTrackList();
 
@@ -229,6 +233,11 @@ static char   channel_buff[DATA_BUFF_SIZE];
 static rtpEPGControlInfo_t rtp_epgControl;
 static rtpEPGInfo_t        rtpEpgInfo;
 
+/** Keeps connections to EPG server between updates, created by first update */
+static epgFetch_t *rtp_epgFetch = NULL;
+/** EPG thread is running, guarded by rtp_epg_semaphore */
+static int rtp_epgUpdating = 0;
+
 static int rtp_sap_collected = 0; 
 
 #ifdef ENABLE_MULTI_VIEW
@@ -296,6 +305,11 @@ void rtp_cleanupMenu()
 {
 	rtp_session_destroy(rtp.rtp_session);
 	rtp_cleanupEPG();
+	// rtp_cleanupEPG aborted the update, wait for it to leave the fetcher
+	while (rtp_epgUpdating)
+		usleep(10000);
+	epgFetch_destroy(rtp_epgFetch);
+	rtp_epgFetch = NULL;
 	mysem_destroy(rtp_semaphore);
 	mysem_destroy(rtp_epg_semaphore);
 	mysem_destroy(rtp_curl_semaphore);
@@ -335,6 +349,13 @@ static void rtp_setStateCheckTimer(int which, int bEnable)
 	}
 }
 
+static unsigned int rtp_getJitterLatency(int channel)
+{
+	if (channel >= 0 && channel != CHANNEL_CUSTOM && rtp_info[channel].jitter >= 0)
+		return rtp_info[channel].jitter;
+	return appControlInfo.rtpMenuInfo.jitterLatency;
+}
+
 static int rtp_checkStream(void *pArg)
 {
 	struct timeval lastts, curts;
@@ -486,6 +507,8 @@ int rtp_startVideo(int which)
 		dprintf("%s: start h264 receiver\n", __FUNCTION__);
 
 		rtp_change_eng(rtp.rtp_session, RTP_ENGINE);	// set RTP engine
+		rtp_set_jitter_latency(rtp.rtp_session, rtp_getJitterLatency(appControlInfo.rtpMenuInfo.channel));
+		rtp_set_output_buffer(rtp.rtp_session, appControlInfo.rtpMenuInfo.outputBuffer);
 
 		if ((ret = rtp_start_receiver(rtp.rtp_session, &rtp.selectedDesc, -1, 0, appControlInfo.useVerimatrix|appControlInfo.useSecureMedia)) != 0)
 		{
@@ -1413,6 +1436,7 @@ static void rtp_urlHandler(void *pArg, const char *location, const char *desc, x
 	rtp_info[streams.count].audio_type = 0;
 	rtp_info[streams.count].video_pid  = 0;
 	rtp_info[streams.count].video_type = 0;
+	rtp_info[streams.count].jitter     = -1;
 	FREE( rtp_info[streams.count].thumb );
 	FREE( rtp_info[streams.count].poster );
 	memset(&streams.items[streams.count], 0, sizeof(sdp_desc));
@@ -1470,6 +1494,11 @@ static void rtp_urlHandler(void *pArg, const char *location, const char *desc, x
 					}
 				}
 			}
+			ptr = strstr(url.stream, "jitter=");
+			if( ptr != NULL )
+			{
+				rtp_info[streams.count].jitter = atoi(&ptr[7]);
+			}
 			streams.items[streams.count].media[0].port = url.port;
 			streams.items[streams.count].connection.addrtype = addrTypeIPv4;
 			streams.items[streams.count].connection.address.IPv4.s_addr = url_ip;
@@ -1658,6 +1687,7 @@ static void *stream_list_updater(void *pArg)
 					rtp_info[i].video_type = 0;
 					rtp_info[i].audio_pid = 0;
 					rtp_info[i].audio_type = 0;
+					rtp_info[i].jitter = -1;
 					rtp_info[i].id = 0;
 					rtp_info[i].genre = 0;
 					FREE(rtp_info[i].thumb);
@@ -2184,6 +2214,132 @@ char* providerCommonGetStbSerial(void)
 }
 #endif
 
+#ifdef ENABLE_PLAYLIST_HTTP_HEADER
+static struct curl_slist *rtp_getEpgHeaders(void)
+{
+	struct curl_slist  *headers = NULL;
+	char header[128];
+	char mac[128] = "";
+	FILE *file = NULL;
+
+	snprintf(header, sizeof(header), "Elecard-StbSerial: %s", providerCommonGetStbSerial());
+	headers = curl_slist_append(headers, header);
+	file = fopen(MAC_PATH, "rt");
+	if (file){
+		fscanf (file, "%s", mac);
+		fclose(file);
+	} else {
+		eprintf ("%s: ERROR! reading MAC from /sys/class/net/eth0/address file.\n", __FUNCTION__);
+	}	
+	snprintf(header, sizeof(header), "Elecard-StbMAC: %s", mac);
+	headers = curl_slist_append(headers, header);
+	return headers;
+}
+#endif
+
+static void rtp_getEpgUrl(char *url, int channel, int offset, rtpInfoType_t type)
+{
+	sprintf(url, "%s?type=%d&channel=%u&offset=%d",appControlInfo.rtpMenuInfo.epg, (int)type, channel >= 0 && channel < RTP_MAX_STREAM_COUNT && rtp_info[channel].id > 0 ? rtp_info[channel].id : (unsigned int)channel, offset);
+}
+
+/**
+ * Parses program list returned by EPG server for rtpInfoTypeList into channel schedule.
+ * First line is channel title, each program takes two lines: offset with start and
+ * end time, and program name.
+ */
+static int rtp_parseSchedule(int channel, char *data)
+{
+	char *str, *ptr;
+	int event_offset;
+	list_element_t *element;
+	EIT_event_t *event;
+	time_t start_time, end_time;
+	struct tm start_tm, end_tm;
+
+	str = index( data, '\n' );
+	if( str == NULL ) // no title
+		return -1;
+	*str = 0;
+	str++;
+	if(str[0] == 0 ) // empty program list
+		return -1;
+	mysem_get(rtp_epg_semaphore);
+	dprintf("%s: free schedule for %d '%s'\n", __FUNCTION__, channel, streams.items[channel].session_name);
+	free_elements(&rtp_info[channel].schedule);
+	mysem_release(rtp_epg_semaphore);
+	memset(&start_tm, 0, sizeof(start_tm));
+	memset(&end_tm, 0, sizeof(end_tm));
+	while( str[0] > 0 && str[0] != '\n' )
+	{
+		ptr = index( str, '\n' );
+		if( !ptr || ptr[1] == 0 )
+		{
+			eprintf("%s: no description for channel %3d %s\n", __FUNCTION__, channel, streams.items[channel].session_name);
+			break;
+		}
+		*ptr = 0;
+		ptr++;
+		if( sscanf(str, "%d %04d-%02d-%02d %d:%d %d:%d", &event_offset, &start_tm.tm_year, &start_tm.tm_mon, &start_tm.tm_mday, &start_tm.tm_hour, &start_tm.tm_min, &end_tm.tm_hour, &end_tm.tm_min) != 8 )
+		{
+			eprintf("%s: wrong formatted time string '%s'\n", __FUNCTION__, str);
+			break;
+		}
+		str = ptr;
+		ptr = index( str, '\n' );
+		if( ptr )
+		{
+			*ptr = 0;
+			ptr++;
+		} else
+			ptr = str + strlen(str);
+
+		mysem_get(rtp_epg_semaphore);
+		if (rtp_info[channel].schedule == NULL)
+		{
+			element = rtp_info[channel].schedule = allocate_element(sizeof(EIT_event_t));
+		} else
+		{
+			element = append_new_element(rtp_info[channel].schedule, sizeof(EIT_event_t));
+		}
+		mysem_release(rtp_epg_semaphore);
+		if( !element )
+		{
+			eprintf("%s: error: can't allocate new event %d '%s'\n", __FUNCTION__, event_offset, str);
+			break;
+		}
+		event = (EIT_event_t*)element->data;
+
+		start_tm.tm_year -= 1900;
+
+		event->start_day   = start_tm.tm_mday;
+		event->start_month = start_tm.tm_mon;
+		event->start_year  = start_tm.tm_year;
+
+		start_tm.tm_mon  --;
+
+		end_tm.tm_mday  = start_tm.tm_mday;
+		end_tm.tm_mon   = start_tm.tm_mon;
+		end_tm.tm_year  = start_tm.tm_year;
+		end_tm.tm_sec   = start_tm.tm_sec   = 0;
+		end_tm.tm_isdst = start_tm.tm_isdst = -1;
+		start_time = gmktime(&start_tm);
+		end_time   = gmktime(&end_tm);
+		if( end_time <= start_time )
+			end_time += 24*60*60;
+
+		end_time -= start_time;
+		event->start_time  = encode_bcd_time(&start_tm);
+		event->duration    = encode_bcd_time(gmtime(&end_time));
+		event->event_id    = event_offset;
+		strncpy((char*)event->description.event_name, str, sizeof(event->description.event_name) );
+		event->description.event_name[sizeof(event->description.event_name)-1] = 0;
+		dprintf("%s: adding event '%s' [%ld:%ld]\n", __FUNCTION__, event->description.event_name, start_time, end_time);
+
+		str = ptr;
+	}
+	return 0;
+}
+
 static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type)
 {
 	CURLcode ret;
@@ -2192,15 +2348,9 @@ static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type)
 	char url[MAX_URL];
 	static char errbuff[CURL_ERROR_SIZE];
 	char *str, *ptr;
-	int event_offset;
-	list_element_t *element;
-	EIT_event_t *event;
 	time_t start_time, end_time;
 #ifdef ENABLE_PLAYLIST_HTTP_HEADER
 	struct curl_slist  *headers = NULL;
-	char header[128];
-	char mac[128];
-	FILE *file = NULL;
 #endif
 
 	switch( type )
@@ -2209,7 +2359,7 @@ static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type)
 		case rtpInfoTypeFull:
 		case rtpInfoTypeName:
 		case rtpInfoTypeList:
-			sprintf(url, "%s?type=%d&channel=%u&offset=%d",appControlInfo.rtpMenuInfo.epg, (int)type, channel >= 0 && channel < RTP_MAX_STREAM_COUNT && rtp_info[channel].id > 0 ? rtp_info[channel].id : (unsigned int)channel, offset);
+			rtp_getEpgUrl(url, channel, offset, type);
 			break;
 		default:
 			eprintf("RTP: Unsupported info type %d\n",type);
@@ -2220,17 +2370,7 @@ static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type)
 	mysem_get( rtp_curl_semaphore );
 	hnd = curl_easy_init();
 #ifdef ENABLE_PLAYLIST_HTTP_HEADER
-	snprintf(header, sizeof(header), "Elecard-StbSerial: %s", providerCommonGetStbSerial());
-	headers = curl_slist_append(headers, header);
-	file = fopen(MAC_PATH, "rt");
-	if (file){
-		fscanf (file, "%s", mac);
-		fclose(file);
-	} else {
-		eprintf ("%s: ERROR! reading MAC from /sys/class/net/eth0/address file.\n", __FUNCTION__);
-	}	
-	snprintf(header, sizeof(header), "Elecard-StbMAC: %s", mac);
-	headers = curl_slist_append(headers, header);
+	headers = rtp_getEpgHeaders();
 #endif
 	curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, http_epg_callback);
 	curl_easy_setopt(hnd, CURLOPT_WRITEDATA, channel_buff);
@@ -2260,107 +2400,13 @@ static int rtp_getProgramInfo(int channel, int offset, rtpInfoType_t type)
 			switch(type)
 			{
 				case rtpInfoTypeList:
-					str = index( channel_buff, '\n' );
-					if( str == NULL ) // no title
+					if( rtp_parseSchedule( channel, channel_buff ) != 0 )
 					{
 						ret = -1;
 						channel_buff[0] = 0;
-						rtpEpgInfo.program.title = channel_buff;
-						break;
-					}
-					*str = 0;
-					str++;
-					//if( *str == '\r' )
-					//{
-					//	*str = 0;
-					//	str++;
-					//}
-					if(str[0] == 0 ) // empty program list
-					{
-						ret = -1;
-						rtpEpgInfo.program.title = channel_buff;
-						break;
-					}
-					mysem_get(rtp_epg_semaphore);
-					dprintf("%s: free schedule for %d '%s'\n", __FUNCTION__, channel, streams.items[channel].session_name);
-					free_elements(&rtp_info[channel].schedule);
-					mysem_release(rtp_epg_semaphore);
-					while( str[0] > 0 && str[0] != '\n' )
-					{
-						ptr = index( str, '\n' );
-						if( !ptr || ptr[1] == 0 )
-						{
-							eprintf("%s: no description for channel %3d %s\n", __FUNCTION__, channel, streams.items[channel].session_name);
-							break;
-						}
-						*ptr = 0;
-						ptr++;
-						//if( *ptr == '\r' )
-						//{
-						//	*ptr = 0;
-						//	ptr++;
-						//}
-						if( sscanf(str, "%d %04d-%02d-%02d %d:%d %d:%d", &event_offset, &rtpEpgInfo.program.start_tm.tm_year, &rtpEpgInfo.program.start_tm.tm_mon, &rtpEpgInfo.program.start_tm.tm_mday, &rtpEpgInfo.program.start_tm.tm_hour, &rtpEpgInfo.program.start_tm.tm_min, &rtpEpgInfo.program.end_tm.tm_hour, &rtpEpgInfo.program.end_tm.tm_min) != 8 )
-						{
-							eprintf("%s: wrong formatted time string '%s'\n", __FUNCTION__, str);
-							break;
-						}
-						str = ptr;
-						ptr = index( str, '\n' );
-						if( ptr )
-						{
-							*ptr = 0;
-							ptr++;
-						} else
-							ptr = str + strlen(str);
-
-						mysem_get(rtp_epg_semaphore);
-						if (rtp_info[channel].schedule == NULL)
-						{
-							element = rtp_info[channel].schedule = allocate_element(sizeof(EIT_event_t));
-						} else
-						{
-							element = append_new_element(rtp_info[channel].schedule, sizeof(EIT_event_t));
-						}
-						mysem_release(rtp_epg_semaphore);
-						if( !element )
-						{
-							eprintf("%s: error: can't allocate new event %d '%s'\n", __FUNCTION__, event_offset, str);
-							break;
-						}
-						event = (EIT_event_t*)element->data;
-
-						rtpEpgInfo.program.start_tm.tm_year -= 1900;
-
-						event->start_day   = rtpEpgInfo.program.start_tm.tm_mday;
-						event->start_month = rtpEpgInfo.program.start_tm.tm_mon;
-						event->start_year  = rtpEpgInfo.program.start_tm.tm_year;
-
-						rtpEpgInfo.program.start_tm.tm_mon  --;
-
-						rtpEpgInfo.program.end_tm.tm_mday  = rtpEpgInfo.program.start_tm.tm_mday;
-						rtpEpgInfo.program.end_tm.tm_mon   = rtpEpgInfo.program.start_tm.tm_mon;
-						rtpEpgInfo.program.end_tm.tm_year  = rtpEpgInfo.program.start_tm.tm_year;
-						rtpEpgInfo.program.end_tm.tm_sec   = rtpEpgInfo.program.start_tm.tm_sec   = 0;
-						rtpEpgInfo.program.end_tm.tm_isdst = rtpEpgInfo.program.start_tm.tm_isdst = -1;
-						start_time = gmktime(&rtpEpgInfo.program.start_tm);
-						//dprintf("%s: %s start %02d-%02d-%04d %02d:%02d %d\n\n", __FUNCTION__, str, rtpEpgInfo.program.start_tm.tm_mday, rtpEpgInfo.program.start_tm.tm_mon,rtpEpgInfo.program.start_tm.tm_year, rtpEpgInfo.program.start_tm.tm_hour, rtpEpgInfo.program.start_tm.tm_min, start_time);
-						end_time   = gmktime(&rtpEpgInfo.program.end_tm);
-						//dprintf("%s: %s end   %02d-%02d-%04d %02d:%02d %d\n\n", __FUNCTION__, str, rtpEpgInfo.program.end_tm.tm_mday, rtpEpgInfo.program.end_tm.tm_mon, rtpEpgInfo.program.end_tm.tm_year, rtpEpgInfo.program.end_tm.tm_hour, rtpEpgInfo.program.end_tm.tm_min, end_time);
-						if( end_time <= start_time )
-							end_time += 24*60*60;
-
-						end_time -= start_time;
-						event->start_time  = encode_bcd_time(&rtpEpgInfo.program.start_tm);
-						event->duration    = encode_bcd_time(gmtime(&end_time));
-						//dprintf("%s: %s duration %d %06x\n", __FUNCTION__, str, end_time/60, event->duration);
-						event->event_id    = event_offset;
-						strncpy((char*)event->description.event_name, str, sizeof(event->description.event_name) );
-						event->description.event_name[sizeof(event->description.event_name)-1] = 0;
-						dprintf("%s: adding event '%s' [%ld:%ld]\n", __FUNCTION__, event->description.event_name, start_time, end_time);
-
-						str = ptr;
 					}
+					rtpEpgInfo.program.title = channel_buff;
+					str = &channel_buff[strlen(channel_buff)];
 					break;
 				default:
 					str = index( channel_buff, '\n' );
@@ -3138,29 +3184,89 @@ static int rtp_multiviewPlay(interfaceMenu_t *pMenu, void *pArg)
 }
 #endif
 
-static void* rtp_epgThread(void *pArg)
+static void rtp_epgFetched(void *pArg, epgFetchStatus_t status, char *body, size_t size)
 {
-	unsigned int i;
+	int channel = GET_NUMBER(pArg);
+	char *src, *dst;
 	int res;
 
+	if (status == EPG_FETCH_NOT_MODIFIED && rtp_info[channel].schedule != NULL)
+	{
+		dprintf("%s: schedule for %d (id %d) not modified\n", __FUNCTION__, channel, rtp_info[channel].id);
+		return;
+	}
+	if (body == NULL || channel >= streams.count)
+		return;
+
+	// skip non-printable, as http_epg_callback does
+	for (src = dst = body; src < body + size; src++)
+	{
+		if ((unsigned char)*src >= (unsigned char)' ' || *src == '\n')
+			*dst++ = *src;
+	}
+	*dst = 0;
+
+	res = rtp_parseSchedule(channel, body);
+	dprintf("%s: got schedule for %d (id %d) : %d\n", __FUNCTION__, channel, rtp_info[channel].id, res);
+	(void)res;
+}
+
+static void* rtp_epgThread(void *pArg)
+{
+	char url[MAX_URL];
+	epgFetchStats_t stats;
+	int i;
+#ifdef ENABLE_PLAYLIST_HTTP_HEADER
+	struct curl_slist *headers = NULL;
+#endif
+
+	mysem_get(rtp_epg_semaphore);
+	if (rtp_epgUpdating)
+	{
+		mysem_release(rtp_epg_semaphore);
+		dprintf("%s: update is already running\n", __FUNCTION__);
+		pthread_exit(NULL);
+	}
+	rtp_epgUpdating = 1;
+	mysem_release(rtp_epg_semaphore);
+
 	dprintf("%s: updating EPG\n", __FUNCTION__);
 
-	for( i = 0; i < (unsigned)streams.count; i++ )
+	if (rtp_epgFetch == NULL)
+		rtp_epgFetch = epgFetch_create(appControlInfo.rtpMenuInfo.epgParallel, DATA_BUFF_SIZE-1, IPTV_EPG_CACHE_DIR);
+	if (rtp_epgFetch == NULL)
 	{
-		if ( rtp.collectFlag == 0 )
-		{
-			eprintf("%s: aborted\n", __FUNCTION__);
-			break;
-		}
-		if( rtp_info[i].schedule == NULL )
-		{
-			res = rtp_getProgramInfo( i, 0, rtpInfoTypeList );
-			dprintf("%s: got schedule for %d (id %d) : %d\n", __FUNCTION__, i, rtp_info[i].id, res);
-			(void)res;
-		}
+		eprintf("%s: failed to create EPG fetcher\n", __FUNCTION__);
+		goto finish;
 	}
-	dprintf("%s: finished on %d of %d\n", __FUNCTION__, i, streams.count);
+#ifdef ENABLE_PLAYLIST_HTTP_HEADER
+	headers = rtp_getEpgHeaders();
+	epgFetch_setHeaders(rtp_epgFetch, headers);
+#endif
 
+	/* Schedules which are already loaded are only revalidated,
+	   so they are neither downloaded nor parsed again while unchanged */
+	for (i = 0; i < streams.count; i++)
+	{
+		rtp_getEpgUrl(url, i, 0, rtpInfoTypeList);
+		epgFetch_add(rtp_epgFetch, url,
+			rtp_info[i].schedule == NULL ? EPG_FETCH_CACHED_BODY : EPG_FETCH_REVALIDATE,
+			rtp_epgFetched, SET_NUMBER(i));
+	}
+	epgFetch_run(rtp_epgFetch, &rtp.collectFlag, &stats);
+	if (rtp.collectFlag == 0)
+		eprintf("%s: aborted\n", __FUNCTION__);
+	dprintf("%s: %u requests (%u not modified, %u failed) over %u connections, %u bytes in %u ms\n", __FUNCTION__,
+		stats.requests, stats.notModified, stats.failed, stats.connects, (unsigned)stats.downloaded, stats.timeMs);
+
+#ifdef ENABLE_PLAYLIST_HTTP_HEADER
+	epgFetch_setHeaders(rtp_epgFetch, NULL);
+	curl_slist_free_all(headers);
+#endif
+finish:
+	mysem_get(rtp_epg_semaphore);
+	rtp_epgUpdating = 0;
+	mysem_release(rtp_epg_semaphore);
 	pthread_exit(NULL);
 }
 
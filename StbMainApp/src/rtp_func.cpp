@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ************************************************/
 
 #include "rtp_func.h"
+#include "rtp_jitter.h"
 
 #include "debug.h"
 #include "StbMainApp.h"
@@ -52,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -97,11 +100,42 @@ SML_USE();
 
 #define BUFFER_SIZE (2*1024)
 #define GET_STREAMS_TIMEOUT (5)
+/* DemuxTS_Parse return value when PSI of the stream is complete */
+#define DEMUX_TS_COMPLETE   (1)
+
+#define TS_PACKET_SIZE             (188)
+/* Output ring is sized in ms of stream at maximum expected bitrate */
+#define RTP_OUTPUT_MAX_BITRATE     (20000000)
+#define RTP_OUTPUT_DEFAULT_BUFFER  (1000)
+#define RTP_OUTPUT_MIN_BUFFER      (100)
+#define RTP_OUTPUT_STALL_TIMEOUT   (1000)
+/* Time in ms producer waits for free space in full ring before dropping data.
+ * Jitter buffer output doesn't wait, payloads stay in jitter buffer instead. */
+#define RTP_OUTPUT_FULL_TIMEOUT    (200)
 
 /******************************************************************
 * LOCAL TYPEDEFS                                                  *
 *******************************************************************/
 
+typedef struct
+{
+	unsigned char  *ring;
+	size_t          size;
+	unsigned int    buffer_ms; // requested ring length, applied on next start
+	size_t          head;
+	size_t          fill;
+	bool            dropping;
+
+	int             fd;
+	bool            running;
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	pthread_cond_t  space;
+
+	rtp_output_stats stats;
+} rtp_output;
+
 typedef struct rtp_session_t
 {
 
@@ -126,7 +160,10 @@ typedef struct rtp_session_t
 	void *hDemuxer;
 	pStreamsPIDs pTsStreams;
 
-	pmysem_t confirm_sem;
+	rtp_output output;
+
+	struct rtp_jitter_t *jitter;
+	unsigned int jitter_latency;
 
 #ifdef ENABLE_VERIMATRIX
 	int             vmEnable;
@@ -306,24 +343,314 @@ int set_nonblock_flag (int desc, int value)
   return fcntl (desc, F_SETFL, oldflags);
 }
 
-//#else // #ifndef USE_CCRTP
+//------------------------------------------------------------------------
+// output stage
+//
+// _confirm only copies payloads into the ring, a dedicated writer drains
+// everything accumulated since the previous pass with a single writev().
+
+static size_t rtp_output_size(unsigned int ms)
+{
+	unsigned long long bytes;
+
+	if (ms == 0)
+		ms = RTP_OUTPUT_DEFAULT_BUFFER;
+	if (ms < RTP_OUTPUT_MIN_BUFFER)
+		ms = RTP_OUTPUT_MIN_BUFFER;
+	bytes = (unsigned long long)RTP_OUTPUT_MAX_BITRATE/8 * ms / 1000;
+	/* Keep ring a multiple of TS packet size */
+	return (size_t)(bytes / TS_PACKET_SIZE * TS_PACKET_SIZE);
+}
+
+static void rtp_output_init(rtp_output *output)
+{
+	pthread_condattr_t attr;
+
+	memset(output, 0, sizeof(rtp_output));
+	output->fd   = -1;
+	pthread_mutex_init(&output->mutex, NULL);
+	pthread_cond_init(&output->cond, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&output->space, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void rtp_output_destroy(rtp_output *output)
+{
+	pthread_mutex_destroy(&output->mutex);
+	pthread_cond_destroy(&output->cond);
+	pthread_cond_destroy(&output->space);
+}
+
+/* Returns true if running output has no room for size bytes now */
+static bool rtp_output_full(rtp_output *output, size_t size)
+{
+	bool full;
+
+	pthread_mutex_lock(&output->mutex);
+	full = output->ring != NULL && output->running &&
+		output->size - output->fill < size && size <= output->size;
+	pthread_mutex_unlock(&output->mutex);
+	return full;
+}
+
+static int rtp_output_queue(rtp_output *output, const unsigned char *buffer, size_t size)
+{
+	struct timespec deadline;
+	size_t tail, chunk;
+
+	pthread_mutex_lock(&output->mutex);
+	if (output->ring == NULL || !output->running)
+	{
+		pthread_mutex_unlock(&output->mutex);
+		return -1;
+	}
+	if (output->size - output->fill < size && size <= output->size)
+	{
+		/* Apply backpressure on short downstream stalls, like direct write did */
+		output->stats.full_waits++;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += (RTP_OUTPUT_FULL_TIMEOUT%1000)*1000000;
+		deadline.tv_sec  += RTP_OUTPUT_FULL_TIMEOUT/1000 + deadline.tv_nsec/1000000000;
+		deadline.tv_nsec %= 1000000000;
+		while (output->running && output->size - output->fill < size)
+		{
+			if (pthread_cond_timedwait(&output->space, &output->mutex, &deadline) == ETIMEDOUT)
+				break;
+		}
+	}
+	if (!output->running || output->size - output->fill < size)
+	{
+		if (!output->dropping)
+		{
+			eprintf("rtp_func: output ring full (%u bytes), dropping data\n", (unsigned int)output->size);
+			output->dropping = true;
+		}
+		output->stats.bytes_dropped += size;
+		output->stats.packets_dropped++;
+		pthread_mutex_unlock(&output->mutex);
+		return -1;
+	}
+	output->dropping = false;
+
+	tail  = (output->head + output->fill) % output->size;
+	chunk = output->size - tail;
+	if (chunk >= size)
+	{
+		memcpy(&output->ring[tail], buffer, size);
+	} else
+	{
+		memcpy(&output->ring[tail], buffer, chunk);
+		memcpy(output->ring, &buffer[chunk], size - chunk);
+	}
+	output->fill += size;
+	output->stats.bytes_queued += size;
+	if (output->fill > output->stats.max_fill)
+		output->stats.max_fill = output->fill;
+
+	pthread_cond_signal(&output->cond);
+	pthread_mutex_unlock(&output->mutex);
+
+	return 0;
+}
+
+static void *rtp_output_thread(void *pArg)
+{
+	rtp_output *output = (rtp_output *)pArg;
+	struct iovec iov[2];
+	struct pollfd pfd;
+	int iovcnt;
+	size_t fill, chunk;
+	ssize_t res;
+
+	pfd.fd = output->fd;
+	pfd.events = POLLOUT;
+
+	pthread_mutex_lock(&output->mutex);
+	while (output->running)
+	{
+		if (output->fill == 0)
+		{
+			pthread_cond_wait(&output->cond, &output->mutex);
+			continue;
+		}
+
+		/* Writer is the only consumer, so data between head and head+fill
+		 * stays valid while the lock is released. */
+		fill  = output->fill;
+		chunk = output->size - output->head;
+		iov[0].iov_base = &output->ring[output->head];
+		if (chunk >= fill)
+		{
+			iov[0].iov_len = fill;
+			iovcnt = 1;
+		} else
+		{
+			iov[0].iov_len  = chunk;
+			iov[1].iov_base = output->ring;
+			iov[1].iov_len  = fill - chunk;
+			iovcnt = 2;
+		}
+		pthread_mutex_unlock(&output->mutex);
+
+		res = writev(output->fd, iov, iovcnt);
+		if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			pthread_mutex_lock(&output->mutex);
+			output->stats.write_stalls++;
+			pthread_mutex_unlock(&output->mutex);
+
+			res = poll(&pfd, 1, RTP_OUTPUT_STALL_TIMEOUT);
+			if (res == 0)
+			{
+				eprintf("rtp_func: output stalled with %u bytes to %d\n", (unsigned int)fill, output->fd);
+			}
+			pthread_mutex_lock(&output->mutex);
+			continue;
+		}
+
+		pthread_mutex_lock(&output->mutex);
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			eprintf("rtp_func: error write %u bytes to %d: errno %d\n", (unsigned int)fill, output->fd, errno);
+			/* Drop what we have and wait for new data */
+			res = fill;
+			output->stats.bytes_dropped += fill;
+		} else
+		{
+			output->stats.bytes_written += res;
+			output->stats.writes++;
+		}
+		output->head  = (output->head + res) % output->size;
+		output->fill -= res;
+		pthread_cond_signal(&output->space);
+	}
+	pthread_mutex_unlock(&output->mutex);
+
+	return NULL;
+}
+
+static int rtp_output_start(rtp_output *output, int fd)
+{
+	int err;
+
+	if (output->running)
+		return 0;
+
+	output->size = rtp_output_size(output->buffer_ms);
+	output->ring = (unsigned char *)dmalloc(output->size);
+	if (output->ring == NULL)
+	{
+		eprintf("rtp_func: failed to allocate %u bytes for output ring\n", (unsigned int)output->size);
+		return -1;
+	}
+
+	set_nonblock_flag(fd, 1);
+
+	pthread_mutex_lock(&output->mutex);
+	output->fd   = fd;
+	output->head = 0;
+	output->fill = 0;
+	output->dropping = false;
+	memset(&output->stats, 0, sizeof(output->stats));
+	output->stats.size = output->size;
+	output->running = true;
+	pthread_mutex_unlock(&output->mutex);
+
+	err = pthread_create(&output->thread, NULL, rtp_output_thread, output);
+	if (err != 0)
+	{
+		eprintf("rtp_func: failed to create output thread: %s\n", strerror(err));
+		pthread_mutex_lock(&output->mutex);
+		output->running = false;
+		dfree(output->ring);
+		output->ring = NULL;
+		pthread_mutex_unlock(&output->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void rtp_output_stop(rtp_output *output)
+{
+	pthread_mutex_lock(&output->mutex);
+	if (!output->running)
+	{
+		pthread_mutex_unlock(&output->mutex);
+		return;
+	}
+	output->running = false;
+	pthread_cond_signal(&output->cond);
+	pthread_cond_broadcast(&output->space);
+	pthread_mutex_unlock(&output->mutex);
+
+	pthread_join(output->thread, NULL);
+
+	eprintf("rtp_func: output queued %llu written %llu dropped %llu bytes (%u packets), %u writes, %u stalls, %u full waits, max fill %u/%u\n",
+		output->stats.bytes_queued, output->stats.bytes_written, output->stats.bytes_dropped,
+		output->stats.packets_dropped, output->stats.writes, output->stats.write_stalls,
+		output->stats.full_waits, output->stats.max_fill, output->stats.size);
+
+	pthread_mutex_lock(&output->mutex);
+	dfree(output->ring);
+	output->ring = NULL;
+	output->fd   = -1;
+	pthread_mutex_unlock(&output->mutex);
+}
+
+void rtp_set_output_buffer(rtp_session *session, unsigned int ms)
+{
+	pthread_mutex_lock(&session->output.mutex);
+	session->output.buffer_ms = ms;
+	pthread_mutex_unlock(&session->output.mutex);
+}
+
+void rtp_set_jitter_latency(rtp_session *session, unsigned int latency)
+{
+	session->jitter_latency = latency;
+	if (session->jitter != NULL)
+	{
+		rtp_jitter_set_latency(session->jitter, latency);
+	}
+}
+
+int rtp_get_jitter_stats(rtp_session *session, rtp_jitter_stats *stats)
+{
+	if (session->jitter == NULL)
+	{
+		memset(stats, 0, sizeof(rtp_jitter_stats));
+		return -1;
+	}
+	rtp_jitter_get_stats(session->jitter, stats);
+	return 0;
+}
+
+void rtp_get_output_stats(rtp_session *session, rtp_output_stats *stats)
+{
+	pthread_mutex_lock(&session->output.mutex);
+	*stats = session->output.stats;
+	stats->fill = session->output.fill;
+	pthread_mutex_unlock(&session->output.mutex);
+}
+
 // Returns 0 if DemuxTS_Parse didn't find any PIDs
-unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long numbytes)
-//#endif // #ifndef USE_CCRTP
+static unsigned long rtp_deliver(rtp_session *session, const unsigned char *buffer, unsigned long size)
 {
 	int *outfd;
-	//dprintf("%s: Enter confirm(); numbytes=%d\r\n", __FUNCTION__, numbytes);
-	rtp_session *session = (rtp_session *)arg;
 
 	//static int fd = open("/dump/rtp_dump.ts", O_CREAT|O_WRONLY|O_TRUNC);
 
-	//write(fd, buffer, numbytes+session->size_addon);
+	//write(fd, buffer, size);
 
 	/*
 	static FILE *fd = fopen("/rtp_dump.ts", "wb");
 
 	if (fd != NULL) {
-		fwrite(buffer, 1, numbytes, fd);
+		fwrite(buffer, 1, size, fd);
 	}
 	*/
 
@@ -335,8 +662,8 @@ unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long num
 	if (session->vmEnable != 0 && session->vmContext != NULL)
 	{
 		int iBytesRead, iResult;
-		iResult = VMDecryptStreamData(session->vmContext,(unsigned char*)buffer,numbytes+session->size_addon,&iBytesRead);
-		if (iResult != 0 || iBytesRead != numbytes+session->size_addon)
+		iResult = VMDecryptStreamData(session->vmContext,(unsigned char*)buffer,size,&iBytesRead);
+		if (iResult != 0 || iBytesRead != size)
 		{
 			eprintf("rtp_func: Verimatrix decrypt result: %d, processed: %d\n", iResult, iBytesRead);
 		}
@@ -349,8 +676,8 @@ unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long num
 		size_t iBytesRead;
 		SM_RESULT iResult;
 
-		iResult = SmM2TsDecProcessor_Decrypt(session->smContext, (void*)buffer, numbytes+session->size_addon, &iBytesRead);
-		if (iResult != 0 || iBytesRead != numbytes+session->size_addon)
+		iResult = SmM2TsDecProcessor_Decrypt(session->smContext, (void*)buffer, size, &iBytesRead);
+		if (iResult != 0 || iBytesRead != size)
 		{
 			dprintf("rtp_func: SecureMedia decrypt result: %d, processed: %d\n", iResult, iBytesRead);
 		}
@@ -359,20 +686,12 @@ unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long num
 
 	if ( *outfd == 0 && session->hDemuxer != NULL )
 	{
-		//dprintf("%s: demux pkt %d bytes\n", __FUNCTION__, numbytes+session->size_addon);
-		DemuxTS_Parse(session->hDemuxer, (char*)buffer, numbytes+session->size_addon, session->pTsStreams);
-		//if ( session->pTsStreams->ItemsCnt )
-		if ( session->pTsStreams->ItemsCnt > 0 &&
-			 session->pTsStreams->ProgramCnt > 0 &&
-			 (!(session->pktcounter< 10
-				&& session->pTsStreams->ItemsCnt == 1))
-			 )
-			 //session->pTsStreams->ProgramCnt == session->pTsStreams->TotalProgramCnt)
+		//dprintf("%s: demux pkt %d bytes\n", __FUNCTION__, size);
+		// PAT and PMTs of all announced programs are parsed
+		if ( DemuxTS_Parse(session->hDemuxer, (char*)buffer, size, session->pTsStreams) == DEMUX_TS_COMPLETE &&
+			 session->pTsStreams->ItemsCnt > 0 )
 		{
-
 			dprintf("%s: found streams %d\n", __FUNCTION__, session->pTsStreams->ItemsCnt);
-			//dfree(session->pTsStreams->pStream);
-			//session->pTsStreams->ItemsCnt = 0;
 			DemuxTS_Close(session->hDemuxer);
 			eprintf("rtp_func: Found %d streams in %d/%d programs of TS on buffer %d\n", session->pTsStreams->ItemsCnt, session->pTsStreams->ProgramCnt, session->pTsStreams->TotalProgramCnt, session->pktcounter);
 			session->hDemuxer = NULL;
@@ -392,67 +711,60 @@ unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long num
 
 		if (*outfd > 0)
 		{
-			mysem_get(session->confirm_sem);
-
 			gettimeofday(&session->last_data_timestamp, 0);
 
-			//dprintf("%s: write %d bytes to %d\n", __FUNCTION__, numbytes+session->size_addon, *outfd);
-
+			//dprintf("%s: queue %d bytes to %d\n", __FUNCTION__, size, *outfd);
 	#ifndef DISABLE_OUTPUT
-			set_nonblock_flag(*outfd, 1);
-
-			//static int fd = open("/rtp_dump.h264", O_CREAT|O_TRUNC|O_WRONLY);
-			int res = 0;
-			int offset = 0;
-			int size = numbytes+session->size_addon;
-			fd_set wfd;
-			struct timeval tout;
-			while (size > 0)
+			if (rtp_output_queue(&session->output, buffer, size) != 0)
 			{
-				FD_ZERO(&wfd);
-				FD_SET(*outfd, &wfd);
-				tout.tv_sec = 1;
-				tout.tv_usec = 0;
-				res = select((*outfd)+1, NULL, &wfd, NULL, &tout);
-				if (res == 0) // timeout
-				{
-					eprintf("rtp_func: select timeout %d bytes to %d\n", size, *outfd);
-					mysem_release(session->confirm_sem);
-					return numbytes+session->size_addon-size;
-				}
-				if (res == -1)
-				{
-					eprintf("rtp_func: select error %d bytes to %d: errno = %d\n", size, *outfd, errno);
-					mysem_release(session->confirm_sem);
-					return 0;
-				}
-				res = write(*outfd, &buffer[offset], size);
-				if (res == size)
-				{
-					break;
-				}
-				//dprintf("%s: write %d bytes to %d: res = %d\n", __FUNCTION__, size, *outfd, res);
-				if (res > 0)
-				{
-					offset += res;
-					size -= res;
-				} else if (res == -1 && errno == EWOULDBLOCK)
-				{
-					eprintf("rtp_func: write will block %d bytes to %d: res = %d\n", size, *outfd, res);
-				} else
-				{
-					eprintf("rtp_func: error write %d bytes to %d: res = %d, errno %d\n", size, *outfd, res, errno);
-					break;
-				}
+				return 0;
 			}
-			//dprintf("%s: final write %d bytes to %d: res = %d\n", __FUNCTION__, size, *outfd, res);
 	#endif
-
-			mysem_release(session->confirm_sem);
 		}
 	}
 
-	return numbytes+session->size_addon;
+	return size;
+}
+
+static int rtp_jitter_deliver(void *pArg, unsigned char *data, size_t size)
+{
+	rtp_session *session = (rtp_session *)pArg;
+
+	/* Streams are found but output is not started yet: keep payload in jitter
+	 * buffer rather than waiting in rtp_deliver under its lock */
+	if (session->dvrfd == 0 && session->hDemuxer == NULL)
+		return 1;
+	/* Jitter lock is held here, so waiting for full output would stall
+	 * network receive thread. Payload is retried on next push or poll, and
+	 * jitter buffer drops it if output is stuck longer than its window. */
+	if (session->dvrfd > 0 && rtp_output_full(&session->output, size))
+		return 1;
+	rtp_deliver(session, data, size);
+	return 0;
+}
+
+#ifdef INCLUDE_CCRTP
+static unsigned long rtp_receive(rtp_session *session, uint16_t seq, uint32_t timestamp, const unsigned char *buffer, unsigned long size)
+{
+	if (session->jitter != NULL)
+	{
+		rtp_jitter_push(session->jitter, seq, timestamp, buffer, size);
+		return size;
+	}
+	return rtp_deliver(session, buffer, size);
+}
+#endif // #ifdef INCLUDE_CCRTP
+
+//#else // #ifndef USE_CCRTP
+unsigned long _confirm(void *arg, const unsigned char *buffer, unsigned long numbytes)
+//#endif // #ifndef USE_CCRTP
+{
+	//dprintf("%s: Enter confirm(); numbytes=%d\r\n", __FUNCTION__, numbytes);
+	rtp_session *session = (rtp_session *)arg;
+
+	/* NETLib hands us payloads without RTP header, so there is nothing to
+	 * reorder by: smallRTP bypasses jitter buffer */
+	return rtp_deliver(session, buffer, numbytes+session->size_addon);
 }
 
 
@@ -479,9 +791,14 @@ void *recv_main(void *pArg)
 		while ( (adu = session->rtp_session->getData(session->rtp_session->getFirstTimestamp())) )
 		{
 			//dprintf("%s: got packet\n", __FUNCTION__);
-			_confirm(session, (unsigned char*)adu->getData(), adu->getSize());
+			rtp_receive(session, adu->getSeqNum(), adu->getTimestamp(), (unsigned char*)adu->getData(), adu->getSize()+session->size_addon);
 			delete adu;
 		}
+		/* Releases buffered tail when input pauses or stops */
+		if (session->jitter != NULL)
+		{
+			rtp_jitter_poll(session->jitter);
+		}
 		Thread::sleep(7);
 	}
 
@@ -546,7 +863,23 @@ int rtp_start_receiver(rtp_session *session, sdp_desc *desc, int media_no, int d
 	session->dmxfd = 0;
 	session->dvrfd = 0;
 
-	mysem_create(&session->confirm_sem);
+	/* Only ccRTP provides real sequence numbers and timestamps, buffer is
+	 * kept even with zero latency for loss accounting */
+	if (session->engine == 1)
+	{
+		if (session->jitter != NULL)
+		{
+			rtp_jitter_reset(session->jitter);
+			rtp_jitter_set_latency(session->jitter, session->jitter_latency);
+		} else
+		{
+			rtp_jitter_create(&session->jitter, session->jitter_latency, rtp_jitter_deliver, session);
+		}
+		eprintf("rtp_func: jitter buffer latency %u ms\n", session->jitter_latency);
+	} else if (session->jitter_latency > 0)
+	{
+		eprintf("rtp_func: jitter buffer is not supported by RTP engine %d\n", session->engine);
+	}
 
 #ifdef ENABLE_VERIMATRIX
 	if (verimatrix != 0)
@@ -668,7 +1001,6 @@ int rtp_stop_receiver(rtp_session *session)
 	{ // ccRTP
 		dprintf("%s: stop receiver\n", __FUNCTION__);
 		session->cancel_thread = true;
-		mysem_destroy(session->confirm_sem);
 		//pthread_kill(session->recv_thread, SIGKILL);
 //#endif // #ifndef USE_CCRTP
 
@@ -684,8 +1016,23 @@ int rtp_stop_receiver(rtp_session *session)
 			session->smrtp_session[m] = NULL;
 			m++;
 		}
-		mysem_destroy(session->confirm_sem);
 	}
+	if (session->jitter != NULL)
+	{
+		rtp_jitter_stats stats;
+
+		rtp_jitter_get_stats(session->jitter, &stats);
+		eprintf("rtp_func: jitter received %llu released %llu lost %u late %u dup %u reordered %u (max depth %u) oversized %u dropped %u max occupancy %u\n",
+			stats.received, stats.released, stats.lost, stats.late, stats.duplicates,
+			stats.reordered, stats.reorder_max, stats.oversized, stats.dropped, stats.occupancy_max);
+		/* ccRTP thread is stopped asynchronously and may still push */
+		if (session->engine != 1)
+		{
+			rtp_jitter_destroy(session->jitter);
+			session->jitter = NULL;
+		}
+	}
+	rtp_output_stop(&session->output);
 #ifdef ENABLE_VERIMATRIX
 	if (session->vmContext != NULL)
 	{
@@ -710,10 +1057,6 @@ void rtp_clear_streams(rtp_session *session)
 	dprintf("%s: clear streams\n", __FUNCTION__);
 	if ( session->pTsStreams != NULL )
 	{
-		if ( session->pTsStreams->pStream != NULL )
-		{
-			dfree(session->pTsStreams->pStream);
-		}
 		dfree(session->pTsStreams);
 	}
 	session->pTsStreams = NULL;
@@ -774,6 +1117,11 @@ int rtp_start_output( rtp_session *session, int fd, int dmx )
 
 	dprintf("%s: start receiving\n", __FUNCTION__);
 
+	if (rtp_output_start(&session->output, fd) != 0)
+	{
+		return -1;
+	}
+
 	session->dvrfd = fd;
 	session->dmxfd = dmx;
 
@@ -792,6 +1140,10 @@ int rtp_session_init(struct rtp_session_t **psession)
 	session->cancel_thread = 0;
 	session->pTsStreams = NULL;
 	session->pktcounter = 0;
+	session->jitter = NULL;
+	session->jitter_latency = 0;
+
+	rtp_output_init(&session->output);
 
 	rtp_change_eng(session, 0);
 
@@ -832,6 +1184,10 @@ void rtp_session_destroy(struct rtp_session_t *session)
 	session->smContext = NULL;
 #endif
 
+	rtp_output_stop(&session->output);
+	rtp_output_destroy(&session->output);
+	rtp_jitter_destroy(session->jitter);
+
 	dfree(session);
 }
 
@@ -34,6 +34,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sdp.h>
 
+#include "rtp_jitter.h"
+
 #define RTP_MAX_STREAM_COUNT (256)
 #define RTP_SDP_TTL          (7000)
 
@@ -43,6 +45,9 @@ struct rtp_list
 	sdp_desc items[RTP_MAX_STREAM_COUNT];
 };
 
+/* Maximum number of elementary streams reported by TS demuxer */
+#define TS_MAX_STREAMS       (128)
+
 typedef struct
 {
 	int ItemsCnt;
@@ -55,9 +60,24 @@ typedef struct
 		int PCR_PID;
 		int stream_type;
 		int elementary_PID;
-	} *pStream;
+	} pStream[TS_MAX_STREAMS];
 } StreamsPIDs, *pStreamsPIDs;
 
+/* Counters of the batched TS output stage */
+typedef struct
+{
+	unsigned long long bytes_queued;
+	unsigned long long bytes_written;
+	unsigned long long bytes_dropped;
+	unsigned int       packets_dropped;
+	unsigned int       writes;
+	unsigned int       write_stalls;
+	unsigned int       full_waits;   // producer waited for free space in full ring
+	unsigned int       fill;
+	unsigned int       max_fill;
+	unsigned int       size;
+} rtp_output_stats;
+
 struct rtp_session_t;
 
 #ifdef __cplusplus
@@ -68,6 +88,13 @@ void rtp_get_last_data_timestamp(struct rtp_session_t *session, struct timeval *
 int rtp_engine_supports_transport(int eng, int transport);
 void rtp_flush_receive_buffers(struct rtp_session_t *session);
 int rtp_start_output(struct rtp_session_t *session, int fd, int dmx);
+void rtp_get_output_stats(struct rtp_session_t *session, rtp_output_stats *stats);
+/** Sets output ring length in ms of 20 Mbit/s stream for next output start, 0 selects default */
+void rtp_set_output_buffer(struct rtp_session_t *session, unsigned int ms);
+/** Sets jitter buffer latency in ms for next receiver start, 0 disables buffering */
+void rtp_set_jitter_latency(struct rtp_session_t *session, unsigned int latency);
+/** Returns -1 if session has no jitter buffer */
+int rtp_get_jitter_stats(struct rtp_session_t *session, rtp_jitter_stats *stats);
 pStreamsPIDs rtp_get_streams(struct rtp_session_t *session);
 void rtp_clear_streams(struct rtp_session_t *session);
 int rtp_start_receiver(struct rtp_session_t *session, sdp_desc *desc, int media_no, int delayFeeding, int verimatrix);
@@ -0,0 +1,386 @@
+/*
+ rtp_jitter.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "rtp_jitter.h"
+
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define RTP_JITTER_MASK          (RTP_JITTER_SLOTS-1)
+/* Sequence jump considered as stream restart rather than loss */
+#define RTP_JITTER_RESYNC_SEQ    (4*RTP_JITTER_SLOTS)
+
+/******************************************************************
+* LOCAL TYPEDEFS                                                  *
+*******************************************************************/
+
+typedef struct
+{
+	int           used;
+	uint16_t      seq;
+	uint16_t      size;
+	uint32_t      timestamp;
+	unsigned char data[RTP_JITTER_MAX_PAYLOAD];
+} rtp_jitter_slot;
+
+struct rtp_jitter_t
+{
+	pthread_mutex_t   mutex;
+
+	rtp_jitter_output pOutput;
+	void             *pArg;
+
+	unsigned int      latency;
+
+	int               started;
+	uint16_t          next_seq;  // first sequence number not yet released
+	uint16_t          high_seq;  // highest received sequence number
+	unsigned int      count;
+
+	/* Maps RTP timestamps to local monotonic time: payload with timestamp
+	 * base_ts is released at base_time + latency. base_time tracks the
+	 * smallest observed transit delay. */
+	uint32_t          base_ts;
+	int64_t           base_time;
+
+	rtp_jitter_stats  stats;
+
+	rtp_jitter_slot   slots[RTP_JITTER_SLOTS];
+};
+
+/*******************************************************************************
+* FUNCTION IMPLEMENTATION  <Module>[_<Word>+] for static functions             *
+*                          tm[<layer>]<Module>[_<Word>+] for exported functions*
+********************************************************************************/
+
+static int64_t rtp_jitter_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static inline int64_t rtp_jitter_offset(struct rtp_jitter_t *jitter, uint32_t timestamp)
+{
+	return (int64_t)(int32_t)(timestamp - jitter->base_ts) * 1000000 / RTP_JITTER_CLOCK_RATE;
+}
+
+static inline int64_t rtp_jitter_playout(struct rtp_jitter_t *jitter, uint32_t timestamp)
+{
+	return jitter->base_time + rtp_jitter_offset(jitter, timestamp) + (int64_t)jitter->latency*1000;
+}
+
+static void rtp_jitter_rebase(struct rtp_jitter_t *jitter, uint32_t timestamp, int64_t now)
+{
+	jitter->base_ts   = timestamp;
+	jitter->base_time = now;
+}
+
+/* Returns nonzero if output refused payload, slot is kept then */
+static int rtp_jitter_emit(struct rtp_jitter_t *jitter, rtp_jitter_slot *slot)
+{
+	if (jitter->pOutput(jitter->pArg, slot->data, slot->size) != 0)
+		return 1;
+	slot->used = 0;
+	jitter->count--;
+	jitter->stats.released++;
+	jitter->next_seq = slot->seq + 1;
+	return 0;
+}
+
+/* Releases slot regardless of output state */
+static void rtp_jitter_force(struct rtp_jitter_t *jitter, rtp_jitter_slot *slot)
+{
+	if (rtp_jitter_emit(jitter, slot) == 0)
+		return;
+	slot->used = 0;
+	jitter->count--;
+	jitter->stats.dropped++;
+	jitter->next_seq = slot->seq + 1;
+}
+
+/* Returns slot of first buffered payload after next_seq, count must be > 0 */
+static rtp_jitter_slot *rtp_jitter_nextBuffered(struct rtp_jitter_t *jitter)
+{
+	unsigned int i;
+	rtp_jitter_slot *slot;
+
+	for (i = 0; i < RTP_JITTER_SLOTS; i++)
+	{
+		slot = &jitter->slots[(uint16_t)(jitter->next_seq + i) & RTP_JITTER_MASK];
+		if (slot->used)
+			return slot;
+	}
+	return NULL;
+}
+
+static void rtp_jitter_release(struct rtp_jitter_t *jitter, int force)
+{
+	int64_t now = force ? 0 : rtp_jitter_now();
+	rtp_jitter_slot *slot;
+	uint16_t gap;
+
+	while (jitter->count > 0)
+	{
+		slot = &jitter->slots[jitter->next_seq & RTP_JITTER_MASK];
+		if (!slot->used)
+		{
+			/* Gap is given up once the payload following it is due */
+			slot = rtp_jitter_nextBuffered(jitter);
+			if (slot == NULL)
+				break;
+		}
+		if (!force && now < rtp_jitter_playout(jitter, slot->timestamp))
+			break;
+		gap = slot->seq - jitter->next_seq;
+		if (force)
+			rtp_jitter_force(jitter, slot);
+		else if (rtp_jitter_emit(jitter, slot) != 0)
+			break; // output not ready, retry on next poll
+		jitter->stats.lost += gap;
+	}
+}
+
+/* Releases everything that falls out of the window ending at seq */
+static void rtp_jitter_advance(struct rtp_jitter_t *jitter, uint16_t seq)
+{
+	uint16_t first = seq - RTP_JITTER_SLOTS + 1;
+	rtp_jitter_slot *slot;
+
+	while ((int16_t)(first - jitter->next_seq) > 0)
+	{
+		slot = &jitter->slots[jitter->next_seq & RTP_JITTER_MASK];
+		if (slot->used)
+		{
+			jitter->stats.overflows++;
+			rtp_jitter_force(jitter, slot);
+		} else
+		{
+			jitter->stats.lost++;
+			jitter->next_seq++;
+		}
+	}
+}
+
+static void rtp_jitter_start(struct rtp_jitter_t *jitter, uint16_t seq, uint32_t timestamp, int64_t now)
+{
+	jitter->next_seq = seq;
+	jitter->high_seq = seq;
+	rtp_jitter_rebase(jitter, timestamp, now);
+	jitter->started = 1;
+}
+
+int rtp_jitter_push(struct rtp_jitter_t *jitter, uint16_t seq, uint32_t timestamp, const unsigned char *data, size_t size)
+{
+	int64_t now, expected;
+	int16_t delta;
+	uint16_t distance;
+	rtp_jitter_slot *slot;
+
+	pthread_mutex_lock(&jitter->mutex);
+
+	if (size > RTP_JITTER_MAX_PAYLOAD)
+	{
+		if (jitter->stats.oversized++ == 0)
+			eprintf("%s: payload %u is too big, dropped\n", __FUNCTION__, (unsigned int)size);
+		pthread_mutex_unlock(&jitter->mutex);
+		return 1;
+	}
+
+	now = rtp_jitter_now();
+	if (!jitter->started)
+		rtp_jitter_start(jitter, seq, timestamp, now);
+
+	distance = seq - jitter->next_seq;
+	if (distance >= RTP_JITTER_SLOTS)
+	{
+		if ((int16_t)distance < 0 && (uint16_t)-distance < RTP_JITTER_RESYNC_SEQ)
+		{
+			jitter->stats.late++;
+			pthread_mutex_unlock(&jitter->mutex);
+			return 1;
+		}
+		if (distance >= RTP_JITTER_RESYNC_SEQ && (uint16_t)-distance >= RTP_JITTER_RESYNC_SEQ)
+		{
+			/* Source restarted or switched: drain old stream */
+			rtp_jitter_release(jitter, 1);
+			rtp_jitter_start(jitter, seq, timestamp, now);
+			jitter->stats.resyncs++;
+		} else
+		{
+			rtp_jitter_advance(jitter, seq);
+		}
+	}
+
+	slot = &jitter->slots[seq & RTP_JITTER_MASK];
+	if (slot->used)
+	{
+		jitter->stats.duplicates++;
+		pthread_mutex_unlock(&jitter->mutex);
+		return 1;
+	}
+
+	memcpy(slot->data, data, size);
+	slot->size      = size;
+	slot->seq       = seq;
+	slot->timestamp = timestamp;
+	slot->used      = 1;
+	jitter->count++;
+	jitter->stats.received++;
+
+	delta = seq - jitter->high_seq;
+	if (delta > 0)
+	{
+		jitter->high_seq = seq;
+	} else if (delta < 0)
+	{
+		jitter->stats.reordered++;
+		jitter->stats.reorder_depth = -delta;
+		if ((unsigned int)-delta > jitter->stats.reorder_max)
+			jitter->stats.reorder_max = -delta;
+	}
+
+	expected = jitter->base_time + rtp_jitter_offset(jitter, timestamp);
+	if (now < expected)
+	{
+		/* Smaller transit delay than seen before */
+		jitter->base_time -= expected - now;
+	} else if (now - expected > (int64_t)RTP_JITTER_MAX_LATENCY*1000)
+	{
+		/* Timestamp discontinuity or sender clock drifted away */
+		rtp_jitter_rebase(jitter, timestamp, now);
+		jitter->stats.resyncs++;
+	}
+
+	if (jitter->count > jitter->stats.occupancy_max)
+		jitter->stats.occupancy_max = jitter->count;
+
+	rtp_jitter_release(jitter, 0);
+
+	pthread_mutex_unlock(&jitter->mutex);
+	return 0;
+}
+
+void rtp_jitter_poll(struct rtp_jitter_t *jitter)
+{
+	pthread_mutex_lock(&jitter->mutex);
+	rtp_jitter_release(jitter, 0);
+	pthread_mutex_unlock(&jitter->mutex);
+}
+
+void rtp_jitter_flush(struct rtp_jitter_t *jitter)
+{
+	pthread_mutex_lock(&jitter->mutex);
+	rtp_jitter_release(jitter, 1);
+	pthread_mutex_unlock(&jitter->mutex);
+}
+
+void rtp_jitter_reset(struct rtp_jitter_t *jitter)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&jitter->mutex);
+	for (i = 0; i < RTP_JITTER_SLOTS; i++)
+		jitter->slots[i].used = 0;
+	jitter->count   = 0;
+	jitter->started = 0;
+	memset(&jitter->stats, 0, sizeof(jitter->stats));
+	pthread_mutex_unlock(&jitter->mutex);
+}
+
+void rtp_jitter_set_latency(struct rtp_jitter_t *jitter, unsigned int latency)
+{
+	if (latency > RTP_JITTER_MAX_LATENCY)
+		latency = RTP_JITTER_MAX_LATENCY;
+
+	pthread_mutex_lock(&jitter->mutex);
+	jitter->latency = latency;
+	pthread_mutex_unlock(&jitter->mutex);
+}
+
+void rtp_jitter_get_stats(struct rtp_jitter_t *jitter, rtp_jitter_stats *stats)
+{
+	rtp_jitter_slot *first, *last;
+
+	pthread_mutex_lock(&jitter->mutex);
+	*stats = jitter->stats;
+	stats->latency      = jitter->latency;
+	stats->occupancy    = jitter->count;
+	stats->occupancy_ms = 0;
+	if (jitter->count > 0)
+	{
+		first = rtp_jitter_nextBuffered(jitter);
+		last  = &jitter->slots[jitter->high_seq & RTP_JITTER_MASK];
+		if (first != NULL && last->used)
+			stats->occupancy_ms = (uint32_t)(last->timestamp - first->timestamp) / (RTP_JITTER_CLOCK_RATE/1000);
+	}
+	pthread_mutex_unlock(&jitter->mutex);
+}
+
+int rtp_jitter_create(struct rtp_jitter_t **pjitter, unsigned int latency, rtp_jitter_output pOutput, void *pArg)
+{
+	struct rtp_jitter_t *jitter;
+
+	jitter = dmalloc(sizeof(struct rtp_jitter_t));
+	if (jitter == NULL)
+	{
+		eprintf("%s: failed to allocate jitter buffer\n", __FUNCTION__);
+		return -1;
+	}
+	memset(jitter, 0, sizeof(struct rtp_jitter_t) - sizeof(jitter->slots));
+	pthread_mutex_init(&jitter->mutex, NULL);
+	jitter->pOutput = pOutput;
+	jitter->pArg    = pArg;
+	jitter->latency = latency > RTP_JITTER_MAX_LATENCY ? RTP_JITTER_MAX_LATENCY : latency;
+	rtp_jitter_reset(jitter);
+
+	*pjitter = jitter;
+	return 0;
+}
+
+void rtp_jitter_destroy(struct rtp_jitter_t *jitter)
+{
+	if (jitter == NULL)
+		return;
+	pthread_mutex_destroy(&jitter->mutex);
+	dfree(jitter);
+}
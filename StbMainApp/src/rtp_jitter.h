@@ -0,0 +1,125 @@
+#if !defined(__RTP_JITTER_H)
+#define __RTP_JITTER_H
+
+/*
+ rtp_jitter.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file rtp_jitter.h RTP jitter buffer
+ * Reorders received RTP payloads by sequence number within a window,
+ * accounts lost, late and duplicate packets and releases payloads paced on
+ * their RTP timestamps delayed by configurable latency.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Number of payload slots, must be power of 2. Limits reorder window. */
+#define RTP_JITTER_SLOTS        (1024)
+#define RTP_JITTER_MAX_PAYLOAD  (1500)
+#define RTP_JITTER_MAX_LATENCY  (2000)
+/** MPEG TS over RTP uses 90 kHz timestamp clock */
+#define RTP_JITTER_CLOCK_RATE   (90000)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct
+{
+	unsigned int latency;        /**< Configured latency, ms */
+
+	unsigned long long received; /**< Packets pushed into buffer */
+	unsigned long long released; /**< Packets passed to output */
+	unsigned int lost;           /**< Sequence numbers skipped as missing */
+	unsigned int late;           /**< Packets arrived after their position was released */
+	unsigned int duplicates;
+	unsigned int reordered;      /**< Packets arrived after a packet with greater sequence number */
+	unsigned int reorder_depth;  /**< Last reorder distance, packets */
+	unsigned int reorder_max;
+	unsigned int overflows;      /**< Packets released early because reorder window was exceeded */
+	unsigned int oversized;      /**< Packets dropped because payload exceeds RTP_JITTER_MAX_PAYLOAD */
+	unsigned int dropped;        /**< Packets dropped because output was not ready when they had to be released */
+	unsigned int resyncs;        /**< Timestamp or sequence discontinuities */
+
+	unsigned int occupancy;      /**< Packets currently buffered */
+	unsigned int occupancy_max;
+	unsigned int occupancy_ms;   /**< Buffered stream duration by RTP timestamps */
+} rtp_jitter_stats;
+
+/** Returns 0 if payload was consumed, nonzero if output is not ready and payload must stay buffered */
+typedef int (*rtp_jitter_output)(void *pArg, unsigned char *data, size_t size);
+
+struct rtp_jitter_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  rtp_jitter_create(struct rtp_jitter_t **pjitter, unsigned int latency, rtp_jitter_output pOutput, void *pArg);
+void rtp_jitter_destroy(struct rtp_jitter_t *jitter);
+
+/** Changes latency, ms. Takes effect for packets released after the call. */
+void rtp_jitter_set_latency(struct rtp_jitter_t *jitter, unsigned int latency);
+
+/**
+ *  @brief Puts payload into buffer and releases all payloads that are due
+ *
+ *  @return 0 if payload was accepted, 1 if it was dropped as late, duplicate or oversized
+ */
+int  rtp_jitter_push(struct rtp_jitter_t *jitter, uint16_t seq, uint32_t timestamp, const unsigned char *data, size_t size);
+
+/** Releases payloads that became due since last push, must be called periodically */
+void rtp_jitter_poll(struct rtp_jitter_t *jitter);
+
+/** Releases all buffered payloads in sequence order */
+void rtp_jitter_flush(struct rtp_jitter_t *jitter);
+
+/** Drops buffered payloads and resets sequence tracking */
+void rtp_jitter_reset(struct rtp_jitter_t *jitter);
+
+void rtp_jitter_get_stats(struct rtp_jitter_t *jitter, rtp_jitter_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__RTP_JITTER_H
@@ -0,0 +1,624 @@
+/*
+ scheduler.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "scheduler.h"
+
+#include "debug.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define SCHEDULER_HASH_SIZE  (64)
+#define SCHEDULER_READY_SIZE (SCHEDULER_MAX_EVENTS)
+#define SCHEDULER_NONE       (-1)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct
+{
+	schedulerAction_t pAction;
+	void     *pArg;
+	uint64_t  deadline; // monotonic, microseconds
+	int       heapPos;
+	int       hashNext; // also used as free list link
+} schedulerEvent_t;
+
+typedef struct
+{
+	schedulerAction_t pAction;
+	void     *pArg;
+	uint64_t  deadline;
+	uint64_t  queued;   // monotonic time the job entered ready queue
+} schedulerJob_t;
+
+/******************************************************************
+* STATIC FUNCTION PROTOTYPES                  <Module>[_<Word>+]  *
+*******************************************************************/
+
+static void *scheduler_timerThread(void *pArg);
+static void *scheduler_workerThread(void *pArg);
+static void *scheduler_overflowThread(void *pArg);
+
+/***********************************************
+* STATIC DATA                                  *
+************************************************/
+
+static pthread_mutex_t   scheduler_mutex      = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    scheduler_timerCond;
+static pthread_cond_t    scheduler_readyCond;
+
+static pthread_t         scheduler_timer;
+static int               scheduler_running    = 0;
+static int               scheduler_initialized = 0;
+static volatile int     *scheduler_alive      = NULL;
+
+static schedulerEvent_t  scheduler_events[SCHEDULER_MAX_EVENTS];
+static int               scheduler_heap[SCHEDULER_MAX_EVENTS];
+static int               scheduler_hash[SCHEDULER_HASH_SIZE];
+static int               scheduler_freeList;
+static int               scheduler_count;
+
+static schedulerJob_t    scheduler_ready[SCHEDULER_READY_SIZE];
+static int               scheduler_readyHead;
+static int               scheduler_readyCount;
+
+static schedulerStats_t  scheduler_stats;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
+*******************************************************************/
+
+/* Must be called with scheduler_mutex held */
+static void scheduler_reset(void)
+{
+	pthread_condattr_t attr;
+	int i;
+
+	if (!scheduler_initialized)
+	{
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&scheduler_timerCond, &attr);
+		pthread_condattr_destroy(&attr);
+		pthread_cond_init(&scheduler_readyCond, NULL);
+		memset(&scheduler_stats, 0, sizeof(scheduler_stats));
+		scheduler_initialized = 1;
+	}
+
+	for (i = 0; i < SCHEDULER_HASH_SIZE; i++)
+		scheduler_hash[i] = SCHEDULER_NONE;
+	for (i = 0; i < SCHEDULER_MAX_EVENTS; i++)
+	{
+		scheduler_events[i].pAction  = NULL;
+		scheduler_events[i].hashNext = i+1 < SCHEDULER_MAX_EVENTS ? i+1 : SCHEDULER_NONE;
+	}
+	scheduler_freeList   = 0;
+	scheduler_count      = 0;
+	scheduler_readyHead  = 0;
+	scheduler_readyCount = 0;
+}
+
+static uint64_t scheduler_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static inline unsigned int scheduler_hashKey(schedulerAction_t pAction, void *pArg)
+{
+	unsigned long key = (unsigned long)pAction ^ ((unsigned long)pArg * 2654435761UL);
+	key ^= key >> 7;
+	return (unsigned int)(key % SCHEDULER_HASH_SIZE);
+}
+
+static int scheduler_find(schedulerAction_t pAction, void *pArg, int **ppLink)
+{
+	int *link = &scheduler_hash[scheduler_hashKey(pAction, pArg)];
+
+	while (*link != SCHEDULER_NONE)
+	{
+		schedulerEvent_t *ev = &scheduler_events[*link];
+		if (ev->pAction == pAction && ev->pArg == pArg)
+		{
+			if (ppLink)
+				*ppLink = link;
+			return *link;
+		}
+		link = &ev->hashNext;
+	}
+	return SCHEDULER_NONE;
+}
+
+static inline void scheduler_heapSet(int pos, int id)
+{
+	scheduler_heap[pos] = id;
+	scheduler_events[id].heapPos = pos;
+}
+
+static void scheduler_siftUp(int pos)
+{
+	int id = scheduler_heap[pos];
+	uint64_t deadline = scheduler_events[id].deadline;
+
+	while (pos > 0)
+	{
+		int parent = (pos-1)/2;
+		if (scheduler_events[scheduler_heap[parent]].deadline <= deadline)
+			break;
+		scheduler_heapSet(pos, scheduler_heap[parent]);
+		pos = parent;
+	}
+	scheduler_heapSet(pos, id);
+}
+
+static void scheduler_siftDown(int pos)
+{
+	int id = scheduler_heap[pos];
+	uint64_t deadline = scheduler_events[id].deadline;
+
+	for (;;)
+	{
+		int child = 2*pos+1;
+		if (child >= scheduler_count)
+			break;
+		if (child+1 < scheduler_count &&
+		    scheduler_events[scheduler_heap[child+1]].deadline < scheduler_events[scheduler_heap[child]].deadline)
+			child++;
+		if (deadline <= scheduler_events[scheduler_heap[child]].deadline)
+			break;
+		scheduler_heapSet(pos, scheduler_heap[child]);
+		pos = child;
+	}
+	scheduler_heapSet(pos, id);
+}
+
+static void scheduler_heapUpdate(int pos)
+{
+	if (pos > 0 && scheduler_events[scheduler_heap[(pos-1)/2]].deadline > scheduler_events[scheduler_heap[pos]].deadline)
+		scheduler_siftUp(pos);
+	else
+		scheduler_siftDown(pos);
+}
+
+/* Must be called with scheduler_mutex held */
+static void scheduler_delete(int id, int *link)
+{
+	int pos = scheduler_events[id].heapPos;
+
+	*link = scheduler_events[id].hashNext;
+
+	scheduler_count--;
+	if (pos != scheduler_count)
+	{
+		scheduler_heapSet(pos, scheduler_heap[scheduler_count]);
+		scheduler_heapUpdate(pos);
+	}
+
+	scheduler_events[id].pAction  = NULL;
+	scheduler_events[id].hashNext = scheduler_freeList;
+	scheduler_freeList = id;
+}
+
+int scheduler_addEvent(schedulerAction_t pAction, void *pArg, int timeout, int replaceSimilar)
+{
+	int id;
+	int count;
+	unsigned int key;
+
+	if (pAction == NULL)
+		return -1;
+
+	pthread_mutex_lock(&scheduler_mutex);
+
+	/* Events may be added before scheduler_init, they fire once it starts */
+	if (!scheduler_initialized)
+		scheduler_reset();
+
+	id = replaceSimilar ? scheduler_find(pAction, pArg, NULL) : SCHEDULER_NONE;
+	if (id != SCHEDULER_NONE)
+	{
+		scheduler_events[id].deadline = scheduler_now() + (uint64_t)(timeout > 0 ? timeout : 0)*1000;
+		scheduler_heapUpdate(scheduler_events[id].heapPos);
+	} else
+	{
+		if (scheduler_freeList == SCHEDULER_NONE)
+		{
+			scheduler_stats.rejected++;
+			pthread_mutex_unlock(&scheduler_mutex);
+			eprintf("%s: event pool is full, dropping %p(%p)\n", __FUNCTION__, pAction, pArg);
+			return -1;
+		}
+		id = scheduler_freeList;
+		scheduler_freeList = scheduler_events[id].hashNext;
+
+		key = scheduler_hashKey(pAction, pArg);
+		scheduler_events[id].pAction  = pAction;
+		scheduler_events[id].pArg     = pArg;
+		scheduler_events[id].deadline = scheduler_now() + (uint64_t)(timeout > 0 ? timeout : 0)*1000;
+		scheduler_events[id].hashNext = scheduler_hash[key];
+		scheduler_hash[key] = id;
+
+		scheduler_heapSet(scheduler_count, id);
+		scheduler_count++;
+		scheduler_siftUp(scheduler_count-1);
+
+		if ((uint32_t)scheduler_count > scheduler_stats.pendingMax)
+			scheduler_stats.pendingMax = scheduler_count;
+	}
+
+	/* Timer thread only has to wake up if earliest deadline changed */
+	if (scheduler_heap[0] == id)
+		pthread_cond_signal(&scheduler_timerCond);
+
+	count = scheduler_count;
+	pthread_mutex_unlock(&scheduler_mutex);
+
+	return count;
+}
+
+int scheduler_removeEvent(schedulerAction_t pAction, void *pArg)
+{
+	int id;
+	int *link = NULL;
+
+	pthread_mutex_lock(&scheduler_mutex);
+
+	if (!scheduler_initialized)
+	{
+		pthread_mutex_unlock(&scheduler_mutex);
+		return -1;
+	}
+
+	id = scheduler_find(pAction, pArg, &link);
+	if (id == SCHEDULER_NONE)
+	{
+		pthread_mutex_unlock(&scheduler_mutex);
+		return -1;
+	}
+	/* Removing earliest event only makes timer thread wake up later, no need to signal it */
+	scheduler_delete(id, link);
+
+	pthread_mutex_unlock(&scheduler_mutex);
+	return 0;
+}
+
+/* Must be called with scheduler_mutex held */
+static void scheduler_dispatch(schedulerAction_t pAction, void *pArg, uint64_t deadline)
+{
+	scheduler_stats.fired++;
+
+	if (scheduler_readyCount < SCHEDULER_READY_SIZE)
+	{
+		schedulerJob_t *job = &scheduler_ready[(scheduler_readyHead + scheduler_readyCount) % SCHEDULER_READY_SIZE];
+		job->pAction  = pAction;
+		job->pArg     = pArg;
+		job->deadline = deadline;
+		job->queued   = scheduler_now();
+		scheduler_readyCount++;
+		if ((uint32_t)scheduler_readyCount > scheduler_stats.readyMax)
+			scheduler_stats.readyMax = scheduler_readyCount;
+		pthread_cond_signal(&scheduler_readyCond);
+	} else
+	{
+		/* All workers are stuck in long actions: fall back to a one-shot
+		 * thread rather than delaying the event indefinitely. */
+		pthread_t id;
+		schedulerJob_t *job = dmalloc(sizeof(schedulerJob_t));
+
+		scheduler_stats.overflows++;
+		if (job == NULL)
+		{
+			eprintf("%s: failed to allocate overflow job\n", __FUNCTION__);
+			return;
+		}
+		job->pAction  = pAction;
+		job->pArg     = pArg;
+		job->deadline = deadline;
+		job->queued   = scheduler_now();
+		if (pthread_create(&id, NULL, scheduler_overflowThread, job) == 0)
+		{
+			pthread_detach(id);
+		} else
+		{
+			eprintf("%s: failed to create event-action thread!\n", __FUNCTION__);
+			dfree(job);
+		}
+	}
+}
+
+/* Must be called with scheduler_mutex held.
+ * Returns time when oldest ready job starts starving, UINT64_MAX if there is
+ * nothing to wait for. */
+static uint64_t scheduler_starveDeadline(void)
+{
+	if (scheduler_readyCount == 0 ||
+	    scheduler_stats.busyWorkers < scheduler_stats.workers ||
+	    scheduler_stats.workers >= SCHEDULER_MAX_WORKERS)
+		return UINT64_MAX;
+	return scheduler_ready[scheduler_readyHead].queued + SCHEDULER_STARVE_TIMEOUT*1000;
+}
+
+/* Must be called with scheduler_mutex held */
+static void scheduler_spawnWorker(void)
+{
+	pthread_t id;
+	int err;
+
+	/* Temporary worker drains ready queue and exits once it is empty */
+	err = pthread_create(&id, NULL, scheduler_workerThread, (void*)1);
+	if (err)
+	{
+		eprintf("%s: failed to create temporary worker: %s\n", __FUNCTION__, strerror(err));
+		/* Retry after another timeout instead of spinning */
+		scheduler_ready[scheduler_readyHead].queued = scheduler_now();
+		return;
+	}
+	pthread_detach(id);
+	scheduler_stats.workers++;
+	scheduler_stats.overflows++;
+}
+
+static void *scheduler_timerThread(void *pArg)
+{
+	struct timespec ts;
+	uint64_t now, wake;
+	schedulerEvent_t *ev;
+	int *link;
+	int id;
+
+	pthread_mutex_lock(&scheduler_mutex);
+	while (scheduler_running)
+	{
+		now  = scheduler_now();
+		wake = scheduler_starveDeadline();
+		if (wake <= now)
+		{
+			scheduler_spawnWorker();
+			continue;
+		}
+
+		if (scheduler_count == 0 || scheduler_events[scheduler_heap[0]].deadline > now)
+		{
+			if (scheduler_count > 0 && scheduler_events[scheduler_heap[0]].deadline < wake)
+				wake = scheduler_events[scheduler_heap[0]].deadline;
+			if (wake == UINT64_MAX)
+			{
+				pthread_cond_wait(&scheduler_timerCond, &scheduler_mutex);
+			} else
+			{
+				ts.tv_sec  = wake / 1000000;
+				ts.tv_nsec = (wake % 1000000) * 1000;
+				pthread_cond_timedwait(&scheduler_timerCond, &scheduler_mutex, &ts);
+			}
+			continue;
+		}
+
+		id = scheduler_heap[0];
+		ev = &scheduler_events[id];
+
+		/* Duplicates may share a key: unlink exactly this node */
+		link = &scheduler_hash[scheduler_hashKey(ev->pAction, ev->pArg)];
+		while (*link != id)
+			link = &scheduler_events[*link].hashNext;
+		scheduler_dispatch(ev->pAction, ev->pArg, ev->deadline);
+		scheduler_delete(id, link);
+	}
+	pthread_mutex_unlock(&scheduler_mutex);
+
+	return NULL;
+}
+
+static void scheduler_runJob(schedulerJob_t *job)
+{
+	uint64_t started, finished;
+	uint32_t late, run;
+
+	if (scheduler_alive != NULL && *scheduler_alive == 0)
+	{
+		pthread_mutex_lock(&scheduler_mutex);
+		scheduler_stats.skipped++;
+		pthread_mutex_unlock(&scheduler_mutex);
+		return;
+	}
+
+	started = scheduler_now();
+	job->pAction(job->pArg);
+	finished = scheduler_now();
+
+	late = (uint32_t)(started  - job->deadline);
+	run  = (uint32_t)(finished - started);
+
+	pthread_mutex_lock(&scheduler_mutex);
+	scheduler_stats.lateLastUs   = late;
+	scheduler_stats.lateTotalUs += late;
+	if (late > scheduler_stats.lateMaxUs)
+		scheduler_stats.lateMaxUs = late;
+	scheduler_stats.runLastUs    = run;
+	scheduler_stats.runTotalUs  += run;
+	if (run > scheduler_stats.runMaxUs)
+		scheduler_stats.runMaxUs = run;
+	scheduler_stats.completed++;
+	pthread_mutex_unlock(&scheduler_mutex);
+}
+
+static void *scheduler_workerThread(void *pArg)
+{
+	int temporary = pArg != NULL;
+	schedulerJob_t job;
+
+	pthread_mutex_lock(&scheduler_mutex);
+	while (scheduler_running)
+	{
+		if (scheduler_readyCount == 0)
+		{
+			if (temporary)
+				break;
+			pthread_cond_wait(&scheduler_readyCond, &scheduler_mutex);
+			continue;
+		}
+		job = scheduler_ready[scheduler_readyHead];
+		scheduler_readyHead = (scheduler_readyHead + 1) % SCHEDULER_READY_SIZE;
+		scheduler_readyCount--;
+		scheduler_stats.busyWorkers++;
+		/* Pool just became fully busy with jobs left: let timer thread watch them */
+		if (scheduler_readyCount > 0 && scheduler_stats.busyWorkers >= scheduler_stats.workers)
+			pthread_cond_signal(&scheduler_timerCond);
+		pthread_mutex_unlock(&scheduler_mutex);
+
+		scheduler_runJob(&job);
+
+		pthread_mutex_lock(&scheduler_mutex);
+		scheduler_stats.busyWorkers--;
+	}
+	scheduler_stats.workers--;
+	pthread_mutex_unlock(&scheduler_mutex);
+
+	return NULL;
+}
+
+static void *scheduler_overflowThread(void *pArg)
+{
+	schedulerJob_t *job = pArg;
+	scheduler_runJob(job);
+	dfree(job);
+	return NULL;
+}
+
+int scheduler_init(int workers, volatile int *pAlive)
+{
+	pthread_t id;
+	int i, err;
+
+	if (workers <= 0)
+		workers = SCHEDULER_DEFAULT_WORKERS;
+	if (workers > SCHEDULER_MAX_WORKERS)
+		workers = SCHEDULER_MAX_WORKERS;
+
+	pthread_mutex_lock(&scheduler_mutex);
+	if (scheduler_running)
+	{
+		pthread_mutex_unlock(&scheduler_mutex);
+		return 0;
+	}
+	if (!scheduler_initialized)
+		scheduler_reset();
+	scheduler_alive   = pAlive;
+	scheduler_running = 1;
+	pthread_mutex_unlock(&scheduler_mutex);
+
+	err = pthread_create(&scheduler_timer, NULL, scheduler_timerThread, NULL);
+	if (err)
+	{
+		eprintf("%s: failed to create timer thread: %s\n", __FUNCTION__, strerror(err));
+		scheduler_running = 0;
+		return -1;
+	}
+
+	for (i = 0; i < workers; i++)
+	{
+		/* Workers are detached: destroy must not wait for actions which may
+		 * themselves wait for the thread calling destroy. */
+		err = pthread_create(&id, NULL, scheduler_workerThread, NULL);
+		if (err)
+		{
+			eprintf("%s: failed to create worker %d: %s\n", __FUNCTION__, i, strerror(err));
+			break;
+		}
+		pthread_detach(id);
+		pthread_mutex_lock(&scheduler_mutex);
+		scheduler_stats.workers++;
+		pthread_mutex_unlock(&scheduler_mutex);
+	}
+
+	return 0;
+}
+
+void scheduler_destroy(void)
+{
+	pthread_mutex_lock(&scheduler_mutex);
+	if (!scheduler_running)
+	{
+		pthread_mutex_unlock(&scheduler_mutex);
+		return;
+	}
+	scheduler_running = 0;
+	pthread_cond_broadcast(&scheduler_timerCond);
+	pthread_cond_broadcast(&scheduler_readyCond);
+	pthread_mutex_unlock(&scheduler_mutex);
+
+	pthread_join(scheduler_timer, NULL);
+
+	pthread_mutex_lock(&scheduler_mutex);
+	scheduler_reset();
+	pthread_mutex_unlock(&scheduler_mutex);
+}
+
+void scheduler_getStats(schedulerStats_t *stats)
+{
+	pthread_mutex_lock(&scheduler_mutex);
+	if (!scheduler_initialized)
+		scheduler_reset();
+	*stats = scheduler_stats;
+	stats->pending = scheduler_count;
+	stats->ready   = scheduler_readyCount;
+	pthread_mutex_unlock(&scheduler_mutex);
+}
+
+void scheduler_printStats(void)
+{
+	schedulerStats_t s;
+
+	scheduler_getStats(&s);
+	eprintf("scheduler: pending %u (max %u) ready %u (max %u) workers %u/%u\n",
+		s.pending, s.pendingMax, s.ready, s.readyMax, s.busyWorkers, s.workers);
+	eprintf("scheduler: fired %llu overflows %llu rejected %llu skipped %llu\n",
+		(unsigned long long)s.fired, (unsigned long long)s.overflows, (unsigned long long)s.rejected,
+		(unsigned long long)s.skipped);
+	if (s.completed > 0)
+	{
+		eprintf("scheduler: late last %u max %u avg %llu us, run last %u max %u avg %llu us\n",
+			s.lateLastUs, s.lateMaxUs, (unsigned long long)(s.lateTotalUs/s.completed),
+			s.runLastUs,  s.runMaxUs,  (unsigned long long)(s.runTotalUs/s.completed));
+	}
+}
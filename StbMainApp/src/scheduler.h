@@ -0,0 +1,141 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+/*
+ scheduler.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file scheduler.h Deadline-driven timed event scheduler
+ * Pending events are kept in a binary min-heap ordered by deadline. A single
+ * timer thread sleeps on a condition variable until the earliest deadline and
+ * hands fired actions to a pool of worker threads. If every worker is stuck in
+ * a long action, the timer thread adds a temporary worker so that queued
+ * actions are not delayed by more than SCHEDULER_STARVE_TIMEOUT.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include <stdint.h>
+
+/***********************************************
+* EXPORTED MACROS                              *
+************************************************/
+
+/** Maximum number of simultaneously pending events */
+#define SCHEDULER_MAX_EVENTS      (128)
+/** Default number of worker threads executing fired actions */
+#define SCHEDULER_DEFAULT_WORKERS (4)
+/** Upper limit for worker threads, including temporary ones */
+#define SCHEDULER_MAX_WORKERS     (16)
+/** Time in ms a fired action may wait for a busy pool before a temporary worker is spawned */
+#define SCHEDULER_STARVE_TIMEOUT  (100)
+
+/***********************************************
+* EXPORTED TYPEDEFS                            *
+************************************************/
+
+typedef int (*schedulerAction_t)(void*);
+
+typedef struct
+{
+	uint32_t pending;      /**< Events currently waiting for their deadline */
+	uint32_t pendingMax;   /**< High-water mark of pending events */
+	uint32_t ready;        /**< Fired actions waiting for a free worker */
+	uint32_t readyMax;     /**< High-water mark of fired actions waiting for a worker */
+	uint32_t busyWorkers;  /**< Workers currently executing an action */
+	uint32_t workers;      /**< Total number of workers, including temporary ones */
+
+	uint64_t fired;        /**< Total number of fired events */
+	uint64_t overflows;    /**< Temporary workers spawned because the pool was busy or the ready queue was full */
+	uint64_t rejected;     /**< Events not added because the heap was full */
+	uint64_t skipped;      /**< Fired actions not run because application is shutting down */
+
+	uint32_t lateLastUs;   /**< Delay between deadline and actual start of the last action */
+	uint32_t lateMaxUs;
+	uint64_t lateTotalUs;
+
+	uint32_t runLastUs;    /**< Execution time of the last completed action */
+	uint32_t runMaxUs;
+	uint64_t runTotalUs;
+	uint64_t completed;
+} schedulerStats_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @brief Starts timer thread and worker pool
+ *
+ *  @param[in]  workers  Number of worker threads, 0 selects SCHEDULER_DEFAULT_WORKERS
+ *  @param[in]  pAlive   Optional flag checked before each fired action, actions are skipped once it is 0
+ *
+ *  @return 0 on success
+ */
+int  scheduler_init(int workers, volatile int *pAlive);
+
+/**
+ *  @brief Stops timer thread and signals workers to exit after finishing current actions
+ *
+ *  Pending events are discarded.
+ */
+void scheduler_destroy(void);
+
+/**
+ *  @brief Schedules pAction(pArg) to run after timeout milliseconds
+ *
+ *  @param[in]  replaceSimilar  If set and event with equal pAction & pArg is pending, its deadline is reset instead of adding new event
+ *
+ *  @return Number of pending events on success, -1 if pool is full or pAction is NULL
+ */
+int  scheduler_addEvent(schedulerAction_t pAction, void *pArg, int timeout, int replaceSimilar);
+
+/**
+ *  @brief Cancels pending event with equal pAction & pArg
+ *
+ *  Actions that already fired are not affected.
+ *
+ *  @return 0 if event was found and removed, -1 otherwise
+ */
+int  scheduler_removeEvent(schedulerAction_t pAction, void *pArg);
+
+void scheduler_getStats(schedulerStats_t *stats);
+void scheduler_printStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__SCHEDULER_H
@@ -71,6 +71,30 @@ int mysem_get(pmysem_t semaphore)
 	return 0;
 }
 
+/********************************************************************************/
+int mysem_tryget(pmysem_t semaphore)
+{
+	int rc;
+	if(semaphore == NULL) {
+		eprintf("Error: while trying get semaphore\n");
+		return -1;
+	}
+	if((rc = pthread_mutex_lock(&(semaphore->mutex))) != 0) {
+		eprintf("%s:%s()[%d]: Error: rc=%d\n", __FILE__, __func__, __LINE__, rc);
+		return rc;
+	}
+
+	if(semaphore->semCount > 0) {
+		semaphore->semCount--;
+		rc = 0;
+	} else {
+		rc = EBUSY;
+	}
+
+	pthread_mutex_unlock(&(semaphore->mutex));
+	return rc;
+}
+
 /********************************************************************************/
 int mysem_release(pmysem_t semaphore)
 {
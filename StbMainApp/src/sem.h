@@ -58,6 +58,9 @@ extern "C" {
 /* Obtains the semaphore. */
 extern int mysem_get(pmysem_t semaphore);
 
+/* Obtains the semaphore only if it is free, returns EBUSY otherwise. */
+extern int mysem_tryget(pmysem_t semaphore);
+
 /* Releases the semaphore. */
 extern int mysem_release(pmysem_t semaphore);
 
@@ -37,7 +37,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifdef STSDK
 
 #include "debug.h"
-#include "client.h"
 #include "app_info.h"
 #include "interface.h"
 #include "helper.h"
@@ -46,20 +45,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
 #include <gfx.h>
+#include <elcd-rpc-client.h>
 
 /***********************************************
 * LOCAL MACROS                                 *
 ************************************************/
 
-#define RPC_POOL_SIZE (32)
-
-//#define RPC_POOL_TRACE
-//#define RPC_TRACE eprintf
-#ifndef RPC_TRACE
-#define RPC_TRACE(x...)
-#endif
-//#define RPC_DUMP "/var/log/mainapp_rpc.log"
+/** Times reported by elcd are reused during this period */
+#define ST_TIMES_CACHE_MS (250)
 
 /***********************************************
 * LOCAL TYPEDEFS                               *
@@ -67,39 +62,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 typedef struct
 {
-	unsigned int id;
-	void      *pArg;
-	rpcCallback_t callback;
-#ifdef DEBUG
-	elcdRpcCommand_t cmd;
-#endif
-#ifdef RPC_POOL_TRACE
-	char      *msg;
-#endif
-} rpc_t;
-
-typedef struct
-{
-	unsigned int    id;
-	elcdRpcType_t   type;
-	cJSON         * jsonResult;
-	char          * pArg;
-	sem_t           lock;
-} rpcSync_t;
-
-typedef struct
-{
-	socketClient_t socket;
-	rpc_t waiting[RPC_POOL_SIZE];
-	pthread_t thread;
-} rpcPool_t;
+	pthread_mutex_t lock;       // serializes times requests
+	pthread_mutex_t valueLock;
+	double          position;
+	double          length;
+	uint32_t        updated;    // ms
+	uint32_t        generation; // incremented when playback state changes
+	int             valid;
+} stTimes_t;
 
 /******************************************************************
 * STATIC FUNCTION PROTOTYPES                  <Module>_<Word>+    *
 *******************************************************************/
 
-static void  st_syncCallback(elcdRpcType_t type, cJSON *result, void* pArg);
-static void* st_poolThread(void* pArg);
+static void st_rpcNotify(const char *method, cJSON *params, void *pArg);
 static int st_setVideoFormat(const char *output, const char *mode);
 
 /******************************************************************
@@ -126,18 +102,12 @@ static const struct {
 	{0, NULL}
 };
 #endif
-static rpcPool_t pool;
-
-#ifdef RPC_DUMP
-static int st_rpc_fd = -1;
-#endif
+static rpcClient_t *st_rpc = NULL;
+static stTimes_t st_times = {
+	.lock      = PTHREAD_MUTEX_INITIALIZER,
+	.valueLock = PTHREAD_MUTEX_INITIALIZER,
+};
 
-/** request_id should never be zero */
-static unsigned int request_id = 1;
-static inline unsigned int get_id()
-{
-	return request_id+=2;
-}
 static int needRestart = 0;
 static g_board_type_t g_board_id = eSTB830;
 static int32_t g_board_ver = 0;
@@ -149,24 +119,10 @@ static int32_t g_board_ver = 0;
 
 int st_init(void)
 {
-	int res;
-	memset(&pool, 0, sizeof(pool));
-
-#ifdef RPC_DUMP
-	st_rpc_fd = open(RPC_DUMP, O_CREAT|O_WRONLY);
-	if(st_rpc_fd < 0) {
-		exit(110);
-	}
-#endif
-
-	if((res = client_create(&pool.socket, ELCD_SOCKET_FILE, NULL, NULL, NULL, NULL)) != 0) {
-		eprintf("%s: failed to connect elcd socket\n", __FUNCTION__);
-		return res;
-	}
-
-	res = pthread_create(&pool.thread, NULL, st_poolThread, NULL);
-	if(res != 0) {
-		eprintf("%s: (!) failed to create pool thread: %s\n", __FUNCTION__, strerror(res));
+	st_rpc = rpcClient_create(ELCD_SOCKET_FILE, st_rpcNotify, NULL);
+	if(st_rpc == NULL) {
+		eprintf("%s: failed to create elcd client\n", __FUNCTION__);
+		return -1;
 	}
 
 #ifdef ENABLE_FUSION
@@ -175,127 +131,55 @@ int st_init(void)
 	//eprintf("%s: st_setVideoFormat %s\n", __FUNCTION__, FUSION_PREFERRED_FMT);
 	//st_setVideoFormat("main", FUSION_PREFERRED_FMT);
 #endif
-	return res;
+	return 0;
 }
 
 void st_terminate(void )
 {
-	if( pool.thread != 0 )
-	{
-		pthread_cancel( pool.thread );
-		eprintf("%s: waiting pool thread to finish...\n", __FUNCTION__);
-		pthread_join( pool.thread, NULL );
-		pool.thread = 0;
+	if(st_rpc) {
+		rpcClientStats_t stats;
+		rpcClient_getStats(st_rpc, &stats);
+		eprintf("%s: %u calls in %u writes, %u replies, %u notifications, %u lost, max %u waiting\n", __FUNCTION__,
+			stats.calls, stats.batches, stats.received, stats.notifications, stats.lost, stats.pendingMax);
+		rpcClient_destroy(st_rpc);
+		st_rpc = NULL;
 	}
-	client_destroy(&pool.socket);
-#ifdef RPC_DUMP
-	close(st_rpc_fd);
-	st_rpc_fd = -1;
-#endif
 }
 
-static inline void st_poolFreeAt(int i)
+static uint32_t st_getMs(void)
 {
-	pool.waiting[i].id = 0;
-#ifdef RPC_POOL_TRACE
-	free(pool.waiting[i].msg);
-	pool.waiting[i].msg = NULL;
-#endif
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1000 + t.tv_nsec/1000000;
 }
 
-#ifdef RPC_POOL_TRACE
-static void st_poolPrint(void)
+/** Playback commands change position, so cached times should not be used */
+static inline void st_rpcPrepare(elcdRpcCommand_t cmd)
 {
-	int empty = 1;
-	int i;
-	for( i = 0; i<RPC_POOL_SIZE; i++)
-		if( pool.waiting[i].id )
-		{
-			printf("  pool[%2u]: %6u %s\n", i, pool.waiting[i].id, pool.waiting[i].msg);
-			empty = 0;
-		}
-	if( empty )
-		printf("  pool is empty\n");
+	if(cmd >= elcmd_async) {
+		st_resetTimes();
+	}
 }
-#else
-#define st_poolPrint()
-#endif
 
 int st_rpcAsync(elcdRpcCommand_t cmd, cJSON* params, rpcCallback_t callback, void *pArg)
 {
-	int res = -1;
-
-	int i;
-	for( i = 0; i<RPC_POOL_SIZE; i++ )
-		if( pool.waiting[i].id == 0 )
-			break;
-	if( i >= RPC_POOL_SIZE )
-	{
-		eprintf("%s: RPC pool is full\n", __FUNCTION__);
-		return -1;
-	}
+	int res;
 
-	unsigned int id = get_id();
-	char *msg = rpc_request( rpc_getCmdName(cmd), id, params );
-	if( !msg )
-	{
-		eprintf("%s: failed to create RPC message\n", __FUNCTION__);
-		return -1;
+	st_rpcPrepare(cmd);
+	res = rpcClient_call(st_rpc, rpc_getCmdName(cmd), params, callback, pArg);
+	if(res < 0) {
+		eprintf("%s: failed to send %s\n", __FUNCTION__, rpc_getCmdName(cmd));
 	}
-	pool.waiting[i].id   = id;
-	pool.waiting[i].callback = callback;
-	pool.waiting[i].pArg = pArg;
-#ifdef DEBUG
-	pool.waiting[i].cmd  = cmd;
-#endif
-#ifdef RPC_POOL_TRACE
-	pool.waiting[i].msg  = msg;
-	dprintf("%s[%2d]: -> %s\n", __FUNCTION__, i, msg);
-#endif
-	RPC_TRACE("st: -> %s\n", msg);
-#ifdef RPC_DUMP
-	write(st_rpc_fd, msg, strlen(msg));
-	write(st_rpc_fd, "\n", 1);
-#endif
-	if( client_write( &pool.socket, msg, strlen(msg)+1 ) > 0 )
-	{
-		res = i;
-		st_poolPrint();
-	}
-	else
-	{
-		eprintf("%s: failed to write %s\n", __FUNCTION__, rpc_getCmdName(cmd));
-		st_poolFreeAt(i);
-	}
-#ifndef RPC_POOL_TRACE
-	free(msg);
-#endif
 	return res;
 }
 
 void st_cancelAsync(int index, int execute)
 {
-	if (index < 0 || index >= RPC_POOL_SIZE)
-	{
-		eprintf("%s: index %d is out of range!\n", __FUNCTION__, index);
+	if(index <= 0) {
+		eprintf("%s: invalid request %d!\n", __FUNCTION__, index);
 		return;
 	}
-#ifdef RPC_POOL_TRACE
-	dprintf("%s[%2d]: cancel %s\n", __FUNCTION__, index, pool.waiting[index].msg);
-#endif
-	if (execute && pool.waiting[index].callback)
-	{
-		pool.waiting[index].callback(elcdRpcInvalid, NULL, pool.waiting[index].pArg);
-	}
-	st_poolFreeAt(index);
-}
-
-void st_syncCallback(elcdRpcType_t type, cJSON *result, void* pArg)
-{
-	rpcSync_t *s = pArg;
-	s->type       = type;
-	s->jsonResult = result;
-	sem_post(&s->lock);
+	rpcClient_cancel(st_rpc, index, execute);
 }
 
 int st_rpcSync(elcdRpcCommand_t cmd, cJSON* params, elcdRpcType_t *type, cJSON **result)
@@ -305,50 +189,108 @@ int st_rpcSync(elcdRpcCommand_t cmd, cJSON* params, elcdRpcType_t *type, cJSON *
 
 int st_rpcSyncTimeout(elcdRpcCommand_t cmd, cJSON* params, int timeout , elcdRpcType_t *type, cJSON **result)
 {
-	rpcSync_t s;
+	int res;
 
-	s.type = elcdRpcInvalid;
-	if (sem_init(&s.lock, 0, 0) != 0 )
-	{
-		eprintf("%s: failed to create semaphore: %s\n", __FUNCTION__, strerror(errno));
-		return -1;
+	st_rpcPrepare(cmd);
+	res = rpcClient_callSync(st_rpc, rpc_getCmdName(cmd), params, timeout*1000, type, result);
+	if(res == -2) {
+		dprintf("%s: canceled %s\n", __FUNCTION__, rpc_getCmdName(cmd));
 	}
+	return res;
+}
 
-	int i;
-	if( (i = st_rpcAsync( cmd, params, st_syncCallback, &s )) < 0 )
+double st_getTimeValue(cJSON *object, const char *value_name)
+{
+	unsigned int hh, mm, ss;
+	cJSON *pos = cJSON_GetObjectItem(object, value_name);
+	if (pos &&
+	    pos->type == cJSON_String &&
+	    sscanf(pos->valuestring, "%02u:%02u:%02u", &hh, &mm, &ss) == 3)
 	{
-		sem_destroy(&s.lock);
-		return -1;
+		return ss + 60 * mm + 3600 * hh;
 	}
+	return 0;
+}
 
-	struct timespec t;
-	t.tv_sec  = time(NULL)+timeout;
-	t.tv_nsec = 0;
-	sem_timedwait(&s.lock, &t);
+static void st_setTimes(cJSON *times, uint32_t generation)
+{
+	pthread_mutex_lock(&st_times.valueLock);
+	if(st_times.generation == generation) {
+		st_times.position = st_getTimeValue(times, "current");
+		st_times.length   = st_getTimeValue(times, "total");
+		st_times.updated  = st_getMs();
+		st_times.valid    = 1;
+	}
+	pthread_mutex_unlock(&st_times.valueLock);
+}
 
-	sem_destroy(&s.lock);
-	if( s.type == elcdRpcInvalid )
-	{
-#ifndef RPC_POOL_TRACE
-		dprintf("%s: canceled rpc[%2u]: %6u %s\n", __FUNCTION__, i, pool.waiting[i].id, rpc_getCmdName(pool.waiting[i].cmd));
-#else
-		dprintf("%s: canceled rpc[%2u]: %s\n", __FUNCTION__, i, pool.waiting[i].msg);
-#endif
-		st_poolFreeAt(i);
-		st_poolPrint();
-		return -2;
+static int st_getCachedTimes(double *position, double *length)
+{
+	int valid;
+
+	pthread_mutex_lock(&st_times.valueLock);
+	valid = st_times.valid && st_getMs() - st_times.updated < ST_TIMES_CACHE_MS;
+	if(valid) {
+		if(position) *position = st_times.position;
+		if(length)   *length   = st_times.length;
+	}
+	pthread_mutex_unlock(&st_times.valueLock);
+	return valid;
+}
+
+void st_resetTimes(void)
+{
+	pthread_mutex_lock(&st_times.valueLock);
+	st_times.generation++;
+	st_times.valid = 0;
+	pthread_mutex_unlock(&st_times.valueLock);
+}
+
+int st_getTimes(double *position, double *length)
+{
+	elcdRpcType_t type;
+	cJSON        *res = NULL;
+	uint32_t      generation;
+	int           ret = 0;
+
+	if(st_getCachedTimes(position, length)) {
+		return 0;
 	}
-	if (type) {
-		*type = s.type;
+	// concurrent callers wait for the single request in flight
+	pthread_mutex_lock(&st_times.lock);
+	if(!st_getCachedTimes(position, length)) {
+		pthread_mutex_lock(&st_times.valueLock);
+		generation = st_times.generation;
+		pthread_mutex_unlock(&st_times.valueLock);
+
+		ret = rpcClient_callSync(st_rpc, rpc_getCmdName(elcmd_times), NULL, RPC_TIMEOUT*1000, &type, &res);
+		if(ret == 0 && type == elcdRpcResult && res && res->type == cJSON_Object) {
+			st_setTimes(res, generation);
+			if(position) *position = st_getTimeValue(res, "current");
+			if(length)   *length   = st_getTimeValue(res, "total");
+		} else {
+			ret = -1;
+		}
+		cJSON_Delete(res);
 	}
+	pthread_mutex_unlock(&st_times.lock);
+	return ret;
+}
 
-	if (!result) {
-		cJSON_Delete(s.jsonResult);
+static void st_rpcNotify(const char *method, cJSON *params, void *pArg)
+{
+	if(params && params->type == cJSON_Array) {
+		params = params->child;
 	}
-	else {
-		*result = s.jsonResult;
+	if(strcmp(method, rpc_getCmdName(elcmd_times)) == 0 && params && params->type == cJSON_Object) {
+		uint32_t generation;
+		pthread_mutex_lock(&st_times.valueLock);
+		generation = st_times.generation;
+		pthread_mutex_unlock(&st_times.valueLock);
+		st_setTimes(params, generation);
+		return;
 	}
-	return 0;
+	dprintf("%s: %s\n", __FUNCTION__, method);
 }
 
 int st_isOk(elcdRpcType_t type, cJSON *res, const char *msg)
@@ -366,113 +308,6 @@ int st_isOk(elcdRpcType_t type, cJSON *res, const char *msg)
     return 1;
 }
 
-static void st_poolThreadCleanup(void* pArg)
-{
-	eprintf("%s: out, cancelling waiting RPCs\n", __FUNCTION__);
-	st_poolPrint();
-	int i;
-	for( i = 0; i < RPC_POOL_SIZE; i++ )
-		if( pool.waiting[i].id )
-		{
-			cJSON *err = cJSON_CreateString( "canceled" );
-			pool.waiting[i].callback( elcdRpcError, err, pool.waiting[i].pArg );
-			st_poolFreeAt(i);
-			cJSON_Delete(err);
-		}
-}
-
-static void *st_poolThread(void* pArg)
-{
-	char buf[BUFFER_SIZE];
-	cJSON *msg = NULL;
-
-	pthread_cleanup_push(st_poolThreadCleanup, NULL);
-	for(;;)
-	{
-		pthread_testcancel();
-
-		if (client_read( &pool.socket, buf, sizeof(buf)) <= 0)
-		{
-			usleep(50000);
-			continue;
-		}
-
-		RPC_TRACE("st: <- %s\n", buf);
-		msg = cJSON_Parse( buf );
-		if( !msg )
-		{
-			eprintf("%s: failed to parse message: '%s'\n", __FUNCTION__, buf);
-			continue;
-		}
-
-		elcdRpcType_t type = elcdRpcInvalid;
-		cJSON *value = NULL;
-		cJSON *id = cJSON_GetObjectItem(msg, "id");
-		if( !id || id->type != cJSON_Number || id->valueint == 0 )
-		{
-			eprintf("%s: missing id\n", __FUNCTION__);
-			goto type_known;
-		}
-		value = cJSON_GetObjectItem( msg, "method" );
-		if( value != NULL && value->type == cJSON_String )
-		{
-			type = elcdRpcRequest;
-			goto type_known;
-		}
-		value = cJSON_DetachItemFromObject( msg, "result" );
-		if( value != NULL && value->type != cJSON_NULL )
-		{
-			type = elcdRpcResult;
-			goto type_known;
-		}
-		value = cJSON_DetachItemFromObject( msg, "error" );
-		if( value != NULL && value->type != cJSON_NULL )
-		{
-			type = elcdRpcError;
-		}
-type_known:
-		dprintf( "%s:   <- %s type %d\n", __FUNCTION__, buf, type);
-		switch( type )
-		{
-			case elcdRpcInvalid:
-				eprintf("%s: malformed message: '%s'\n", __FUNCTION__, buf);
-				break;
-			case elcdRpcRequest:
-				/// TODO
-				eprintf("%s: don't know what to do with request %s\n", __FUNCTION__, value->valuestring);
-				break;
-			case elcdRpcError:
-			case elcdRpcResult:
-			{
-				int i;
-				for( i = 0; i < RPC_POOL_SIZE; i++ )
-					if( (unsigned int)id->valueint == pool.waiting[i].id )
-					{
-                        if(pool.waiting[i].callback)
-                        {
-                            pool.waiting[i].callback( type, value, pool.waiting[i].pArg );
-                        }
-						st_poolFreeAt(i);
-						break;
-					}
-				if( i >= RPC_POOL_SIZE )
-				{
-					eprintf("%s: lost message %6u\n", __FUNCTION__, (unsigned int)id->valueint);
-					cJSON_Delete(value);
-				}
-				st_poolPrint();
-				break;
-			}
-		}
-
-		cJSON_Delete(msg);
-		msg = NULL;
-	}
-	pthread_cleanup_pop(1);
-
-	pthread_exit(NULL);
-}
-
 #ifdef ENABLE_DVB
 static const char *getModulationName(fe_modulation_t modulation)
 {
@@ -63,12 +63,6 @@ extern "C" {
 
 #ifdef STSDK
 
-/***********************************************
-* EXPORTED TYPEDEFS                            *
-************************************************/
-
-typedef void (*rpcCallback_t)(elcdRpcType_t type, cJSON *result, void* pArg);
-
 /******************************************************************
 * EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
 *******************************************************************/
@@ -94,8 +88,9 @@ static inline int st_command(elcdRpcCommand_t cmd, cJSON* param)
 
 /** Makes asynchronous call to elcd server. Waiting has no time constraint.
  * Caller should take care of freeing params and result returned in callback.
+ * Callback is called from RPC client thread.
  * 
- * @return Place in RPC pool, >= 0 on success
+ * @return Request id, > 0 on success
  *         Negative in case of error.
  */
 int st_rpcAsync(elcdRpcCommand_t cmd, cJSON* params, rpcCallback_t callback, void *pArg);
@@ -104,10 +99,25 @@ int st_isOk(elcdRpcType_t type, cJSON *res, const char *msg);
 
 /** Cancel queued asynchronous call.
  * 
+ * @param[in] index   Request id returned by st_rpcAsync
  * @param[in] execute Call queued callback with type == invalid, empty result and saved pArg
  */
 void st_cancelAsync(int index, int execute);
 
+/** Returns playback position and length in seconds.
+ * Values pushed by elcd in times notification or received recently are reused,
+ * otherwise times is requested. Any of pointers may be NULL.
+ * 
+ * @return 0 on success
+ */
+int  st_getTimes(double *position, double *length);
+
+/** Drops cached times, called automatically for playback commands */
+void st_resetTimes(void);
+
+/** Parses hh:mm:ss value of times result */
+double st_getTimeValue(cJSON *object, const char *value_name);
+
 #ifdef ENABLE_DVB
 void st_setTuneParams(uint32_t adapter, cJSON *params, EIT_media_config_t *media);
 void st_sendDiseqc(uint32_t adapter, const uint8_t *cmd, size_t len);
@@ -45,7 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 * EXPORTED MACROS                              *
 ************************************************/
 
-#define TELETEXT_PACKET_BUFFER_SIZE (5*TS_PACKET_SIZE)
+#define TELETEXT_PACKET_BUFFER_SIZE (32*TS_PACKET_SIZE)
 #define TELETEXT_pipe_TS "/tmp/ttx.ts"
 /******************************************************************
 * EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
@@ -0,0 +1,889 @@
+/*
+ teletextDecoder.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "teletextDecoder.h"
+
+#include "debug.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define TELETEXT_TS_PACKET_SIZE  (188)
+#define TELETEXT_TS_SYNC         (0x47)
+#define TELETEXT_PES_BUFFER_SIZE (4096)
+#define TELETEXT_PES_STREAM_ID   (0xBD)
+
+#define TELETEXT_DATA_UNIT_NONSUBTITLE (0x02)
+#define TELETEXT_DATA_UNIT_SUBTITLE    (0x03)
+#define TELETEXT_DATA_UNIT_LENGTH      (44)
+
+#define TELETEXT_PAGES     (TELETEXT_LAST_PAGE - TELETEXT_FIRST_PAGE + 1)
+/* Rows 0-24 of level 1 page */
+#define TELETEXT_ALL_ROWS  ((1 << TELETEXT_ROWS) - 1)
+/* Marks character with parity error in teletextDecoder_char */
+#define TELETEXT_BAD_CHAR  (0xFF)
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+/* Page being assembled in one magazine */
+typedef struct
+{
+	int            page;         /* 0 while rows are not stored anywhere */
+	uint16_t       subpage;
+	uint8_t        flags;
+	uint8_t        charset;
+	int16_t        designation;
+	uint32_t       rows;         /* Rows page has, some may be from previous transmission */
+	uint32_t       received;     /* Rows received since header */
+	int            dirty;        /* Changed since last stored */
+	uint8_t        hasLinks;
+	uint8_t        showLinks;
+	teletextLink_t links[TELETEXT_LINKS];
+	uint32_t       headerPacket; /* stats.packets when header came */
+	char           text[TELETEXT_ROWS][TELETEXT_COLUMNS];
+} teletextMagazine_t;
+
+typedef struct
+{
+	int             count;
+	teletextPage_t *subpages[TELETEXT_MAX_SUBPAGES];
+	teletextPage_t *latest;
+} teletextStoredPage_t;
+
+struct teletextDecoder_s
+{
+	teletextDecoderReadyFunction ready;
+	void                        *pArg;
+
+	/* Transport stream and PES reassembly, used by feeding thread only */
+	uint8_t  carry[TELETEXT_TS_PACKET_SIZE];
+	size_t   carrySize;
+	int      continuity;     /* -1 until first packet */
+	int      pesStarted;
+	size_t   pesSize;
+	size_t   pesLength;      /* Full length from PES header, 0 if unknown */
+	uint8_t  pes[TELETEXT_PES_BUFFER_SIZE];
+
+	teletextMagazine_t magazines[TELETEXT_MAGAZINES];
+	int16_t  magazineDesignation[TELETEXT_MAGAZINES]; /* From M/29 */
+	teletextDecoderStats_t stats;
+
+	/* Protects everything below */
+	pthread_mutex_t        mutex;
+	char                   header[TELETEXT_COLUMNS];
+	uint32_t               sequence;
+	teletextStoredPage_t  *pages[TELETEXT_PAGES];
+};
+
+/******************************************************************
+* STATIC DATA                  g[k|p|kp|pk|kpk]<Module>_<Word>+   *
+*******************************************************************/
+
+/* Tables below are indexed by bytes with first transmitted bit as LSB,
+ * while transport stream carries them MSB first. Lookup tables used for
+ * decoding are built from them with bit reversal folded in. */
+
+static const uint8_t REVERSE_8[256] = {
+	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+	0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+	0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+	0x0c	, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+	0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+	0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+	0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+	0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+	0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+	0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+	0x05	, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+	0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+	0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+	0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+	0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+	0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+};
+
+static const uint16_t hammtab[256] = {
+	0x0101, 0x100f, 0x0001, 0x0101, 0x100f, 0x0100, 0x0101, 0x100f,
+	0x100f, 0x0102, 0x0101, 0x100f, 0x010a, 0x100f, 0x100f, 0x0107,
+	0x100f, 0x0100, 0x0101, 0x100f, 0x0100, 0x0000, 0x100f, 0x0100,
+	0x0106, 0x100f, 0x100f, 0x010b, 0x100f, 0x0100, 0x0103, 0x100f,
+	0x100f, 0x010c, 0x0101, 0x100f, 0x0104, 0x100f, 0x100f, 0x0107,
+	0x0106, 0x100f, 0x100f, 0x0107, 0x100f, 0x0107, 0x0107, 0x0007,
+	0x0106, 0x100f, 0x100f, 0x0105, 0x100f, 0x0100, 0x010d, 0x100f,
+	0x0006, 0x0106, 0x0106, 0x100f, 0x0106, 0x100f, 0x100f, 0x0107,
+	0x100f, 0x0102, 0x0101, 0x100f, 0x0104, 0x100f, 0x100f, 0x0109,
+	0x0102, 0x0002, 0x100f, 0x0102, 0x100f, 0x0102, 0x0103, 0x100f,
+	0x0108, 0x100f, 0x100f, 0x0105, 0x100f, 0x0100, 0x0103, 0x100f,
+	0x100f, 0x0102, 0x0103, 0x100f, 0x0103, 0x100f, 0x0003, 0x0103,
+	0x0104, 0x100f, 0x100f, 0x0105, 0x0004, 0x0104, 0x0104, 0x100f,
+	0x100f, 0x0102, 0x010f, 0x100f, 0x0104, 0x100f, 0x100f, 0x0107,
+	0x100f, 0x0105, 0x0105, 0x0005, 0x0104, 0x100f, 0x100f, 0x0105,
+	0x0106, 0x100f, 0x100f, 0x0105, 0x100f, 0x010e, 0x0103, 0x100f,
+	0x100f, 0x010c, 0x0101, 0x100f, 0x010a, 0x100f, 0x100f, 0x0109,
+	0x010a, 0x100f, 0x100f, 0x010b, 0x000a, 0x010a, 0x010a, 0x100f,
+	0x0108, 0x100f, 0x100f, 0x010b, 0x100f, 0x0100, 0x010d, 0x100f,
+	0x100f, 0x010b, 0x010b, 0x000b, 0x010a, 0x100f, 0x100f, 0x010b,
+	0x010c, 0x000c, 0x100f, 0x010c, 0x100f, 0x010c, 0x010d, 0x100f,
+	0x100f, 0x010c, 0x010f, 0x100f, 0x010a, 0x100f, 0x100f, 0x0107,
+	0x100f, 0x010c, 0x010d, 0x100f, 0x010d, 0x100f, 0x000d, 0x010d,
+	0x0106, 0x100f, 0x100f, 0x010b, 0x100f, 0x010e, 0x010d, 0x100f,
+	0x0108, 0x100f, 0x100f, 0x0109, 0x100f, 0x0109, 0x0109, 0x0009,
+	0x100f, 0x0102, 0x010f, 0x100f, 0x010a, 0x100f, 0x100f, 0x0109,
+	0x0008, 0x0108, 0x0108, 0x100f, 0x0108, 0x100f, 0x100f, 0x0109,
+	0x0108, 0x100f, 0x100f, 0x010b, 0x100f, 0x010e, 0x0103, 0x100f,
+	0x100f, 0x010c, 0x010f, 0x100f, 0x0104, 0x100f, 0x100f, 0x0109,
+	0x010f, 0x100f, 0x000f, 0x010f, 0x100f, 0x010e, 0x010f, 0x100f,
+	0x0108, 0x100f, 0x100f, 0x0105, 0x100f, 0x010e, 0x010d, 0x100f,
+	0x100f, 0x010e, 0x010f, 0x100f, 0x010e, 0x000e, 0x100f, 0x010e,
+};
+
+static const uint8_t vtx2iso8559_1_table[96] = {
+/* English */
+	0x20,0x21,0x22,0xa3,0x24,0x25,0x26,0x27,0x28,0x29,0x2a,0x2b,0x2c,0x2d,0x2e,0x2f,   // 0x20-0x2f
+	0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x3b,0x3c,0x3d,0x3e,0x3f,   // 0x30-0x3f
+	0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x4b,0x4c,0x4d,0x4e,0x4f,   // 0x40-0x4f
+	0x50,0x51,0x52,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x5b,0x5c,0x5d,0x5e,0x23,   // 0x50-0x5f
+	0x60,0x61,0x62,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x6b,0x6c,0x6d,0x6e,0x6f,   // 0x60-0x6f
+	0x70,0x71,0x72,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x7b,0x7c,0xbe,0xf7,0x7f    // 0x70-0x7f
+};
+
+static const uint8_t hamm24par[3][256] = {
+    { // parities of first byte
+	 0, 33, 34,  3, 35,  2,  1, 32, 36,  5,  6, 39,  7, 38, 37,  4,
+	37,  4,  7, 38,  6, 39, 36,  5,  1, 32, 35,  2, 34,  3,  0, 33,
+	38,  7,  4, 37,  5, 36, 39,  6,  2, 35, 32,  1, 33,  0,  3, 34,
+	 3, 34, 33,  0, 32,  1,  2, 35, 39,  6,  5, 36,  4, 37, 38,  7,
+	39,  6,  5, 36,  4, 37, 38,  7,  3, 34, 33,  0, 32,  1,  2, 35,
+	 2, 35, 32,  1, 33,  0,  3, 34, 38,  7,  4, 37,  5, 36, 39,  6,
+	 1, 32, 35,  2, 34,  3,  0, 33, 37,  4,  7, 38,  6, 39, 36,  5,
+	36,  5,  6, 39,  7, 38, 37,  4,  0, 33, 34,  3, 35,  2,  1, 32,
+	40,  9, 10, 43, 11, 42, 41,  8, 12, 45, 46, 15, 47, 14, 13, 44,
+	13, 44, 47, 14, 46, 15, 12, 45, 41,  8, 11, 42, 10, 43, 40,  9,
+	14, 47, 44, 13, 45, 12, 15, 46, 42, 11,  8, 41,  9, 40, 43, 10,
+	43, 10,  9, 40,  8, 41, 42, 11, 15, 46, 45, 12, 44, 13, 14, 47,
+	15, 46, 45, 12, 44, 13, 14, 47, 43, 10,  9, 40,  8, 41, 42, 11,
+	42, 11,  8, 41,  9, 40, 43, 10, 14, 47, 44, 13, 45, 12, 15, 46,
+	41,  8, 11, 42, 10, 43, 40,  9, 13, 44, 47, 14, 46, 15, 12, 45,
+	12, 45, 46, 15, 47, 14, 13, 44, 40,  9, 10, 43, 11, 42, 41,  8
+    }, { // parities of second byte
+	 0, 41, 42,  3, 43,  2,  1, 40, 44,  5,  6, 47,  7, 46, 45,  4,
+	45,  4,  7, 46,  6, 47, 44,  5,  1, 40, 43,  2, 42,  3,  0, 41,
+	46,  7,  4, 45,  5, 44, 47,  6,  2, 43, 40,  1, 41,  0,  3, 42,
+	 3, 42, 41,  0, 40,  1,  2, 43, 47,  6,  5, 44,  4, 45, 46,  7,
+	47,  6,  5, 44,  4, 45, 46,  7,  3, 42, 41,  0, 40,  1,  2, 43,
+	 2, 43, 40,  1, 41,  0,  3, 42, 46,  7,  4, 45,  5, 44, 47,  6,
+	 1, 40, 43,  2, 42,  3,  0, 41, 45,  4,  7, 46,  6, 47, 44,  5,
+	44,  5,  6, 47,  7, 46, 45,  4,  0, 41, 42,  3, 43,  2,  1, 40,
+	48, 25, 26, 51, 27, 50, 49, 24, 28, 53, 54, 31, 55, 30, 29, 52,
+	29, 52, 55, 30, 54, 31, 28, 53, 49, 24, 27, 50, 26, 51, 48, 25,
+	30, 55, 52, 29, 53, 28, 31, 54, 50, 27, 24, 49, 25, 48, 51, 26,
+	51, 26, 25, 48, 24, 49, 50, 27, 31, 54, 53, 28, 52, 29, 30, 55,
+	31, 54, 53, 28, 52, 29, 30, 55, 51, 26, 25, 48, 24, 49, 50, 27,
+	50, 27, 24, 49, 25, 48, 51, 26, 30, 55, 52, 29, 53, 28, 31, 54,
+	49, 24, 27, 50, 26, 51, 48, 25, 29, 52, 55, 30, 54, 31, 28, 53,
+	28, 53, 54, 31, 55, 30, 29, 52, 48, 25, 26, 51, 27, 50, 49, 24
+    }, { // parities of third byte
+	63, 14, 13, 60, 12, 61, 62, 15, 11, 58, 57,  8, 56,  9, 10, 59,
+	10, 59, 56,  9, 57,  8, 11, 58, 62, 15, 12, 61, 13, 60, 63, 14,
+	 9, 56, 59, 10, 58, 11,  8, 57, 61, 12, 15, 62, 14, 63, 60, 13,
+	60, 13, 14, 63, 15, 62, 61, 12,  8, 57, 58, 11, 59, 10,  9, 56,
+	 8, 57, 58, 11, 59, 10,  9, 56, 60, 13, 14, 63, 15, 62, 61, 12,
+	61, 12, 15, 62, 14, 63, 60, 13,  9, 56, 59, 10, 58, 11,  8, 57,
+	62, 15, 12, 61, 13, 60, 63, 14, 10, 59, 56,  9, 57,  8, 11, 58,
+	11, 58, 57,  8, 56,  9, 10, 59, 63, 14, 13, 60, 12, 61, 62, 15,
+	31, 46, 45, 28, 44, 29, 30, 47, 43, 26, 25, 40, 24, 41, 42, 27,
+	42, 27, 24, 41, 25, 40, 43, 26, 30, 47, 44, 29, 45, 28, 31, 46,
+	41, 24, 27, 42, 26, 43, 40, 25, 29, 44, 47, 30, 46, 31, 28, 45,
+	28, 45, 46, 31, 47, 30, 29, 44, 40, 25, 26, 43, 27, 42, 41, 24,
+	40, 25, 26, 43, 27, 42, 41, 24, 28, 45, 46, 31, 47, 30, 29, 44,
+	29, 44, 47, 30, 46, 31, 28, 45, 41, 24, 27, 42, 26, 43, 40, 25,
+	30, 47, 44, 29, 45, 28, 31, 46, 42, 27, 24, 41, 25, 40, 43, 26,
+	43, 26, 25, 40, 24, 41, 42, 27, 31, 46, 45, 28, 44, 29, 30, 47
+    }
+};
+
+// table to extract the lower 4 bit from hamm24/18 encoded bytes
+static const uint8_t hamm24val[256] = {
+      0,  0,  0,  0,  1,  1,  1,  1,  0,  0,  0,  0,  1,  1,  1,  1,
+      2,  2,  2,  2,  3,  3,  3,  3,  2,  2,  2,  2,  3,  3,  3,  3,
+      4,  4,  4,  4,  5,  5,  5,  5,  4,  4,  4,  4,  5,  5,  5,  5,
+      6,  6,  6,  6,  7,  7,  7,  7,  6,  6,  6,  6,  7,  7,  7,  7,
+      8,  8,  8,  8,  9,  9,  9,  9,  8,  8,  8,  8,  9,  9,  9,  9,
+     10, 10, 10, 10, 11, 11, 11, 11, 10, 10, 10, 10, 11, 11, 11, 11,
+     12, 12, 12, 12, 13, 13, 13, 13, 12, 12, 12, 12, 13, 13, 13, 13,
+     14, 14, 14, 14, 15, 15, 15, 15, 14, 14, 14, 14, 15, 15, 15, 15,
+      0,  0,  0,  0,  1,  1,  1,  1,  0,  0,  0,  0,  1,  1,  1,  1,
+      2,  2,  2,  2,  3,  3,  3,  3,  2,  2,  2,  2,  3,  3,  3,  3,
+      4,  4,  4,  4,  5,  5,  5,  5,  4,  4,  4,  4,  5,  5,  5,  5,
+      6,  6,  6,  6,  7,  7,  7,  7,  6,  6,  6,  6,  7,  7,  7,  7,
+      8,  8,  8,  8,  9,  9,  9,  9,  8,  8,  8,  8,  9,  9,  9,  9,
+     10, 10, 10, 10, 11, 11, 11, 11, 10, 10, 10, 10, 11, 11, 11, 11,
+     12, 12, 12, 12, 13, 13, 13, 13, 12, 12, 12, 12, 13, 13, 13, 13,
+     14, 14, 14, 14, 15, 15, 15, 15, 14, 14, 14, 14, 15, 15, 15, 15
+};
+
+// mapping from parity checks made by table hamm24par to error
+// results return by hamm24.
+// (0 = no error, 0x0100 = single bit error, 0x1000 = double error)
+static const uint16_t hamm24err[64] = {
+    0x0000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000,
+    0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000,
+    0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000,
+    0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000,
+    0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100,
+    0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100,
+    0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100, 0x0100,
+    0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000, 0x1000,
+};
+
+// mapping from parity checks made by table hamm24par to faulty bit
+// in the decoded 18 bit word.
+static const int32_t hamm24cor[64] = {
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000,
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000,
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000,
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000,
+    0x00000, 0x00000, 0x00000, 0x00001, 0x00000, 0x00002, 0x00004, 0x00008,
+    0x00000, 0x00010, 0x00020, 0x00040, 0x00080, 0x00100, 0x00200, 0x00400,
+    0x00000, 0x00800, 0x01000, 0x02000, 0x04000, 0x08000, 0x10000, 0x20000,
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000,
+};
+
+static pthread_once_t teletextDecoder_tablesOnce = PTHREAD_ONCE_INIT;
+/* Hamming 8/4 value of stream byte, -1 if it can't be corrected */
+static int8_t   teletextDecoder_hamm84[256];
+/* Latin-1 character of odd parity stream byte or TELETEXT_BAD_CHAR */
+static uint8_t  teletextDecoder_char[256];
+/* Hamming 24/18 contribution of each stream byte of triplet: data bits
+ * in bits 0-17 and parity checks in bits 24-29, combined by XOR */
+static uint32_t teletextDecoder_hamm24[3][256];
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>_<Word>+    *
+*******************************************************************/
+
+static void teletextDecoder_buildTables(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		uint8_t b = REVERSE_8[i];
+		uint8_t c = b & 0x7f;
+
+		teletextDecoder_hamm84[i] = (hammtab[b] & 0x1000) ? -1 : (int8_t)(hammtab[b] & 0x0f);
+
+		if (hamm24par[0][b] & 32)
+			teletextDecoder_char[i] = c < 0x20 ? c : vtx2iso8559_1_table[c - 0x20];
+		else
+			teletextDecoder_char[i] = TELETEXT_BAD_CHAR;
+
+		teletextDecoder_hamm24[0][i] = (uint32_t)hamm24par[0][b] << 24 | hamm24val[b];
+		teletextDecoder_hamm24[1][i] = (uint32_t)hamm24par[1][b] << 24 | (uint32_t)c << 4;
+		teletextDecoder_hamm24[2][i] = (uint32_t)hamm24par[2][b] << 24 | (uint32_t)c << 11;
+	}
+}
+
+/* Returns two Hamming 8/4 nibbles as byte, first one in low bits, or -1 */
+static inline int teletextDecoder_hamm16(const uint8_t *p)
+{
+	int low  = teletextDecoder_hamm84[p[0]];
+	int high = teletextDecoder_hamm84[p[1]];
+
+	if ((low | high) < 0)
+		return -1;
+	return low | high << 4;
+}
+
+/* Returns 18 bit value of Hamming 24/18 triplet or -1 */
+static inline int32_t teletextDecoder_hamm2418(const uint8_t *p)
+{
+	uint32_t word = teletextDecoder_hamm24[0][p[0]] ^
+	                teletextDecoder_hamm24[1][p[1]] ^
+	                teletextDecoder_hamm24[2][p[2]];
+	uint32_t check = word >> 24;
+
+	if (hamm24err[check] & 0x1000)
+		return -1;
+	return (int32_t)((word & 0x3ffff) ^ hamm24cor[check]);
+}
+
+/* Converts page number tens and units to decimal page, 0 for hex pages */
+static inline int teletextDecoder_decimalPage(int magazine, int number)
+{
+	int tens  = number >> 4;
+	int units = number & 0x0f;
+
+	if (tens > 9 || units > 9)
+		return 0;
+	return (magazine ? magazine : 8)*100 + tens*10 + units;
+}
+
+/* Must be called with decoder locked */
+static teletextPage_t *teletextDecoder_findSubpage(teletextDecoder_t *decoder, int page, int subpage)
+{
+	teletextStoredPage_t *stored;
+	int i;
+
+	if (page < TELETEXT_FIRST_PAGE || page > TELETEXT_LAST_PAGE)
+		return NULL;
+	stored = decoder->pages[page - TELETEXT_FIRST_PAGE];
+	if (stored == NULL)
+		return NULL;
+	if (subpage < 0)
+		return stored->latest;
+	for (i = 0; i < stored->count; i++)
+		if (stored->subpages[i]->subpage == subpage)
+			return stored->subpages[i];
+	return NULL;
+}
+
+/* Must be called with decoder locked. Replaces least recently received
+ * subpage when page has no room for new one */
+static teletextPage_t *teletextDecoder_allocSubpage(teletextDecoder_t *decoder, int page, int subpage)
+{
+	teletextStoredPage_t *stored = decoder->pages[page - TELETEXT_FIRST_PAGE];
+	teletextPage_t *entry;
+	int i, oldest = 0;
+
+	if (stored == NULL) {
+		stored = calloc(1, sizeof(*stored));
+		if (stored == NULL)
+			return NULL;
+		decoder->pages[page - TELETEXT_FIRST_PAGE] = stored;
+	}
+	if (stored->count < TELETEXT_MAX_SUBPAGES) {
+		entry = malloc(sizeof(*entry));
+		if (entry == NULL)
+			return NULL;
+		/* Subpages are kept sorted by code */
+		for (i = stored->count; i > 0 && stored->subpages[i-1]->subpage > subpage; i--)
+			stored->subpages[i] = stored->subpages[i-1];
+		stored->subpages[i] = entry;
+		stored->count++;
+		return entry;
+	}
+	for (i = 1; i < stored->count; i++)
+		if (stored->subpages[i]->sequence < stored->subpages[oldest]->sequence)
+			oldest = i;
+	entry = stored->subpages[oldest];
+	for (i = oldest; i < stored->count - 1; i++)
+		stored->subpages[i] = stored->subpages[i+1];
+	for (i = stored->count - 1; i > 0 && stored->subpages[i-1]->subpage > subpage; i--)
+		stored->subpages[i] = stored->subpages[i-1];
+	stored->subpages[i] = entry;
+	return entry;
+}
+
+/* Stores page assembled in magazine if it changed */
+static void teletextDecoder_storePage(teletextDecoder_t *decoder, teletextMagazine_t *magazine, int mag)
+{
+	teletextPage_t *entry;
+	uint32_t latency;
+
+	if (magazine->page == 0 || !magazine->dirty)
+		return;
+	magazine->dirty = 0;
+
+	pthread_mutex_lock(&decoder->mutex);
+	entry = teletextDecoder_findSubpage(decoder, magazine->page, magazine->subpage);
+	if (entry == NULL)
+		entry = teletextDecoder_allocSubpage(decoder, magazine->page, magazine->subpage);
+	if (entry == NULL) {
+		pthread_mutex_unlock(&decoder->mutex);
+		eprintf("%s: failed to store page %d\n", __FUNCTION__, magazine->page);
+		return;
+	}
+	entry->page        = magazine->page;
+	entry->subpage     = magazine->subpage;
+	entry->flags       = magazine->flags;
+	entry->charset     = magazine->charset;
+	entry->designation = magazine->designation >= 0 ? magazine->designation : decoder->magazineDesignation[mag];
+	entry->rows        = magazine->rows;
+	entry->sequence    = ++decoder->sequence;
+	entry->hasLinks    = magazine->hasLinks;
+	entry->showLinks   = magazine->showLinks;
+	memcpy(entry->links, magazine->links, sizeof(entry->links));
+	memcpy(entry->text, magazine->text, sizeof(entry->text));
+	decoder->pages[magazine->page - TELETEXT_FIRST_PAGE]->latest = entry;
+	pthread_mutex_unlock(&decoder->mutex);
+
+	latency = decoder->stats.packets - magazine->headerPacket;
+	decoder->stats.pagesReady++;
+	decoder->stats.latencyTotal += latency;
+	if (latency > decoder->stats.latencyMax)
+		decoder->stats.latencyMax = latency;
+
+	if (decoder->ready)
+		decoder->ready(magazine->page, magazine->subpage, decoder->pArg);
+}
+
+/* Copies characters of row, keeping previous ones where parity fails */
+static void teletextDecoder_copyRow(teletextDecoder_t *decoder, char *row, const uint8_t *p, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		uint8_t c = teletextDecoder_char[p[i]];
+
+		if (c != TELETEXT_BAD_CHAR)
+			row[i] = (char)c;
+		else
+			decoder->stats.parityErrors++;
+	}
+}
+
+static void teletextDecoder_header(teletextDecoder_t *decoder, int mag, const uint8_t *p)
+{
+	teletextMagazine_t *magazine = &decoder->magazines[mag];
+	teletextPage_t *stored;
+	int number   = teletextDecoder_hamm16(p);
+	int subcode1 = teletextDecoder_hamm16(p + 2);
+	int subcode2 = teletextDecoder_hamm16(p + 4);
+	int control  = teletextDecoder_hamm16(p + 6);
+	int clockChanged, i;
+	char header[TELETEXT_COLUMNS];
+
+	if ((number | subcode1 | subcode2 | control) < 0) {
+		/* Page boundary is lost, so rows which follow are dropped */
+		decoder->stats.hammingErrors++;
+		teletextDecoder_storePage(decoder, magazine, mag);
+		magazine->page = 0;
+		return;
+	}
+
+	/* Header ends page of its magazine, or pages of all magazines when
+	 * they are transmitted serially */
+	if (control & 0x10) {
+		for (i = 0; i < TELETEXT_MAGAZINES; i++) {
+			teletextDecoder_storePage(decoder, &decoder->magazines[i], i);
+			decoder->magazines[i].page = 0;
+		}
+	} else {
+		teletextDecoder_storePage(decoder, magazine, mag);
+		magazine->page = 0;
+	}
+
+	pthread_mutex_lock(&decoder->mutex);
+	memcpy(header, decoder->header, sizeof(header));
+	teletextDecoder_copyRow(decoder, &header[8], p + 8, TELETEXT_COLUMNS - 8);
+	clockChanged = memcmp(&header[24], &decoder->header[24], TELETEXT_COLUMNS - 24) != 0;
+	memcpy(decoder->header, header, sizeof(header));
+	pthread_mutex_unlock(&decoder->mutex);
+	if (clockChanged && decoder->ready)
+		decoder->ready(0, 0, decoder->pArg);
+
+	/* Time filling header or page which is not for display */
+	magazine->page = teletextDecoder_decimalPage(mag, number);
+	if (magazine->page == 0)
+		return;
+
+	magazine->subpage      = (subcode1 | subcode2 << 8) & TELETEXT_ANY_SUBPAGE;
+	magazine->flags        = (subcode1 >> 7) | ((subcode2 >> 6) & 0x03) << 1 | (control & 0x1f) << 3;
+	magazine->charset      = control >> 5;
+	magazine->designation  = -1;
+	magazine->headerPacket = decoder->stats.packets;
+	magazine->dirty        = 1;
+
+	/* Rows which are not sent again keep previous contents unless page is erased */
+	pthread_mutex_lock(&decoder->mutex);
+	stored = (magazine->flags & TELETEXT_FLAG_ERASE) ? NULL :
+		teletextDecoder_findSubpage(decoder, magazine->page, magazine->subpage);
+	if (stored) {
+		magazine->rows      = stored->rows;
+		magazine->hasLinks  = stored->hasLinks;
+		magazine->showLinks = stored->showLinks;
+		memcpy(magazine->links, stored->links, sizeof(magazine->links));
+		memcpy(magazine->text, stored->text, sizeof(magazine->text));
+	}
+	pthread_mutex_unlock(&decoder->mutex);
+	if (stored == NULL) {
+		magazine->rows      = 0;
+		magazine->hasLinks  = 0;
+		magazine->showLinks = 0;
+		memset(magazine->links, 0, sizeof(magazine->links));
+		memset(magazine->text, 0, sizeof(magazine->text));
+		memset(magazine->text[0], ' ', TELETEXT_COLUMNS);
+	}
+	magazine->rows    |= 1;
+	magazine->received = 1;
+	teletextDecoder_copyRow(decoder, &magazine->text[0][8], p + 8, TELETEXT_COLUMNS - 8);
+}
+
+static void teletextDecoder_row(teletextDecoder_t *decoder, int mag, int row, const uint8_t *p)
+{
+	teletextMagazine_t *magazine = &decoder->magazines[mag];
+
+	if (magazine->page == 0)
+		return;
+
+	if (!(magazine->rows & (1 << row)))
+		memset(magazine->text[row], ' ', TELETEXT_COLUMNS);
+	teletextDecoder_copyRow(decoder, magazine->text[row], p, TELETEXT_COLUMNS);
+	magazine->rows     |= 1 << row;
+	magazine->received |= 1 << row;
+	magazine->dirty     = 1;
+
+	/* Subtitles are shown row by row, other pages as soon as every row
+	 * came, without waiting for the next header of magazine */
+	if ((magazine->flags & TELETEXT_FLAG_SUBTITLE) || magazine->received == TELETEXT_ALL_ROWS)
+		teletextDecoder_storePage(decoder, magazine, mag);
+}
+
+/* Packet X/27/0 carries FastText links of page */
+static void teletextDecoder_links(teletextDecoder_t *decoder, int mag, const uint8_t *p)
+{
+	teletextMagazine_t *magazine = &decoder->magazines[mag];
+	int control, i;
+
+	if (magazine->page == 0 || teletextDecoder_hamm84[p[0]] != 0)
+		return;
+	control = teletextDecoder_hamm84[p[37]];
+	if (control < 0) {
+		decoder->stats.hammingErrors++;
+		return;
+	}
+
+	for (i = 0; i < TELETEXT_LINKS; i++) {
+		const uint8_t *l = p + 1 + 6*i;
+		int number   = teletextDecoder_hamm16(l);
+		int subcode1 = teletextDecoder_hamm16(l + 2);
+		int subcode2 = teletextDecoder_hamm16(l + 4);
+
+		if ((number | subcode1 | subcode2) < 0) {
+			decoder->stats.hammingErrors++;
+			continue;
+		}
+		/* Magazine of link is relative to the one of page */
+		magazine->links[i].page    = teletextDecoder_decimalPage(mag ^ ((subcode1 >> 7) | (subcode2 >> 5 & 0x06)), number);
+		magazine->links[i].subpage = (subcode1 | subcode2 << 8) & TELETEXT_ANY_SUBPAGE;
+	}
+	magazine->hasLinks  = 1;
+	magazine->showLinks = (control & 0x08) != 0;
+	magazine->dirty     = 1;
+}
+
+/* Packets X/28/0,4 and M/29/0,4 designate character set of page or magazine */
+static void teletextDecoder_designation(teletextDecoder_t *decoder, int mag, int row, const uint8_t *p)
+{
+	int code = teletextDecoder_hamm84[p[0]];
+	int32_t triplet;
+
+	if (code != 0 && code != 4)
+		return;
+	triplet = teletextDecoder_hamm2418(p + 1);
+	if (triplet < 0) {
+		decoder->stats.hammingErrors++;
+		return;
+	}
+	/* Only level 1 pages with 7 bit odd parity coding are decoded */
+	if (triplet & 0x7f)
+		return;
+
+	if (row == 29)
+		decoder->magazineDesignation[mag] = (triplet >> 7) & 0x7f;
+	else if (decoder->magazines[mag].page) {
+		decoder->magazines[mag].designation = (triplet >> 7) & 0x7f;
+		decoder->magazines[mag].dirty = 1;
+	}
+}
+
+/* Decodes 42 byte teletext packet starting with magazine and row address */
+static void teletextDecoder_packet(teletextDecoder_t *decoder, const uint8_t *packet)
+{
+	int address = teletextDecoder_hamm16(packet);
+	int mag, row;
+
+	decoder->stats.packets++;
+	if (address < 0) {
+		decoder->stats.hammingErrors++;
+		return;
+	}
+	mag = address & 0x07;
+	row = address >> 3;
+
+	switch (row) {
+		case 0:
+			teletextDecoder_header(decoder, mag, packet + 2);
+			break;
+		case 1 ... 24:
+			teletextDecoder_row(decoder, mag, row, packet + 2);
+			break;
+		case 27:
+			teletextDecoder_links(decoder, mag, packet + 2);
+			break;
+		case 28:
+		case 29:
+			teletextDecoder_designation(decoder, mag, row, packet + 2);
+			break;
+		default:
+			/* Enhancements X/26, broadcast service data 8/30 and
+			 * independent data services are not used for display */
+			break;
+	}
+}
+
+void teletextDecoder_feedPes(teletextDecoder_t *decoder, const uint8_t *data, size_t size)
+{
+	size_t length, pos;
+
+	decoder->stats.pesPackets++;
+	/* Private stream 1 with PES header of fixed 36 bytes, EN 300 472 */
+	if (size < 9 || data[0] != 0 || data[1] != 0 || data[2] != 1 || data[3] != TELETEXT_PES_STREAM_ID)
+		return;
+	length = 6 + (data[4] << 8 | data[5]);
+	if (length == 6 || length > size)
+		length = size;
+
+	pos = 9 + data[8];
+	/* First byte after header is data identifier */
+	for (pos++; pos + 2 <= length; pos += 2 + data[pos + 1]) {
+		int id  = data[pos];
+		int len = data[pos + 1];
+
+		if (pos + 2 + len > length)
+			break;
+		/* Data unit is field parity and line offset, framing code and packet */
+		if ((id == TELETEXT_DATA_UNIT_NONSUBTITLE || id == TELETEXT_DATA_UNIT_SUBTITLE) &&
+		    len == TELETEXT_DATA_UNIT_LENGTH)
+			teletextDecoder_packet(decoder, &data[pos + 4]);
+	}
+}
+
+static void teletextDecoder_feedTsPacket(teletextDecoder_t *decoder, const uint8_t *ts)
+{
+	int start      = ts[1] & 0x40;
+	int control    = (ts[3] >> 4) & 0x03;
+	int continuity = ts[3] & 0x0f;
+	int discontinuity = 0;
+	size_t offset = 4;
+
+	decoder->stats.tsPackets++;
+	if (ts[1] & 0x80) {
+		decoder->stats.tsErrors++;
+		decoder->pesStarted = 0;
+		return;
+	}
+	if (control & 0x02) {
+		offset += 1 + ts[4];
+		discontinuity = ts[4] > 0 && (ts[5] & 0x80);
+	}
+	if (!(control & 0x01) || offset >= TELETEXT_TS_PACKET_SIZE)
+		return;
+
+	if (decoder->continuity >= 0 && !discontinuity) {
+		if (continuity == decoder->continuity)
+			return; /* Duplicate packet */
+		if (continuity != ((decoder->continuity + 1) & 0x0f)) {
+			decoder->stats.tsErrors++;
+			decoder->pesStarted = 0;
+		}
+	}
+	decoder->continuity = continuity;
+
+	if (start) {
+		/* PES of unbounded length ends where next one starts */
+		if (decoder->pesStarted && decoder->pesSize > 0)
+			teletextDecoder_feedPes(decoder, decoder->pes, decoder->pesSize);
+		decoder->pesStarted = 1;
+		decoder->pesSize    = 0;
+		decoder->pesLength  = 0;
+	} else if (!decoder->pesStarted)
+		return;
+
+	if (decoder->pesSize + TELETEXT_TS_PACKET_SIZE - offset > sizeof(decoder->pes)) {
+		decoder->pesStarted = 0;
+		return;
+	}
+	memcpy(&decoder->pes[decoder->pesSize], &ts[offset], TELETEXT_TS_PACKET_SIZE - offset);
+	decoder->pesSize += TELETEXT_TS_PACKET_SIZE - offset;
+
+	/* Complete PES is decoded at once rather than with start of next one */
+	if (decoder->pesLength == 0 && decoder->pesSize >= 6)
+		decoder->pesLength = 6 + (decoder->pes[4] << 8 | decoder->pes[5]);
+	if (decoder->pesLength > 6 && decoder->pesSize >= decoder->pesLength) {
+		teletextDecoder_feedPes(decoder, decoder->pes, decoder->pesLength);
+		decoder->pesStarted = 0;
+	}
+}
+
+void teletextDecoder_feedTs(teletextDecoder_t *decoder, const uint8_t *data, size_t size)
+{
+	if (decoder->carrySize > 0) {
+		size_t part = TELETEXT_TS_PACKET_SIZE - decoder->carrySize;
+
+		if (part > size)
+			part = size;
+		memcpy(&decoder->carry[decoder->carrySize], data, part);
+		decoder->carrySize += part;
+		data += part;
+		size -= part;
+		if (decoder->carrySize < TELETEXT_TS_PACKET_SIZE)
+			return;
+		decoder->carrySize = 0;
+		teletextDecoder_feedTsPacket(decoder, decoder->carry);
+	}
+
+	while (size >= TELETEXT_TS_PACKET_SIZE) {
+		if (data[0] != TELETEXT_TS_SYNC) {
+			/* Resynchronize on next sync byte */
+			const uint8_t *sync = memchr(data + 1, TELETEXT_TS_SYNC, size - 1);
+
+			decoder->stats.tsErrors++;
+			decoder->pesStarted = 0;
+			if (sync == NULL) {
+				size = 0;
+				break;
+			}
+			size -= sync - data;
+			data  = sync;
+			continue;
+		}
+		teletextDecoder_feedTsPacket(decoder, data);
+		data += TELETEXT_TS_PACKET_SIZE;
+		size -= TELETEXT_TS_PACKET_SIZE;
+	}
+	if (size > 0) {
+		memcpy(decoder->carry, data, size);
+		decoder->carrySize = size;
+	}
+}
+
+teletextDecoder_t *teletextDecoder_create(teletextDecoderReadyFunction ready, void *pArg)
+{
+	teletextDecoder_t *decoder;
+	int i;
+
+	pthread_once(&teletextDecoder_tablesOnce, teletextDecoder_buildTables);
+
+	decoder = calloc(1, sizeof(*decoder));
+	if (decoder == NULL) {
+		eprintf("%s: failed to allocate decoder\n", __FUNCTION__);
+		return NULL;
+	}
+	decoder->ready      = ready;
+	decoder->pArg       = pArg;
+	decoder->continuity = -1;
+	for (i = 0; i < TELETEXT_MAGAZINES; i++) {
+		decoder->magazines[i].designation = -1;
+		decoder->magazineDesignation[i]   = -1;
+	}
+	memset(decoder->header, ' ', sizeof(decoder->header));
+	pthread_mutex_init(&decoder->mutex, NULL);
+	return decoder;
+}
+
+void teletextDecoder_destroy(teletextDecoder_t *decoder)
+{
+	int i, j;
+
+	if (decoder == NULL)
+		return;
+	for (i = 0; i < TELETEXT_PAGES; i++) {
+		if (decoder->pages[i] == NULL)
+			continue;
+		for (j = 0; j < decoder->pages[i]->count; j++)
+			free(decoder->pages[i]->subpages[j]);
+		free(decoder->pages[i]);
+	}
+	pthread_mutex_destroy(&decoder->mutex);
+	free(decoder);
+}
+
+int teletextDecoder_getPage(teletextDecoder_t *decoder, int page, int subpage, teletextPage_t *out)
+{
+	teletextPage_t *entry;
+
+	pthread_mutex_lock(&decoder->mutex);
+	entry = teletextDecoder_findSubpage(decoder, page, subpage);
+	if (entry)
+		memcpy(out, entry, sizeof(*out));
+	pthread_mutex_unlock(&decoder->mutex);
+	return entry ? 0 : -1;
+}
+
+int teletextDecoder_getSubpages(teletextDecoder_t *decoder, int page, uint16_t *subpages, int max)
+{
+	teletextStoredPage_t *stored;
+	int count = 0;
+
+	if (page < TELETEXT_FIRST_PAGE || page > TELETEXT_LAST_PAGE)
+		return 0;
+	pthread_mutex_lock(&decoder->mutex);
+	stored = decoder->pages[page - TELETEXT_FIRST_PAGE];
+	if (stored)
+		for (; count < stored->count && count < max; count++)
+			subpages[count] = stored->subpages[count]->subpage;
+	pthread_mutex_unlock(&decoder->mutex);
+	return count;
+}
+
+int teletextDecoder_findPage(teletextDecoder_t *decoder, int page, int step)
+{
+	int index, i;
+
+	if (page < TELETEXT_FIRST_PAGE || page > TELETEXT_LAST_PAGE)
+		page = step > 0 ? TELETEXT_LAST_PAGE : TELETEXT_FIRST_PAGE;
+	index = page - TELETEXT_FIRST_PAGE;
+
+	pthread_mutex_lock(&decoder->mutex);
+	for (i = 1; i < TELETEXT_PAGES; i++) {
+		int next = (index + (step > 0 ? i : TELETEXT_PAGES - i)) % TELETEXT_PAGES;
+
+		if (decoder->pages[next]) {
+			page = next + TELETEXT_FIRST_PAGE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&decoder->mutex);
+	return page;
+}
+
+void teletextDecoder_getHeader(teletextDecoder_t *decoder, char *header)
+{
+	pthread_mutex_lock(&decoder->mutex);
+	memcpy(header, decoder->header, sizeof(decoder->header));
+	pthread_mutex_unlock(&decoder->mutex);
+}
+
+void teletextDecoder_getStats(teletextDecoder_t *decoder, teletextDecoderStats_t *stats)
+{
+	memcpy(stats, &decoder->stats, sizeof(*stats));
+}
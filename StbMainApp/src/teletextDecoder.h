@@ -0,0 +1,180 @@
+#if !defined(__TELETEXT_DECODER_H)
+#define __TELETEXT_DECODER_H
+
+/*
+ teletextDecoder.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file teletextDecoder.h Teletext page assembly and storage
+ * Decodes EBU teletext carried in DVB transport stream (EN 300 472) into
+ * level 1 pages. Magazines are assembled in parallel, each in its own
+ * context, so pages transmitted in interleaved magazines do not mix. Every
+ * received subpage of rotating pages is kept together with its FastText
+ * (FLOF) links. Hamming and parity checks work on bytes as they come from
+ * stream, with bit reversal folded into lookup tables.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+#define TELETEXT_ROWS          (25)
+#define TELETEXT_COLUMNS       (40)
+#define TELETEXT_MAGAZINES     (8)
+/** Number of FastText links, red, green, yellow, cyan, next and index */
+#define TELETEXT_LINKS         (6)
+/** Subpages kept per page, least recently received one is replaced */
+#define TELETEXT_MAX_SUBPAGES  (32)
+
+#define TELETEXT_FIRST_PAGE    (100)
+#define TELETEXT_LAST_PAGE     (899)
+/** Subpage code of links and requests which match any subpage */
+#define TELETEXT_ANY_SUBPAGE   (0x3F7F)
+
+/* Page control bits C4-C11 of page header */
+#define TELETEXT_FLAG_ERASE       (0x01)
+#define TELETEXT_FLAG_NEWSFLASH   (0x02)
+#define TELETEXT_FLAG_SUBTITLE    (0x04)
+#define TELETEXT_FLAG_SUPPRESS    (0x08)
+#define TELETEXT_FLAG_UPDATE      (0x10)
+#define TELETEXT_FLAG_INTERRUPTED (0x20)
+#define TELETEXT_FLAG_INHIBIT     (0x40)
+#define TELETEXT_FLAG_SERIAL      (0x80)
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct teletextDecoder_s teletextDecoder_t;
+
+typedef struct
+{
+	uint16_t page;     /**< Decimal page number, 0 if link is not set */
+	uint16_t subpage;
+} teletextLink_t;
+
+typedef struct
+{
+	uint16_t page;         /**< Decimal page number */
+	uint16_t subpage;      /**< Subpage code S1-S4 */
+	uint8_t  flags;        /**< TELETEXT_FLAG_* */
+	uint8_t  charset;      /**< National option C12-C14 */
+	int16_t  designation;  /**< G0 set designation from X/28 or M/29, -1 if not sent */
+	uint32_t rows;         /**< Bit per received row */
+	uint32_t sequence;     /**< Grows each time page is stored */
+	uint8_t  hasLinks;     /**< Links were sent in X/27/0 */
+	uint8_t  showLinks;    /**< Row 24 holds link captions */
+	teletextLink_t links[TELETEXT_LINKS];
+	/** Latin-1 characters and spacing attributes, row 0 is header from column 8 */
+	char     text[TELETEXT_ROWS][TELETEXT_COLUMNS];
+} teletextPage_t;
+
+typedef struct
+{
+	uint32_t tsPackets;
+	uint32_t tsErrors;        /**< Lost sync, transport errors and continuity breaks */
+	uint32_t pesPackets;
+	uint32_t packets;         /**< Teletext packets (rows) received */
+	uint32_t hammingErrors;   /**< Packets dropped on uncorrectable Hamming code */
+	uint32_t parityErrors;    /**< Characters kept from previous reception */
+	uint32_t pagesReady;      /**< Pages and subpages stored */
+	uint32_t latencyTotal;    /**< Teletext packets from header to page ready, summed */
+	uint32_t latencyMax;
+} teletextDecoderStats_t;
+
+/**
+ *  @brief Called by decoding thread after page is stored
+ *
+ *  Page is 0 when only clock in rolling header changed. Called without
+ *  decoder locked, so any teletextDecoder_get* function may be used.
+ */
+typedef void (*teletextDecoderReadyFunction)(int page, int subpage, void *pArg);
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+teletextDecoder_t *teletextDecoder_create(teletextDecoderReadyFunction ready, void *pArg);
+void teletextDecoder_destroy(teletextDecoder_t *decoder);
+
+/**
+ *  @brief Decodes transport stream of teletext PID
+ *
+ *  Data is not required to be aligned to TS packets, part of packet left
+ *  at the end is completed by next call. Must be called from one thread.
+ */
+void teletextDecoder_feedTs(teletextDecoder_t *decoder, const uint8_t *data, size_t size);
+
+/** Decodes complete PES packet with teletext data units */
+void teletextDecoder_feedPes(teletextDecoder_t *decoder, const uint8_t *data, size_t size);
+
+/**
+ *  @brief Copies stored page
+ *
+ *  @param subpage Subpage code or -1 for most recently received one
+ *  @return 0 on success, -1 if there is no such page
+ */
+int  teletextDecoder_getPage(teletextDecoder_t *decoder, int page, int subpage, teletextPage_t *out);
+
+/**
+ *  @brief Lists stored subpages of page in ascending order
+ *
+ *  @return Number of subpages, at most max
+ */
+int  teletextDecoder_getSubpages(teletextDecoder_t *decoder, int page, uint16_t *subpages, int max);
+
+/**
+ *  @brief Finds nearest stored page after (step 1) or before (step -1) given one
+ *
+ *  @return Page number, or page itself if no other page is stored
+ */
+int  teletextDecoder_findPage(teletextDecoder_t *decoder, int page, int step);
+
+/** Copies last received header row, columns 8-39 hold title and clock */
+void teletextDecoder_getHeader(teletextDecoder_t *decoder, char *header);
+
+/** Copies counters, must be called from feeding thread or after it stopped */
+void teletextDecoder_getStats(teletextDecoder_t *decoder, teletextDecoderStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELETEXT_DECODER_H      Do not add any thing below this line */
@@ -40,6 +40,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
 #define STBPVR_STATUSLIST  "/tmp/stbpvrStatus.conf"
 #define STBPVR_SOCKET_FILE "/tmp/pvr.socket"
 #define STBPVR_PIPE_FILE   "/tmp/pipe_pvr"
+/* Timeshift playback is written to this FIFO, player reading it paces the stream */
+#define STBPVR_TIMESHIFT_FIFO   "/tmp/pvr_timeshift.ts"
+#define STBPVR_TIMESHIFT_FOLDER "/.timeshift"
+/* Default timeshift window in seconds */
+#define STBPVR_TIMESHIFT_WINDOW (30*60)
 #define STBPVR_FOLDER      "/pvr"
 #define STBELCD_SOCKET_FILE    "/var/run/elcd.sock"
 
@@ -0,0 +1,155 @@
+#if !defined(__PVRINDEX_H)
+#define __PVRINDEX_H
+
+/*
+
+Elecard STB820 Demo Application
+Copyright (C) 2007  Elecard Devices
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 1, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+
+*/
+
+/** @file pvrIndex.h Random access index of recordings
+ * Indexer follows PAT/PMT of recorded transport stream and stores position
+ * and PTS of every random access point (I-frame, IDR, sequence header) of
+ * video stream to index.idx file next to part%02d.ts files. Audio only
+ * streams are indexed once per second.
+ *
+ * Index consists of fixed size entries sorted by time, so reader finds
+ * position for any time or next I-frame for trick play with a binary
+ * search of few small reads, independent of recording length.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+#define PVR_INDEX_FILE     "index.idx"
+
+/** Entry flags */
+#define PVR_INDEX_IDR      (0x01) /**< Video random access point */
+#define PVR_INDEX_AUDIO    (0x02) /**< Audio PES start in stream without video */
+#define PVR_INDEX_DISCONT  (0x04) /**< PTS jumped, time is continued from previous entry */
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct pvrIndexer_s pvrIndexer_t;
+typedef struct pvrIndex_s   pvrIndex_t;
+
+/** Index entry as stored in file, host byte order */
+typedef struct
+{
+	uint64_t       pts;          /**< 33 bit PTS of access unit */
+	uint32_t       timeMs;       /**< Time since first entry */
+	uint32_t       offset;       /**< Offset of PES start packet in part */
+	uint32_t       size;         /**< Bytes up to next PES of the same stream, may continue in next part */
+	uint16_t       part;         /**< Number of part%02d.ts file */
+	uint16_t       flags;
+} pvrIndexEntry_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+/**
+ *  @brief Creates empty directory/index.idx
+ *
+ *  @return Indexer handle, NULL on failure with errno set
+ */
+pvrIndexer_t *pvrIndexer_open(const char *directory);
+
+/**
+ *  @brief Parses recorded data
+ *
+ *  Data must be passed in the order it is stored, packets may be split
+ *  between calls.
+ *
+ *  @param[in]  part    Number of part file data is stored to
+ *  @param[in]  offset  Position of data in part file
+ *
+ *  @return 0 on success, -1 with errno set if index can't be written
+ */
+int pvrIndexer_feed(pvrIndexer_t *indexer, const void *data, size_t size, int part, off_t offset);
+
+/**
+ *  @brief Stores last entry and frees indexer
+ *
+ *  @return 0 on success, -1 with errno set if index can't be written
+ */
+int pvrIndexer_close(pvrIndexer_t *indexer);
+
+/**
+ *  @brief Recreates index of finished recording from its part files
+ *
+ *  @return Number of entries, -1 with errno set on failure
+ */
+int pvrIndex_rebuild(const char *directory);
+
+/**
+ *  @brief Opens directory/index.idx for reading
+ *
+ *  Index of recording in progress may be read, new entries are picked up
+ *  by each call.
+ *
+ *  @return Index handle, NULL on failure with errno set
+ */
+pvrIndex_t *pvrIndex_open(const char *directory);
+
+void pvrIndex_close(pvrIndex_t *index);
+
+/** @return Number of entries available */
+long pvrIndex_count(pvrIndex_t *index);
+
+/** @return Time of last entry in milliseconds */
+uint32_t pvrIndex_duration(pvrIndex_t *index);
+
+/**
+ *  @brief Reads entry by number
+ *
+ *  @return 0 on success, -1 if entry is out of range
+ */
+int pvrIndex_get(pvrIndex_t *index, long number, pvrIndexEntry_t *entry);
+
+/**
+ *  @brief Finds random access point to start playback at given time
+ *
+ *  @return Number of last entry not later than timeMs, -1 if index is empty
+ */
+long pvrIndex_find(pvrIndex_t *index, uint32_t timeMs);
+
+/**
+ *  @brief Selects next I-frame to show in fast forward or rewind
+ *
+ *  Entry closest to current time + speed*periodMs is selected, where
+ *  periodMs is how long each I-frame is displayed. At least one entry is
+ *  stepped in requested direction.
+ *
+ *  @param[in]  speed  Playback speed, negative for rewind
+ *
+ *  @return Entry number, -1 when beginning or end of recording is reached
+ */
+long pvrIndex_trick(pvrIndex_t *index, long number, int speed, uint32_t periodMs);
+
+#endif /* __PVRINDEX_H      Do not add any thing below this line */
@@ -0,0 +1,161 @@
+#if !defined(__PVRWRITER_H)
+#define __PVRWRITER_H
+
+/*
+
+Elecard STB820 Demo Application
+Copyright (C) 2007  Elecard Devices
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 1, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+
+*/
+
+/** @file pvrWriter.h Buffered writer for recording part files
+ * Input thread copies stream data into a preallocated ring, writer thread
+ * drains it to part%02d.ts files in large aligned blocks, starting a new
+ * part when FILESIZE_THRESHOLD is reached.
+ *
+ * In timeshift mode short parts are written and the oldest ones are deleted,
+ * so only the configured window is kept on disk. Readers may follow the
+ * window at any lag, and the window can be turned into normal recording
+ * by renaming its parts.
+ */
+
+/*******************
+* INCLUDE FILES    *
+********************/
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*******************
+* EXPORTED MACROS  *
+********************/
+
+/** Write granularity: common multiple of TS packet and memory page sizes,
+ *  so blocks are O_DIRECT friendly and parts always end on packet boundary */
+#define PVR_WRITER_ALIGN          (188*4096/4)
+#define PVR_WRITER_BLOCK_SIZE     (8*PVR_WRITER_ALIGN)
+#define PVR_WRITER_DEFAULT_RING   (4*PVR_WRITER_BLOCK_SIZE)
+
+/** Flags for pvrWriterConfig_t */
+#define PVR_WRITER_DIRECT   (0x01) /**< Open parts with O_DIRECT, falls back to buffered I/O if unsupported */
+#define PVR_WRITER_DONTNEED (0x02) /**< Drop written blocks from page cache */
+#define PVR_WRITER_BLOCKING (0x04) /**< pvrWriter_write waits for free space instead of dropping data */
+#define PVR_WRITER_INDEX    (0x08) /**< Write random access index of normal recording, see pvrIndex.h */
+
+/*********************
+* EXPORTED TYPEDEFS  *
+**********************/
+
+typedef struct pvrWriter_s pvrWriter_t;
+
+typedef struct
+{
+	size_t         ringSize;     /**< Ring size in bytes, 0 selects PVR_WRITER_DEFAULT_RING */
+	int            flags;
+	uint32_t       window;       /**< Timeshift window in seconds, 0 for normal recording */
+} pvrWriterConfig_t;
+
+typedef struct
+{
+	size_t         ringSize;
+	size_t         used;         /**< Bytes waiting in ring */
+	size_t         usedMax;      /**< High-water mark of used */
+	uint32_t       overflows;    /**< Writes dropped because ring was full */
+	uint64_t       dropped;      /**< Bytes lost on overflows */
+	uint64_t       written;      /**< Bytes stored to disk */
+	uint32_t       blocks;       /**< Number of block writes */
+	uint32_t       blockMaxMs;   /**< Slowest block write */
+	int            part;
+	int            direct;       /**< O_DIRECT is in use */
+	int            error;        /**< errno of failed write, 0 if none */
+	uint32_t       window;       /**< Seconds available for timeshift, 0 if not in timeshift mode */
+} pvrWriterStats_t;
+
+/** Position of timeshift reader */
+typedef struct
+{
+	int            part;
+	off_t          offset;
+	int            fd;
+	int            fdPart;
+} pvrWriterReader_t;
+
+/********************************
+* EXPORTED FUNCTIONS PROTOTYPES *
+*********************************/
+
+/**
+ *  @brief Creates directory/part01.ts and starts writer thread
+ *
+ *  @return Writer handle, NULL on failure with errno set
+ */
+pvrWriter_t *pvrWriter_open(const char *directory, const pvrWriterConfig_t *config);
+
+/**
+ *  @brief Queues data for writing
+ *
+ *  Must be called from single thread. Without PVR_WRITER_BLOCKING data which
+ *  doesn't fit into ring is dropped as a whole and counted as overflow.
+ *  With PVR_WRITER_BLOCKING as much as fits is queued, waiting for free space
+ *  up to a short timeout.
+ *
+ *  @return Number of bytes queued, -1 with errno set if writer failed
+ */
+ssize_t pvrWriter_write(pvrWriter_t *writer, const void *data, size_t size);
+
+void pvrWriter_getStats(pvrWriter_t *writer, pvrWriterStats_t *stats);
+
+/**
+ *  @brief Stops deleting old parts and moves them to directory as part01.ts, part02.ts...
+ *
+ *  Recording continues in directory as normal one. Nothing is copied, so
+ *  directory must be on the same filesystem as the timeshift buffer.
+ *
+ *  @return 0 on success, -1 with errno set if parts can't be moved
+ */
+int pvrWriter_keep(pvrWriter_t *writer, const char *directory);
+
+void pvrWriter_readerInit(pvrWriterReader_t *reader);
+void pvrWriter_readerClose(pvrWriterReader_t *reader);
+
+/**
+ *  @brief Positions reader lag seconds behind live, clamped to window start
+ *
+ *  @return Actual lag in seconds
+ */
+uint32_t pvrWriter_seek(pvrWriter_t *writer, pvrWriterReader_t *reader, uint32_t lag);
+
+/**
+ *  @brief Reads data stored at reader position
+ *
+ *  @return Number of bytes read, 0 if reader reached live position,
+ *          -1 with errno ENOENT if position dropped out of window
+ */
+ssize_t pvrWriter_read(pvrWriter_t *writer, pvrWriterReader_t *reader, void *buf, size_t size);
+
+/**
+ *  @brief Flushes queued data, closes current part and frees writer
+ *
+ *  Parts of timeshift buffer which was not kept are deleted.
+ *
+ *  @param[out] stats  Final statistics, may be NULL
+ *
+ *  @return 0 on success, -1 with errno set if any write failed
+ */
+int pvrWriter_close(pvrWriter_t *writer, pvrWriterStats_t *stats);
+
+#endif /* __PVRWRITER_H      Do not add any thing below this line */
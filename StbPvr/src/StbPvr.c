@@ -29,6 +29,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
 #include <dvb_types.h>
 
 #include "StbPvr.h"
+#include "pvrWriter.h"
+#include "pvrIndex.h"
 
 /* NETLib */
 #include <platform.h>
@@ -61,6 +63,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
 #include <signal.h>
 #include <limits.h>
 #include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <poll.h>
 #include "cJSON.h"
 #include <elcd-rpc.h>
 
@@ -119,6 +124,8 @@ do {\
 #define PVR_BUFFER_SIZE (TS_PACKET_SIZE * 100)
 #define PVR_CHUNK_SIZE  (TS_PACKET_SIZE * 7)
 #define PVR_WRITE_COUNT (3)
+// Minimal interval between ring overflow reports
+#define PVR_OVERFLOW_REPORT_PERIOD (5)
 
 #define MAX_CLIENTS	4
 
@@ -161,10 +168,10 @@ typedef struct
 } stb810_dvbInfo;
 
 typedef struct {
-	int               fd;
+	pvrWriter_t      *writer;
 	char              directory[PATH_MAX];
-	int               part;
-	off_t             position;
+	int               timeshift;
+	char              recordDirectory[PATH_MAX]; /**< Where timeshift buffer goes when kept */
 } fileRecordInfo_t;
 
 // defines one chain of devices which together make up a DVB receiver/playter
@@ -227,8 +234,18 @@ typedef struct
 	char              path[PATH_MAX];
 	list_element_t   *current_job;
 	time_t            current_job_end; /**< running job end time (needed when job is deleted from outside when already started) */
+	pvrWriterConfig_t writer;
+	char              timeshiftPath[PATH_MAX];
 } pvrInfo_t;
 
+typedef struct {
+	pthread_t         thread;
+	volatile int      running;
+	volatile int32_t  seek;     /**< Requested lag in seconds, -1 if none */
+	uint32_t          lag;
+	fileRecordInfo_t *out;
+} timeshiftReaderInfo_t;
+
 /******************************************************************
 * STATIC FUNCTION PROTOTYPES  <Module>_<Word>+*
 *******************************************************************/
@@ -240,7 +257,7 @@ static char *dvb_getTempServiceName(int index);
 static int   dvb_setTuner(dvbRecordInfo_t *dvb, long frequency);
 
 static int   dvb_instance_set_defaults (dvbRecordInfo_t * dvb);
-static int   dvb_instance_open (dvbRecordInfo_t * dvb);
+static int   dvb_instance_open (dvbRecordInfo_t * dvb, const pvrWriterConfig_t *writer);
 static int   dvb_instance_setup (dvbRecordInfo_t * dvb);
 static int   dvb_instance_close (dvbRecordInfo_t * dvb);
 static int   dvb_recording_stop(pvrInfo_t *pvr);
@@ -258,6 +275,16 @@ static int   http_recording_start(pvrInfo_t *pvr, const char *url, const char *c
 static int   http_write_status(pvrInfo_t *pvr);
 
 static int   pvr_recording_stop(pvrInfo_t *pvr);
+static int   pvr_writerOpen(fileRecordInfo_t *out, const pvrWriterConfig_t *config, int flags);
+static int   pvr_writerClose(fileRecordInfo_t *out, const char *name);
+static int   pvr_writerStatus(fileRecordInfo_t *out, char source);
+
+static void  pvr_timeshiftDirectory(pvrInfo_t *pvr, fileRecordInfo_t *out, const char *name);
+static int   pvr_timeshiftPlay(pvrInfo_t *pvr, uint32_t lag);
+static void  pvr_timeshiftStop(void);
+static void  pvr_timeshiftJoin(void);
+static int   pvr_timeshiftKeep(pvrInfo_t *pvr);
+static int   pvr_timeshiftStatus(void);
 
 static int   pvr_importJobList(void);
 static int   pvr_clearJobList(void);
@@ -278,6 +305,12 @@ static volatile int     exit_app = 0;
 static volatile int     update_required = 1;
 static time_t           notifyTimeout = 10;
 static dvb_status_rec   dvb_status_rec_t = 0;
+/* Protects fileRecordInfo_t.writer pointers against status requests from socket thread */
+static pthread_mutex_t  writer_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes starting and stopping timeshift reader between RTP, HTTP, DVB
+ * and socket threads, taken before writer_lock */
+static pthread_mutex_t  timeshift_lock = PTHREAD_MUTEX_INITIALIZER;
+static timeshiftReaderInfo_t timeshift_reader;
 
 static struct clientSockets
 {
@@ -458,7 +491,7 @@ static int dvb_instance_setup (dvbRecordInfo_t * dvb)
    create a dvb player instance by chaining the basic devices.
    Uses given device setup data (params) & device paths.
 */
-static int dvb_instance_open (dvbRecordInfo_t * dvb)
+static int dvb_instance_open (dvbRecordInfo_t * dvb, const pvrWriterConfig_t *writer)
 {
 	char path[MAX_PATH_LENGTH];
 	int error;
@@ -516,15 +549,12 @@ static int dvb_instance_open (dvbRecordInfo_t * dvb)
 		return -1;
 	}
 
-	dvb->out.position  = 0;
-	dvb->out.part = 1;
-
 	if (!dvb->play_only)
 	{
-		sprintf(path, "%s/part%02d.ts", dvb->out.directory, dvb->out.part);
-		if ((dvb->out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) <0)
+		// input can't wait: dvr device overflows and loses packets anyway
+		if (pvr_writerOpen(&dvb->out, writer, 0) != 0)
 		{
-			PERROR ("failed opening '%s' for write", path);
+			PERROR ("failed opening '%s/part01.ts' for write", dvb->out.directory);
 			return -1;
 		}
 	}
@@ -552,7 +582,8 @@ do { \
 	CLOSE_FD(dvb->fdf, "frontend");
 #endif
 	CLOSE_FD(dvb->fdin,"input");
-	CLOSE_FD(dvb->out.fd, "output");
+	if (pvr_writerClose(&dvb->out, "DVB") != 0)
+		PERROR("output closed with error");
 	CLOSE_FD(dvb->fdplay, "pipe");
 	dvb->play_only = 0;
 
@@ -827,6 +858,7 @@ static int dvb_recording_start(pvrInfo_t *pvr, int channel, EIT_service_t *servi
 		}
 	}
 	strftime(str, 20, "%Y-%m-%d/%H-%M", t);
+	pvr_timeshiftDirectory(pvr, &dvb->out, "dvb");
 	INFO("Recording to '%s'\n", dvb->out.directory);
 
 	mkdirs(dvb->out.directory);
@@ -835,7 +867,7 @@ static int dvb_recording_start(pvrInfo_t *pvr, int channel, EIT_service_t *servi
 	INFO( "Starting recording\n" );
 
 	if (0 == dvb_instance_set_defaults(dvb) &&
-	    0 == dvb_instance_open(dvb) &&
+	    0 == dvb_instance_open(dvb, &pvr->writer) &&
 	    0 == dvb_getPIDs( service, 0, NULL, NULL, &vpid, &apid, &pcr))
 	{
 		dvb_setTuner(dvb, dvb_getFrequency(service));
@@ -927,7 +959,7 @@ static int rtp_recording_stop(pvrInfo_t *pvr)
 
 		small_rtp_stop(pvr->rtp.RTPSession);
 		small_rtp_destroy(pvr->rtp.RTPSession);
-		close(pvr->rtp.out.fd);
+		pvr_writerClose(&pvr->rtp.out, "RTP");
 
 		pvr->rtp.desc.fmt = payloadTypeUnknown;
 
@@ -943,33 +975,17 @@ static unsigned long rtp_recv_callback(void *arg, const unsigned char *buffer, u
 {
 	pvrInfo_t *pvr = (pvrInfo_t *)arg;
 	rtpRecordInfo_t * rtp = &pvr->rtp;
-	static char filename[PATH_MAX];
+	static time_t overflow_report = 0;
 	int res = 0;
 
-	if (rtp->out.fd <= 0)
+	if (rtp->out.writer == NULL)
 		return 0;
 
-    if (rtp->out.position + numbytes > FILESIZE_THRESHOLD)
-	{
-		close(rtp->out.fd);
-		sprintf(filename, "%s/part%02d.ts", rtp->out.directory, rtp->out.part+1);
-		if ((rtp->out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) >= 0)
-		{
-			rtp->out.part++;
-			rtp->out.position = 0;
-		} else
-		{
-			PERROR("Failed to open '%s' for writing", filename);
-			goto rtp_record_failed;
-		}
-	}
-
-	res = write(rtp->out.fd, buffer, numbytes);
+	res = pvrWriter_write(rtp->out.writer, buffer, numbytes);
 	if (res < 0)
 	{
-		close(pvr->rtp.out.fd);
-		pvr->rtp.out.fd = -1;
 		PERROR("Write error");
+		pvr_writerClose(&rtp->out, "RTP");
 		switch (errno)
 		{
 			case ENOSPC: write_chunk("es", 3); break;
@@ -980,10 +996,14 @@ static unsigned long rtp_recv_callback(void *arg, const unsigned char *buffer, u
 
 		//pvr->rtp.desc.fmt = payloadTypeUnknown;
 		goto rtp_record_failed;
-	} else
-		rtp->out.position += res;
+	} else if (res == 0 && time(NULL) - overflow_report >= PVR_OVERFLOW_REPORT_PERIOD)
+	{
+		overflow_report = time(NULL);
+		ERROR("RTP recording buffer overflow");
+		pvr_writerStatus(&rtp->out, 'u');
+	}
 	//INFO("%s: written %d\n", __FUNCTION__, res);
-	return res;
+	return numbytes;
 
 rtp_record_failed:
 	pvr->current_job_end = 0;
@@ -996,7 +1016,7 @@ rtp_record_failed:
 static int rtp_recording_start(pvrInfo_t *pvr, media_desc *desc, struct in_addr *ip, char *channelName)
 {
 	rtpRecordInfo_t *rtp = &pvr->rtp;
-	char *str, filename[PATH_MAX];
+	char *str;
 	time_t rawtime;
 	int st;
 	struct tm *t;
@@ -1044,13 +1064,11 @@ static int rtp_recording_start(pvrInfo_t *pvr, media_desc *desc, struct in_addr
 	time( &rawtime );
 	t = localtime(&rawtime);
 	strftime(str, 20, "%Y-%m-%d/%H-%M", t);
+	pvr_timeshiftDirectory(pvr, &rtp->out, "rtp");
 	mkdirs(rtp->out.directory);
 
 	INFO("Recording RTP to '%s'\n", rtp->out.directory);
-	rtp->out.part = 1;
-	rtp->out.position = 0;
-	sprintf(filename, "%s/part%02d.ts", rtp->out.directory, rtp->out.part);
-	if ((rtp->out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) < 0)
+	if (pvr_writerOpen(&rtp->out, &pvr->writer, 0) != 0)
 	{
 		PERROR("Output file create failed");
 		write_chunk( "e", 2 );
@@ -1066,6 +1084,7 @@ static int rtp_recording_start(pvrInfo_t *pvr, media_desc *desc, struct in_addr
 	rtp_write_status(pvr);
 	return 0;
 failure:
+	pvr_writerClose(&rtp->out, "RTP");
 	rtp->desc.fmt = payloadTypeUnknown;
 	return -1;
 }
@@ -1076,52 +1095,28 @@ static size_t http_write_callback(char *buffer, size_t size, size_t nmemb, void
 	httpRecordInfo_t *http = &pvr->http;
 	ssize_t numbytes = size*nmemb;
 	ssize_t offset, written;
-	static char filename[PATH_MAX];
 
-	if( http->out.fd <= 0 )
+	if( http->out.writer == NULL )
 		return 0;
 
-    if (http->out.position + numbytes > FILESIZE_THRESHOLD)
-	{
-		close(http->out.fd);
-		sprintf(filename, "%s/part%02d.ts", http->out.directory, http->out.part+1);
-		if ((http->out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) >= 0)
-		{
-			http->out.part++;
-			http->out.position = 0;
-		} else
-		{
-			switch( errno )
-			{
-				case ENOSPC:
-					write_chunk("es", 3);
-					break;
-				default:
-					write_chunk("e", 2);
-			}
-			return 0;
-		}
-	}
-
 	offset = 0;
 	do
 	{
 		if( http->need_stop )
 			break;
-		written = write(http->out.fd, &buffer[offset], (numbytes-offset));
-		//INFO("Written %d of %d (%d total)\n", written, size*nmemb, http->out.position + written);
-		if (written > 0)
+		// blocking writer: slow disk throttles download instead of losing data
+		written = pvrWriter_write(http->out.writer, &buffer[offset], (numbytes-offset));
+		//INFO("Written %d of %d\n", written, size*nmemb);
+		if (written >= 0)
 		{
 			offset += written;
-			http->out.position += written;
 		} else
 		{
-			close(pvr->http.out.fd);
-			pvr->http.out.fd = -1;
+			PERROR("Write error");
+			pvr_writerClose(&http->out, "HTTP");
 			pvr->current_job_end = 0;
 			if( pvr->current_job && ((pvrJob_t*)(pvr->current_job->data))->type == pvrJobTypeHTTP )
 				pvr_cancelCurrentJob(pvr);
-			PERROR("Write error");
 			switch( errno )
 			{
 				case ENOSPC:
@@ -1183,7 +1178,7 @@ static void* http_record_thread(void *pArg)
 		ERROR("Failed to download '%s': %s\n", http->url, errbuff );
 	}
 	curl_easy_cleanup( http->curl );
-	close(http->out.fd);
+	pvr_writerClose(&http->out, "HTTP");
 	http->curl = NULL;
 
 	http_write_status(pvr);
@@ -1194,7 +1189,7 @@ static void* http_record_thread(void *pArg)
 static int http_recording_start(pvrInfo_t *pvr, const char *url, const char *channelName)
 {
 	httpRecordInfo_t *http = &pvr->http;
-	char *str, filename[PATH_MAX];
+	char *str;
 	time_t rawtime;
 	struct tm *t;
 	struct stat stat_info;
@@ -1260,13 +1255,11 @@ static int http_recording_start(pvrInfo_t *pvr, const char *url, const char *cha
 	time( &rawtime );
 	t = localtime(&rawtime);
 	strftime(str, 20, "%Y-%m-%d/%H-%M", t);
+	pvr_timeshiftDirectory(pvr, &http->out, "http");
 	mkdirs(http->out.directory);
 
 	INFO("Recording HTTP to '%s'\n", http->out.directory);
-	http->out.part = 1;
-	http->out.position = 0;
-	sprintf(filename, "%s/part%02d.ts", http->out.directory, http->out.part);
-	if ((http->out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) < 0)
+	if (pvr_writerOpen(&http->out, &pvr->writer, PVR_WRITER_BLOCKING) != 0)
 	{
 		PERROR("Output file create failed");
 		write_chunk( "e", 2 );
@@ -1284,6 +1277,7 @@ static int http_recording_start(pvrInfo_t *pvr, const char *url, const char *cha
 	http_write_status(pvr);
 	return 0;
 failure:
+	pvr_writerClose(&http->out, "HTTP");
 	curl_easy_cleanup( http->curl );
 	return -1;
 }
@@ -1323,6 +1317,307 @@ static int pvr_recording_stop(pvrInfo_t *pvr)
 	return 0;
 }
 
+static int pvr_writerOpen(fileRecordInfo_t *out, const pvrWriterConfig_t *config, int flags)
+{
+	pvrWriterConfig_t writerConfig = *config;
+	pvrWriter_t *writer;
+
+	writerConfig.flags |= flags;
+	writerConfig.window = out->timeshift ? config->window : 0;
+	writer = pvrWriter_open(out->directory, &writerConfig);
+
+	pthread_mutex_lock(&writer_lock);
+	out->writer = writer;
+	pthread_mutex_unlock(&writer_lock);
+
+	return writer != NULL ? 0 : -1;
+}
+
+static int pvr_writerClose(fileRecordInfo_t *out, const char *name)
+{
+	pvrWriterStats_t stats;
+	pvrWriter_t *writer;
+	int ret, err;
+
+	/* Reader is stopped and writer detached under one lock, so reader can't
+	 * be started again on closing writer */
+	pthread_mutex_lock(&timeshift_lock);
+	if (timeshift_reader.running && timeshift_reader.out == out)
+		pvr_timeshiftJoin();
+
+	pthread_mutex_lock(&writer_lock);
+	writer = out->writer;
+	out->writer = NULL;
+	pthread_mutex_unlock(&writer_lock);
+	pthread_mutex_unlock(&timeshift_lock);
+	out->timeshift = 0; // next recording is normal unless requested again
+
+	if (writer == NULL)
+		return 0;
+
+	ret = pvrWriter_close(writer, &stats);
+	err = errno;
+	INFO("%s recording closed: %llu bytes in %d part(s), ring %u/%u KB used max, %u overflows (%llu bytes lost), slowest write %u ms%s\n",
+		name, (unsigned long long)stats.written, stats.part,
+		(unsigned)(stats.usedMax/1024), (unsigned)(stats.ringSize/1024),
+		stats.overflows, (unsigned long long)stats.dropped, stats.blockMaxMs,
+		stats.direct ? ", direct I/O" : "");
+	errno = err;
+	return ret;
+}
+
+/* Sends w<source> message with ring statistics of active recording */
+static int pvr_writerStatus(fileRecordInfo_t *out, char source)
+{
+	pvrWriterStats_t stats;
+	char buf[BUFFER_SIZE];
+	int active = 0;
+
+	pthread_mutex_lock(&writer_lock);
+	if (out->writer != NULL)
+	{
+		pvrWriter_getStats(out->writer, &stats);
+		active = 1;
+	}
+	pthread_mutex_unlock(&writer_lock);
+
+	if (!active)
+		return 0;
+
+	snprintf(buf, sizeof(buf), "w%cring=%u used=%u max=%u overflows=%u dropped=%llu written=%llu part=%d slowest=%u direct=%d error=%d window=%u",
+		source, (unsigned)stats.ringSize, (unsigned)stats.used, (unsigned)stats.usedMax,
+		stats.overflows, (unsigned long long)stats.dropped, (unsigned long long)stats.written,
+		stats.part, stats.blockMaxMs, stats.direct, stats.error, stats.window);
+	return write_chunk(buf, strlen(buf)+1);
+}
+
+/*****************************************************************************
+ * Timeshift
+ */
+
+/* Redirects output of recording being started to timeshift buffer,
+ * original directory is used if buffer is kept later */
+static void pvr_timeshiftDirectory(pvrInfo_t *pvr, fileRecordInfo_t *out, const char *name)
+{
+	DIR *dir;
+	struct dirent *entry;
+	char filename[PATH_MAX];
+
+	if (!out->timeshift)
+		return;
+
+	strcpy(out->recordDirectory, out->directory);
+	if (pvr->timeshiftPath[0] != 0)
+		snprintf(out->directory, sizeof(out->directory), "%s/%s", pvr->timeshiftPath, name);
+	else
+		snprintf(out->directory, sizeof(out->directory), "%s" STBPVR_FOLDER STBPVR_TIMESHIFT_FOLDER "/%s", pvr->path, name);
+
+	// parts left by previous run
+	if ((dir = opendir(out->directory)) != NULL)
+	{
+		while ((entry = readdir(dir)) != NULL)
+		{
+			if (strncmp(entry->d_name, "part", 4) == 0)
+			{
+				snprintf(filename, sizeof(filename), "%s/%s", out->directory, entry->d_name);
+				unlink(filename);
+			}
+		}
+		closedir(dir);
+	}
+}
+
+static fileRecordInfo_t *pvr_timeshiftSource(pvrInfo_t *pvr)
+{
+	if (pvr->dvb.out.writer  != NULL && pvr->dvb.out.timeshift)  return &pvr->dvb.out;
+	if (pvr->rtp.out.writer  != NULL && pvr->rtp.out.timeshift)  return &pvr->rtp.out;
+	if (pvr->http.out.writer != NULL && pvr->http.out.timeshift) return &pvr->http.out;
+	return NULL;
+}
+
+/* Streams timeshift buffer to FIFO. Player opening the FIFO paces reading,
+ * pausing player just stops reading while buffer keeps recording. */
+static void *pvr_timeshiftThread(void *pArg)
+{
+	timeshiftReaderInfo_t *reader_info = (timeshiftReaderInfo_t *)pArg;
+	pvrWriter_t *writer = reader_info->out->writer;
+	pvrWriterReader_t reader;
+	unsigned char buffer[PVR_BUFFER_SIZE];
+	int fd = -1;
+
+	pvrWriter_readerInit(&reader);
+	while (reader_info->running)
+	{
+		ssize_t length, offset;
+
+		if (fd < 0)
+		{
+			// non-blocking open fails with ENXIO until player opens FIFO
+			if ((fd = open(STBPVR_TIMESHIFT_FIFO, O_WRONLY | O_NONBLOCK)) < 0)
+			{
+				if (errno != ENXIO)
+					PERROR("Failed to open %s", STBPVR_TIMESHIFT_FIFO);
+				usleep(100000);
+				continue;
+			}
+			INFO("Timeshift player connected\n");
+		}
+		if (reader_info->seek >= 0)
+		{
+			reader_info->lag  = pvrWriter_seek(writer, &reader, reader_info->seek);
+			reader_info->seek = -1;
+			INFO("Timeshift playback %u s behind live\n", reader_info->lag);
+		}
+
+		length = pvrWriter_read(writer, &reader, buffer, sizeof(buffer));
+		if (length < 0)
+		{
+			if (errno != ENOENT)
+			{
+				PERROR("Timeshift read error");
+				break;
+			}
+			// paused longer than window
+			pvrWriter_seek(writer, &reader, UINT32_MAX);
+			continue;
+		}
+		if (length == 0)
+		{
+			usleep(100000);
+			continue;
+		}
+
+		offset = 0;
+		while (offset < length && reader_info->running)
+		{
+			struct pollfd pfd = { fd, POLLOUT, 0 };
+			ssize_t written;
+
+			if (poll(&pfd, 1, 100) <= 0)
+				continue;
+			written = write(fd, &buffer[offset], length - offset);
+			if (written > 0)
+			{
+				offset += written;
+			} else if (written < 0 && errno != EAGAIN && errno != EINTR)
+			{
+				INFO("Timeshift player disconnected\n");
+				close(fd);
+				fd = -1;
+				break;
+			}
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+	pvrWriter_readerClose(&reader);
+	return NULL;
+}
+
+static int pvr_timeshiftPlay(pvrInfo_t *pvr, uint32_t lag)
+{
+	fileRecordInfo_t *out;
+	struct stat st;
+
+	pthread_mutex_lock(&timeshift_lock);
+	out = pvr_timeshiftSource(pvr);
+	if (out == NULL)
+	{
+		pthread_mutex_unlock(&timeshift_lock);
+		ERROR("Timeshift is not active");
+		return -1;
+	}
+	if (timeshift_reader.running && timeshift_reader.out == out)
+	{
+		timeshift_reader.seek = lag;
+		timeshift_reader.lag  = lag;
+		pthread_mutex_unlock(&timeshift_lock);
+		return 0;
+	}
+	pvr_timeshiftJoin();
+
+	if (stat(STBPVR_TIMESHIFT_FIFO, &st) == 0 && !S_ISFIFO(st.st_mode))
+		unlink(STBPVR_TIMESHIFT_FIFO);
+	if (mkfifo(STBPVR_TIMESHIFT_FIFO, FILE_PERMS) != 0 && errno != EEXIST)
+	{
+		pthread_mutex_unlock(&timeshift_lock);
+		PERROR("Failed to create %s", STBPVR_TIMESHIFT_FIFO);
+		return -1;
+	}
+
+	timeshift_reader.out     = out;
+	timeshift_reader.seek    = lag;
+	timeshift_reader.lag     = lag;
+	timeshift_reader.running = 1;
+	if (pthread_create(&timeshift_reader.thread, NULL, pvr_timeshiftThread, &timeshift_reader) != 0)
+	{
+		timeshift_reader.running = 0;
+		timeshift_reader.out     = NULL;
+		pthread_mutex_unlock(&timeshift_lock);
+		ERROR("Can't create timeshift thread");
+		return -1;
+	}
+	pthread_mutex_unlock(&timeshift_lock);
+	return 0;
+}
+
+/* Stops reader thread, called with timeshift_lock held so thread is joined once */
+static void pvr_timeshiftJoin(void)
+{
+	if (!timeshift_reader.running)
+		return;
+	timeshift_reader.running = 0;
+	pthread_join(timeshift_reader.thread, NULL);
+	timeshift_reader.out = NULL;
+}
+
+static void pvr_timeshiftStop(void)
+{
+	pthread_mutex_lock(&timeshift_lock);
+	pvr_timeshiftJoin();
+	pthread_mutex_unlock(&timeshift_lock);
+}
+
+/* Turns timeshift buffer into normal recording, starting from the oldest data in window */
+static int pvr_timeshiftKeep(pvrInfo_t *pvr)
+{
+	fileRecordInfo_t *out = pvr_timeshiftSource(pvr);
+	int res;
+
+	if (out == NULL)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	mkdirs(out->recordDirectory);
+	pthread_mutex_lock(&writer_lock);
+	res = out->writer != NULL ? pvrWriter_keep(out->writer, out->recordDirectory) : -1;
+	pthread_mutex_unlock(&writer_lock);
+	if (res != 0)
+	{
+		PERROR("Failed to move timeshift buffer to '%s'", out->recordDirectory);
+		return -1;
+	}
+	INFO("Timeshift buffer kept in '%s'\n", out->recordDirectory);
+	strcpy(out->directory, out->recordDirectory);
+	out->timeshift = 0;
+	return 0;
+}
+
+static int pvr_timeshiftStatus(void)
+{
+	char buf[32];
+
+	pthread_mutex_lock(&timeshift_lock);
+	if (timeshift_reader.running)
+		snprintf(buf, sizeof(buf), "tp%u", timeshift_reader.lag);
+	else
+		strcpy(buf, "tn");
+	pthread_mutex_unlock(&timeshift_lock);
+	return write_chunk(buf, strlen(buf)+1);
+}
+
 static int pvr_clearJobList(void)
 {
 	list_element_t *cur_element, *del_element;
@@ -1706,7 +2001,6 @@ static void dvb_recording_threadTerm(void* pArg)
 
 	INFO("Exiting DVB Thread\n");
 	dvb->channel = STBPVR_DVB_CHANNEL_NONE;
-	if (dvb->out.fd > 0) fsync(dvb->out.fd);
 	dvb_instance_close(dvb);
 
 	dvb->running = 0;
@@ -1719,7 +2013,7 @@ static void *dvb_recording_thread(void *pArg)
 	ssize_t read_length;
 	int write_length;
 	struct timeval pat_time, cur_time;
-	char filename[PATH_MAX];
+	time_t overflow_report = 0;
 	unsigned char pat[2*188]; // PAT+PMT
 	unsigned char *pmt = &pat[188];
 	unsigned char packet_counter = 0;
@@ -1794,10 +2088,8 @@ static void *dvb_recording_thread(void *pArg)
 	{
 		INFO("Writing initial PAT/PMT\n");
 
-		dvb->out.position += sizeof(pat);
-
-		if (dvb->out.fd > 0 &&
-		    write(dvb->out.fd, pat, sizeof(pat)) != sizeof(pat))
+		if (dvb->out.writer != NULL &&
+		    pvrWriter_write(dvb->out.writer, pat, sizeof(pat)) != sizeof(pat))
 			PERROR("Failed to write PAT/PMT");
 		if (dvb->fdplay > 0 &&
 		    write(dvb->fdplay, pat, sizeof(pat)) != sizeof(pat))
@@ -1821,33 +2113,15 @@ static void *dvb_recording_thread(void *pArg)
 		{
 			write_chunk("e", 2);
 			PERROR("Read error");
-			ERROR( "fdf=%d fdin=%d fdout=%d v=%d a=%d p=%d",dvb->fdf, dvb->fdin, dvb->out.fd, dvb->filterv.pid, dvb->filtera.pid, dvb->filterp.pid);
+			ERROR( "fdf=%d fdin=%d out=%p v=%d a=%d p=%d",dvb->fdf, dvb->fdin, dvb->out.writer, dvb->filterv.pid, dvb->filtera.pid, dvb->filterp.pid);
 			break;
 		}
 
 		pthread_testcancel();
 
-		if (dvb->out.fd > 0)
+		if (dvb->out.writer != NULL)
 		{
-			dvb->out.position += read_length;
-
-			if (dvb->out.position > FILESIZE_THRESHOLD)
-			{
-				close(dvb->out.fd);
-
-				sprintf(filename, "%s/part%02d.ts", dvb->out.directory, dvb->out.part+1);
-				if ((dvb->out.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) >= 0)
-				{
-					dvb->out.part++;
-					dvb->out.position = read_length;
-				} else
-				{
-					ERROR("Failed to open '%s' for writing", filename);
-					break;
-				}
-			}
-
-			write_length = write(dvb->out.fd, buffer, read_length);
+			write_length = pvrWriter_write(dvb->out.writer, buffer, read_length);
 
 			if (write_length < 0)
 			{
@@ -1859,6 +2133,12 @@ static void *dvb_recording_thread(void *pArg)
 				}
 				break;
 			}
+			if (write_length == 0 && time(NULL) - overflow_report >= PVR_OVERFLOW_REPORT_PERIOD)
+			{
+				overflow_report = time(NULL);
+				ERROR("DVB recording buffer overflow, %d bytes dropped", (int)read_length);
+				pvr_writerStatus(&dvb->out, 'd');
+			}
 		}
 
 		if (dvb->fdplay > 0)
@@ -1914,7 +2194,7 @@ cancel_pipe_write:
 				packet_counter++;
 				pat[3] = 0x30 | (packet_counter & 0xf);
 				pmt[3] = 0x30 | (packet_counter & 0xf);
-				if (dvb->out.fd > 0 && write(dvb->out.fd, pat, sizeof(pat)) != sizeof(pat))
+				if (dvb->out.writer != NULL && pvrWriter_write(dvb->out.writer, pat, sizeof(pat)) != sizeof(pat))
 				{
 					PERROR("PAT/PMT write error");
 				}
@@ -1938,6 +2218,7 @@ static int loadAppSettings(pvrInfo_t *pvr)
 {
 	char buf[BUFFER_SIZE];
 	char passwd[512];
+	unsigned int value;
 	FILE *fd;
 	fd = fopen(SETTINGS_FILE, "r");
 	if (fd == NULL)
@@ -1953,6 +2234,17 @@ static int loadAppSettings(pvrInfo_t *pvr)
 		sscanf(buf, "DVBTBANDWIDTH=%ld",     &pvr->dvb.info.dvbtInfo.bandwidth);
 		sscanf(buf, "QAMMODULATION=%ld",     &pvr->dvb.info.dvbcInfo.modulation);
 		sscanf(buf, "QAMSYMBOLRATE=%ld",     &pvr->dvb.info.dvbcInfo.symbolRate);
+		if (sscanf(buf, "PVRRINGSIZE=%u", &value) == 1) // KB
+			pvr->writer.ringSize = (size_t)value * 1024;
+		if (sscanf(buf, "PVRDIRECTIO=%u", &value) == 1)
+			pvr->writer.flags = value ? (pvr->writer.flags | PVR_WRITER_DIRECT) : (pvr->writer.flags & ~PVR_WRITER_DIRECT);
+		if (sscanf(buf, "PVRDROPCACHE=%u", &value) == 1)
+			pvr->writer.flags = value ? (pvr->writer.flags | PVR_WRITER_DONTNEED) : (pvr->writer.flags & ~PVR_WRITER_DONTNEED);
+		if (sscanf(buf, "PVRINDEX=%u", &value) == 1)
+			pvr->writer.flags = value ? (pvr->writer.flags | PVR_WRITER_INDEX) : (pvr->writer.flags & ~PVR_WRITER_INDEX);
+		if (sscanf(buf, "PVRTIMESHIFT=%u", &value) == 1) // seconds
+			pvr->writer.window = value;
+		sscanf(buf, "PVRTIMESHIFTDIR=%[^\r\n]", pvr->timeshiftPath);
 		if (strncasecmp(buf, "PVRDIRECTORY=", 13) == 0)
 		{
 			strcpy(pvr->path,&buf[13]);
@@ -1985,6 +2277,12 @@ static int loadAppSettings(pvrInfo_t *pvr)
 	}
 	INFO("PVRDIRECTORY=%s\n", pvr->path);
 	INFO("PROXY=%s\n", pvr->http.proxy);
+	INFO("PVRRINGSIZE=%u KB%s%s%s\n", (unsigned)((pvr->writer.ringSize ? pvr->writer.ringSize : PVR_WRITER_DEFAULT_RING)/1024),
+		(pvr->writer.flags & PVR_WRITER_DIRECT)   ? " direct"    : "",
+		(pvr->writer.flags & PVR_WRITER_DONTNEED) ? " dropcache" : "",
+		(pvr->writer.flags & PVR_WRITER_INDEX)    ? " index"     : "");
+	if (pvr->writer.window > 0)
+		INFO("PVRTIMESHIFT=%u s in %s\n", pvr->writer.window, pvr->timeshiftPath[0] ? pvr->timeshiftPath : "PVRDIRECTORY");
 	if( pvr->http.proxy[0] != 0 && pvr->http.login[0] != 0 )
 		INFO("PROXY_LOGIN=%s\n", pvr->http.login);
 	return 0;
@@ -2130,6 +2428,9 @@ static inline void pvr_write_status(pvrInfo_t *pvr)
 	dvb_write_status(pvr);
 	rtp_write_status(pvr);
 	http_write_status(pvr);
+	pvr_writerStatus(&pvr->dvb.out,  'd');
+	pvr_writerStatus(&pvr->rtp.out,  'u');
+	pvr_writerStatus(&pvr->http.out, 'h');
 }
 
 static int setDvbRecStatus(const int setStatus, const char *URL,const int id)
@@ -2213,6 +2514,7 @@ static void* pvr_socket_thread(void *arg)
 
 	int socket_fd = -1;
 	int len, channel;
+	int timeshift;
 	struct sockaddr_un local, remote;
 	char buf[PATH_MAX];
 	char *type  =  buf;
@@ -2287,6 +2589,7 @@ static void* pvr_socket_thread(void *arg)
 		}
 
 		INFO("Got: '%s'\n", buf);
+		timeshift = 0;
 
                 cJSON *params = cJSON_Parse(buf);
                 if (params != NULL && params->type != cJSON_NULL)
@@ -2394,10 +2697,60 @@ static void* pvr_socket_thread(void *arg)
                cJSON_Delete(params);
 
 
+pvr_dispatch:
 		switch (*type) {
 			case '?': // status?
 				pvr_write_status(pvr);
 				break;
+			case 't': // timeshift
+				switch (*cmd)
+				{
+					case 'd': // start buffering as if recording: tdr<channel>, tur<url>, thr<url>
+					case 'u':
+					case 'h':
+						timeshift = 1;
+						// strip leading 't' so that type, cmd and value point to <d|u|h>r<arg>
+						memmove(buf, buf+1, strlen(buf));
+						goto pvr_dispatch;
+					case 'p': // play lag seconds behind live
+						if (pvr_timeshiftPlay(pvr, *value != 0 ? atoi(value) : 0) != 0)
+							write_chunk("te", 3);
+						else
+							pvr_timeshiftStatus();
+						break;
+					case 'n': // stop playiNg
+						pvr_timeshiftStop();
+						pvr_timeshiftStatus();
+						break;
+					case 'k': // keep buffer as recording
+						if (pvr_timeshiftKeep(pvr) != 0)
+						{
+							char err[16];
+							snprintf(err, sizeof(err), "te%d", errno);
+							write_chunk(err, strlen(err)+1);
+						}
+						break;
+					case 's': // stop buffering
+						pvr_timeshiftStop();
+						if (dvb->out.timeshift)
+							dvb_recording_stop(pvr);
+						if (pvr->rtp.out.timeshift)
+							rtp_recording_stop(pvr);
+						if (pvr->http.out.timeshift)
+							http_recording_stop(pvr);
+						pvr_timeshiftStatus();
+						break;
+					case '?':
+						pvr_timeshiftStatus();
+						break;
+					default: ;// ignore
+				}
+				break;
+			case 'w': // recording writer statistics
+				pvr_writerStatus(&pvr->dvb.out,  'd');
+				pvr_writerStatus(&pvr->rtp.out,  'u');
+				pvr_writerStatus(&pvr->http.out, 'h');
+				break;
 			case 'd': //dvb
 				switch(*cmd)
 				{
@@ -2481,6 +2834,7 @@ static void* pvr_socket_thread(void *arg)
 						if ( service != NULL )
 						{
 							dvb_recording_stop(pvr);
+							dvb->out.timeshift = timeshift;
 							dvb_recording_start( pvr, channel, service );
 						} else
 						{
@@ -2621,6 +2975,7 @@ static void* pvr_socket_thread(void *arg)
 							break;
 						}
 						rtp_recording_stop(pvr);
+						pvr->rtp.out.timeshift = timeshift;
 						if( rtp_recording_start( pvr, &desc, &ip, str ) != 0 )
 							break;
 						break;
@@ -2662,6 +3017,7 @@ static void* pvr_socket_thread(void *arg)
 							str++;
 						}
 						http_recording_stop(pvr);
+						pvr->http.out.timeshift = timeshift;
 						if( http_recording_start( pvr, value, str ) != 0 )
 							break;
 						break;
@@ -2737,7 +3093,21 @@ int main(int argc, char **argv)
 	EIT_service_t *service = NULL;
 	pvrInfo_t pvr;
 	pthread_t socket_thread;
-	(void)argc;
+
+	if (argc > 2 && strcmp(argv[1], "--reindex") == 0)
+	{
+		int i, count, ret = 0;
+		for (i = 2; i < argc; i++)
+		{
+			if ((count = pvrIndex_rebuild(argv[i])) < 0)
+			{
+				PERROR("Failed to index '%s'", argv[i]);
+				ret = 1;
+			} else
+				INFO("%s: %d entries\n", argv[i], count);
+		}
+		return ret;
+	}
 
 	if( (fd = open( STBPVR_PIDFILE, O_RDONLY)) >= 0 )
 	{
@@ -2755,6 +3125,8 @@ int main(int argc, char **argv)
 	}
 
 	memset(&pvr, 0, sizeof(pvr));
+	pvr.writer.window = STBPVR_TIMESHIFT_WINDOW;
+	pvr.writer.flags  = PVR_WRITER_INDEX;
 
 	pvr.rtp.desc.fmt = payloadTypeUnknown;
 	pvr.dvb.channel  = STBPVR_DVB_CHANNEL_NONE;
@@ -0,0 +1,686 @@
+/*
+
+Elecard STB820 Demo Application
+Copyright (C) 2007  Elecard Devices
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 1, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+
+*/
+
+/***********************************************
+* INCLUDE FILES*
+************************************************/
+
+/* StbMainApp */
+#include <defines.h>
+#include <dvb_types.h>
+
+#include "pvrIndex.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/***********************************************
+* LOCAL MACROS *
+************************************************/
+
+#define FILE_PERMS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
+
+#define PVR_INDEX_MAGIC      "PVRI"
+#define PVR_INDEX_VERSION    (1)
+/* Entries collected before writing to file */
+#define PVR_INDEX_CACHE      (64)
+/* Interval of entries for streams without video */
+#define PVR_INDEX_AUDIO_TICKS (90000)
+/* Larger PTS step between entries is treated as discontinuity */
+#define PVR_INDEX_MAX_JUMP   (10*90000)
+/* PES bytes searched for picture type before giving up */
+#define PVR_INDEX_SCAN_SIZE  (16*TS_PACKET_SIZE)
+#define PVR_INDEX_READ_SIZE  (512*TS_PACKET_SIZE)
+
+#define PTS_MASK             ((1ULL << 33) - 1)
+
+/******************************************************************
+* LOCAL TYPEDEFS  *
+*******************************************************************/
+
+typedef struct
+{
+	char              magic[4];
+	uint16_t          version;
+	uint16_t          entrySize;
+} pvrIndexHeader_t;
+
+typedef enum
+{
+	pvrIndexScanNone = 0,
+	pvrIndexScanCode,            // searching start codes in video PES
+	pvrIndexScanPicture,         // MPEG-2 picture header found, waiting for coding type
+} pvrIndexScan_t;
+
+struct pvrIndexer_s
+{
+	int               fd;
+
+	/* packet split between feed calls */
+	unsigned char     packet[TS_PACKET_SIZE];
+	size_t            carry;
+	int               carryPart;
+	off_t             carryOffset;
+	uint64_t          carryPosition;
+	uint64_t          position;     // bytes fed, used to measure PES sizes
+
+	int               pmtPid;
+	int               pid;          // indexed stream
+	int               streamType;
+	int               audio;
+
+	/* PES being searched for random access point */
+	pvrIndexScan_t    scan;
+	size_t            scanned;
+	uint32_t          code;
+	int               pictureBytes;
+	pvrIndexEntry_t   current;
+	uint64_t          currentPosition;
+
+	/* entry waiting for start of next PES to know its size */
+	pvrIndexEntry_t   pending;
+	uint64_t          pendingPosition;
+	int               hasPending;
+
+	/* time line */
+	int               started;
+	uint64_t          lastPts;
+	uint64_t          ticks;        // 90 kHz ticks since first entry
+	uint64_t          entryTicks;   // ticks of last entry
+
+	pvrIndexEntry_t   cache[PVR_INDEX_CACHE];
+	int               cached;
+	int               count;
+};
+
+struct pvrIndex_s
+{
+	int               fd;
+};
+
+/*******************************************************************************
+* FUNCTION IMPLEMENTATION  <Module>[_<Word>+] for static functions *
+*  tm[<layer>]<Module>[_<Word>+] for exported functions*
+********************************************************************************/
+
+static int pvrIndex_writeAll(int fd, const void *data, size_t size)
+{
+	const unsigned char *ptr = data;
+
+	while (size > 0)
+	{
+		ssize_t ret = write(fd, ptr, size);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		ptr  += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+static int pvrIndexer_flush(pvrIndexer_t *ix)
+{
+	int ret;
+
+	if (ix->cached == 0)
+		return 0;
+	ret = pvrIndex_writeAll(ix->fd, ix->cache, ix->cached * sizeof(ix->cache[0]));
+	ix->count += ix->cached;
+	ix->cached = 0;
+	return ret;
+}
+
+/* Completes entry of previous PES once next one starts */
+static int pvrIndexer_finishPending(pvrIndexer_t *ix, uint64_t position)
+{
+	if (!ix->hasPending)
+		return 0;
+	ix->hasPending = 0;
+	ix->pending.size = (uint32_t)(position - ix->pendingPosition);
+	ix->cache[ix->cached++] = ix->pending;
+	if (ix->cached == PVR_INDEX_CACHE)
+		return pvrIndexer_flush(ix);
+	return 0;
+}
+
+/* Advances time line to PTS, returns 0 if entry is discontinuity */
+static int pvrIndexer_setTime(pvrIndexer_t *ix, uint64_t pts)
+{
+	uint64_t delta;
+
+	if (!ix->started)
+	{
+		ix->started = 1;
+		ix->lastPts = pts;
+		return 1;
+	}
+	delta = (pts - ix->lastPts) & PTS_MASK;
+	ix->lastPts = pts;
+	if (delta > PVR_INDEX_MAX_JUMP)
+		return 0;
+	ix->ticks += delta;
+	return 1;
+}
+
+static void pvrIndexer_addEntry(pvrIndexer_t *ix)
+{
+	if (!pvrIndexer_setTime(ix, ix->current.pts))
+		ix->current.flags |= PVR_INDEX_DISCONT;
+	ix->current.timeMs = (uint32_t)(ix->ticks / 90);
+	ix->entryTicks = ix->ticks;
+
+	ix->pending = ix->current;
+	ix->pendingPosition = ix->currentPosition;
+	ix->hasPending = 1;
+	ix->scan = pvrIndexScanNone;
+}
+
+/* Returns 1 for random access point, 0 for other picture, -1 if undecided */
+static int pvrIndexer_startCode(pvrIndexer_t *ix, unsigned char value)
+{
+	int type;
+
+	switch (ix->streamType)
+	{
+		case 0x01: // MPEG-1
+		case 0x02: // MPEG-2
+			if (value == 0xB3 || value == 0xB8) // sequence header, GOP
+				return 1;
+			if (value == 0x00)
+			{
+				ix->scan = pvrIndexScanPicture;
+				ix->pictureBytes = 0;
+			}
+			return -1;
+		case 0x1B: // H.264
+			type = value & 0x1F;
+			if (type == 5 || type == 7) // IDR, SPS
+				return 1;
+			if (type == 1)
+				return 0;
+			return -1;
+		case 0x24: // HEVC
+			type = (value >> 1) & 0x3F;
+			if ((type >= 16 && type <= 21) || type == 32 || type == 33) // IRAP, VPS, SPS
+				return 1;
+			if (type < 16)
+				return 0;
+			return -1;
+	}
+	return 0;
+}
+
+static void pvrIndexer_scan(pvrIndexer_t *ix, const unsigned char *data, size_t size)
+{
+	size_t i;
+	int rap = -1;
+
+	for (i = 0; i < size && rap < 0; i++)
+	{
+		if (ix->scan == pvrIndexScanPicture)
+		{
+			// temporal_reference:10 picture_coding_type:3
+			if (++ix->pictureBytes == 2)
+				rap = ((data[i] >> 3) & 0x07) == 1;
+			continue;
+		}
+		if ((ix->code & 0x00FFFFFF) == 0x000001)
+			rap = pvrIndexer_startCode(ix, data[i]);
+		ix->code = (ix->code << 8) | data[i];
+	}
+	ix->scanned += size;
+	if (rap == 1)
+		pvrIndexer_addEntry(ix);
+	else if (rap == 0 || ix->scanned > PVR_INDEX_SCAN_SIZE)
+		ix->scan = pvrIndexScanNone;
+}
+
+static void pvrIndexer_parsePAT(pvrIndexer_t *ix, const unsigned char *p, size_t size)
+{
+	size_t length, i;
+
+	if (size < 8 || p[0] != 0x00)
+		return;
+	length = 3 + (((p[1] & 0x0F) << 8) | p[2]) - 4; // without CRC
+	if (length > size)
+		length = size;
+	for (i = 8; i + 4 <= length; i += 4)
+	{
+		if (((p[i] << 8) | p[i+1]) != 0) // not NIT
+		{
+			ix->pmtPid = ((p[i+2] & 0x1F) << 8) | p[i+3];
+			return;
+		}
+	}
+}
+
+static int pvrIndexer_isAudio(int streamType, const unsigned char *descriptors, size_t size)
+{
+	size_t i;
+
+	switch (streamType)
+	{
+		case 0x03: case 0x04: case 0x0F: case 0x11: case 0x81:
+			return 1;
+		case 0x06: // private data: AC-3, E-AC-3 or DTS descriptor
+			for (i = 0; i + 2 <= size; i += 2 + descriptors[i+1])
+				if (descriptors[i] == 0x6A || descriptors[i] == 0x7A || descriptors[i] == 0x7B)
+					return 1;
+	}
+	return 0;
+}
+
+static void pvrIndexer_parsePMT(pvrIndexer_t *ix, const unsigned char *p, size_t size)
+{
+	size_t length, i;
+	int pid = -1, streamType = 0, audio = 0;
+
+	if (size < 12 || p[0] != 0x02)
+		return;
+	length = 3 + (((p[1] & 0x0F) << 8) | p[2]) - 4;
+	if (length > size)
+		length = size;
+	for (i = 12 + (((p[10] & 0x0F) << 8) | p[11]); i + 5 <= length; i += 5 + (((p[i+3] & 0x0F) << 8) | p[i+4]))
+	{
+		int type = p[i];
+		int es   = ((p[i+1] & 0x1F) << 8) | p[i+2];
+		size_t infoLength = ((p[i+3] & 0x0F) << 8) | p[i+4];
+
+		if (type == 0x01 || type == 0x02 || type == 0x1B || type == 0x24)
+		{
+			pid = es;
+			streamType = type;
+			audio = 0;
+			break;
+		}
+		if (pid < 0 && pvrIndexer_isAudio(type, &p[i+5], i + 5 + infoLength <= length ? infoLength : 0))
+		{
+			pid = es;
+			streamType = type;
+			audio = 1;
+		}
+	}
+	if (pid >= 0 && (pid != ix->pid || streamType != ix->streamType))
+	{
+		ix->pid        = pid;
+		ix->streamType = streamType;
+		ix->audio      = audio;
+		ix->scan       = pvrIndexScanNone;
+	}
+}
+
+static int pvrIndexer_packet(pvrIndexer_t *ix, const unsigned char *p, int part, off_t offset, uint64_t position)
+{
+	int pid  = ((p[1] & 0x1F) << 8) | p[2];
+	int pusi = (p[1] & 0x40) != 0;
+	int rai  = 0;
+	size_t pos = 4;
+
+	if (p[3] & 0x20) // adaptation field
+	{
+		rai = p[4] > 0 && (p[5] & 0x40);
+		pos += 1 + p[4];
+	}
+	if (!(p[3] & 0x10) || pos >= TS_PACKET_SIZE)
+		return 0;
+
+	if (pusi && pid == 0)
+	{
+		pos += 1 + p[pos]; // pointer field
+		if (pos < TS_PACKET_SIZE)
+			pvrIndexer_parsePAT(ix, &p[pos], TS_PACKET_SIZE - pos);
+		return 0;
+	}
+	if (pusi && pid == ix->pmtPid && ix->pmtPid > 0)
+	{
+		pos += 1 + p[pos];
+		if (pos < TS_PACKET_SIZE)
+			pvrIndexer_parsePMT(ix, &p[pos], TS_PACKET_SIZE - pos);
+		return 0;
+	}
+	if (pid != ix->pid || ix->pid <= 0)
+		return 0;
+
+	if (pusi)
+	{
+		const unsigned char *pes = &p[pos];
+		size_t size = TS_PACKET_SIZE - pos;
+
+		if (pvrIndexer_finishPending(ix, position) != 0)
+			return -1;
+		ix->scan = pvrIndexScanNone;
+		// PES with PTS
+		if (size < 14 || pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || (pes[7] & 0x80) == 0)
+			return 0;
+
+		memset(&ix->current, 0, sizeof(ix->current));
+		ix->current.pts = ((uint64_t)(pes[9] & 0x0E) << 29) | (pes[10] << 22) | ((pes[11] & 0xFE) << 14) |
+		                  (pes[12] << 7) | (pes[13] >> 1);
+		ix->current.part   = (uint16_t)part;
+		ix->current.offset = (uint32_t)offset;
+		ix->currentPosition = position;
+
+		if (ix->audio)
+		{
+			if (!ix->started || ((ix->current.pts - ix->lastPts) & PTS_MASK) + ix->ticks - ix->entryTicks >= PVR_INDEX_AUDIO_TICKS)
+			{
+				ix->current.flags = PVR_INDEX_AUDIO;
+				pvrIndexer_addEntry(ix);
+			} else
+				pvrIndexer_setTime(ix, ix->current.pts);
+			return 0;
+		}
+		ix->current.flags = PVR_INDEX_IDR;
+		if (rai)
+		{
+			pvrIndexer_addEntry(ix);
+			return 0;
+		}
+		pos += 9 + pes[8];
+		if (pos >= TS_PACKET_SIZE)
+			return 0;
+		ix->scan    = pvrIndexScanCode;
+		ix->scanned = 0;
+		ix->code    = 0xFFFFFFFF;
+	}
+	if (ix->scan != pvrIndexScanNone)
+		pvrIndexer_scan(ix, &p[pos], TS_PACKET_SIZE - pos);
+	return 0;
+}
+
+pvrIndexer_t *pvrIndexer_open(const char *directory)
+{
+	pvrIndexHeader_t header;
+	char filename[PATH_MAX];
+	pvrIndexer_t *ix;
+	int err;
+
+	ix = calloc(1, sizeof(*ix));
+	if (ix == NULL)
+		return NULL;
+	snprintf(filename, sizeof(filename), "%s/" PVR_INDEX_FILE, directory);
+	if ((ix->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) < 0)
+	{
+		free(ix);
+		return NULL;
+	}
+	memcpy(header.magic, PVR_INDEX_MAGIC, sizeof(header.magic));
+	header.version   = PVR_INDEX_VERSION;
+	header.entrySize = sizeof(pvrIndexEntry_t);
+	if (pvrIndex_writeAll(ix->fd, &header, sizeof(header)) != 0)
+	{
+		err = errno;
+		close(ix->fd);
+		free(ix);
+		errno = err;
+		return NULL;
+	}
+	return ix;
+}
+
+int pvrIndexer_feed(pvrIndexer_t *ix, const void *data, size_t size, int part, off_t offset)
+{
+	const unsigned char *ptr = data;
+
+	while (size > 0)
+	{
+		if (ix->carry > 0)
+		{
+			size_t length = TS_PACKET_SIZE - ix->carry;
+			if (length > size)
+				length = size;
+			memcpy(&ix->packet[ix->carry], ptr, length);
+			ix->carry += length;
+			ptr    += length;
+			size   -= length;
+			offset += length;
+			ix->position += length;
+			if (ix->carry == TS_PACKET_SIZE)
+			{
+				ix->carry = 0;
+				if (pvrIndexer_packet(ix, ix->packet, ix->carryPart, ix->carryOffset, ix->carryPosition) != 0)
+					return -1;
+			}
+			continue;
+		}
+		if (*ptr != 0x47)
+		{
+			// lost sync
+			ptr++;
+			size--;
+			offset++;
+			ix->position++;
+			continue;
+		}
+		if (size < TS_PACKET_SIZE)
+		{
+			ix->carryPart     = part;
+			ix->carryOffset   = offset;
+			ix->carryPosition = ix->position;
+			memcpy(ix->packet, ptr, size);
+			ix->carry = size;
+			ix->position += size;
+			break;
+		}
+		if (pvrIndexer_packet(ix, ptr, part, offset, ix->position) != 0)
+			return -1;
+		ptr    += TS_PACKET_SIZE;
+		size   -= TS_PACKET_SIZE;
+		offset += TS_PACKET_SIZE;
+		ix->position += TS_PACKET_SIZE;
+	}
+	// make entries available to readers of recording in progress
+	return pvrIndexer_flush(ix);
+}
+
+int pvrIndexer_close(pvrIndexer_t *ix)
+{
+	int ret = 0;
+	int err = 0;
+
+	if (pvrIndexer_finishPending(ix, ix->position) != 0 || pvrIndexer_flush(ix) != 0)
+	{
+		err = errno;
+		ret = -1;
+	}
+	if (close(ix->fd) != 0 && ret == 0)
+	{
+		err = errno;
+		ret = -1;
+	}
+	free(ix);
+	errno = err;
+	return ret;
+}
+
+int pvrIndex_rebuild(const char *directory)
+{
+	char filename[PATH_MAX];
+	pvrIndexer_t *ix;
+	unsigned char *buffer;
+	int part, count, err;
+
+	buffer = malloc(PVR_INDEX_READ_SIZE);
+	if (buffer == NULL)
+		return -1;
+	if ((ix = pvrIndexer_open(directory)) == NULL)
+	{
+		free(buffer);
+		return -1;
+	}
+	for (part = 1; ; part++)
+	{
+		off_t offset = 0;
+		ssize_t length;
+		int fd;
+
+		snprintf(filename, sizeof(filename), "%s/part%02d.ts", directory, part);
+		if ((fd = open(filename, O_RDONLY)) < 0)
+		{
+			if (errno == ENOENT && part > 1)
+				break;
+			goto failure;
+		}
+		while ((length = read(fd, buffer, PVR_INDEX_READ_SIZE)) > 0)
+		{
+			if (pvrIndexer_feed(ix, buffer, length, part, offset) != 0)
+				break;
+			offset += length;
+		}
+		err = errno;
+		close(fd);
+		if (length != 0)
+		{
+			errno = err;
+			goto failure;
+		}
+	}
+	free(buffer);
+	count = ix->count + ix->cached + ix->hasPending;
+	if (pvrIndexer_close(ix) != 0)
+		return -1;
+	return count;
+
+failure:
+	err = errno;
+	free(buffer);
+	pvrIndexer_close(ix);
+	errno = err;
+	return -1;
+}
+
+pvrIndex_t *pvrIndex_open(const char *directory)
+{
+	pvrIndexHeader_t header;
+	char filename[PATH_MAX];
+	pvrIndex_t *index;
+
+	index = malloc(sizeof(*index));
+	if (index == NULL)
+		return NULL;
+	snprintf(filename, sizeof(filename), "%s/" PVR_INDEX_FILE, directory);
+	if ((index->fd = open(filename, O_RDONLY)) < 0)
+	{
+		free(index);
+		return NULL;
+	}
+	if (pread(index->fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    memcmp(header.magic, PVR_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != PVR_INDEX_VERSION ||
+	    header.entrySize != sizeof(pvrIndexEntry_t))
+	{
+		close(index->fd);
+		free(index);
+		errno = EINVAL;
+		return NULL;
+	}
+	return index;
+}
+
+void pvrIndex_close(pvrIndex_t *index)
+{
+	close(index->fd);
+	free(index);
+}
+
+long pvrIndex_count(pvrIndex_t *index)
+{
+	struct stat st;
+
+	if (fstat(index->fd, &st) != 0 || st.st_size < (off_t)sizeof(pvrIndexHeader_t))
+		return 0;
+	return (st.st_size - sizeof(pvrIndexHeader_t)) / sizeof(pvrIndexEntry_t);
+}
+
+int pvrIndex_get(pvrIndex_t *index, long number, pvrIndexEntry_t *entry)
+{
+	off_t offset = sizeof(pvrIndexHeader_t) + (off_t)number * sizeof(pvrIndexEntry_t);
+
+	if (number < 0 || pread(index->fd, entry, sizeof(*entry), offset) != sizeof(*entry))
+		return -1;
+	return 0;
+}
+
+uint32_t pvrIndex_duration(pvrIndex_t *index)
+{
+	pvrIndexEntry_t entry;
+
+	if (pvrIndex_get(index, pvrIndex_count(index) - 1, &entry) != 0)
+		return 0;
+	return entry.timeMs;
+}
+
+static long pvrIndex_search(pvrIndex_t *index, long count, int64_t timeMs)
+{
+	pvrIndexEntry_t entry;
+	long low = 0, high = count - 1;
+
+	// last entry with entry.timeMs <= timeMs
+	while (low < high)
+	{
+		long middle = (low + high + 1) / 2;
+		if (pvrIndex_get(index, middle, &entry) != 0)
+			return -1;
+		if ((int64_t)entry.timeMs <= timeMs)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return count > 0 ? low : -1;
+}
+
+long pvrIndex_find(pvrIndex_t *index, uint32_t timeMs)
+{
+	return pvrIndex_search(index, pvrIndex_count(index), timeMs);
+}
+
+long pvrIndex_trick(pvrIndex_t *index, long number, int speed, uint32_t periodMs)
+{
+	pvrIndexEntry_t entry;
+	long count = pvrIndex_count(index);
+	long next;
+
+	if (pvrIndex_get(index, number, &entry) != 0)
+		return -1;
+	if (speed == 0)
+		return number;
+
+	next = pvrIndex_search(index, count, (int64_t)entry.timeMs + (int64_t)speed * periodMs);
+	if (speed > 0)
+	{
+		if (next <= number)
+			next = number + 1;
+		return next < count ? next : -1;
+	}
+	if (next < 0 || next >= number)
+		next = number - 1;
+	return next;
+}
@@ -0,0 +1,708 @@
+/*
+
+Elecard STB820 Demo Application
+Copyright (C) 2007  Elecard Devices
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 1, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+
+*/
+
+/***********************************************
+* INCLUDE FILES*
+************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT, fallocate
+#endif
+
+/* StbMainApp */
+#include <defines.h>
+#include <dvb_types.h>
+
+#include "pvrWriter.h"
+#include "pvrIndex.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/***********************************************
+* LOCAL MACROS *
+************************************************/
+
+#define APP_NAME "StbPvr"
+
+#define INFO(x...)   printf(APP_NAME ": " x)
+#define PERROR(x...) \
+do {\
+	fprintf(stderr, APP_NAME ": " x); \
+	fprintf(stderr, " (%s)\n", strerror(errno)); \
+} while (0)
+
+#define FILE_PERMS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
+
+/* O_DIRECT transfers must be multiple of logical block size */
+#define PVR_WRITER_DIRECT_ALIGN (4096)
+/* Queued data is written at least this often, even if block is not complete.
+ * Partial block goes through page cache, next block realigns ring for O_DIRECT */
+#define PVR_WRITER_FLUSH_MS     (1000)
+/* How long blocking pvrWriter_write waits for free space */
+#define PVR_WRITER_WAIT_MS      (500)
+/* Duration of timeshift part, window is shortened by deleting oldest part */
+#define PVR_TIMESHIFT_PART_SEC  (10)
+
+/******************************************************************
+* LOCAL TYPEDEFS  *
+*******************************************************************/
+
+typedef struct
+{
+	int               number;
+	time_t            started;      // monotonic seconds
+	off_t             size;         // bytes available to readers
+} pvrWriterPart_t;
+
+struct pvrWriter_s
+{
+	/* directory, fileBase and parts change under mutex, so readers and
+	 * pvrWriter_keep always see consistent file names */
+	char              directory[PATH_MAX];
+	int               fileBase;     // part number - fileBase = index in file name
+	int               fd;
+	int               part;
+	off_t             position;
+	uint32_t          window;       // timeshift window, 0 if parts are kept
+	pvrWriterPart_t  *parts;
+	int               partCount;
+	int               partCapacity;
+	int               flags;        // owned by writer thread
+	int               direct;
+	int               blocking;
+	pvrIndexer_t     *indexer;      // owned by writer thread
+
+	/* head and tail are only advanced under mutex, but data between them is
+	 * owned by writer thread and data after head by producer, so copying is
+	 * done unlocked */
+	unsigned char    *ring;
+	size_t            size;
+	uint64_t          head;
+	uint64_t          tail;
+
+	pthread_mutex_t   mutex;
+	pthread_cond_t    dataCond;
+	pthread_cond_t    spaceCond;
+	pthread_t         thread;
+	int               stop;
+	int               error;
+
+	pvrWriterStats_t  stats;
+};
+
+/*******************************************************************************
+* FUNCTION IMPLEMENTATION  <Module>[_<Word>+] for static functions *
+*  tm[<layer>]<Module>[_<Word>+] for exported functions*
+********************************************************************************/
+
+static uint32_t pvrWriter_nowMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static time_t pvrWriter_nowSec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void pvrWriter_deadline(struct timespec *ts, uint32_t timeoutMs)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	ts->tv_sec  = tv.tv_sec + timeoutMs/1000;
+	ts->tv_nsec = tv.tv_usec*1000 + (timeoutMs%1000)*1000000;
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static int pvrWriter_setDirect(pvrWriter_t *w, int enable)
+{
+#ifdef O_DIRECT
+	int fl = fcntl(w->fd, F_GETFL);
+	if (fl < 0 || fcntl(w->fd, F_SETFL, enable ? (fl | O_DIRECT) : (fl & ~O_DIRECT)) < 0)
+		return -1;
+#else
+	if (enable)
+		return -1;
+#endif
+	w->direct = enable;
+	return 0;
+}
+
+/* Called with mutex held */
+static void pvrWriter_partName(pvrWriter_t *w, int number, char *filename, size_t size)
+{
+	snprintf(filename, size, "%s/part%02d.ts", w->directory, number - w->fileBase);
+}
+
+static int pvrWriter_openPart(pvrWriter_t *w)
+{
+	char filename[PATH_MAX];
+	off_t prealloc = FILESIZE_THRESHOLD;
+
+	pthread_mutex_lock(&w->mutex);
+	if (w->partCount == w->partCapacity)
+	{
+		int capacity = w->partCapacity ? 2*w->partCapacity : 16;
+		pvrWriterPart_t *parts = realloc(w->parts, capacity * sizeof(*parts));
+		if (parts == NULL)
+		{
+			pthread_mutex_unlock(&w->mutex);
+			errno = ENOMEM;
+			return -1;
+		}
+		w->parts = parts;
+		w->partCapacity = capacity;
+	}
+	pvrWriter_partName(w, w->part, filename, sizeof(filename));
+	if ((w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMS)) < 0)
+	{
+		pthread_mutex_unlock(&w->mutex);
+		PERROR("Failed to open '%s' for writing", filename);
+		return -1;
+	}
+	if (w->window)
+	{
+		// timeshift parts are short, previous part is a good estimate
+		prealloc = w->partCount > 0 ? w->parts[w->partCount-1].size * 5/4 : 0;
+	}
+	w->parts[w->partCount].number  = w->part;
+	w->parts[w->partCount].started = pvrWriter_nowSec();
+	w->parts[w->partCount].size    = 0;
+	w->partCount++;
+	pthread_mutex_unlock(&w->mutex);
+	w->position = 0;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+	/* Reserve extents for whole part, so filesystem doesn't fragment it
+	 * between parallel recordings. Size is kept, readers see only real data. */
+	if (prealloc > 0)
+		fallocate(w->fd, FALLOC_FL_KEEP_SIZE, 0, prealloc);
+#else
+	(void)prealloc;
+#endif
+	if ((w->flags & PVR_WRITER_DIRECT) && pvrWriter_setDirect(w, 1) != 0)
+	{
+		INFO("O_DIRECT is not supported for '%s', using buffered writes\n", filename);
+		w->flags &= ~PVR_WRITER_DIRECT;
+	}
+	return 0;
+}
+
+static int pvrWriter_closePart(pvrWriter_t *w)
+{
+	int ret = 0;
+
+	if (w->fd < 0)
+		return 0;
+
+	if (fdatasync(w->fd) != 0 && errno != EINVAL)
+		ret = -1;
+	// release preallocated space beyond written data
+	ftruncate(w->fd, w->position);
+	if (close(w->fd) != 0)
+		ret = -1;
+	w->fd = -1;
+	return ret;
+}
+
+/* Drops parts which are completely out of timeshift window. Called with mutex held */
+static void pvrWriter_expire(pvrWriter_t *w)
+{
+	time_t now = pvrWriter_nowSec();
+	char filename[PATH_MAX];
+
+	while (w->window && w->partCount > 1 && now - w->parts[1].started > (time_t)w->window)
+	{
+		pvrWriter_partName(w, w->parts[0].number, filename, sizeof(filename));
+		unlink(filename);
+		w->partCount--;
+		memmove(&w->parts[0], &w->parts[1], w->partCount * sizeof(w->parts[0]));
+	}
+}
+
+static int pvrWriter_writeBlock(pvrWriter_t *w, const unsigned char *data, size_t size)
+{
+	size_t done = 0;
+	int rotate;
+	int direct;
+
+	pthread_mutex_lock(&w->mutex);
+	rotate = w->window && pvrWriter_nowSec() - w->parts[w->partCount-1].started >= PVR_TIMESHIFT_PART_SEC;
+	pthread_mutex_unlock(&w->mutex);
+
+	/* After partial flush parts are not switched until ring is realigned,
+	 * so new part starts on packet and O_DIRECT boundary */
+	if (w->position > 0 && (data - w->ring) % PVR_WRITER_ALIGN == 0 &&
+	    (rotate || w->position + (off_t)size > FILESIZE_THRESHOLD))
+	{
+		pvrWriter_closePart(w);
+		w->part++;
+		if (pvrWriter_openPart(w) != 0)
+			return -1;
+	}
+
+	// partial flush and tail of recording are written through page cache
+	direct = (w->flags & PVR_WRITER_DIRECT) &&
+		size % PVR_WRITER_DIRECT_ALIGN == 0 &&
+		w->position % PVR_WRITER_DIRECT_ALIGN == 0 &&
+		(data - w->ring) % PVR_WRITER_DIRECT_ALIGN == 0;
+	if (direct != w->direct && pvrWriter_setDirect(w, direct) != 0)
+		w->flags &= ~PVR_WRITER_DIRECT;
+
+	while (done < size)
+	{
+		ssize_t ret = write(w->fd, &data[done], size - done);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EINVAL && w->direct)
+			{
+				INFO("O_DIRECT write failed, using buffered writes\n");
+				w->flags &= ~PVR_WRITER_DIRECT;
+				pvrWriter_setDirect(w, 0);
+				continue;
+			}
+			return -1;
+		}
+		done += ret;
+		if (done < size && w->direct)
+			pvrWriter_setDirect(w, 0);
+	}
+	if (w->indexer != NULL && pvrIndexer_feed(w->indexer, data, size, w->part - w->fileBase, w->position) != 0)
+	{
+		// recording is still usable without index
+		PERROR("Index write failed");
+		pvrIndexer_close(w->indexer);
+		w->indexer = NULL;
+	}
+	w->position += size;
+
+	pthread_mutex_lock(&w->mutex);
+	w->parts[w->partCount-1].size = w->position;
+	pvrWriter_expire(w);
+	pthread_mutex_unlock(&w->mutex);
+
+	if ((w->flags & PVR_WRITER_DONTNEED) && !w->direct)
+	{
+		/* Pages must be clean to be dropped. Waiting here only delays writer
+		 * thread, input keeps filling ring. */
+		fdatasync(w->fd);
+		posix_fadvise(w->fd, w->position - size, size, POSIX_FADV_DONTNEED);
+	}
+	return 0;
+}
+
+static void *pvrWriter_thread(void *pArg)
+{
+	pvrWriter_t *w = pArg;
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;)
+	{
+		size_t pending = w->head - w->tail;
+		size_t offset;
+		size_t size;
+		uint32_t started;
+		uint32_t elapsed;
+		int flush = 0;
+		int ret;
+
+		while (!w->stop && pending < PVR_WRITER_BLOCK_SIZE)
+		{
+			struct timespec deadline;
+
+			pvrWriter_deadline(&deadline, PVR_WRITER_FLUSH_MS);
+			if (pthread_cond_timedwait(&w->dataCond, &w->mutex, &deadline) == ETIMEDOUT)
+			{
+				pending = w->head - w->tail;
+				flush = 1;
+				break;
+			}
+			pending = w->head - w->tail;
+		}
+
+		size = pending < PVR_WRITER_BLOCK_SIZE ? pending : PVR_WRITER_BLOCK_SIZE;
+		if (flush)
+			size -= size % TS_PACKET_SIZE;
+		else if (!w->stop)
+			// block ends on aligned ring offset, even after partial flush
+			size -= (w->tail + size) % PVR_WRITER_ALIGN;
+		offset = w->tail % w->size;
+		if (size > w->size - offset)
+			size = w->size - offset;
+		if (size == 0)
+		{
+			if (w->stop)
+				break;
+			continue;
+		}
+		pthread_mutex_unlock(&w->mutex);
+
+		started = pvrWriter_nowMs();
+		ret = pvrWriter_writeBlock(w, &w->ring[offset], size);
+		elapsed = pvrWriter_nowMs() - started;
+
+		pthread_mutex_lock(&w->mutex);
+		if (ret != 0)
+		{
+			w->error = errno ? errno : EIO;
+			pthread_cond_broadcast(&w->spaceCond);
+			break;
+		}
+		w->tail += size;
+		w->stats.written += size;
+		w->stats.blocks++;
+		if (elapsed > w->stats.blockMaxMs)
+			w->stats.blockMaxMs = elapsed;
+		pthread_cond_broadcast(&w->spaceCond);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+pvrWriter_t *pvrWriter_open(const char *directory, const pvrWriterConfig_t *config)
+{
+	pvrWriter_t *w;
+	size_t size = config && config->ringSize ? config->ringSize : PVR_WRITER_DEFAULT_RING;
+	int err;
+
+	size = (size + PVR_WRITER_BLOCK_SIZE - 1) / PVR_WRITER_BLOCK_SIZE * PVR_WRITER_BLOCK_SIZE;
+	if (size < 2*PVR_WRITER_BLOCK_SIZE)
+		size = 2*PVR_WRITER_BLOCK_SIZE;
+
+	w = calloc(1, sizeof(*w));
+	if (w == NULL)
+		return NULL;
+	if ((err = posix_memalign((void **)&w->ring, PVR_WRITER_DIRECT_ALIGN, size)) != 0)
+	{
+		free(w);
+		errno = err;
+		return NULL;
+	}
+	strncpy(w->directory, directory, sizeof(w->directory)-1);
+	w->size  = size;
+	w->flags = config ? config->flags : 0;
+	w->blocking = (w->flags & PVR_WRITER_BLOCKING) != 0;
+	w->part  = 1;
+	w->fd    = -1;
+	w->window = config ? config->window : 0;
+	w->stats.ringSize = size;
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->dataCond, NULL);
+	pthread_cond_init(&w->spaceCond, NULL);
+	if (pvrWriter_openPart(w) != 0)
+	{
+		err = errno;
+		goto failure;
+	}
+	if ((w->flags & PVR_WRITER_INDEX) && !w->window && (w->indexer = pvrIndexer_open(directory)) == NULL)
+		PERROR("Failed to create index in '%s'", directory);
+	if ((err = pthread_create(&w->thread, NULL, pvrWriter_thread, w)) != 0)
+	{
+		pvrWriter_closePart(w);
+		if (w->indexer != NULL)
+			pvrIndexer_close(w->indexer);
+		goto failure;
+	}
+	return w;
+
+failure:
+	pthread_cond_destroy(&w->spaceCond);
+	pthread_cond_destroy(&w->dataCond);
+	pthread_mutex_destroy(&w->mutex);
+	free(w->parts);
+	free(w->ring);
+	free(w);
+	errno = err;
+	return NULL;
+}
+
+ssize_t pvrWriter_write(pvrWriter_t *w, const void *data, size_t size)
+{
+	size_t offset;
+	size_t space;
+	size_t first;
+
+	pthread_mutex_lock(&w->mutex);
+	space = w->size - (w->head - w->tail);
+	if (w->blocking && space == 0 && !w->error)
+	{
+		struct timespec deadline;
+
+		pvrWriter_deadline(&deadline, PVR_WRITER_WAIT_MS);
+		while (space == 0 && !w->error &&
+		       pthread_cond_timedwait(&w->spaceCond, &w->mutex, &deadline) != ETIMEDOUT)
+		{
+			space = w->size - (w->head - w->tail);
+		}
+	}
+	if (w->error)
+	{
+		errno = w->error;
+		pthread_mutex_unlock(&w->mutex);
+		return -1;
+	}
+	if (size > space)
+	{
+		if (!w->blocking)
+		{
+			w->stats.overflows++;
+			w->stats.dropped += size;
+			pthread_mutex_unlock(&w->mutex);
+			return 0;
+		}
+		size = space;
+	}
+	offset = w->head % w->size;
+	pthread_mutex_unlock(&w->mutex);
+
+	first = w->size - offset;
+	if (first > size)
+		first = size;
+	memcpy(&w->ring[offset], data, first);
+	memcpy(w->ring, (const unsigned char *)data + first, size - first);
+
+	pthread_mutex_lock(&w->mutex);
+	w->head += size;
+	if (w->head - w->tail > w->stats.usedMax)
+		w->stats.usedMax = w->head - w->tail;
+	if (w->head - w->tail >= PVR_WRITER_BLOCK_SIZE)
+		pthread_cond_signal(&w->dataCond);
+	pthread_mutex_unlock(&w->mutex);
+
+	return size;
+}
+
+void pvrWriter_getStats(pvrWriter_t *w, pvrWriterStats_t *stats)
+{
+	pthread_mutex_lock(&w->mutex);
+	*stats = w->stats;
+	stats->used   = w->head - w->tail;
+	stats->part   = w->part - w->fileBase;
+	stats->direct = w->direct;
+	stats->error  = w->error;
+	stats->window = (w->window && w->partCount > 0) ? (uint32_t)(pvrWriter_nowSec() - w->parts[0].started) : 0;
+	pthread_mutex_unlock(&w->mutex);
+}
+
+int pvrWriter_keep(pvrWriter_t *w, const char *directory)
+{
+	char oldName[PATH_MAX];
+	char newName[PATH_MAX];
+	int fileBase;
+	int i, err;
+
+	pthread_mutex_lock(&w->mutex);
+	if (!w->window)
+	{
+		pthread_mutex_unlock(&w->mutex);
+		return 0;
+	}
+	fileBase = w->parts[0].number - 1;
+	for (i = 0; i < w->partCount; i++)
+	{
+		pvrWriter_partName(w, w->parts[i].number, oldName, sizeof(oldName));
+		snprintf(newName, sizeof(newName), "%s/part%02d.ts", directory, w->parts[i].number - fileBase);
+		if (rename(oldName, newName) != 0)
+			break;
+	}
+	if (i < w->partCount)
+	{
+		// EXDEV when timeshift buffer is on other filesystem: leave window as is
+		err = errno;
+		while (--i >= 0)
+		{
+			pvrWriter_partName(w, w->parts[i].number, oldName, sizeof(oldName));
+			snprintf(newName, sizeof(newName), "%s/part%02d.ts", directory, w->parts[i].number - fileBase);
+			rename(newName, oldName);
+		}
+		pthread_mutex_unlock(&w->mutex);
+		errno = err;
+		return -1;
+	}
+	strncpy(w->directory, directory, sizeof(w->directory)-1);
+	w->fileBase = fileBase;
+	w->window = 0;
+	pthread_mutex_unlock(&w->mutex);
+	return 0;
+}
+
+uint32_t pvrWriter_seek(pvrWriter_t *w, pvrWriterReader_t *r, uint32_t lag)
+{
+	time_t now;
+	time_t t;
+	time_t end;
+	off_t offset;
+	int i;
+
+	pthread_mutex_lock(&w->mutex);
+	now = pvrWriter_nowSec();
+	t = now - lag;
+	if (t < w->parts[0].started)
+		t = w->parts[0].started;
+	for (i = w->partCount-1; i > 0 && w->parts[i].started > t; i--);
+
+	/* Bitrate is assumed constant inside part */
+	end = (i+1 < w->partCount) ? w->parts[i+1].started : now;
+	offset = 0;
+	if (end > w->parts[i].started)
+	{
+		offset = (off_t)((int64_t)w->parts[i].size * (t - w->parts[i].started) / (end - w->parts[i].started));
+		offset -= offset % TS_PACKET_SIZE;
+	}
+	r->part   = w->parts[i].number;
+	r->offset = offset;
+	pthread_mutex_unlock(&w->mutex);
+
+	return now - t;
+}
+
+ssize_t pvrWriter_read(pvrWriter_t *w, pvrWriterReader_t *r, void *buf, size_t size)
+{
+	char filename[PATH_MAX];
+	off_t available;
+	ssize_t ret;
+	int i;
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;)
+	{
+		i = r->part - w->parts[0].number;
+		if (i < 0 || i >= w->partCount)
+		{
+			pthread_mutex_unlock(&w->mutex);
+			errno = ENOENT;
+			return -1;
+		}
+		available = w->parts[i].size - r->offset;
+		if (available > 0)
+			break;
+		if (i+1 == w->partCount)
+		{
+			// reached live position
+			pthread_mutex_unlock(&w->mutex);
+			return 0;
+		}
+		r->part++;
+		r->offset = 0;
+	}
+	if (r->fd < 0 || r->fdPart != r->part)
+	{
+		if (r->fd >= 0)
+			close(r->fd);
+		pvrWriter_partName(w, r->part, filename, sizeof(filename));
+		r->fd = open(filename, O_RDONLY);
+		r->fdPart = r->part;
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	if (r->fd < 0)
+		return -1;
+	if ((off_t)size > available)
+		size = available;
+	ret = pread(r->fd, buf, size, r->offset);
+	if (ret > 0)
+		r->offset += ret;
+	return ret;
+}
+
+void pvrWriter_readerInit(pvrWriterReader_t *r)
+{
+	r->part   = 0;
+	r->offset = 0;
+	r->fd     = -1;
+	r->fdPart = 0;
+}
+
+void pvrWriter_readerClose(pvrWriterReader_t *r)
+{
+	if (r->fd >= 0)
+		close(r->fd);
+	r->fd = -1;
+}
+
+int pvrWriter_close(pvrWriter_t *w, pvrWriterStats_t *stats)
+{
+	int err;
+
+	pthread_mutex_lock(&w->mutex);
+	w->stop = 1;
+	pthread_cond_signal(&w->dataCond);
+	pthread_mutex_unlock(&w->mutex);
+	pthread_join(w->thread, NULL);
+
+	if (pvrWriter_closePart(w) != 0 && w->error == 0)
+		w->error = errno;
+	if (w->indexer != NULL && pvrIndexer_close(w->indexer) != 0)
+		PERROR("Index write failed");
+	if (stats != NULL)
+		pvrWriter_getStats(w, stats);
+	err = w->error;
+
+	if (w->window)
+	{
+		// timeshift buffer which was not kept
+		char filename[PATH_MAX];
+		int i;
+
+		for (i = 0; i < w->partCount; i++)
+		{
+			pvrWriter_partName(w, w->parts[i].number, filename, sizeof(filename));
+			unlink(filename);
+		}
+	}
+	free(w->parts);
+
+	pthread_cond_destroy(&w->spaceCond);
+	pthread_cond_destroy(&w->dataCond);
+	pthread_mutex_destroy(&w->mutex);
+	free(w->ring);
+	free(w);
+
+	if (err != 0)
+	{
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
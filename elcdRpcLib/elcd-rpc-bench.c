@@ -0,0 +1,321 @@
+
+/*
+ elcd-rpc-bench.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file elcd-rpc-bench.c Latency benchmark of elcd RPC client
+ * Runs stand-in elcd in a thread, which answers every request with times
+ * result, and measures request serialization, synchronous round-trip,
+ * concurrent and pipelined calls.
+ *
+ * Usage: elcd-rpc-bench [calls]
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "elcd-rpc-client.h"
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define BENCH_THREADS  (4)
+#define BENCH_WINDOW   (32)
+
+#define BENCH_RESULT "{\"result\":{\"current\":\"00:01:02\",\"total\":\"01:30:00\"},\"id\":"
+#define BENCH_NOTIFY "{\"method\":\"times\",\"params\":[{\"current\":\"00:01:02\",\"total\":\"01:30:00\"}]}"
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct
+{
+	rpcClient_t *client;
+	int          calls;
+	uint64_t    *latency;
+} benchThread_t;
+
+/***********************************************
+* STATIC DATA                                  *
+************************************************/
+
+static char bench_socket[108];
+static int  bench_listen = -1;
+static volatile int bench_notifications;
+
+static sem_t bench_window;
+static volatile int bench_done;
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
+*******************************************************************/
+
+static uint64_t bench_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+/** Stand-in elcd: replies to each zero terminated request, sends notification first */
+static void *bench_daemon(void *pArg)
+{
+	char in[65536], out[65536];
+	int fd;
+
+	while((fd = accept(bench_listen, NULL, NULL)) >= 0) {
+		size_t length = 0;
+		ssize_t res;
+
+		send(fd, BENCH_NOTIFY, sizeof(BENCH_NOTIFY), MSG_NOSIGNAL);
+		while((res = recv(fd, in + length, sizeof(in) - length, 0)) > 0) {
+			size_t outLength = 0, start = 0, i;
+			length += res;
+			for(i = 0; i < length; i++) {
+				if(in[i] == 0) {
+					const char *id = strstr(in + start, "\"id\":");
+					if(id) {
+						outLength += sprintf(out + outLength, BENCH_RESULT "%d}", atoi(id + 5)) + 1;
+					}
+					start = i+1;
+				}
+			}
+			memmove(in, in + start, length - start);
+			length -= start;
+			if(outLength && send(fd, out, outLength, MSG_NOSIGNAL) < 0) {
+				break;
+			}
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+static void bench_notify(const char *method, cJSON *params, void *pArg)
+{
+	bench_notifications++;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void bench_report(const char *name, uint64_t *latency, int count, uint64_t total)
+{
+	qsort(latency, count, sizeof(*latency), bench_compare);
+	printf("%-16s %7d calls %8.0f calls/s  p50 %6.1f us  p99 %6.1f us  max %7.1f us\n", name, count,
+		count * 1e9 / total, latency[count/2] / 1e3, latency[count*99/100] / 1e3, latency[count-1] / 1e3);
+}
+
+static void bench_stats(rpcClient_t *client)
+{
+	rpcClientStats_t stats;
+	rpcClient_getStats(client, &stats);
+	printf("%16s %7u calls %7u writes %7u replies %u notifications %u lost, %u pending max\n", "",
+		stats.calls, stats.batches, stats.received, stats.notifications, stats.lost, stats.pendingMax);
+}
+
+static int bench_timesSync(rpcClient_t *client)
+{
+	elcdRpcType_t type = elcdRpcInvalid;
+	cJSON *result = NULL;
+	rpcWriter_t w;
+	char buf[64];
+
+	rpc_writerInit(&w, buf, sizeof(buf));
+	rpc_writeRequestBegin(&w, rpc_getCmdName(elcmd_times));
+	if(rpcClient_sendSync(client, &w, 3000, &type, &result) != 0 || type != elcdRpcResult) {
+		printf("%s: call failed\n", __func__);
+		return -1;
+	}
+	cJSON_Delete(result);
+	return 0;
+}
+
+static void *bench_thread(void *pArg)
+{
+	benchThread_t *t = pArg;
+	int i;
+
+	for(i = 0; i < t->calls; i++) {
+		uint64_t start = bench_now();
+		if(bench_timesSync(t->client) != 0) {
+			break;
+		}
+		t->latency[i] = bench_now() - start;
+	}
+	return NULL;
+}
+
+static void bench_asyncCallback(elcdRpcType_t type, cJSON *result, void *pArg)
+{
+	if(type != elcdRpcResult) {
+		printf("%s: call failed\n", __func__);
+	}
+	cJSON_Delete(result);
+	bench_done++;
+	sem_post(&bench_window);
+}
+
+static void bench_serialize(int calls)
+{
+	uint64_t start;
+	size_t bytes = 0;
+	int i;
+
+	start = bench_now();
+	for(i = 0; i < calls; i++) {
+		cJSON *params = cJSON_CreateObject();
+		char *msg;
+		cJSON_AddItemToObject(params, "position", cJSON_CreateNumber(i + 0.5));
+		cJSON_AddItemToObject(params, "url", cJSON_CreateString("http://192.168.0.1/movie.ts"));
+		msg = rpc_request("setpos", 2*i+1, params);
+		bytes += strlen(msg);
+		free(msg);
+		cJSON_Delete(params);
+	}
+	printf("%-16s %7.0f ns/request\n", "cJSON request", (bench_now() - start) / (double)calls);
+
+	start = bench_now();
+	for(i = 0; i < calls; i++) {
+		rpcWriter_t w;
+		char buf[256];
+		rpc_writerInit(&w, buf, sizeof(buf));
+		rpc_writeRequestBegin(&w, "setpos");
+		rpc_writeObjectBegin(&w, NULL);
+		rpc_writeDouble(&w, "position", i + 0.5);
+		rpc_writeString(&w, "url", "http://192.168.0.1/movie.ts");
+		rpc_writeObjectEnd(&w);
+		rpc_writeRequestEnd(&w, 2*i+1);
+		bytes -= w.length;
+		rpc_writerFree(&w);
+	}
+	printf("%-16s %7.0f ns/request%s\n", "writer request", (bench_now() - start) / (double)calls,
+		bytes ? " (output differs)" : "");
+}
+
+int main(int argc, char *argv[])
+{
+	benchThread_t threads[BENCH_THREADS];
+	pthread_t     tid[BENCH_THREADS];
+	struct sockaddr_un addr;
+	rpcClient_t *client;
+	pthread_t daemon;
+	uint64_t *latency, start;
+	int calls = argc > 1 ? atoi(argv[1]) : 20000;
+	int i;
+
+	if(calls < 100) {
+		calls = 100;
+	}
+	latency = malloc(sizeof(*latency) * calls * BENCH_THREADS);
+	snprintf(bench_socket, sizeof(bench_socket), "/tmp/elcd-rpc-bench.%d", getpid());
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, bench_socket);
+	bench_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(latency == NULL || bench_listen < 0 ||
+	   bind(bench_listen, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(bench_listen, 1) != 0) {
+		printf("Failed to create %s: %s\n", bench_socket, strerror(errno));
+		return 1;
+	}
+	pthread_create(&daemon, NULL, bench_daemon, NULL);
+
+	bench_serialize(calls);
+
+	client = rpcClient_create(bench_socket, bench_notify, NULL);
+	if(client == NULL) {
+		return 1;
+	}
+
+	// warm up and wait for connection
+	for(i = 0; i < 100 && bench_timesSync(client) != 0; i++) {
+		usleep(10000);
+	}
+
+	threads[0].client  = client;
+	threads[0].calls   = calls;
+	threads[0].latency = latency;
+	start = bench_now();
+	bench_thread(&threads[0]);
+	bench_report("sync", latency, calls, bench_now() - start);
+	bench_stats(client);
+
+	start = bench_now();
+	for(i = 0; i < BENCH_THREADS; i++) {
+		threads[i].client  = client;
+		threads[i].calls   = calls / BENCH_THREADS;
+		threads[i].latency = latency + i * threads[i].calls;
+		pthread_create(&tid[i], NULL, bench_thread, &threads[i]);
+	}
+	for(i = 0; i < BENCH_THREADS; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	bench_report("sync concurrent", latency, BENCH_THREADS * (calls / BENCH_THREADS), bench_now() - start);
+	bench_stats(client);
+
+	sem_init(&bench_window, 0, BENCH_WINDOW);
+	start = bench_now();
+	for(i = 0; i < calls; i++) {
+		sem_wait(&bench_window);
+		if(rpcClient_call(client, rpc_getCmdName(elcmd_times), NULL, bench_asyncCallback, NULL) < 0) {
+			printf("call %d failed\n", i);
+			sem_post(&bench_window);
+			bench_done++;
+		}
+	}
+	while(bench_done < calls) {
+		usleep(1000);
+	}
+	printf("%-16s %7d calls %8.0f calls/s, %d in flight\n", "pipelined", calls,
+		calls * 1e9 / (bench_now() - start), BENCH_WINDOW);
+	bench_stats(client);
+
+	rpcClient_destroy(client);
+	shutdown(bench_listen, SHUT_RDWR);
+	close(bench_listen);
+	unlink(bench_socket);
+	free(latency);
+	return bench_notifications == 1 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#ifndef __ELCD_RPC_CLIENT_H
+#define __ELCD_RPC_CLIENT_H
+
+/*
+ elcd-rpc-client.h
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file elcd-rpc-client.h Client side transport of elcd RPC
+ * Requests are written with rpcWriter_t directly into the send buffer and
+ * matched to replies by id in a lock-free table, so any thread may call
+ * elcd without serializing on the others. Requests issued while another
+ * thread is sending are batched into a single write.
+ * Messages without id sent by elcd are delivered as notifications.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include "elcd-rpc.h"
+
+/***********************************************
+* EXPORTED MACROS                              *
+************************************************/
+
+/** Maximum number of requests waiting for reply, power of 2 */
+#define RPC_CLIENT_SLOTS        (64)
+/** Incoming messages larger than this are dropped */
+#define RPC_CLIENT_MAX_MESSAGE  (1024*1024)
+
+/***********************************************
+* EXPORTED TYPEDEFS                            *
+************************************************/
+
+typedef struct rpcClient_s rpcClient_t;
+
+/** Called from client thread, params are owned by client and valid only during the call */
+typedef void (*rpcNotifyCallback_t)(const char *method, cJSON *params, void *pArg);
+
+typedef struct
+{
+	uint32_t calls;
+	uint32_t batches;       // socket writes, less than calls if requests were batched
+	uint32_t received;
+	uint32_t notifications;
+	uint32_t lost;          // replies which didn't match any request
+	uint32_t pending;       // requests waiting for reply
+	uint32_t pendingMax;
+} rpcClientStats_t;
+
+/******************************************************************
+* EXPORTED FUNCTIONS PROTOTYPES               <Module>_<Word>+    *
+*******************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Starts client thread, which connects to socketName and reconnects if connection is lost
+ * @return NULL if client can't be created
+ */
+rpcClient_t *rpcClient_create(const char *socketName, rpcNotifyCallback_t notify, void *pArg);
+
+/** Stops client thread. Callbacks of waiting requests are called with elcdRpcError. */
+void rpcClient_destroy(rpcClient_t *client);
+
+/** Sends request started by rpc_writeRequestBegin. Request id is assigned and written by client.
+ * Callback is called from client thread. If connection is lost, it is called with elcdRpcError.
+ * @return Request id > 0, negative on error
+ */
+int rpcClient_send(rpcClient_t *client, rpcWriter_t *request, rpcCallback_t callback, void *pArg);
+
+/** Builds and sends request, params is either array of params or single param, may be NULL */
+int rpcClient_call(rpcClient_t *client, const char *method, cJSON *params, rpcCallback_t callback, void *pArg);
+
+/** Cancels waiting request
+ * @param[in] execute Call callback with elcdRpcInvalid and empty result
+ * @return 1 if request was canceled, 0 if reply was already received
+ */
+int rpcClient_cancel(rpcClient_t *client, int id, int execute);
+
+/** Synchronous versions of rpcClient_send and rpcClient_call. Reply is waited timeout milliseconds.
+ * Pointer stored in result should be freed by caller.
+ * @return 0 on success, type and result are left unchanged on failure
+ */
+int rpcClient_sendSync(rpcClient_t *client, rpcWriter_t *request, int timeout, elcdRpcType_t *type, cJSON **result);
+int rpcClient_callSync(rpcClient_t *client, const char *method, cJSON *params, int timeout, elcdRpcType_t *type, cJSON **result);
+
+void rpcClient_getStats(rpcClient_t *client, rpcClientStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ELCD_RPC_CLIENT_H
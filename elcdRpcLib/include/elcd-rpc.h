@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ************************************************/
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <cJSON.h>
 
 /***********************************************
@@ -114,6 +115,23 @@ typedef enum
 	elcmd_cmd_count,
 } elcdRpcCommand_t;
 
+/** Callback receives ownership of result */
+typedef void (*rpcCallback_t)(elcdRpcType_t type, cJSON *result, void* pArg);
+
+/** Streaming JSON writer
+ * Appends JSON text directly to a buffer, so simple calls don't need cJSON trees.
+ * Writer starts with caller supplied buffer and switches to heap when it is exhausted.
+ */
+typedef struct
+{
+	char   *data;
+	size_t  size;
+	size_t  length;
+	char   *heap;   // data, if it was malloc'ated by writer
+	int     first;  // next value starts array/object, so needs no comma
+	int     error;
+} rpcWriter_t;
+
 /***********************************************
 * EXPORTED MACROS                              *
 ************************************************/
@@ -185,6 +203,35 @@ char* rpc_request( const char *cmd, int id, cJSON *value);
 char* rpc_result ( int id, cJSON *result);
 char* rpc_error  ( int id, cJSON *err );
 
+/** Writer functions
+ * name is the key of value in enclosing object, NULL for array items and top level.
+ * On allocation failure writer sets error and ignores further values.
+ */
+void rpc_writerInit(rpcWriter_t *w, char *buf, size_t size);
+void rpc_writerFree(rpcWriter_t *w);
+/** Appends ready JSON text */
+void rpc_writeRaw        (rpcWriter_t *w, const char *text, size_t len);
+void rpc_writeObjectBegin(rpcWriter_t *w, const char *name);
+void rpc_writeObjectEnd  (rpcWriter_t *w);
+void rpc_writeArrayBegin (rpcWriter_t *w, const char *name);
+void rpc_writeArrayEnd   (rpcWriter_t *w);
+void rpc_writeNull       (rpcWriter_t *w, const char *name);
+void rpc_writeBool       (rpcWriter_t *w, const char *name, int value);
+void rpc_writeInt        (rpcWriter_t *w, const char *name, int32_t value);
+void rpc_writeDouble     (rpcWriter_t *w, const char *name, double value);
+void rpc_writeString     (rpcWriter_t *w, const char *name, const char *value);
+/** Binary safe version, zero bytes are escaped as \u0000 */
+void rpc_writeStringLen  (rpcWriter_t *w, const char *name, const char *value, size_t len);
+/** Serializes cJSON tree the same way cJSON_PrintUnformatted does */
+void rpc_writeJson       (rpcWriter_t *w, const char *name, cJSON *item);
+
+/** Starts request {"method":cmd,"params":[
+ * Following values are written as items of params array.
+ */
+void rpc_writeRequestBegin(rpcWriter_t *w, const char *cmd);
+/** Completes request with ]"id":id} */
+void rpc_writeRequestEnd  (rpcWriter_t *w, int id);
+
 #ifdef __cplusplus
 }
 #endif
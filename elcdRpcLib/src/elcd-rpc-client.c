@@ -0,0 +1,722 @@
+
+/*
+ elcd-rpc-client.c
+
+Copyright (C) 2014  Elecard Devices
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Elecard Devices nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL ELECARD DEVICES BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/***********************************************
+* INCLUDE FILES                                *
+************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+
+#include "elcd-rpc-client.h"
+
+/***********************************************
+* LOCAL MACROS                                 *
+************************************************/
+
+#define CLIENT_BUFFER_SIZE     (4096)
+#define CLIENT_READ_TIMEOUT    (1)
+#define CLIENT_RECONNECT_DELAY (50000)
+
+#define CLIENT_SLOT(id) ((((uint32_t)(id)) >> 1) & (RPC_CLIENT_SLOTS-1))
+// slot is claimed but callback is not stored yet; ids are odd, so it never matches one
+#define CLIENT_SLOT_RESERVED (2)
+
+#define CAS(ptr,old,new) __sync_bool_compare_and_swap((ptr),(old),(new))
+#define ADD(ptr,value)   __sync_add_and_fetch((ptr),(value))
+
+/***********************************************
+* LOCAL TYPEDEFS                               *
+************************************************/
+
+typedef struct
+{
+	volatile uint32_t id;  // 0 if slot is free, CLIENT_SLOT_RESERVED while being filled
+	rpcCallback_t     callback;
+	void             *pArg;
+} rpcClientSlot_t;
+
+/** Incoming stream splitter state
+ * Messages are delimited by zero byte, unterminated messages are ended by
+ * closing bracket of top level object.
+ */
+typedef struct
+{
+	char   *data;
+	size_t  size;
+	size_t  length;
+	size_t  scanned;
+	int     depth;
+	int     inString;
+	int     escape;
+	int     discard;  // current message is too large
+} rpcClientBuffer_t;
+
+struct rpcClient_s
+{
+	char               socketName[sizeof(((struct sockaddr_un*)0)->sun_path)];
+	int                fd;
+	int                connectFailed;
+	volatile int       quit;
+	pthread_t          thread;
+
+	rpcNotifyCallback_t notify;
+	void              *pArg;
+
+	volatile uint32_t  sequence;
+	rpcClientSlot_t    slots[RPC_CLIENT_SLOTS];
+
+	/** Batching: requests are appended to out, the first thread which finds
+	 *  nobody sending becomes sender and writes out until it's empty */
+	pthread_mutex_t    lock;
+	pthread_cond_t     sentCond;
+	char              *out;
+	size_t             outLength;
+	size_t             outSize;
+	int                sending;
+	uint32_t           batch;       // number of batch accumulated in out
+	uint32_t           sentBatch;   // last written batch
+	uint32_t           failedBatch; // last batch failed to write
+	/** Socket written by sender without lock. Client thread doesn't close it
+	 *  on disconnect, but sets closeWriting and leaves it to the sender, so
+	 *  the descriptor can't be reused by another socket during the write */
+	int                writingFd;
+	int                closeWriting;
+
+	rpcClientStats_t   stats;
+};
+
+typedef struct
+{
+	elcdRpcType_t   type;
+	cJSON          *result;
+	sem_t           lock;
+} rpcClientSync_t;
+
+/******************************************************************
+* STATIC FUNCTION PROTOTYPES                  <Module>_<Word>+    *
+*******************************************************************/
+
+static void *rpcClient_thread(void *pArg);
+
+/******************************************************************
+* FUNCTION IMPLEMENTATION                     <Module>[_<Word>+]  *
+*******************************************************************/
+
+/** Should be called with client lock held */
+static int rpcClient_connect(rpcClient_t *c)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if(c->fd >= 0) {
+		return 0;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) {
+		printf("%s: can't create socket: %s\n", __func__, strerror(errno));
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, c->socketName);
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		if(!c->connectFailed) {
+			printf("%s: can't connect to %s: %s\n", __func__, c->socketName, strerror(errno));
+			c->connectFailed = 1;
+		}
+		close(fd);
+		return -1;
+	}
+	c->connectFailed = 0;
+	c->fd = fd;
+	return 0;
+}
+
+static int rpcClient_claim(rpcClient_t *c, rpcCallback_t callback, void *pArg)
+{
+	uint32_t pending;
+	int i;
+
+	// slot is selected by id, so try next ids while slots are occupied by older requests
+	for(i = 0; i < 2*RPC_CLIENT_SLOTS; i++) {
+		// ids are odd and positive, as they were before
+		uint32_t id = ((ADD(&c->sequence, 1) & 0x3fffffff) << 1) | 1;
+		rpcClientSlot_t *slot = &c->slots[CLIENT_SLOT(id)];
+
+		// publish id only after callback is stored, so that release never
+		// picks up callback of the previous request in this slot
+		if(CAS(&slot->id, 0, CLIENT_SLOT_RESERVED)) {
+			slot->callback = callback;
+			slot->pArg     = pArg;
+			CAS(&slot->id, CLIENT_SLOT_RESERVED, id);
+			pending = ADD(&c->stats.pending, 1);
+			if(pending > c->stats.pendingMax) {
+				c->stats.pendingMax = pending;
+			}
+			return id;
+		}
+	}
+	return -1;
+}
+
+/** @return 1 if slot was released by this call */
+static int rpcClient_release(rpcClient_t *c, uint32_t id, rpcCallback_t *callback, void **pArg)
+{
+	rpcClientSlot_t *slot = &c->slots[CLIENT_SLOT(id)];
+
+	if(id == CLIENT_SLOT_RESERVED || slot->id != id) {
+		return 0;
+	}
+	__sync_synchronize();
+	// read before releasing, slot may be reused right after that
+	*callback = slot->callback;
+	*pArg     = slot->pArg;
+	if(!CAS(&slot->id, id, 0)) {
+		return 0;
+	}
+	ADD(&c->stats.pending, -1);
+	return 1;
+}
+
+static void rpcClient_failAll(rpcClient_t *c, const char *reason)
+{
+	rpcCallback_t callback;
+	void *pArg;
+	int i;
+
+	for(i = 0; i < RPC_CLIENT_SLOTS; i++) {
+		uint32_t id = c->slots[i].id;
+		if(id && rpcClient_release(c, id, &callback, &pArg) && callback) {
+			callback(elcdRpcError, cJSON_CreateString(reason), pArg);
+		}
+	}
+}
+
+static int rpcClient_write(int fd, const char *data, size_t len)
+{
+	while(len > 0) {
+		ssize_t res = send(fd, data, len, MSG_NOSIGNAL);
+		if(res < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			printf("%s: can't write: %s\n", __func__, strerror(errno));
+			return -1;
+		}
+		data += res;
+		len  -= res;
+	}
+	return 0;
+}
+
+/** Appends zero terminated request to out and waits until it is written */
+static int rpcClient_queue(rpcClient_t *c, const char *msg, size_t len)
+{
+	uint32_t batch;
+	int res;
+
+	pthread_mutex_lock(&c->lock);
+	if(c->outLength + len > c->outSize) {
+		size_t size = c->outSize ? c->outSize : CLIENT_BUFFER_SIZE;
+		char *out;
+		while(size < c->outLength + len) {
+			size *= 2;
+		}
+		out = realloc(c->out, size);
+		if(out == NULL) {
+			pthread_mutex_unlock(&c->lock);
+			return -1;
+		}
+		c->out = out;
+		c->outSize = size;
+	}
+	memcpy(c->out + c->outLength, msg, len);
+	c->outLength += len;
+	batch = c->batch;
+
+	if(c->sending) {
+		while((int32_t)(c->sentBatch - batch) < 0) {
+			pthread_cond_wait(&c->sentCond, &c->lock);
+		}
+	} else {
+		c->sending = 1;
+		while(c->outLength > 0) {
+			uint32_t sending = c->batch++;
+			char  *data = c->out;
+			size_t length = c->outLength;
+			size_t size = c->outSize;
+			int    fd;
+
+			// others append to fresh buffer while this one is written
+			c->out = NULL;
+			c->outLength = c->outSize = 0;
+			res = rpcClient_connect(c);
+			fd = c->fd;
+			c->writingFd = fd;
+			c->stats.batches++;
+			pthread_mutex_unlock(&c->lock);
+
+			if(res == 0 && rpcClient_write(fd, data, length) != 0) {
+				// client thread closes socket and fails waiting requests
+				shutdown(fd, SHUT_RDWR);
+				res = -1;
+			}
+
+			pthread_mutex_lock(&c->lock);
+			if(c->closeWriting) {
+				// client thread has already dropped this socket
+				close(fd);
+				c->closeWriting = 0;
+			}
+			c->writingFd = -1;
+			if(c->out == NULL) {
+				c->out = data;
+				c->outSize = size;
+			} else {
+				free(data);
+			}
+			if(res != 0) {
+				c->failedBatch = sending;
+			}
+			c->sentBatch = sending;
+			pthread_cond_broadcast(&c->sentCond);
+		}
+		c->sending = 0;
+	}
+	res = c->failedBatch == batch ? -1 : 0;
+	pthread_mutex_unlock(&c->lock);
+	return res;
+}
+
+rpcClient_t *rpcClient_create(const char *socketName, rpcNotifyCallback_t notify, void *pArg)
+{
+	rpcClient_t *c;
+	int res;
+
+	if(strlen(socketName) >= sizeof(c->socketName)) {
+		printf("%s: socket name is too long: %s\n", __func__, socketName);
+		return NULL;
+	}
+	c = calloc(1, sizeof(*c));
+	if(c == NULL) {
+		return NULL;
+	}
+	strcpy(c->socketName, socketName);
+	c->fd     = -1;
+	c->writingFd = -1;
+	c->notify = notify;
+	c->pArg   = pArg;
+	c->batch  = 1;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->sentCond, NULL);
+
+	res = pthread_create(&c->thread, NULL, rpcClient_thread, c);
+	if(res != 0) {
+		printf("%s: failed to create client thread: %s\n", __func__, strerror(res));
+		pthread_cond_destroy(&c->sentCond);
+		pthread_mutex_destroy(&c->lock);
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+void rpcClient_destroy(rpcClient_t *c)
+{
+	if(c == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&c->lock);
+	c->quit = 1;
+	if(c->fd >= 0) {
+		shutdown(c->fd, SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->thread, NULL);
+
+	if(c->fd >= 0) {
+		close(c->fd);
+	}
+	pthread_cond_destroy(&c->sentCond);
+	pthread_mutex_destroy(&c->lock);
+	free(c->out);
+	free(c);
+}
+
+int rpcClient_send(rpcClient_t *c, rpcWriter_t *request, rpcCallback_t callback, void *pArg)
+{
+	rpcCallback_t cb;
+	void *arg;
+	int id;
+
+	if(c == NULL || request->error) {
+		return -1;
+	}
+	id = rpcClient_claim(c, callback, pArg);
+	if(id < 0) {
+		printf("%s: RPC pool is full\n", __func__);
+		return -1;
+	}
+	ADD(&c->stats.calls, 1);
+	rpc_writeRequestEnd(request, id);
+	if(request->error ||
+	   rpcClient_queue(c, request->data, request->length + 1) != 0) {
+		rpcClient_release(c, id, &cb, &arg);
+		return -1;
+	}
+	return id;
+}
+
+int rpcClient_call(rpcClient_t *c, const char *method, cJSON *params, rpcCallback_t callback, void *pArg)
+{
+	rpcWriter_t w;
+	char buf[512];
+	int res;
+
+	rpc_writerInit(&w, buf, sizeof(buf));
+	rpc_writeRequestBegin(&w, method);
+	if(params && params->type == cJSON_Array) {
+		cJSON *item;
+		for(item = params->child; item; item = item->next) {
+			rpc_writeJson(&w, NULL, item);
+		}
+	} else if(params) {
+		rpc_writeJson(&w, NULL, params);
+	}
+	res = rpcClient_send(c, &w, callback, pArg);
+	rpc_writerFree(&w);
+	return res;
+}
+
+int rpcClient_cancel(rpcClient_t *c, int id, int execute)
+{
+	rpcCallback_t callback;
+	void *pArg;
+
+	if(c == NULL || id <= 0 || !rpcClient_release(c, id, &callback, &pArg)) {
+		return 0;
+	}
+	if(execute && callback) {
+		callback(elcdRpcInvalid, NULL, pArg);
+	}
+	return 1;
+}
+
+static void rpcClient_syncCallback(elcdRpcType_t type, cJSON *result, void* pArg)
+{
+	rpcClientSync_t *s = pArg;
+	s->type   = type;
+	s->result = result;
+	sem_post(&s->lock);
+}
+
+int rpcClient_sendSync(rpcClient_t *c, rpcWriter_t *request, int timeout, elcdRpcType_t *type, cJSON **result)
+{
+	rpcClientSync_t s;
+	struct timespec t;
+	int id;
+
+	s.type   = elcdRpcInvalid;
+	s.result = NULL;
+	if(sem_init(&s.lock, 0, 0) != 0) {
+		printf("%s: failed to create semaphore: %s\n", __func__, strerror(errno));
+		return -1;
+	}
+	id = rpcClient_send(c, request, rpcClient_syncCallback, &s);
+	if(id < 0) {
+		sem_destroy(&s.lock);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &t);
+	t.tv_sec  += timeout / 1000;
+	t.tv_nsec += (timeout % 1000) * 1000000;
+	if(t.tv_nsec >= 1000000000) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	}
+	while(sem_timedwait(&s.lock, &t) != 0) {
+		if(errno == EINTR) {
+			continue;
+		}
+		if(rpcClient_cancel(c, id, 0)) {
+			sem_destroy(&s.lock);
+			return -2;
+		}
+		// reply arrived meanwhile and callback is being called
+		sem_wait(&s.lock);
+		break;
+	}
+	sem_destroy(&s.lock);
+
+	if(type) {
+		*type = s.type;
+	}
+	if(result) {
+		*result = s.result;
+	} else {
+		cJSON_Delete(s.result);
+	}
+	return 0;
+}
+
+int rpcClient_callSync(rpcClient_t *c, const char *method, cJSON *params, int timeout, elcdRpcType_t *type, cJSON **result)
+{
+	rpcWriter_t w;
+	char buf[512];
+	int res;
+
+	rpc_writerInit(&w, buf, sizeof(buf));
+	rpc_writeRequestBegin(&w, method);
+	if(params && params->type == cJSON_Array) {
+		cJSON *item;
+		for(item = params->child; item; item = item->next) {
+			rpc_writeJson(&w, NULL, item);
+		}
+	} else if(params) {
+		rpc_writeJson(&w, NULL, params);
+	}
+	res = rpcClient_sendSync(c, &w, timeout, type, result);
+	rpc_writerFree(&w);
+	return res;
+}
+
+void rpcClient_getStats(rpcClient_t *c, rpcClientStats_t *stats)
+{
+	pthread_mutex_lock(&c->lock);
+	*stats = c->stats;
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void rpcClient_dispatch(rpcClient_t *c, const char *text)
+{
+	elcdRpcType_t type = elcdRpcInvalid;
+	rpcCallback_t callback;
+	cJSON *msg, *id, *method, *value = NULL;
+	void *pArg;
+
+	msg = cJSON_Parse(text);
+	if(msg == NULL) {
+		printf("%s: failed to parse message: '%.256s'\n", __func__, text);
+		return;
+	}
+	c->stats.received++;
+	id     = cJSON_GetObjectItem(msg, "id");
+	method = cJSON_GetObjectItem(msg, "method");
+	if(method && method->type == cJSON_String) {
+		if(id == NULL || id->type == cJSON_NULL) {
+			c->stats.notifications++;
+			if(c->notify) {
+				c->notify(method->valuestring, cJSON_GetObjectItem(msg, "params"), c->pArg);
+			}
+		} else {
+			printf("%s: don't know what to do with request %s\n", __func__, method->valuestring);
+		}
+		cJSON_Delete(msg);
+		return;
+	}
+	if(id == NULL || id->type != cJSON_Number || id->valueint <= 0) {
+		printf("%s: missing id\n", __func__);
+		cJSON_Delete(msg);
+		return;
+	}
+	value = cJSON_DetachItemFromObject(msg, "result");
+	if(value && value->type != cJSON_NULL) {
+		type = elcdRpcResult;
+	} else {
+		cJSON_Delete(value);
+		value = cJSON_DetachItemFromObject(msg, "error");
+		if(value && value->type != cJSON_NULL) {
+			type = elcdRpcError;
+		}
+	}
+	if(type == elcdRpcInvalid) {
+		printf("%s: malformed message: '%.256s'\n", __func__, text);
+		cJSON_Delete(value);
+	} else if(rpcClient_release(c, id->valueint, &callback, &pArg)) {
+		if(callback) {
+			callback(type, value, pArg);
+		} else {
+			cJSON_Delete(value);
+		}
+	} else {
+		printf("%s: lost message %6u\n", __func__, (unsigned int)id->valueint);
+		c->stats.lost++;
+		cJSON_Delete(value);
+	}
+	cJSON_Delete(msg);
+}
+
+/** Splits received data to messages and dispatches complete ones */
+static void rpcClient_process(rpcClient_t *c, rpcClientBuffer_t *b)
+{
+	size_t start = 0;
+	size_t i;
+
+	for(i = b->scanned; i < b->length; i++) {
+		char ch = b->data[i];
+		int  end = 0;
+
+		if(ch == 0) {
+			end = 1;
+		} else if(b->inString) {
+			if(b->escape) {
+				b->escape = 0;
+			} else if(ch == '\\') {
+				b->escape = 1;
+			} else if(ch == '"') {
+				b->inString = 0;
+			}
+		} else if(ch == '"') {
+			b->inString = 1;
+		} else if(ch == '{' || ch == '[') {
+			b->depth++;
+		} else if(ch == '}' || ch == ']') {
+			end = --b->depth <= 0;
+		} else if(b->depth == 0 && start == i) {
+			// whitespace between messages
+			start = i+1;
+		}
+		if(!end) {
+			continue;
+		}
+		if(b->discard) {
+			printf("%s: dropped message larger than %d bytes\n", __func__, RPC_CLIENT_MAX_MESSAGE);
+			b->discard = 0;
+		} else if(i >= start && b->data[start] != 0) {
+			char last = b->data[i+1];
+			b->data[i+1] = 0;
+			rpcClient_dispatch(c, b->data + start);
+			b->data[i+1] = last;
+		}
+		start = i+1;
+		b->depth = b->inString = b->escape = 0;
+	}
+
+	if(start > 0) {
+		b->length -= start;
+		memmove(b->data, b->data + start, b->length);
+	}
+	b->scanned = b->length;
+	b->data[b->length] = 0;
+
+	if(b->length + 1 >= b->size) {
+		if(b->size*2 > RPC_CLIENT_MAX_MESSAGE) {
+			// keep scanner state to find the end of message
+			b->discard = 1;
+			b->length = b->scanned = 0;
+		} else {
+			char *data = realloc(b->data, b->size*2);
+			if(data == NULL) {
+				b->discard = 1;
+				b->length = b->scanned = 0;
+			} else {
+				b->data  = data;
+				b->size *= 2;
+			}
+		}
+	}
+}
+
+static void *rpcClient_thread(void *pArg)
+{
+	rpcClient_t *c = pArg;
+	rpcClientBuffer_t b;
+
+	memset(&b, 0, sizeof(b));
+	b.size = CLIENT_BUFFER_SIZE;
+	b.data = malloc(b.size);
+	if(b.data == NULL) {
+		printf("%s: out of memory\n", __func__);
+		return NULL;
+	}
+
+	while(!c->quit) {
+		struct timeval tv;
+		fd_set rfds;
+		ssize_t res;
+		int fd;
+
+		pthread_mutex_lock(&c->lock);
+		rpcClient_connect(c);
+		fd = c->fd;
+		pthread_mutex_unlock(&c->lock);
+		if(fd < 0) {
+			usleep(CLIENT_RECONNECT_DELAY);
+			continue;
+		}
+
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		tv.tv_sec  = CLIENT_READ_TIMEOUT;
+		tv.tv_usec = 0;
+		res = select(fd+1, &rfds, NULL, NULL, &tv);
+		if(res <= 0) {
+			continue;
+		}
+		res = recv(fd, b.data + b.length, b.size - b.length - 1, 0);
+		if(res < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		if(res <= 0) {
+			pthread_mutex_lock(&c->lock);
+			if(fd == c->writingFd) {
+				c->closeWriting = 1;
+			} else {
+				close(fd);
+			}
+			c->fd = -1;
+			pthread_mutex_unlock(&c->lock);
+			if(!c->quit) {
+				printf("%s: disconnected from %s\n", __func__, c->socketName);
+			}
+			rpcClient_failAll(c, "disconnected");
+			b.length = b.scanned = 0;
+			b.depth = b.inString = b.escape = b.discard = 0;
+			continue;
+		}
+		b.length += res;
+		rpcClient_process(c, &b);
+	}
+
+	rpcClient_failAll(c, "canceled");
+	free(b.data);
+	return NULL;
+}
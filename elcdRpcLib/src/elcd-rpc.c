@@ -36,6 +36,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
 
 #include "elcd-rpc.h"
 
@@ -46,6 +49,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define CMD_NAME_NONE		"none"
 #define CMD_NAME_UNKNOWN	"unknown"
 
+#define WRITER_MIN_HEAP		(256)
+
 /***********************************************
 * LOCAL TYPEDEFS                               *
 ************************************************/
@@ -159,34 +164,30 @@ elcdRpcCommand_t rpc_getCmd(const char *name)
 
 char *rpc_request(const char *cmd, int id, cJSON *value)
 {
-	cJSON *array = NULL;
+	rpcWriter_t w;
+	char buf[512];
 
 	if(cmd == NULL) {
 		printf("%s:%s(): ERROR cmd=NULL!!!\n", __FILE__, __func__);
 		cmd = CMD_NAME_NONE;
 	}
-	if(!value || value->type != cJSON_Array) {
-		array = cJSON_CreateArray();
-		if(value) {
-			cJSON_AddItemReferenceToArray(array, value);
+	rpc_writerInit(&w, buf, sizeof(buf));
+	rpc_writeRequestBegin(&w, cmd);
+	if(value && value->type == cJSON_Array) {
+		cJSON *item;
+		for(item = value->child; item; item = item->next) {
+			rpc_writeJson(&w, NULL, item);
 		}
-	} else {
-		array = value;
+	} else if(value) {
+		rpc_writeJson(&w, NULL, value);
 	}
+	rpc_writeRequestEnd(&w, id);
 
-	cJSON *req = cJSON_CreateObject();
-	cJSON_AddItemToObject(req, "method", cJSON_CreateString(cmd));
-	cJSON_AddItemReferenceToObject(req, "params", array);
-	cJSON_AddItemToObject(req, "id",     cJSON_CreateNumber(id));
-
-	char *str = cJSON_PrintUnformatted(req);
-
-	if(array != value) {
-		cJSON_Delete(array);
+	if(w.error) {
+		rpc_writerFree(&w);
+		return NULL;
 	}
-	cJSON_Delete(req);
-
-	return str;
+	return w.heap ? w.heap : strdup(w.data);
 }
 
 char *rpc_result(int id, cJSON *result)
@@ -216,3 +217,266 @@ char *rpc_error(int id, cJSON *err)
 
 	return str;
 }
+
+static int rpc_writerReserve(rpcWriter_t *w, size_t len)
+{
+	size_t size;
+	char  *data;
+
+	if(w->error) {
+		return -1;
+	}
+	// keep space for terminating zero
+	if(w->length + len < w->size) {
+		return 0;
+	}
+	size = w->size*2 > WRITER_MIN_HEAP ? w->size*2 : WRITER_MIN_HEAP;
+	while(size <= w->length + len) {
+		size *= 2;
+	}
+	data = realloc(w->heap, size);
+	if(data == NULL) {
+		w->error = 1;
+		return -1;
+	}
+	if(w->heap == NULL && w->length) {
+		memcpy(data, w->data, w->length);
+	}
+	w->heap = w->data = data;
+	w->size = size;
+	return 0;
+}
+
+static inline void rpc_writerPut(rpcWriter_t *w, const char *text, size_t len)
+{
+	memcpy(w->data + w->length, text, len);
+	w->length += len;
+	w->data[w->length] = 0;
+}
+
+static void rpc_writerString(rpcWriter_t *w, const char *str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *ptr = (const unsigned char *)str;
+	const unsigned char *end = ptr + len;
+	char *out;
+
+	// worst case is \u00XX for every byte
+	if(rpc_writerReserve(w, len*6 + 2) != 0) {
+		return;
+	}
+	out = w->data + w->length;
+	*out++ = '\"';
+	for(; ptr < end; ptr++) {
+		if(*ptr > 31 && *ptr != '\"' && *ptr != '\\') {
+			*out++ = *ptr;
+			continue;
+		}
+		*out++ = '\\';
+		switch(*ptr) {
+			case '\\': *out++ = '\\'; break;
+			case '\"':  *out++ = '\"';  break;
+			case '\b':  *out++ = 'b';   break;
+			case '\f':  *out++ = 'f';   break;
+			case '\n':  *out++ = 'n';   break;
+			case '\r':  *out++ = 'r';   break;
+			case '\t':  *out++ = 't';   break;
+			default:
+				*out++ = 'u';
+				*out++ = '0';
+				*out++ = '0';
+				*out++ = hex[*ptr >> 4];
+				*out++ = hex[*ptr & 0x0f];
+				break;
+		}
+	}
+	*out++ = '\"';
+	*out = 0;
+	w->length = out - w->data;
+}
+
+/** Writes separator and name of the next value */
+static int rpc_writerValue(rpcWriter_t *w, const char *name)
+{
+	if(rpc_writerReserve(w, 1) != 0) {
+		return -1;
+	}
+	if(!w->first) {
+		rpc_writerPut(w, ",", 1);
+	}
+	w->first = 0;
+	if(name) {
+		rpc_writerString(w, name, strlen(name));
+		if(rpc_writerReserve(w, 1) != 0) {
+			return -1;
+		}
+		rpc_writerPut(w, ":", 1);
+	}
+	return w->error ? -1 : 0;
+}
+
+void rpc_writerInit(rpcWriter_t *w, char *buf, size_t size)
+{
+	w->data   = buf;
+	w->size   = buf ? size : 0;
+	w->length = 0;
+	w->heap   = NULL;
+	w->first  = 1;
+	w->error  = 0;
+	if(w->size) {
+		buf[0] = 0;
+	}
+}
+
+void rpc_writerFree(rpcWriter_t *w)
+{
+	free(w->heap);
+	w->heap = w->data = NULL;
+	w->size = w->length = 0;
+}
+
+void rpc_writeRaw(rpcWriter_t *w, const char *text, size_t len)
+{
+	if(rpc_writerReserve(w, len) == 0) {
+		rpc_writerPut(w, text, len);
+	}
+}
+
+void rpc_writeObjectBegin(rpcWriter_t *w, const char *name)
+{
+	if(rpc_writerValue(w, name) == 0) {
+		rpc_writeRaw(w, "{", 1);
+		w->first = 1;
+	}
+}
+
+void rpc_writeObjectEnd(rpcWriter_t *w)
+{
+	rpc_writeRaw(w, "}", 1);
+	w->first = 0;
+}
+
+void rpc_writeArrayBegin(rpcWriter_t *w, const char *name)
+{
+	if(rpc_writerValue(w, name) == 0) {
+		rpc_writeRaw(w, "[", 1);
+		w->first = 1;
+	}
+}
+
+void rpc_writeArrayEnd(rpcWriter_t *w)
+{
+	rpc_writeRaw(w, "]", 1);
+	w->first = 0;
+}
+
+void rpc_writeNull(rpcWriter_t *w, const char *name)
+{
+	if(rpc_writerValue(w, name) == 0) {
+		rpc_writeRaw(w, "null", 4);
+	}
+}
+
+void rpc_writeBool(rpcWriter_t *w, const char *name, int value)
+{
+	if(rpc_writerValue(w, name) == 0) {
+		if(value) {
+			rpc_writeRaw(w, "true", 4);
+		} else {
+			rpc_writeRaw(w, "false", 5);
+		}
+	}
+}
+
+void rpc_writeInt(rpcWriter_t *w, const char *name, int32_t value)
+{
+	char buf[16];
+	if(rpc_writerValue(w, name) == 0) {
+		rpc_writeRaw(w, buf, snprintf(buf, sizeof(buf), "%d", value));
+	}
+}
+
+void rpc_writeDouble(rpcWriter_t *w, const char *name, double value)
+{
+	char buf[64];
+	int  len;
+
+	if(rpc_writerValue(w, name) != 0) {
+		return;
+	}
+	// same formatting as cJSON print_number
+	if(value <= INT_MAX && value >= INT_MIN && fabs((double)(int)value - value) <= DBL_EPSILON) {
+		len = snprintf(buf, sizeof(buf), "%d", (int)value);
+	} else if(fabs(floor(value) - value) <= DBL_EPSILON) {
+		len = snprintf(buf, sizeof(buf), "%.0f", value);
+	} else if(fabs(value) < 1.0e-6 || fabs(value) > 1.0e9) {
+		len = snprintf(buf, sizeof(buf), "%e", value);
+	} else {
+		len = snprintf(buf, sizeof(buf), "%f", value);
+	}
+	rpc_writeRaw(w, buf, len);
+}
+
+void rpc_writeString(rpcWriter_t *w, const char *name, const char *value)
+{
+	rpc_writeStringLen(w, name, value, value ? strlen(value) : 0);
+}
+
+void rpc_writeStringLen(rpcWriter_t *w, const char *name, const char *value, size_t len)
+{
+	if(rpc_writerValue(w, name) == 0) {
+		rpc_writerString(w, value, len);
+	}
+}
+
+void rpc_writeJson(rpcWriter_t *w, const char *name, cJSON *item)
+{
+	cJSON *child;
+
+	if(item == NULL) {
+		return;
+	}
+	switch(item->type & 0xff) {
+		case cJSON_False:  rpc_writeBool  (w, name, 0); break;
+		case cJSON_True:   rpc_writeBool  (w, name, 1); break;
+		case cJSON_NULL:   rpc_writeNull  (w, name);    break;
+		case cJSON_Number:
+			// cJSON keeps both representations, valueint is authoritative for integers
+			if(fabs((double)item->valueint - item->valuedouble) <= DBL_EPSILON) {
+				rpc_writeInt(w, name, item->valueint);
+			} else {
+				rpc_writeDouble(w, name, item->valuedouble);
+			}
+			break;
+		case cJSON_String: rpc_writeString(w, name, item->valuestring); break;
+		case cJSON_Array:
+			rpc_writeArrayBegin(w, name);
+			for(child = item->child; child; child = child->next) {
+				rpc_writeJson(w, NULL, child);
+			}
+			rpc_writeArrayEnd(w);
+			break;
+		case cJSON_Object:
+			rpc_writeObjectBegin(w, name);
+			for(child = item->child; child; child = child->next) {
+				rpc_writeJson(w, child->string ? child->string : "", child);
+			}
+			rpc_writeObjectEnd(w);
+			break;
+	}
+}
+
+void rpc_writeRequestBegin(rpcWriter_t *w, const char *cmd)
+{
+	w->first = 1;
+	rpc_writeObjectBegin(w, NULL);
+	rpc_writeString(w, "method", cmd);
+	rpc_writeArrayBegin(w, "params");
+}
+
+void rpc_writeRequestEnd(rpcWriter_t *w, int id)
+{
+	rpc_writeArrayEnd(w);
+	rpc_writeInt(w, "id", id);
+	rpc_writeObjectEnd(w);
+}